@@ -0,0 +1,71 @@
+#include <cstdio>
+#include <sys/time.h>
+#include <vector>
+
+// Native version of fannkuch.py
+static int fannkuch(int n) {
+    std::vector<int> count(n), perm1(n), perm(n);
+    for (int i = 0; i < n; i++) {
+        count[i] = i + 1;
+        perm1[i] = i;
+    }
+    int max_flips = 0;
+    int m = n - 1;
+    int r = n;
+
+    while (true) {
+        while (r != 1) {
+            count[r - 1] = r;
+            r--;
+        }
+
+        if (perm1[0] != 0 && perm1[m] != m) {
+            perm = perm1;
+            int flips_count = 0;
+            int k = perm[0];
+            while (k) {
+                for (int i = 0, j = k; i < j; i++, j--) {
+                    int t = perm[i];
+                    perm[i] = perm[j];
+                    perm[j] = t;
+                }
+                flips_count++;
+                k = perm[0];
+            }
+
+            if (flips_count > max_flips)
+                max_flips = flips_count;
+        }
+
+        while (true) {
+            if (r == n)
+                return max_flips;
+
+            // perm1.insert(r, perm1.pop(0))
+            int first = perm1[0];
+            for (int i = 0; i < r; i++)
+                perm1[i] = perm1[i + 1];
+            perm1[r] = first;
+
+            count[r]--;
+            if (count[r] > 0)
+                break;
+            r++;
+        }
+    }
+}
+
+static double now() {
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + .000001 * tv.tv_usec;
+}
+
+int main(int argc, char** argv) {
+    for (int i = 2; i < 11; i++) {
+        double t0 = now();
+        printf("%d\n", fannkuch(i));
+        printf("%.12g\n", now() - t0);
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// Native version of nbody.py
+static const double PI = 3.14159265358979323;
+static const double SOLAR_MASS = 4 * PI * PI;
+static const double DAYS_PER_YEAR = 365.24;
+
+struct Body {
+    double r[3], v[3], m;
+};
+
+static Body system_bodies[] = {
+    {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, SOLAR_MASS},
+
+    {{4.84143144246472090e+00, -1.16032004402742839e+00, -1.03622044471123109e-01},
+     {1.66007664274403694e-03 * DAYS_PER_YEAR, 7.69901118419740425e-03 * DAYS_PER_YEAR, -6.90460016972063023e-05 * DAYS_PER_YEAR},
+     9.54791938424326609e-04 * SOLAR_MASS},
+
+    {{8.34336671824457987e+00, 4.12479856412430479e+00, -4.03523417114321381e-01},
+     {-2.76742510726862411e-03 * DAYS_PER_YEAR, 4.99852801234917238e-03 * DAYS_PER_YEAR, 2.30417297573763929e-05 * DAYS_PER_YEAR},
+     2.85885980666130812e-04 * SOLAR_MASS},
+
+    {{1.28943695621391310e+01, -1.51111514016986312e+01, -2.23307578892655734e-01},
+     {2.96460137564761618e-03 * DAYS_PER_YEAR, 2.37847173959480950e-03 * DAYS_PER_YEAR, -2.96589568540237556e-05 * DAYS_PER_YEAR},
+     4.36624404335156298e-05 * SOLAR_MASS},
+
+    {{1.53796971148509165e+01, -2.59193146099879641e+01, 1.79258772950371181e-01},
+     {2.68067772490389322e-03 * DAYS_PER_YEAR, 1.62824170038242295e-03 * DAYS_PER_YEAR, -9.51592254519715870e-05 * DAYS_PER_YEAR},
+     5.15138902046611451e-05 * SOLAR_MASS},
+};
+static const int NUM_BODIES = sizeof(system_bodies) / sizeof(system_bodies[0]);
+
+static void advance(double dt, int n) {
+    for (int i = 0; i < n; i++) {
+        for (int a = 0; a < NUM_BODIES - 1; a++) {
+            for (int b = a + 1; b < NUM_BODIES; b++) {
+                Body &b1 = system_bodies[a], &b2 = system_bodies[b];
+                double dx = b1.r[0] - b2.r[0];
+                double dy = b1.r[1] - b2.r[1];
+                double dz = b1.r[2] - b2.r[2];
+                double mag = dt * pow(dx * dx + dy * dy + dz * dz, -1.5);
+                double b1m = b1.m * mag;
+                double b2m = b2.m * mag;
+                b1.v[0] -= dx * b2m;
+                b1.v[1] -= dy * b2m;
+                b1.v[2] -= dz * b2m;
+                b2.v[0] += dx * b1m;
+                b2.v[1] += dy * b1m;
+                b2.v[2] += dz * b1m;
+            }
+        }
+        for (int a = 0; a < NUM_BODIES; a++) {
+            Body &b = system_bodies[a];
+            b.r[0] += dt * b.v[0];
+            b.r[1] += dt * b.v[1];
+            b.r[2] += dt * b.v[2];
+        }
+    }
+}
+
+static double report_energy() {
+    double e = 0.0;
+    for (int a = 0; a < NUM_BODIES - 1; a++) {
+        for (int b = a + 1; b < NUM_BODIES; b++) {
+            Body &b1 = system_bodies[a], &b2 = system_bodies[b];
+            double dx = b1.r[0] - b2.r[0];
+            double dy = b1.r[1] - b2.r[1];
+            double dz = b1.r[2] - b2.r[2];
+            e -= (b1.m * b2.m) / pow(dx * dx + dy * dy + dz * dz, 0.5);
+        }
+    }
+    for (int a = 0; a < NUM_BODIES; a++) {
+        Body &b = system_bodies[a];
+        e += b.m * (b.v[0] * b.v[0] + b.v[1] * b.v[1] + b.v[2] * b.v[2]) / 2.;
+    }
+    return e;
+}
+
+static void offset_momentum(Body &ref, double px, double py, double pz) {
+    for (int a = 0; a < NUM_BODIES; a++) {
+        Body &b = system_bodies[a];
+        px -= b.v[0] * b.m;
+        py -= b.v[1] * b.m;
+        pz -= b.v[2] * b.m;
+    }
+    ref.v[0] = px / ref.m;
+    ref.v[1] = py / ref.m;
+    ref.v[2] = pz / ref.m;
+}
+
+static const int NUMBER_OF_ITERATIONS = 20000;
+
+int main(int argc, char** argv) {
+    // nbody.py uses BODIES[2], which is the second one:
+    Body &ref = system_bodies[1];
+    for (int i = 0; i < 40; i++) {
+        offset_momentum(ref, 0.0, 0.0, 0.0);
+        double e1 = report_energy();
+        advance(0.01, NUMBER_OF_ITERATIONS);
+        printf("%.12g\n", e1 - report_energy());
+    }
+    return 0;
+}
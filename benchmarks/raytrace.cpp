@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// Native version of raytrace.py, down to its quirks (ex the halfspace intersection time, and the
+// checkerboard's discarded scale), so that it renders the same picture.
+static const double EPSILON = 0.00001;
+static const double INF = 1.0e9;
+
+struct Vector {
+    double x, y, z;
+    Vector(double x, double y, double z) : x(x), y(y), z(z) {}
+
+    double magnitude() const {
+        return sqrt(dot(*this));
+    }
+    Vector operator+(const Vector &other) const {
+        return Vector(x + other.x, y + other.y, z + other.z);
+    }
+    Vector operator-(const Vector &other) const {
+        return Vector(x - other.x, y - other.y, z - other.z);
+    }
+    Vector scale(double factor) const {
+        return Vector(factor * x, factor * y, factor * z);
+    }
+    double dot(const Vector &other) const {
+        return (x * other.x) + (y * other.y) + (z * other.z);
+    }
+    Vector cross(const Vector &other) const {
+        return Vector(y * other.z - z * other.y, z * other.x - x * other.z, x * other.y - y * other.x);
+    }
+    Vector normalized() const {
+        return scale(1.0 / magnitude());
+    }
+    Vector reflectThrough(const Vector &normal) const {
+        Vector d = normal.scale(dot(normal));
+        return *this - d.scale(2);
+    }
+};
+
+static const Vector VUP(0, 1, 0);
+static const Vector PZERO(0, 0, 0);
+
+struct Ray {
+    Vector point, vector;
+    Ray(const Vector &point, const Vector &vector) : point(point), vector(vector.normalized()) {}
+
+    Vector pointAtTime(double t) const {
+        return point + vector.scale(t);
+    }
+};
+
+struct Colour {
+    double r, g, b;
+    Colour(double r, double g, double b) : r(r), g(g), b(b) {}
+};
+
+static Colour addColours(const Colour &a, double scale, const Colour &b) {
+    return Colour(a.r + scale * b.r, a.g + scale * b.g, a.b + scale * b.b);
+}
+
+struct PpmCanvas {
+    std::vector<unsigned char> bytes;
+    int width, height;
+    const char* filename;
+
+    PpmCanvas(int width, int height, const char* filename) : bytes(width * height * 3, 0), width(width), height(height), filename(filename) {
+        for (int i = 0; i < width * height; i++)
+            bytes[i * 3 + 2] = 255;
+    }
+
+    static unsigned char clamp(double c) {
+        return std::max(0, std::min(255, (int)(c * 255)));
+    }
+
+    void plot(int x, int y, const Colour &c) {
+        int i = ((height - y - 1) * width + x) * 3;
+        bytes[i] = clamp(c.r);
+        bytes[i + 1] = clamp(c.g);
+        bytes[i + 2] = clamp(c.b);
+    }
+
+    void save() {
+        FILE* f = fopen(filename, "wb");
+        fprintf(f, "P6 %d %d 255\n", width, height);
+        fwrite(&bytes[0], 1, bytes.size(), f);
+        fclose(f);
+    }
+};
+
+struct Object {
+    bool is_sphere;
+    // the sphere's centre, or the halfspace's point:
+    Vector point;
+    double radius;
+    Vector normal;
+
+    static Object sphere(const Vector &centre, double radius) {
+        return Object(true, centre, radius, Vector(0, 0, 0));
+    }
+    static Object halfspace(const Vector &point, const Vector &normal) {
+        return Object(false, point, 0, normal.normalized());
+    }
+
+    double intersectionTime(const Ray &ray) const {
+        if (is_sphere) {
+            Vector cp = point - ray.point;
+            double v = cp.dot(ray.vector);
+            double discriminant = (radius * radius) - (cp.dot(cp) - v * v);
+            if (discriminant < 0)
+                return INF + 1;
+            return v - sqrt(discriminant);
+        }
+
+        double v = ray.vector.dot(normal);
+        if (v)
+            return 1 / -v;
+        return INF + 1;
+    }
+
+    Vector normalAt(const Vector &p) const {
+        if (is_sphere)
+            return (p - point).normalized();
+        return normal;
+    }
+
+private:
+    Object(bool is_sphere, const Vector &point, double radius, const Vector &normal) : is_sphere(is_sphere), point(point), radius(radius), normal(normal) {}
+};
+
+struct Scene;
+
+struct Surface {
+    bool checkerboard;
+    Colour base_colour, other_colour;
+    double specular_coefficient, lambert_coefficient, ambient_coefficient;
+
+    Surface(const Colour &base_colour, bool checkerboard) : checkerboard(checkerboard), base_colour(base_colour), other_colour(0.0, 0.0, 0.0),
+            specular_coefficient(0.2), lambert_coefficient(0.6), ambient_coefficient(1.0 - 0.2 - 0.6) {}
+
+    Colour baseColourAt(const Vector &p) const {
+        if (!checkerboard)
+            return base_colour;
+
+        Vector v = p - PZERO;
+        if (((int)(fabs(v.x) + 0.5) + (int)(fabs(v.y) + 0.5) + (int)(fabs(v.z) + 0.5)) % 2)
+            return other_colour;
+        return base_colour;
+    }
+
+    Colour colourAt(Scene &scene, const Ray &ray, const Vector &p, const Vector &normal) const;
+};
+
+struct SceneObject {
+    Object object;
+    Surface surface;
+    SceneObject(const Object &object, const Surface &surface) : object(object), surface(surface) {}
+};
+
+struct Scene {
+    std::vector<SceneObject> objects;
+    std::vector<Vector> light_points;
+    Vector position, looking_at;
+    double field_of_view;
+    int recursion_depth;
+
+    Scene() : position(0, 1.8, 10), looking_at(PZERO), field_of_view(45), recursion_depth(0) {}
+
+    void render(PpmCanvas &canvas) {
+        double fov_radians = M_PI * (field_of_view / 2.0) / 180.0;
+        double half_width = tan(fov_radians);
+        double half_height = 0.75 * half_width;
+        double width = half_width * 2;
+        double height = half_height * 2;
+        double pixel_width = width / (canvas.width - 1);
+        double pixel_height = height / (canvas.height - 1);
+
+        Ray eye(position, looking_at - position);
+        Vector vp_right = eye.vector.cross(VUP).normalized();
+        Vector vp_up = vp_right.cross(eye.vector).normalized();
+
+        double previous_fraction = 0.0;
+        for (int y = 0; y < canvas.height; y++) {
+            double current_fraction = 1.0 * y / canvas.height;
+            if (current_fraction - previous_fraction > 0.05) {
+                printf("%d%% complete\n", (int)(current_fraction * 100));
+                previous_fraction = current_fraction;
+            }
+            for (int x = 0; x < canvas.width; x++) {
+                Vector xcomp = vp_right.scale(x * pixel_width - half_width);
+                Vector ycomp = vp_up.scale(y * pixel_height - half_height);
+                Ray ray(eye.point, eye.vector + xcomp + ycomp);
+                canvas.plot(x, y, rayColour(ray));
+            }
+        }
+
+        printf("Complete.\n");
+        canvas.save();
+    }
+
+    Colour rayColour(const Ray &ray) {
+        if (recursion_depth > 3)
+            return Colour(0.0, 0.0, 0.0);
+
+        recursion_depth++;
+        int found = 0;
+        double found_t = INF + 1;
+        for (int i = 0; i < objects.size(); i++) {
+            double t = objects[i].object.intersectionTime(ray);
+            if (t < INF && t > -EPSILON) {
+                if (found_t > INF || t < found_t) {
+                    found = i;
+                    found_t = t;
+                }
+            }
+        }
+
+        if (found_t > INF) {
+            recursion_depth--;
+            return Colour(0.0, 0.0, 0.0);
+        }
+
+        const SceneObject &o = objects[found];
+        Vector p = ray.pointAtTime(found_t);
+        Colour r = o.surface.colourAt(*this, ray, p, o.object.normalAt(p));
+        recursion_depth--;
+        return r;
+    }
+
+    bool lightIsVisible(const Vector &l, const Vector &p) const {
+        for (const SceneObject &o : objects) {
+            double t = o.object.intersectionTime(Ray(p, l - p));
+            if (t < INF && t > EPSILON)
+                return false;
+        }
+        return true;
+    }
+};
+
+Colour Surface::colourAt(Scene &scene, const Ray &ray, const Vector &p, const Vector &normal) const {
+    Colour b = baseColourAt(p);
+
+    Colour c(0.0, 0.0, 0.0);
+    if (specular_coefficient > 0) {
+        Ray reflected_ray(p, ray.vector.reflectThrough(normal));
+        Colour reflected_colour = scene.rayColour(reflected_ray);
+        c = addColours(c, specular_coefficient, reflected_colour);
+    }
+
+    if (lambert_coefficient > 0) {
+        double lambert_amount = 0.0;
+        for (const Vector &light_point : scene.light_points) {
+            if (!scene.lightIsVisible(light_point, p))
+                continue;
+            double contribution = (light_point - p).normalized().dot(normal);
+            if (contribution > 0)
+                lambert_amount = lambert_amount + contribution;
+        }
+        lambert_amount = std::min(1.0, lambert_amount);
+        c = addColours(c, lambert_coefficient * lambert_amount, b);
+    }
+
+    if (ambient_coefficient > 0)
+        c = addColours(c, ambient_coefficient, b);
+
+    return c;
+}
+
+int main(int argc, char** argv) {
+    PpmCanvas c(640, 480, "test_raytrace_big.ppm");
+    Scene s;
+    s.light_points.push_back(Vector(30, 30, 10));
+    s.light_points.push_back(Vector(-10, 100, 30));
+    s.looking_at = Vector(0, 2, 0);
+
+    Surface surf(Colour(1.0, 1.0, 0.0), false);
+    surf.specular_coefficient = 0.5;
+    surf.lambert_coefficient = 0.5;
+    surf.ambient_coefficient = 0.0;
+    s.objects.push_back(SceneObject(Object::sphere(Vector(1, 3, -10), 2), surf));
+    for (int y = 0; y < 6; y++) {
+        s.objects.push_back(SceneObject(Object::sphere(Vector(-3 - y * 0.4, 2.3, -5), 0.4),
+                    Surface(Colour(y / 6.0, 1 - y / 6.0, 0.5), false)));
+    }
+    s.objects.push_back(SceneObject(Object::halfspace(PZERO, VUP), Surface(Colour(1.0, 1.0, 1.0), true)));
+
+    s.render(c);
+    return 0;
+}
@@ -27,6 +27,8 @@ struct PyMethodDef {
 typedef struct PyMethodDef PyMethodDef;
 
 #define METH_VARARGS  0x0001
+#define METH_NOARGS   0x0004
+#define METH_O        0x0008
 
 #ifdef __cplusplus
 #define PyMODINIT_FUNC extern "C" void
@@ -0,0 +1,47 @@
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Native version of dict_ops.py
+static long strKeys(int n) {
+    std::vector<std::string> keys;
+    for (int i = 0; i < n; i++)
+        keys.push_back("key" + std::to_string(i));
+
+    std::unordered_map<std::string, long> d;
+    for (auto &k : keys)
+        d[k] = k.size();
+
+    long total = 0;
+    for (int r = 0; r < 10; r++) {
+        for (auto &k : keys)
+            total += d[k];
+    }
+    for (auto &p : d)
+        total += p.second;
+    return total;
+}
+
+static long intKeys(int n) {
+    std::unordered_map<long, long> d;
+    for (long i = 0; i < n; i++)
+        d[i * 7] = i;
+
+    long total = 0;
+    for (int r = 0; r < 10; r++) {
+        for (long i = 0; i < n; i++)
+            total += d[i * 7];
+    }
+    for (auto &p : d)
+        total += p.first;
+    for (auto &p : d)
+        total += p.second;
+    return total;
+}
+
+int main(int argc, char** argv) {
+    printf("%ld\n", strKeys(200000));
+    printf("%ld\n", intKeys(200000));
+    return 0;
+}
@@ -0,0 +1,36 @@
+# Dict insertion, lookup and iteration, with str and with int keys.
+
+def str_keys(n):
+    keys = []
+    for i in xrange(n):
+        keys.append("key" + str(i))
+
+    d = {}
+    for k in keys:
+        d[k] = len(k)
+
+    total = 0
+    for r in xrange(10):
+        for k in keys:
+            total = total + d[k]
+    for k, v in d.iteritems():
+        total = total + v
+    return total
+
+def int_keys(n):
+    d = {}
+    for i in xrange(n):
+        d[i * 7] = i
+
+    total = 0
+    for r in xrange(10):
+        for i in xrange(n):
+            total = total + d[i * 7]
+    for k in d.iterkeys():
+        total = total + k
+    for v in d.itervalues():
+        total = total + v
+    return total
+
+print str_keys(200000)
+print int_keys(200000)
@@ -0,0 +1,13 @@
+#include <cstdio>
+
+// Native version of fib.py
+static long fib(long n) {
+    if (n <= 2)
+        return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+int main(int argc, char** argv) {
+    printf("%ld\n", fib(36));
+    return 0;
+}
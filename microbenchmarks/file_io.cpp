@@ -0,0 +1,53 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Native version of file_io.py
+static const char* FN = "/tmp/pyston_file_io_bench.txt";
+
+static void write(int n) {
+    FILE* f = fopen(FN, "w");
+    for (int i = 0; i < n; i++) {
+        std::string s = "line number " + std::to_string(i) + " of the benchmark file\n";
+        fwrite(s.data(), 1, s.size(), f);
+    }
+    fclose(f);
+}
+
+static long read(int reps) {
+    long total = 0;
+    char* line = NULL;
+    size_t cap = 0;
+    for (int r = 0; r < reps; r++) {
+        FILE* f = fopen(FN, "r");
+        std::string all;
+        char buf[4096];
+        size_t nread;
+        while ((nread = fread(buf, 1, sizeof(buf), f)) > 0)
+            all.append(buf, nread);
+        total += all.size();
+        fclose(f);
+
+        f = fopen(FN, "r");
+        std::vector<std::string> lines;
+        ssize_t len;
+        while ((len = getline(&line, &cap, f)) != -1)
+            lines.push_back(std::string(line, len));
+        total += lines.size();
+        fclose(f);
+
+        f = fopen(FN, "r");
+        while ((len = getline(&line, &cap, f)) != -1)
+            total += len;
+        fclose(f);
+    }
+    free(line);
+    return total;
+}
+
+int main(int argc, char** argv) {
+    write(500000);
+    printf("%ld\n", read(5));
+    return 0;
+}
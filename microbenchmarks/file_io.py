@@ -0,0 +1,29 @@
+# Writing a file line by line, and reading it back in whole, as lines, and by iterating.
+
+FN = "/tmp/pyston_file_io_bench.txt"
+
+def write(n):
+    f = open(FN, "w")
+    for i in xrange(n):
+        f.write("line number " + str(i) + " of the benchmark file\n")
+    f.close()
+
+def read(reps):
+    total = 0
+    for r in xrange(reps):
+        f = open(FN)
+        total = total + len(f.read())
+        f.close()
+
+        f = open(FN)
+        total = total + len(f.readlines())
+        f.close()
+
+        f = open(FN)
+        for l in f:
+            total = total + len(l)
+        f.close()
+    return total
+
+write(500000)
+print read(5)
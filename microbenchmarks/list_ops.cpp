@@ -0,0 +1,46 @@
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+// Native version of list_ops.py
+static long appendSlice(int n) {
+    std::vector<long> l;
+    for (int i = 0; i < n; i++)
+        l.push_back(i);
+
+    long total = 0;
+    for (int r = 0; r < 20; r++) {
+        for (int i = 0; i < n / 100 - 1; i++) {
+            std::vector<long> s(l.begin() + i * 100, l.begin() + std::min(n, i * 100 + 150));
+            total += s.size() + s[0];
+        }
+    }
+    return total;
+}
+
+static long sort(int n) {
+    std::vector<long> l;
+    long x = 1;
+    for (int i = 0; i < n; i++) {
+        x = (x * 1103515245 + 12345) % 2147483648;
+        l.push_back(x);
+    }
+
+    long total = 0;
+    std::vector<long> m;
+    for (int r = 0; r < 20; r++) {
+        m = l;
+        std::sort(m.begin(), m.end());
+        total += m[0] + m[n / 2] + m[n - 1];
+    }
+    // Sorting an already-sorted list:
+    std::sort(m.begin(), m.end());
+    total += m[n / 3];
+    return total;
+}
+
+int main(int argc, char** argv) {
+    printf("%ld\n", appendSlice(1000000));
+    printf("%ld\n", sort(100000));
+    return 0;
+}
@@ -0,0 +1,33 @@
+# List appends, slicing and sorting.
+
+def append_slice(n):
+    l = []
+    for i in xrange(n):
+        l.append(i)
+
+    total = 0
+    for r in xrange(20):
+        for i in xrange(n / 100 - 1):
+            s = l[i * 100:i * 100 + 150]
+            total = total + len(s) + s[0]
+    return total
+
+def sort(n):
+    l = []
+    x = 1
+    for i in xrange(n):
+        x = (x * 1103515245 + 12345) % 2147483648
+        l.append(x)
+
+    total = 0
+    for r in xrange(20):
+        m = l[0:n]
+        m.sort()
+        total = total + m[0] + m[n / 2] + m[n - 1]
+    # Sorting an already-sorted list:
+    m.sort()
+    total = total + m[n / 3]
+    return total
+
+print append_slice(1000000)
+print sort(100000)
@@ -0,0 +1,31 @@
+#include <cstdio>
+#include <vector>
+
+// Native version of sort.py
+static void sort(std::vector<long> &l) {
+    int n = l.size();
+    for (int i = 0; i < n; i++) {
+        printf("%d\n", i);
+        for (int j = 0; j < i; j++) {
+            if (l[i] < l[j]) {
+                long t = l[i];
+                l[i] = l[j];
+                l[j] = t;
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const int N = 5000;
+    std::vector<long> l;
+    for (int i = 0; i < N; i++)
+        l.push_back(N - i);
+    sort(l);
+
+    printf("[");
+    for (int i = 0; i < N; i++)
+        printf(i ? ", %ld" : "%ld", l[i]);
+    printf("]\n");
+    return 0;
+}
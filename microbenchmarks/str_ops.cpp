@@ -0,0 +1,66 @@
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Native version of str_ops.py
+static long concat(int n) {
+    long total = 0;
+    for (int i = 0; i < n; i++) {
+        std::string s = "abc" + std::to_string(i) + "defgh";
+        total += s.size();
+    }
+    return total;
+}
+
+static long join(int n) {
+    std::vector<std::string> parts;
+    for (int i = 0; i < 100; i++)
+        parts.push_back(std::to_string(i));
+
+    long total = 0;
+    for (int i = 0; i < n; i++) {
+        std::string s;
+        for (int j = 0; j < parts.size(); j++) {
+            if (j)
+                s += ',';
+            s += parts[j];
+        }
+        total += s.size();
+    }
+    return total;
+}
+
+static long formatting(int n) {
+    long total = 0;
+    char buf[80];
+    for (int i = 0; i < n; i++) {
+        std::string s(buf, snprintf(buf, sizeof(buf), "%s: %d items", "name", i));
+        total += s.size();
+    }
+    return total;
+}
+
+static long hashing(int n) {
+    std::vector<std::string> strs;
+    for (int i = 0; i < 1000; i++)
+        strs.push_back("some string " + std::to_string(i));
+
+    std::hash<std::string> hash;
+    long same = 0;
+    for (int r = 0; r < n / 1000; r++) {
+        for (auto &s : strs) {
+            if (hash(s) == hash(s + ""))
+                same++;
+        }
+    }
+    return same;
+}
+
+int main(int argc, char** argv) {
+    printf("%ld\n", concat(1000000));
+    printf("%ld\n", join(50000));
+    printf("%ld\n", formatting(1000000));
+    printf("%ld\n", hashing(1000000));
+    return 0;
+}
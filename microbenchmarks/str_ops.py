@@ -0,0 +1,44 @@
+# String concatenation, joining, %-formatting and hashing.
+
+def concat(n):
+    total = 0
+    for i in xrange(n):
+        s = "abc" + str(i) + "defgh"
+        total = total + len(s)
+    return total
+
+def join(n):
+    parts = []
+    for i in xrange(100):
+        parts.append(str(i))
+
+    total = 0
+    for i in xrange(n):
+        s = ",".join(parts)
+        total = total + len(s)
+    return total
+
+def formatting(n):
+    total = 0
+    for i in xrange(n):
+        s = "%s: %d items" % ("name", i)
+        total = total + len(s)
+    return total
+
+def hashing(n):
+    strs = []
+    for i in xrange(1000):
+        strs.append("some string " + str(i))
+
+    # The values differ between implementations, so just check that they're consistent:
+    same = 0
+    for r in xrange(n / 1000):
+        for s in strs:
+            if hash(s) == hash(s + ""):
+                same = same + 1
+    return same
+
+print concat(1000000)
+print join(50000)
+print formatting(1000000)
+print hashing(1000000)
@@ -0,0 +1,29 @@
+#include <cstdio>
+#include <tuple>
+#include <utility>
+
+// Native version of tuple_ops.py
+static std::pair<long, long> divmod_(long a, long b) {
+    return std::make_pair(a / b, a % b);
+}
+
+static long tuples(long n) {
+    long total = 0;
+    long x = 0, y = 1;
+    for (long i = 0; i < n; i++) {
+        std::tuple<long, long, long> t(i, i + 1, i + 2);
+        long a, b, c;
+        std::tie(a, b, c) = t;
+        total += a - b + c;
+        std::tie(x, y) = std::make_pair(y, x);
+        long q, r;
+        std::tie(q, r) = divmod_(i, 7);
+        total += q + r + x;
+    }
+    return total;
+}
+
+int main(int argc, char** argv) {
+    printf("%ld\n", tuples(3000000));
+    return 0;
+}
@@ -0,0 +1,19 @@
+# Tuple creation, unpacking and returning multiple values.
+
+def divmod_(a, b):
+    return a / b, a % b
+
+def tuples(n):
+    total = 0
+    x = 0
+    y = 1
+    for i in xrange(n):
+        t = (i, i + 1, i + 2)
+        a, b, c = t
+        total = total + a - b + c
+        x, y = y, x
+        q, r = divmod_(i, 7)
+        total = total + q + r + x
+    return total
+
+print tuples(3000000)
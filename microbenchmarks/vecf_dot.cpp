@@ -0,0 +1,29 @@
+#include <cstdio>
+
+// Native version of vecf_dot.py
+struct Vector {
+    double x, y, z;
+    Vector(double x, double y, double z) : x(x), y(y), z(z) {}
+
+    Vector operator+(const Vector &rhs) const {
+        return Vector(x + rhs.x, y + rhs.y, z + rhs.z);
+    }
+
+    double dot(const Vector &rhs) const {
+        return x * rhs.x + y * rhs.y + z * rhs.z;
+    }
+};
+
+static double f(long n) {
+    Vector v(0, 0.1, 0);
+    Vector a(1.0, 1.1, 1.2);
+    double t = 0;
+    for (long i = 0; i < n; i++)
+        t = t + v.dot(a);
+    return t;
+}
+
+int main(int argc, char** argv) {
+    printf("%.12g\n", f(10000000));
+    return 0;
+}
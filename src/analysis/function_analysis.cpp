@@ -16,7 +16,7 @@
 #include <cstdlib>
 
 #include <unordered_set>
-#include <deque>
+#include <vector>
 
 #include "core/common.h"
 
@@ -24,7 +24,6 @@
 #include "core/cfg.h"
 #include "core/util.h"
 
-#include "analysis/fpc.h"
 #include "analysis/function_analysis.h"
 #include "analysis/scoping_analysis.h"
 
@@ -54,13 +53,23 @@ class LivenessBBVisitor : public NoopASTVisitor {
         const StrSet& stores() { return _stores; }
 
         bool visit_classdef(AST_ClassDef* node) {
+            // The defaults of the methods get evaluated here:
+            for (AST_stmt* s : node->body) {
+                if (s->type == AST_TYPE::FunctionDef)
+                    visitVector(static_cast<AST_FunctionDef*>(s)->args->defaults);
+            }
             _doStore(node->name);
             return true;
         }
         bool visit_functiondef(AST_FunctionDef* node) {
+            visitVector(node->args->defaults);
             _doStore(node->name);
             return true;
         }
+        void visitVector(const std::vector<AST_expr*> &exprs) {
+            for (AST_expr* e : exprs)
+                e->accept(this);
+        }
         bool visit_name(AST_Name* node) {
             if (node->ctx_type == AST_TYPE::Load)
                 _doLoad(node->id);
@@ -74,72 +83,118 @@ class LivenessBBVisitor : public NoopASTVisitor {
         }
 };
 
-bool LivenessAnalysis::isLiveAtEnd(const std::string &name, CFGBlock *block) {
-    if (block->successors.size() == 0)
-        return false;
+void VarSet::unionWith(const VarSet &rhs) {
+    assert(words.size() == rhs.words.size());
+    for (int i = 0; i < words.size(); i++)
+        words[i] |= rhs.words[i];
+}
 
-    // Very inefficient liveness analysis:
-    // for each query, trace forward through all possible control flow paths.
-    // if we hit a store to the name, stop tracing that path
-    // if we hit a load to the name, return true.
-    std::unordered_set<CFGBlock*> visited;
-    std::deque<CFGBlock*> q;
-    for (int i = 0; i < block->successors.size(); i++) {
-        q.push_back(block->successors[i]);
-    }
+void VarSet::intersectWith(const VarSet &rhs) {
+    assert(words.size() == rhs.words.size());
+    for (int i = 0; i < words.size(); i++)
+        words[i] &= rhs.words[i];
+}
 
-    while(q.size()) {
-        CFGBlock* thisblock = q.front();
-        q.pop_front();
-        if (visited.count(thisblock))
-            continue;
-        visited.insert(thisblock);
+void VarSet::unionWithout(const VarSet &rhs, const VarSet &minus) {
+    assert(words.size() == rhs.words.size());
+    assert(words.size() == minus.words.size());
+    for (int i = 0; i < words.size(); i++)
+        words[i] |= rhs.words[i] & ~minus.words[i];
+}
+
+static int getNameIdx(std::unordered_map<std::string, int> &name_idxs, const std::string &name) {
+    std::unordered_map<std::string, int>::iterator it = name_idxs.find(name);
+    if (it != name_idxs.end())
+        return it->second;
+    int idx = name_idxs.size();
+    name_idxs[name] = idx;
+    return idx;
+}
+
+LivenessAnalysis::LivenessAnalysis(CFG* cfg) {
+    int nblocks = cfg->blocks.size();
+
+    // Loads that aren't preceded by a store in the same block, and stores that aren't preceded by a load:
+    std::vector<std::vector<int> > block_loads(nblocks), block_stores(nblocks);
+    for (int i = 0; i < nblocks; i++) {
+        CFGBlock* block = cfg->blocks[i];
+        assert(block->idx == i);
 
         LivenessBBVisitor visitor;
-        for (int i = 0; i < thisblock->body.size(); i++) {
-            thisblock->body[i]->accept(&visitor);
+        for (int j = 0; j < block->body.size(); j++) {
+            block->body[j]->accept(&visitor);
         }
-        if (visitor.loads().count(name))
-            return true;
-        if (!visitor.stores().count(name)) {
-            for (int i = 0; i < thisblock->successors.size(); i++) {
-                q.push_back(thisblock->successors[i]);
+        for (const std::string &name : visitor.loads())
+            block_loads[i].push_back(getNameIdx(name_idxs, name));
+        for (const std::string &name : visitor.stores())
+            block_stores[i].push_back(getNameIdx(name_idxs, name));
+    }
+
+    int nvars = name_idxs.size();
+    std::vector<VarSet> gen, kill;
+    for (int i = 0; i < nblocks; i++) {
+        gen.push_back(VarSet(nvars, false));
+        for (int idx : block_loads[i])
+            gen.back().insert(idx);
+        kill.push_back(VarSet(nvars, false));
+        for (int idx : block_stores[i])
+            kill.back().insert(idx);
+    }
+
+    std::vector<VarSet> live_in(nblocks, VarSet(nvars, false));
+    live_out.assign(nblocks, VarSet(nvars, false));
+
+    // Everything starts on the worklist, with the last blocks on top since information flows backwards;
+    // after that a block only gets looked at again if one of its successors changed.
+    std::vector<int> q;
+    std::vector<bool> in_queue(nblocks, true);
+    for (int i = 0; i < nblocks; i++)
+        q.push_back(i);
+
+    while (q.size()) {
+        int idx = q.back();
+        q.pop_back();
+        in_queue[idx] = false;
+
+        CFGBlock* block = cfg->blocks[idx];
+        VarSet &out = live_out[idx];
+        for (int i = 0; i < block->successors.size(); i++) {
+            out.unionWith(live_in[block->successors[i]->idx]);
+        }
+
+        VarSet in(gen[idx]);
+        in.unionWithout(out, kill[idx]);
+        if (in == live_in[idx])
+            continue;
+        live_in[idx] = in;
+
+        for (int i = 0; i < block->predecessors.size(); i++) {
+            int pred_idx = block->predecessors[i]->idx;
+            if (!in_queue[pred_idx]) {
+                in_queue[pred_idx] = true;
+                q.push_back(pred_idx);
             }
         }
     }
-
-    return false;
 }
 
-class DefinednessBBAnalyzer : public BBAnalyzer<DefinednessAnalysis::DefinitionLevel> {
-    private:
-        typedef DefinednessAnalysis::DefinitionLevel DefinitionLevel;
+bool LivenessAnalysis::isLiveAtEnd(const std::string &name, CFGBlock *block) {
+    std::unordered_map<std::string, int>::iterator it = name_idxs.find(name);
+    // Never loaded anywhere in the function:
+    if (it == name_idxs.end())
+        return false;
 
-        AST_arguments* arguments;
-    public:
-        DefinednessBBAnalyzer(AST_arguments* arguments) : arguments(arguments) {
-        }
+    assert(block->idx >= 0 && block->idx < live_out.size());
+    return live_out[block->idx].contains(it->second);
+}
 
-        virtual DefinitionLevel merge(DefinitionLevel from, DefinitionLevel into) const {
-            assert(from != DefinednessAnalysis::Undefined);
-            assert(into != DefinednessAnalysis::Undefined);
-            if (from == DefinednessAnalysis::PotentiallyDefined || into == DefinednessAnalysis::PotentiallyDefined)
-                return DefinednessAnalysis::PotentiallyDefined;
-            return DefinednessAnalysis::Defined;
-        }
-        virtual void processBB(Map &starting, CFGBlock *block) const;
-        virtual DefinitionLevel mergeBlank(DefinitionLevel into) const {
-            assert(into != DefinednessAnalysis::Undefined);
-            return DefinednessAnalysis::PotentiallyDefined;
-        }
-};
 class DefinednessVisitor : public ASTVisitor {
     private:
-        typedef DefinednessBBAnalyzer::Map Map;
-        Map &state;
+        // The names that get assigned to, in order (and possibly with repeats):
+        std::vector<std::string> &assigned;
 
         void _doSet(const std::string &s) {
-            state[s] = DefinednessAnalysis::Defined;
+            assigned.push_back(s);
         }
 
         void _doSet(AST* t) {
@@ -164,7 +219,7 @@ class DefinednessVisitor : public ASTVisitor {
             }
         }
     public:
-        DefinednessVisitor(Map &state) : state(state) {
+        DefinednessVisitor(std::vector<std::string> &assigned) : assigned(assigned) {
         }
 
         virtual bool visit_branch(AST_Branch* node) { return true; }
@@ -213,39 +268,108 @@ class DefinednessVisitor : public ASTVisitor {
             return true;
         }
 };
-void DefinednessBBAnalyzer::processBB(Map &starting, CFGBlock *block) const {
-    DefinednessVisitor visitor(starting);
-    for (int i = 0; i < block->body.size(); i++) {
-        block->body[i]->accept(&visitor);
+DefinednessAnalysis::DefinednessAnalysis(AST_arguments *args, CFG* cfg, ScopeInfo *scope_info) : scope_info(scope_info) {
+    int nblocks = cfg->blocks.size();
+
+    std::vector<std::vector<int> > block_defs(nblocks);
+    for (int i = 0; i < nblocks; i++) {
+        CFGBlock* block = cfg->blocks[i];
+        assert(block->idx == i);
+
+        std::vector<std::string> assigned;
+        DefinednessVisitor visitor(assigned);
+        for (int j = 0; j < block->body.size(); j++) {
+            block->body[j]->accept(&visitor);
+        }
+        if (i == 0 && args) {
+            args->accept(&visitor);
+        }
+        for (const std::string &name : assigned)
+            block_defs[i].push_back(getNameIdx(name_idxs, name));
     }
-    if (block->idx == 0 && arguments) {
-        arguments->accept(&visitor);
+
+    int nvars = name_idxs.size();
+    maybe_defined.assign(nblocks, VarSet(nvars, false));
+    must_defined.assign(nblocks, VarSet(nvars, true));
+
+    // Forwards from the entry block.  Predecessors that we haven't reached yet don't get merged in,
+    // and unreachable blocks end up with nothing defined.
+    std::vector<bool> reached(nblocks, false);
+    std::vector<int> q;
+    std::vector<bool> in_queue(nblocks, false);
+    q.push_back(0);
+    in_queue[0] = true;
+
+    while (q.size()) {
+        int idx = q.back();
+        q.pop_back();
+        in_queue[idx] = false;
+
+        CFGBlock* block = cfg->blocks[idx];
+        VarSet maybe(nvars, false), must(nvars, true);
+        bool any_preds = false;
+        for (int i = 0; i < block->predecessors.size(); i++) {
+            int pred_idx = block->predecessors[i]->idx;
+            if (!reached[pred_idx])
+                continue;
+            any_preds = true;
+            maybe.unionWith(maybe_defined[pred_idx]);
+            must.intersectWith(must_defined[pred_idx]);
+        }
+        if (!any_preds)
+            must = VarSet(nvars, false);
+
+        for (int var_idx : block_defs[idx]) {
+            maybe.insert(var_idx);
+            must.insert(var_idx);
+        }
+
+        if (reached[idx] && maybe == maybe_defined[idx] && must == must_defined[idx])
+            continue;
+        reached[idx] = true;
+        maybe_defined[idx] = maybe;
+        must_defined[idx] = must;
+
+        for (int i = 0; i < block->successors.size(); i++) {
+            int succ_idx = block->successors[i]->idx;
+            if (!in_queue[succ_idx]) {
+                in_queue[succ_idx] = true;
+                q.push_back(succ_idx);
+            }
+        }
     }
-}
 
-DefinednessAnalysis::DefinednessAnalysis(AST_arguments *args, CFG* cfg, ScopeInfo *scope_info) : scope_info(scope_info) {
-    results = computeFixedPoint(cfg, DefinednessBBAnalyzer(args), false);
+    std::vector<const std::string*> names(nvars);
+    for (std::unordered_map<std::string, int>::iterator it = name_idxs.begin(), end = name_idxs.end(); it != end; ++it)
+        names[it->second] = &it->first;
+
+    for (int i = 0; i < nblocks; i++) {
+        if (!reached[i])
+            continue;
 
-    for (std::unordered_map<CFGBlock*, std::unordered_map<std::string, DefinitionLevel> >::iterator
-            it = results.begin(), end = results.end(); it != end; ++it) {
         RequiredSet required;
-        for (std::unordered_map<std::string, DefinitionLevel>::iterator it2 = it->second.begin(), end2 = it->second.end();
-                it2 != end2; ++it2) {
-            if (scope_info->refersToGlobal(it2->first))
+        for (int var_idx = 0; var_idx < nvars; var_idx++) {
+            if (!maybe_defined[i].contains(var_idx))
                 continue;
-
-            //printf("%d %s %d\n", it->first->idx, it2->first.c_str(), it2->second);
-            required.insert(it2->first);
+            if (scope_info->refersToGlobal(*names[var_idx]))
+                continue;
+            required.insert(*names[var_idx]);
         }
-        defined.insert(make_pair(it->first, required));
+        defined.insert(make_pair(cfg->blocks[i], required));
     }
 }
 
 DefinednessAnalysis::DefinitionLevel DefinednessAnalysis::isDefinedAt(const std::string &name, CFGBlock *block) {
-    std::unordered_map<std::string, DefinitionLevel> &map = results[block];
-    if (map.count(name) == 0)
+    std::unordered_map<std::string, int>::iterator it = name_idxs.find(name);
+    if (it == name_idxs.end())
+        return Undefined;
+
+    assert(block->idx >= 0 && block->idx < maybe_defined.size());
+    if (!maybe_defined[block->idx].contains(it->second))
         return Undefined;
-    return map[name];
+    if (must_defined[block->idx].contains(it->second))
+        return Defined;
+    return PotentiallyDefined;
 }
 
 const DefinednessAnalysis::RequiredSet& DefinednessAnalysis::getDefinedNamesAt(CFGBlock *block) {
@@ -307,8 +431,8 @@ bool PhiAnalysis::isPotentiallyUndefinedAfter(const std::string &name, CFGBlock*
     return dlevel == DefinednessAnalysis::PotentiallyDefined;
 }
 
-LivenessAnalysis* computeLivenessInfo(CFG*) {
-    return new LivenessAnalysis();
+LivenessAnalysis* computeLivenessInfo(CFG* cfg) {
+    return new LivenessAnalysis(cfg);
 }
 
 PhiAnalysis* computeRequiredPhis(AST_arguments* args, CFG* cfg, LivenessAnalysis* liveness, ScopeInfo *scope_info) {
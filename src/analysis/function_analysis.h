@@ -15,7 +15,11 @@
 #ifndef PYSTON_ANALYSIS_FUNCTIONANALYSIS_H
 #define PYSTON_ANALYSIS_FUNCTIONANALYSIS_H
 
+#include <cstdint>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 namespace pyston {
 
@@ -25,8 +29,36 @@ class CFG;
 class CFGBlock;
 class ScopeInfo;
 
+// A set of a function's variables, as a bitvector over the dense indices that an analysis gave them.
+class VarSet {
+    private:
+        std::vector<uint64_t> words;
+
+    public:
+        VarSet(int num_vars, bool full) : words((num_vars + 63) / 64, full ? ~0ULL : 0ULL) {}
+
+        bool contains(int idx) const { return (words[idx / 64] >> (idx % 64)) & 1; }
+        void insert(int idx) { words[idx / 64] |= 1ULL << (idx % 64); }
+
+        void unionWith(const VarSet &rhs);
+        void intersectWith(const VarSet &rhs);
+        // this |= (rhs - minus)
+        void unionWithout(const VarSet &rhs, const VarSet &minus);
+
+        bool operator==(const VarSet &rhs) const { return words == rhs.words; }
+        bool operator!=(const VarSet &rhs) const { return words != rhs.words; }
+};
+
 class LivenessAnalysis {
+    private:
+        // Every name that gets loaded or stored in the function:
+        std::unordered_map<std::string, int> name_idxs;
+        // Indexed by block idx:
+        std::vector<VarSet> live_out;
+
     public:
+        LivenessAnalysis(CFG* cfg);
+
         bool isLiveAtEnd(const std::string &name, CFGBlock *block);
 };
 class DefinednessAnalysis {
@@ -39,7 +71,10 @@ class DefinednessAnalysis {
         typedef std::unordered_set<std::string> RequiredSet;
 
     private:
-        std::unordered_map<CFGBlock*, std::unordered_map<std::string, DefinitionLevel> > results;
+        std::unordered_map<std::string, int> name_idxs;
+        // Indexed by block idx, and describing the end of the block: a name is PotentiallyDefined if
+        // it's in maybe_defined, and Defined if it's in must_defined as well.
+        std::vector<VarSet> maybe_defined, must_defined;
         std::unordered_map<CFGBlock*, const RequiredSet> defined;
         ScopeInfo *scope_info;
 
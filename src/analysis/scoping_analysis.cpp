@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+
 #include "core/common.h"
 
 #include "core/ast.h"
@@ -52,6 +54,16 @@ class ModuleScopeInfo : public ScopeInfo {
         virtual bool saveInClosure(const std::string name) {
             return false;
         }
+
+        virtual int getClosureSize() {
+            return 0;
+        }
+        virtual int getClosureSlot(const std::string &name) {
+            RELEASE_ASSERT(0, "%s", name.c_str());
+        }
+        virtual void getClosureLookup(const std::string &name, int *depth, int *slot) {
+            RELEASE_ASSERT(0, "%s", name.c_str());
+        }
 };
 
 struct ScopingAnalysis::ScopeNameUsage {
@@ -68,8 +80,16 @@ struct ScopingAnalysis::ScopeNameUsage {
     // Properties determined by looking at other scopes as well:
     StrSet referenced_from_nested;
     StrSet got_from_closure;
+    // Whether this scope has to pass along a closure for nested scopes, even if it doesn't refer to
+    // anything in it itself:
+    bool passes_closure;
+
+    // The closure layout: slots for the referenced_from_nested names, and where to find the
+    // got_from_closure ones (as a depth and a slot).
+    std::unordered_map<std::string, int> closure_slots;
+    std::unordered_map<std::string, std::pair<int, int> > closure_lookups;
 
-    ScopeNameUsage(AST* node, ScopeNameUsage* parent) : node(node), parent(parent) {
+    ScopeNameUsage(AST* node, ScopeNameUsage* parent) : node(node), parent(parent), passes_closure(false) {
     }
 };
 
@@ -92,13 +112,11 @@ class ScopeInfoBase : public ScopeInfo {
         }
 
         virtual bool createsClosure() {
-            assert(0);
             return usage->referenced_from_nested.size() > 0;
         }
 
         virtual bool takesClosure() {
-            assert(0);
-            return false;
+            return usage->got_from_closure.size() > 0 || usage->passes_closure;
         }
 
         virtual bool refersToGlobal(const std::string &name) {
@@ -122,6 +140,21 @@ class ScopeInfoBase : public ScopeInfo {
                 return false;
             return usage->referenced_from_nested.count(name) != 0;
         }
+
+        virtual int getClosureSize() {
+            return usage->closure_slots.size();
+        }
+        virtual int getClosureSlot(const std::string &name) {
+            std::unordered_map<std::string, int>::iterator it = usage->closure_slots.find(name);
+            RELEASE_ASSERT(it != usage->closure_slots.end(), "%s", name.c_str());
+            return it->second;
+        }
+        virtual void getClosureLookup(const std::string &name, int *depth, int *slot) {
+            std::unordered_map<std::string, std::pair<int, int> >::iterator it = usage->closure_lookups.find(name);
+            RELEASE_ASSERT(it != usage->closure_lookups.end(), "%s", name.c_str());
+            *depth = it->second.first;
+            *slot = it->second.second;
+        }
 };
 
 class NameCollectorVisitor : public ASTVisitor {
@@ -161,7 +194,16 @@ class NameCollectorVisitor : public ASTVisitor {
             return true;
         }
 
-        virtual bool visit_arguments(AST_arguments *node) { return false; }
+        virtual bool visit_arguments(AST_arguments *node) {
+            // The defaults belong to the parent scope (see visit_functiondef):
+            for (AST_expr* e : node->args)
+                e->accept(this);
+            if (node->vararg.size())
+                doWrite(node->vararg);
+            if (node->kwarg)
+                node->kwarg->accept(this);
+            return true;
+        }
         virtual bool visit_assign(AST_Assign *node) { return false; }
         virtual bool visit_attribute(AST_Attribute *node) { return false; }
         virtual bool visit_binop(AST_BinOp *node) { return false; }
@@ -172,6 +214,7 @@ class NameCollectorVisitor : public ASTVisitor {
         //virtual bool visit_classdef(AST_ClassDef *node) { return false; }
         virtual bool visit_continue(AST_Continue *node) { return false; }
         virtual bool visit_dict(AST_Dict *node) { return false; }
+        virtual bool visit_excepthandler(AST_ExceptHandler *node) { return false; }
         virtual bool visit_expr(AST_Expr *node) { return false; }
         virtual bool visit_for(AST_For *node) { return false; }
         //virtual bool visit_functiondef(AST_FunctionDef *node) { return false; }
@@ -185,10 +228,13 @@ class NameCollectorVisitor : public ASTVisitor {
         virtual bool visit_num(AST_Num *node) { return false; }
         virtual bool visit_pass(AST_Pass *node) { return false; }
         virtual bool visit_print(AST_Print *node) { return false; }
+        virtual bool visit_raise(AST_Raise *node) { return false; }
         virtual bool visit_return(AST_Return *node) { return false; }
         virtual bool visit_slice(AST_Slice *node) { return false; }
         virtual bool visit_str(AST_Str *node) { return false; }
         virtual bool visit_subscript(AST_Subscript *node) { return false; }
+        virtual bool visit_tryexcept(AST_TryExcept *node) { return false; }
+        virtual bool visit_tryfinally(AST_TryFinally *node) { return false; }
         virtual bool visit_tuple(AST_Tuple *node) { return false; }
         virtual bool visit_unaryop(AST_UnaryOp *node) { return false; }
         virtual bool visit_while(AST_While *node) { return false; }
@@ -221,6 +267,8 @@ class NameCollectorVisitor : public ASTVisitor {
             if (node == orig_node) {
                 return false;
             } else {
+                for (AST_expr* e : node->args->defaults)
+                    e->accept(this);
                 doWrite(node->name);
                 (*map)[node] = new ScopingAnalysis::ScopeNameUsage(node, cur);
                 collect(node, map);
@@ -297,6 +345,12 @@ void ScopingAnalysis::processNameUsages(ScopingAnalysis::NameUsageMap* usages) {
                 } else if (parent->written.count(*it2)) {
                     usage->got_from_closure.insert(*it2);
                     parent->referenced_from_nested.insert(*it2);
+                    // Class bodies don't get closures of their own; their methods get the one from
+                    // the enclosing function:
+                    for (ScopeNameUsage *s = usage->parent; s != parent; s = s->parent) {
+                        if (s->node->type != AST_TYPE::ClassDef)
+                            s->passes_closure = true;
+                    }
                     break;
                 } else {
                     parent = parent->parent;
@@ -306,6 +360,35 @@ void ScopingAnalysis::processNameUsages(ScopingAnalysis::NameUsageMap* usages) {
     }
 
 
+    // Lay out the closures.  The slots go in name order, so that they don't depend on how the
+    // names happened to get hashed:
+    for (ScopingAnalysis::NameUsageMap::iterator it = usages->begin(), end = usages->end();
+            it != end; ++it) {
+        ScopeNameUsage *usage = it->second;
+        std::vector<std::string> names(usage->referenced_from_nested.begin(), usage->referenced_from_nested.end());
+        std::sort(names.begin(), names.end());
+        for (int i = 0; i < names.size(); i++)
+            usage->closure_slots[names[i]] = i;
+    }
+
+    for (ScopingAnalysis::NameUsageMap::iterator it = usages->begin(), end = usages->end();
+            it != end; ++it) {
+        ScopeNameUsage *usage = it->second;
+        for (StrSet::iterator it2 = usage->got_from_closure.begin(), end2 = usage->got_from_closure.end();
+                it2 != end2; ++it2) {
+            // Every scope that creates a closure on the way up is one more parent link:
+            int depth = usage->referenced_from_nested.size() ? 1 : 0;
+            ScopeNameUsage *parent = usage->parent;
+            while (parent->node->type == AST_TYPE::ClassDef || !parent->written.count(*it2)) {
+                if (parent->node->type != AST_TYPE::ClassDef && parent->referenced_from_nested.size())
+                    depth++;
+                parent = parent->parent;
+                assert(parent);
+            }
+            usage->closure_lookups[*it2] = std::make_pair(depth, parent->closure_slots[*it2]);
+        }
+    }
+
     std::vector<ScopeNameUsage*> sorted_usages = sortNameUsages(usages);
 
     // Construct the public-facing ScopeInfo's from the analyzed data:
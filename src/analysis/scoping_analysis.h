@@ -26,12 +26,23 @@ class ScopeInfo {
         virtual ~ScopeInfo() {}
         virtual ScopeInfo* getParent() = 0;
 
+        // A scope creates a closure if nested scopes refer to any of its variables, and takes one if
+        // it (or something nested in it) refers to variables of enclosing scopes.  The code of a scope
+        // works with a single closure: the one it creates, if it does, whose parent is the one it took.
         virtual bool createsClosure() = 0;
         virtual bool takesClosure() = 0;
 
         virtual bool refersToGlobal(const std::string &name) = 0;
         virtual bool refersToClosure(const std::string name) = 0;
         virtual bool saveInClosure(const std::string name) = 0;
+
+        // The number of slots in the closure that this scope creates, and which one a saveInClosure name
+        // goes in:
+        virtual int getClosureSize() = 0;
+        virtual int getClosureSlot(const std::string &name) = 0;
+        // For a refersToClosure name: how many parent links to follow from the closure that this scope's
+        // code works with, and the slot in the closure that that gets to.
+        virtual void getClosureLookup(const std::string &name, int *depth, int *slot) = 0;
 };
 
 class ScopingAnalysis {
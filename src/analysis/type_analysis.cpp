@@ -12,11 +12,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <cstdio>
 #include <deque>
 #include <unordered_set>
 
 #include "core/options.h"
+#include "core/stats.h"
 
 #include "core/ast.h"
 #include "core/cfg.h"
@@ -24,6 +26,9 @@
 #include "analysis/scoping_analysis.h"
 #include "analysis/type_analysis.h"
 
+#include "codegen/type_recording.h"
+#include "codegen/irgen/tiering.h"
+
 #include "runtime/types.h"
 
 //#undef VERBOSITY
@@ -63,10 +68,31 @@ static BoxedClass* simpleCallSpeculation(AST_Call* node, CompilerType* rtn_type,
 
     if (node->func->type == AST_TYPE::Name && static_cast<AST_Name*>(node->func)->id == "xrange")
         return xrange_cls;
+    // (irgen does the common cases of this inline, and unboxed)
+    if (node->func->type == AST_TYPE::Name && static_cast<AST_Name*>(node->func)->id == "len")
+        return int_cls;
+    // (same for sum() of something that's known to be an xrange)
+    if (node->func->type == AST_TYPE::Name && static_cast<AST_Name*>(node->func)->id == "sum"
+            && arg_types.size() == 1 && arg_types[0]->getConcreteType() == typeFromClass(xrange_cls))
+        return int_cls;
 
     //if (node->func->type == AST_TYPE::Attribute && static_cast<AST_Attribute*>(node->func)->attr == "dot")
         //return float_cls;
 
+    // irgen can call the unboxed versions of these directly, once it's speculating on a float result:
+    if (node->func->type == AST_TYPE::Attribute) {
+        AST_Attribute* attr = static_cast<AST_Attribute*>(node->func);
+        if (attr->value->type == AST_TYPE::Name && static_cast<AST_Name*>(attr->value)->id == "math"
+                && (attr->attr == "sqrt" || attr->attr == "tan"))
+            return float_cls;
+        if (attr->value->type == AST_TYPE::Name && static_cast<AST_Name*>(attr->value)->id == "time") {
+            if (attr->attr == "time" || attr->attr == "perf_counter" || attr->attr == "monotonic")
+                return float_cls;
+            if (attr->attr == "hwcounter_read")
+                return int_cls;
+        }
+    }
+
     return NULL;
 }
 
@@ -74,6 +100,7 @@ typedef std::unordered_map<std::string, CompilerType*> TypeMap;
 typedef std::unordered_map<int, TypeMap> AllTypeMap;
 typedef std::unordered_map<AST_expr*, CompilerType*> ExprTypeMap;
 typedef std::unordered_map<AST_expr*, BoxedClass*> TypeSpeculations;
+typedef std::unordered_set<AST_expr*> SpeculationSet;
 class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
     private:
         static const bool EXPAND_UNNEEDED = true;
@@ -84,8 +111,11 @@ class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
         TypeSpeculations &type_speculations;
         TypeAnalysis::SpeculationLevel speculation;
         ScopeInfo *scope_info;
+        TypeFeedback *feedback;
+        // If set, the only expressions that we're allowed to speculate on:
+        const SpeculationSet *allowed_speculations;
 
-        BasicBlockTypePropagator(CFGBlock *block, TypeMap &initial, ExprTypeMap &expr_types, TypeSpeculations &type_speculations, TypeAnalysis::SpeculationLevel speculation, ScopeInfo *scope_info) : block(block), sym_table(initial), expr_types(expr_types), type_speculations(type_speculations), speculation(speculation), scope_info(scope_info) {}
+        BasicBlockTypePropagator(CFGBlock *block, TypeMap &initial, ExprTypeMap &expr_types, TypeSpeculations &type_speculations, TypeAnalysis::SpeculationLevel speculation, ScopeInfo *scope_info, TypeFeedback *feedback, const SpeculationSet *allowed_speculations) : block(block), sym_table(initial), expr_types(expr_types), type_speculations(type_speculations), speculation(speculation), scope_info(scope_info), feedback(feedback), allowed_speculations(allowed_speculations) {}
 
         void run() {
             for (int i = 0; i < block->body.size(); i++) {
@@ -97,6 +127,14 @@ class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
             assert(old_type);
             assert(speculation != TypeAnalysis::NONE);
 
+            if (feedback && feedback->speculationFailed(node))
+                return old_type;
+            // No point in paying for a guard in code that the lower tiers never ran:
+            if (feedback && feedback->isColdBlock(block))
+                return old_type;
+            if (allowed_speculations && allowed_speculations->count(node) == 0)
+                return old_type;
+
             if (speculated_cls != NULL) {
                 ConcreteCompilerType* speculated_type = unboxedType(typeFromClass(speculated_cls));
                 if (VERBOSITY() >= 2) {
@@ -113,6 +151,20 @@ class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
             return old_type;
         }
 
+        // Speculate based on what the lower tiers saw, for things that we otherwise know nothing about:
+        CompilerType* processFeedback(AST_expr* node, CompilerType* old_type) {
+            if (speculation == TypeAnalysis::NONE || feedback == NULL || old_type != UNKNOWN)
+                return old_type;
+
+            BoxedClass* predicted = feedback->predictClassFor(node);
+            if (predicted == NULL)
+                return old_type;
+
+            static StatCounter num_feedback_speculations("type_feedback_speculations");
+            num_feedback_speculations.log();
+            return processSpeculation(predicted, node, old_type);
+        }
+
         CompilerType* getType(AST_expr* node) {
             type_speculations.erase(node);
 
@@ -164,6 +216,7 @@ class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
             //if (speculation != TypeAnalysis::NONE && (node->attr == "x" || node->attr == "y" || node->attr == "z")) {
                 //rtn = processSpeculation(float_cls, node, rtn);
             //}
+            rtn = processFeedback(node, rtn);
 
             if (VERBOSITY() >= 2 && rtn == UNDEF) {
                 printf("Think %s.%s is undefined, at %d:%d\n", t->debugName().c_str(), node->attr.c_str(), node->lineno, node->col_offset);
@@ -184,6 +237,28 @@ class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
             return rtn;
         }
 
+        virtual void* visit_langprimitive(AST_LangPrimitive *node) {
+            switch (node->opcode) {
+                case AST_LangPrimitive::ITER_NEXT: {
+                    // irgen calls the iterator's next directly if it knows the type, so this is what
+                    // that returns (and otherwise UNKNOWN, for a boxed value or NULL):
+                    CompilerType *t = getType(node->args[0]);
+                    std::vector<CompilerType*> arg_types;
+                    return t->getattrType("next")->callType(arg_types);
+                }
+                case AST_LangPrimitive::ITER_HAS_VALUE:
+                    getType(node->args[1]);
+                    return BOOL;
+                case AST_LangPrimitive::RAISE:
+                    for (int i = 0; i < node->args.size(); i++)
+                        getType(node->args[i]);
+                    // (it doesn't return)
+                    return UNKNOWN;
+                default:
+                    RELEASE_ASSERT(0, "%d", node->opcode);
+            }
+        }
+
         virtual void* visit_binop(AST_BinOp *node) {
             CompilerType *left = getType(node->left);
             CompilerType *right = getType(node->right);
@@ -200,7 +275,18 @@ class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
                 ASSERT((rtn == left || rtn == UNDEF) && "not strictly required but probably something worth looking into", "%s %s", name.c_str(), rtn->debugName().c_str());
             }
 
-            return rtn;
+            // These can overflow into a long, so an int result is only a speculation (which irgen checks by
+            // deopting when they do overflow); without one, they get done boxed.
+            if (left == INT && right == INT && (node->op_type == AST_TYPE::Add || node->op_type == AST_TYPE::Sub
+                        || node->op_type == AST_TYPE::Mult || node->op_type == AST_TYPE::Pow)) {
+                if (speculation == TypeAnalysis::NONE)
+                    return UNKNOWN;
+                if (feedback && feedback->predictClassFor(node) != NULL && feedback->predictClassFor(node) != int_cls)
+                    return UNKNOWN;
+                return processSpeculation(int_cls, node, UNKNOWN);
+            }
+
+            return processFeedback(node, rtn);
         }
 
         virtual void* visit_boolop(AST_BoolOp *node) {
@@ -221,13 +307,20 @@ class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
         virtual void* visit_call(AST_Call *node) {
             assert(!node->starargs);
             assert(!node->kwargs);
-            assert(node->keywords.size() == 0);
             CompilerType* func = getType(node->func);
 
             std::vector<CompilerType*> arg_types;
             for (int i = 0; i < node->args.size(); i++) {
                 arg_types.push_back(getType(node->args[i]));
             }
+
+            // These go through runtimeCallKeywords, which doesn't know any more about what it returns:
+            if (node->keywords.size()) {
+                for (int i = 0; i < node->keywords.size(); i++) {
+                    getType(node->keywords[i]->value);
+                }
+                return UNKNOWN;
+            }
             CompilerType *rtn_type = func->callType(arg_types);
 
             // Should be unboxing things before getting here:
@@ -236,7 +329,10 @@ class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
 
             if (speculation != TypeAnalysis::NONE) {
                 BoxedClass* speculated_rtn_cls = simpleCallSpeculation(node, rtn_type, arg_types);
-                rtn_type = processSpeculation(speculated_rtn_cls, node, rtn_type);
+                if (speculated_rtn_cls)
+                    rtn_type = processSpeculation(speculated_rtn_cls, node, rtn_type);
+                else
+                    rtn_type = processFeedback(node, rtn_type);
             }
 
             return rtn_type;
@@ -252,6 +348,9 @@ class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
                 assert(node->ops.size() == 1 && "I don't think this should happen");
                 return BOOL;
             }
+            // These are looked up on the rhs, not the lhs:
+            if (node->ops[0] == AST_TYPE::In || node->ops[0] == AST_TYPE::NotIn)
+                return UNKNOWN;
             std::string name = getOpName(node->ops[0]);
             CompilerType *attr_type = left->getattrType(name);
             std::vector<CompilerType*> arg_types;
@@ -279,6 +378,8 @@ class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
                 }
                 return UNKNOWN;
             }
+            if (scope_info->refersToClosure(node->id))
+                return UNKNOWN;
 
             CompilerType* &t = sym_table[node->id];
             if (t == NULL) {
@@ -288,6 +389,8 @@ class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
                 }
                 t = UNDEF;
             }
+            if (block->getCFG()->speculated_loads.count(node))
+                return processFeedback(node, t);
             return t;
         }
 
@@ -315,7 +418,7 @@ class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
             CompilerType *getitem_type = val->getattrType("__getitem__");
             std::vector<CompilerType*> args;
             args.push_back(slice);
-            return getitem_type->callType(args);
+            return processFeedback(node, getitem_type->callType(args));
         }
 
         virtual void* visit_tuple(AST_Tuple *node) {
@@ -353,6 +456,15 @@ class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
         }
 
         virtual void visit_classdef(AST_ClassDef *node) {
+            for (int i = 0; i < node->body.size(); i++) {
+                if (node->body[i]->type == AST_TYPE::FunctionDef) {
+                    AST_FunctionDef *fdef = static_cast<AST_FunctionDef*>(node->body[i]);
+                    for (int j = 0; j < fdef->args->defaults.size(); j++) {
+                        getType(fdef->args->defaults[j]);
+                    }
+                }
+            }
+
             CompilerType *t = typeFromClass(type_cls);
             _doSet(node->name, t);
         }
@@ -365,6 +477,9 @@ class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
         }
 
         virtual void visit_functiondef(AST_FunctionDef *node) {
+            for (int i = 0; i < node->args->defaults.size(); i++) {
+                getType(node->args->defaults[i]);
+            }
             _doSet(node->name, typeFromClass(function_cls));
         }
 
@@ -402,9 +517,9 @@ class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
         }
 
     public:
-        static void propagate(CFGBlock *block, const TypeMap &starting, TypeMap &ending, ExprTypeMap &expr_types, TypeSpeculations &type_speculations, TypeAnalysis::SpeculationLevel speculation, ScopeInfo *scope_info) {
+        static void propagate(CFGBlock *block, const TypeMap &starting, TypeMap &ending, ExprTypeMap &expr_types, TypeSpeculations &type_speculations, TypeAnalysis::SpeculationLevel speculation, ScopeInfo *scope_info, TypeFeedback *feedback, const SpeculationSet *allowed_speculations) {
             ending.insert(starting.begin(), starting.end());
-            BasicBlockTypePropagator(block, ending, expr_types, type_speculations, speculation, scope_info).run();
+            BasicBlockTypePropagator(block, ending, expr_types, type_speculations, speculation, scope_info, feedback, allowed_speculations).run();
         }
 };
 
@@ -469,11 +584,7 @@ class PropagatingTypeAnalysis : public TypeAnalysis {
             return changed;
         }
 
-        static PropagatingTypeAnalysis* doAnalysis(CFG *cfg, const std::vector<AST_expr*> &arg_names, const std::vector<ConcreteCompilerType*> &arg_types, SpeculationLevel speculation, ScopeInfo *scope_info) {
-            AllTypeMap starting_types;
-            ExprTypeMap expr_types;
-            TypeSpeculations type_speculations;
-
+        static void propagateAll(CFG *cfg, const std::vector<AST_expr*> &arg_names, const std::vector<ConcreteCompilerType*> &arg_types, SpeculationLevel speculation, ScopeInfo *scope_info, TypeFeedback *feedback, const SpeculationSet *allowed_speculations, AllTypeMap &starting_types, ExprTypeMap &expr_types, TypeSpeculations &type_speculations) {
             assert(arg_names.size() == arg_types.size());
 
             {
@@ -511,7 +622,7 @@ class PropagatingTypeAnalysis : public TypeAnalysis {
                     }
                 }
 
-                BasicBlockTypePropagator::propagate(block, starting_types[block_id], ending, expr_types, type_speculations, speculation, scope_info);
+                BasicBlockTypePropagator::propagate(block, starting_types[block_id], ending, expr_types, type_speculations, speculation, scope_info, feedback, allowed_speculations);
 
                 if (VERBOSITY("types") >= 2) {
                     printf("before (after):\n");
@@ -549,6 +660,51 @@ class PropagatingTypeAnalysis : public TypeAnalysis {
                     }
                 }
             }
+        }
+
+        // Every speculation costs a guard (and a deopt path for it), so we only make as many as the
+        // function's budget allows, preferring the ones we've seen the most evidence for.  If the first
+        // pass went over the budget, we redo the analysis allowing only the best ones.
+        static PropagatingTypeAnalysis* doAnalysis(CFG *cfg, const std::vector<AST_expr*> &arg_names, const std::vector<ConcreteCompilerType*> &arg_types, SpeculationLevel speculation, ScopeInfo *scope_info, TypeFeedback *feedback) {
+            AllTypeMap starting_types;
+            ExprTypeMap expr_types;
+            TypeSpeculations type_speculations;
+
+            propagateAll(cfg, arg_names, arg_types, speculation, scope_info, feedback, NULL, starting_types, expr_types, type_speculations);
+
+            int budget = feedback ? feedback->speculationBudget() : getTieringPolicy()->speculation_budget;
+            if (type_speculations.size() > budget) {
+                std::vector<std::pair<int64_t, AST_expr*> > ranked;
+                for (TypeSpeculations::iterator it = type_speculations.begin(), end = type_speculations.end(); it != end; ++it) {
+                    // The ones that simpleCallSpeculation came up with don't have a recorder, and are
+                    // about as safe as it gets:
+                    int64_t observations = INT64_MAX;
+                    if (feedback && feedback->predictClassFor(it->first))
+                        observations = feedback->observationsFor(it->first);
+                    ranked.push_back(std::make_pair(observations, it->first));
+                }
+                // Break ties by position, so that the choice doesn't depend on pointer values:
+                std::sort(ranked.begin(), ranked.end(), [](const std::pair<int64_t, AST_expr*> &lhs, const std::pair<int64_t, AST_expr*> &rhs) {
+                    if (lhs.first != rhs.first)
+                        return lhs.first > rhs.first;
+                    if (lhs.second->lineno != rhs.second->lineno)
+                        return lhs.second->lineno < rhs.second->lineno;
+                    return lhs.second->col_offset < rhs.second->col_offset;
+                });
+
+                SpeculationSet allowed;
+                for (int i = 0; i < budget; i++)
+                    allowed.insert(ranked[i].second);
+
+                static StatCounter num_dropped("type_speculations_over_budget");
+                num_dropped.log(ranked.size() - budget);
+
+                starting_types.clear();
+                expr_types.clear();
+                type_speculations.clear();
+                propagateAll(cfg, arg_names, arg_types, speculation, scope_info, feedback, &allowed, starting_types, expr_types, type_speculations);
+                assert(type_speculations.size() <= budget);
+            }
 
             return new PropagatingTypeAnalysis(starting_types, expr_types, type_speculations, speculation);
         }
@@ -556,9 +712,9 @@ class PropagatingTypeAnalysis : public TypeAnalysis {
 
 
 // public entry point:
-TypeAnalysis* doTypeAnalysis(CFG *cfg, const std::vector<AST_expr*> &arg_names, const std::vector<ConcreteCompilerType*> &arg_types, TypeAnalysis::SpeculationLevel speculation, ScopeInfo *scope_info) {
+TypeAnalysis* doTypeAnalysis(CFG *cfg, const std::vector<AST_expr*> &arg_names, const std::vector<ConcreteCompilerType*> &arg_types, TypeAnalysis::SpeculationLevel speculation, ScopeInfo *scope_info, TypeFeedback *feedback) {
     //return new NullTypeAnalysis();
-    return PropagatingTypeAnalysis::doAnalysis(cfg, arg_names, arg_types, speculation, scope_info);
+    return PropagatingTypeAnalysis::doAnalysis(cfg, arg_names, arg_types, speculation, scope_info, feedback);
 }
 
 }
@@ -24,6 +24,7 @@
 namespace pyston {
 
 class ScopeInfo;
+class TypeFeedback;
 
 class TypeAnalysis {
     public:
@@ -40,7 +41,7 @@ class TypeAnalysis {
 };
 
 //TypeAnalysis* analyze(CFG *cfg, std::unordered_map<std::string, ConcreteCompilerType*> arg_types);
-TypeAnalysis* doTypeAnalysis(CFG *cfg, const std::vector<AST_expr*> &arg_names, const std::vector<ConcreteCompilerType*> &arg_types, TypeAnalysis::SpeculationLevel speculation, ScopeInfo *scope_info);
+TypeAnalysis* doTypeAnalysis(CFG *cfg, const std::vector<AST_expr*> &arg_names, const std::vector<ConcreteCompilerType*> &arg_types, TypeAnalysis::SpeculationLevel speculation, ScopeInfo *scope_info, TypeFeedback *feedback=NULL);
 
 }
 
@@ -107,8 +107,8 @@ void Assembler::emitArith(Immediate imm, Register r, int opcode) {
 
 
 void Assembler::emitByte(uint8_t b) {
-    assert(addr < end_addr);
-    *addr = b;
+    if (addr < end_addr)
+        *addr = b;
     ++addr;
 }
 
@@ -302,6 +302,50 @@ void Assembler::mov(Indirect src, Register dest) {
     }
 }
 
+void Assembler::movIndexed(Register base, Register index, int offset, Register dest) {
+    int rex = REX_W;
+
+    int base_idx = base.regnum;
+    int index_idx = index.regnum;
+    int dest_idx = dest.regnum;
+
+    if (base_idx >= 8) {
+        rex |= REX_B;
+        base_idx -= 8;
+    }
+    if (index_idx >= 8) {
+        rex |= REX_X;
+        index_idx -= 8;
+    }
+    if (dest_idx >= 8) {
+        rex |= REX_R;
+        dest_idx -= 8;
+    }
+    // That encoding means "no index":
+    assert(index.regnum != RSP.regnum);
+
+    emitRex(rex);
+    emitByte(0x8b); // opcode
+
+    // A base of rbp or r13 with no displacement would mean "no base", so those always get one:
+    int mode;
+    if (offset == 0 && base_idx != 0b101)
+        mode = 0b00;
+    else if (-0x80 <= offset && offset < 0x80)
+        mode = 0b01;
+    else
+        mode = 0b10;
+
+    emitModRM(mode, dest_idx, 0b100);
+    emitSIB(0b11, index_idx, base_idx);
+
+    if (mode == 0b01) {
+        emitByte(offset);
+    } else if (mode == 0b10) {
+        emitInt(offset, 4);
+    }
+}
+
 void Assembler::movsd(XMMRegister src, XMMRegister dest) {
     int rex = 0;
     int src_idx = src.regnum;
@@ -475,6 +519,14 @@ void Assembler::callq(Register r) {
     emitByte(0xd3);
 }
 
+void Assembler::call(JumpDestination dest) {
+    assert(dest.type == JumpDestination::FROM_START);
+    int offset = dest.offset - (addr - start_addr) - 5;
+
+    emitByte(0xe8);
+    emitInt((uint32_t)offset, 4);
+}
+
 
 
 void Assembler::cmp(Register reg1, Register reg2) {
@@ -487,7 +539,6 @@ void Assembler::cmp(Register reg1, Register reg2) {
         reg1_idx -= 8;
     }
     if (reg2_idx >= 8) {
-        trap();
         rex |= REX_B;
         reg2_idx -= 8;
     }
@@ -586,7 +637,6 @@ void Assembler::test(Register reg1, Register reg2) {
         reg1_idx -= 8;
     }
     if (reg2_idx >= 8) {
-        trap();
         rex |= REX_B;
         reg2_idx -= 8;
     }
@@ -640,6 +690,23 @@ void Assembler::jmp(JumpDestination dest) {
     }
 }
 
+void Assembler::jmp_cond_long(JumpDestination dest, ConditionCode condition) {
+    assert(dest.type == JumpDestination::FROM_START);
+    int offset = dest.offset - (addr - start_addr) - 6;
+
+    emitByte(0x0f);
+    emitByte(0x80 | condition);
+    emitInt((uint32_t)offset, 4);
+}
+
+void Assembler::jmp_long(JumpDestination dest) {
+    assert(dest.type == JumpDestination::FROM_START);
+    int offset = dest.offset - (addr - start_addr) - 5;
+
+    emitByte(0xe9);
+    emitInt((uint32_t)offset, 4);
+}
+
 void Assembler::jne(JumpDestination dest) {
     jmp_cond(dest, COND_NOT_EQUAL);
 }
@@ -727,13 +794,19 @@ void Assembler::emitBatchPop(StackInfo stack_info, const std::vector<GenericRegi
 }
 
 void Assembler::fillWithNops() {
-    assert(addr <= end_addr);
+    content_size = bytesWritten();
+    if (hasFailed())
+        return;
     memset(addr, 0x90, end_addr - addr);
     addr = end_addr;
 }
 
 void Assembler::fillWithNopsExcept(int bytes) {
-    assert(end_addr - addr >= bytes);
+    content_size = bytesWritten() + bytes;
+    if (end_addr - addr < bytes) {
+        addr += bytes;
+        return;
+    }
     memset(addr, 0x90, end_addr - addr - bytes);
     addr = end_addr - bytes;
 }
@@ -746,7 +819,7 @@ void Assembler::emitAnnotation(int num) {
 
 
 
-uint8_t* initializePatchpoint2(uint8_t* start_addr, uint8_t* slowpath_start, uint8_t* end_addr, StackInfo stack_info, const std::unordered_set<int> &live_outs) {
+uint8_t* initializePatchpoint2(uint8_t* start_addr, uint8_t* slowpath_start, uint8_t* end_addr, StackInfo stack_info, const LiveOutSet &live_outs, uint8_t* cold_start, int cold_size) {
     assert(start_addr < slowpath_start);
     static const int INITIAL_CALL_SIZE = 13;
     assert(end_addr > slowpath_start + INITIAL_CALL_SIZE);
@@ -799,15 +872,37 @@ uint8_t* initializePatchpoint2(uint8_t* start_addr, uint8_t* slowpath_start, uin
 
     Assembler assem(slowpath_start, end_addr - slowpath_start);
 
+    if (cold_start) {
+        Assembler cold(cold_start, cold_size);
+        cold.emitBatchPush(stack_info, regs_to_spill);
+        uint8_t* rtn = cold.emitCall(call_addr, R11);
+        cold.emitBatchPop(stack_info, regs_to_spill);
+        cold.jmp_long(JumpDestination::fromStart(end_addr - cold_start));
+        cold.fillWithNops();
+        RELEASE_ASSERT(!cold.hasFailed(), "");
+
+        assem.jmp_long(JumpDestination::fromStart(cold_start - slowpath_start));
+        // The stub comes back to end_addr, so this never gets run:
+        assem.fillWithNops();
+        return rtn;
+    }
+
     //if (regs_to_spill.size())
         //assem.trap();
     assem.emitBatchPush(stack_info, regs_to_spill);
     uint8_t* rtn = assem.emitCall(call_addr, R11);
     assem.emitBatchPop(stack_info, regs_to_spill);
     assem.fillWithNops();
+    RELEASE_ASSERT(!assem.hasFailed(), "");
 
     return rtn;
 }
 
+int coldSlowpathSize(const LiveOutSet &live_outs) {
+    // A spill or a restore is at most 9 bytes (a movsd with a 32-bit displacement), the call is 13,
+    // and the jump back is 5.
+    return live_outs.size() * 2 * 9 + 13 + 5;
+}
+
 }
 }
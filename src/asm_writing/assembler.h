@@ -52,6 +52,7 @@ class Assembler {
     private:
         uint8_t *const start_addr, *const end_addr;
         uint8_t *addr;
+        int content_size;
 
         static const uint8_t OPCODE_ADD = 0b000, OPCODE_SUB = 0b101;
         static const uint8_t REX_B = 1, REX_X = 2, REX_R = 4, REX_W = 8;
@@ -64,10 +65,13 @@ class Assembler {
         void emitArith(Immediate imm, Register reg, int opcode);
 
     public:
-        Assembler(uint8_t* start, int size) : start_addr(start), end_addr(start + size), addr(start_addr) {}
+        Assembler(uint8_t* start, int size) : start_addr(start), end_addr(start + size), addr(start_addr), content_size(-1) {}
 
         void nop() { emitByte(0x90); }
         void trap() { emitByte(0xcc); }
+        void ret() { emitByte(0xc3); }
+        void clc() { emitByte(0xf8); }
+        void stc() { emitByte(0xf9); }
 
         // some things (such as objdump) call this "movabs" if the immediate is 64-bit
         void mov(Immediate imm, Register dest);
@@ -77,6 +81,8 @@ class Assembler {
         void mov(Register src, Register dest);
         void mov(Register src, Indirect dest);
         void mov(Indirect src, Register dest);
+        // Loads from base + index * 8 + offset, ie an element of an array of words:
+        void movIndexed(Register base, Register index, int offset, Register dest);
         void movsd(XMMRegister src, XMMRegister dest);
         void movsd(XMMRegister src, Indirect dest);
         void movsd(Indirect src, XMMRegister dest);
@@ -90,6 +96,8 @@ class Assembler {
         void inc(Indirect mem);
 
         void callq(Register reg);
+        // A call with a 32-bit relative offset:
+        void call(JumpDestination dest);
 
         void cmp(Register reg1, Register reg2);
         void cmp(Register reg, Immediate imm);
@@ -102,6 +110,10 @@ class Assembler {
         void jmp(JumpDestination dest);
         void je(JumpDestination dest);
         void jne(JumpDestination dest);
+        // Always use the 32-bit offset form, so the size doesn't depend on the destination (for when
+        // it isn't known yet):
+        void jmp_long(JumpDestination dest);
+        void jmp_cond_long(JumpDestination dest, ConditionCode condition);
 
         void set_cond(Register reg, ConditionCode condition);
         void sete(Register reg);
@@ -119,9 +131,19 @@ class Assembler {
         void emitAnnotation(int num);
 
         bool isExactlyFull() { return addr == end_addr; }
+        int bytesWritten() { return addr - start_addr; }
+        // Once the code runs past the end of the buffer, it stops getting written but still gets counted,
+        // so that the caller can tell that it didn't fit, and how much space it would have needed:
+        bool hasFailed() { return addr > end_addr; }
+        // The space the code needs, not counting the nop padding that the fillWithNops calls add:
+        int bytesNeeded() { return content_size >= 0 ? content_size : bytesWritten(); }
 };
 
-uint8_t* initializePatchpoint2(uint8_t* start_addr, uint8_t* slowpath_start, uint8_t* end_addr, StackInfo stack_info, const std::unordered_set<int> &live_outs);
+// If cold_start is non-NULL, the spills and the slowpath call get written there instead, followed by a jump
+// back to end_addr, and the slowpath region of the patchpoint just jumps to them.  cold_size has to be
+// at least coldSlowpathSize(live_outs).
+uint8_t* initializePatchpoint2(uint8_t* start_addr, uint8_t* slowpath_start, uint8_t* end_addr, StackInfo stack_info, const LiveOutSet &live_outs, uint8_t* cold_start = NULL, int cold_size = 0);
+int coldSlowpathSize(const LiveOutSet &live_outs);
 
 }
 }
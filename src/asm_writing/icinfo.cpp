@@ -12,15 +12,22 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <cstring>
 #include <memory>
+#include <string>
+#include <unordered_map>
 
 #include "llvm/Support/Memory.h"
 
+#include "codegen/codegen.h"
+#include "codegen/memmgr.h"
 #include "codegen/patchpoints.h"
 
 #include "core/common.h"
 #include "core/options.h"
+#include "core/stats.h"
+#include "core/trace.h"
 #include "core/types.h"
 
 #include "asm_writing/assembler.h"
@@ -52,6 +59,7 @@ void ICInvalidator::invalidateAll() {
 
 
 void ICSlotInfo::clear() {
+    ic->num_invalidations++;
     ic->clear(this);
 }
 
@@ -68,6 +76,51 @@ ICSlotRewrite::~ICSlotRewrite() {
     free(buf);
 }
 
+// Rewrites whose code came out byte-for-byte the same, keyed by the code and the slot size (since that's
+// where the guards jump to).  The first one of each gets to keep its code in its slot, and the later
+// ones call a shared copy instead.
+static std::unordered_map<std::string, uint8_t*> shared_stubs;
+// Anything smaller isn't worth replacing with the call + checks:
+static const int MIN_SHARED_STUB_SIZE = 24;
+
+static uint8_t* getSharedStub(uint8_t* code, int size, int slot_size) {
+    if (size < MIN_SHARED_STUB_SIZE)
+        return NULL;
+
+    std::string key((char*)code, size);
+    key.append((char*)&slot_size, sizeof(slot_size));
+
+    auto it = shared_stubs.find(key);
+    if (it == shared_stubs.end()) {
+        shared_stubs[key] = NULL;
+        return NULL;
+    }
+    if (it->second) {
+        static StatCounter sc_shared("ic_shared_stub_uses");
+        sc_shared.log();
+        return it->second;
+    }
+
+    // The code stays at the same offsets that it had in the slot, so that the guards' jumps to the end of
+    // the slot land on the failure exit:
+    int stub_size = slot_size + 2;
+    uint8_t* stub = allocateStubCode(stub_size);
+    memcpy(stub, code, size);
+
+    Assembler assem(stub + size, stub_size - size);
+    assem.clc();
+    assem.ret();
+    assem.fillWithNopsExcept(2);
+    assem.stc();
+    assem.ret();
+    assert(assem.isExactlyFull());
+
+    static StatCounter sc_stubs("ic_shared_stubs");
+    sc_stubs.log();
+    it->second = stub;
+    return stub;
+}
+
 void ICSlotRewrite::commit(uint64_t decision_path, CommitHook *hook) {
     bool still_valid = true;
     for (int i = 0; i < dependencies.size(); i++) {
@@ -83,26 +136,81 @@ void ICSlotRewrite::commit(uint64_t decision_path, CommitHook *hook) {
         return;
     }
 
+    if (assembler->hasFailed()) {
+        noteTooBig();
+        return;
+    }
+
     ICSlotInfo *ic_entry = ic->pickEntryForRewrite(decision_path, debug_name);
     if (ic_entry == NULL)
         return;
 
-    for (int i = 0; i < dependencies.size(); i++) {
-        ICInvalidator *invalidator = dependencies[i].first;
-        invalidator->addDependent(ic_entry);
-    }
-
     uint8_t* slot_start = (uint8_t*)ic->start_addr + ic_entry->idx * ic->getSlotSize();
     uint8_t* continue_point = (uint8_t*)ic->continue_addr;
 
-    hook->finishAssembly(continue_point - slot_start);
+    uint8_t* stub = NULL;
+    if (ENABLE_SHARED_IC_STUBS && hook->canShareStub())
+        stub = getSharedStub(buf, assembler->bytesWritten(), ic->getSlotSize());
 
-    assert(assembler->isExactlyFull());
+    if (stub) {
+        if (ic->size_stats)
+            patchpoints::noteRewriteSize(ic->size_stats, assembler->bytesWritten() + 5, true);
+
+        int64_t dist = stub - slot_start;
+        RELEASE_ASSERT(dist == (int32_t)dist, "stub is too far from %p", slot_start);
+
+        // The stub comes back with the carry flag set if one of its guards failed:
+        Assembler slot(buf, ic->getSlotSize());
+        slot.call(JumpDestination::fromStart(dist));
+        slot.jmp_cond(JumpDestination::fromStart(ic->getSlotSize()), COND_BELOW);
+        slot.jmp(JumpDestination::fromStart(continue_point - slot_start));
+        slot.fillWithNops();
+        assert(slot.isExactlyFull());
+    } else {
+        hook->finishAssembly(continue_point - slot_start);
+
+        // The jump back out can still push it over:
+        if (assembler->hasFailed()) {
+            noteTooBig();
+            ic->clear(ic_entry);
+            return;
+        }
+
+        assert(assembler->isExactlyFull());
+        if (ic->size_stats)
+            patchpoints::noteRewriteSize(ic->size_stats, assembler->bytesNeeded(), true);
+    }
+
+    ic->num_rewrites++;
+
+    for (int i = 0; i < dependencies.size(); i++) {
+        ICInvalidator *invalidator = dependencies[i].first;
+        invalidator->addDependent(ic_entry);
+    }
 
     //if (VERBOSITY()) printf("Commiting to %p-%p\n", start, start + ic->slot_size);
     memcpy(slot_start, buf, ic->getSlotSize());
 
     llvm::sys::Memory::InvalidateInstructionCache(slot_start, ic->getSlotSize());
+
+    if (TRACING) {
+        TraceArgs args;
+        std::string func_name;
+        if (g.func_addr_registry.getFuncNameContaining(ic->start_addr, &func_name))
+            addTraceArg(args, "function", func_name);
+        addTraceArg(args, "slot", (long)ic_entry->idx);
+        addTraceArg(args, "num_rewrites", (long)ic->num_rewrites);
+        traceInstant("ic", std::string("rewrite ") + debug_name, args);
+    }
+}
+
+void ICSlotRewrite::noteTooBig() {
+    static StatCounter sc_too_big("ic_rewrites_too_big");
+    sc_too_big.log();
+    if (VERBOSITY()) printf("not committing %s icentry since it needs at least %d bytes and the slot is %d\n", debug_name, assembler->bytesNeeded(), ic->getSlotSize());
+
+    if (ic->size_stats)
+        patchpoints::noteRewriteSize(ic->size_stats, assembler->bytesNeeded(), false);
 }
 
 void ICSlotRewrite::addDependenceOn(ICInvalidator &invalidator) {
@@ -136,10 +244,20 @@ assembler::GenericRegister ICSlotRewrite::returnRegister() {
 
 
 ICSlotRewrite* ICInfo::startRewrite(const char* debug_name) {
+    assert(!isMegamorphic());
     return new ICSlotRewrite(this, debug_name);
 }
 
+// How many times an IC can have to throw out one of its slots before we decide it's megamorphic:
+static const int MAX_IC_EVICTIONS = 16;
+
 ICSlotInfo* ICInfo::pickEntryForRewrite(uint64_t decision_path, const char* debug_name) {
+    // Rewrites that were started before the IC went megamorphic:
+    if (isMegamorphic()) {
+        if (VERBOSITY()) printf("not committing %s icentry since %p is megamorphic\n", debug_name, start_addr);
+        return NULL;
+    }
+
     for (int i = 0; i < getNumSlots(); i++) {
         SlotInfo &sinfo = slots[i];
         if (!sinfo.is_patched) {
@@ -149,38 +267,73 @@ ICSlotInfo* ICInfo::pickEntryForRewrite(uint64_t decision_path, const char* debu
 
             sinfo.is_patched = true;
             sinfo.decision_path = decision_path;
+            state = (i == 0 ? MONOMORPHIC : POLYMORPHIC);
             return &sinfo.entry;
         }
     }
 
-    for (int i = 0; i < getNumSlots(); i++) {
-        SlotInfo &sinfo = slots[i];
-        if (sinfo.is_patched && sinfo.decision_path != decision_path) {
-            continue;
+    // All the slots are in use, so something has to go.  Prefer a slot that took the same path,
+    // which is probably an out-of-date version of this one, and otherwise go round-robin.
+    if (++num_evictions > MAX_IC_EVICTIONS) {
+        static StatCounter ic_megamorphic("ic_megamorphic");
+        ic_megamorphic.log();
+
+        if (VERBOSITY()) printf("not committing %s icentry; %p is now megamorphic\n", debug_name, start_addr);
+        state = MEGAMORPHIC;
+        for (int i = 0; i < getNumSlots(); i++) {
+            clear(&slots[i].entry);
         }
+        return NULL;
+    }
 
-        if (VERBOSITY()) {
-            printf("committing %s icentry to in-use slot %d at %p\n", debug_name, i, start_addr);
+    int idx = -1;
+    for (int i = 0; i < getNumSlots(); i++) {
+        if (slots[i].decision_path == decision_path) {
+            idx = i;
+            break;
         }
+    }
+    if (idx == -1) {
+        idx = next_slot_to_evict;
+        next_slot_to_evict = (next_slot_to_evict + 1) % getNumSlots();
+    }
 
-        sinfo.is_patched = true;
-        sinfo.decision_path = decision_path;
-        return &sinfo.entry;
+    if (VERBOSITY()) {
+        printf("committing %s icentry to in-use slot %d at %p\n", debug_name, idx, start_addr);
     }
-    if (VERBOSITY()) printf("not committing %s icentry since it is not compatible (%lx)\n", debug_name, decision_path);
-    return NULL;
+
+    SlotInfo &sinfo = slots[idx];
+    sinfo.decision_path = decision_path;
+    return &sinfo.entry;
 }
 
 
 
-ICInfo::ICInfo(void* start_addr, void* continue_addr, StackInfo stack_info, int num_slots, int slot_size, llvm::CallingConv::ID calling_conv, const std::unordered_set<int> &live_outs, assembler::GenericRegister return_register) : stack_info(stack_info), num_slots(num_slots), slot_size(slot_size), calling_conv(calling_conv), live_outs(live_outs.begin(), live_outs.end()), return_register(return_register), start_addr(start_addr), continue_addr(continue_addr) {
+ICInfo::ICInfo(void* start_addr, void* continue_addr, StackInfo stack_info, int num_slots, int slot_size, llvm::CallingConv::ID calling_conv, const LiveOutSet &live_outs, assembler::GenericRegister return_register, patchpoints::PatchpointType type, int lineno, patchpoints::RewriteSizeStats* size_stats) : stack_info(stack_info), num_slots(num_slots), slot_size(slot_size), calling_conv(calling_conv), live_outs(live_outs), return_register(return_register), state(MONOMORPHIC), num_evictions(0), next_slot_to_evict(0), start_addr(start_addr), continue_addr(continue_addr), type(type), lineno(lineno), num_slowpaths(0), num_rewrites(0), num_invalidations(0), size_stats(size_stats) {
     for (int i = 0; i < num_slots; i++) {
         slots.push_back(SlotInfo(this, i));
     }
 }
 
 static std::unordered_map<void*, ICInfo*> ics_by_return_addr;
-void registerCompiledPatchpoint(uint8_t* start_addr, PatchpointSetupInfo* pp, StackInfo stack_info, std::unordered_set<int> live_outs) {
+
+// Most ICs never get to their slowpath, so until one does, all that gets kept around for it is
+// what it would take to construct its ICInfo.
+struct PendingIC {
+    void* start_addr;
+    void* continue_addr;
+    StackInfo stack_info;
+    int num_slots, slot_size;
+    llvm::CallingConv::ID calling_conv;
+    LiveOutSet live_outs;
+    assembler::GenericRegister return_register;
+    patchpoints::PatchpointType type;
+    int lineno;
+    patchpoints::RewriteSizeStats* size_stats;
+};
+static std::unordered_map<void*, PendingIC> pending_ics_by_return_addr;
+
+void registerCompiledPatchpoint(uint8_t* start_addr, PatchpointSetupInfo* pp, StackInfo stack_info, LiveOutSet live_outs) {
     int size = pp->totalSize();
     uint8_t* end_addr = start_addr + size;
     void* slowpath_addr = end_addr;
@@ -204,7 +357,16 @@ void registerCompiledPatchpoint(uint8_t* start_addr, PatchpointSetupInfo* pp, St
 
     if (pp->getCallingConvention() != llvm::CallingConv::C) {
         uint8_t* slowpath_start = start_addr + pp->num_slots * pp->slot_size;
-        rtn_addr = initializePatchpoint2(start_addr, slowpath_start, (uint8_t*)end_addr, stack_info, live_outs);
+        if (ENABLE_COLD_SLOWPATHS) {
+            int cold_size = coldSlowpathSize(live_outs);
+            uint8_t* cold_start = allocateColdCode(cold_size);
+            // Both of the jumps between them are rel32:
+            int64_t dist = cold_start - start_addr;
+            RELEASE_ASSERT(dist == (int32_t)dist, "cold code is too far from %p", start_addr);
+            rtn_addr = initializePatchpoint2(start_addr, slowpath_start, (uint8_t*)end_addr, stack_info, live_outs, cold_start, cold_size);
+        } else {
+            rtn_addr = initializePatchpoint2(start_addr, slowpath_start, (uint8_t*)end_addr, stack_info, live_outs);
+        }
     } else {
         //for (int regnum : live_outs) {
             //// LLVM has a bug where it incorrectly determines the set of liveouts;
@@ -234,14 +396,85 @@ void registerCompiledPatchpoint(uint8_t* start_addr, PatchpointSetupInfo* pp, St
         writer->jmp(JumpDestination::fromStart(pp->slot_size * (pp->num_slots - i)));
     }
 
-    ics_by_return_addr[rtn_addr] = new ICInfo(start_addr, end_addr, stack_info, pp->num_slots, pp->slot_size, pp->getCallingConvention(), live_outs, return_register);
+    PendingIC &pending = pending_ics_by_return_addr[rtn_addr];
+    pending.start_addr = start_addr;
+    pending.continue_addr = end_addr;
+    pending.stack_info = stack_info;
+    pending.num_slots = pp->num_slots;
+    pending.slot_size = pp->slot_size;
+    pending.calling_conv = pp->getCallingConvention();
+    pending.live_outs = live_outs;
+    pending.return_register = return_register;
+    pending.type = pp->type;
+    pending.lineno = pp->lineno;
+    pending.size_stats = pp->size_stats;
 }
 
 ICInfo* getICInfo(void* rtn_addr) {
     std::unordered_map<void*, ICInfo*>::iterator it = ics_by_return_addr.find(rtn_addr);
-    if (it == ics_by_return_addr.end())
+    if (it != ics_by_return_addr.end())
+        return it->second;
+
+    auto pending_it = pending_ics_by_return_addr.find(rtn_addr);
+    if (pending_it == pending_ics_by_return_addr.end())
         return NULL;
-    return it->second;
+
+    const PendingIC &p = pending_it->second;
+    ICInfo* ic = new ICInfo(p.start_addr, p.continue_addr, p.stack_info, p.num_slots, p.slot_size, p.calling_conv, p.live_outs, p.return_register, p.type, p.lineno, p.size_stats);
+    ics_by_return_addr[rtn_addr] = ic;
+    pending_ics_by_return_addr.erase(pending_it);
+    return ic;
+}
+
+static const char* getPatchpointTypeName(patchpoints::PatchpointType type) {
+    switch (type) {
+        case patchpoints::Generic: return "generic";
+        case patchpoints::Callsite: return "callsite";
+        case patchpoints::GetGlobal: return "getglobal";
+        case patchpoints::Getattr: return "getattr";
+        case patchpoints::Setattr: return "setattr";
+        case patchpoints::Getitem: return "getitem";
+        case patchpoints::Setitem: return "setitem";
+        case patchpoints::Binexp: return "binexp";
+        case patchpoints::Nonzero: return "nonzero";
+    }
+    return "?";
+}
+
+static const char* getICStateName(ICInfo::State state) {
+    switch (state) {
+        case ICInfo::MONOMORPHIC: return "mono";
+        case ICInfo::POLYMORPHIC: return "poly";
+        case ICInfo::MEGAMORPHIC: return "mega";
+    }
+    return "?";
+}
+
+// Don't bother listing more than this many ICs:
+#define MAX_IC_REPORT_ENTRIES 50
+
+void dumpICReport(FILE* f) {
+    std::vector<ICInfo*> ics;
+    for (auto &p : ics_by_return_addr) {
+        if (p.second->num_slowpaths || p.second->num_invalidations)
+            ics.push_back(p.second);
+    }
+    std::sort(ics.begin(), ics.end(), [](ICInfo* lhs, ICInfo* rhs) {
+        return lhs->num_slowpaths > rhs->num_slowpaths;
+    });
+
+    fprintf(f, "IC report (%ld ICs, %ld with activity):\n", (long)(ics_by_return_addr.size() + pending_ics_by_return_addr.size()), (long)ics.size());
+    fprintf(f, "%10s %9s %12s %6s  %-10s %s\n", "slowpaths", "rewrites", "invalidated", "state", "type", "location");
+    for (int i = 0; i < ics.size() && i < MAX_IC_REPORT_ENTRIES; i++) {
+        ICInfo* ic = ics[i];
+
+        std::string name;
+        if (!g.func_addr_registry.getFuncNameContaining(ic->start_addr, &name))
+            name = "<unknown>";
+
+        fprintf(f, "%10ld %9ld %12ld %6s  %-10s %s:%d\n", ic->num_slowpaths, ic->num_rewrites, ic->num_invalidations,
+                getICStateName(ic->getState()), getPatchpointTypeName(ic->type), name.c_str(), ic->lineno);
+    }
 }
 
 void ICInfo::clear(ICSlotInfo* icentry) {
@@ -15,6 +15,7 @@
 #ifndef PYSTON_ASMWRITING_ICINFO_H
 #define PYSTON_ASMWRITING_ICINFO_H
 
+#include <cstdio>
 #include <unordered_set>
 #include <vector>
 
@@ -22,6 +23,8 @@
 
 #include "asm_writing/types.h"
 
+#include "codegen/patchpoints.h"
+
 namespace pyston {
 
 class ICInfo;
@@ -42,6 +45,9 @@ class ICSlotRewrite {
         class CommitHook {
             public:
                 virtual void finishAssembly(int fastpath_offset) = 0;
+                // Whether the code would still work if it got run with a call from somewhere else, ie it
+                // doesn't touch the stack pointer or make calls of its own:
+                virtual bool canShareStub() { return false; }
         };
     private:
         ICInfo* ic;
@@ -54,6 +60,8 @@ class ICSlotRewrite {
 
         ICSlotRewrite(ICInfo* ic, const char* debug_name);
 
+        void noteTooBig();
+
     public:
         ~ICSlotRewrite();
 
@@ -72,6 +80,15 @@ class ICSlotRewrite {
 };
 
 class ICInfo {
+    public:
+        enum State {
+            MONOMORPHIC,    // at most one slot has been filled
+            POLYMORPHIC,    // more than one has
+            // It kept having to throw out slots to make room, so it's been cleared out for good and
+            // everything goes straight to the slowpath; the runtime has the method cache behind that.
+            MEGAMORPHIC,
+        };
+
     private:
         struct SlotInfo {
             bool is_patched;
@@ -86,22 +103,34 @@ class ICInfo {
         const int num_slots;
         const int slot_size;
         const llvm::CallingConv::ID calling_conv;
-        const std::vector<int> live_outs;
+        const LiveOutSet live_outs;
         const assembler::GenericRegister return_register;
 
+        State state;
+        int num_evictions;
+        int next_slot_to_evict;
+
         // for ICSlotRewrite:
         ICSlotInfo *pickEntryForRewrite(uint64_t decision_path, const char* debug_name);
 
         void* getSlowpathStart();
 
     public:
-        ICInfo(void* start_addr, void* continue_addr, StackInfo stack_info, int num_slots, int slot_size, llvm::CallingConv::ID calling_conv, const std::unordered_set<int> &live_outs, assembler::GenericRegister return_register);
+        ICInfo(void* start_addr, void* continue_addr, StackInfo stack_info, int num_slots, int slot_size, llvm::CallingConv::ID calling_conv, const LiveOutSet &live_outs, assembler::GenericRegister return_register, patchpoints::PatchpointType type, int lineno, patchpoints::RewriteSizeStats* size_stats);
         void *const start_addr, *const continue_addr;
 
+        // For the IC report:
+        const patchpoints::PatchpointType type;
+        const int lineno;
+        int64_t num_slowpaths, num_rewrites, num_invalidations;
+        patchpoints::RewriteSizeStats* const size_stats;
+
         int getSlotSize() { return slot_size; }
         int getNumSlots() { return num_slots; }
         llvm::CallingConv::ID getCallingConvention() { return calling_conv; }
-        const std::vector<int>& getLiveOuts() { return live_outs; }
+        const LiveOutSet& getLiveOuts() { return live_outs; }
+        State getState() { return state; }
+        bool isMegamorphic() { return state == MEGAMORPHIC; }
 
         ICSlotRewrite* startRewrite(const char* debug_name);
         void clear(ICSlotInfo *entry);
@@ -110,10 +139,13 @@ class ICInfo {
 };
 
 class PatchpointSetupInfo;
-void registerCompiledPatchpoint(uint8_t* start_addr, PatchpointSetupInfo*, StackInfo stack_info, std::unordered_set<int> live_outs);
+void registerCompiledPatchpoint(uint8_t* start_addr, PatchpointSetupInfo*, StackInfo stack_info, LiveOutSet live_outs);
 
 ICInfo* getICInfo(void* rtn_addr);
 
+// Ranks the ICs by how many times they went to the slowpath:
+void dumpICReport(FILE* f);
+
 
 }
 
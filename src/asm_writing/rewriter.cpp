@@ -93,6 +93,15 @@ RewriterVar RewriterVar::getAttr(int offset, int dest) {
     return RewriterVar(rewriter, dest, version);
 }
 
+RewriterVar RewriterVar::getIndexedAttr(const RewriterVar &index, int offset, int dest) {
+    assertValid();
+    index.assertValid();
+
+    rewriter->assembler->movIndexed(fromArgnum(this->argnum), fromArgnum(index.argnum), offset, fromArgnum(dest));
+    int version = rewriter->mutate(dest);
+    return RewriterVar(rewriter, dest, version);
+}
+
 void RewriterVar::incAttr(int offset) {
     assertValid();
 
@@ -181,6 +190,19 @@ void RewriterVar::addAttrGuard(int offset, intptr_t val) {
     rewriter->assembler->jne(JumpDestination::fromStart(rewriter->rewrite->getSlotSize() - bytes/8));
 }
 
+void RewriterVar::addGuardBelow(const RewriterVar &bound) {
+    assert(!rewriter->changed_something && "too late to add a guard!");
+    assertValid();
+    bound.assertValid();
+
+    rewriter->checkArgsValid();
+
+    int bytes = 8 * rewriter->pushes.size() + rewriter->alloca_bytes;
+    // This sets the flags for this - bound:
+    rewriter->assembler->cmp(fromArgnum(bound.argnum), fromArgnum(this->argnum));
+    rewriter->assembler->jmp_cond(JumpDestination::fromStart(rewriter->rewrite->getSlotSize() - bytes/8), COND_NOT_BELOW);
+}
+
 void RewriterVar::addGuardNotEq(intptr_t val) {
     assert(!rewriter->changed_something && "too late to add a guard!");
     assertValid();
@@ -245,6 +267,10 @@ Rewriter* Rewriter::createRewriter(void* ic_rtn_addr, int num_orig_args, int num
         return NULL;
     }
 
+    ic->num_slowpaths++;
+    if (ic->isMegamorphic())
+        return NULL;
+
     assert(ic->getCallingConvention() == llvm::CallingConv::C && "Rewriter[1] only supports the C calling convention!");
     return new Rewriter(ic->startRewrite(debug_name), num_orig_args, num_temp_regs);
 }
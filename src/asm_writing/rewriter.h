@@ -61,8 +61,12 @@ class RewriterVar {
         void addGuardNotEq(intptr_t val);
         // More efficient than getAttr().addGuard(), but less efficient than addGuard() if the value is already available:
         void addAttrGuard(int offset, intptr_t val);
+        // Guards that this is less than bound, comparing them as unsigned, so negative values fail it too:
+        void addGuardBelow(const RewriterVar &bound);
 
         RewriterVar getAttr(int offset, int dest);
+        // Loads the word at this + index * 8 + offset:
+        RewriterVar getIndexedAttr(const RewriterVar &index, int offset, int dest);
         void incAttr(int offset);
         void setAttr(int offset, const RewriterVar &val, bool user_visible=true);
         RewriterVar move(int argnum);
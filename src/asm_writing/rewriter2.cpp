@@ -141,11 +141,16 @@ RewriterVarUsage2 RewriterVarUsage2::getAttr(int offset, KillFlag kill, Location
     assembler::Register this_reg = var->getInReg();
     Rewriter2* rewriter = var->rewriter;
 
+    bool reuse_reg = false;
     if (kill) {
         setDoneUsing();
+
+        // If that was the last use, the register is free now, so load right over it instead of
+        // tying up another one:
+        reuse_reg = (dest.type == Location::AnyReg && rewriter->vars_by_location.count(this_reg) == 0);
     }
 
-    assembler::Register newvar_reg = rewriter->allocReg(dest);
+    assembler::Register newvar_reg = reuse_reg ? this_reg : rewriter->allocReg(dest);
     RewriterVarUsage2 newvar = rewriter->createNewVar(newvar_reg);
     rewriter->assembler->mov(assembler::Indirect(this_reg, offset), newvar_reg);
     return std::move(newvar);
@@ -427,6 +432,7 @@ static const Location caller_save_registers[] {
 
 RewriterVarUsage2 Rewriter2::call(bool can_call_into_python, void* func_addr, std::vector<RewriterVarUsage2> args) {
     assert(!can_call_into_python);
+    made_calls = true;
 
     assertChangesOk();
 
@@ -439,6 +445,8 @@ RewriterVarUsage2 Rewriter2::call(bool can_call_into_python, void* func_addr, st
         if (!var->isInLocation(l)) {
             assembler::Register r = l.asRegister();
 
+            // Moves whatever was in there out of the way; if it's one of the later arguments, it'll
+            // get moved back into its own argument register when we get to it.
             assembler::Register r2 = allocReg(l);
             assert(r == r2);
             assert(vars_by_location.count(l) == 0);
@@ -446,9 +454,14 @@ RewriterVarUsage2 Rewriter2::call(bool can_call_into_python, void* func_addr, st
             bool is_immediate;
             assembler::Immediate imm = var->tryGetAsImmediate(&is_immediate);
 
-            assert(is_immediate);
-            assembler->mov(imm, r);
-            addLocationToVar(var, l);
+            if (is_immediate) {
+                assembler->mov(imm, r);
+                addLocationToVar(var, l);
+            } else {
+                // This is the only copy we need; if this was the last use of the var, its old
+                // register gets freed up right after this.
+                var->getInReg(l);
+            }
         }
 
         assert(var->isInLocation(Location::forArg(i)));
@@ -683,9 +696,9 @@ RewriterVarUsage2 Rewriter2::createNewVar(Location dest) {
     return var;
 }
 
-Rewriter2::Rewriter2(ICSlotRewrite* rewrite, int num_args, const std::vector<int> &live_outs) :
+Rewriter2::Rewriter2(ICSlotRewrite* rewrite, int num_args, const LiveOutSet &live_outs) :
             rewrite(rewrite), assembler(rewrite->getAssembler()),
-            return_location(rewrite->returnRegister()), done_guarding(false) {
+            return_location(rewrite->returnRegister()), done_guarding(false), made_calls(false) {
     //assembler->trap();
 
     for (int i = 0; i < num_args; i++) {
@@ -743,6 +756,10 @@ Rewriter2* Rewriter2::createRewriter(void* rtn_addr, int num_args, const char* d
         return NULL;
     }
 
+    ic->num_slowpaths++;
+    if (ic->isMegamorphic())
+        return NULL;
+
     return new Rewriter2(ic->startRewrite(debug_name), num_args, ic->getLiveOuts());
 }
 
@@ -211,6 +211,7 @@ class Rewriter2 : public ICSlotRewrite::CommitHook {
         const Location return_location;
 
         bool done_guarding;
+        bool made_calls;
 
         std::vector<int> live_out_regs;
 
@@ -218,7 +219,7 @@ class Rewriter2 : public ICSlotRewrite::CommitHook {
         std::vector<RewriterVar2*> args;
         std::vector<RewriterVar2*> live_outs;
 
-        Rewriter2(ICSlotRewrite* rewrite, int num_args, const std::vector<int>& live_outs);
+        Rewriter2(ICSlotRewrite* rewrite, int num_args, const LiveOutSet& live_outs);
 
         void assertChangesOk() { assert(done_guarding); }
 
@@ -243,6 +244,8 @@ class Rewriter2 : public ICSlotRewrite::CommitHook {
         void removeLocationFromVar(RewriterVar2 *var, Location l);
 
         void finishAssembly(int continue_offset) override;
+        // It only ever uses rbp-relative scratch space, so this just depends on whether it called anything:
+        bool canShareStub() override { return !made_calls; }
 
     public:
         // This should be called exactly once for each argument
@@ -15,6 +15,9 @@
 #ifndef PYSTON_ASMWRITING_TYPES_H
 #define PYSTON_ASMWRITING_TYPES_H
 
+#include <cassert>
+#include <cstdint>
+
 namespace pyston {
 
 struct StackInfo {
@@ -25,6 +28,45 @@ struct StackInfo {
     int scratch_rbp_offset;
 };
 
+// A set of registers, by dwarf number; the x86_64 ones only go up to 32 (%xmm15), so they fit in a mask.
+class LiveOutSet {
+    private:
+        uint64_t bits;
+
+    public:
+        LiveOutSet() : bits(0) {}
+
+        void insert(int dwarf_regnum) {
+            assert(0 <= dwarf_regnum && dwarf_regnum < 64);
+            bits |= (1UL << dwarf_regnum);
+        }
+        void erase(int dwarf_regnum) {
+            bits &= ~(1UL << dwarf_regnum);
+        }
+        bool count(int dwarf_regnum) const {
+            return (bits >> dwarf_regnum) & 1;
+        }
+        int size() const {
+            return __builtin_popcountl(bits);
+        }
+
+        // Goes through the registers in increasing order:
+        class iterator {
+            private:
+                uint64_t rest;
+            public:
+                iterator(uint64_t rest) : rest(rest) {}
+                int operator*() const { return __builtin_ctzl(rest); }
+                iterator& operator++() {
+                    rest &= rest - 1;
+                    return *this;
+                }
+                bool operator!=(const iterator &rhs) const { return rest != rhs.rest; }
+        };
+        iterator begin() const { return iterator(bits); }
+        iterator end() const { return iterator(0); }
+};
+
 namespace assembler {
 
 class Assembler;
@@ -0,0 +1,883 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <alloca.h>
+#include <map>
+#include <string>
+#include <sys/mman.h>
+#include <unordered_map>
+#include <vector>
+
+#include "core/common.h"
+#include "core/options.h"
+#include "core/stats.h"
+#include "core/threading.h"
+#include "core/types.h"
+
+#include "core/ast.h"
+#include "core/cfg.h"
+#include "core/util.h"
+
+#include "analysis/function_analysis.h"
+#include "analysis/scoping_analysis.h"
+
+#include "asm_writing/assembler.h"
+
+#include "codegen/ast_interpreter.h"
+#include "codegen/compvars.h"
+#include "codegen/irgen.h"
+#include "codegen/osrentry.h"
+#include "codegen/type_recording.h"
+#include "codegen/profiling/line_profiler.h"
+#include "codegen/irgen/hooks.h"
+#include "codegen/irgen/tiering.h"
+
+#include "gc/collector.h"
+
+#include "runtime/objmodel.h"
+#include "runtime/types.h"
+
+namespace pyston {
+
+typedef std::unordered_map<std::string, Box*> InterpSymbolTable;
+
+// The OSR bookkeeping irgen would have put into the generated code for each backedge:
+struct InterpreterOSRPoint {
+    int64_t edge_count;
+    OSRExit *exit;
+    // Set if this loop needs something the OSR entry can't take (potentially-undefined variables):
+    bool disabled;
+
+    InterpreterOSRPoint() : edge_count(0), exit(NULL), disabled(false) {}
+};
+static std::unordered_map<CompiledFunction*, std::unordered_map<AST_Jump*, InterpreterOSRPoint> > osr_points;
+
+class ASTInterpreter;
+static std::unordered_map<void*, const ASTInterpreter*> interpreter_roots;
+
+// All the values are kept boxed, and go through the same runtime entry points that the jitted code's
+// inline caches fall back to.
+// Temporaries have to stay somewhere that the conservative stack scan can see them (C locals or alloca'd
+// arrays, never a std::vector); the locals in the symbol table get reported by gatherASTInterpreterRootsForFrame.
+class ASTInterpreter {
+    private:
+        CompiledFunction *cf;
+        SourceInfo *source;
+        ScopeInfo *scope_info;
+        TypeFeedback *feedback;
+        CFGBlock *current_block;
+        // Where the threaded code leaves the return value:
+        Box* threaded_rtn;
+
+        InterpSymbolTable symbols;
+        // The closure that this code works with, same as in irgen:
+        BoxedClosure *closure;
+
+        bool isModule() {
+            return source->ast->type == AST_TYPE::Module;
+        }
+
+        Box* evalAttribute(AST_Attribute *node) {
+            assert(node->ctx_type == AST_TYPE::Load);
+            Box* value = evalExpr(node->value);
+            return getattr(value, internString(node->attr)->c_str());
+        }
+
+        Box* evalClsAttribute(AST_ClsAttribute *node) {
+            Box* value = evalExpr(node->value);
+            return getclsattr(value, internString(node->attr)->c_str());
+        }
+
+        Box* evalLangPrimitive(AST_LangPrimitive *node) {
+            switch (node->opcode) {
+                case AST_LangPrimitive::ITER_NEXT:
+                    return iterNext(evalExpr(node->args[0]));
+                case AST_LangPrimitive::ITER_HAS_VALUE:
+                    return boxBool(evalExpr(node->args[1]) != NULL);
+                case AST_LangPrimitive::RAISE:
+                    raise3(evalExpr(node->args[0]), evalExpr(node->args[1]), evalExpr(node->args[2]));
+                default:
+                    RELEASE_ASSERT(0, "%d", node->opcode);
+            }
+        }
+
+        Box* evalBinOp(AST_BinOp *node) {
+            Box* left = evalExpr(node->left);
+            Box* right = evalExpr(node->right);
+            assert(node->op_type != AST_TYPE::Is && node->op_type != AST_TYPE::IsNot && "not tested yet");
+            return binop(left, right, node->op_type);
+        }
+
+        Box* evalBoolOp(AST_BoolOp *node) {
+            assert(node->op_type == AST_TYPE::And || node->op_type == AST_TYPE::Or);
+            bool is_and = node->op_type == AST_TYPE::And;
+            int nvals = node->values.size();
+            assert(nvals >= 2);
+
+            Box* v = NULL;
+            for (int i = 0; i < nvals; i++) {
+                v = evalExpr(node->values[i]);
+                if (i < nvals - 1 && nonzero(v) != is_and)
+                    break;
+            }
+            return v;
+        }
+
+        // Same as in irgen, with one KeywordCallSite per node:
+        Box* evalKeywordCall(AST_Call *node) {
+            static std::unordered_map<AST_Call*, KeywordCallSite*> sites;
+
+            Box* func;
+            if (node->func->type == AST_TYPE::Attribute) {
+                AST_Attribute* attr_ast = static_cast<AST_Attribute*>(node->func);
+                func = getattr(evalExpr(attr_ast->value), internString(attr_ast->attr)->c_str());
+            } else {
+                RELEASE_ASSERT(node->func->type != AST_TYPE::ClsAttribute, "");
+                func = evalExpr(node->func);
+            }
+
+            int npositional = node->args.size();
+            int nargs = npositional + node->keywords.size();
+            Box** args = (Box**)alloca(nargs * sizeof(Box*));
+            for (int i = 0; i < npositional; i++)
+                args[i] = evalExpr(node->args[i]);
+            for (int i = 0; i < node->keywords.size(); i++)
+                args[npositional + i] = evalExpr(node->keywords[i]->value);
+
+            KeywordCallSite* &site = sites[node];
+            if (site == NULL) {
+                std::vector<const std::string*> keyword_names;
+                for (int i = 0; i < node->keywords.size(); i++)
+                    keyword_names.push_back(internString(node->keywords[i]->arg));
+                site = new KeywordCallSite(npositional, keyword_names);
+            }
+            return runtimeCallKeywords(func, site, args);
+        }
+
+        Box* evalCall(AST_Call *node) {
+            if (node->keywords.size())
+                return evalKeywordCall(node);
+
+            bool is_callattr = false;
+            bool callattr_clsonly = false;
+            std::string *attr = NULL;
+            Box* func;
+            if (node->func->type == AST_TYPE::Attribute) {
+                is_callattr = true;
+                AST_Attribute* attr_ast = static_cast<AST_Attribute*>(node->func);
+                func = evalExpr(attr_ast->value);
+                attr = &attr_ast->attr;
+            } else if (node->func->type == AST_TYPE::ClsAttribute) {
+                is_callattr = true;
+                callattr_clsonly = true;
+                AST_ClsAttribute* attr_ast = static_cast<AST_ClsAttribute*>(node->func);
+                func = evalExpr(attr_ast->value);
+                attr = &attr_ast->attr;
+            } else {
+                func = evalExpr(node->func);
+            }
+
+            int nargs = node->args.size();
+            Box* first_args[3] = {NULL, NULL, NULL};
+            Box** rest = NULL;
+            if (nargs > 3)
+                rest = (Box**)alloca((nargs - 3) * sizeof(Box*));
+            for (int i = 0; i < nargs; i++) {
+                Box* a = evalExpr(node->args[i]);
+                if (i < 3)
+                    first_args[i] = a;
+                else
+                    rest[i - 3] = a;
+            }
+
+            if (is_callattr)
+                return callattr(func, const_cast<std::string*>(internString(*attr)), callattr_clsonly, nargs, first_args[0], first_args[1], first_args[2], rest);
+            recordCallee(feedback->getCalleeRecorder(node), func);
+            return runtimeCall(func, nargs, first_args[0], first_args[1], first_args[2], rest);
+        }
+
+        Box* evalCompare(AST_Compare *node) {
+            RELEASE_ASSERT(node->ops.size() == 1, "");
+
+            Box* left = evalExpr(node->left);
+            Box* right = evalExpr(node->comparators[0]);
+            return compare(left, right, node->ops[0]);
+        }
+
+        Box* evalDict(AST_Dict *node) {
+            Box* rtn = createDict();
+            if (node->keys.size()) {
+                Box* setitem = getattr(rtn, internString("__setitem__")->c_str());
+                for (int i = 0; i < node->keys.size(); i++) {
+                    Box* key = evalExpr(node->keys[i]);
+                    Box* value = evalExpr(node->values[i]);
+                    runtimeCall(setitem, 2, key, value, NULL, NULL);
+                }
+            }
+            return rtn;
+        }
+
+        Box* evalList(AST_List *node) {
+            int nelts = node->elts.size();
+            Box** elts = (Box**)alloca(nelts * sizeof(Box*));
+            for (int i = 0; i < nelts; i++) {
+                elts[i] = evalExpr(node->elts[i]);
+            }
+
+            Box* rtn = createListSized(nelts);
+            for (int i = 0; i < nelts; i++) {
+                listAppendInternal(rtn, elts[i]);
+            }
+            return rtn;
+        }
+
+        Box* evalName(AST_Name *node) {
+            if (scope_info->refersToGlobal(node->id)) {
+                return getGlobal(source->parent_module, const_cast<std::string*>(internString(node->id)), isModule());
+            }
+
+            if (scope_info->refersToClosure(node->id)) {
+                int depth, slot;
+                scope_info->getClosureLookup(node->id, &depth, &slot);
+                BoxedClosure *c = closure;
+                for (int i = 0; i < depth; i++)
+                    c = c->parent;
+                if (c->elts[slot] == NULL) {
+                    raiseUndefinedClosureName(node->id.c_str());
+                    abort();
+                }
+                return c->elts[slot];
+            }
+
+            InterpSymbolTable::iterator it = symbols.find(node->id);
+            if (it == symbols.end()) {
+                assertNameDefined(false, node->id.c_str());
+                abort();
+            }
+            return it->second;
+        }
+
+        Box* evalNum(AST_Num *node) {
+            if (node->num_type == AST_Num::INT)
+                return boxInt(node->n_int);
+            else if (node->num_type == AST_Num::FLOAT)
+                return boxFloat(node->n_float);
+            else
+                RELEASE_ASSERT(0, "");
+        }
+
+        Box* evalSlice(AST_Slice *node) {
+            Box *start = node->lower ? evalExpr(node->lower) : None;
+            Box *stop = node->upper ? evalExpr(node->upper) : None;
+            Box *step = node->step ? evalExpr(node->step) : None;
+            return createSlice(start, stop, step);
+        }
+
+        Box* evalSubscript(AST_Subscript *node) {
+            Box* value = evalExpr(node->value);
+            Box* slice = evalExpr(node->slice);
+            return getitem(value, slice);
+        }
+
+        Box* evalTuple(AST_Tuple *node) {
+            int nelts = node->elts.size();
+            Box** elts = (Box**)alloca(nelts * sizeof(Box*));
+            for (int i = 0; i < nelts; i++) {
+                elts[i] = evalExpr(node->elts[i]);
+            }
+            return createTuple(nelts, elts);
+        }
+
+        Box* evalUnaryOp(AST_UnaryOp *node) {
+            Box* operand = evalExpr(node->operand);
+            if (node->op_type == AST_TYPE::Not)
+                return boxBool(!nonzero(operand));
+            return unaryop(operand, node->op_type);
+        }
+
+        Box* evalExpr(AST_expr *node) {
+            Box* rtn;
+            switch (node->type) {
+                case AST_TYPE::Attribute:
+                    rtn = evalAttribute(static_cast<AST_Attribute*>(node));
+                    break;
+                case AST_TYPE::BinOp:
+                    rtn = evalBinOp(static_cast<AST_BinOp*>(node));
+                    break;
+                case AST_TYPE::BoolOp:
+                    rtn = evalBoolOp(static_cast<AST_BoolOp*>(node));
+                    break;
+                case AST_TYPE::Call:
+                    rtn = evalCall(static_cast<AST_Call*>(node));
+                    break;
+                case AST_TYPE::Compare:
+                    rtn = evalCompare(static_cast<AST_Compare*>(node));
+                    break;
+                case AST_TYPE::Dict:
+                    rtn = evalDict(static_cast<AST_Dict*>(node));
+                    break;
+                case AST_TYPE::Index:
+                    rtn = evalExpr(static_cast<AST_Index*>(node)->value);
+                    break;
+                case AST_TYPE::List:
+                    rtn = evalList(static_cast<AST_List*>(node));
+                    break;
+                case AST_TYPE::Name:
+                    rtn = evalName(static_cast<AST_Name*>(node));
+                    break;
+                case AST_TYPE::Num:
+                    rtn = evalNum(static_cast<AST_Num*>(node));
+                    break;
+                case AST_TYPE::Slice:
+                    rtn = evalSlice(static_cast<AST_Slice*>(node));
+                    break;
+                case AST_TYPE::Str:
+                    rtn = boxStringPtr(&static_cast<AST_Str*>(node)->s);
+                    break;
+                case AST_TYPE::Subscript:
+                    rtn = evalSubscript(static_cast<AST_Subscript*>(node));
+                    break;
+                case AST_TYPE::Tuple:
+                    rtn = evalTuple(static_cast<AST_Tuple*>(node));
+                    break;
+                case AST_TYPE::UnaryOp:
+                    rtn = evalUnaryOp(static_cast<AST_UnaryOp*>(node));
+                    break;
+                case AST_TYPE::ClsAttribute:
+                    rtn = evalClsAttribute(static_cast<AST_ClsAttribute*>(node));
+                    break;
+                case AST_TYPE::LangPrimitive:
+                    rtn = evalLangPrimitive(static_cast<AST_LangPrimitive*>(node));
+                    break;
+                default:
+                    printf("Unhandled expr type: %d (ast_interpreter.cpp:" STRINGIFY(__LINE__) ")\n", node->type);
+                    exit(1);
+            }
+
+            // Same places that irgen records feedback for in the low tiers:
+            bool speculated_load = (node->type == AST_TYPE::Name && source->cfg->speculated_loads.count(static_cast<AST_Name*>(node)));
+            if (node->type == AST_TYPE::Attribute || node->type == AST_TYPE::BinOp || node->type == AST_TYPE::Call || speculated_load)
+                feedback->getRecorder(node)->record(rtn->cls);
+
+            return rtn;
+        }
+
+        void doSet(const std::string &name, Box* val) {
+            assert(name != "None");
+            if (scope_info->refersToGlobal(name)) {
+                setattr(source->parent_module, internString(name)->c_str(), val);
+            } else {
+                symbols[name] = val;
+                if (scope_info->saveInClosure(name)) {
+                    closure->elts[scope_info->getClosureSlot(name)] = val;
+                    gc::writeBarrier(closure, val);
+                }
+            }
+        }
+
+        void doSet(AST* target, Box* val) {
+            switch (target->type) {
+                case AST_TYPE::Attribute: {
+                    AST_Attribute *attr = static_cast<AST_Attribute*>(target);
+                    Box* t = evalExpr(attr->value);
+                    setattr(t, internString(attr->attr)->c_str(), val);
+                    break;
+                }
+                case AST_TYPE::Name:
+                    doSet(static_cast<AST_Name*>(target)->id, val);
+                    break;
+                case AST_TYPE::Subscript: {
+                    AST_Subscript *sub = static_cast<AST_Subscript*>(target);
+                    Box* t = evalExpr(sub->value);
+                    Box* slice = evalExpr(sub->slice);
+                    setitem(t, slice, val);
+                    break;
+                }
+                case AST_TYPE::Tuple: {
+                    AST_Tuple *tuple = static_cast<AST_Tuple*>(target);
+                    int ntargets = tuple->elts.size();
+                    checkUnpackingLength(ntargets, unboxedLen(val));
+                    for (int i = 0; i < ntargets; i++) {
+                        doSet(tuple->elts[i], getitem(val, boxInt(i)));
+                    }
+                    break;
+                }
+                default:
+                    ASSERT(0, "Unknown type for ASTInterpreter: %d", target->type);
+                    abort();
+            }
+        }
+
+        Box* makeFunctionDef(AST_FunctionDef *node) {
+            CLFunction *cl = wrapFunction(node, source);
+            bool takes_closure = source->scoping->getScopeInfoForNode(node)->takesClosure();
+            int ndefaults = node->args->defaults.size();
+            if (ndefaults == 0 && !takes_closure)
+                return boxCLFunction(cl);
+
+            Box* boxed_defaults = NULL;
+            if (ndefaults) {
+                Box** defaults = (Box**)alloca(ndefaults * sizeof(Box*));
+                for (int i = 0; i < ndefaults; i++)
+                    defaults[i] = evalExpr(node->args->defaults[i]);
+                boxed_defaults = createTuple(ndefaults, defaults);
+            }
+            if (takes_closure) {
+                assert(closure);
+                return boxCLFunctionClosure(cl, boxed_defaults, closure);
+            }
+            return boxCLFunctionDefaults(cl, boxed_defaults);
+        }
+
+        void doClassDef(AST_ClassDef *node) {
+            RELEASE_ASSERT(node->bases.size() == 1, "");
+            RELEASE_ASSERT(node->bases[0]->type == AST_TYPE::Name, "");
+            RELEASE_ASSERT(static_cast<AST_Name*>(node->bases[0])->id == "object", "");
+
+            Box* cls = createClass(&node->name, source->parent_module);
+
+            for (int i = 0, n = node->body.size(); i < n; i++) {
+                AST_TYPE::AST_TYPE type = node->body[i]->type;
+                if (type == AST_TYPE::Pass) {
+                    continue;
+                } else if (type == AST_TYPE::FunctionDef) {
+                    AST_FunctionDef *fdef = static_cast<AST_FunctionDef*>(node->body[i]);
+                    setattr(cls, internString(fdef->name)->c_str(), makeFunctionDef(fdef));
+                } else {
+                    RELEASE_ASSERT(node->body[i]->type == AST_TYPE::Pass, "%d", type);
+                }
+            }
+
+            doSet(node->name, cls);
+        }
+
+        void doImport(AST_Import *node) {
+            for (int i = 0; i < node->names.size(); i++) {
+                AST_alias *alias = node->names[i];
+
+                std::string &modname = alias->name;
+                std::string &asname = alias->asname.size() ? alias->asname : alias->name;
+
+                doSet(asname, import(&modname));
+            }
+        }
+
+        void doPrint(AST_Print *node) {
+            assert(node->dest == NULL);
+            for (int i = 0; i < node->values.size(); i++) {
+                if (i > 0)
+                    printf(" ");
+                print(evalExpr(node->values[i]));
+            }
+            if (node->nl)
+                printf("\n");
+            else
+                printf(" ");
+        }
+
+        void doStmt(AST_stmt *node) {
+            switch (node->type) {
+                case AST_TYPE::Assign: {
+                    AST_Assign *assign = static_cast<AST_Assign*>(node);
+                    Box* val = evalExpr(assign->value);
+                    for (int i = 0; i < assign->targets.size(); i++) {
+                        doSet(assign->targets[i], val);
+                    }
+                    break;
+                }
+                case AST_TYPE::ClassDef:
+                    doClassDef(static_cast<AST_ClassDef*>(node));
+                    break;
+                case AST_TYPE::Expr:
+                    evalExpr(static_cast<AST_Expr*>(node)->value);
+                    break;
+                case AST_TYPE::FunctionDef: {
+                    AST_FunctionDef *fdef = static_cast<AST_FunctionDef*>(node);
+                    doSet(fdef->name, makeFunctionDef(fdef));
+                    break;
+                }
+                case AST_TYPE::Import:
+                    doImport(static_cast<AST_Import*>(node));
+                    break;
+                case AST_TYPE::Global:
+                    // Should have been handled already
+                    break;
+                case AST_TYPE::Pass:
+                    break;
+                case AST_TYPE::Print:
+                    doPrint(static_cast<AST_Print*>(node));
+                    break;
+                default:
+                    printf("Unhandled stmt type at " __FILE__ ":" STRINGIFY(__LINE__) ": %d\n", node->type);
+                    exit(1);
+            }
+        }
+
+        // Mirrors doOSRExit in irgen: hands the live variables to an OSR-entry compile of the rest of the
+        // function, which then runs to completion.  Returns false if we should keep interpreting.
+        bool tryOSR(AST_Jump *node, Box* &rtn) {
+            InterpreterOSRPoint &point = osr_points[cf][node];
+            if (point.disabled)
+                return false;
+
+            point.edge_count++;
+            if (point.edge_count <= getTieringPolicy()->osrThreshold(cf->effort))
+                return false;
+
+            const PhiAnalysis::RequiredSet &live = source->phis->getAllRequiredAfter(current_block);
+            if (point.exit == NULL) {
+                OSREntryDescriptor *entry = OSREntryDescriptor::create(cf, node);
+                for (PhiAnalysis::RequiredSet::const_iterator it = live.begin(), end = live.end(); it != end; ++it) {
+                    // irgen would pass these along with an is_defined flag, which the OSR entry
+                    // doesn't know how to take:
+                    if (source->phis->isPotentiallyUndefinedAfter(*it, current_block)) {
+                        point.disabled = true;
+                        delete entry;
+                        return false;
+                    }
+                    entry->args[*it] = UNKNOWN;
+                }
+                if (closure)
+                    entry->args[CLOSURE_ARG_NAME] = UNKNOWN;
+                point.exit = new OSRExit(cf, entry);
+            }
+
+            void* partial_func = compilePartialFunc(point.exit);
+
+            // Same calling convention as the jitted OSR exits: arg1, arg2, arg3, argarray
+            const OSREntryDescriptor::ArgMap &args = point.exit->entry->args;
+            Box* first_args[3] = {NULL, NULL, NULL};
+            Box** rest = NULL;
+            if (args.size() > 3)
+                rest = (Box**)alloca((args.size() - 3) * sizeof(Box*));
+            int i = 0;
+            for (OSREntryDescriptor::ArgMap::const_iterator it = args.begin(), end = args.end(); it != end; ++it, ++i) {
+                Box* val;
+                if (it->first == CLOSURE_ARG_NAME) {
+                    val = closure;
+                } else {
+                    InterpSymbolTable::iterator sym = symbols.find(it->first);
+                    ASSERT(sym != symbols.end(), "%s", it->first.c_str());
+                    val = sym->second;
+                }
+                if (i < 3)
+                    first_args[i] = val;
+                else
+                    rest[i - 3] = val;
+            }
+
+            rtn = ((Box* (*)(Box*, Box*, Box*, Box**))partial_func)(first_args[0], first_args[1], first_args[2], rest);
+            if (cf->sig->rtn_type == VOID)
+                rtn = NULL;
+            return true;
+        }
+
+    public:
+        ASTInterpreter(CompiledFunction *cf) : cf(cf), source(cf->clfunc->source), current_block(NULL), threaded_rtn(NULL), closure(NULL) {
+            assert(source->cfg);
+            scope_info = source->scoping->getScopeInfoForNode(source->ast);
+            feedback = getTypeFeedback(source);
+        }
+
+        void gatherRoots(GCVisitor *visitor) const {
+            for (InterpSymbolTable::const_iterator it = symbols.begin(), end = symbols.end(); it != end; ++it) {
+                visitor->visitPotential(it->second);
+            }
+            if (closure)
+                visitor->visit(closure);
+        }
+
+        void loadArguments(int64_t nargs, Box* arg1, Box* arg2, Box* arg3, Box** args) {
+            const std::vector<AST_expr*> &arg_names = source->getArgNames();
+            RELEASE_ASSERT(nargs == arg_names.size(), "%ld %ld", nargs, arg_names.size());
+
+            // Like in irgen, our own closure has to exist before any parameters get saved in it:
+            int nparams = nargs;
+            BoxedClosure *passed_closure = NULL;
+            if (scope_info->takesClosure()) {
+                nparams--;
+                Box* first_args[3] = {arg1, arg2, arg3};
+                Box* c = (nparams < 3) ? first_args[nparams] : args[nparams - 3];
+                assert(c->cls == closure_cls);
+                passed_closure = static_cast<BoxedClosure*>(c);
+            }
+            if (scope_info->createsClosure())
+                closure = static_cast<BoxedClosure*>(createClosure(passed_closure, scope_info->getClosureSize()));
+            else
+                closure = passed_closure;
+
+            for (int i = 0; i < nparams; i++) {
+                Box* v;
+                if (i == 0) v = arg1;
+                else if (i == 1) v = arg2;
+                else if (i == 2) v = arg3;
+                else v = args[i - 3];
+                doSet(arg_names[i], v);
+            }
+        }
+
+        Box* execute() {
+            current_block = source->cfg->blocks[0];
+            while (true) {
+                CFGBlock *next_block = NULL;
+                for (int i = 0; i < current_block->body.size(); i++) {
+                    AST_stmt *stmt = current_block->body[i];
+                    if (isLineProfiling() && startsProfiledLine(current_block, i)) {
+                        LineProfileEntry *entry = getLineProfileEntry(source, stmt->lineno);
+                        if (entry)
+                            lineProfilerHit(entry);
+                    }
+                    if (stmt->type == AST_TYPE::Return) {
+                        AST_Return *ret = static_cast<AST_Return*>(stmt);
+                        if (ret->value == NULL)
+                            return (cf->sig->rtn_type == VOID) ? NULL : None;
+                        return evalExpr(ret->value);
+                    } else if (stmt->type == AST_TYPE::Branch) {
+                        AST_Branch *branch = static_cast<AST_Branch*>(stmt);
+                        next_block = nonzero(evalExpr(branch->test)) ? branch->iftrue : branch->iffalse;
+                    } else if (stmt->type == AST_TYPE::Jump) {
+                        AST_Jump *jump = static_cast<AST_Jump*>(stmt);
+                        if (jump->target->idx < current_block->idx) {
+                            // Same safepoint as the jitted code has on its backedges:
+                            threading::allowGLPreemption();
+                        }
+                        if (ENABLE_OSR && jump->target->idx < current_block->idx) {
+                            assert(jump->target->predecessors.size() > 1);
+                            Box* rtn;
+                            if (tryOSR(jump, rtn))
+                                return rtn;
+                        }
+                        next_block = jump->target;
+                    } else {
+                        doStmt(stmt);
+                    }
+                }
+
+                RELEASE_ASSERT(next_block, "block %d doesn't end in a terminator", current_block->idx);
+                current_block = next_block;
+            }
+        }
+
+        Box* executeThreaded();
+
+        // What the threaded code calls; the branch and backedge ones return whether to take the jump.
+        static void threadedDoStmt(ASTInterpreter *self, AST_stmt *node) {
+            self->doStmt(node);
+        }
+
+        static int64_t threadedBranch(ASTInterpreter *self, AST_Branch *node) {
+            return nonzero(self->evalExpr(node->test));
+        }
+
+        static void threadedReturn(ASTInterpreter *self, AST_Return *node) {
+            if (node->value == NULL)
+                self->threaded_rtn = (self->cf->sig->rtn_type == VOID) ? NULL : None;
+            else
+                self->threaded_rtn = self->evalExpr(node->value);
+        }
+
+        static int64_t threadedBackedge(ASTInterpreter *self, AST_Jump *node, CFGBlock *block) {
+            threading::allowGLPreemption();
+            if (!ENABLE_OSR)
+                return false;
+            self->current_block = block;
+            return self->tryOSR(node, self->threaded_rtn);
+        }
+};
+
+// Threaded dispatch for the interpreter (-J): instead of walking the CFG, each block becomes straight-line
+// machine code that calls back into the interpreter once per statement, and the control flow between blocks
+// turns into real jumps.  That only gets rid of the dispatch loop; the statements still get evaluated by the
+// interpreter (with no ics or type feedback of its own), so this is still the INTERPRETED tier and tiers up
+// to MINIMAL the same as it.  A baseline jit, with code and an ic for each operation, that could take
+// MINIMAL's place and keep llvm out of the warmup would be a separate thing.
+//
+// The generated code has no unwind info, so it keeps a standard rbp frame for the gc's stack walk to get
+// through it with.
+typedef void (*ThreadedCode)(ASTInterpreter*);
+static std::unordered_map<CompiledFunction*, ThreadedCode> threaded_code;
+
+static void emitThreadedCall(assembler::Assembler &as, void* func, void* arg, void* arg2 = NULL) {
+    as.mov(assembler::RBX, assembler::RDI);
+    as.mov(assembler::Immediate(arg), assembler::RSI);
+    if (arg2)
+        as.mov(assembler::Immediate(arg2), assembler::RDX);
+    as.emitCall(func, assembler::R11);
+}
+
+// Jumps get sent to block_offsets, which then gets updated with where the blocks actually ended up.
+// All the jumps are the fixed-size kind, so a second run with the first run's offsets gets them right.
+static int emitThreadedCode(CFG *cfg, uint8_t* buf, int size, std::vector<int> &block_offsets, int &epilogue_offset) {
+    using namespace assembler;
+    Assembler as(buf, size);
+
+    as.push(RBP);
+    as.mov(RSP, RBP);
+    as.push(RBX);
+    as.push(R12); // just to keep the stack aligned for the calls
+    as.mov(RDI, RBX);
+
+    for (CFGBlock *block : cfg->blocks) {
+        block_offsets[block->idx] = as.bytesWritten();
+        RELEASE_ASSERT(block->body.size(), "block %d doesn't end in a terminator", block->idx);
+
+        for (int i = 0; i < block->body.size(); i++) {
+            AST_stmt *stmt = block->body[i];
+            bool is_last = (i == block->body.size() - 1);
+
+            if (stmt->type == AST_TYPE::Return) {
+                emitThreadedCall(as, (void*)ASTInterpreter::threadedReturn, stmt);
+                as.jmp_long(JumpDestination::fromStart(epilogue_offset));
+            } else if (stmt->type == AST_TYPE::Branch) {
+                AST_Branch *branch = static_cast<AST_Branch*>(stmt);
+                emitThreadedCall(as, (void*)ASTInterpreter::threadedBranch, stmt);
+                as.test(RAX, RAX);
+                as.jmp_cond_long(JumpDestination::fromStart(block_offsets[branch->iftrue->idx]), COND_NOT_ZERO);
+                as.jmp_long(JumpDestination::fromStart(block_offsets[branch->iffalse->idx]));
+            } else if (stmt->type == AST_TYPE::Jump) {
+                AST_Jump *jump = static_cast<AST_Jump*>(stmt);
+                if (jump->target->idx < block->idx) {
+                    emitThreadedCall(as, (void*)ASTInterpreter::threadedBackedge, stmt, block);
+                    as.test(RAX, RAX);
+                    as.jmp_cond_long(JumpDestination::fromStart(epilogue_offset), COND_NOT_ZERO);
+                }
+                as.jmp_long(JumpDestination::fromStart(block_offsets[jump->target->idx]));
+            } else {
+                RELEASE_ASSERT(!is_last, "block %d doesn't end in a terminator", block->idx);
+                emitThreadedCall(as, (void*)ASTInterpreter::threadedDoStmt, stmt);
+                continue;
+            }
+
+            RELEASE_ASSERT(is_last, "block %d has statements after its terminator", block->idx);
+        }
+    }
+
+    epilogue_offset = as.bytesWritten();
+    as.pop(R12);
+    as.pop(RBX);
+    as.pop(RBP);
+    as.ret();
+
+    return as.bytesWritten();
+}
+
+static uint8_t* allocThreadedCodeMemory(int size) {
+    static uint8_t *cur = NULL, *end = NULL;
+    const int CHUNK_SIZE = 1 << 20;
+
+    size = (size + 15) & ~15;
+    if (cur == NULL || cur + size > end) {
+        int chunk_size = std::max(size, CHUNK_SIZE);
+        void* chunk = mmap(NULL, chunk_size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        RELEASE_ASSERT(chunk != MAP_FAILED, "couldn't map memory for the threaded code");
+        cur = (uint8_t*)chunk;
+        end = cur + chunk_size;
+    }
+
+    uint8_t* rtn = cur;
+    cur += size;
+    return rtn;
+}
+
+static ThreadedCode compileThreadedCode(CompiledFunction *cf) {
+    static StatCounter sc_threaded("threaded_code_compiles");
+    sc_threaded.log();
+
+    CFG *cfg = cf->clfunc->source->cfg;
+
+    // An upper bound on what each statement or block can take:
+    int max_size = 64;
+    for (CFGBlock *block : cfg->blocks)
+        max_size += 64 + 64 * block->body.size();
+
+    std::vector<int> block_offsets(cfg->blocks.size(), 0);
+    int epilogue_offset = 0;
+
+    uint8_t* scratch = (uint8_t*)malloc(max_size);
+    int size = emitThreadedCode(cfg, scratch, max_size, block_offsets, epilogue_offset);
+    free(scratch);
+
+    uint8_t* code = allocThreadedCodeMemory(size);
+    int final_size = emitThreadedCode(cfg, code, size, block_offsets, epilogue_offset);
+    RELEASE_ASSERT(final_size == size, "%d %d", final_size, size);
+
+    return (ThreadedCode)code;
+}
+
+Box* ASTInterpreter::executeThreaded() {
+    ThreadedCode &code = threaded_code[cf];
+    if (code == NULL)
+        code = compileThreadedCode(cf);
+
+    code(this);
+    return threaded_rtn;
+}
+
+void gatherASTInterpreterRootsForFrame(GCVisitor *visitor, void* frame_ptr) {
+    auto it = interpreter_roots.find(frame_ptr);
+    RELEASE_ASSERT(it != interpreter_roots.end(), "%p is not an interpreter frame", frame_ptr);
+    it->second->gatherRoots(visitor);
+}
+
+void gatherASTInterpreterRootsInRange(GCVisitor *visitor, void* start, void* end) {
+    for (auto p : interpreter_roots) {
+        if (p.first >= start && p.first < end)
+            p.second->gatherRoots(visitor);
+    }
+}
+
+class ASTUnregisterHelper {
+    private:
+        void* frame_ptr;
+
+    public:
+        constexpr ASTUnregisterHelper(void* frame_ptr) : frame_ptr(frame_ptr) {}
+
+        ~ASTUnregisterHelper() {
+            assert(interpreter_roots.count(frame_ptr));
+            interpreter_roots.erase(frame_ptr);
+        }
+};
+
+Box* astInterpretFunction(CompiledFunction *cf, int64_t nargs, Box* arg1, Box* arg2, Box* arg3, Box* *args) {
+    assert(cf);
+    assert(cf->is_interpreted && cf->func == NULL);
+
+    static StatCounter interpreted_runs("interpreted_runs");
+    interpreted_runs.log();
+
+    // Same call-count tier-up as the pre-entry block that irgen emits:
+    SourceInfo *source = cf->clfunc->source;
+    if (ENABLE_REOPT && cf->effort < EffortLevel::MAXIMAL && source->ast->type != AST_TYPE::Module) {
+        cf->times_called++;
+        if (cf->times_called > getTieringPolicy()->reoptThreshold(cf->effort)) {
+            void* new_code = reoptCompiledFunc(cf);
+            return ((Box* (*)(Box*, Box*, Box*, Box**))new_code)(arg1, arg2, arg3, args);
+        }
+    }
+
+    ASTInterpreter interpreter(cf);
+
+    void* frame_ptr = __builtin_frame_address(0);
+    interpreter_roots[frame_ptr] = &interpreter;
+    ASTUnregisterHelper helper(frame_ptr);
+
+    interpreter.loadArguments(nargs, arg1, arg2, arg3, args);
+    if (ENABLE_THREADED_INTERPRETER)
+        return interpreter.executeThreaded();
+    return interpreter.execute();
+}
+
+}
@@ -0,0 +1,35 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CODEGEN_ASTINTERPRETER_H
+#define PYSTON_CODEGEN_ASTINTERPRETER_H
+
+#include <stdint.h>
+
+namespace pyston {
+
+class Box;
+class GCVisitor;
+struct CompiledFunction;
+
+// Runs an INTERPRETED-effort version directly off of its CFG, without generating any IR for it.
+// Tiers up the same way the jitted code does: reoptimizes once it's been called enough times,
+// and OSRs out of loops that have gone around enough times.
+void gatherASTInterpreterRootsForFrame(GCVisitor *visitor, void* frame_ptr);
+void gatherASTInterpreterRootsInRange(GCVisitor *visitor, void* start, void* end);
+Box* astInterpretFunction(CompiledFunction *cf, int64_t nargs, Box* arg1, Box* arg2, Box* arg3, Box* *args);
+
+}
+
+#endif
@@ -12,58 +12,100 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <cxxabi.h>
 #include <dlfcn.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "llvm/DebugInfo/DIContext.h"
 #include "llvm/ExecutionEngine/JITEventListener.h"
 #include "llvm/ExecutionEngine/ObjectImage.h"
 
+#include "core/options.h"
 #include "core/util.h"
 
 #include "codegen/codegen.h"
+#include "codegen/perf_map.h"
 
 namespace pyston {
 
+FunctionAddressRegistry::FunctionAddressRegistry() : code_ranges(new CodeRangeIndex()), code_range_readers(0) {
+}
+
 void FunctionAddressRegistry::registerFunction(const std::string& name, void* addr, int length, llvm::Function* llvm_func) {
+    std::lock_guard<std::recursive_mutex> _lock(lock);
     assert(addr);
     assert(functions.count(addr) == 0);
-    functions.insert(std::make_pair(addr, FuncInfo(name, length, llvm_func)));
+    auto it = functions.insert(std::make_pair(addr, FuncInfo(name, length, llvm_func))).first;
+    if (!length)
+        return;
+
+    const CodeRangeIndex* old_ranges = code_ranges.load();
+    CodeRangeIndex* new_ranges = new CodeRangeIndex();
+    new_ranges->reserve(old_ranges->size() + 1);
+
+    CodeRange range;
+    range.start = addr;
+    range.end = (char*)addr + length;
+    range.func = &it->second;
+    auto insert_at = std::upper_bound(old_ranges->begin(), old_ranges->end(), range,
+            [](const CodeRange &lhs, const CodeRange &rhs) { return lhs.start < rhs.start; });
+    new_ranges->insert(new_ranges->end(), old_ranges->begin(), insert_at);
+    new_ranges->push_back(range);
+    new_ranges->insert(new_ranges->end(), insert_at, old_ranges->end());
+
+    code_ranges.store(new_ranges);
+    retired_code_ranges.push_back(old_ranges);
+
+    // Anything that starts reading after this point will see the new copy:
+    if (code_range_readers.load() == 0) {
+        for (const CodeRangeIndex* r : retired_code_ranges)
+            delete r;
+        retired_code_ranges.clear();
+    }
 }
 
-void FunctionAddressRegistry::dumpPerfMap() {
-    std::string out_path = "perf_map";
-    removeDirectoryIfExists(out_path);
-
-    llvm::error_code code;
-    code = llvm::sys::fs::create_directory(out_path, false);
-    assert(!code);
-
-    FILE *index_f = fopen((out_path + "/index.txt").c_str(), "w");
-
-    char buf[80];
-    snprintf(buf, 80, "/tmp/perf-%d.map", getpid());
-    FILE *f = fopen(buf, "w");
-    for (FuncMap::iterator it = functions.begin(), end = functions.end();
-            it != end; ++it) {
-        const FuncInfo& info = it->second;
-        fprintf(f, "%lx %x %s\n", (uintptr_t)it->first, info.length, info.name.c_str());
+const char* FunctionAddressRegistry::getJittedFuncContaining(void* addr, void** start) {
+    code_range_readers++;
+    const CodeRangeIndex* ranges = code_ranges.load();
+
+    const FuncInfo* found = NULL;
+    int lo = 0, hi = ranges->size();
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if ((*ranges)[mid].start <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo > 0 && addr < (*ranges)[lo - 1].end) {
+        found = (*ranges)[lo - 1].func;
+        if (start)
+            *start = (*ranges)[lo - 1].start;
+    }
 
-        if (info.length > 0) {
-            fprintf(index_f, "%lx %s\n", (uintptr_t)it->first, info.name.c_str());
+    code_range_readers--;
+    return found ? found->name.c_str() : NULL;
+}
 
-            FILE *data_f = fopen((out_path + "/" + info.name).c_str(), "wb");
+bool FunctionAddressRegistry::getFuncNameContaining(void* addr, std::string *name) {
+    const char* found = getJittedFuncContaining(addr);
+    if (!found)
+        return false;
+    *name = found;
+    return true;
+}
 
-            int written = fwrite((void*)it->first, 1, info.length, data_f);
-            assert(written == info.length);
-            fclose(data_f);
-        }
-    }
-    fclose(f);
+static llvm::Function* inCurrentContext(llvm::Function* f) {
+    if (f == NULL || &f->getContext() == g.context)
+        return f;
+    return g.stdlib_module->getFunction(f->getName());
 }
 
 llvm::Function* FunctionAddressRegistry::getLLVMFuncAtAddress(void* addr) {
+    std::lock_guard<std::recursive_mutex> _lock(lock);
+
     FuncMap::iterator it = functions.find(addr);
     if (it == functions.end()) {
         if (lookup_neg_cache.count(addr))
@@ -86,7 +128,7 @@ llvm::Function* FunctionAddressRegistry::getLLVMFuncAtAddress(void* addr) {
         registerFunction(name, addr, 0, r);
         return r;
     }
-    return it->second.llvm_func;
+    return inCurrentContext(it->second.llvm_func);
 }
 
 static std::string tryDemangle(const char* s) {
@@ -101,8 +143,16 @@ static std::string tryDemangle(const char* s) {
 }
 
 std::string FunctionAddressRegistry::getFuncNameAtAddress(void* addr, bool demangle, bool *out_success) {
+    std::lock_guard<std::recursive_mutex> _lock(lock);
     FuncMap::iterator it = functions.find(addr);
     if (it == functions.end()) {
+        // Tracebacks and the like give us addresses from the middle of jitted functions:
+        const char* jitted_name = getJittedFuncContaining(addr);
+        if (jitted_name) {
+            if (out_success) *out_success = true;
+            return jitted_name;
+        }
+
         Dl_info info;
         int success = dladdr(addr, &info);
 
@@ -133,6 +183,11 @@ class RegistryEventListener : public llvm::JITEventListener {
             static StatCounter code_bytes("code_bytes");
             code_bytes.log(Obj.getData().size());
 
+            // Only needed for the line numbers in the jitdump file:
+            llvm::DIContext* context = NULL;
+            if (PROFILE)
+                context = llvm::DIContext::getDWARFContext(Obj.getObjectFile());
+
             llvm::error_code code;
             for (llvm::object::symbol_iterator I = Obj.begin_symbols(), E = Obj.end_symbols(); I != E;
 #if LLVMREV < 200442
@@ -166,7 +221,22 @@ class RegistryEventListener : public llvm::JITEventListener {
 
                 //printf("%lx %lx %lx %s\n", addr, addr + size, offset, name.data());
                 g.func_addr_registry.registerFunction(name.data(), (void*)addr, size, NULL);
+
+                if (PROFILE && size > 0) {
+                    std::vector<PerfLineInfo> lines;
+                    llvm::DILineInfoTable table = context->getLineInfoForAddressRange(addr, size, llvm::DILineInfoSpecifier::FileLineInfo);
+                    for (int i = 0; i < table.size(); i++) {
+                        PerfLineInfo l;
+                        l.addr = table[i].first;
+                        l.line = table[i].second.getLine();
+                        l.file = table[i].second.getFileName();
+                        lines.push_back(l);
+                    }
+                    perfMapAddFunction(name.data(), (void*)addr, size, lines);
+                }
             }
+
+            delete context;
         }
 };
 
@@ -15,6 +15,9 @@
 #ifndef PYSTON_CODEGEN_CODEGEN_H
 #define PYSTON_CODEGEN_CODEGEN_H
 
+#include <atomic>
+#include <mutex>
+#include <vector>
 #include <unordered_map>
 
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
@@ -43,39 +46,62 @@ class FunctionAddressRegistry {
         typedef std::unordered_map<void*, FuncInfo> FuncMap;
         FuncMap functions;
         std::unordered_set<void*> lookup_neg_cache;
+        // The optimization passes on the compile threads look things up in here too:
+        std::recursive_mutex lock;
+
+        // The code ranges of the functions that we know the length of (ie the jitted ones), sorted by
+        // address.  Registering a function publishes a new copy, so that lookups don't have to lock
+        // anything; the old copies get freed once no lookups are in progress.
+        struct CodeRange {
+            void* start;
+            void* end;
+            const FuncInfo* func;
+        };
+        typedef std::vector<CodeRange> CodeRangeIndex;
+        std::atomic<const CodeRangeIndex*> code_ranges;
+        std::atomic<int> code_range_readers;
+        std::vector<const CodeRangeIndex*> retired_code_ranges;
 
     public:
+        FunctionAddressRegistry();
+
         std::string getFuncNameAtAddress(void* addr, bool demangle, bool *out_success=NULL);
+        // Finds the jitted function that addr is somewhere inside of, in O(log n).  Doesn't lock or
+        // allocate, so it's safe to call from a signal handler; the name stays valid forever.
+        // Returns NULL if addr isn't in jitted code.
+        const char* getJittedFuncContaining(void* addr, void** start=NULL);
+        bool getFuncNameContaining(void* addr, std::string *name);
+        // Returns the function from the calling thread's copy of the stdlib.
         llvm::Function* getLLVMFuncAtAddress(void* addr);
         void registerFunction(const std::string &name, void *addr, int length, llvm::Function* llvm_func);
-        void dumpPerfMap();
 };
 
 llvm::JITEventListener* makeRegistryListener();
 llvm::JITEventListener* makeTracebacksListener();
 
+// The llvm-context-specific parts are thread-local: the main thread uses the global context, and each
+// parallel compile thread sets up its own (see initCodegenThread()).  The rest is shared, and can only be
+// used while holding the codegen lock.
 struct GlobalState {
-    llvm::LLVMContext &context;
-    llvm::Module *stdlib_module, *cur_module;
+    static __thread llvm::LLVMContext *context;
+    static __thread llvm::Module *stdlib_module, *cur_module;
     llvm::TargetMachine *tm;
     llvm::ExecutionEngine *engine;
 
     std::vector<llvm::JITEventListener*> jit_listeners;
 
     FunctionAddressRegistry func_addr_registry;
-    llvm::Type *llvm_value_type, *llvm_value_type_ptr;
-    llvm::Type *llvm_class_type, *llvm_class_type_ptr;
-    llvm::Type *llvm_flavor_type, *llvm_flavor_type_ptr;
-    llvm::Type *llvm_opaque_type;
-    llvm::Type *llvm_str_type_ptr;
-    llvm::Type *llvm_clfunction_type_ptr;
-    llvm::Type *llvm_module_type_ptr, *llvm_bool_type_ptr;
-    llvm::Type *i1, *i8, *i8_ptr, *i32, *i64, *void_, *double_;
-
-    GlobalFuncs funcs;
-
-    GlobalState() : context(llvm::getGlobalContext()) {
-    };
+    static __thread llvm::Type *llvm_value_type, *llvm_value_type_ptr;
+    static __thread llvm::Type *llvm_class_type, *llvm_class_type_ptr;
+    static __thread llvm::Type *llvm_flavor_type, *llvm_flavor_type_ptr;
+    static __thread llvm::Type *llvm_opaque_type;
+    static __thread llvm::Type *llvm_str_type_ptr;
+    static __thread llvm::Type *llvm_list_type_ptr, *llvm_list_iterator_type_ptr;
+    static __thread llvm::Type *llvm_clfunction_type_ptr;
+    static __thread llvm::Type *llvm_module_type_ptr, *llvm_bool_type_ptr;
+    static __thread llvm::Type *i1, *i8, *i8_ptr, *i32, *i64, *void_, *double_;
+
+    static __thread GlobalFuncs funcs;
 };
 
 extern GlobalState g;
@@ -0,0 +1,98 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "core/options.h"
+
+#include "codegen/compile_cache.h"
+
+namespace pyston {
+
+static const std::vector<std::string>& cacheDirs() {
+    static std::vector<std::string> dirs = []() {
+        std::vector<std::string> rtn;
+        if (COMPILE_CACHE_DIR) {
+            mkdir(COMPILE_CACHE_DIR, 0755);
+            rtn.push_back(COMPILE_CACHE_DIR);
+        }
+        if (COMPILE_CACHE_SHARED_DIRS) {
+            std::istringstream ss(COMPILE_CACHE_SHARED_DIRS);
+            std::string dir;
+            while (std::getline(ss, dir, ':')) {
+                if (!dir.empty())
+                    rtn.push_back(dir);
+            }
+        }
+        return rtn;
+    }();
+    return dirs;
+}
+
+bool compileCacheEnabled() {
+    return !cacheDirs().empty();
+}
+
+static uint64_t fnv1a(const std::string &s) {
+    uint64_t h = 14695981039346656037UL;
+    for (char c : s) {
+        h ^= (uint8_t)c;
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+std::string cacheKey(const std::string &data) {
+    char buf[40];
+    snprintf(buf, sizeof(buf), "%016lx%016lx", (unsigned long)std::hash<std::string>()(data), (unsigned long)fnv1a(data));
+    return buf;
+}
+
+std::string findCacheEntry(const std::string &name) {
+    for (const std::string &dir : cacheDirs()) {
+        std::string fn = dir + "/" + name;
+        if (access(fn.c_str(), R_OK) == 0)
+            return fn;
+    }
+    return "";
+}
+
+bool writeFileAtomically(const std::string &fn, const std::string &data) {
+    std::string tmp_fn = fn + ".tmp" + std::to_string(getpid());
+    FILE* f = fopen(tmp_fn.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp_fn.c_str(), fn.c_str()) != 0) {
+        unlink(tmp_fn.c_str());
+        return false;
+    }
+    return true;
+}
+
+void writeCacheEntry(const std::string &name, const std::string &data) {
+    if (!COMPILE_CACHE_DIR)
+        return;
+    cacheDirs(); // makes sure the directory exists
+    writeFileAtomically(std::string(COMPILE_CACHE_DIR) + "/" + name, data);
+}
+
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CODEGEN_COMPILECACHE_H
+#define PYSTON_CODEGEN_COMPILECACHE_H
+
+#include <string>
+
+namespace pyston {
+
+// The compile cache is a directory of files that are named after a hash of everything that went into them,
+// so identical sources share their entries no matter where they're checked out.  Right now the parser keeps
+// ASTs there (<key>.ast) and the jit keeps object files (<key>.o).
+//
+// New entries only ever get written to COMPILE_CACHE_DIR.  COMPILE_CACHE_SHARED_DIRS is a colon-separated list
+// of more cache directories that get checked after it, ex a prepopulated one on a read-only network mount.
+
+bool compileCacheEnabled();
+
+// A 128-bit hash of the data, as 32 hex digits.
+std::string cacheKey(const std::string &data);
+
+// Returns the path of the named entry from the first cache directory that has it, or "" if none do.
+std::string findCacheEntry(const std::string &name);
+
+// Adds an entry to COMPILE_CACHE_DIR, if it's set.  If this fails we'll just have to redo the work next time.
+void writeCacheEntry(const std::string &name, const std::string &data);
+
+// Writes to a temporary file and renames it into place, so that other processes never see a partial file.
+bool writeFileAtomically(const std::string &fn, const std::string &data);
+
+}
+
+#endif
@@ -12,8 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <cstdio>
 #include <sstream>
+#include <unordered_set>
 
 #include "llvm/IR/IntrinsicInst.h"
 
@@ -28,6 +30,8 @@
 #include "runtime/objmodel.h"
 #include "runtime/int.h"
 #include "runtime/float.h"
+#include "runtime/list.h"
+#include "runtime/str.h"
 #include "runtime/types.h"
 
 namespace pyston {
@@ -180,7 +184,7 @@ class UnknownType : public ConcreteCompilerType {
         virtual ConcreteCompilerVariable* nonzero(IREmitter &emitter, ConcreteCompilerVariable *var);
 
         void setattr(IREmitter &emitter, ConcreteCompilerVariable *var, const std::string &attr, CompilerVariable *v) {
-            llvm::Constant* ptr = getStringConstantPtr(attr + '\0');
+            llvm::Constant* ptr = embedConstantPtr(internString(attr)->c_str(), g.i8_ptr);
             ConcreteCompilerVariable *converted = v->makeConverted(emitter, UNKNOWN);
             //g.funcs.setattr->dump();
             //var->getValue()->dump(); llvm::errs() << '\n';
@@ -205,7 +209,7 @@ class UnknownType : public ConcreteCompilerType {
         virtual llvm::Value* makeClassCheck(IREmitter &emitter, ConcreteCompilerVariable *var, BoxedClass *cls) {
             assert(var->getValue()->getType() == g.llvm_value_type_ptr);
             // TODO this is brittle: directly embeds the position of the class object:
-            llvm::Value* cls_ptr = emitter.getBuilder()->CreateConstInBoundsGEP2_32(var->getValue(), 0, 1);
+            llvm::Value* cls_ptr = emitter.getBuilder()->CreateConstInBoundsGEP2_32(var->getValue(), 0, 0);
             llvm::Value* cls_value = emitter.getBuilder()->CreateLoad(cls_ptr);
             assert(cls_value->getType() == g.llvm_class_type_ptr);
             llvm::Value* rtn = emitter.getBuilder()->CreateICmpEQ(cls_value, embedConstantPtr(cls, g.llvm_class_type_ptr));
@@ -277,7 +281,8 @@ class UnknownType : public ConcreteCompilerType {
 ConcreteCompilerType *UNKNOWN = new UnknownType();
 
 CompilerVariable* UnknownType::getattr(IREmitter &emitter, ConcreteCompilerVariable *var, const std::string &attr) {
-    llvm::Constant* ptr = getStringConstantPtr(attr + '\0');
+    // Pass the interned copy, so that the runtime can look it up by address:
+    llvm::Constant* ptr = embedConstantPtr(internString(attr)->c_str(), g.i8_ptr);
 
     llvm::Value* rtn_val = NULL;
 
@@ -318,22 +323,19 @@ static ConcreteCompilerVariable* _call(IREmitter &emitter, llvm::Value* func, vo
         llvm_args.push_back(converted_args[2]->getValue());
     }
 
-    llvm::Value *mallocsave = NULL;
     if (args.size() >= 4) {
         llvm::Value *arg_array;
 
-        if (emitter.getTarget() == IREmitter::INTERPRETER) {
-            llvm::Value *n_bytes = getConstantInt((args.size() - 3) * sizeof(Box*), g.i64);
-            mallocsave = emitter.getBuilder()->CreateCall(g.funcs.malloc, n_bytes);
-            arg_array = emitter.getBuilder()->CreateBitCast(mallocsave, g.llvm_value_type_ptr->getPointerTo());
-        } else {
-            llvm::Value *n_varargs = getConstantInt(args.size() - 3, g.i64);
+        // The arguments past the third one get passed in an array on the caller's stack.  This goes for
+        // the interpreted IR too, where the interpreter allocates entry-block allocas once per call of the
+        // function, same as malloc'ing the array would be but without the malloc+free around every call.
+        llvm::Value *n_varargs = getConstantInt(args.size() - 3, g.i64);
 
-            // Don't use the IRBuilder since we want to specifically put this in the entry block so it only gets called once.
-            // TODO we could take this further and use the same alloca for all function calls?
-            llvm::Instruction* insertion_point = emitter.currentFunction()->func->getEntryBlock().getTerminator();
-            arg_array = new llvm::AllocaInst(g.llvm_value_type_ptr, n_varargs, "arg_scratch", insertion_point);
-        }
+        // Don't use the IRBuilder since we want to specifically put this in the entry block so it only gets called once.
+        // TODO we could take this further and use the same alloca for all function calls?
+        // (which might not be the CompiledFunction's, if this is the body of a callee that's getting inlined)
+        llvm::Instruction* insertion_point = emitter.getBuilder()->GetInsertBlock()->getParent()->getEntryBlock().getTerminator();
+        arg_array = new llvm::AllocaInst(g.llvm_value_type_ptr, n_varargs, "arg_scratch", insertion_point);
 
         for (int i = 3; i < args.size(); i++) {
             llvm::Value* ptr = emitter.getBuilder()->CreateConstGEP1_32(arg_array, i - 3);
@@ -369,11 +371,6 @@ static ConcreteCompilerVariable* _call(IREmitter &emitter, llvm::Value* func, vo
         rtn = emitter.getBuilder()->CreateCall(func, llvm_args);
     }
 
-    if (mallocsave) {
-        llvm::Value *l_free = embedConstantPtr((void*)free, llvm::FunctionType::get(g.void_, g.i8->getPointerTo(), false)->getPointerTo());
-        emitter.getBuilder()->CreateCall(l_free, mallocsave);
-    }
-
     for (int i = 0; i < args.size(); i++) {
         converted_args[i]->decvref(emitter);
     }
@@ -418,7 +415,7 @@ CompilerVariable* UnknownType::callattr(IREmitter &emitter, ConcreteCompilerVari
 
     std::vector<llvm::Value*> other_args;
     other_args.push_back(var->getValue());
-    other_args.push_back(embedConstantPtr(&attr, g.llvm_str_type_ptr));
+    other_args.push_back(embedConstantPtr(internString(attr), g.llvm_str_type_ptr));
     other_args.push_back(getConstantInt(clsonly, g.i1));
 
     llvm::Value *nargs = llvm::ConstantInt::get(g.i64, args.size(), false);
@@ -443,10 +440,30 @@ ConcreteCompilerVariable* UnknownType::nonzero(IREmitter &emitter, ConcreteCompi
     return new ConcreteCompilerVariable(BOOL, rtn_val, true);
 }
 
-CompilerVariable* makeFunction(IREmitter &emitter, CLFunction *f) {
+CompilerVariable* makeFunction(IREmitter &emitter, CLFunction *f, const std::vector<CompilerVariable*> &defaults, llvm::Value* closure) {
     // Unlike the CLFunction*, which can be shared between recompilations, the Box* around it
     // should be created anew every time the functiondef is encountered
-    llvm::Value *boxed = emitter.getBuilder()->CreateCall(g.funcs.boxCLFunction, embedConstantPtr(f, g.llvm_clfunction_type_ptr));
+    llvm::Value *boxed;
+    if (defaults.size() || closure) {
+        CompilerVariable *tuple = NULL;
+        ConcreteCompilerVariable *converted = NULL;
+        llvm::Value *boxed_defaults = embedConstantPtr(NULL, g.llvm_value_type_ptr);
+        if (defaults.size()) {
+            tuple = makeTuple(defaults);
+            converted = tuple->makeConverted(emitter, UNKNOWN);
+            boxed_defaults = converted->getValue();
+        }
+        if (closure)
+            boxed = emitter.getBuilder()->CreateCall3(g.funcs.boxCLFunctionClosure, embedConstantPtr(f, g.llvm_clfunction_type_ptr), boxed_defaults, closure);
+        else
+            boxed = emitter.getBuilder()->CreateCall2(g.funcs.boxCLFunctionDefaults, embedConstantPtr(f, g.llvm_clfunction_type_ptr), boxed_defaults);
+        if (tuple) {
+            converted->decvref(emitter);
+            tuple->decvref(emitter);
+        }
+    } else {
+        boxed = emitter.getBuilder()->CreateCall(g.funcs.boxCLFunction, embedConstantPtr(f, g.llvm_clfunction_type_ptr));
+    }
     return new ConcreteCompilerVariable(typeFromClass(function_cls), boxed, true);
 }
 
@@ -561,20 +578,33 @@ class IntType : public ConcreteCompilerType {
         }
 
         virtual CompilerType* getattrType(const std::string &attr) {
-            static std::vector<AbstractFunctionType::Sig*> sigs;
+            // The arithmetic ops also take floats (and return them); the bitwise ones don't.
+            static std::vector<AbstractFunctionType::Sig*> sigs, arith_sigs;
             if (sigs.size() == 0) {
                 AbstractFunctionType::Sig *int_sig = new AbstractFunctionType::Sig();
                 int_sig->rtn_type = INT;
                 int_sig->arg_types.push_back(INT);
-                sigs.push_back(int_sig);
+
+                AbstractFunctionType::Sig *float_sig = new AbstractFunctionType::Sig();
+                float_sig->rtn_type = FLOAT;
+                float_sig->arg_types.push_back(FLOAT);
 
                 AbstractFunctionType::Sig *unknown_sig = new AbstractFunctionType::Sig();
                 unknown_sig->rtn_type = UNKNOWN;
                 unknown_sig->arg_types.push_back(UNKNOWN);
+
+                sigs.push_back(int_sig);
                 sigs.push_back(unknown_sig);
+
+                arith_sigs.push_back(int_sig);
+                arith_sigs.push_back(float_sig);
+                arith_sigs.push_back(unknown_sig);
             }
 
-            if (attr == "__add__" || attr == "__sub__" || attr == "__mod__" || attr == "__mul__" || attr == "__lshift__" || attr == "__rshift__" || attr == "__div__" || attr == "__pow__" || attr == "__floordiv__" || attr == "__and__" || attr == "__or__" || attr == "__xor__") {
+            if (attr == "__add__" || attr == "__sub__" || attr == "__mod__" || attr == "__mul__" || attr == "__div__" || attr == "__pow__" || attr == "__floordiv__") {
+                return AbstractFunctionType::get(arith_sigs);
+            }
+            if (attr == "__lshift__" || attr == "__rshift__" || attr == "__and__" || attr == "__or__" || attr == "__xor__") {
                 return AbstractFunctionType::get(sigs);
             }
 
@@ -808,8 +838,13 @@ class NormalObjectType : public ConcreteCompilerType {
             return c == cls;
         }
 
+        // Slices don't have attributes either, but their bounds look like them (see getSliceAttr):
+        bool attrsAreStatic() {
+            return cls->is_constant && !cls->hasattrs && cls != slice_cls;
+        }
+
         virtual CompilerType* getattrType(const std::string &attr) {
-            if (cls->is_constant && !cls->hasattrs) {
+            if (attrsAreStatic()) {
                 Box* rtattr = cls->peekattr(attr);
                 if (rtattr == NULL)
                     return UNDEF;
@@ -831,7 +866,7 @@ class NormalObjectType : public ConcreteCompilerType {
 
         CompilerVariable* getattr(IREmitter &emitter, ConcreteCompilerVariable *var, const std::string &attr) {
             //printf("%s.getattr %s\n", debugName().c_str(), attr.c_str());
-            if (cls->is_constant && !cls->hasattrs) {
+            if (attrsAreStatic()) {
                 Box* rtattr = cls->peekattr(attr);
                 if (rtattr == NULL) {
                     llvm::CallInst *call = emitter.getBuilder()->CreateCall2(g.funcs.raiseAttributeErrorStr, getStringConstantPtr(*getNameOfClass(cls) + "\0"), getStringConstantPtr(attr + '\0'));
@@ -861,6 +896,26 @@ class NormalObjectType : public ConcreteCompilerType {
                 return new ConcreteCompilerVariable(BOOL, unboxed, true);
             }
 
+            if (cls == none_cls)
+                return new ConcreteCompilerVariable(BOOL, getConstantInt(0, g.i1), true);
+
+            // These get inlined, so a known container turns into a load and a compare:
+            llvm::Value *f = NULL;
+            if (cls == list_cls)
+                f = g.funcs.listNonzeroUnboxed;
+            else if (cls == tuple_cls)
+                f = g.funcs.tupleNonzeroUnboxed;
+            else if (cls == dict_cls)
+                f = g.funcs.dictNonzeroUnboxed;
+            else if (cls == str_cls)
+                f = g.funcs.strNonzeroUnboxed;
+            if (f) {
+                llvm::Type *self_type = *llvm::cast<llvm::FunctionType>(llvm::cast<llvm::PointerType>(f->getType())->getElementType())->param_begin();
+                llvm::Value *casted = emitter.getBuilder()->CreateBitCast(var->getValue(), self_type);
+                llvm::Value *rtn = emitter.getBuilder()->CreateCall(f, casted);
+                return new ConcreteCompilerVariable(BOOL, rtn, true);
+            }
+
             ConcreteCompilerVariable *converted = var->makeConverted(emitter, UNKNOWN);
             ConcreteCompilerVariable *rtn = converted->nonzero(emitter);
             converted->decvref(emitter);
@@ -878,6 +933,9 @@ class NormalObjectType : public ConcreteCompilerType {
         }
 
         virtual ConcreteCompilerVariable* len(IREmitter &emitter, ConcreteCompilerVariable *var) {
+            llvm::Value *rtn = emitUnboxedLen(emitter, var->getValue(), cls);
+            if (rtn)
+                return new ConcreteCompilerVariable(INT, rtn, true);
             return UNKNOWN->len(emitter, var);
         }
 
@@ -889,7 +947,21 @@ class NormalObjectType : public ConcreteCompilerType {
         }
 
         virtual CompilerVariable* callattr(IREmitter &emitter, ConcreteCompilerVariable *var, const std::string &attr, bool clsonly, const std::vector<CompilerVariable*>& args) {
-            if (cls->is_constant && !cls->hasattrs) {
+            // The loop condition of every for-loop over a list; emit it as a couple of loads
+            // rather than a call per iteration.
+            // TODO this is brittle: directly embeds the positions of BoxedListIterator::l, ::pos, and BoxedList::size
+            if (cls == list_iterator_cls && attr == "__hasnext__" && args.size() == 0) {
+                IREmitter::IRBuilder* b = emitter.getBuilder();
+                llvm::Value* it = b->CreateBitCast(var->getValue(), g.llvm_list_iterator_type_ptr);
+                llvm::Value* l = b->CreateLoad(b->CreateConstInBoundsGEP2_32(it, 0, 1));
+                assert(l->getType() == g.llvm_list_type_ptr);
+                llvm::Value* pos = b->CreateLoad(b->CreateConstInBoundsGEP2_32(it, 0, 2));
+                llvm::Value* size = b->CreateLoad(b->CreateConstInBoundsGEP2_32(l, 0, 1));
+                assert(pos->getType() == g.i64 && size->getType() == g.i64);
+                return new ConcreteCompilerVariable(BOOL, b->CreateICmpSLT(pos, size), true);
+            }
+
+            if (attrsAreStatic()) {
                 Box* rtattr = cls->peekattr(attr);
                 if (rtattr == NULL) {
                     llvm::CallInst *call = emitter.getBuilder()->CreateCall2(g.funcs.raiseAttributeErrorStr, getStringConstantPtr(debugName() + '\0'), getStringConstantPtr(attr + '\0'));
@@ -1016,6 +1088,11 @@ class StrConstantType : public ValuedCompilerType<std::string*> {
 
         virtual ConcreteCompilerVariable* makeConverted(IREmitter &emitter, ValuedCompilerVariable<std::string*> *var, ConcreteCompilerType* other_type) {
             assert(other_type == STR || other_type == UNKNOWN);
+            // Like CPython, identifier-like constants are interned, so they don't need a new box each time:
+            if (isIdentifierLike(*var->getValue())) {
+                llvm::Value *boxed = embedConstantPtr(boxInternedString(*var->getValue()), g.llvm_value_type_ptr);
+                return new ConcreteCompilerVariable(other_type, boxed, true);
+            }
             llvm::Value *boxed = emitter.getBuilder()->CreateCall(g.funcs.boxStringPtr, embedConstantPtr(var->getValue(), g.llvm_str_type_ptr));
             return new ConcreteCompilerVariable(other_type, boxed, true);
         }
@@ -1045,6 +1122,10 @@ class StrConstantType : public ValuedCompilerType<std::string*> {
             return rtn;
         }
 
+        virtual ConcreteCompilerVariable* nonzero(IREmitter &emitter, VAR *var) {
+            return new ConcreteCompilerVariable(BOOL, getConstantInt(var->getValue()->size() != 0, g.i1), true);
+        }
+
 };
 ValuedCompilerType<std::string*> *STR_CONSTANT = new StrConstantType();
 
@@ -1058,6 +1139,27 @@ class VoidType : public ConcreteCompilerType {
 };
 ConcreteCompilerType *VOID = new VoidType();
 
+llvm::Value* emitUnboxedLen(IREmitter &emitter, llvm::Value *obj, BoxedClass *cls) {
+    // Like the ones for nonzero, these get inlined into a load of the size (or a call to std::string::size):
+    llvm::Value *f = NULL;
+    if (cls == list_cls)
+        f = g.funcs.listLenUnboxed;
+    else if (cls == tuple_cls)
+        f = g.funcs.tupleLenUnboxed;
+    else if (cls == dict_cls)
+        f = g.funcs.dictLenUnboxed;
+    else if (cls == str_cls)
+        f = g.funcs.strLenUnboxed;
+    if (!f)
+        return NULL;
+
+    llvm::Type *self_type = *llvm::cast<llvm::FunctionType>(llvm::cast<llvm::PointerType>(f->getType())->getElementType())->param_begin();
+    llvm::Value *casted = emitter.getBuilder()->CreateBitCast(obj, self_type);
+    llvm::Value *rtn = emitter.getBuilder()->CreateCall(f, casted);
+    assert(rtn->getType() == g.i64);
+    return rtn;
+}
+
 ConcreteCompilerType* typeFromClass(BoxedClass* c) {
     assert(c);
     return NormalObjectType::fromClass(c);
@@ -1192,7 +1294,9 @@ class TupleType : public ValuedCompilerType<const std::vector<CompilerVariable*>
             std::vector<ConcreteCompilerVariable*> converted_args;
 
             llvm::Value *nelts = llvm::ConstantInt::get(g.i64, v->size(), false);
-            llvm::Value *alloca = emitter.getBuilder()->CreateAlloca(g.llvm_value_type_ptr, nelts);
+            // In the entry block, so that converting a tuple in a loop doesn't keep growing the stack:
+            llvm::Instruction* insertion_point = emitter.getBuilder()->GetInsertBlock()->getParent()->getEntryBlock().getTerminator();
+            llvm::Value *alloca = new llvm::AllocaInst(g.llvm_value_type_ptr, nelts, "tuple_elts", insertion_point);
             for (int i = 0; i < v->size(); i++) {
                 llvm::Value* ptr = emitter.getBuilder()->CreateConstGEP1_32(alloca, i);
                 ConcreteCompilerVariable* converted = (*v)[i]->makeConverted(emitter, (*v)[i]->getBoxType());
@@ -1216,8 +1320,11 @@ class TupleType : public ValuedCompilerType<const std::vector<CompilerVariable*>
             return BOXED_TUPLE;
         }
 
+        static std::unordered_set<CompilerType*> made;
         static TupleType* make(const std::vector<CompilerType*> &elt_types) {
-            return new TupleType(elt_types);
+            TupleType* rtn = new TupleType(elt_types);
+            made.insert(rtn);
+            return rtn;
         }
 
         virtual CompilerVariable* getitem(IREmitter &emitter, VAR *var, CompilerVariable *slice) {
@@ -1245,11 +1352,17 @@ class TupleType : public ValuedCompilerType<const std::vector<CompilerVariable*>
             return new ConcreteCompilerVariable(INT, getConstantInt(var->getValue()->size(), g.i64), true);
         }
 
+        virtual ConcreteCompilerVariable* nonzero(IREmitter &emitter, VAR *var) {
+            return new ConcreteCompilerVariable(BOOL, getConstantInt(var->getValue()->size() != 0, g.i1), true);
+        }
+
         virtual CompilerType* getattrType(const std::string &attr) {
             return BOXED_TUPLE->getattrType(attr);
         }
 };
 
+std::unordered_set<CompilerType*> TupleType::made;
+
 CompilerType* makeTupleType(const std::vector<CompilerType*> &elt_types) {
     return TupleType::make(elt_types);
 }
@@ -1266,6 +1379,67 @@ CompilerVariable* makeTuple(const std::vector<CompilerVariable*> &elts) {
     return new TupleType::VAR(type, alloc_elts, true);
 }
 
+CompilerVariable* tryConstantStrMod(IREmitter &emitter, CompilerVariable* fmt, CompilerVariable* rhs) {
+    if (fmt->getType() != STR_CONSTANT)
+        return NULL;
+    const std::string &fmt_str = *static_cast<ValuedCompilerVariable<std::string*>*>(fmt)->getValue();
+
+    std::vector<CompilerVariable*> args;
+    CompilerType* rhs_type = rhs->getType();
+    if (TupleType::made.count(rhs_type)) {
+        args = *static_cast<TupleType::VAR*>(rhs)->getValue();
+    } else if (rhs_type == INT || rhs_type == FLOAT || rhs_type == BOOL || rhs_type == STR_CONSTANT || rhs_type == STR
+            || rhs_type == BOXED_INT || rhs_type == BOXED_FLOAT || rhs_type == BOXED_BOOL || rhs_type == NONE) {
+        // Anything else could turn out to be a tuple at runtime
+        args.push_back(rhs);
+    } else {
+        return NULL;
+    }
+
+    std::vector<FormatArgKind> kinds;
+    for (int i = 0; i < args.size(); i++) {
+        if (args[i]->getType() == INT)
+            kinds.push_back(FMT_INT);
+        else if (args[i]->getType() == FLOAT)
+            kinds.push_back(FMT_FLOAT);
+        else
+            kinds.push_back(FMT_BOXED);
+    }
+
+    CompiledFormat* cf = compileFormat(fmt_str, kinds);
+    if (cf == NULL)
+        return NULL;
+
+    // Each argument goes in an i64 slot, as whatever the compiled format said it wants:
+    llvm::Value *nslots = getConstantInt(std::max((int)args.size(), 1), g.i64);
+    llvm::Instruction* insertion_point = emitter.getBuilder()->GetInsertBlock()->getParent()->getEntryBlock().getTerminator();
+    llvm::Value *alloca = new llvm::AllocaInst(g.i64, nslots, "fmt_args", insertion_point);
+
+    std::vector<ConcreteCompilerVariable*> converted_args;
+    for (int i = 0; i < args.size(); i++) {
+        llvm::Value* ptr = emitter.getBuilder()->CreateConstGEP1_32(alloca, i);
+        ConcreteCompilerVariable* converted;
+        if (cf->kinds[i] == FMT_INT) {
+            converted = args[i]->makeConverted(emitter, INT);
+        } else if (cf->kinds[i] == FMT_FLOAT) {
+            converted = args[i]->makeConverted(emitter, FLOAT);
+            ptr = emitter.getBuilder()->CreateBitCast(ptr, g.double_->getPointerTo());
+        } else {
+            converted = args[i]->makeConverted(emitter, args[i]->getBoxType());
+            ptr = emitter.getBuilder()->CreateBitCast(ptr, g.llvm_value_type_ptr->getPointerTo());
+        }
+        converted_args.push_back(converted);
+        emitter.getBuilder()->CreateStore(converted->getValue(), ptr);
+    }
+
+    llvm::Value* rtn = emitter.getBuilder()->CreateCall2(g.funcs.strModCompiled, embedConstantPtr(cf, g.i8_ptr), alloca);
+
+    for (int i = 0; i < converted_args.size(); i++) {
+        converted_args[i]->decvref(emitter);
+    }
+    return new ConcreteCompilerVariable(UNKNOWN, rtn, true);
+}
+
 class UndefType : public ConcreteCompilerType {
     public:
         std::string debugName() {
@@ -1275,7 +1449,7 @@ class UndefType : public ConcreteCompilerType {
         llvm::Type* llvmType() override {
             // Something that no one else uses...
             // TODO should do something more rare like a unique custom struct
-            return llvm::Type::getInt16Ty(g.context);
+            return llvm::Type::getInt16Ty(*g.context);
         }
 
         virtual CompilerVariable* call(IREmitter &emitter, VAR *var, const std::vector<CompilerVariable*>& args) {
@@ -1341,6 +1515,6 @@ CompilerVariable* undefVariable() {
 }
 
 
-ConcreteCompilerType *LIST, *SLICE, *MODULE, *DICT;
+ConcreteCompilerType *LIST, *SLICE, *MODULE, *DICT, *SET;
 
 } // namespace pyston
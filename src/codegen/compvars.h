@@ -28,7 +28,7 @@ namespace pyston {
 
 class CompilerType;
 
-extern ConcreteCompilerType *INT, *BOXED_INT, *FLOAT, *BOXED_FLOAT, *VOID, *UNKNOWN, *BOOL, *STR, *NONE, *LIST, *SLICE, *MODULE, *DICT, *BOOL, *BOXED_BOOL, *BOXED_TUPLE;
+extern ConcreteCompilerType *INT, *BOXED_INT, *FLOAT, *BOXED_FLOAT, *VOID, *UNKNOWN, *BOOL, *STR, *NONE, *LIST, *SLICE, *MODULE, *DICT, *SET, *BOOL, *BOXED_BOOL, *BOXED_TUPLE;
 extern CompilerType* UNDEF;
 
 class CompilerType {
@@ -312,9 +312,17 @@ CompilerVariable* makeInt(int64_t);
 CompilerVariable* makeFloat(double);
 CompilerVariable* makeBool(bool);
 CompilerVariable* makeStr(std::string*);
-CompilerVariable* makeFunction(IREmitter &emitter, CLFunction*);
+// closure is NULL unless the function takes one.
+CompilerVariable* makeFunction(IREmitter &emitter, CLFunction*, const std::vector<CompilerVariable*> &defaults, llvm::Value* closure);
 CompilerVariable* undefVariable();
 CompilerVariable* makeTuple(const std::vector<CompilerVariable*> &elts);
+// For fmt % rhs: if fmt is a constant string, formats it with a version of the format that got parsed at
+// compile time, passing ints and floats unboxed.  Returns NULL if that isn't possible.
+CompilerVariable* tryConstantStrMod(IREmitter &emitter, CompilerVariable* fmt, CompilerVariable* rhs);
+
+// len() of obj, which is known to be of class cls, without going through __len__ or boxing the result;
+// returns NULL if cls isn't one of the builtin containers.
+llvm::Value* emitUnboxedLen(IREmitter &emitter, llvm::Value *obj, BoxedClass *cls);
 
 ConcreteCompilerType* typeFromClass(BoxedClass*);
 CompilerType* typeOfClassobj(BoxedClass*);
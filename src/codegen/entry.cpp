@@ -14,6 +14,9 @@
 
 #include <cstdio>
 #include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <type_traits>
 #include <unordered_map>
 
 #include "llvm/Analysis/Passes.h"
@@ -26,17 +29,21 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 
 #include "core/options.h"
+#include "core/stats.h"
 #include "core/types.h"
 
 #include "core/util.h"
 
 #include "codegen/codegen.h"
+#include "codegen/compile_cache.h"
 #include "codegen/compvars.h"
 #include "codegen/dis.h"
 #include "codegen/entry.h"
@@ -49,6 +56,18 @@
 namespace pyston {
 
 GlobalState g;
+__thread llvm::LLVMContext *GlobalState::context;
+__thread llvm::Module *GlobalState::stdlib_module, *GlobalState::cur_module;
+__thread llvm::Type *GlobalState::llvm_value_type, *GlobalState::llvm_value_type_ptr;
+__thread llvm::Type *GlobalState::llvm_class_type, *GlobalState::llvm_class_type_ptr;
+__thread llvm::Type *GlobalState::llvm_flavor_type, *GlobalState::llvm_flavor_type_ptr;
+__thread llvm::Type *GlobalState::llvm_opaque_type;
+__thread llvm::Type *GlobalState::llvm_str_type_ptr;
+__thread llvm::Type *GlobalState::llvm_list_type_ptr, *GlobalState::llvm_list_iterator_type_ptr;
+__thread llvm::Type *GlobalState::llvm_clfunction_type_ptr;
+__thread llvm::Type *GlobalState::llvm_module_type_ptr, *GlobalState::llvm_bool_type_ptr;
+__thread llvm::Type *GlobalState::i1, *GlobalState::i8, *GlobalState::i8_ptr, *GlobalState::i32, *GlobalState::i64, *GlobalState::void_, *GlobalState::double_;
+__thread GlobalFuncs GlobalState::funcs;
 
 extern "C" {
 #ifndef BINARY_SUFFIX
@@ -97,8 +116,8 @@ static llvm::Module* loadStdlib() {
 
     llvm::MemoryBuffer *buffer = llvm::MemoryBuffer::getMemBuffer(data, "", false);
 
-    //llvm::ErrorOr<llvm::Module*> m_or = llvm::parseBitcodeFile(buffer, g.context);
-    llvm::ErrorOr<llvm::Module*> m_or = llvm::getLazyBitcodeModule(buffer, g.context);
+    //llvm::ErrorOr<llvm::Module*> m_or = llvm::parseBitcodeFile(buffer, *g.context);
+    llvm::ErrorOr<llvm::Module*> m_or = llvm::getLazyBitcodeModule(buffer, *g.context);
     RELEASE_ASSERT(m_or, "");
     llvm::Module* m = m_or.get();
     assert(m);
@@ -111,46 +130,77 @@ static llvm::Module* loadStdlib() {
     return m;
 }
 
-class MyObjectCache : public llvm::ObjectCache {
+static bool readFile(const std::string &fn, std::string &data) {
+    FILE* f = fopen(fn.c_str(), "rb");
+    if (!f)
+        return false;
+
+    char buf[1 << 16];
+    while (true) {
+        size_t nread = fread(buf, 1, sizeof(buf), f);
+        if (nread == 0)
+            break;
+        data.append(buf, nread);
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// Keeps the object files for jitted code in the compile cache, so that a later run that ends up generating
+// the same IR can skip the codegen.  The key is a hash of the module's final IR plus the build and the
+// host cpu; the IR already includes everything else that determines the code (effort level, signature,
+// the speculations that were made), and pointers to runtime objects go through the relocation table
+// that embedConstantPtr sets up, so they don't keep the IR from matching.
+class PersistentObjectCache : public llvm::ObjectCache {
     private:
-        bool loaded;
+        std::string build_id;
+        // The misses, which get saved once they're compiled:
+        std::unordered_map<const llvm::Module*, std::string> pending;
+
+        std::string getEntryName(const llvm::Module* M) {
+            std::string key;
+            llvm::raw_string_ostream os(key);
+            M->print(os, NULL);
+            os << build_id;
+            os.flush();
+            return cacheKey(key) + ".o";
+        }
+
     public:
-        MyObjectCache() : loaded(false) {}
+        PersistentObjectCache() {
+            std::string exe;
+            bool found = readFile("/proc/self/exe", exe);
+            RELEASE_ASSERT(found, "couldn't read the executable to get the build id");
+            build_id = cacheKey(exe) + ' ' + llvm::sys::getHostCPUName().str();
+        }
 
-        virtual void notifyObjectCompiled(const llvm::Module *M, const llvm::MemoryBuffer *Obj) {}
+        virtual void notifyObjectCompiled(const llvm::Module *M, const llvm::MemoryBuffer *Obj) {
+            auto it = pending.find(M);
+            if (it == pending.end())
+                return;
+            writeCacheEntry(it->second, std::string(Obj->getBufferStart(), Obj->getBufferSize()));
+            pending.erase(it);
+        }
 
         virtual llvm::MemoryBuffer* getObject(const llvm::Module* M) {
-            assert(!loaded);
-            loaded = true;
-            g.engine->setObjectCache(NULL);
-            std::unique_ptr<MyObjectCache> del_at_end(this);
-
-#if 0
-            if (!USE_STRIPPED_STDLIB) {
-                stajt = STDLIB_CACHE_START;
-                size = (intptr_t)&STDLIB_CACHE_SIZE;
-            } else {
-                start = STRIPPED_STDLIB_CACHE_START;
-                size = (intptr_t)&STRIPPED_STDLIB_CACHE_SIZE;
+            if (M == g.stdlib_module)
+                return NULL;
+
+            static StatCounter sc_hits("jit_cache_hits"), sc_misses("jit_cache_misses");
+
+            std::string name = getEntryName(M);
+            std::string fn = findCacheEntry(name);
+            std::string data;
+            if (fn.empty() || !readFile(fn, data) || data.size() < 4 || data.compare(0, 4, "\x7f" "ELF") != 0) {
+                sc_misses.log();
+                pending[M] = name;
+                return NULL;
             }
-#else
-            RELEASE_ASSERT(0, "");
-            char* start = NULL;
-            intptr_t size = 0;
-#endif
-
-            // Make sure the stdlib got linked in correctly; check the magic number at the beginning:
-            assert(start[0] == 0x7f);
-            assert(start[1] == 'E');
-            assert(start[2] == 'L');
-            assert(start[3] == 'F');
 
-            assert(size > 0 && size < 1 << 30); // make sure the size is being loaded correctly
-
-            llvm::StringRef data(start, size);
-            return llvm::MemoryBuffer::getMemBufferCopy(data, "");
+            sc_hits.log();
+            return llvm::MemoryBuffer::getMemBufferCopy(data, fn);
         }
-
 };
 
 static void handle_sigfpe(int signum) {
@@ -159,14 +209,57 @@ static void handle_sigfpe(int signum) {
     exit(1);
 }
 
+static void initBasicTypes() {
+    g.i1 = llvm::Type::getInt1Ty(*g.context);
+    g.i8 = llvm::Type::getInt8Ty(*g.context);
+    g.i8_ptr = g.i8->getPointerTo();
+    g.i32 = llvm::Type::getInt32Ty(*g.context);
+    g.i64 = llvm::Type::getInt64Ty(*g.context);
+    g.void_ = llvm::Type::getVoidTy(*g.context);
+    g.double_ = llvm::Type::getDoubleTy(*g.context);
+}
+
+void initCodegenThread() {
+    assert(g.context == NULL);
+    g.context = new llvm::LLVMContext();
+    g.stdlib_module = loadStdlib();
+    initBasicTypes();
+    initGlobalFuncs(g);
+}
+
+#define FOR_EACH_THREAD_LOCAL(X) \
+    X(context) X(stdlib_module) X(cur_module) \
+    X(llvm_value_type) X(llvm_value_type_ptr) X(llvm_class_type) X(llvm_class_type_ptr) \
+    X(llvm_flavor_type) X(llvm_flavor_type_ptr) X(llvm_opaque_type) X(llvm_str_type_ptr) \
+    X(llvm_list_type_ptr) X(llvm_list_iterator_type_ptr) X(llvm_clfunction_type_ptr) \
+    X(llvm_module_type_ptr) X(llvm_bool_type_ptr) \
+    X(i1) X(i8) X(i8_ptr) X(i32) X(i64) X(void_) X(double_) \
+    X(funcs)
+
+// The main thread's values, for the threads that use the main context rather than getting their own:
+static struct {
+#define DECLARE(name) std::remove_reference<decltype(GlobalState::name)>::type name;
+    FOR_EACH_THREAD_LOCAL(DECLARE)
+#undef DECLARE
+} main_thread_state;
+
+void shareMainThreadCodegen() {
+    assert(g.context == NULL);
+#define COPY(name) g.name = main_thread_state.name;
+    FOR_EACH_THREAD_LOCAL(COPY)
+#undef COPY
+}
+
 void initCodegen() {
+    g.context = &llvm::getGlobalContext();
+
     llvm::InitializeNativeTarget();
     llvm::InitializeNativeTargetAsmPrinter();
     llvm::InitializeNativeTargetAsmParser();
 
     g.stdlib_module = loadStdlib();
 
-    llvm::EngineBuilder eb(new llvm::Module("empty_initial_module", g.context));
+    llvm::EngineBuilder eb(new llvm::Module("empty_initial_module", *g.context));
     eb.setEngineKind(llvm::EngineKind::JIT); // specify we only want the JIT, and not the interpreter fallback
     eb.setUseMCJIT(true);
     eb.setMCJITMemoryManager(createMemoryManager());
@@ -185,15 +278,10 @@ void initCodegen() {
     g.engine = eb.create(g.tm);
     assert(g.engine && "engine creation failed?");
 
-    //g.engine->setObjectCache(new MyObjectCache());
+    if (compileCacheEnabled())
+        g.engine->setObjectCache(new PersistentObjectCache());
 
-    g.i1 = llvm::Type::getInt1Ty(g.context);
-    g.i8 = llvm::Type::getInt8Ty(g.context);
-    g.i8_ptr = g.i8->getPointerTo();
-    g.i32 = llvm::Type::getInt32Ty(g.context);
-    g.i64 = llvm::Type::getInt64Ty(g.context);
-    g.void_ = llvm::Type::getVoidTy(g.context);
-    g.double_ = llvm::Type::getDoubleTy(g.context);
+    initBasicTypes();
 
     std::vector<llvm::JITEventListener*> listeners = makeJITEventListeners();
     for (int i = 0; i < listeners.size(); i++) {
@@ -242,6 +330,9 @@ void initCodegen() {
     int num_llvm_args = sizeof(llvm_args) / sizeof(llvm_args[0]);
     llvm::cl::ParseCommandLineOptions(num_llvm_args, llvm_args, "<you should never see this>\n");
 
+#define SAVE(name) main_thread_state.name = g.name;
+    FOR_EACH_THREAD_LOCAL(SAVE)
+#undef SAVE
 }
 
 void teardownCodegen() {
@@ -279,9 +370,6 @@ int joinRuntime() {
     // In the future this will have to wait for non-daemon
     // threads to finish
 
-    if (PROFILE)
-        g.func_addr_registry.dumpPerfMap();
-
     teardownRuntime();
     teardownCodegen();
 
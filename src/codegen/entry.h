@@ -22,6 +22,12 @@ class BoxedModule;
 class CompiledFunction;
 
 void initCodegen();
+// Gives the calling thread its own llvm context, with its own copy of the stdlib and the GlobalState types
+// and functions, so that it can work on IR while other threads do.  Has to be called with the codegen lock held.
+void initCodegenThread();
+// Gives the calling thread the main thread's context instead; everything it does with it has to happen while
+// holding the codegen lock, or the GIL for python threads (which never run at the same time as each other).
+void shareMainThreadCodegen();
 void teardownCodegen();
 void printAllIR();
 CompiledFunction* compileModule(AST_Module *m, BoxedModule* bm); // hacky but this method is actually defined in irgen.cpp
@@ -25,9 +25,15 @@ class ConservativeGCBuilder : public GCBuilder {
             assert(ptr_ptr->getType() == g.llvm_value_type_ptr);
             return emitter.getBuilder()->CreateLoad(ptr_ptr);
         }
-        virtual void writePointer(IREmitter& emitter, llvm::Value* ptr_ptr, llvm::Value* ptr_value, bool ignore_existing_value) {
+        virtual void writePointer(IREmitter& emitter, llvm::Value* parent, llvm::Value* ptr_ptr, llvm::Value* ptr_value, bool ignore_existing_value) {
             assert(ptr_ptr->getType() == g.llvm_value_type_ptr);
             emitter.getBuilder()->CreateStore(ptr_value, ptr_ptr);
+
+            // The collector is generational, so tell it about the store.  The barrier gets inlined from
+            // the stdlib, so the common case is just a couple of side-table loads:
+            llvm::Value* parent_raw = emitter.getBuilder()->CreateBitCast(parent, g.i8_ptr);
+            llvm::Value* child = emitter.getBuilder()->CreateBitCast(ptr_value, g.i8_ptr);
+            emitter.getBuilder()->CreateCall2(g.funcs.rt_write_barrier, parent_raw, child);
         }
         virtual void grabPointer(IREmitter& emitter, llvm::Value* ptr) {
         }
@@ -23,7 +23,8 @@ class IREmitter;
 class GCBuilder {
     public:
         virtual llvm::Value* readPointer(IREmitter&, llvm::Value* ptr_ptr) = 0;
-        virtual void writePointer(IREmitter&, llvm::Value* ptr_ptr, llvm::Value* ptr_value, bool ignore_existing_value) = 0;
+        // parent is the object that ptr_ptr points into, for the write barrier.
+        virtual void writePointer(IREmitter&, llvm::Value* parent, llvm::Value* ptr_ptr, llvm::Value* ptr_value, bool ignore_existing_value) = 0;
 
         virtual void grabPointer(IREmitter&, llvm::Value* ptr) = 0;
         virtual void dropPointer(IREmitter&, llvm::Value* ptr) = 0;
@@ -26,9 +26,12 @@
 #include "llvm/IR/Verifier.h"
 #include "llvm/Transforms/Instrumentation.h"
 #include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 
 #include "core/options.h"
 #include "core/stats.h"
+#include "core/threading.h"
+#include "core/trace.h"
 
 #include "core/ast.h"
 #include "core/cfg.h"
@@ -43,14 +46,18 @@
 #include "codegen/irgen.h"
 #include "codegen/patchpoints.h"
 #include "codegen/osrentry.h"
+#include "codegen/type_recording.h"
+#include "codegen/profiling/line_profiler.h"
 #include "codegen/stackmaps.h"
+#include "codegen/irgen/hooks.h"
+#include "codegen/irgen/tiering.h"
 #include "codegen/irgen/util.h"
-#include "codegen/opt/escape_analysis.h"
-#include "codegen/opt/inliner.h"
 #include "codegen/opt/passes.h"
+#include "codegen/opt/pipelines.h"
 
 #include "runtime/types.h"
 #include "runtime/objmodel.h"
+#include "runtime/util.h"
 
 namespace pyston {
 
@@ -68,25 +75,56 @@ void MyInserter::InsertHelper(llvm::Instruction *I, const llvm::Twine &Name,
 class IRGenState {
     private:
         CompiledFunction *cf;
+        // Usually cf's own function and signature; when emitting a callee to get inlined into cf,
+        // these are the ones for that callee's body.
+        llvm::Function *func;
+        FunctionSignature *sig;
         SourceInfo* source_info;
         GCBuilder *gc;
         llvm::MDNode* func_dbg_info;
+        int inline_depth;
 
         llvm::AllocaInst *scratch_space;
         int scratch_size;
 
+        // The closure that the code works with (see ScopeInfo), or NULL if it doesn't have one.  It gets
+        // set up at the function (or OSR) entry, so it's available everywhere else.
+        llvm::Value *closure;
+
+        std::vector<llvm::CallInst*> inlined_calls;
+
     public:
-        IRGenState(CompiledFunction *cf, SourceInfo* source_info, GCBuilder *gc, llvm::MDNode* func_dbg_info) : cf(cf), source_info(source_info), gc(gc), func_dbg_info(func_dbg_info), scratch_space(NULL), scratch_size(0) {
+        IRGenState(CompiledFunction *cf, SourceInfo* source_info, GCBuilder *gc, llvm::MDNode* func_dbg_info) : cf(cf), func(cf->func), sig(cf->sig), source_info(source_info), gc(gc), func_dbg_info(func_dbg_info), inline_depth(0), scratch_space(NULL), scratch_size(0), closure(NULL) {
             assert(cf->func);
             assert(!cf->clfunc); // in this case don't need to pass in sourceinfo
         }
 
+        IRGenState(IRGenState *parent, llvm::Function *func, FunctionSignature *sig, SourceInfo* source_info) : cf(parent->cf), func(func), sig(sig), source_info(source_info), gc(parent->gc), func_dbg_info(parent->func_dbg_info), inline_depth(parent->inline_depth + 1), scratch_space(NULL), scratch_size(0), closure(NULL) {
+        }
+
         CompiledFunction* getCurFunction() {
             return cf;
         }
 
         llvm::Function* getLLVMFunction() {
-            return cf->func;
+            return func;
+        }
+
+        FunctionSignature* getSignature() {
+            return sig;
+        }
+
+        int getInlineDepth() {
+            return inline_depth;
+        }
+
+        // Calls to separately-emitted callee bodies, which get inlined once the function is done:
+        void addInlinedCall(llvm::CallInst *call) {
+            inlined_calls.push_back(call);
+        }
+
+        const std::vector<llvm::CallInst*>& getInlinedCalls() {
+            return inlined_calls;
         }
 
         EffortLevel::EffortLevel getEffortLevel() {
@@ -130,8 +168,8 @@ class IRGenState {
         }
 
         ConcreteCompilerType* getReturnType() {
-            assert(cf->sig);
-            return cf->sig->rtn_type;
+            assert(sig);
+            return sig->rtn_type;
         }
 
         SourceInfo* getSourceInfo() {
@@ -146,6 +184,15 @@ class IRGenState {
         llvm::MDNode* getFuncDbgInfo() {
             return func_dbg_info;
         }
+
+        llvm::Value* getClosure() {
+            return closure;
+        }
+
+        void setClosure(llvm::Value *closure) {
+            assert(this->closure == NULL);
+            this->closure = closure;
+        }
 };
 
 class IREmitterImpl : public IREmitter {
@@ -154,7 +201,7 @@ class IREmitterImpl : public IREmitter {
         IRBuilder *builder;
 
     public:
-        explicit IREmitterImpl(IRGenState *irstate) : irstate(irstate), builder(new IRBuilder(g.context)) {
+        explicit IREmitterImpl(IRGenState *irstate) : irstate(irstate), builder(new IRBuilder(*g.context)) {
             builder->setEmitter(this);
         }
 
@@ -180,7 +227,10 @@ class IREmitterImpl : public IREmitter {
             return irstate->getCurFunction();
         }
 
-        llvm::Value* createPatchpoint(const PatchpointSetupInfo* pp, void* func_addr, const std::vector<llvm::Value*> &args) override {
+        llvm::Value* createPatchpoint(PatchpointSetupInfo* pp, void* func_addr, const std::vector<llvm::Value*> &args) override {
+            // For the IC report:
+            pp->lineno = getBuilder()->getCurrentDebugLocation().getLine();
+
             std::vector<llvm::Value*> pp_args;
             pp_args.push_back(getConstantInt(pp->getPatchpointId(), g.i64));
             pp_args.push_back(getConstantInt(pp->totalSize(), g.i32));
@@ -214,6 +264,22 @@ class IREmitterImpl : public IREmitter {
         }
 };
 
+// Has to run after all the other passes, since it records which values are live across each call.
+static void addGCRootStackmaps(llvm::Function *f, CompiledFunction *cf) {
+    Timer _t("gcroots");
+
+    llvm::FunctionPassManager fpm(g.cur_module);
+    fpm.add(new llvm::DataLayout(*g.tm->getDataLayout()));
+    fpm.add(createGCRootsPass(cf));
+
+    fpm.doInitialization();
+    fpm.run(*f);
+
+    long us = _t.end();
+    static StatCounter us_gcroots("us_compiling_gcroots");
+    us_gcroots.log(us);
+}
+
 static void addIRDebugSymbols(llvm::Function *f) {
     llvm::legacy::PassManager mpm;
 
@@ -226,100 +292,21 @@ static void addIRDebugSymbols(llvm::Function *f) {
 }
 
 static void optimizeIR(llvm::Function *f, EffortLevel::EffortLevel effort) {
-    // TODO maybe should do some simple passes (ex: gvn?) if effort level isn't maximal?
-    // In general, this function needs a lot of tuning.
-    if (effort < EffortLevel::MAXIMAL)
+    // The passes to run at each effort level are set up in opt/pipelines.cpp:
+    if (!hasPassPipeline(effort))
         return;
 
     Timer _t("optimizing");
+    TraceScope _trace("llvm", "optimize");
+    _trace.addArg("function", f->getName().str());
+    _trace.addArg("effort", (long)effort);
 
     llvm::FunctionPassManager fpm(g.cur_module);
 
     fpm.add(new llvm::DataLayout(*g.tm->getDataLayout()));
-
-    if (ENABLE_INLINING && effort >= EffortLevel::MAXIMAL) fpm.add(makeFPInliner(275));
-    fpm.add(llvm::createCFGSimplificationPass());
-
-    fpm.add(llvm::createBasicAliasAnalysisPass());
-    fpm.add(llvm::createTypeBasedAliasAnalysisPass());
-    if (ENABLE_PYSTON_PASSES) {
-        fpm.add(new EscapeAnalysis());
-        fpm.add(createPystonAAPass());
-    }
-
-    if (ENABLE_PYSTON_PASSES) fpm.add(createMallocsNonNullPass());
-
-    // TODO Find the right place for this pass (and ideally not duplicate it)
-    if (ENABLE_PYSTON_PASSES) {
-        fpm.add(llvm::createGVNPass());
-        fpm.add(createConstClassesPass());
-    }
-
-    // TODO: find the right set of passes
-    if (0) {
-        // My original set of passes, that seem to get about 90% of the benefit:
-        fpm.add(llvm::createInstructionCombiningPass());
-        fpm.add(llvm::createReassociatePass());
-        fpm.add(llvm::createGVNPass());
-        fpm.add(llvm::createCFGSimplificationPass());
-    } else {
-        // copied + slightly modified from llvm/lib/Transforms/IPO/PassManagerBuilder.cpp::populateModulePassManager
-        fpm.add(llvm::createEarlyCSEPass());              // Catch trivial redundancies
-        fpm.add(llvm::createJumpThreadingPass());         // Thread jumps.
-        fpm.add(llvm::createCorrelatedValuePropagationPass()); // Propagate conditionals
-        fpm.add(llvm::createCFGSimplificationPass());     // Merge & remove BBs
-        fpm.add(llvm::createInstructionCombiningPass());  // Combine silly seq's
-
-        fpm.add(llvm::createTailCallEliminationPass());   // Eliminate tail calls
-        fpm.add(llvm::createCFGSimplificationPass());     // Merge & remove BBs
-        fpm.add(llvm::createReassociatePass());           // Reassociate expressions
-        fpm.add(llvm::createLoopRotatePass());            // Rotate Loop
-        fpm.add(llvm::createLICMPass());                  // Hoist loop invariants
-        fpm.add(llvm::createLoopUnswitchPass(true /*optimize_for_size*/));
-        fpm.add(llvm::createInstructionCombiningPass());
-        fpm.add(llvm::createIndVarSimplifyPass());        // Canonicalize indvars
-        fpm.add(llvm::createLoopIdiomPass());             // Recognize idioms like memset.
-        fpm.add(llvm::createLoopDeletionPass());          // Delete dead loops
-
-        fpm.add(llvm::createLoopUnrollPass());          // Unroll small loops
-
-        fpm.add(llvm::createGVNPass());                 // Remove redundancies
-        fpm.add(llvm::createMemCpyOptPass());             // Remove memcpy / form memset
-        fpm.add(llvm::createSCCPPass());                  // Constant prop with SCCP
-
-        // Run instcombine after redundancy elimination to exploit opportunities
-        // opened up by them.
-        fpm.add(llvm::createInstructionCombiningPass());
-        fpm.add(llvm::createJumpThreadingPass());         // Thread jumps
-        fpm.add(llvm::createCorrelatedValuePropagationPass());
-        fpm.add(llvm::createDeadStoreEliminationPass());  // Delete dead stores
-
-        fpm.add(llvm::createLoopRerollPass());
-        //fpm.add(llvm::createSLPVectorizerPass());   // Vectorize parallel scalar chains.
-
-
-        fpm.add(llvm::createAggressiveDCEPass());         // Delete dead instructions
-        fpm.add(llvm::createCFGSimplificationPass()); // Merge & remove BBs
-        fpm.add(llvm::createInstructionCombiningPass());  // Clean up after everything.
-
-        //fpm.add(llvm::createBarrierNoopPass());
-        //fpm.add(llvm::createLoopVectorizePass(DisableUnrollLoops, LoopVectorize));
-        fpm.add(llvm::createInstructionCombiningPass());
-        fpm.add(llvm::createCFGSimplificationPass());
-    }
-
-    // TODO Find the right place for this pass (and ideally not duplicate it)
-    if (ENABLE_PYSTON_PASSES) {
-        fpm.add(createConstClassesPass());
-        fpm.add(llvm::createInstructionCombiningPass());
-        fpm.add(llvm::createCFGSimplificationPass());
-        fpm.add(createConstClassesPass());
-        fpm.add(createDeadAllocsPass());
-        //fpm.add(llvm::createSCCPPass());                  // Constant prop with SCCP
-        //fpm.add(llvm::createEarlyCSEPass());              // Catch trivial redundancies
-        //fpm.add(llvm::createInstructionCombiningPass());
-        //fpm.add(llvm::createCFGSimplificationPass());
-    }
+    // The target's cost model, so that the vectorizers know what vector instructions there are:
+    g.tm->addAnalysisPasses(fpm);
+    addPassPipeline(fpm, effort);
 
     fpm.doInitialization();
 
@@ -348,6 +335,30 @@ static void optimizeIR(llvm::Function *f, EffortLevel::EffortLevel effort) {
     us_optimizing.log(us);
 }
 
+// Guard failures go through a counter on their way to the deopt code; once a guard has failed
+// GUARD_FAILURE_THRESHOLD times, we let the runtime know so that it can stop making that speculation.
+static const int GUARD_FAILURE_THRESHOLD = 100;
+static void setGuardFailureTarget(IRGenState *irstate, llvm::BranchInst *guard, llvm::BasicBlock *target, AST_expr *node) {
+    GuardFailureInfo *info = new GuardFailureInfo(irstate->getCurFunction(), node);
+
+    llvm::BasicBlock *count_bb = llvm::BasicBlock::Create(*g.context, "guard_failed", irstate->getLLVMFunction());
+    llvm::BasicBlock *report_bb = llvm::BasicBlock::Create(*g.context, "guard_failed_report", irstate->getLLVMFunction());
+
+    IREmitterImpl emitter(irstate);
+    emitter.getBuilder()->SetInsertPoint(count_bb);
+    llvm::Value *count_ptr = embedConstantPtr(&info->num_failures, g.i64->getPointerTo());
+    llvm::Value *count = emitter.getBuilder()->CreateAdd(emitter.getBuilder()->CreateLoad(count_ptr), getConstantInt(1, g.i64));
+    emitter.getBuilder()->CreateStore(count, count_ptr);
+    llvm::Value *should_report = emitter.getBuilder()->CreateICmpEQ(count, getConstantInt(GUARD_FAILURE_THRESHOLD, g.i64));
+    emitter.getBuilder()->CreateCondBr(should_report, report_bb, target);
+
+    emitter.getBuilder()->SetInsertPoint(report_bb);
+    emitter.getBuilder()->CreateCall(g.funcs.guardFailed, embedConstantPtr(info, g.i8_ptr));
+    emitter.getBuilder()->CreateBr(target);
+
+    guard->setSuccessor(1, count_bb);
+}
+
 class GuardList {
     public:
         struct ExprTypeGuard {
@@ -426,6 +437,73 @@ class GuardList {
         }
 };
 
+CLFunction* wrapFunction(AST_FunctionDef *node, SourceInfo *parent) {
+    // Different compilations of the parent scope of a functiondef (including interpreting it)
+    // should lead to the same CLFunction* being used:
+    static std::unordered_map<AST_FunctionDef*, CLFunction*> made;
+
+    CLFunction* &cl = made[node];
+    if (cl == NULL) {
+        SourceInfo *si = new SourceInfo(parent->parent_module, parent->scoping);
+        si->ast = node;
+
+        AST_arguments *args = node->args;
+        si->arg_names = args->args;
+        if (args->vararg.size()) {
+            AST_Name *vararg = new AST_Name();
+            vararg->id = args->vararg;
+            vararg->ctx_type = AST_TYPE::Param;
+            vararg->lineno = node->lineno;
+            vararg->col_offset = node->col_offset;
+            si->arg_names.push_back(vararg);
+        }
+        if (args->kwarg)
+            si->arg_names.push_back(args->kwarg);
+        if (parent->scoping->getScopeInfoForNode(node)->takesClosure()) {
+            AST_Name *closure = new AST_Name();
+            closure->id = CLOSURE_ARG_NAME;
+            closure->ctx_type = AST_TYPE::Param;
+            closure->lineno = node->lineno;
+            closure->col_offset = node->col_offset;
+            si->arg_names.push_back(closure);
+        }
+
+        cl = new CLFunction(si);
+    }
+    return cl;
+}
+
+// Small, straightforward Python functions can get inlined into MAXIMAL-effort callers:
+static const int MAX_INLINED_STMTS = 40;
+static bool isInlinable(CLFunction *cl, int nargs) {
+    SourceInfo *source = cl->source;
+    // (anything that's been called has had its cfg computed)
+    if (source == NULL || source->ast == NULL || source->ast->type != AST_TYPE::FunctionDef || source->cfg == NULL)
+        return false;
+
+    AST_arguments *args = source->getArgsAST();
+    if (args->args.size() != nargs || args->defaults.size() || args->vararg.size() || args->kwarg)
+        return false;
+
+    ScopeInfo *scope_info = source->scoping->getScopeInfoForNode(source->ast);
+    if (scope_info->createsClosure() || scope_info->takesClosure())
+        return false;
+
+    int nstmts = 0;
+    for (int i = 0; i < source->cfg->blocks.size(); i++) {
+        nstmts += source->cfg->blocks[i]->body.size();
+    }
+    return nstmts <= MAX_INLINED_STMTS;
+}
+
+#define FUNCTION_CL_OFFSET ((char*)&(((BoxedFunction*)0x01)->f) - (char*)0x1)
+#define TUPLE_NELTS_OFFSET ((char*)&(((BoxedTuple*)0x01)->nelts) - (char*)0x1)
+#define TUPLE_ELTS_OFFSET ((char*)&(((BoxedTuple*)0x01)->elts) - (char*)0x1)
+#define CLOSURE_PARENT_OFFSET ((char*)&(((BoxedClosure*)0x01)->parent) - (char*)0x1)
+#define CLOSURE_ELTS_OFFSET ((char*)&(((BoxedClosure*)0x01)->elts) - (char*)0x1)
+
+static llvm::Function* emitInlinedCallee(IRGenState *parent, SourceInfo *source, FunctionSignature *sig);
+
 class IRGenerator {
     private:
         IRGenState *irstate;
@@ -438,6 +516,8 @@ class IRGenerator {
         TypeAnalysis *types;
         GuardList &out_guards;
         const GuardList &in_guards;
+        // Globals that evalConstantGlobal embedded, by the expression that loaded them.
+        std::unordered_map<AST_expr*, Box*> constant_globals;
 
         enum State {
             PARTIAL, // running through a partial block, waiting to hit the first in_guard
@@ -461,13 +541,13 @@ class IRGenerator {
         void createExprTypeGuard(llvm::Value *check_val, AST_expr* node, CompilerVariable* node_value) {
             assert(check_val->getType() == g.i1);
 
-            llvm::Value* md_vals[] = {llvm::MDString::get(g.context, "branch_weights"), getConstantInt(1000), getConstantInt(1)};
-            llvm::MDNode* branch_weights = llvm::MDNode::get(g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
+            llvm::Value* md_vals[] = {llvm::MDString::get(*g.context, "branch_weights"), getConstantInt(1000), getConstantInt(1)};
+            llvm::MDNode* branch_weights = llvm::MDNode::get(*g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
 
             // For some reason there doesn't seem to be the ability to place the new BB
             // right after the current bb (can only place it *before* something else),
             // but we can put it somewhere arbitrary and then move it.
-            llvm::BasicBlock* success_bb = llvm::BasicBlock::Create(g.context, "check_succeeded", irstate->getLLVMFunction());
+            llvm::BasicBlock* success_bb = llvm::BasicBlock::Create(*g.context, "check_succeeded", irstate->getLLVMFunction());
             success_bb->moveAfter(curblock);
 
             llvm::BranchInst* guard = emitter.getBuilder()->CreateCondBr(check_val, success_bb, success_bb, branch_weights);
@@ -518,30 +598,341 @@ class IRGenerator {
             return new ConcreteCompilerVariable(UNKNOWN, rtn, true);
         }
 
+        // How for loops step their iterator.  If the iterator's type is known, ITER_NEXT calls its __hasnext__
+        // and next the same way as any other callattr would (which for the builtin ones are direct calls or
+        // less, and let the value stay unboxed), and hands the result of the __hasnext__ over to the
+        // ITER_HAS_VALUE through a fake.  Otherwise it's a single call to iterNext(), and the value is NULL
+        // once the iterator is done.
+        CompilerVariable* evalLangPrimitive(AST_LangPrimitive *node) {
+            switch (node->opcode) {
+                case AST_LangPrimitive::ITER_NEXT:
+                    return evalIterNext(node);
+                case AST_LangPrimitive::ITER_HAS_VALUE:
+                    return evalIterHasValue(node);
+                case AST_LangPrimitive::RAISE:
+                    return evalRaise(node);
+                default:
+                    RELEASE_ASSERT(0, "%d", node->opcode);
+            }
+        }
+
+        CompilerVariable* evalRaise(AST_LangPrimitive *node) {
+            assert(node->args.size() == 3);
+            for (int i = 0; i < 3; i++) {
+                CompilerVariable *arg = evalExpr(node->args[i]);
+                _setFake(_nodeFakeName(i, node), arg);
+            }
+
+            if (state == PARTIAL) {
+                for (int i = 0; i < 3; i++)
+                    _clearFake(_nodeFakeName(i, node));
+                return NULL;
+            }
+
+            std::vector<ConcreteCompilerVariable*> converted;
+            for (int i = 0; i < 3; i++) {
+                CompilerVariable *arg = _getFake(_nodeFakeName(i, node));
+                converted.push_back(arg->makeConverted(emitter, UNKNOWN));
+                arg->decvref(emitter);
+            }
+
+            llvm::CallInst* call = emitter.getBuilder()->CreateCall3(g.funcs.raise3,
+                    converted[0]->getValue(), converted[1]->getValue(), converted[2]->getValue());
+            call->setDoesNotReturn();
+            for (int i = 0; i < 3; i++)
+                converted[i]->decvref(emitter);
+            return new ConcreteCompilerVariable(UNKNOWN, llvm::UndefValue::get(g.llvm_value_type_ptr), true);
+        }
+
+        std::string _hasNextFakeName(AST_LangPrimitive *node) {
+            assert(node->args[0]->type == AST_TYPE::Name);
+            return _getFakeName("has_next", static_cast<AST_Name*>(node->args[0])->id.c_str());
+        }
+
+        CompilerVariable* evalIterNext(AST_LangPrimitive *node) {
+            CompilerVariable *iter = evalExpr(node->args[0]);
+            if (state == PARTIAL)
+                return NULL;
+
+            IREmitter::IRBuilder *b = emitter.getBuilder();
+
+            if (iter->getType() == UNKNOWN) {
+                ConcreteCompilerVariable *converted = iter->makeConverted(emitter, UNKNOWN);
+                iter->decvref(emitter);
+
+                bool do_patchpoint = ENABLE_ICITERNEXTS && emitter.getTarget() != IREmitter::INTERPRETER;
+                llvm::Value *rtn;
+                if (do_patchpoint) {
+                    PatchpointSetupInfo *pp = patchpoints::createIterNextPatchpoint(emitter.currentFunction());
+
+                    std::vector<llvm::Value*> llvm_args;
+                    llvm_args.push_back(converted->getValue());
+
+                    llvm::Value* uncasted = emitter.createPatchpoint(pp, (void*)pyston::iterNext, llvm_args);
+                    rtn = b->CreateIntToPtr(uncasted, g.llvm_value_type_ptr);
+                } else {
+                    rtn = b->CreateCall(g.funcs.iterNext, converted->getValue());
+                }
+                converted->decvref(emitter);
+                return new ConcreteCompilerVariable(UNKNOWN, rtn, true);
+            }
+
+            std::vector<CompilerVariable*> no_args;
+            CompilerVariable *hasnext = iter->callattr(emitter, "__hasnext__", true, no_args);
+            ConcreteCompilerVariable *has_next = hasnext->nonzero(emitter);
+            hasnext->decvref(emitter);
+
+            llvm::BasicBlock *test_end = curblock;
+            llvm::BasicBlock *next_bb = llvm::BasicBlock::Create(*g.context, "iter_next", irstate->getLLVMFunction());
+            llvm::BasicBlock *join_bb = llvm::BasicBlock::Create(*g.context, "iter_join", irstate->getLLVMFunction());
+            next_bb->moveAfter(curblock);
+            join_bb->moveAfter(next_bb);
+            b->CreateCondBr(has_next->getValue(), next_bb, join_bb);
+
+            curblock = next_bb;
+            b->SetInsertPoint(curblock);
+            CompilerVariable *next = iter->callattr(emitter, "next", true, no_args);
+            ConcreteCompilerVariable *converted_next = next->makeConverted(emitter, next->getConcreteType());
+            next->decvref(emitter);
+            llvm::BasicBlock *next_end = curblock;
+            b->CreateBr(join_bb);
+
+            curblock = join_bb;
+            b->SetInsertPoint(curblock);
+            ConcreteCompilerType *next_type = converted_next->getConcreteType();
+            llvm::PHINode *phi = b->CreatePHI(next_type->llvmType(), 2);
+            phi->addIncoming(converted_next->getValue(), next_end);
+            phi->addIncoming(llvm::Constant::getNullValue(next_type->llvmType()), test_end);
+            converted_next->decvref(emitter);
+            iter->decvref(emitter);
+
+            _setFake(_hasNextFakeName(node), has_next);
+            return new ConcreteCompilerVariable(next_type, phi, true);
+        }
+
+        CompilerVariable* evalIterHasValue(AST_LangPrimitive *node) {
+            CompilerVariable *value = evalExpr(node->args[1]);
+            if (state == PARTIAL)
+                return NULL;
+
+            CompilerVariable *has_next = _getFake(_hasNextFakeName(node), true);
+            if (has_next) {
+                value->decvref(emitter);
+                return has_next;
+            }
+
+            ConcreteCompilerVariable *converted = value->makeConverted(emitter, UNKNOWN);
+            value->decvref(emitter);
+            llvm::Value *has_value = emitter.getBuilder()->CreateIsNotNull(converted->getValue());
+            converted->decvref(emitter);
+            return new ConcreteCompilerVariable(BOOL, has_value, true);
+        }
+
         enum BinExpType {
             BinOp,
             Compare,
         };
+        // Unboxed int add/sub/mult, checked for overflow; on overflow this branches to overflow_bb, which
+        // redoes the operation boxed (see createIntOverflowExit).  The no-overflow path costs one (predicted)
+        // branch.
+        llvm::Value* emitCheckedIntBinop(AST_TYPE::AST_TYPE type, llvm::Value *lhs, llvm::Value *rhs, llvm::BasicBlock *overflow_bb) {
+            // (the llvm interpreter doesn't support the overflow intrinsics, but that tier doesn't speculate)
+            assert(irstate->getEffortLevel() != EffortLevel::INTERPRETED);
+
+            llvm::Intrinsic::ID intrinsic_id;
+            switch (type) {
+                case AST_TYPE::Add:
+                    intrinsic_id = llvm::Intrinsic::sadd_with_overflow;
+                    break;
+                case AST_TYPE::Sub:
+                    intrinsic_id = llvm::Intrinsic::ssub_with_overflow;
+                    break;
+                case AST_TYPE::Mult:
+                    intrinsic_id = llvm::Intrinsic::smul_with_overflow;
+                    break;
+                default:
+                    ASSERT(0, "%s", getOpName(type).c_str());
+                    abort();
+            }
+
+            llvm::Type* overload_types[] = {g.i64};
+            llvm::Function *intrinsic = llvm::Intrinsic::getDeclaration(g.cur_module, intrinsic_id, overload_types);
+            llvm::Value *result = emitter.getBuilder()->CreateCall2(intrinsic, lhs, rhs);
+            llvm::Value *overflowed = emitter.getBuilder()->CreateExtractValue(result, 1);
+
+            llvm::Value* md_vals[] = {llvm::MDString::get(*g.context, "branch_weights"), getConstantInt(1), getConstantInt(1000)};
+            llvm::MDNode* branch_weights = llvm::MDNode::get(*g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
+
+            llvm::BasicBlock* ok_bb = llvm::BasicBlock::Create(*g.context, "int_ok", irstate->getLLVMFunction());
+            ok_bb->moveAfter(curblock);
+            emitter.getBuilder()->CreateCondBr(overflowed, overflow_bb, ok_bb, branch_weights);
+
+            curblock = ok_bb;
+            emitter.getBuilder()->SetInsertPoint(curblock);
+            return emitter.getBuilder()->CreateExtractValue(result, 0);
+        }
+
+        // Where unboxed int math overflows after all: does the operation over again boxed, which promotes
+        // to a long, and then fails the node's guard so that the rest of the function continues in the
+        // deopt version with that as the value.  Every overflow check for the node branches here.
+        llvm::BasicBlock* createIntOverflowExit(AST_BinOp *node, ConcreteCompilerVariable *left, ConcreteCompilerVariable *right) {
+            llvm::BasicBlock *rejoin_bb = curblock;
+            IREmitter::IRBuilder *b = emitter.getBuilder();
+
+            llvm::BasicBlock *overflow_bb = llvm::BasicBlock::Create(*g.context, "int_overflow", irstate->getLLVMFunction());
+            curblock = overflow_bb;
+            b->SetInsertPoint(curblock);
+            ConcreteCompilerVariable *boxed_left = left->makeConverted(emitter, UNKNOWN);
+            ConcreteCompilerVariable *boxed_right = right->makeConverted(emitter, UNKNOWN);
+            CompilerVariable *boxed_rtn = _evalBinExp(boxed_left, boxed_right, node->op_type, BinOp);
+            boxed_left->decvref(emitter);
+            boxed_right->decvref(emitter);
+            createExprTypeGuard(getConstantInt(false, g.i1), node, boxed_rtn);
+            b->CreateUnreachable();
+
+            curblock = rejoin_bb;
+            b->SetInsertPoint(curblock);
+            return overflow_bb;
+        }
+
+        // Python's // and % round towards negative infinity, whereas sdiv / srem round towards zero;
+        // the two only differ when the remainder is nonzero and has the opposite sign of the divisor.
+        // Doesn't check the divisor.
+        llvm::Value* emitFloorDivMod(bool is_mod, llvm::Value *lhs, llvm::Value *rhs) {
+            IREmitter::IRBuilder* b = emitter.getBuilder();
+            llvm::Value *zero = getConstantInt(0, g.i64);
+            llvm::Value *rem = b->CreateSRem(lhs, rhs);
+            llvm::Value *adjust = b->CreateAnd(b->CreateICmpNE(rem, zero), b->CreateICmpSLT(b->CreateXor(rem, rhs), zero));
+            if (is_mod)
+                return b->CreateAdd(rem, b->CreateSelect(adjust, rhs, zero));
+            return b->CreateSub(b->CreateSDiv(lhs, rhs), b->CreateZExt(adjust, g.i64));
+        }
+
+        // Unboxed int // and %.  The runtime versions handle the divisors that need special treatment
+        // (0, which raises, and -1, which can overflow); everything else is done inline, and constant
+        // divisors get left to llvm to turn into shifts or multiplies.
+        llvm::Value* emitIntDivMod(AST_TYPE::AST_TYPE type, llvm::Value *lhs, llvm::Value *rhs) {
+            bool is_mod = (type == AST_TYPE::Mod);
+            llvm::Value *slowpath_func = is_mod ? g.funcs.mod_i64_i64 : g.funcs.div_i64_i64;
+            IREmitter::IRBuilder* b = emitter.getBuilder();
+
+            if (irstate->getEffortLevel() == EffortLevel::INTERPRETED)
+                return b->CreateCall2(slowpath_func, lhs, rhs);
+
+            if (llvm::ConstantInt* c = llvm::dyn_cast<llvm::ConstantInt>(rhs)) {
+                int64_t d = c->getSExtValue();
+                // For positive powers of two, the floor semantics are exactly what the bit ops do:
+                if (d > 0 && (d & (d - 1)) == 0) {
+                    if (is_mod)
+                        return b->CreateAnd(lhs, llvm::ConstantInt::get(g.i64, d - 1, true));
+                    int shift = 0;
+                    while ((1L << shift) != d)
+                        shift++;
+                    return b->CreateAShr(lhs, getConstantInt(shift, g.i64));
+                }
+                if (d == 0 || d == -1)
+                    return b->CreateCall2(slowpath_func, lhs, rhs);
+                return emitFloorDivMod(is_mod, lhs, rhs);
+            }
+
+            // The divisors that need the slow path are the ones where rhs + 1 is 0 or 1:
+            llvm::Value *is_special = b->CreateICmpULT(b->CreateAdd(rhs, getConstantInt(1, g.i64)), getConstantInt(2, g.i64));
+
+            llvm::Value* md_vals[] = {llvm::MDString::get(*g.context, "branch_weights"), getConstantInt(1), getConstantInt(1000)};
+            llvm::MDNode* branch_weights = llvm::MDNode::get(*g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
+
+            llvm::BasicBlock* slow_bb = llvm::BasicBlock::Create(*g.context, "divmod_slow", irstate->getLLVMFunction());
+            llvm::BasicBlock* fast_bb = llvm::BasicBlock::Create(*g.context, "divmod_fast", irstate->getLLVMFunction());
+            llvm::BasicBlock* join_bb = llvm::BasicBlock::Create(*g.context, "divmod_join", irstate->getLLVMFunction());
+            fast_bb->moveAfter(curblock);
+            join_bb->moveAfter(fast_bb);
+            b->CreateCondBr(is_special, slow_bb, fast_bb, branch_weights);
+
+            b->SetInsertPoint(slow_bb);
+            llvm::Value *slow_rtn = b->CreateCall2(slowpath_func, lhs, rhs);
+            b->CreateBr(join_bb);
+
+            b->SetInsertPoint(fast_bb);
+            llvm::Value *fast_rtn = emitFloorDivMod(is_mod, lhs, rhs);
+            b->CreateBr(join_bb);
+
+            curblock = join_bb;
+            b->SetInsertPoint(curblock);
+            llvm::PHINode *phi = b->CreatePHI(g.i64, 2);
+            phi->addIncoming(slow_rtn, slow_bb);
+            phi->addIncoming(fast_rtn, fast_bb);
+            return phi;
+        }
+
+        // Only small constant exponents get done unboxed, since those can be unrolled into checked multiplies
+        // (by squaring, so they overflow exactly when the boxed version would):
+        static const int MAX_UNROLLED_POW = 16;
+        static bool isUnrolledPow(llvm::Value *rhs) {
+            llvm::ConstantInt* c = llvm::dyn_cast<llvm::ConstantInt>(rhs);
+            return c && c->getSExtValue() >= 0 && c->getSExtValue() <= MAX_UNROLLED_POW;
+        }
+
+        llvm::Value* emitIntPow(llvm::Value *lhs, llvm::Value *rhs, llvm::BasicBlock *overflow_bb) {
+            assert(isUnrolledPow(rhs));
+            assert(overflow_bb || llvm::cast<llvm::ConstantInt>(rhs)->getSExtValue() < 2);
+            int64_t e = llvm::cast<llvm::ConstantInt>(rhs)->getSExtValue();
+            llvm::Value *rtn = NULL, *curpow = lhs;
+            while (e) {
+                if (e & 1) {
+                    if (rtn)
+                        rtn = emitCheckedIntBinop(AST_TYPE::Mult, rtn, curpow, overflow_bb);
+                    else
+                        rtn = curpow;
+                }
+                e >>= 1;
+                if (e)
+                    curpow = emitCheckedIntBinop(AST_TYPE::Mult, curpow, curpow, overflow_bb);
+            }
+            if (!rtn)
+                return getConstantInt(1, g.i64);
+            return rtn;
+        }
+
+        ConcreteCompilerVariable* convertToFloat(CompilerVariable *var) {
+            if (var->getType() == FLOAT)
+                return var->makeConverted(emitter, FLOAT);
+
+            ConcreteCompilerVariable *converted = var->makeConverted(emitter, INT);
+            llvm::Value* conv = emitter.getBuilder()->CreateSIToFP(converted->getValue(), g.double_);
+            converted->decvref(emitter);
+            return new ConcreteCompilerVariable(FLOAT, conv, true);
+        }
+
         CompilerVariable* _evalBinExp(CompilerVariable *left, CompilerVariable *right, AST_TYPE::AST_TYPE type, BinExpType exp_type) {
             assert(left);
             assert(right);
 
-            if (left->getType() == INT && right->getType() == INT) {
+            // `not in` is just a negated `in`, which is the one that the compare IC knows how to rewrite;
+            // both of them always produce a bool:
+            if (type == AST_TYPE::NotIn) {
+                assert(exp_type == Compare);
+                CompilerVariable *is_in = _evalBinExp(left, right, AST_TYPE::In, Compare);
+                assert(is_in->getType() == UNKNOWN);
+                llvm::Value *v = static_cast<ConcreteCompilerVariable*>(is_in)->getValue();
+                llvm::Value *was_true = emitter.getBuilder()->CreateICmpEQ(v, embedConstantPtr(True, g.llvm_value_type_ptr));
+                llvm::Value *rtn = emitter.getBuilder()->CreateSelect(was_true, embedConstantPtr(False, g.llvm_value_type_ptr), embedConstantPtr(True, g.llvm_value_type_ptr));
+                is_in->decvref(emitter);
+                return new ConcreteCompilerVariable(UNKNOWN, rtn, true);
+            }
+            // (and they go by the rhs's type, so the unboxed paths don't apply)
+            bool is_contains = (type == AST_TYPE::In);
+
+            if (!is_contains && left->getType() == INT && right->getType() == INT) {
                 ConcreteCompilerVariable *converted_left = left->makeConverted(emitter, INT);
                 ConcreteCompilerVariable *converted_right = right->makeConverted(emitter, INT);
                 llvm::Value *v;
-                if (type == AST_TYPE::Mod) {
-                    v = emitter.getBuilder()->CreateCall2(g.funcs.mod_i64_i64, converted_left->getValue(), converted_right->getValue());
-                } else if (type == AST_TYPE::Div || type == AST_TYPE::FloorDiv) {
-                    v = emitter.getBuilder()->CreateCall2(g.funcs.div_i64_i64, converted_left->getValue(), converted_right->getValue());
-                } else if (type == AST_TYPE::Pow) {
-                    v = emitter.getBuilder()->CreateCall2(g.funcs.pow_i64_i64, converted_left->getValue(), converted_right->getValue());
+                // (the ones that can overflow into a long go through evalIntBinOp instead)
+                assert(type != AST_TYPE::Add && type != AST_TYPE::Sub && type != AST_TYPE::Mult && type != AST_TYPE::Pow);
+                if (type == AST_TYPE::Mod || type == AST_TYPE::Div || type == AST_TYPE::FloorDiv) {
+                    v = emitIntDivMod(type, converted_left->getValue(), converted_right->getValue());
                 } else if (exp_type == BinOp) {
                     llvm::Instruction::BinaryOps binopcode;
                     switch (type) {
-                        case AST_TYPE::Add:
-                            binopcode = llvm::Instruction::Add;
-                            break;
                         case AST_TYPE::BitAnd:
                             binopcode = llvm::Instruction::And;
                             break;
@@ -557,12 +948,6 @@ class IRGenerator {
                         case AST_TYPE::RShift:
                             binopcode = llvm::Instruction::AShr;
                             break;
-                        case AST_TYPE::Mult:
-                            binopcode = llvm::Instruction::Mul;
-                            break;
-                        case AST_TYPE::Sub:
-                            binopcode = llvm::Instruction::Sub;
-                            break;
                         default:
                             ASSERT(0, "%s", getOpName(type).c_str());
                             abort();
@@ -606,24 +991,24 @@ class IRGenerator {
                 return new ConcreteCompilerVariable(v->getType() == g.i64 ? INT : BOOL, v, true);
             }
 
-            if (left->getType() == FLOAT && (right->getType() == FLOAT || right->getType() == INT)) {
-                ConcreteCompilerVariable *converted_left = left->makeConverted(emitter, FLOAT);
+            // Mixed int/float math promotes the int, same as the runtime versions (which convert it
+            // with a plain C cast):
+            bool left_numeric = (left->getType() == FLOAT || left->getType() == INT);
+            bool right_numeric = (right->getType() == FLOAT || right->getType() == INT);
+            // (An int is never the same object as a float, so leave mixed 'is' to the boxed path.)
+            bool mixed_identity = (type == AST_TYPE::Is || type == AST_TYPE::IsNot) && left->getType() != right->getType();
+            if (!is_contains && left_numeric && right_numeric && (left->getType() == FLOAT || right->getType() == FLOAT) && !mixed_identity) {
+                ConcreteCompilerVariable *converted_left = convertToFloat(left);
+                ConcreteCompilerVariable *converted_right = convertToFloat(right);
 
-                ConcreteCompilerVariable *converted_right;
-                if (right->getType() == FLOAT) {
-                    converted_right = right->makeConverted(emitter, FLOAT);
-                } else {
-                    converted_right = right->makeConverted(emitter, INT);
-                    llvm::Value* conv = emitter.getBuilder()->CreateSIToFP(converted_right->getValue(), g.double_);
-                    converted_right->decvref(emitter);
-                    converted_right = new ConcreteCompilerVariable(FLOAT, conv, true);
-                }
                 llvm::Value *v;
                 bool succeeded = true;
                 if (type == AST_TYPE::Mod) {
                     v = emitter.getBuilder()->CreateCall2(g.funcs.mod_float_float, converted_left->getValue(), converted_right->getValue());
-                } else if (type == AST_TYPE::Div || type == AST_TYPE::FloorDiv) {
+                } else if (type == AST_TYPE::Div) {
                     v = emitter.getBuilder()->CreateCall2(g.funcs.div_float_float, converted_left->getValue(), converted_right->getValue());
+                } else if (type == AST_TYPE::FloorDiv) {
+                    v = emitter.getBuilder()->CreateCall2(g.funcs.floordiv_float_float, converted_left->getValue(), converted_right->getValue());
                 } else if (type == AST_TYPE::Pow) {
                     v = emitter.getBuilder()->CreateCall2(g.funcs.pow_float_float, converted_left->getValue(), converted_right->getValue());
                 } else if (exp_type == BinOp) {
@@ -693,6 +1078,28 @@ class IRGenerator {
                     return new ConcreteCompilerVariable(v->getType() == g.double_ ? FLOAT : BOOL, v, true);
                 }
             }
+            // Comparing two known strs (or str constants) for equality doesn't need the compare IC; strEqUnboxed
+            // gets inlined:
+            if (exp_type == Compare && (type == AST_TYPE::Eq || type == AST_TYPE::NotEq)
+                    && left->getType()->getConcreteType() == STR && right->getType()->getConcreteType() == STR) {
+                ConcreteCompilerVariable *converted_left = left->makeConverted(emitter, STR);
+                ConcreteCompilerVariable *converted_right = right->makeConverted(emitter, STR);
+                llvm::Value *f = g.funcs.strEqUnboxed;
+                llvm::Type *str_type = *llvm::cast<llvm::FunctionType>(llvm::cast<llvm::PointerType>(f->getType())->getElementType())->param_begin();
+                IREmitter::IRBuilder* b = emitter.getBuilder();
+                llvm::Value *v = b->CreateCall2(f, b->CreateBitCast(converted_left->getValue(), str_type), b->CreateBitCast(converted_right->getValue(), str_type));
+                if (type == AST_TYPE::NotEq)
+                    v = b->CreateNot(v);
+                converted_left->decvref(emitter);
+                converted_right->decvref(emitter);
+                return new ConcreteCompilerVariable(BOOL, v, true);
+            }
+            if (type == AST_TYPE::Mod && exp_type == BinOp) {
+                CompilerVariable *formatted = tryConstantStrMod(emitter, left, right);
+                if (formatted)
+                    return formatted;
+            }
+
             //ASSERT(left->getType() == left->getBoxType() || right->getType() == right->getBoxType(), "%s %s",
                     //left->getType()->debugName().c_str(), right->getType()->debugName().c_str());
 
@@ -749,12 +1156,52 @@ class IRGenerator {
 
             assert(node->op_type != AST_TYPE::Is && node->op_type != AST_TYPE::IsNot && "not tested yet");
 
-            CompilerVariable *rtn = this->_evalBinExp(left, right, node->op_type, BinOp);
+            AST_TYPE::AST_TYPE type = node->op_type;
+            CompilerVariable *rtn;
+            if (left->getType() == INT && right->getType() == INT
+                    && (type == AST_TYPE::Add || type == AST_TYPE::Sub || type == AST_TYPE::Mult || type == AST_TYPE::Pow))
+                rtn = evalIntBinOp(node, left, right);
+            else
+                rtn = this->_evalBinExp(left, right, type, BinOp);
             left->decvref(emitter);
             right->decvref(emitter);
             return rtn;
         }
 
+        // Int add/sub/mult/pow, which can overflow into a long.  They only get done unboxed where the type
+        // analysis speculated that the result would be an int, since then there's a deopt path to take when
+        // it isn't; anything else is done boxed (and if it was speculated, gets guarded on in evalExpr like
+        // any other speculation).
+        CompilerVariable* evalIntBinOp(AST_BinOp *node, CompilerVariable *left, CompilerVariable *right) {
+            ConcreteCompilerVariable *converted_left = left->makeConverted(emitter, INT);
+            ConcreteCompilerVariable *converted_right = right->makeConverted(emitter, INT);
+            llvm::Value *lhs = converted_left->getValue(), *rhs = converted_right->getValue();
+
+            CompilerVariable *rtn;
+            if (types->speculatedExprClass(node) == int_cls && (node->op_type != AST_TYPE::Pow || isUnrolledPow(rhs))) {
+                // (a pow by 0 or 1 doesn't have anything to check)
+                llvm::BasicBlock *overflow_bb = NULL;
+                if (node->op_type != AST_TYPE::Pow || llvm::cast<llvm::ConstantInt>(rhs)->getSExtValue() >= 2)
+                    overflow_bb = createIntOverflowExit(node, converted_left, converted_right);
+                llvm::Value *v;
+                if (node->op_type == AST_TYPE::Pow)
+                    v = emitIntPow(lhs, rhs, overflow_bb);
+                else
+                    v = emitCheckedIntBinop(node->op_type, lhs, rhs, overflow_bb);
+                rtn = new ConcreteCompilerVariable(INT, v, true);
+            } else {
+                ConcreteCompilerVariable *boxed_left = converted_left->makeConverted(emitter, UNKNOWN);
+                ConcreteCompilerVariable *boxed_right = converted_right->makeConverted(emitter, UNKNOWN);
+                rtn = _evalBinExp(boxed_left, boxed_right, node->op_type, BinOp);
+                boxed_left->decvref(emitter);
+                boxed_right->decvref(emitter);
+            }
+
+            converted_left->decvref(emitter);
+            converted_right->decvref(emitter);
+            return rtn;
+        }
+
         CompilerVariable* evalBoolOp(AST_BoolOp *node) {
             assert(state != PARTIAL);
 
@@ -765,9 +1212,9 @@ class IRGenerator {
 
             std::vector<llvm::BasicBlock*> starting_blocks;
             for (int i = 0; i < nvals - 1; i++) {
-                starting_blocks.push_back(llvm::BasicBlock::Create(g.context, "", irstate->getLLVMFunction()));
+                starting_blocks.push_back(llvm::BasicBlock::Create(*g.context, "", irstate->getLLVMFunction()));
             }
-            llvm::BasicBlock *exit_block = llvm::BasicBlock::Create(g.context, "", irstate->getLLVMFunction());
+            llvm::BasicBlock *exit_block = llvm::BasicBlock::Create(*g.context, "", irstate->getLLVMFunction());
             std::vector<llvm::BasicBlock*> ending_blocks;
 
             std::vector<llvm::Value*> converted_vals;
@@ -845,7 +1292,478 @@ class IRGenerator {
             return rtn;
         }
 
+        // math.sqrt(x) and friends, where x is an unboxed float or int and the type analysis is
+        // speculating that the call returns a float.  If the function turns out to be the math module's,
+        // call its registered double(double) version directly (or the matching llvm intrinsic) without
+        // boxing anything.  Otherwise make the generic call and guard that it returned a float, exactly
+        // like the speculation in evalExpr would have.
+        CompilerVariable* evalUnboxedMathCall(AST_Call *node, CompilerVariable *obj, const std::string &attr, CompilerVariable *arg) {
+            if (types->speculatedExprClass(node) != float_cls)
+                return NULL;
+            if (obj->getType() != UNKNOWN || (arg->getType() != FLOAT && arg->getType() != INT))
+                return NULL;
+
+            Box* rtfunc = math_module->peekattr(attr);
+            if (rtfunc == NULL || rtfunc->cls != function_cls)
+                return NULL;
+
+            void* float_func = NULL;
+            CLFunction *cl = unboxRTFunction(rtfunc);
+            for (int i = 0; i < cl->versions.size(); i++) {
+                FunctionSignature *sig = cl->versions[i]->sig;
+                if (sig->rtn_type == FLOAT && sig->arg_types.size() == 1 && sig->arg_types[0] == FLOAT)
+                    float_func = cl->versions[i]->code;
+            }
+            if (float_func == NULL)
+                return NULL;
+
+            IREmitter::IRBuilder* b = emitter.getBuilder();
+
+            CompilerVariable *func = obj->getattr(emitter, attr);
+            ConcreteCompilerVariable *converted_func = func->makeConverted(emitter, UNKNOWN);
+            func->decvref(emitter);
+
+            llvm::Value *d;
+            if (arg->getType() == FLOAT) {
+                ConcreteCompilerVariable *converted_arg = arg->makeConverted(emitter, FLOAT);
+                d = converted_arg->getValue();
+                converted_arg->decvref(emitter);
+            } else {
+                ConcreteCompilerVariable *converted_arg = arg->makeConverted(emitter, INT);
+                d = b->CreateSIToFP(converted_arg->getValue(), g.double_);
+                converted_arg->decvref(emitter);
+            }
+
+            llvm::Value *is_builtin = b->CreateICmpEQ(converted_func->getValue(), embedConstantPtr(rtfunc, g.llvm_value_type_ptr));
+            // Leave the domain error to the slow path, so that the fast path can be a bare sqrt instruction:
+            if (attr == "sqrt")
+                is_builtin = b->CreateAnd(is_builtin, b->CreateFCmpOGE(d, llvm::ConstantFP::get(g.double_, 0)));
+
+            llvm::Value* md_vals[] = {llvm::MDString::get(*g.context, "branch_weights"), getConstantInt(1000), getConstantInt(1)};
+            llvm::MDNode* branch_weights = llvm::MDNode::get(*g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
+
+            llvm::BasicBlock *fast_bb = llvm::BasicBlock::Create(*g.context, "math_fast", irstate->getLLVMFunction());
+            llvm::BasicBlock *slow_bb = llvm::BasicBlock::Create(*g.context, "math_slow", irstate->getLLVMFunction());
+            llvm::BasicBlock *join_bb = llvm::BasicBlock::Create(*g.context, "math_join", irstate->getLLVMFunction());
+            fast_bb->moveAfter(curblock);
+            join_bb->moveAfter(fast_bb);
+            b->CreateCondBr(is_builtin, fast_bb, slow_bb, branch_weights);
+
+            b->SetInsertPoint(fast_bb);
+            llvm::Value *fast_rtn;
+            if (attr == "sqrt") {
+                llvm::Type* overload_types[] = {g.double_};
+                fast_rtn = b->CreateCall(llvm::Intrinsic::getDeclaration(g.cur_module, llvm::Intrinsic::sqrt, overload_types), d);
+            } else {
+                llvm::Type* double_arg[] = {g.double_};
+                llvm::FunctionType *ft = llvm::FunctionType::get(g.double_, double_arg, false);
+                fast_rtn = b->CreateCall(embedConstantPtr(float_func, ft->getPointerTo()), d);
+            }
+            b->CreateBr(join_bb);
+
+            curblock = slow_bb;
+            b->SetInsertPoint(curblock);
+            std::vector<CompilerVariable*> call_args(1, arg);
+            CompilerVariable *slow_rtn = converted_func->call(emitter, call_args);
+            ConcreteCompilerVariable *boxed_rtn = slow_rtn->makeConverted(emitter, UNKNOWN);
+            slow_rtn->decvref(emitter);
+            converted_func->decvref(emitter);
+
+            createExprTypeGuard(boxed_rtn->makeClassCheck(emitter, float_cls), node, boxed_rtn);
+            ConcreteCompilerVariable *unboxed = unboxVar(BOXED_FLOAT, boxed_rtn->getValue(), true);
+            llvm::BasicBlock *slow_end = curblock;
+            b->CreateBr(join_bb);
+
+            curblock = join_bb;
+            b->SetInsertPoint(curblock);
+            llvm::PHINode *phi = b->CreatePHI(g.double_, 2);
+            phi->addIncoming(fast_rtn, fast_bb);
+            phi->addIncoming(unboxed->getValue(), slow_end);
+            unboxed->decvref(emitter);
+
+            return new ConcreteCompilerVariable(FLOAT, phi, true);
+        }
+
+        // time.perf_counter() and the other timers (which return unboxed floats), and time.hwcounter_read(fd)
+        // with an unboxed int fd (which returns an unboxed int), when the type analysis is speculating on
+        // that result.  Same as evalUnboxedMathCall: if the function is the time module's, call its unboxed
+        // version directly, so that timing a piece of code doesn't add any allocations to it.
+        CompilerVariable* evalUnboxedTimeCall(AST_Call *node, CompilerVariable *obj, const std::string &attr, const std::vector<CompilerVariable*> &args) {
+            BoxedClass *speculated_class = types->speculatedExprClass(node);
+            if (speculated_class != float_cls && speculated_class != int_cls)
+                return NULL;
+            bool is_float = (speculated_class == float_cls);
+            if (obj->getType() != UNKNOWN || args.size() != (is_float ? 0 : 1))
+                return NULL;
+            if (!is_float && args[0]->getType() != INT)
+                return NULL;
+
+            Box* rtfunc = time_module->peekattr(attr);
+            if (rtfunc == NULL || rtfunc->cls != function_cls)
+                return NULL;
+
+            void* unboxed_func = NULL;
+            CLFunction *cl = unboxRTFunction(rtfunc);
+            for (int i = 0; i < cl->versions.size(); i++) {
+                FunctionSignature *sig = cl->versions[i]->sig;
+                if (sig->rtn_type == (is_float ? FLOAT : INT) && sig->arg_types.size() == args.size()
+                        && (args.size() == 0 || sig->arg_types[0] == INT))
+                    unboxed_func = cl->versions[i]->code;
+            }
+            if (unboxed_func == NULL)
+                return NULL;
+
+            IREmitter::IRBuilder* b = emitter.getBuilder();
+
+            CompilerVariable *func = obj->getattr(emitter, attr);
+            ConcreteCompilerVariable *converted_func = func->makeConverted(emitter, UNKNOWN);
+            func->decvref(emitter);
+
+            llvm::Value *is_builtin = b->CreateICmpEQ(converted_func->getValue(), embedConstantPtr(rtfunc, g.llvm_value_type_ptr));
+
+            llvm::Value* md_vals[] = {llvm::MDString::get(*g.context, "branch_weights"), getConstantInt(1000), getConstantInt(1)};
+            llvm::MDNode* branch_weights = llvm::MDNode::get(*g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
+
+            llvm::BasicBlock *fast_bb = llvm::BasicBlock::Create(*g.context, "time_fast", irstate->getLLVMFunction());
+            llvm::BasicBlock *slow_bb = llvm::BasicBlock::Create(*g.context, "time_slow", irstate->getLLVMFunction());
+            llvm::BasicBlock *join_bb = llvm::BasicBlock::Create(*g.context, "time_join", irstate->getLLVMFunction());
+            fast_bb->moveAfter(curblock);
+            join_bb->moveAfter(fast_bb);
+            b->CreateCondBr(is_builtin, fast_bb, slow_bb, branch_weights);
+
+            b->SetInsertPoint(fast_bb);
+            llvm::Type *rtn_type = is_float ? g.double_ : g.i64;
+            std::vector<llvm::Type*> arg_types;
+            std::vector<llvm::Value*> llvm_args;
+            if (!is_float) {
+                ConcreteCompilerVariable *converted_arg = args[0]->makeConverted(emitter, INT);
+                arg_types.push_back(g.i64);
+                llvm_args.push_back(converted_arg->getValue());
+                converted_arg->decvref(emitter);
+            }
+            llvm::FunctionType *ft = llvm::FunctionType::get(rtn_type, arg_types, false);
+            llvm::Value *fast_rtn = b->CreateCall(embedConstantPtr(unboxed_func, ft->getPointerTo()), llvm_args);
+            b->CreateBr(join_bb);
+
+            curblock = slow_bb;
+            b->SetInsertPoint(curblock);
+            CompilerVariable *slow_rtn = converted_func->call(emitter, args);
+            ConcreteCompilerVariable *boxed_rtn = slow_rtn->makeConverted(emitter, UNKNOWN);
+            slow_rtn->decvref(emitter);
+            converted_func->decvref(emitter);
+
+            createExprTypeGuard(boxed_rtn->makeClassCheck(emitter, speculated_class), node, boxed_rtn);
+            ConcreteCompilerVariable *unboxed = unboxVar(is_float ? BOXED_FLOAT : BOXED_INT, boxed_rtn->getValue(), true);
+            llvm::BasicBlock *slow_end = curblock;
+            b->CreateBr(join_bb);
+
+            curblock = join_bb;
+            b->SetInsertPoint(curblock);
+            llvm::PHINode *phi = b->CreatePHI(rtn_type, 2);
+            phi->addIncoming(fast_rtn, fast_bb);
+            phi->addIncoming(unboxed->getValue(), slow_end);
+            unboxed->decvref(emitter);
+
+            return new ConcreteCompilerVariable(is_float ? FLOAT : INT, phi, true);
+        }
+
+        // The class that a value is known to have, without looking at it; NULL if it has to be checked.
+        static BoxedClass* knownClassOf(CompilerVariable *v) {
+            ConcreteCompilerType *t = v->getConcreteType();
+            if (t == INT)
+                return int_cls;
+            if (t == FLOAT)
+                return float_cls;
+            if (t == BOOL)
+                return bool_cls;
+            return t->guaranteedClass();
+        }
+
+        // isinstance(x, C), when both isinstance and C are globals that got embedded as constants.  There
+        // aren't any subclasses, so this is the same check on x's class that the runtime version does,
+        // and it's already known what it comes out to if the type of x is.
+        CompilerVariable* evalIsinstanceCall(AST_Call *node, CompilerVariable *obj) {
+            std::unordered_map<AST_expr*, Box*>::iterator func_it = constant_globals.find(node->func);
+            if (func_it == constant_globals.end() || func_it->second != isinstance_obj)
+                return NULL;
+            std::unordered_map<AST_expr*, Box*>::iterator cls_it = constant_globals.find(node->args[1]);
+            if (cls_it == constant_globals.end() || cls_it->second->cls != type_cls)
+                return NULL;
+            BoxedClass *cls = static_cast<BoxedClass*>(cls_it->second);
+
+            static StatCounter num_inline_isinstance("num_inline_isinstance");
+            num_inline_isinstance.log();
+
+            BoxedClass *known_cls = knownClassOf(obj);
+            if (known_cls)
+                return makeBool(known_cls == cls);
+
+            ConcreteCompilerVariable *converted = obj->makeConverted(emitter, UNKNOWN);
+            llvm::Value *is_instance = converted->makeClassCheck(emitter, cls);
+            converted->decvref(emitter);
+            return new ConcreteCompilerVariable(BOOL, is_instance, true);
+        }
+
+        // len(x), when len is a global that got embedded as a constant.  If the class of x is known, this is
+        // just a load of its size; otherwise the builtin containers get checked for inline, and only other
+        // classes go through unboxedLen.  Either way the result stays unboxed.
+        CompilerVariable* evalLenCall(AST_Call *node, CompilerVariable *obj) {
+            std::unordered_map<AST_expr*, Box*>::iterator func_it = constant_globals.find(node->func);
+            if (func_it == constant_globals.end() || func_it->second != len_obj)
+                return NULL;
+
+            static StatCounter num_inline_len("num_inline_len");
+            num_inline_len.log();
+
+            if (obj->getType() != UNKNOWN)
+                return obj->len(emitter);
+
+            IREmitter::IRBuilder* b = emitter.getBuilder();
+            ConcreteCompilerVariable *converted = obj->makeConverted(emitter, UNKNOWN);
+            llvm::Value *v = converted->getValue();
+            // TODO this is brittle: directly embeds the position of the class object:
+            llvm::Value *cls_value = b->CreateLoad(b->CreateConstInBoundsGEP2_32(v, 0, 0));
+
+            llvm::BasicBlock *join_bb = llvm::BasicBlock::Create(*g.context, "len_join", irstate->getLLVMFunction());
+            std::vector<std::pair<llvm::Value*, llvm::BasicBlock*> > incoming;
+            BoxedClass* container_classes[] = {list_cls, tuple_cls, dict_cls, str_cls};
+            for (BoxedClass *cls : container_classes) {
+                llvm::BasicBlock *fast_bb = llvm::BasicBlock::Create(*g.context, "len_fast", irstate->getLLVMFunction());
+                llvm::BasicBlock *next_bb = llvm::BasicBlock::Create(*g.context, "len_next", irstate->getLLVMFunction());
+                fast_bb->moveAfter(curblock);
+                next_bb->moveAfter(fast_bb);
+                b->CreateCondBr(b->CreateICmpEQ(cls_value, embedConstantPtr(cls, g.llvm_class_type_ptr)), fast_bb, next_bb);
+
+                b->SetInsertPoint(fast_bb);
+                incoming.push_back(std::make_pair(emitUnboxedLen(emitter, v, cls), fast_bb));
+                b->CreateBr(join_bb);
+
+                curblock = next_bb;
+                b->SetInsertPoint(curblock);
+            }
+
+            ConcreteCompilerVariable *slow_rtn = converted->len(emitter);
+            converted->decvref(emitter);
+            incoming.push_back(std::make_pair(slow_rtn->getValue(), curblock));
+            b->CreateBr(join_bb);
+
+            join_bb->moveAfter(curblock);
+            curblock = join_bb;
+            b->SetInsertPoint(curblock);
+            llvm::PHINode *phi = b->CreatePHI(g.i64, incoming.size());
+            for (const std::pair<llvm::Value*, llvm::BasicBlock*> &p : incoming)
+                phi->addIncoming(p.first, p.second);
+            slow_rtn->decvref(emitter);
+
+            return new ConcreteCompilerVariable(INT, phi, true);
+        }
+
+        // sum(x), when sum is a global that got embedded as a constant and x is known to be an xrange (which is
+        // what sum(xrange(n)) ends up as), and the type analysis is speculating that it comes out to an int: the
+        // sum gets worked out from the bounds, and stays unboxed.  If it doesn't fit, this calls sum for real
+        // (which makes it a long) and deopts with that, like the unboxed int math does when it overflows.
+        CompilerVariable* evalSumCall(AST_Call *node, CompilerVariable *obj) {
+            std::unordered_map<AST_expr*, Box*>::iterator func_it = constant_globals.find(node->func);
+            if (func_it == constant_globals.end() || func_it->second != sum_obj)
+                return NULL;
+            if (knownClassOf(obj) != xrange_cls || types->speculatedExprClass(node) != int_cls)
+                return NULL;
+
+            static StatCounter num_inline_sum("num_inline_sum");
+            num_inline_sum.log();
+
+            ConcreteCompilerVariable *converted = obj->makeConverted(emitter, UNKNOWN);
+            llvm::Value *f = g.funcs.xrangeSumUnboxed;
+            llvm::Type *arg_type = *llvm::cast<llvm::FunctionType>(llvm::cast<llvm::PointerType>(f->getType())->getElementType())->param_begin();
+            IREmitter::IRBuilder* b = emitter.getBuilder();
+            llvm::Value *v = b->CreateCall(f, b->CreateBitCast(converted->getValue(), arg_type));
+
+            // xrangeSumUnboxed returns INT64_MIN for the sums that don't fit; a sum that really is INT64_MIN
+            // takes the slow path too, which is still correct, just slower.
+            llvm::Value* md_vals[] = {llvm::MDString::get(*g.context, "branch_weights"), getConstantInt(1), getConstantInt(1000)};
+            llvm::MDNode* branch_weights = llvm::MDNode::get(*g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
+
+            llvm::BasicBlock *overflow_bb = llvm::BasicBlock::Create(*g.context, "sum_overflow", irstate->getLLVMFunction());
+            llvm::BasicBlock *ok_bb = llvm::BasicBlock::Create(*g.context, "sum_ok", irstate->getLLVMFunction());
+            ok_bb->moveAfter(curblock);
+            b->CreateCondBr(b->CreateICmpEQ(v, llvm::ConstantInt::get(g.i64, INT64_MIN, true)), overflow_bb, ok_bb, branch_weights);
+
+            curblock = overflow_bb;
+            b->SetInsertPoint(curblock);
+            ConcreteCompilerVariable *sum_func = new ConcreteCompilerVariable(UNKNOWN, embedConstantPtr(sum_obj, g.llvm_value_type_ptr), false);
+            std::vector<CompilerVariable*> args(1, converted);
+            CompilerVariable *boxed_rtn = sum_func->call(emitter, args);
+            sum_func->decvref(emitter);
+            createExprTypeGuard(getConstantInt(false, g.i1), node, boxed_rtn);
+            b->CreateUnreachable();
+
+            curblock = ok_bb;
+            b->SetInsertPoint(curblock);
+            converted->decvref(emitter);
+            return new ConcreteCompilerVariable(INT, v, true);
+        }
+
+        // Inlines the body of the function that the lower tiers saw getting called here, if it's small
+        // enough.  The inlined code is guarded on the CLFunction (ie the code being inlined)
+        // rather than on the function object, so it still applies if the function gets redefined
+        // with the same def; anything else falls back to the regular call.  The arguments get
+        // passed with their current types, so unboxed values can stay unboxed in the callee.
+        CompilerVariable* evalInlinedCall(AST_Call *node, CompilerVariable *func, const std::vector<CompilerVariable*> &args) {
+            if (!ENABLE_PYTHON_INLINING || irstate->getEffortLevel() != EffortLevel::MAXIMAL || irstate->getInlineDepth() > 0)
+                return NULL;
+            if (func->getType() != UNKNOWN || args.size() > 3)
+                return NULL;
+
+            // If the function is a global that got embedded as a constant, it's already known what it is:
+            Box *constant_func = NULL;
+            std::unordered_map<AST_expr*, Box*>::iterator constant_it = constant_globals.find(node->func);
+            if (constant_it != constant_globals.end() && constant_it->second->cls == function_cls)
+                constant_func = constant_it->second;
+
+            CLFunction *cl;
+            if (constant_func)
+                cl = static_cast<BoxedFunction*>(constant_func)->f;
+            else
+                cl = getTypeFeedback(irstate->getSourceInfo())->predictCallee(node);
+            if (cl == NULL || !isInlinable(cl, args.size()))
+                return NULL;
+            // Not worth the code size if the lower tiers never got here:
+            if (getTypeFeedback(irstate->getSourceInfo())->isColdBlock(myblock))
+                return NULL;
+
+            if (VERBOSITY("irgen") >= 1)
+                printf("Inlining %s into a call on line %d\n", cl->source->getName().c_str(), node->lineno);
+            static StatCounter num_python_inlines("num_python_inlines");
+            num_python_inlines.log();
+
+            std::vector<ConcreteCompilerType*> arg_types;
+            for (int i = 0; i < args.size(); i++) {
+                ConcreteCompilerType *t = args[i]->getConcreteType();
+                if (t != INT && t != FLOAT)
+                    t = UNKNOWN;
+                arg_types.push_back(t);
+            }
+            FunctionSignature *sig = new FunctionSignature(UNKNOWN, arg_types, false);
+            llvm::Function *inlined_func = emitInlinedCallee(irstate, cl->source, sig);
+
+            IREmitter::IRBuilder* b = emitter.getBuilder();
+            ConcreteCompilerVariable *converted_func = func->makeConverted(emitter, UNKNOWN);
+
+            llvm::Value* md_vals[] = {llvm::MDString::get(*g.context, "branch_weights"), getConstantInt(1000), getConstantInt(1)};
+            llvm::MDNode* branch_weights = llvm::MDNode::get(*g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
+
+            llvm::BasicBlock *inline_bb = llvm::BasicBlock::Create(*g.context, "inline", irstate->getLLVMFunction());
+            llvm::BasicBlock *slow_bb = llvm::BasicBlock::Create(*g.context, "inline_slow", irstate->getLLVMFunction());
+            llvm::BasicBlock *join_bb = llvm::BasicBlock::Create(*g.context, "inline_join", irstate->getLLVMFunction());
+            inline_bb->moveAfter(curblock);
+            join_bb->moveAfter(inline_bb);
+
+            if (constant_func) {
+                // (the slow path is left unreachable, and llvm will get rid of it)
+                b->CreateBr(inline_bb);
+            } else {
+                llvm::BasicBlock *check_bb = llvm::BasicBlock::Create(*g.context, "inline_check", irstate->getLLVMFunction());
+                check_bb->moveAfter(curblock);
+                b->CreateCondBr(converted_func->makeClassCheck(emitter, function_cls), check_bb, slow_bb, branch_weights);
+
+                b->SetInsertPoint(check_bb);
+                llvm::Value *cl_ptr = b->CreateConstGEP1_32(b->CreateBitCast(converted_func->getValue(), g.i8_ptr), FUNCTION_CL_OFFSET);
+                llvm::Value *loaded_cl = b->CreateLoad(b->CreateBitCast(cl_ptr, g.i8_ptr->getPointerTo()));
+                llvm::Value *is_cl = b->CreateICmpEQ(loaded_cl, embedConstantPtr(cl, g.i8_ptr));
+                b->CreateCondBr(is_cl, inline_bb, slow_bb, branch_weights);
+            }
+
+            b->SetInsertPoint(inline_bb);
+            std::vector<llvm::Value*> llvm_args;
+            for (int i = 0; i < args.size(); i++) {
+                ConcreteCompilerVariable *converted = args[i]->makeConverted(emitter, arg_types[i]);
+                llvm_args.push_back(converted->getValue());
+                converted->decvref(emitter);
+            }
+            llvm::CallInst *inlined_rtn = b->CreateCall(inlined_func, llvm_args);
+            irstate->addInlinedCall(inlined_rtn);
+            b->CreateBr(join_bb);
+
+            curblock = slow_bb;
+            b->SetInsertPoint(curblock);
+            CompilerVariable *slow_rtn = converted_func->call(emitter, args);
+            ConcreteCompilerVariable *boxed_rtn = slow_rtn->makeConverted(emitter, UNKNOWN);
+            slow_rtn->decvref(emitter);
+            converted_func->decvref(emitter);
+            llvm::BasicBlock *slow_end = curblock;
+            b->CreateBr(join_bb);
+
+            curblock = join_bb;
+            b->SetInsertPoint(curblock);
+            llvm::PHINode *phi = b->CreatePHI(g.llvm_value_type_ptr, 2);
+            phi->addIncoming(inlined_rtn, inline_bb);
+            phi->addIncoming(boxed_rtn->getValue(), slow_end);
+            boxed_rtn->decvref(emitter);
+
+            return new ConcreteCompilerVariable(UNKNOWN, phi, true);
+        }
+
+        // Calls with keyword arguments go through runtimeCallKeywords, with everything passed boxed
+        // in an array.  The names of the keywords (and the argument mapping that the runtime works
+        // out for them) live in a KeywordCallSite that belongs to this code.
+        CompilerVariable* evalKeywordCall(AST_Call *node) {
+            RELEASE_ASSERT(node->func->type != AST_TYPE::ClsAttribute, "");
+
+            AST_expr *func_node = node->func;
+            if (func_node->type == AST_TYPE::Attribute)
+                func_node = static_cast<AST_Attribute*>(func_node)->value;
+            _setFake(_nodeFakeName(-1, node), evalExpr(func_node));
+
+            int npositional = node->args.size();
+            int nargs = npositional + node->keywords.size();
+            for (int i = 0; i < nargs; i++) {
+                AST_expr *arg = i < npositional ? node->args[i] : node->keywords[i - npositional]->value;
+                _setFake(_nodeFakeName(i, node), evalExpr(arg));
+            }
+            if (state == PARTIAL) {
+                _clearFake(_nodeFakeName(-1, node));
+                for (int i = 0; i < nargs; i++) {
+                    _clearFake(_nodeFakeName(i, node));
+                }
+                return NULL;
+            }
+
+            CompilerVariable *func = _getFake(_nodeFakeName(-1, node));
+            if (node->func->type == AST_TYPE::Attribute) {
+                CompilerVariable *obj = func;
+                func = obj->getattr(emitter, static_cast<AST_Attribute*>(node->func)->attr);
+                obj->decvref(emitter);
+            }
+            ConcreteCompilerVariable *converted_func = func->makeConverted(emitter, UNKNOWN);
+            func->decvref(emitter);
+
+            IREmitter::IRBuilder* b = emitter.getBuilder();
+            // Same as the argument arrays for regular calls, this goes in the entry block:
+            llvm::Instruction* insertion_point = b->GetInsertBlock()->getParent()->getEntryBlock().getTerminator();
+            llvm::Value *arg_array = new llvm::AllocaInst(g.llvm_value_type_ptr, getConstantInt(nargs, g.i64), "kwarg_scratch", insertion_point);
+            for (int i = 0; i < nargs; i++) {
+                CompilerVariable *arg = _getFake(_nodeFakeName(i, node));
+                ConcreteCompilerVariable *converted = arg->makeConverted(emitter, UNKNOWN);
+                b->CreateStore(converted->getValue(), b->CreateConstGEP1_32(arg_array, i));
+                converted->decvref(emitter);
+                arg->decvref(emitter);
+            }
+
+            std::vector<const std::string*> keyword_names;
+            for (int i = 0; i < node->keywords.size(); i++) {
+                keyword_names.push_back(internString(node->keywords[i]->arg));
+            }
+            KeywordCallSite *site = new KeywordCallSite(npositional, keyword_names);
+
+            llvm::Value *rtn = b->CreateCall3(g.funcs.runtimeCallKeywords, converted_func->getValue(), embedConstantPtr(site, g.i8_ptr), arg_array);
+            converted_func->decvref(emitter);
+            return new ConcreteCompilerVariable(UNKNOWN, rtn, true);
+        }
+
         CompilerVariable* evalCall(AST_Call *node) {
+            if (node->keywords.size())
+                return evalKeywordCall(node);
+
             bool is_callattr;
             bool callattr_clsonly = false;
             std::string *attr = NULL;
@@ -890,8 +1808,30 @@ class IRGenerator {
             //if (VERBOSITY("irgen") >= 1)
                 //_addAnnotation("before_call");
 
-            CompilerVariable *rtn;
-            if (is_callattr) {
+            // Let the top tier know which function gets called here, in case it's worth inlining:
+            if (!is_callattr && irstate->getEffortLevel() <= EffortLevel::MINIMAL && func->getType() == UNKNOWN) {
+                CalleeRecorder *recorder = getTypeFeedback(irstate->getSourceInfo())->getCalleeRecorder(node);
+                llvm::Value *boxed = static_cast<ConcreteCompilerVariable*>(func)->getValue();
+                emitter.getBuilder()->CreateCall2(g.funcs.recordCallee, embedConstantPtr(recorder, g.i8_ptr), boxed);
+            }
+
+            CompilerVariable *rtn = NULL;
+            if (is_callattr && !callattr_clsonly && args.size() == 1)
+                rtn = evalUnboxedMathCall(node, func, *attr, args[0]);
+            else if (!is_callattr && args.size() == 2)
+                rtn = evalIsinstanceCall(node, args[0]);
+            else if (!is_callattr && args.size() == 1)
+                rtn = evalLenCall(node, args[0]);
+            if (!rtn && !is_callattr && args.size() == 1)
+                rtn = evalSumCall(node, args[0]);
+            if (!rtn && is_callattr && !callattr_clsonly && args.size() <= 1)
+                rtn = evalUnboxedTimeCall(node, func, *attr, args);
+            if (!rtn && !is_callattr)
+                rtn = evalInlinedCall(node, func, args);
+
+            if (rtn) {
+                // pass
+            } else if (is_callattr) {
                 rtn = func->callattr(emitter, *attr, callattr_clsonly, args);
             } else {
                 rtn = func->call(emitter, args);
@@ -937,7 +1877,7 @@ class IRGenerator {
         void _addAnnotation(const char* message) {
             llvm::Instruction *inst = emitter.getBuilder()->CreateCall(llvm::Intrinsic::getDeclaration(g.cur_module, llvm::Intrinsic::donothing));
             llvm::Value* md_vals[] = {getConstantInt(0)};
-            llvm::MDNode* mdnode = llvm::MDNode::get(g.context, md_vals);
+            llvm::MDNode* mdnode = llvm::MDNode::get(*g.context, md_vals);
             inst->setMetadata(message, mdnode);
         }
 
@@ -963,7 +1903,9 @@ class IRGenerator {
                 elts.push_back(_getFake(_nodeFakeName(i, node)));
             }
 
-            llvm::Value* v = emitter.getBuilder()->CreateCall(g.funcs.createList);
+            // Sized up front, so that the appends all take listAppendInternal's inlined fast path (other than the
+            // first one, which picks the strategy):
+            llvm::Value* v = emitter.getBuilder()->CreateCall(g.funcs.createListSized, getConstantInt(node->elts.size(), g.i64));
             ConcreteCompilerVariable *rtn = new ConcreteCompilerVariable(LIST, v, true);
 
             llvm::Value *f = g.funcs.listAppendInternal;
@@ -985,11 +1927,89 @@ class IRGenerator {
             return v;
         }
 
+        // The cell that getGlobal() keeps for this name, if the lower tiers already made one.  (Making one
+        // here would invalidate the module's setattr ICs for nothing.)
+        static BoxedModule::GlobalCell* findGlobalCell(BoxedModule *m, const std::string *interned_name) {
+            std::unordered_map<const std::string*, BoxedModule::GlobalCell>::iterator it = m->global_cells.find(interned_name);
+            if (it == m->global_cells.end())
+                return NULL;
+            return &it->second;
+        }
+
+        llvm::Value* isGlobalUnchanged(BoxedModule::GlobalCell *cell) {
+            llvm::Value *changes = emitter.getBuilder()->CreateLoad(embedConstantPtr(&cell->num_changes, g.i32->getPointerTo()));
+            return emitter.getBuilder()->CreateICmpEQ(changes, getConstantInt(cell->num_changes, g.i32));
+        }
+
+        // In the top tier, globals (or builtins) that are bound to a function or class and haven't been
+        // changed too often get embedded as constants, which lets calls to them get inlined without
+        // checking what they are.  Invalidating the getGlobal ICs doesn't do anything for code that's
+        // already running, so every use still compares the cell's change count with the one it was
+        // compiled with, and deopts (with the real value) if the global has been assigned to since.
+        CompilerVariable* evalConstantGlobal(AST_Name *node) {
+            if (!ENABLE_SPECULATION || irstate->getEffortLevel() != EffortLevel::MAXIMAL || irstate->getInlineDepth() > 0)
+                return NULL;
+            // Not in the deopt version, and not in module-level code since that only runs once anyway:
+            if (!in_guards.isEmpty() || irstate->getSourceInfo()->ast->type == AST_TYPE::Module)
+                return NULL;
+
+            BoxedModule *module = irstate->getSourceInfo()->parent_module;
+            const std::string *name = internString(node->id);
+
+            BoxedModule::GlobalCell *cell = findGlobalCell(module, name);
+            if (cell == NULL || cell->num_changes >= BoxedModule::MAX_GLOBAL_CHANGES)
+                return NULL;
+
+            BoxedModule::GlobalCell *builtin_cell = NULL;
+            Box *value = module->peekattr(node->id);
+            if (value == NULL) {
+                builtin_cell = findGlobalCell(builtins_module, name);
+                if (builtin_cell == NULL || builtin_cell->num_changes >= BoxedModule::MAX_GLOBAL_CHANGES)
+                    return NULL;
+                value = builtins_module->peekattr(node->id);
+            }
+            if (value == NULL || (value->cls != function_cls && value->cls != type_cls))
+                return NULL;
+
+            static StatCounter num_constant_globals("num_constant_globals");
+            num_constant_globals.log();
+
+            IREmitter::IRBuilder *b = emitter.getBuilder();
+            llvm::Value *unchanged = isGlobalUnchanged(cell);
+            if (builtin_cell)
+                unchanged = b->CreateAnd(unchanged, isGlobalUnchanged(builtin_cell));
+
+            llvm::Value* md_vals[] = {llvm::MDString::get(*g.context, "branch_weights"), getConstantInt(1000), getConstantInt(1)};
+            llvm::MDNode* branch_weights = llvm::MDNode::get(*g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
+
+            llvm::BasicBlock *changed_bb = llvm::BasicBlock::Create(*g.context, "global_changed", irstate->getLLVMFunction());
+            llvm::BasicBlock *unchanged_bb = llvm::BasicBlock::Create(*g.context, "global_unchanged", irstate->getLLVMFunction());
+            unchanged_bb->moveAfter(curblock);
+            b->CreateCondBr(unchanged, unchanged_bb, changed_bb, branch_weights);
+
+            // The slow path looks the global up for real and then unconditionally fails a guard, so that the
+            // rest of the function continues in the deopt version:
+            curblock = changed_bb;
+            b->SetInsertPoint(curblock);
+            llvm::Value *r = b->CreateCall3(g.funcs.getGlobal, embedConstantPtr(module, g.llvm_module_type_ptr), embedConstantPtr(name, g.llvm_str_type_ptr), getConstantInt(false, g.i1));
+            createExprTypeGuard(getConstantInt(false, g.i1), node, new ConcreteCompilerVariable(UNKNOWN, r, true));
+            b->CreateUnreachable();
+
+            curblock = unchanged_bb;
+            b->SetInsertPoint(curblock);
+            constant_globals[node] = value;
+            return new ConcreteCompilerVariable(UNKNOWN, embedConstantPtr(value, g.llvm_value_type_ptr), false);
+        }
+
         CompilerVariable* evalName(AST_Name *node) {
             if (state == PARTIAL)
                 return NULL;
 
             if (irstate->getScopeInfo()->refersToGlobal(node->id)) {
+                CompilerVariable *constant = evalConstantGlobal(node);
+                if (constant)
+                    return constant;
+
                 if (1) {
                     // Method 1: calls into the runtime getGlobal(), which handles things like falling back to builtins
                     // or raising the correct error message.
@@ -1000,14 +2020,14 @@ class IRGenerator {
 
                         std::vector<llvm::Value*> llvm_args;
                         llvm_args.push_back(embedConstantPtr(irstate->getSourceInfo()->parent_module, g.llvm_module_type_ptr));
-                        llvm_args.push_back(embedConstantPtr(&node->id, g.llvm_str_type_ptr));
+                        llvm_args.push_back(embedConstantPtr(internString(node->id), g.llvm_str_type_ptr));
                         llvm_args.push_back(getConstantInt(from_global, g.i1));
 
                         llvm::Value* uncasted = emitter.createPatchpoint(pp, (void*)pyston::getGlobal, llvm_args);
                         llvm::Value* r = emitter.getBuilder()->CreateIntToPtr(uncasted, g.llvm_value_type_ptr);
                         return new ConcreteCompilerVariable(UNKNOWN, r, true);
                     } else {
-                        llvm::Value *r = emitter.getBuilder()->CreateCall3(g.funcs.getGlobal, embedConstantPtr(irstate->getSourceInfo()->parent_module, g.llvm_module_type_ptr), embedConstantPtr(&node->id, g.llvm_str_type_ptr), getConstantInt(from_global, g.i1));
+                        llvm::Value *r = emitter.getBuilder()->CreateCall3(g.funcs.getGlobal, embedConstantPtr(irstate->getSourceInfo()->parent_module, g.llvm_module_type_ptr), embedConstantPtr(internString(node->id), g.llvm_str_type_ptr), getConstantInt(from_global, g.i1));
                         return new ConcreteCompilerVariable(UNKNOWN, r, true);
                     }
                 } else {
@@ -1018,6 +2038,8 @@ class IRGenerator {
                     mod->decvref(emitter);
                     return attr;
                 }
+            } else if (irstate->getScopeInfo()->refersToClosure(node->id)) {
+                return _loadFromClosure(node->id);
             } else {
                 if (symbol_table.find(node->id) == symbol_table.end()) {
                     // TODO should mark as DEAD here, though we won't end up setting all the names appropriately
@@ -1039,6 +2061,48 @@ class IRGenerator {
             }
         }
 
+        // The address of a variable in a closure, depth parent links up from the one that we work with.
+        llvm::Value* _getClosureSlot(int depth, int slot) {
+            IREmitter::IRBuilder* b = emitter.getBuilder();
+            llvm::Value* closure = irstate->getClosure();
+            assert(closure);
+            for (int i = 0; i < depth; i++) {
+                llvm::Value* raw = b->CreateBitCast(closure, g.i8_ptr);
+                closure = b->CreateLoad(b->CreateBitCast(b->CreateConstGEP1_32(raw, CLOSURE_PARENT_OFFSET), g.llvm_value_type_ptr->getPointerTo()));
+            }
+            llvm::Value* raw = b->CreateBitCast(closure, g.i8_ptr);
+            llvm::Value* elts = b->CreateBitCast(b->CreateConstGEP1_32(raw, CLOSURE_ELTS_OFFSET), g.llvm_value_type_ptr->getPointerTo());
+            return b->CreateConstGEP1_32(elts, slot);
+        }
+
+        // Variables of enclosing functions have to get loaded every time, since those functions can
+        // still change them.  NULL means the enclosing function hasn't assigned it (yet).
+        CompilerVariable* _loadFromClosure(const std::string &name) {
+            int depth, slot;
+            irstate->getScopeInfo()->getClosureLookup(name, &depth, &slot);
+
+            IREmitter::IRBuilder* b = emitter.getBuilder();
+            llvm::Value* v = b->CreateLoad(_getClosureSlot(depth, slot));
+
+            llvm::BasicBlock *defined_bb = llvm::BasicBlock::Create(*g.context, "closure_defined", irstate->getLLVMFunction());
+            llvm::BasicBlock *undefined_bb = llvm::BasicBlock::Create(*g.context, "closure_undefined", irstate->getLLVMFunction());
+            defined_bb->moveAfter(curblock);
+
+            llvm::Value* md_vals[] = {llvm::MDString::get(*g.context, "branch_weights"), getConstantInt(1), getConstantInt(1000)};
+            llvm::MDNode* branch_weights = llvm::MDNode::get(*g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
+            llvm::Value* is_undefined = b->CreateICmpEQ(v, embedConstantPtr(NULL, g.llvm_value_type_ptr));
+            b->CreateCondBr(is_undefined, undefined_bb, defined_bb, branch_weights);
+
+            b->SetInsertPoint(undefined_bb);
+            llvm::CallInst *call = b->CreateCall(g.funcs.raiseUndefinedClosureName, getStringConstantPtr(name + '\0'));
+            call->setDoesNotReturn();
+            b->CreateUnreachable();
+
+            curblock = defined_bb;
+            b->SetInsertPoint(curblock);
+            return new ConcreteCompilerVariable(UNKNOWN, v, false);
+        }
+
         CompilerVariable* evalNum(AST_Num *node) {
             if (state == PARTIAL)
                 return NULL;
@@ -1055,9 +2119,23 @@ class IRGenerator {
                 return NULL;
 
             CompilerVariable *start, *stop, *step;
-            start = node->lower ? evalExpr(node->lower) : getNone();
-            stop = node->upper ? evalExpr(node->upper) : getNone();
-            step = node->step ? evalExpr(node->step) : getNone();
+            start = node->lower ? evalExpr(node->lower) : NULL;
+            stop = node->upper ? evalExpr(node->upper) : NULL;
+            step = node->step ? evalExpr(node->step) : NULL;
+            return _makeSlice(start, stop, step);
+        }
+
+        CompilerVariable* evalStr(AST_Str *node) {
+            if (state == PARTIAL)
+                return NULL;
+            return makeStr(&node->s);
+        }
+
+        // Makes a slice object, for the bounds that were given (the rest are None):
+        CompilerVariable* _makeSlice(CompilerVariable *start, CompilerVariable *stop, CompilerVariable *step) {
+            if (!start) start = getNone();
+            if (!stop) stop = getNone();
+            if (!step) step = getNone();
 
             ConcreteCompilerVariable *cstart, *cstop, *cstep;
             cstart = start->makeConverted(emitter, start->getBoxType());
@@ -1079,13 +2157,210 @@ class IRGenerator {
             return new ConcreteCompilerVariable(SLICE, rtn, true);
         }
 
-        CompilerVariable* evalStr(AST_Str *node) {
-            if (state == PARTIAL)
+        // Slicing a list or a str with int bounds (or none) doesn't need a slice object, the bounds can
+        // get passed unboxed to the type's slicing function instead.
+        CompilerVariable* evalSliceSubscript(AST_Subscript *node) {
+            AST_Slice *slice = static_cast<AST_Slice*>(node->slice);
+            AST_expr* bound_nodes[3] = {slice->lower, slice->upper, slice->step};
+
+            CompilerVariable *value = evalExpr(node->value);
+            _setFake(_nodeFakeName(0, node), value);
+            for (int i = 0; i < 3; i++) {
+                if (bound_nodes[i])
+                    _setFake(_nodeFakeName(i + 1, node), evalExpr(bound_nodes[i]));
+            }
+
+            if (state == PARTIAL) {
+                _clearFake(_nodeFakeName(0, node));
+                for (int i = 0; i < 3; i++) {
+                    if (bound_nodes[i])
+                        _clearFake(_nodeFakeName(i + 1, node));
+                }
                 return NULL;
-            return makeStr(&node->s);
+            }
+
+            value = _getFake(_nodeFakeName(0, node));
+            CompilerVariable* bounds[3] = {NULL, NULL, NULL};
+            bool unboxed_bounds = true;
+            for (int i = 0; i < 3; i++) {
+                if (bound_nodes[i]) {
+                    bounds[i] = _getFake(_nodeFakeName(i + 1, node));
+                    if (bounds[i]->getConcreteType() != INT)
+                        unboxed_bounds = false;
+                }
+            }
+
+            ConcreteCompilerType *value_type = value->getConcreteType();
+            llvm::Value *slice_func = NULL;
+            if (value_type == LIST)
+                slice_func = g.funcs.listSliceUnboxed;
+            else if (value_type == STR)
+                slice_func = g.funcs.strSliceUnboxed;
+
+            if (!slice_func || !unboxed_bounds) {
+                CompilerVariable *slice_var = _makeSlice(bounds[0], bounds[1], bounds[2]);
+                CompilerVariable *rtn = value->getitem(emitter, slice_var);
+                value->decvref(emitter);
+                slice_var->decvref(emitter);
+                return rtn;
+            }
+
+            ConcreteCompilerVariable *converted_value = value->makeConverted(emitter, value_type);
+            value->decvref(emitter);
+
+            std::vector<llvm::Value*> args;
+            // The functions take a BoxedList* / BoxedString*:
+            llvm::Type *self_type = *llvm::cast<llvm::FunctionType>(llvm::cast<llvm::PointerType>(slice_func->getType())->getElementType())->param_begin();
+            args.push_back(emitter.getBuilder()->CreateBitCast(converted_value->getValue(), self_type));
+            for (int i = 0; i < 3; i++) {
+                if (!bounds[i]) {
+                    args.push_back(llvm::ConstantInt::get(g.i64, i == 2 ? 1 : SLICE_BOUND_NONE, true));
+                    continue;
+                }
+                ConcreteCompilerVariable *converted = bounds[i]->makeConverted(emitter, INT);
+                bounds[i]->decvref(emitter);
+                args.push_back(converted->getValue());
+                converted->decvref(emitter);
+            }
+            llvm::Value* rtn = emitter.getBuilder()->CreateCall(slice_func, args);
+            converted_value->decvref(emitter);
+            return new ConcreteCompilerVariable(value_type, rtn, true);
+        }
+
+        // The fast paths for l[i] and l[i] = x, for lists that keep their elements unboxed, when the elements
+        // are known (or for loads, speculated) to be floats or ints: check the strategy and the bounds, and
+        // then use the element array directly.  Everything else, negative indices included, goes through
+        // the regular getitem / setitem.  The checks only load from the list itself, which a loop that just
+        // reads and writes elements doesn't change, so licm and loop_unswitch can pull them out of the loop
+        // and leave the vectorizers a plain loop over the array.
+        // TODO this is brittle: directly embeds the positions of BoxedList::size, ::elts and ::strategy
+        llvm::Value* emitListFastpathCheck(llvm::Value *list, llvm::Value *n, BoxedList::Strategy strategy) {
+            IREmitter::IRBuilder* b = emitter.getBuilder();
+            llvm::Value *size = b->CreateLoad(b->CreateConstInBoundsGEP2_32(list, 0, 1));
+            llvm::Value *cur_strategy = b->CreateLoad(b->CreateConstInBoundsGEP2_32(list, 0, 4));
+            assert(size->getType() == g.i64 && cur_strategy->getType() == g.i64);
+            // (the unsigned compare sends the negative indices to the slow path too)
+            return b->CreateAnd(b->CreateICmpEQ(cur_strategy, getConstantInt(strategy, g.i64)), b->CreateICmpULT(n, size));
+        }
+
+        llvm::Value* emitListEltPtr(llvm::Value *list, llvm::Value *n, llvm::Type *elt_type) {
+            IREmitter::IRBuilder* b = emitter.getBuilder();
+            llvm::Value *elts = b->CreateLoad(b->CreateConstInBoundsGEP2_32(list, 0, 3));
+            llvm::Value *raw = b->CreateConstInBoundsGEP1_64(b->CreateBitCast(elts, g.i8_ptr), sizeof(BoxedList::ElementArray));
+            return b->CreateInBoundsGEP(b->CreateBitCast(raw, elt_type->getPointerTo()), n);
+        }
+
+        CompilerVariable* evalUnboxedListGetitem(AST_Subscript *node, CompilerVariable *value, CompilerVariable *slice) {
+            if (!ENABLE_UNBOXED_LIST_ACCESS || irstate->getEffortLevel() != EffortLevel::MAXIMAL)
+                return NULL;
+            if (value->getConcreteType() != LIST || slice->getConcreteType() != INT)
+                return NULL;
+            BoxedClass *speculated_class = types->speculatedExprClass(node);
+            if (speculated_class != float_cls && speculated_class != int_cls)
+                return NULL;
+            bool is_float = (speculated_class == float_cls);
+
+            static StatCounter num_unboxed_list_gets("num_unboxed_list_getitems");
+            num_unboxed_list_gets.log();
+
+            IREmitter::IRBuilder* b = emitter.getBuilder();
+            ConcreteCompilerVariable *converted_list = value->makeConverted(emitter, LIST);
+            ConcreteCompilerVariable *converted_n = slice->makeConverted(emitter, INT);
+            llvm::Value *list = b->CreateBitCast(converted_list->getValue(), g.llvm_list_type_ptr);
+            llvm::Value *n = converted_n->getValue();
+            llvm::Value *fast = emitListFastpathCheck(list, n, is_float ? BoxedList::FLOAT_STRATEGY : BoxedList::INT_STRATEGY);
+
+            llvm::Value* md_vals[] = {llvm::MDString::get(*g.context, "branch_weights"), getConstantInt(1000), getConstantInt(1)};
+            llvm::MDNode* branch_weights = llvm::MDNode::get(*g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
+
+            llvm::BasicBlock *fast_bb = llvm::BasicBlock::Create(*g.context, "list_get_fast", irstate->getLLVMFunction());
+            llvm::BasicBlock *slow_bb = llvm::BasicBlock::Create(*g.context, "list_get_slow", irstate->getLLVMFunction());
+            llvm::BasicBlock *join_bb = llvm::BasicBlock::Create(*g.context, "list_get_join", irstate->getLLVMFunction());
+            fast_bb->moveAfter(curblock);
+            join_bb->moveAfter(fast_bb);
+            b->CreateCondBr(fast, fast_bb, slow_bb, branch_weights);
+
+            b->SetInsertPoint(fast_bb);
+            llvm::Value *fast_rtn = b->CreateLoad(emitListEltPtr(list, n, is_float ? g.double_ : g.i64));
+            b->CreateBr(join_bb);
+
+            // Like the out-guarding in evalExpr: make the generic call, and deopt if it wasn't what the
+            // lower tiers saw.
+            curblock = slow_bb;
+            b->SetInsertPoint(curblock);
+            CompilerVariable *slow_rtn = converted_list->getitem(emitter, converted_n);
+            ConcreteCompilerVariable *boxed_rtn = slow_rtn->makeConverted(emitter, UNKNOWN);
+            slow_rtn->decvref(emitter);
+            converted_list->decvref(emitter);
+            converted_n->decvref(emitter);
+
+            createExprTypeGuard(boxed_rtn->makeClassCheck(emitter, speculated_class), node, boxed_rtn);
+            ConcreteCompilerVariable *unboxed = unboxVar(is_float ? BOXED_FLOAT : BOXED_INT, boxed_rtn->getValue(), true);
+            llvm::BasicBlock *slow_end = curblock;
+            b->CreateBr(join_bb);
+
+            curblock = join_bb;
+            b->SetInsertPoint(curblock);
+            llvm::PHINode *phi = b->CreatePHI(is_float ? g.double_ : g.i64, 2);
+            phi->addIncoming(fast_rtn, fast_bb);
+            phi->addIncoming(unboxed->getValue(), slow_end);
+            unboxed->decvref(emitter);
+
+            return new ConcreteCompilerVariable(is_float ? FLOAT : INT, phi, true);
+        }
+
+        // Emits the fast path of a store into a list that keeps its elements unboxed, and leaves the builder in
+        // the slow path for the caller to do the regular setitem in.  Returns the block that both of them
+        // should continue in, or NULL if there's no fast path.
+        llvm::BasicBlock* emitUnboxedListSetitem(CompilerVariable *target, CompilerVariable *slice, CompilerVariable *val) {
+            if (!ENABLE_UNBOXED_LIST_ACCESS || irstate->getEffortLevel() != EffortLevel::MAXIMAL)
+                return NULL;
+            if (target->getConcreteType() != LIST || slice->getConcreteType() != INT)
+                return NULL;
+            ConcreteCompilerType *val_type = val->getConcreteType();
+            if (val_type != FLOAT && val_type != INT)
+                return NULL;
+            bool is_float = (val_type == FLOAT);
+
+            static StatCounter num_unboxed_list_sets("num_unboxed_list_setitems");
+            num_unboxed_list_sets.log();
+
+            IREmitter::IRBuilder* b = emitter.getBuilder();
+            ConcreteCompilerVariable *converted_list = target->makeConverted(emitter, LIST);
+            ConcreteCompilerVariable *converted_n = slice->makeConverted(emitter, INT);
+            ConcreteCompilerVariable *converted_val = val->makeConverted(emitter, val_type);
+            llvm::Value *list = b->CreateBitCast(converted_list->getValue(), g.llvm_list_type_ptr);
+            llvm::Value *n = converted_n->getValue();
+            llvm::Value *fast = emitListFastpathCheck(list, n, is_float ? BoxedList::FLOAT_STRATEGY : BoxedList::INT_STRATEGY);
+
+            llvm::Value* md_vals[] = {llvm::MDString::get(*g.context, "branch_weights"), getConstantInt(1000), getConstantInt(1)};
+            llvm::MDNode* branch_weights = llvm::MDNode::get(*g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
+
+            llvm::BasicBlock *fast_bb = llvm::BasicBlock::Create(*g.context, "list_set_fast", irstate->getLLVMFunction());
+            llvm::BasicBlock *slow_bb = llvm::BasicBlock::Create(*g.context, "list_set_slow", irstate->getLLVMFunction());
+            llvm::BasicBlock *join_bb = llvm::BasicBlock::Create(*g.context, "list_set_join", irstate->getLLVMFunction());
+            fast_bb->moveAfter(curblock);
+            join_bb->moveAfter(fast_bb);
+            b->CreateCondBr(fast, fast_bb, slow_bb, branch_weights);
+
+            // (the elements aren't pointers, so there's no write barrier to do)
+            b->SetInsertPoint(fast_bb);
+            b->CreateStore(converted_val->getValue(), emitListEltPtr(list, n, is_float ? g.double_ : g.i64));
+            b->CreateBr(join_bb);
+
+            converted_list->decvref(emitter);
+            converted_n->decvref(emitter);
+            converted_val->decvref(emitter);
+
+            curblock = slow_bb;
+            b->SetInsertPoint(curblock);
+            return join_bb;
         }
 
         CompilerVariable* evalSubscript(AST_Subscript *node) {
+            if (node->slice->type == AST_TYPE::Slice)
+                return evalSliceSubscript(node);
+
             CompilerVariable *value = evalExpr(node->value);
             _setFake(_nodeFakeName(0, node), value); // 'fakes' are for handling deopt entries
             CompilerVariable *slice = evalExpr(node->slice);
@@ -1099,7 +2374,9 @@ class IRGenerator {
             value = _getFake(_nodeFakeName(0, node));
             slice = _getFake(_nodeFakeName(1, node));
 
-            CompilerVariable *rtn = value->getitem(emitter, slice);
+            CompilerVariable *rtn = evalUnboxedListGetitem(node, value, slice);
+            if (!rtn)
+                rtn = value->getitem(emitter, slice);
             value->decvref(emitter);
             slice->decvref(emitter);
             return rtn;
@@ -1171,6 +2448,21 @@ class IRGenerator {
             return new ConcreteCompilerVariable(t, v, grabbed);
         }
 
+        // Have the lower tiers record what classes show up at the places where the type analysis
+        // would otherwise have no idea, so that the higher tiers can speculate on them.
+        void recordTypeFeedback(AST_expr *node, CompilerVariable *rtn) {
+            bool speculated_load = (node->type == AST_TYPE::Name && irstate->getSourceInfo()->cfg->speculated_loads.count(static_cast<AST_Name*>(node)));
+            bool is_index = (node->type == AST_TYPE::Subscript && static_cast<AST_Subscript*>(node)->slice->type != AST_TYPE::Slice);
+            if (node->type != AST_TYPE::Attribute && node->type != AST_TYPE::BinOp && node->type != AST_TYPE::Call && !speculated_load && !is_index)
+                return;
+            if (rtn->getType() != UNKNOWN)
+                return;
+
+            TypeRecorder *recorder = getTypeFeedback(irstate->getSourceInfo())->getRecorder(node);
+            llvm::Value *boxed = static_cast<ConcreteCompilerVariable*>(rtn)->getValue();
+            emitter.getBuilder()->CreateCall2(g.funcs.recordType, embedConstantPtr(recorder, g.i8_ptr), boxed);
+        }
+
         CompilerVariable* evalExpr(AST_expr *node) {
             emitter.getBuilder()->SetCurrentDebugLocation(llvm::DebugLoc::get(node->lineno, 0, irstate->getFuncDbgInfo()));
 
@@ -1224,6 +2516,9 @@ class IRGenerator {
                 case AST_TYPE::ClsAttribute:
                     rtn = evalClsAttribute(static_cast<AST_ClsAttribute*>(node));
                     break;
+                case AST_TYPE::LangPrimitive:
+                    rtn = evalLangPrimitive(static_cast<AST_LangPrimitive*>(node));
+                    break;
                 default:
                     printf("Unhandled expr type: %d (irgen.cpp:" STRINGIFY(__LINE__) ")\n", node->type);
                     exit(1);
@@ -1233,9 +2528,17 @@ class IRGenerator {
                 assert(state == PARTIAL);
             }
 
+            if (state != PARTIAL && irstate->getEffortLevel() <= EffortLevel::MINIMAL)
+                recordTypeFeedback(node, rtn);
+
             // Out-guarding:
             BoxedClass *speculated_class = types->speculatedExprClass(node);
-            if (speculated_class != NULL && state != PARTIAL) {
+            // (evalUnboxedMathCall, evalUnboxedTimeCall, evalUnboxedListGetitem, evalIntBinOp and evalSumCall do their own
+            // guarding, and their results come back already unboxed, as does evalIsinstanceCall's)
+            bool already_unboxed = (speculated_class == float_cls && rtn != NULL && rtn->getType() == FLOAT)
+                || (speculated_class == int_cls && rtn != NULL && rtn->getType() == INT)
+                || (speculated_class == bool_cls && rtn != NULL && rtn->getType() == BOOL);
+            if (speculated_class != NULL && state != PARTIAL && !already_unboxed) {
                 assert(rtn);
 
                 ConcreteCompilerType *speculated_type = typeFromClass(speculated_class);
@@ -1270,7 +2573,7 @@ class IRGenerator {
                     printf("; is_partial=%d\n", state == PARTIAL);
                 }
                 if (state == PARTIAL) {
-                    guard->branch->setSuccessor(1, curblock);
+                    setGuardFailureTarget(irstate, guard->branch, curblock, node);
                     symbol_table = SymbolTable(guard->st);
                     assert(guard->val);
                     state = RUNNING;
@@ -1281,8 +2584,8 @@ class IRGenerator {
                     compareKeyset(&symbol_table, &guard->st);
 
                     assert(symbol_table.size() == guard->st.size());
-                    llvm::BasicBlock *ramp_block = llvm::BasicBlock::Create(g.context, "deopt_ramp", irstate->getLLVMFunction());
-                    llvm::BasicBlock *join_block = llvm::BasicBlock::Create(g.context, "deopt_join", irstate->getLLVMFunction());
+                    llvm::BasicBlock *ramp_block = llvm::BasicBlock::Create(*g.context, "deopt_ramp", irstate->getLLVMFunction());
+                    llvm::BasicBlock *join_block = llvm::BasicBlock::Create(*g.context, "deopt_join", irstate->getLLVMFunction());
                     SymbolTable joined_st;
                     for (SymbolTable::iterator it = guard->st.begin(), end = guard->st.end(); it != end; ++it) {
                         //if (VERBOSITY("irgen") >= 1) printf("merging %s\n", it->first.c_str());
@@ -1324,7 +2627,7 @@ class IRGenerator {
                     emitter.getBuilder()->SetInsertPoint(ramp_block);
                     emitter.getBuilder()->CreateBr(join_block);
 
-                    guard->branch->setSuccessor(1, ramp_block);
+                    setGuardFailureTarget(irstate, guard->branch, ramp_block, node);
 
                     {
                         ConcreteCompilerType *this_merged_type = rtn->getConcreteType();
@@ -1400,6 +2703,14 @@ class IRGenerator {
                 }
                 prev = val;
                 val->incvref();
+
+                // Nested functions can only read it, so our own reads can keep using the local copy:
+                if (irstate->getScopeInfo()->saveInClosure(name)) {
+                    ConcreteCompilerVariable *converted = val->makeConverted(emitter, UNKNOWN);
+                    llvm::Value *slot = _getClosureSlot(0, irstate->getScopeInfo()->getClosureSlot(name));
+                    irstate->getGC()->writePointer(emitter, irstate->getClosure(), emitter.getBuilder()->CreateBitCast(slot, g.llvm_value_type_ptr), converted->getValue(), false);
+                    converted->decvref(emitter);
+                }
             }
         }
 
@@ -1415,6 +2726,8 @@ class IRGenerator {
             CompilerVariable *tget = evalExpr(target->value);
             CompilerVariable *slice = evalExpr(target->slice);
 
+            llvm::BasicBlock *fast_join = emitUnboxedListSetitem(tget, slice, val);
+
             ConcreteCompilerVariable *converted_target = tget->makeConverted(emitter, tget->getBoxType());
             ConcreteCompilerVariable *converted_slice = slice->makeConverted(emitter, slice->getBoxType());
             tget->decvref(emitter);
@@ -1440,13 +2753,50 @@ class IRGenerator {
             converted_target->decvref(emitter);
             converted_slice->decvref(emitter);
             converted_val->decvref(emitter);
+
+            if (fast_join) {
+                emitter.getBuilder()->CreateBr(fast_join);
+                curblock = fast_join;
+                emitter.getBuilder()->SetInsertPoint(curblock);
+            }
+        }
+
+        // Unpacking something that's known to be a tuple can just load the elements, instead of going
+        // through len() and getitem(); this also keeps the tuple from escaping, so the stack_allocs pass
+        // can put it on the stack if we were the ones that made it.
+        void _doUnpackBoxedTuple(AST_Tuple* target, ConcreteCompilerVariable* val) {
+            int ntargets = target->elts.size();
+            IREmitter::IRBuilder* b = emitter.getBuilder();
+
+            llvm::Value* raw = b->CreateBitCast(val->getValue(), g.i8_ptr);
+            llvm::Value* len = b->CreateLoad(b->CreateBitCast(b->CreateConstGEP1_32(raw, TUPLE_NELTS_OFFSET), g.i64->getPointerTo()));
+            b->CreateCall2(g.funcs.checkUnpackingLength, getConstantInt(ntargets, g.i64), len);
+
+            llvm::Value* elts = b->CreateBitCast(b->CreateConstGEP1_32(raw, TUPLE_ELTS_OFFSET), g.llvm_value_type_ptr->getPointerTo());
+            for (int i = 0; i < ntargets; i++) {
+                llvm::Value* elt = b->CreateLoad(b->CreateConstGEP1_32(elts, i));
+                CompilerVariable *unpacked = new ConcreteCompilerVariable(UNKNOWN, elt, false);
+                _doSet(target->elts[i], unpacked);
+                unpacked->decvref(emitter);
+            }
         }
 
         void _doUnpackTuple(AST_Tuple* target, CompilerVariable* val) {
+            if (val->getType() == BOXED_TUPLE) {
+                _doUnpackBoxedTuple(target, static_cast<ConcreteCompilerVariable*>(val));
+                return;
+            }
+
             int ntargets = target->elts.size();
             ConcreteCompilerVariable *len = val->len(emitter);
-            emitter.getBuilder()->CreateCall2(g.funcs.checkUnpackingLength,
-                    getConstantInt(ntargets, g.i64), len->getValue());
+            // Tuples that haven't been boxed (ie "a, b = b, a+b") know their length, so usually there's
+            // nothing left to check, and the elements come straight out of the getitem()s below.
+            llvm::ConstantInt* known_len = llvm::dyn_cast<llvm::ConstantInt>(len->getValue());
+            if (!known_len || known_len->getSExtValue() != ntargets) {
+                emitter.getBuilder()->CreateCall2(g.funcs.checkUnpackingLength,
+                        getConstantInt(ntargets, g.i64), len->getValue());
+            }
+            len->decvref(emitter);
 
             for (int i = 0; i < ntargets; i++) {
                 CompilerVariable *unpacked = val->getitem(emitter, makeInt(i));
@@ -1508,8 +2858,7 @@ class IRGenerator {
                     continue;
                 } else if (type == AST_TYPE::FunctionDef) {
                     AST_FunctionDef *fdef = static_cast<AST_FunctionDef*>(node->body[i]);
-                    CLFunction *cl = this->_wrapFunction(fdef);
-                    CompilerVariable *func = makeFunction(emitter, cl);
+                    CompilerVariable *func = makeFunctionDef(fdef);
                     cls->setattr(emitter, fdef->name, func);
                     func->decvref(emitter);
                 } else {
@@ -1521,26 +2870,31 @@ class IRGenerator {
             cls->decvref(emitter);
         }
 
-        CLFunction* _wrapFunction(AST_FunctionDef *node) {
-            // Different compilations of the parent scope of a functiondef should lead
-            // to the same CLFunction* being used:
-            static std::unordered_map<AST_FunctionDef*, CLFunction*> made;
+        // Evaluates the defaults, and makes the function object.
+        CompilerVariable* makeFunctionDef(AST_FunctionDef *node) {
+            CLFunction *cl = wrapFunction(node, irstate->getSourceInfo());
 
-            CLFunction* &cl = made[node];
-            if (cl == NULL) {
-                SourceInfo *si = new SourceInfo(irstate->getSourceInfo()->parent_module, irstate->getSourceInfo()->scoping);
-                si->ast = node;
-                cl = new CLFunction(si);
+            std::vector<CompilerVariable*> defaults;
+            for (int i = 0; i < node->args->defaults.size(); i++) {
+                defaults.push_back(evalExpr(node->args->defaults[i]));
+            }
+            llvm::Value *closure = NULL;
+            if (irstate->getSourceInfo()->scoping->getScopeInfoForNode(node)->takesClosure()) {
+                closure = irstate->getClosure();
+                assert(closure);
             }
-            return cl;
+            CompilerVariable *func = makeFunction(emitter, cl, defaults, closure);
+            for (int i = 0; i < defaults.size(); i++) {
+                defaults[i]->decvref(emitter);
+            }
+            return func;
         }
 
         void doFunction(AST_FunctionDef *node) {
             if (state == PARTIAL)
                 return;
 
-            CLFunction *cl = this->_wrapFunction(node);
-            CompilerVariable *func = makeFunction(emitter, cl);
+            CompilerVariable *func = makeFunctionDef(node);
 
             //llvm::Type* boxCLFuncArgType = g.funcs.boxCLFunction->arg_begin()->getType();
             //llvm::Value *boxed = emitter.getBuilder()->CreateCall(g.funcs.boxCLFunction, embedConstantPtr(cl, boxCLFuncArgType));
@@ -1644,7 +2998,42 @@ class IRGenerator {
 
             endBlock(FINISHED);
 
-            emitter.getBuilder()->CreateCondBr(llvm_nonzero, iftrue, iffalse);
+            llvm::MDNode* branch_weights = NULL;
+            if (irstate->getEffortLevel() == EffortLevel::MAXIMAL)
+                branch_weights = getProfiledBranchWeights(node->iftrue, node->iffalse);
+            emitter.getBuilder()->CreateCondBr(llvm_nonzero, iftrue, iffalse, branch_weights);
+        }
+
+        // Turns the block counts from the lower tiers into weights for a branch out of this block, or
+        // returns NULL if they don't say enough.  A target's count is only the count of the edge to it
+        // if we're its only predecessor; otherwise it's whatever the other edge didn't take.
+        llvm::MDNode* getProfiledBranchWeights(CFGBlock* iftrue, CFGBlock* iffalse) {
+            TypeFeedback *feedback = getTypeFeedback(irstate->getSourceInfo());
+            int64_t total = feedback->blockCount(myblock);
+            if (total <= 0)
+                return NULL;
+
+            int64_t t = (iftrue->predecessors.size() == 1) ? feedback->blockCount(iftrue) : -1;
+            int64_t f = (iffalse->predecessors.size() == 1) ? feedback->blockCount(iffalse) : -1;
+            if (t == -1 && f == -1)
+                return NULL;
+            if (t == -1)
+                t = std::max(total - f, (int64_t)0);
+            if (f == -1)
+                f = std::max(total - t, (int64_t)0);
+
+            // Only the ratio matters, and the weights are 32 bits; they also get a +1 so that a branch
+            // that was never taken is still "unlikely" rather than "no information":
+            while (t >= (1 << 30) || f >= (1 << 30)) {
+                t >>= 1;
+                f >>= 1;
+            }
+
+            static StatCounter num_profiled_branches("num_profiled_branches");
+            num_profiled_branches.log();
+
+            llvm::Value* md_vals[] = {llvm::MDString::get(*g.context, "branch_weights"), getConstantInt(t + 1), getConstantInt(f + 1)};
+            return llvm::MDNode::get(*g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
         }
 
         void doExpr(AST_Expr *node) {
@@ -1655,7 +3044,7 @@ class IRGenerator {
 
         void doOSRExit(llvm::BasicBlock *normal_target, AST_Jump* osr_key) {
             llvm::BasicBlock *starting_block = curblock;
-            llvm::BasicBlock *onramp = llvm::BasicBlock::Create(g.context, "onramp", irstate->getLLVMFunction());
+            llvm::BasicBlock *onramp = llvm::BasicBlock::Create(*g.context, "onramp", irstate->getLLVMFunction());
 
             // Code to check if we want to do the OSR:
             llvm::GlobalVariable* edgecount_ptr = new llvm::GlobalVariable(*g.cur_module, g.i64, false, llvm::GlobalValue::InternalLinkage, getConstantInt(0, g.i64), "edgecount");
@@ -1663,13 +3052,11 @@ class IRGenerator {
             llvm::Value* newcount = emitter.getBuilder()->CreateAdd(curcount, getConstantInt(1, g.i64));
             emitter.getBuilder()->CreateStore(newcount, edgecount_ptr);
 
-            int OSR_THRESHOLD = 10000;
-            if (irstate->getEffortLevel() == EffortLevel::INTERPRETED)
-                OSR_THRESHOLD = 100;
-            llvm::Value* osr_test = emitter.getBuilder()->CreateICmpSGT(newcount, getConstantInt(OSR_THRESHOLD));
+            int osr_threshold = getTieringPolicy()->osrThreshold(irstate->getEffortLevel());
+            llvm::Value* osr_test = emitter.getBuilder()->CreateICmpSGT(newcount, getConstantInt(osr_threshold));
 
-            llvm::Value* md_vals[] = {llvm::MDString::get(g.context, "branch_weights"), getConstantInt(1), getConstantInt(1000)};
-            llvm::MDNode* branch_weights = llvm::MDNode::get(g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
+            llvm::Value* md_vals[] = {llvm::MDString::get(*g.context, "branch_weights"), getConstantInt(1), getConstantInt(1000)};
+            llvm::MDNode* branch_weights = llvm::MDNode::get(*g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
             emitter.getBuilder()->CreateCondBr(osr_test, onramp, normal_target, branch_weights);
 
             // Emitting the actual OSR:
@@ -1682,6 +3069,12 @@ class IRGenerator {
             std::vector<ConcreteCompilerVariable*> converted_args;
 
             SortedSymbolTable sorted_symbol_table(symbol_table.begin(), symbol_table.end());
+            // The closure gets passed along with the variables:
+            ConcreteCompilerVariable *closure_var = NULL;
+            if (irstate->getClosure()) {
+                closure_var = new ConcreteCompilerVariable(UNKNOWN, irstate->getClosure(), true);
+                sorted_symbol_table[CLOSURE_ARG_NAME] = closure_var;
+            }
             /*
             for (SortedSymbolTable::iterator it = sorted_symbol_table.begin(), end = sorted_symbol_table.end(); it != end; ) {
                 if (!source->liveness->isLiveAtEnd(it->first, myblock)) {
@@ -1726,7 +3119,7 @@ class IRGenerator {
             for (SortedSymbolTable::iterator it = sorted_symbol_table.begin(), end = sorted_symbol_table.end(); it != end; ++it, ++i) {
                 // I don't think this can fail, but if it can we should filter out dead symbols before
                 // passing them on:
-                assert(irstate->getSourceInfo()->liveness->isLiveAtEnd(it->first, myblock));
+                assert(it->second == closure_var || irstate->getSourceInfo()->liveness->isLiveAtEnd(it->first, myblock));
 
                 // This line can never get hit right now since we unnecessarily force every variable to be concrete
                 // for a loop, since we generate all potential phis:
@@ -1793,6 +3186,8 @@ class IRGenerator {
             for (int i = 0; i < converted_args.size(); i++) {
                 converted_args[i]->decvref(emitter);
             }
+            if (closure_var)
+                closure_var->decvref(emitter);
 
             if (irstate->getReturnType() == VOID)
                 emitter.getBuilder()->CreateRetVoid();
@@ -1807,6 +3202,9 @@ class IRGenerator {
 
             llvm::BasicBlock *target = entry_blocks[node->target->idx];
 
+            if (node->target->idx < myblock->idx)
+                doSafepoint();
+
             if (ENABLE_OSR && node->target->idx < myblock->idx && irstate->getEffortLevel() < EffortLevel::MAXIMAL) {
                 assert(node->target->predecessors.size() > 1);
                 doOSRExit(target, node);
@@ -2006,7 +3404,30 @@ class IRGenerator {
             }
         }
 
+        // Lets other threads have the GIL if any of them are waiting for it.  This only costs a load and a
+        // (predicted) branch in the common case, so it goes on every backedge and at every function entry.
+        void doSafepoint() {
+            llvm::Value *waiting_ptr = embedConstantPtr(&threading::threads_waiting_on_gil, g.i64->getPointerTo());
+            llvm::Value *waiting = emitter.getBuilder()->CreateLoad(waiting_ptr, true);
+            llvm::Value *should_yield = emitter.getBuilder()->CreateICmpNE(waiting, getConstantInt(0, g.i64));
+
+            llvm::Value* md_vals[] = {llvm::MDString::get(*g.context, "branch_weights"), getConstantInt(1), getConstantInt(1000)};
+            llvm::MDNode* branch_weights = llvm::MDNode::get(*g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
+
+            llvm::BasicBlock* yield_bb = llvm::BasicBlock::Create(*g.context, "gil_yield", irstate->getLLVMFunction());
+            llvm::BasicBlock* continue_bb = llvm::BasicBlock::Create(*g.context, "gil_continue", irstate->getLLVMFunction());
+            emitter.getBuilder()->CreateCondBr(should_yield, yield_bb, continue_bb, branch_weights);
+
+            emitter.getBuilder()->SetInsertPoint(yield_bb);
+            emitter.getBuilder()->CreateCall(g.funcs.gilYield);
+            emitter.getBuilder()->CreateBr(continue_bb);
+
+            curblock = continue_bb;
+            emitter.getBuilder()->SetInsertPoint(curblock);
+        }
+
         void unpackArguments(const std::vector<AST_expr*> &arg_names, const std::vector<ConcreteCompilerType*> &arg_types) {
+            std::vector<llvm::Value*> values;
             int i = 0;
             llvm::Value* argarray = NULL;
             for (llvm::Function::arg_iterator AI = irstate->getLLVMFunction()->arg_begin(); AI != irstate->getLLVMFunction()->arg_end(); AI++, i++) {
@@ -2014,7 +3435,7 @@ class IRGenerator {
                     argarray = AI;
                     break;
                 }
-                loadArgument(arg_names[i], arg_types[i], AI);
+                values.push_back(AI);
             }
 
             for (int i = 3; i < arg_types.size(); i++) {
@@ -2026,16 +3447,51 @@ class IRGenerator {
                 else
                     assert(arg_types[i]->llvmType() == g.llvm_value_type_ptr);
 
-                loadArgument(arg_names[i], arg_types[i], loaded);
+                values.push_back(loaded);
+            }
+
+            // The closure that we got passed is the last argument.  If we make one of our own, that has
+            // to happen before any parameters get saved in it.
+            ScopeInfo *scope_info = irstate->getScopeInfo();
+            int nparams = arg_types.size();
+            llvm::Value *passed_closure = NULL;
+            if (scope_info->takesClosure()) {
+                nparams--;
+                passed_closure = values[nparams];
+            }
+            if (scope_info->createsClosure()) {
+                llvm::Value *parent = passed_closure ? passed_closure : embedConstantPtr(NULL, g.llvm_value_type_ptr);
+                irstate->setClosure(emitter.getBuilder()->CreateCall2(g.funcs.createClosure, parent, getConstantInt(scope_info->getClosureSize(), g.i64)));
+            } else if (passed_closure) {
+                irstate->setClosure(passed_closure);
+            }
+
+            for (int i = 0; i < nparams; i++) {
+                loadArgument(arg_names[i], arg_types[i], values[i]);
             }
         }
 
-        void run(const CFGBlock* block) {
+        void run(CFGBlock* block) {
+            // The lower tiers count the blocks' executions for the MAXIMAL one (see getProfiledBranchWeights).
+            // A partial block gets entered partway through, where a guard failed, so it doesn't count.
+            if (ENABLE_BLOCK_COUNTS && irstate->getEffortLevel() <= EffortLevel::MINIMAL && state != PARTIAL) {
+                int64_t *counter = getTypeFeedback(irstate->getSourceInfo())->getBlockCounter(block);
+                llvm::Value *counter_ptr = embedConstantPtr(counter, g.i64->getPointerTo());
+                llvm::Value *count = emitter.getBuilder()->CreateLoad(counter_ptr);
+                emitter.getBuilder()->CreateStore(emitter.getBuilder()->CreateAdd(count, getConstantInt(1, g.i64)), counter_ptr);
+            }
+
             for (int i = 0; i < block->body.size(); i++) {
                 if (state == DEAD)
                     break;
                 assert(state != FINISHED);
-                doStmt(block->body[i]);
+                AST_stmt *stmt = block->body[i];
+                if (state != PARTIAL && startsProfiledLine(block, i)) {
+                    LineProfileEntry *entry = getLineProfileEntry(irstate->getSourceInfo(), stmt->lineno);
+                    if (entry)
+                        emitter.getBuilder()->CreateCall(g.funcs.lineProfilerHit, embedConstantPtr(entry, g.i8_ptr));
+                }
+                doStmt(stmt);
             }
         }
 
@@ -2135,15 +3591,15 @@ static void emitBBs(IRGenState* irstate, const char* bb_type, GuardList &out_gua
 
         char buf[40];
         snprintf(buf, 40, "%s_block%d", bb_type, i);
-        llvm_entry_blocks.push_back(llvm::BasicBlock::Create(g.context, buf, irstate->getLLVMFunction()));
+        llvm_entry_blocks.push_back(llvm::BasicBlock::Create(*g.context, buf, irstate->getLLVMFunction()));
     }
 
     llvm::BasicBlock *osr_entry_block = NULL; // the function entry block, where we add the type guards
     llvm::BasicBlock *osr_unbox_block = NULL; // the block after type guards where we up/down-convert things
     ConcreteSymbolTable *osr_syms = NULL; // syms after conversion
     if (entry_descriptor != NULL) {
-        osr_unbox_block = llvm::BasicBlock::Create(g.context, "osr_unbox", irstate->getLLVMFunction(), &irstate->getLLVMFunction()->getEntryBlock());
-        osr_entry_block = llvm::BasicBlock::Create(g.context, "osr_entry", irstate->getLLVMFunction(), &irstate->getLLVMFunction()->getEntryBlock());
+        osr_unbox_block = llvm::BasicBlock::Create(*g.context, "osr_unbox", irstate->getLLVMFunction(), &irstate->getLLVMFunction()->getEntryBlock());
+        osr_entry_block = llvm::BasicBlock::Create(*g.context, "osr_entry", irstate->getLLVMFunction(), &irstate->getLLVMFunction()->getEntryBlock());
         assert(&irstate->getLLVMFunction()->getEntryBlock() == osr_entry_block);
 
         osr_syms = new ConcreteSymbolTable();
@@ -2184,6 +3640,11 @@ static void emitBBs(IRGenState* irstate, const char* bb_type, GuardList &out_gua
                 assert(from_arg->getType() == it->second->llvmType());
             }
 
+            if (it->first == CLOSURE_ARG_NAME) {
+                irstate->setClosure(from_arg);
+                continue;
+            }
+
             ConcreteCompilerType *phi_type = types->getTypeAtBlockStart(it->first, target_block);
             //ConcreteCompilerType *analyzed_type = types->getTypeAtBlockStart(it->first, block);
             //ConcreteCompilerType *phi_type = (*phis)[it->first].first;
@@ -2212,6 +3673,9 @@ static void emitBBs(IRGenState* irstate, const char* bb_type, GuardList &out_gua
                     speculated_class = int_cls;
                 } else if (phi_type == FLOAT) {
                     speculated_class = float_cls;
+                } else if (phi_type == BOOL) {
+                    // the AST interpreter passes everything boxed
+                    speculated_class = bool_cls;
                 } else {
                     speculated_class = phi_type->guaranteedClass();
                 }
@@ -2231,6 +3695,9 @@ static void emitBBs(IRGenState* irstate, const char* bb_type, GuardList &out_gua
                 } else if (speculated_class == float_cls) {
                     v = unbox_emitter.getBuilder()->CreateCall(g.funcs.unboxFloat, from_arg);
                     (new ConcreteCompilerVariable(BOXED_FLOAT, from_arg, true))->decvref(unbox_emitter);
+                } else if (speculated_class == bool_cls) {
+                    v = unbox_emitter.getBuilder()->CreateCall(g.funcs.unboxBool, from_arg);
+                    (new ConcreteCompilerVariable(BOXED_BOOL, from_arg, true))->decvref(unbox_emitter);
                 } else {
                     assert(phi_type == typeFromClass(speculated_class));
                     v = from_arg;
@@ -2326,28 +3793,21 @@ static void emitBBs(IRGenState* irstate, const char* bb_type, GuardList &out_gua
             // pass
         } else if (block->idx == 0) {
             assert(entry_descriptor == NULL);
-            // number of times a function needs to be called to be reoptimized:
-            static const int REOPT_THRESHOLDS[] = {
-                10,      // INTERPRETED->MINIMAL
-                250,     // MINIMAL->MODERATE
-                10000,   // MODERATE->MAXIMAL
-            };
-
             assert(strcmp("opt", bb_type) == 0);
 
             if (ENABLE_REOPT && effort < EffortLevel::MAXIMAL && source->ast != NULL && source->ast->type != AST_TYPE::Module) {
-                llvm::BasicBlock* preentry_bb = llvm::BasicBlock::Create(g.context, "pre_entry", irstate->getLLVMFunction(), llvm_entry_blocks[0]);
-                llvm::BasicBlock* reopt_bb = llvm::BasicBlock::Create(g.context, "reopt", irstate->getLLVMFunction());
+                llvm::BasicBlock* preentry_bb = llvm::BasicBlock::Create(*g.context, "pre_entry", irstate->getLLVMFunction(), llvm_entry_blocks[0]);
+                llvm::BasicBlock* reopt_bb = llvm::BasicBlock::Create(*g.context, "reopt", irstate->getLLVMFunction());
                 emitter.getBuilder()->SetInsertPoint(preentry_bb);
 
                 llvm::Value *call_count_ptr = embedConstantPtr(&cf->times_called, g.i64->getPointerTo());
                 llvm::Value *cur_call_count = emitter.getBuilder()->CreateLoad(call_count_ptr);
                 llvm::Value *new_call_count = emitter.getBuilder()->CreateAdd(cur_call_count, getConstantInt(1, g.i64));
                 emitter.getBuilder()->CreateStore(new_call_count, call_count_ptr);
-                llvm::Value *reopt_test = emitter.getBuilder()->CreateICmpSGT(new_call_count, getConstantInt(REOPT_THRESHOLDS[effort], g.i64));
+                llvm::Value *reopt_test = emitter.getBuilder()->CreateICmpSGT(new_call_count, getConstantInt(getTieringPolicy()->reoptThreshold(effort), g.i64));
 
-                llvm::Value* md_vals[] = {llvm::MDString::get(g.context, "branch_weights"), getConstantInt(1), getConstantInt(1000)};
-                llvm::MDNode* branch_weights = llvm::MDNode::get(g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
+                llvm::Value* md_vals[] = {llvm::MDString::get(*g.context, "branch_weights"), getConstantInt(1), getConstantInt(1000)};
+                llvm::MDNode* branch_weights = llvm::MDNode::get(*g.context, llvm::ArrayRef<llvm::Value*>(md_vals));
 
                 llvm::BranchInst* guard = emitter.getBuilder()->CreateCondBr(reopt_test, reopt_bb, llvm_entry_blocks[0], branch_weights);
 
@@ -2376,13 +3836,16 @@ static void emitBBs(IRGenState* irstate, const char* bb_type, GuardList &out_gua
 
                 emitter.getBuilder()->SetInsertPoint(llvm_entry_blocks[0]);
             }
-            generator.unpackArguments(arg_names, cf->sig->arg_types);
+            generator.doSafepoint();
+            generator.unpackArguments(arg_names, irstate->getSignature()->arg_types);
         } else if (entry_descriptor && block == entry_descriptor->backedge->target) {
             assert(block->predecessors.size() > 1);
             assert(osr_entry_block);
             assert(phis);
 
             for (OSREntryDescriptor::ArgMap::const_iterator it = entry_descriptor->args.begin(), end = entry_descriptor->args.end(); it != end; ++it) {
+                if (it->first == CLOSURE_ARG_NAME)
+                    continue;
                 ConcreteCompilerType *analyzed_type = types->getTypeAtBlockStart(it->first, block);
                 //printf("For %s, given %s, analyzed for %s\n", it->first.c_str(), it->second->debugName().c_str(), analyzed_type->debugName().c_str());
 
@@ -2494,13 +3957,13 @@ static void emitBBs(IRGenState* irstate, const char* bb_type, GuardList &out_gua
         for (int i = 0; i < block_guards.size(); i++) {
             compareKeyset(&block_guards[i]->symbol_table, phis);
 
-            llvm::BasicBlock* off_ramp = llvm::BasicBlock::Create(g.context, "deopt_ramp", irstate->getLLVMFunction());
+            llvm::BasicBlock* off_ramp = llvm::BasicBlock::Create(*g.context, "deopt_ramp", irstate->getLLVMFunction());
             offramps.push_back(off_ramp);
             IREmitterImpl *emitter = new IREmitterImpl(irstate);
             emitter->getBuilder()->SetInsertPoint(off_ramp);
             emitters.push_back(emitter);
 
-            block_guards[i]->branch->setSuccessor(1, off_ramp);
+            setGuardFailureTarget(irstate, block_guards[i]->branch, off_ramp, NULL);
         }
 
         for (PHITable::iterator it = phis->begin(); it != phis->end(); it++) {
@@ -2577,6 +4040,56 @@ static void emitBBs(IRGenState* irstate, const char* bb_type, GuardList &out_gua
     }
 }
 
+// Without speculation, the type analysis only depends on the argument types, so it gets done once per
+// signature and kept on the SourceInfo for the other effort levels, OSR entries, deopt paths and inlined
+// copies.  The speculative one also depends on the type feedback, which keeps changing, so it gets redone
+// each time and the caller has to free it.
+static TypeAnalysis* getTypeAnalysis(SourceInfo *source, const std::vector<ConcreteCompilerType*> &arg_types, TypeAnalysis::SpeculationLevel speculation) {
+    ScopeInfo *scope_info = source->scoping->getScopeInfoForNode(source->ast);
+    if (speculation != TypeAnalysis::NONE) {
+        TraceScope _t("analysis", "speculative type analysis");
+        _t.addArg("function", source->getName());
+        return doTypeAnalysis(source->cfg, source->getArgNames(), arg_types, speculation, scope_info, getTypeFeedback(source));
+    }
+
+    TypeAnalysis* &types = source->type_analyses[arg_types];
+    if (types == NULL) {
+        TraceScope _t("analysis", "type analysis");
+        _t.addArg("function", source->getName());
+        types = doTypeAnalysis(source->cfg, source->getArgNames(), arg_types, TypeAnalysis::NONE, scope_info);
+    }
+    return types;
+}
+
+// Emits the callee's body into a function of its own in the current module, which the parent then
+// inlines once it's done; until then the parent is still in the middle of emitting its own blocks.
+// The body is emitted without any speculations, so there's no deopt path to worry about, and it gets
+// attributed to the parent's CompiledFunction since that's where its patchpoints will end up.
+static llvm::Function* emitInlinedCallee(IRGenState *parent, SourceInfo *source, FunctionSignature *sig) {
+    const std::vector<AST_expr*> &arg_names = source->getArgNames();
+
+    std::vector<llvm::Type*> llvm_arg_types;
+    for (int i = 0; i < sig->arg_types.size(); i++) {
+        llvm_arg_types.push_back(sig->arg_types[i]->llvmType());
+    }
+    llvm::FunctionType *ft = llvm::FunctionType::get(sig->rtn_type->llvmType(), llvm_arg_types, false /*vararg*/);
+    llvm::Function *f = llvm::Function::Create(ft, llvm::Function::InternalLinkage, "inlined_" + source->getName(), g.cur_module);
+
+    TypeAnalysis *types = getTypeAnalysis(source, sig->arg_types, TypeAnalysis::NONE);
+
+    BlockSet full_blocks, partial_blocks;
+    for (int i = 0; i < source->cfg->blocks.size(); i++) {
+        full_blocks.insert(source->cfg->blocks[i]);
+    }
+
+    IRGenState irstate(parent, f, sig, source);
+    GuardList guards;
+    emitBBs(&irstate, "opt", guards, GuardList(), types, arg_names, NULL, full_blocks, partial_blocks);
+    assert(guards.isEmpty());
+
+    return f;
+}
+
 static void computeBlockSetClosure(BlockSet &full_blocks, BlockSet &partial_blocks) {
     if (VERBOSITY("irgen") >= 1) {
         printf("Initial full:");
@@ -2666,15 +4179,22 @@ static std::string getUniqueFunctionName(std::string nameprefix, EffortLevel::Ef
     return os.str();
 }
 
-CompiledFunction* compileFunction(SourceInfo *source, const OSREntryDescriptor *entry_descriptor, EffortLevel::EffortLevel effort, FunctionSignature *sig, const std::vector<AST_expr*> &arg_names, std::string nameprefix) {
-    Timer _t("in compileFunction");
+CompiledFunction* generateIR(SourceInfo *source, const OSREntryDescriptor *entry_descriptor, EffortLevel::EffortLevel effort, FunctionSignature *sig, const std::vector<AST_expr*> &arg_names, std::string nameprefix, llvm::Module *module) {
+    Timer _t("in generateIR");
+    TraceScope _trace("irgen", "irgen");
+    _trace.addArg("function", source->getName());
+    _trace.addArg("effort", (long)effort);
 
     if (VERBOSITY("irgen") >= 1) source->cfg->print();
 
     assert(g.cur_module == NULL);
     std::string name = getUniqueFunctionName(nameprefix, effort, entry_descriptor);
-    g.cur_module = new llvm::Module(name, g.context);
-    g.cur_module->setDataLayout(g.tm->getDataLayout()->getStringRepresentation());
+    if (module) {
+        g.cur_module = module;
+    } else {
+        g.cur_module = new llvm::Module(name, *g.context);
+        g.cur_module->setDataLayout(g.tm->getDataLayout()->getStringRepresentation());
+    }
     //g.engine->addModule(g.cur_module);
 
     ////
@@ -2717,7 +4237,7 @@ CompiledFunction* compileFunction(SourceInfo *source, const OSREntryDescriptor *
     TypeAnalysis::SpeculationLevel speculation_level = TypeAnalysis::NONE;
     if (ENABLE_SPECULATION && effort >= EffortLevel::MODERATE)
         speculation_level = TypeAnalysis::SOME;
-    TypeAnalysis *types = doTypeAnalysis(source->cfg, arg_names, sig->arg_types, speculation_level, source->scoping->getScopeInfoForNode(source->ast));
+    TypeAnalysis *types = getTypeAnalysis(source, sig->arg_types, speculation_level);
 
     GuardList guards;
 
@@ -2748,18 +4268,27 @@ CompiledFunction* compileFunction(SourceInfo *source, const OSREntryDescriptor *
 
         computeBlockSetClosure(deopt_full_blocks, deopt_partial_blocks);
 
-        TypeAnalysis *deopt_types = doTypeAnalysis(source->cfg, arg_names, sig->arg_types, TypeAnalysis::NONE, source->scoping->getScopeInfoForNode(source->ast));
+        TypeAnalysis *deopt_types = getTypeAnalysis(source, sig->arg_types, TypeAnalysis::NONE);
         emitBBs(&irstate, "deopt", deopt_guards, guards, deopt_types, arg_names, NULL, deopt_full_blocks, deopt_partial_blocks);
         assert(deopt_guards.isEmpty());
-
-        delete deopt_types;
     }
 
     for (GuardList::expr_type_guard_iterator it = guards.after_begin(), end = guards.after_end(); it != end; ++it) {
         delete it->second;
     }
 
-    delete types;
+    if (speculation_level != TypeAnalysis::NONE)
+        delete types;
+
+    // Now that the function is complete, splice in the bodies of any callees we decided to inline:
+    for (llvm::CallInst *call : irstate.getInlinedCalls()) {
+        llvm::Function *callee = call->getCalledFunction();
+        llvm::InlineFunctionInfo inline_info;
+        bool inlined = llvm::InlineFunction(call, inline_info);
+        RELEASE_ASSERT(inlined, "");
+        assert(callee->use_empty());
+        callee->eraseFromParent();
+    }
 
     if (VERBOSITY("irgen") >= 1) {
         printf("generated IR:\n");
@@ -2790,9 +4319,28 @@ CompiledFunction* compileFunction(SourceInfo *source, const OSREntryDescriptor *
     static StatCounter us_irgen("us_compiling_irgen");
     us_irgen.log(us);
 
+    g.cur_module = NULL;
+
+    return cf;
+}
+
+// Doesn't look at any runtime state, so it's fine to call this off of the main thread
+// (as long as nothing else is using llvm at the same time).
+void optimizeCompiledFunction(CompiledFunction *cf, llvm::Function *f) {
+    if (f == NULL)
+        f = cf->func;
+    EffortLevel::EffortLevel effort = cf->effort;
+
+    assert(g.cur_module == NULL);
+    g.cur_module = f->getParent();
+
     if (ENABLE_LLVMOPTS)
         optimizeIR(f, effort);
 
+    // The interpreter doesn't know what to do with patchpoints, and interpreted frames have their own root finding.
+    if (ENABLE_PRECISE_STACK_ROOTS && effort != EffortLevel::INTERPRETED)
+        addGCRootStackmaps(f, cf);
+
     bool ENABLE_IR_DEBUG = false;
     if (ENABLE_IR_DEBUG) {
         addIRDebugSymbols(f);
@@ -2800,7 +4348,11 @@ CompiledFunction* compileFunction(SourceInfo *source, const OSREntryDescriptor *
     }
 
     g.cur_module = NULL;
+}
 
+CompiledFunction* compileFunction(SourceInfo *source, const OSREntryDescriptor *entry_descriptor, EffortLevel::EffortLevel effort, FunctionSignature *sig, const std::vector<AST_expr*> &arg_names, std::string nameprefix) {
+    CompiledFunction *cf = generateIR(source, entry_descriptor, effort, sig, arg_names, nameprefix);
+    optimizeCompiledFunction(cf);
     return cf;
 }
 
@@ -64,11 +64,20 @@ class IREmitter {
         virtual CompiledFunction* currentFunction() = 0;
 
         virtual llvm::Function* getIntrinsic(llvm::Intrinsic::ID) = 0;
-        virtual llvm::Value* createPatchpoint(const PatchpointSetupInfo *pp, void* func_addr, const std::vector<llvm::Value*> &args) = 0;
+        virtual llvm::Value* createPatchpoint(PatchpointSetupInfo *pp, void* func_addr, const std::vector<llvm::Value*> &args) = 0;
 };
 
+// compileFunction() is generateIR() followed by optimizeCompiledFunction(); they're split up so that the
+// llvm-only second half can be done on the background compile thread.
+// If module is given, the function gets added to it instead of to a new one (for compiling several functions together).
+CompiledFunction* generateIR(SourceInfo *source, const OSREntryDescriptor *entry_descriptor, EffortLevel::EffortLevel effort, FunctionSignature *sig, const std::vector<AST_expr*> &arg_names, std::string nameprefix, llvm::Module *module = NULL);
+// f is the llvm function to work on, if it's not cf->func (ex a copy of it in another llvm context).
+void optimizeCompiledFunction(CompiledFunction *cf, llvm::Function *f = NULL);
 CompiledFunction* compileFunction(SourceInfo *source, const OSREntryDescriptor *entry_descriptor, EffortLevel::EffortLevel effort, FunctionSignature *sig, const std::vector<AST_expr*> &arg_names, std::string nameprefix);
 
+// Gets the (shared) CLFunction for a def that appears in the given function.
+CLFunction* wrapFunction(AST_FunctionDef *node, SourceInfo *parent);
+
 }
 
 #endif
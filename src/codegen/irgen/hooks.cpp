@@ -12,11 +12,29 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/TypeFinder.h"
+#include "llvm/Linker.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include "core/common.h"
 #include "core/options.h"
 #include "core/stats.h"
+#include "core/trace.h"
 #include "core/types.h"
 
 #include "core/ast.h"
@@ -25,18 +43,26 @@
 
 #include "analysis/function_analysis.h"
 #include "analysis/scoping_analysis.h"
+#include "analysis/type_analysis.h"
 
 #include "asm_writing/icinfo.h"
 
+#include "codegen/ast_interpreter.h"
 #include "codegen/codegen.h"
+#include "codegen/compile_cache.h"
 #include "codegen/compvars.h"
+#include "codegen/entry.h"
 #include "codegen/irgen.h"
 #include "codegen/llvm_interpreter.h"
+#include "codegen/memmgr.h"
 #include "codegen/osrentry.h"
 #include "codegen/stackmaps.h"
+#include "codegen/type_recording.h"
 #include "codegen/patchpoints.h"
 #include "codegen/irgen/hooks.h"
+#include "codegen/irgen/tiering.h"
 #include "codegen/irgen/util.h"
+#include "codegen/irgen/warmup.h"
 
 #include "runtime/gc_runtime.h"
 #include "runtime/objmodel.h"
@@ -45,6 +71,14 @@
 namespace pyston {
 
 // TODO terrible place for these!
+SourceInfo::~SourceInfo() {
+    for (auto &p : type_analyses)
+        delete p.second;
+    delete phis;
+    delete liveness;
+    delete cfg;
+}
+
 const std::string SourceInfo::getName() {
     assert(ast);
     switch (ast->type) {
@@ -70,12 +104,7 @@ AST_arguments* SourceInfo::getArgsAST() {
 }
 
 const std::vector<AST_expr*>& SourceInfo::getArgNames() {
-    static std::vector<AST_expr*> empty;
-
-    AST_arguments* args = getArgsAST();
-    if (args == NULL)
-        return empty;
-    return args->args;
+    return arg_names;
 }
 
 const std::vector<AST_stmt*>& SourceInfo::getBody() {
@@ -90,7 +119,56 @@ const std::vector<AST_stmt*>& SourceInfo::getBody() {
     }
 }
 
-static void compileIR(CompiledFunction* cf, EffortLevel::EffortLevel effort) {
+// Everything that touches llvm (or the patchpoint registries that irgen / the jit fill in) has to hold this,
+// since that can happen on the background compile thread as well as the main thread.
+static std::mutex codegen_lock;
+
+// Jits all the functions in the module (which have to be the given ones) in one go.
+// The module can be a copy of the one the functions were generated into, in which case the functions
+// get looked up by name, and it's up to the caller to set llvm_code.
+static void jitModule(llvm::Module* module, const std::vector<CompiledFunction*> &cfs) {
+    Timer _t("to jit the IR");
+    TraceScope _trace("mcjit", "jit");
+    _trace.addArg("num_functions", (long)cfs.size());
+    if (cfs.size() == 1)
+        _trace.addArg("function", cfs[0]->func->getName().str());
+
+    startLoadingModule(module);
+    g.engine->addModule(module);
+    for (CompiledFunction *cf : cfs) {
+        llvm::Function* func = module->getFunction(cf->func->getName());
+        assert(func);
+        void* compiled = (void*)g.engine->getFunctionAddress(func->getName());
+        assert(compiled);
+        cf->code = compiled;
+        if (func == cf->func)
+            cf->llvm_code = embedConstantPtr(compiled, cf->func->getType());
+        if (VERBOSITY("irgen") >= 1) {
+            printf("Compiled function to %p\n", compiled);
+        }
+    }
+    finishLoadingModule(module);
+
+    // Nothing looks at the bodies again (reopts and osr compiles generate new IR from the CFG), and they're
+    // usually a lot bigger than the machine code.  The declarations have to stay, since the module is
+    // still owned by the engine and other things refer to the functions by name.
+    if (ENABLE_IR_FREEING) {
+        static StatCounter num_freed("num_ir_bodies_freed");
+        for (CompiledFunction *cf : cfs) {
+            module->getFunction(cf->func->getName())->deleteBody();
+            num_freed.log();
+        }
+    }
+
+    long us = _t.end();
+    static StatCounter us_jitting("us_compiling_jitting");
+    us_jitting.log(us);
+    static StatCounter num_jits("num_jits");
+    num_jits.log();
+}
+
+// Returns the stackmap for the new code; it has to be processed before the code can be run.
+static StackMap* compileIR(CompiledFunction* cf, EffortLevel::EffortLevel effort) {
     assert(cf);
     assert(cf->func);
 
@@ -100,36 +178,26 @@ static void compileIR(CompiledFunction* cf, EffortLevel::EffortLevel effort) {
         //g.cur_module->dump();
     }
 
-    void* compiled = NULL;
     if (effort > EffortLevel::INTERPRETED) {
-        Timer _t("to jit the IR");
-        g.engine->addModule(cf->func->getParent());
-        compiled = (void*)g.engine->getFunctionAddress(cf->func->getName());
-        assert(compiled);
-        cf->llvm_code = embedConstantPtr(compiled, cf->func->getType());
-
-        long us = _t.end();
-        static StatCounter us_jitting("us_compiling_jitting");
-        us_jitting.log(us);
-        static StatCounter num_jits("num_jits");
-        num_jits.log();
+        jitModule(cf->func->getParent(), std::vector<CompiledFunction*>(1, cf));
     } else {
         // HAX just get it for now; this is just to make sure everything works
         //(void*)g.func_registry.getFunctionAddress(cf->func->getName());
+        cf->code = NULL;
     }
 
-    cf->code = compiled;
-    if (VERBOSITY("irgen") >= 1) {
-        printf("Compiled function to %p\n", compiled);
-    }
-
-    StackMap *stackmap = parseStackMap();
-    patchpoints::processStackmap(stackmap);
+    return parseStackMap();
 }
 
 // Compiles a new version of the function with the given signature and adds it to the list;
 // should only be called after checking to see if the other versions would work.
+// Every function that's had something compiled for it, for recompileFunctions:
+static std::unordered_set<CLFunction*> compiled_clfuncs;
+
 static CompiledFunction* _doCompile(CLFunction *f, FunctionSignature *sig, EffortLevel::EffortLevel effort, const OSREntryDescriptor *entry) {
+    std::lock_guard<std::mutex> _lock(codegen_lock);
+    compiled_clfuncs.insert(f);
+
     Timer _t("for _doCompile()");
     assert(sig);
 
@@ -141,6 +209,10 @@ static CompiledFunction* _doCompile(CLFunction *f, FunctionSignature *sig, Effor
     const std::vector<AST_expr*> &arg_names = source->getArgNames();
     AST_arguments *args = source->getArgsAST();
 
+    TraceScope _trace("compile", entry ? "osr compile" : "compile");
+    _trace.addArg("function", name);
+    _trace.addArg("effort", (long)effort);
+
     if (VERBOSITY("irgen") >= 1) {
         std::string s;
         llvm::raw_string_ostream ss(s);
@@ -165,20 +237,37 @@ static CompiledFunction* _doCompile(CLFunction *f, FunctionSignature *sig, Effor
     // Do the analysis now if we had deferred it earlier:
     if (source->cfg == NULL) {
         assert(source->ast);
-        source->cfg = computeCFG(source->ast->type, source->getBody());
-        source->liveness = computeLivenessInfo(source->cfg);
+        {
+            TraceScope _t("analysis", "cfg");
+            _t.addArg("function", name);
+            source->cfg = computeCFG(source->ast->type, source->getBody());
+        }
+        {
+            TraceScope _t("analysis", "liveness");
+            _t.addArg("function", name);
+            source->liveness = computeLivenessInfo(source->cfg);
+        }
+        TraceScope _t("analysis", "phis");
+        _t.addArg("function", name);
         source->phis = computeRequiredPhis(args, source->cfg, source->liveness, 
                 source->scoping->getScopeInfoForNode(source->ast));
     }
 
-    CompiledFunction *cf = compileFunction(source, entry, effort, sig, arg_names, name);
-
-    compileIR(cf, effort);
+    CompiledFunction *cf;
+    if (effort == EffortLevel::INTERPRETED && !ENABLE_LLVM_INTERPRETER) {
+        // The AST interpreter runs straight off of the CFG, so there's nothing to generate:
+        assert(entry == NULL);
+        cf = new CompiledFunction(NULL, sig, true, NULL, NULL, effort, NULL);
+    } else {
+        cf = compileFunction(source, entry, effort, sig, arg_names, name);
+        patchpoints::processStackmap(compileIR(cf, effort));
+    }
     f->addVersion(cf);
     assert(f->versions.size());
+    noteCompiledVersion(cf);
 
     long us = _t.end();
-    static StatCounter us_compiling("us_compiling");
+    static StatHistogram us_compiling("us_compiling");
     us_compiling.log(us);
     static StatCounter num_compiles("num_compiles");
     num_compiles.log();
@@ -218,11 +307,7 @@ static CompiledFunction* _doCompile(CLFunction *f, FunctionSignature *sig, Effor
 }
 
 static EffortLevel::EffortLevel initialEffort() {
-    if (FORCE_OPTIMIZE)
-        return EffortLevel::MAXIMAL;
-    if (ENABLE_INTERPRETER)
-        return EffortLevel::INTERPRETED;
-    return EffortLevel::MINIMAL;
+    return getTieringPolicy()->initialEffort();
 }
 
 CompiledFunction* compileModule(AST_Module *m, BoxedModule *bm) {
@@ -264,11 +349,13 @@ static CompiledFunction* _doReopt(CompiledFunction *cf, EffortLevel::EffortLevel
     FunctionList &versions = clfunc->versions;
     for (int i = 0; i < versions.size(); i++) {
         if (versions[i] == cf) {
-            versions.erase(versions.begin() + i);
+            clfunc->removeVersion(i);
 
             CompiledFunction *new_cf = _doCompile(clfunc, cf->sig, new_effort, NULL); // this pushes the new CompiledVersion to the back of the version list
 
             cf->dependent_callsites.invalidateAll();
+            if (!cf->is_interpreted)
+                noteObsoleteCode(cf->code);
 
             return new_cf;
         }
@@ -283,17 +370,19 @@ void* compilePartialFunc(OSRExit* exit) {
     assert(exit->parent_cf);
     assert(exit->parent_cf->effort < EffortLevel::MAXIMAL);
     stat_osrexits.log();
+    if (TRACING) {
+        TraceArgs args;
+        addTraceArg(args, "function", exit->parent_cf->clfunc->source->getName());
+        addTraceArg(args, "effort", (long)exit->parent_cf->effort);
+        traceInstant("osr", "OSR exit", args);
+    }
 
     //if (VERBOSITY("irgen") >= 1) printf("In compilePartialFunc, handling %p\n", exit);
 
     assert(exit->parent_cf->clfunc);
     CompiledFunction* &new_cf = exit->parent_cf->clfunc->osr_versions[exit->entry];
     if (new_cf == NULL) {
-        EffortLevel::EffortLevel new_effort = EffortLevel::MAXIMAL;
-        if (exit->parent_cf->effort == EffortLevel::INTERPRETED)
-            new_effort = EffortLevel::MINIMAL;
-        //EffortLevel::EffortLevel new_effort = (EffortLevel::EffortLevel)(exit->parent_cf->effort + 1);
-        //new_effort = EffortLevel::MAXIMAL;
+        EffortLevel::EffortLevel new_effort = getTieringPolicy()->osrEffort(exit->parent_cf->effort);
         CompiledFunction *compiled = _doCompile(exit->parent_cf->clfunc, exit->parent_cf->sig, new_effort, exit->entry);
         assert(compiled = new_cf);
     }
@@ -301,22 +390,436 @@ void* compilePartialFunc(OSRExit* exit) {
     return new_cf->code;
 }
 
+// Background reoptimization:
+// The irgen half of the compile looks at runtime state (and can allocate, ex for interned strings), so it
+// still happens on the main thread; the worker thread only does the llvm half (optimizing and jitting),
+// which is the expensive part at the higher effort levels.  The new version gets installed by the main
+// thread the next time the old version asks to be reoptimized, which is a point at which it's safe to
+// swap it in; until then the old version keeps getting used.
+//
+// Compiles that get queued close together for the same effort level get batched into one module, since
+// there's a big fixed cost to each module that gets jitted.
+//
+// With more than one compile thread, each thread has its own llvm context (an llvm context can only be
+// used by one thread at a time).  The thread copies the batch's module into its context through bitcode,
+// and then optimizes it there without holding the codegen lock, so that batches get optimized in parallel
+// with each other and with irgen on the main thread.  Jitting uses the shared execution engine and memory
+// manager, so that part still happens under the codegen lock.
+struct CompileBatch;
+struct BackgroundCompile {
+    CompiledFunction *old_cf, *new_cf;
+    CompileBatch *batch;
+    std::atomic<bool> done;
+
+    BackgroundCompile(CompiledFunction *old_cf, CompiledFunction *new_cf, CompileBatch *batch) : old_cf(old_cf), new_cf(new_cf), batch(batch), done(false) {}
+};
+
+struct CompileBatch {
+    EffortLevel::EffortLevel effort;
+    llvm::Module *module;
+    std::chrono::steady_clock::time_point started;
+    std::vector<BackgroundCompile*> jobs;
+    // Whether a compile thread has picked this batch to work on next; it can still get added to until it
+    // gets taken off the queue.
+    bool claimed;
+
+    // The stackmap covers the whole module, so it gets processed when the first of the jobs gets installed:
+    StackMap *stackmap;
+    bool stackmap_processed;
+    int num_uninstalled;
+
+    CompileBatch(EffortLevel::EffortLevel effort, llvm::Module *module) : effort(effort), module(module), started(std::chrono::steady_clock::now()), claimed(false), stackmap(NULL), stackmap_processed(false), num_uninstalled(0) {}
+};
+
+static std::mutex compile_queue_lock;
+static std::condition_variable compile_queue_cv;
+static std::deque<CompileBatch*> compile_queue;
+// The batches that have been taken off of the queue but aren't done yet:
+static int num_batches_compiling = 0;
+static bool workers_started = false;
+// Only used from the main thread; keyed by the version being replaced.
+static std::unordered_map<CompiledFunction*, BackgroundCompile*> pending_compiles;
+
+static StatCounter us_compiling_background("us_compiling_background");
+static StatCounter num_compiles_background("num_compiles_background");
+static StatCounter num_batches_background("num_compile_batches_background");
+
+static CompileBatch* firstUnclaimedBatch() {
+    for (CompileBatch *batch : compile_queue) {
+        if (!batch->claimed)
+            return batch;
+    }
+    return NULL;
+}
+
+static void optimizeAndJitBatch(CompileBatch *batch) {
+    std::lock_guard<std::mutex> _lock(codegen_lock);
+    std::vector<CompiledFunction*> cfs;
+    for (BackgroundCompile *job : batch->jobs) {
+        optimizeCompiledFunction(job->new_cf);
+        cfs.push_back(job->new_cf);
+    }
+    jitModule(batch->module, cfs);
+    batch->stackmap = parseStackMap();
+}
+
+// Reading the bitcode into this thread's context gives it its own copies of all the named types (ex
+// "class.pyston::BoxedClass.1"), which don't match the ones in this thread's copy of the stdlib that the passes
+// compare against.  The linker knows how to merge them back together, as long as the destination module
+// uses the originals, so link it into a module that has a dummy global for each of them.
+static llvm::Module* importModule(const std::string &bitcode) {
+    llvm::MemoryBuffer *buffer = llvm::MemoryBuffer::getMemBuffer(bitcode, "", false);
+    llvm::ErrorOr<llvm::Module*> m_or = llvm::parseBitcodeFile(buffer, *g.context);
+    delete buffer;
+    RELEASE_ASSERT(m_or, "");
+    llvm::Module *parsed = m_or.get();
+
+    llvm::Module *module = new llvm::Module(parsed->getModuleIdentifier(), *g.context);
+    llvm::TypeFinder types;
+    types.run(*g.stdlib_module, true);
+    std::vector<llvm::StructType*> to_anchor(types.begin(), types.end());
+    to_anchor.push_back(llvm::cast<llvm::StructType>(g.llvm_opaque_type));
+
+    std::vector<llvm::GlobalVariable*> anchors;
+    for (llvm::StructType *t : to_anchor)
+        anchors.push_back(new llvm::GlobalVariable(*module, t, false, llvm::GlobalValue::ExternalLinkage, NULL, "type_anchor"));
+
+    std::string error;
+    bool failed = llvm::Linker::LinkModules(module, parsed, llvm::Linker::DestroySource, &error);
+    RELEASE_ASSERT(!failed, "%s", error.c_str());
+    delete parsed;
+
+    for (llvm::GlobalVariable *gv : anchors)
+        gv->eraseFromParent();
+    return module;
+}
+
+// Does the same thing as optimizeAndJitBatch, but in this thread's own llvm context.
+static void optimizeAndJitBatchInOwnContext(CompileBatch *batch) {
+    std::string bitcode;
+    {
+        std::lock_guard<std::mutex> _lock(codegen_lock);
+        llvm::raw_string_ostream os(bitcode);
+        llvm::WriteBitcodeToFile(batch->module, os);
+        os.flush();
+
+        // From here on, the main thread's copy is only used for the declarations:
+        for (BackgroundCompile *job : batch->jobs)
+            job->new_cf->func->deleteBody();
+    }
+
+    llvm::Module *module = importModule(bitcode);
+
+    std::vector<CompiledFunction*> cfs;
+    for (BackgroundCompile *job : batch->jobs) {
+        llvm::Function *f = module->getFunction(job->new_cf->func->getName());
+        assert(f);
+        optimizeCompiledFunction(job->new_cf, f);
+        cfs.push_back(job->new_cf);
+    }
+
+    std::lock_guard<std::mutex> _lock(codegen_lock);
+    jitModule(module, cfs);
+    batch->stackmap = parseStackMap();
+}
+
+static void backgroundCompileWorker(bool own_context) {
+    bool initialized = false;
+    if (!own_context)
+        shareMainThreadCodegen();
+    while (true) {
+        CompileBatch *batch;
+        {
+            std::unique_lock<std::mutex> l(compile_queue_lock);
+            compile_queue_cv.wait(l, []{ return firstUnclaimedBatch() != NULL; });
+            batch = firstUnclaimedBatch();
+            batch->claimed = true;
+
+            // Give some more compiles a chance to join the batch before starting on it:
+            TieringPolicy *policy = getTieringPolicy();
+            if (policy->max_batch_size > 1) {
+                compile_queue_cv.wait_until(l, batch->started + std::chrono::milliseconds(policy->batch_window_ms),
+                        [batch, policy]{ return batch->jobs.size() >= policy->max_batch_size; });
+            }
+            compile_queue.erase(std::find(compile_queue.begin(), compile_queue.end(), batch));
+            num_batches_compiling++;
+        }
+
+        // Loading our own copy of the stdlib takes a while (and happens under the codegen lock), so wait until
+        // this thread actually gets something to compile; with a short-running program most of them never will.
+        if (own_context && !initialized) {
+            std::lock_guard<std::mutex> _lock(codegen_lock);
+            initCodegenThread();
+            initialized = true;
+        }
+
+        Timer _t("background compile");
+        if (own_context)
+            optimizeAndJitBatchInOwnContext(batch);
+        else
+            optimizeAndJitBatch(batch);
+        us_compiling_background.log(_t.end());
+        num_compiles_background.log(batch->jobs.size());
+        num_batches_background.log();
+
+        batch->num_uninstalled = batch->jobs.size();
+        for (BackgroundCompile *job : batch->jobs) {
+            job->done = true;
+            // Make the old version call back into reoptCompiledFunc on its next call, so that the new one
+            // gets picked up quickly.  This races with the jitted code's (non-atomic) increment, but the worst
+            // that can happen is that we lose this store and the install waits until the threshold gets hit again.
+            job->old_cf->times_called = INT64_MAX / 2;
+        }
+
+        {
+            std::lock_guard<std::mutex> l(compile_queue_lock);
+            num_batches_compiling--;
+        }
+        compile_queue_cv.notify_all();
+    }
+}
+
+void beforeFork() {
+    {
+        std::unique_lock<std::mutex> l(compile_queue_lock);
+        compile_queue_cv.wait(l, []{ return compile_queue.empty() && num_batches_compiling == 0; });
+    }
+    // Same order as startBackgroundReopt:
+    codegen_lock.lock();
+    compile_queue_lock.lock();
+}
+
+void afterFork(bool in_child) {
+    if (in_child)
+        workers_started = false;
+    compile_queue_lock.unlock();
+    codegen_lock.unlock();
+}
+
+static void startBackgroundReopt(CompiledFunction *cf, EffortLevel::EffortLevel new_effort) {
+    if (!workers_started) {
+        int nthreads = getTieringPolicy()->compile_threads;
+        if (nthreads > 1) {
+            bool ok = llvm::llvm_start_multithreaded();
+            RELEASE_ASSERT(ok, "llvm wasn't built with thread support");
+        }
+        // The jit cache keeps track of which relocations belong to which (main-thread) module, so the
+        // threads all have to share the main context when it's on:
+        bool own_contexts = nthreads > 1 && !compileCacheEnabled();
+        for (int i = 0; i < nthreads; i++)
+            std::thread(backgroundCompileWorker, own_contexts).detach();
+        workers_started = true;
+    }
+
+    CLFunction *clfunc = cf->clfunc;
+    SourceInfo *source = clfunc->source;
+    assert(source && source->cfg);
+
+    {
+        // Holding the queue lock the whole time keeps the worker from starting on the batch while
+        // we're adding to its module.
+        std::lock_guard<std::mutex> _lock(codegen_lock);
+        std::lock_guard<std::mutex> l(compile_queue_lock);
+
+        // Only the newest batch can still be waiting to get started on.  (Batching is off with the jit cache,
+        // since a cached batch only gets reused if everything in it gets compiled again the same way.)
+        CompileBatch *batch = NULL;
+        if (!compile_queue.empty() && compile_queue.back()->effort == new_effort
+                && compile_queue.back()->jobs.size() < getTieringPolicy()->max_batch_size && !compileCacheEnabled())
+            batch = compile_queue.back();
+
+        CompiledFunction *new_cf = generateIR(source, NULL, new_effort, cf->sig, source->getArgNames(), source->getName(), batch ? batch->module : NULL);
+        if (batch == NULL) {
+            batch = new CompileBatch(new_effort, new_cf->func->getParent());
+            compile_queue.push_back(batch);
+        }
+
+        BackgroundCompile *job = new BackgroundCompile(cf, new_cf, batch);
+        batch->jobs.push_back(job);
+        pending_compiles[cf] = job;
+    }
+    // The thread waiting on the newest batch might not be the one that should wake up:
+    compile_queue_cv.notify_all();
+}
+
+// Returns the new version if the background compile for this one has finished, or NULL if the old one
+// should keep getting used for now.
+static CompiledFunction* _doBackgroundReopt(CompiledFunction *cf, EffortLevel::EffortLevel new_effort) {
+    auto it = pending_compiles.find(cf);
+    if (it == pending_compiles.end()) {
+        startBackgroundReopt(cf, new_effort);
+        return NULL;
+    }
+
+    BackgroundCompile *job = it->second;
+    if (!job->done)
+        return NULL;
+    pending_compiles.erase(it);
+
+    CompiledFunction *new_cf = job->new_cf;
+    CLFunction *clfunc = cf->clfunc;
+    CompileBatch *batch = job->batch;
+    {
+        std::lock_guard<std::mutex> _lock(codegen_lock);
+        if (!batch->stackmap_processed) {
+            patchpoints::processStackmap(batch->stackmap);
+            batch->stackmap = NULL;
+            batch->stackmap_processed = true;
+        }
+        // Not set yet if the code was compiled from a copy of the function in another llvm context:
+        if (new_cf->llvm_code == NULL)
+            new_cf->llvm_code = embedConstantPtr(new_cf->code, new_cf->func->getType());
+    }
+    delete job;
+    if (--batch->num_uninstalled == 0)
+        delete batch;
+
+    FunctionList &versions = clfunc->versions;
+    for (int i = 0; i < versions.size(); i++) {
+        if (versions[i] == cf) {
+            clfunc->removeVersion(i);
+            clfunc->addVersion(new_cf);
+            noteCompiledVersion(new_cf);
+            cf->dependent_callsites.invalidateAll();
+            if (!cf->is_interpreted)
+                noteObsoleteCode(cf->code);
+            return new_cf;
+        }
+    }
+    assert(0 && "Couldn't find a version to reopt! Probably reopt'd already?");
+    abort();
+}
+
 static StatCounter stat_reopt("reopts");
 extern "C" char* reoptCompiledFunc(CompiledFunction *cf) {
     if (VERBOSITY("irgen") >= 1) printf("In reoptCompiledFunc, %p, %ld\n", cf, cf->times_called);
-    stat_reopt.log();
 
     assert(cf->effort < EffortLevel::MAXIMAL);
     assert(cf->clfunc->versions.size());
-    CompiledFunction *new_cf = _doReopt(cf, (EffortLevel::EffortLevel(cf->effort + 1)));
+
+    // Interpreted versions don't have any code that we could keep running, and compiling
+    // at the MINIMAL level is cheap anyway.
+    EffortLevel::EffortLevel new_effort = getTieringPolicy()->reoptEffort(cf->effort);
+
+    if (BACKGROUND_COMPILE && !cf->is_interpreted) {
+        CompiledFunction *new_cf = NULL;
+        if (pending_compiles.count(cf) || getTieringPolicy()->shouldStartCompile(pending_compiles.size()))
+            new_cf = _doBackgroundReopt(cf, new_effort);
+        if (new_cf == NULL) {
+            // We're going to call right back into the old version, so don't have it come straight back here:
+            cf->times_called = 0;
+            return (char*)cf->code;
+        }
+        stat_reopt.log();
+        assert(!new_cf->is_interpreted);
+        return (char*)new_cf->code;
+    }
+
+    stat_reopt.log();
+    CompiledFunction *new_cf = _doReopt(cf, new_effort);
     assert(!new_cf->is_interpreted);
     return (char*)new_cf->code;
 }
 
+static StatCounter stat_guard_failures("guard_failure_reports");
+static StatCounter stat_guard_recompiles("guard_failure_recompiles");
+extern "C" void guardFailed(GuardFailureInfo* info) {
+    CompiledFunction *cf = info->parent_cf;
+    CLFunction *clfunc = cf->clfunc;
+    assert(clfunc && clfunc->source);
+    SourceInfo *source = clfunc->source;
+
+    stat_guard_failures.log();
+    // So that the sites that keep failing show up in the stats:
+    std::string site_name = "guard_failures_" + source->getName();
+    if (info->node)
+        site_name += "_line" + std::to_string(info->node->lineno);
+    else
+        site_name += "_osr_entry";
+    StatCounter(site_name).log();
+
+    if (VERBOSITY("irgen") >= 1) printf("Guard in %p has failed %ld times; recompiling without it (%s)\n", cf, info->num_failures, site_name.c_str());
+
+    getTypeFeedback(source)->markSpeculationFailed(info->node);
+
+    // The current call keeps going in the deopt code; new calls will get the recompiled version.
+    if (cf->entry_descriptor) {
+        // The next time the OSR exit gets taken it'll compile a new version:
+        auto it = clfunc->osr_versions.find(cf->entry_descriptor);
+        if (it != clfunc->osr_versions.end() && it->second == cf)
+            clfunc->osr_versions.erase(it);
+        return;
+    }
+
+    FunctionList &versions = clfunc->versions;
+    for (int i = 0; i < versions.size(); i++) {
+        if (versions[i] == cf) {
+            stat_guard_recompiles.log();
+
+            // If there's a background reopt going, it was made with the bad speculation too; just forget about it.
+            pending_compiles.erase(cf);
+
+            clfunc->removeVersion(i);
+            _doCompile(clfunc, cf->sig, cf->effort, NULL);
+            cf->dependent_callsites.invalidateAll();
+            return;
+        }
+    }
+    // Must have gotten replaced already.
+}
+
+static StatCounter stat_recompiles("forced_recompiles");
+void recompileFunctions(bool (*filter)(CLFunction*)) {
+    std::vector<CLFunction*> to_recompile;
+    for (CLFunction *clfunc : compiled_clfuncs) {
+        if (filter(clfunc))
+            to_recompile.push_back(clfunc);
+    }
+
+    for (CLFunction *clfunc : to_recompile) {
+        // The OSR versions get recompiled the next time their exits get taken:
+        clfunc->osr_versions.clear();
+
+        std::vector<CompiledFunction*> old_versions(clfunc->versions.begin(), clfunc->versions.end());
+        for (CompiledFunction *cf : old_versions) {
+            if (cf->is_interpreted)
+                continue;
+            stat_recompiles.log();
+
+            // Anything compiling in the background was made from the same state as the old version:
+            pending_compiles.erase(cf);
+
+            FunctionList &versions = clfunc->versions;
+            int idx = std::find(versions.begin(), versions.end(), cf) - versions.begin();
+            assert(idx < versions.size());
+            clfunc->removeVersion(idx);
+            _doCompile(clfunc, cf->sig, cf->effort, NULL);
+            cf->dependent_callsites.invalidateAll();
+            noteObsoleteCode(cf->code);
+        }
+    }
+}
+
 CompiledFunction* resolveCLFunc(CLFunction *f, int64_t nargs, Box* arg1, Box* arg2, Box* arg3, Box** args) {
     static StatCounter slowpath_resolveclfunc("slowpath_resolveclfunc");
+    static StatCounter slowpath_resolveclfunc_scan("slowpath_resolveclfunc_scan");
     slowpath_resolveclfunc.log();
 
+    BoxedClass* arg_classes[CLFunction::VERSION_CACHE_MAX_ARGS];
+    bool cacheable = nargs <= CLFunction::VERSION_CACHE_MAX_ARGS;
+    if (cacheable) {
+        if (nargs >= 1) arg_classes[0] = arg1->cls;
+        if (nargs >= 2) arg_classes[1] = arg2->cls;
+        if (nargs >= 3) arg_classes[2] = arg3->cls;
+        for (int j = 3; j < nargs; j++)
+            arg_classes[j] = args[j-3]->cls;
+
+        CompiledFunction *cf = f->lookupVersionCache(nargs, arg_classes);
+        if (cf)
+            return cf;
+    }
+    slowpath_resolveclfunc_scan.log();
+
     FunctionList &versions = f->versions;
 
     for (int i = 0; i < versions.size(); i++) {
@@ -365,6 +868,8 @@ CompiledFunction* resolveCLFunc(CLFunction *f, int64_t nargs, Box* arg1, Box* ar
         assert(!cf->entry_descriptor);
         assert(cf->is_interpreted == (cf->code == NULL));
 
+        if (cacheable)
+            f->addToVersionCache(nargs, arg_classes, cf);
         return cf;
     }
 
@@ -395,29 +900,70 @@ CompiledFunction* resolveCLFunc(CLFunction *f, int64_t nargs, Box* arg1, Box* ar
         abort();
     }
 
-    assert(f->source->getArgsAST()->vararg.size() == 0);
     bool is_vararg = false;
 
-    std::vector<ConcreteCompilerType*> arg_types;
-    if (nargs >= 1) {
-        arg_types.push_back(typeFromClass(arg1->cls));
-    }
-    if (nargs >= 2) {
-        arg_types.push_back(typeFromClass(arg2->cls));
-    }
-    if (nargs >= 3) {
-        arg_types.push_back(typeFromClass(arg3->cls));
+    // Functions that get called with lots of different argument types stop getting specialized
+    // versions past a point; they get one that takes everything as UNKNOWN instead, which (since it'll
+    // fit any arguments) is the last version that the function will need.
+    int num_specialized = 0;
+    for (CompiledFunction *version : versions) {
+        for (ConcreteCompilerType *t : version->sig->arg_types) {
+            if (t != UNKNOWN) {
+                num_specialized++;
+                break;
+            }
+        }
     }
-    for (int j = 3; j < nargs; j++) {
-        arg_types.push_back(typeFromClass(args[j-3]->cls));
+    bool generic = num_specialized >= MAX_SPECIALIZED_VERSIONS;
+
+    std::vector<ConcreteCompilerType*> arg_types;
+    if (generic) {
+        static StatCounter stat_generic("generic_versions_compiled");
+        static StatCounterFamily stat_capped("capped_versions_");
+        stat_generic.log();
+        stat_capped.log(f->source->getName(), num_specialized);
+
+        for (int j = 0; j < nargs; j++)
+            arg_types.push_back(UNKNOWN);
+    } else {
+        if (nargs >= 1) {
+            arg_types.push_back(typeFromClass(arg1->cls));
+        }
+        if (nargs >= 2) {
+            arg_types.push_back(typeFromClass(arg2->cls));
+        }
+        if (nargs >= 3) {
+            arg_types.push_back(typeFromClass(arg3->cls));
+        }
+        for (int j = 3; j < nargs; j++) {
+            arg_types.push_back(typeFromClass(args[j-3]->cls));
+        }
     }
     FunctionSignature *sig = new FunctionSignature(UNKNOWN, arg_types, is_vararg);
 
     EffortLevel::EffortLevel new_effort = initialEffort();
 
+    // If this version got hot in an earlier run, go straight to the level it got to:
+    EffortLevel::EffortLevel warm_effort = warmupEffort(f->source, sig);
+    if (warm_effort > new_effort) {
+        static StatCounter stat_warmups("warmup_compiles");
+        stat_warmups.log();
+
+        // Interpreted versions can't get replaced from the background, so start with a MINIMAL one:
+        if (BACKGROUND_COMPILE && ENABLE_REOPT && warm_effort > EffortLevel::MINIMAL) {
+            CompiledFunction *cf = _doCompile(f, sig, std::max(new_effort, EffortLevel::MINIMAL), NULL);
+            startBackgroundReopt(cf, warm_effort);
+            return cf;
+        }
+        new_effort = warm_effort;
+    }
+
     CompiledFunction *cf = _doCompile(f, sig, new_effort, NULL); // this pushes the new CompiledVersion to the back of the version list
     assert(cf->is_interpreted == (cf->code == NULL));
 
+    static StatHistogram stat_num_versions("function_versions");
+    stat_num_versions.log(versions.size());
+
     return cf;
 }
 
@@ -442,7 +988,7 @@ Box* callCompiledFunc(CompiledFunction *cf, int64_t nargs, Box* arg1, Box* arg2,
 
     BoxedList* made_vararg = NULL;
     if (cf->sig->is_vararg) {
-        made_vararg = (BoxedList*)createList();
+        made_vararg = (BoxedList*)createListSized(nargs - nsig_args);
         if (nsig_args == 0)
             rarg1 = made_vararg;
         else if (nsig_args == 1)
@@ -467,6 +1013,8 @@ Box* callCompiledFunc(CompiledFunction *cf, int64_t nargs, Box* arg1, Box* arg2,
         } else {
             return cf->call(rarg1, rarg2, rarg3, rargs);
         }
+    } else if (cf->func == NULL) {
+        return astInterpretFunction(cf, nargs, rarg1, rarg2, rarg3, rargs);
     } else {
         return interpretFunction(cf->func, nargs, rarg1, rarg2, rarg3, rargs);
     }
@@ -494,17 +1042,14 @@ static ConcreteCompilerType* processType(ConcreteCompilerType *type) {
     return type;
 }
 
+// This gets called for every builtin method during setupRuntime, so it stays away from llvm (and the codegen lock);
+// calls to these go through the function's address, so there's no llvm_code to make.
 void addRTFunction(CLFunction *cl_f, void* f, ConcreteCompilerType* rtn_type, const std::vector<ConcreteCompilerType*> &arg_types, bool is_vararg) {
     FunctionSignature *sig = new FunctionSignature(processType(rtn_type), is_vararg);
-    std::vector<llvm::Type*> llvm_arg_types;
-    for (int i = 0; i < arg_types.size(); i++) {
+    for (int i = 0; i < arg_types.size(); i++)
         sig->arg_types.push_back(processType(arg_types[i]));
-        llvm_arg_types.push_back(g.llvm_value_type_ptr);
-    }
-
-    llvm::FunctionType *ft = llvm::FunctionType::get(g.llvm_value_type_ptr, llvm_arg_types, false);
 
-    cl_f->addVersion(new CompiledFunction(NULL, sig, false, f, embedConstantPtr(f, ft->getPointerTo()), EffortLevel::MAXIMAL, NULL));
+    cl_f->addVersion(new CompiledFunction(NULL, sig, false, f, NULL, EffortLevel::MAXIMAL, NULL));
 }
 
 }
@@ -15,12 +15,42 @@
 #ifndef PYSTON_CODEGEN_IRGEN_HOOKS_H
 #define PYSTON_CODEGEN_IRGEN_HOOKS_H
 
+#include <cstdint>
+
 namespace pyston {
 
+class AST_expr;
 class OSRExit;
+struct CLFunction;
+struct CompiledFunction;
+
 void* compilePartialFunc(OSRExit*);
 extern "C" char* reoptCompiledFunc(CompiledFunction*);
 
+// One of these per speculation guard in the generated code:
+struct GuardFailureInfo {
+    CompiledFunction* parent_cf;
+    // The expression whose type got speculated on, or NULL for the type checks on entry to an OSR version:
+    AST_expr* node;
+    int64_t num_failures;
+
+    GuardFailureInfo(CompiledFunction* parent_cf, AST_expr* node) : parent_cf(parent_cf), node(node), num_failures(0) {}
+};
+extern "C" void guardFailed(GuardFailureInfo*);
+
+// Recompiles every version of the functions that filter picks (out of the ones that have been compiled so far), at
+// the same effort levels, and switches the callers over to the new code; frames that are already running keep
+// running the old code.  For when something that irgen looks at has changed, like which functions the line
+// profiler is instrumenting.  Interpreted versions don't have any code to replace, so they get left alone.
+void recompileFunctions(bool (*filter)(CLFunction*));
+
+// For os.fork().  Only the forking thread makes it into the child, so this waits for the compile threads to finish
+// whatever they're working on (the children then all inherit the finished code, instead of each redoing it), and
+// holds the codegen locks across the fork so that the child doesn't start with them taken.
+void beforeFork();
+// The child starts new compile threads the next time it needs them.
+void afterFork(bool in_child);
+
 }
 
 #endif
@@ -0,0 +1,173 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+#include "core/common.h"
+#include "core/options.h"
+
+#include "codegen/irgen/tiering.h"
+
+namespace pyston {
+
+static const char* effort_names[] = {"interpreted", "minimal", "moderate", "maximal"};
+
+const char* effortLevelName(EffortLevel::EffortLevel effort) {
+    assert(0 <= effort && effort <= EffortLevel::MAXIMAL);
+    return effort_names[effort];
+}
+
+bool parseEffortLevel(const std::string &s, EffortLevel::EffortLevel *rtn) {
+    for (int i = 0; i <= EffortLevel::MAXIMAL; i++) {
+        if (s == effort_names[i]) {
+            *rtn = (EffortLevel::EffortLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parseCount(const std::string &s, int *rtn) {
+    char* end;
+    long v = strtol(s.c_str(), &end, 10);
+    if (s.size() == 0 || *end != '\0' || v < 1 || v > INT_MAX)
+        return false;
+    *rtn = v;
+    return true;
+}
+
+TieringPolicy::TieringPolicy() : osr_effort(EffortLevel::MAXIMAL), max_queued_compiles(0), max_batch_size(1), batch_window_ms(5), compile_threads(1), speculation_budget(64) {
+    reopt_thresholds[EffortLevel::INTERPRETED] = 10;
+    reopt_thresholds[EffortLevel::MINIMAL] = 250;
+    reopt_thresholds[EffortLevel::MODERATE] = 10000;
+
+    osr_thresholds[EffortLevel::INTERPRETED] = 100;
+    osr_thresholds[EffortLevel::MINIMAL] = 10000;
+    osr_thresholds[EffortLevel::MODERATE] = 10000;
+}
+
+EffortLevel::EffortLevel TieringPolicy::initialEffort() {
+    if (FORCE_OPTIMIZE)
+        return EffortLevel::MAXIMAL;
+    if (ENABLE_INTERPRETER)
+        return EffortLevel::INTERPRETED;
+    return EffortLevel::MINIMAL;
+}
+
+int TieringPolicy::reoptThreshold(EffortLevel::EffortLevel effort) {
+    assert(effort < EffortLevel::MAXIMAL);
+    return reopt_thresholds[effort];
+}
+
+EffortLevel::EffortLevel TieringPolicy::reoptEffort(EffortLevel::EffortLevel effort) {
+    assert(effort < EffortLevel::MAXIMAL);
+    return (EffortLevel::EffortLevel)(effort + 1);
+}
+
+int TieringPolicy::osrThreshold(EffortLevel::EffortLevel effort) {
+    assert(effort < EffortLevel::MAXIMAL);
+    return osr_thresholds[effort];
+}
+
+EffortLevel::EffortLevel TieringPolicy::osrEffort(EffortLevel::EffortLevel effort) {
+    assert(effort < EffortLevel::MAXIMAL);
+    // Getting out of the interpreter is what matters; going further would make the
+    // osr compile expensive for what might be a short loop.
+    if (effort == EffortLevel::INTERPRETED)
+        return EffortLevel::MINIMAL;
+    if (osr_effort <= effort)
+        return (EffortLevel::EffortLevel)(effort + 1);
+    return osr_effort;
+}
+
+bool TieringPolicy::shouldStartCompile(int num_queued) {
+    return max_queued_compiles == 0 || num_queued < max_queued_compiles;
+}
+
+bool TieringPolicy::parseSettings(const std::string &s) {
+    std::istringstream ss(s);
+    std::string setting;
+    while (std::getline(ss, setting, ',')) {
+        size_t eq = setting.find('=');
+        if (eq == std::string::npos) {
+            fprintf(stderr, "Error: tiering settings look like name=value, got '%s'\n", setting.c_str());
+            return false;
+        }
+        std::string name = setting.substr(0, eq);
+        std::string value = setting.substr(eq + 1);
+
+        bool ok = false;
+        bool known = false;
+        for (int i = 0; i < EffortLevel::MAXIMAL; i++) {
+            if (name == std::string(effort_names[i]) + "_calls") {
+                known = true;
+                ok = parseCount(value, &reopt_thresholds[i]);
+            } else if (name == std::string(effort_names[i]) + "_backedges") {
+                known = true;
+                ok = parseCount(value, &osr_thresholds[i]);
+            }
+        }
+
+        if (name == "osr_effort") {
+            known = true;
+            ok = parseEffortLevel(value, &osr_effort) && osr_effort > EffortLevel::MINIMAL;
+        } else if (name == "max_queued") {
+            known = true;
+            int n;
+            ok = parseCount(value, &n);
+            if (ok)
+                max_queued_compiles = n;
+        } else if (name == "batch_size") {
+            known = true;
+            ok = parseCount(value, &max_batch_size);
+        } else if (name == "batch_window_ms") {
+            known = true;
+            ok = parseCount(value, &batch_window_ms);
+        } else if (name == "compile_threads") {
+            known = true;
+            ok = parseCount(value, &compile_threads) && compile_threads >= 1;
+        } else if (name == "speculation_budget") {
+            known = true;
+            ok = parseCount(value, &speculation_budget);
+        }
+
+        if (!known) {
+            fprintf(stderr, "Error: unknown tiering setting '%s'\n", name.c_str());
+            return false;
+        }
+        if (!ok) {
+            fprintf(stderr, "Error: bad value '%s' for tiering setting '%s'\n", value.c_str(), name.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+static TieringPolicy* policy = NULL;
+TieringPolicy* getTieringPolicy() {
+    if (!policy)
+        policy = new TieringPolicy();
+    return policy;
+}
+
+void setTieringPolicy(TieringPolicy* new_policy) {
+    assert(new_policy);
+    policy = new_policy;
+}
+
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef PYSTON_CODEGEN_IRGEN_TIERING_H
+#define PYSTON_CODEGEN_IRGEN_TIERING_H
+
+#include <string>
+
+#include "core/types.h"
+
+namespace pyston {
+
+// Decides which effort level things get compiled at, and when to move them up to the next one.
+// The thresholds get baked into the generated code, so changing them only affects functions
+// compiled afterwards.
+class TieringPolicy {
+    public:
+        // Number of calls a version at the given level takes before it gets reoptimized:
+        int reopt_thresholds[EffortLevel::MAXIMAL];
+        // Number of times a loop backedge in a version at the given level gets taken before we OSR out of it:
+        int osr_thresholds[EffortLevel::MAXIMAL];
+        // Effort level that compiled (non-interpreted) versions OSR into:
+        EffortLevel::EffortLevel osr_effort;
+        // If nonzero, don't start any new background compiles while this many are still in flight:
+        int max_queued_compiles;
+        // Background compiles for the same effort level that get queued within batch_window_ms of each other
+        // get put into one llvm module (up to max_batch_size of them), and jitted together:
+        int max_batch_size;
+        int batch_window_ms;
+        // Number of background compile threads.  With more than one, each thread optimizes in its own llvm
+        // context, so that different batches can get optimized at the same time:
+        int compile_threads;
+        // Most speculations (each of which needs a guard) that a compile of one function can make, before
+        // taking its speculations' failures into account; see TypeFeedback::speculationBudget().
+        int speculation_budget;
+
+        TieringPolicy();
+        virtual ~TieringPolicy() {}
+
+        virtual EffortLevel::EffortLevel initialEffort();
+
+        virtual int reoptThreshold(EffortLevel::EffortLevel effort);
+        virtual EffortLevel::EffortLevel reoptEffort(EffortLevel::EffortLevel effort);
+
+        virtual int osrThreshold(EffortLevel::EffortLevel effort);
+        virtual EffortLevel::EffortLevel osrEffort(EffortLevel::EffortLevel effort);
+
+        // Returns false if the reopt should get put off for now, given how many background compiles are pending:
+        virtual bool shouldStartCompile(int num_queued);
+
+        // Parses a comma-separated list of settings, such as "minimal_calls=100,osr_effort=moderate".
+        // Returns false (after printing an error) if it couldn't be parsed.
+        bool parseSettings(const std::string &s);
+};
+
+// Parses an effort level name, ex "moderate".
+bool parseEffortLevel(const std::string &s, EffortLevel::EffortLevel *rtn);
+const char* effortLevelName(EffortLevel::EffortLevel effort);
+
+TieringPolicy* getTieringPolicy();
+void setTieringPolicy(TieringPolicy* policy);
+
+}
+
+#endif
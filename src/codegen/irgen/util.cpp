@@ -14,15 +14,20 @@
 
 #include <sstream>
 #include <unordered_map>
+#include <vector>
 
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Module.h"
 #include "llvm/Support/InstIterator.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 
 #include "core/common.h"
+#include "core/options.h"
 
 #include "runtime/types.h"
 
 #include "codegen/codegen.h"
+#include "codegen/compile_cache.h"
 #include "codegen/irgen/util.h"
 
 namespace pyston {
@@ -89,13 +94,69 @@ llvm::Constant* getStringConstantPtr(const char* str) {
 // to some associated compiler-level data structure.
 // It's slightly easier to emit them as integers (there are primitive integer constants but not pointer constants),
 // but doing it this way makes it clearer what's going on.
+//
+// With the jit cache on, pointers to anything outside the executable (which is all that stays put
+// from one run of the same build to the next) go through a per-module table of external symbols
+// instead, so that compiling the same thing in a later run gives the same IR, and the cached object
+// file just needs its symbols resolved to that run's addresses.
+struct RelocationTable {
+    std::unordered_map<const void*, llvm::GlobalVariable*> by_addr;
+    std::vector<const void*> addrs;
+};
+static std::unordered_map<llvm::Module*, RelocationTable> relocation_tables;
+static RelocationTable* loading_table = NULL;
+
+extern "C" char __executable_start[], _end[];
+static bool isStableAddress(const void* addr) {
+    return addr == NULL || (addr >= __executable_start && addr < _end);
+}
+
+static llvm::Type* getRelocationType() {
+    // Unsized, so that llvm can't draw any conclusions from the object being smaller than the accesses
+    static llvm::StructType* type = llvm::StructType::create(*g.context, "reloc_target");
+    return type;
+}
+
 llvm::Constant* embedConstantPtr(const void* addr, llvm::Type* type) {
     assert(type);
+    if (compileCacheEnabled() && g.cur_module && g.cur_module != g.stdlib_module && !isStableAddress(addr)) {
+        RelocationTable &table = relocation_tables[g.cur_module];
+        llvm::GlobalVariable* &gv = table.by_addr[addr];
+        if (gv == NULL) {
+            gv = new llvm::GlobalVariable(*g.cur_module, getRelocationType(), false, llvm::GlobalValue::ExternalLinkage, NULL,
+                    "pyston_reloc_" + std::to_string(table.addrs.size()));
+            table.addrs.push_back(addr);
+        }
+        return llvm::ConstantExpr::getBitCast(gv, type);
+    }
+
     llvm::Constant *int_val = llvm::ConstantInt::get(g.i64, reinterpret_cast<uintptr_t>(addr), false);
     llvm::Constant *ptr_val = llvm::ConstantExpr::getIntToPtr(int_val, type);
     return ptr_val;
 }
 
+void startLoadingModule(llvm::Module* m) {
+    assert(loading_table == NULL);
+    auto it = relocation_tables.find(m);
+    if (it != relocation_tables.end())
+        loading_table = &it->second;
+}
+
+void finishLoadingModule(llvm::Module* m) {
+    loading_table = NULL;
+    relocation_tables.erase(m);
+}
+
+uint64_t getRelocationAddress(const std::string &name) {
+    static const std::string prefix = "pyston_reloc_";
+    if (loading_table == NULL || name.compare(0, prefix.size(), prefix) != 0)
+        return 0;
+
+    int idx = atoi(name.c_str() + prefix.size());
+    RELEASE_ASSERT(idx >= 0 && idx < loading_table->addrs.size(), "%s", name.c_str());
+    return (uint64_t)loading_table->addrs[idx];
+}
+
 llvm::Constant* getConstantInt(int n, llvm::Type* t) {
     return llvm::ConstantInt::get(t, n);
 }
@@ -138,7 +199,7 @@ class PrettifyingMaterializer : public llvm::ValueMaterializer {
 
 void dumpPrettyIR(llvm::Function *f) {
     std::unique_ptr<llvm::Module> tmp_module(llvm::CloneModule(f->getParent()));
-    //std::unique_ptr<llvm::Module> tmp_module(new llvm::Module("tmp", g.context));
+    //std::unique_ptr<llvm::Module> tmp_module(new llvm::Module("tmp", *g.context));
 
     llvm::Function *new_f = tmp_module->begin();
 
@@ -15,10 +15,12 @@
 #ifndef PYSTON_CODEGEN_IRGEN_UTIL_H
 #define PYSTON_CODEGEN_IRGEN_UTIL_H
 
+#include <stdint.h>
 #include <string>
 
 namespace llvm {
 class Constant;
+class Module;
 class Type;
 }
 
@@ -27,6 +29,11 @@ namespace pyston {
 llvm::Constant* getStringConstantPtr(const std::string &str);
 llvm::Constant* getStringConstantPtr(const char* str);
 llvm::Constant* embedConstantPtr(const void* addr, llvm::Type*);
+// The symbols that embedConstantPtr references when the jit cache is on get resolved against the table of
+// whichever module is being loaded:
+void startLoadingModule(llvm::Module* m);
+void finishLoadingModule(llvm::Module* m);
+uint64_t getRelocationAddress(const std::string &name);
 llvm::Constant* getConstantInt(int val);
 llvm::Constant* getConstantInt(int val, llvm::Type*);
 
@@ -0,0 +1,166 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+#include "core/common.h"
+#include "core/ast.h"
+#include "core/options.h"
+#include "core/stats.h"
+#include "core/types.h"
+
+#include "codegen/compile_cache.h"
+#include "codegen/compvars.h"
+#include "codegen/osrentry.h"
+#include "codegen/irgen/tiering.h"
+#include "codegen/irgen/warmup.h"
+
+#include "runtime/types.h"
+
+namespace pyston {
+
+static const char MANIFEST_HEADER[] = "pyston_warmup 1";
+// Least amount of time between the writes that happen while the program is running:
+static const int WRITE_INTERVAL_SECS = 10;
+
+// Protects everything below; versions get added from the compile threads as well as the main one.
+static std::mutex manifest_lock;
+static bool manifest_loaded = false;
+static std::unordered_map<std::string, EffortLevel::EffortLevel> manifest;
+// Whether there's anything that hasn't been written out yet:
+static bool manifest_dirty = false;
+static time_t last_write = 0;
+
+static bool manifestKey(SourceInfo *source, FunctionSignature *sig, std::string *rtn) {
+    // The module's body only runs once, so there's nothing to skip there:
+    if (source == NULL || source->ast == NULL || source->ast->type != AST_TYPE::FunctionDef)
+        return false;
+
+    std::ostringstream os;
+    os << source->parent_module->fn << '\t' << source->ast->lineno << ':' << source->ast->col_offset << '\t'
+       << source->getName() << '\t';
+    for (int i = 0; i < sig->arg_types.size(); i++) {
+        if (i > 0)
+            os << ',';
+        os << sig->arg_types[i]->debugName();
+    }
+    if (sig->is_vararg)
+        os << (sig->arg_types.size() ? ",*" : "*");
+    *rtn = os.str();
+    return true;
+}
+
+static void loadManifest() {
+    if (manifest_loaded)
+        return;
+    manifest_loaded = true;
+
+    std::ifstream f(WARMUP_MANIFEST);
+    if (!f)
+        return; // this is the first run
+
+    std::string line;
+    if (!std::getline(f, line) || line != MANIFEST_HEADER) {
+        if (VERBOSITY() >= 1)
+            fprintf(stderr, "Ignoring %s, since it isn't a warmup manifest (or is from a different version)\n", WARMUP_MANIFEST);
+        return;
+    }
+
+    while (std::getline(f, line)) {
+        size_t tab = line.find('\t');
+        EffortLevel::EffortLevel effort;
+        if (tab == std::string::npos || !parseEffortLevel(line.substr(0, tab), &effort))
+            continue;
+
+        EffortLevel::EffortLevel &e = manifest[line.substr(tab + 1)];
+        e = std::max(e, effort);
+    }
+
+    static StatCounter num_loaded("warmup_manifest_entries_loaded");
+    num_loaded.log(manifest.size());
+}
+
+static void writeManifestLocked() {
+    std::ostringstream os;
+    os << MANIFEST_HEADER << '\n';
+    for (const auto &p : manifest)
+        os << effortLevelName(p.second) << '\t' << p.first << '\n';
+
+    if (!writeFileAtomically(WARMUP_MANIFEST, os.str()) && VERBOSITY() >= 1)
+        fprintf(stderr, "Couldn't write the warmup manifest to %s\n", WARMUP_MANIFEST);
+    manifest_dirty = false;
+    last_write = time(NULL);
+}
+
+void noteCompiledVersion(CompiledFunction *cf) {
+    if (!WARMUP_MANIFEST)
+        return;
+    if (cf->effort <= getTieringPolicy()->initialEffort())
+        return;
+
+    CompiledFunction *version = cf;
+    if (cf->entry_descriptor)
+        version = cf->entry_descriptor->cf;
+
+    std::string key;
+    if (!manifestKey(cf->clfunc->source, version->sig, &key))
+        return;
+
+    std::lock_guard<std::mutex> _lock(manifest_lock);
+    loadManifest();
+
+    EffortLevel::EffortLevel &e = manifest[key];
+    if (cf->effort <= e)
+        return;
+    e = cf->effort;
+    manifest_dirty = true;
+
+    if (time(NULL) - last_write >= WRITE_INTERVAL_SECS)
+        writeManifestLocked();
+}
+
+EffortLevel::EffortLevel warmupEffort(SourceInfo *source, FunctionSignature *sig) {
+    if (!WARMUP_MANIFEST)
+        return EffortLevel::INTERPRETED;
+
+    std::string key;
+    if (!manifestKey(source, sig, &key))
+        return EffortLevel::INTERPRETED;
+
+    std::lock_guard<std::mutex> _lock(manifest_lock);
+    loadManifest();
+
+    auto it = manifest.find(key);
+    if (it == manifest.end())
+        return EffortLevel::INTERPRETED;
+    return it->second;
+}
+
+void writeWarmupManifest() {
+    if (!WARMUP_MANIFEST)
+        return;
+
+    std::lock_guard<std::mutex> _lock(manifest_lock);
+    if (manifest_dirty)
+        writeManifestLocked();
+}
+
+}
@@ -0,0 +1,48 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CODEGEN_IRGEN_WARMUP_H
+#define PYSTON_CODEGEN_IRGEN_WARMUP_H
+
+#include "core/types.h"
+
+namespace pyston {
+
+// The warmup manifest (WARMUP_MANIFEST, set with -W) remembers which versions of which functions made it past
+// the initial effort level, so that a restarted process can compile them at that level the first time they get
+// called, instead of going up through the tiers again.  With BACKGROUND_COMPILE on, the compile happens on the
+// background threads while a MINIMAL version runs (see resolveCLFunc).
+//
+// Functions are identified by their file, position and name, and versions by their argument types, so an entry
+// can go stale if the source changes; that only costs an unneeded compile.  OSR compiles count towards the
+// version they exited from.  The manifest gets rewritten at exit, and at most every few seconds as new versions
+// get hot (to cover processes that never exit normally, ex forked workers).  The entries from the previous
+// manifest are kept, so it only ever adds up the levels that got reached.
+//
+// The file is text:
+//   pyston_warmup 1
+//   <effort>\t<file>\t<line>:<col>\t<function name>\t<comma-separated arg types>
+
+// Should be called for every version that gets added to a function.
+void noteCompiledVersion(CompiledFunction *cf);
+
+// The effort level that this version got to in an earlier run, or INTERPRETED if it's not in the manifest.
+EffortLevel::EffortLevel warmupEffort(SourceInfo *source, FunctionSignature *sig);
+
+// Does nothing if WARMUP_MANIFEST isn't set, or nothing's changed since the last write.
+void writeWarmupManifest();
+
+}
+
+#endif
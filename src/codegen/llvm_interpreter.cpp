@@ -13,8 +13,10 @@
 // limitations under the License.
 
 #include <sstream>
+#include <vector>
 #include <unordered_map>
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DataLayout.h"
 
@@ -40,9 +42,49 @@ union Val {
     Val(int64_t n) : n(n) {}
     Val(double d) : d(d) {}
     Val(Box* o) : o(o) {}
+    Val() : n(0) {}
 };
 
-typedef std::unordered_map<llvm::Value*, Val> SymMap;
+// Every argument and instruction in the function gets its own slot in a flat frame.
+// Instructions are numbered in order within their block, so the interpreter only has to look
+// up the start of each block and can then just count along for the values it sets.
+struct FrameLayout {
+    llvm::DenseMap<llvm::Value*, int> slots;
+    llvm::DenseMap<llvm::BasicBlock*, int> block_starts;
+    int nslots;
+};
+
+static const FrameLayout* getFrameLayout(llvm::Function *f) {
+    static std::unordered_map<llvm::Function*, FrameLayout*> layouts;
+
+    FrameLayout* &layout = layouts[f];
+    if (layout == NULL) {
+        layout = new FrameLayout();
+        int n = 0;
+        for (llvm::Function::arg_iterator AI = f->arg_begin(), end = f->arg_end(); AI != end; AI++) {
+            layout->slots[&(*AI)] = n++;
+        }
+        for (llvm::Function::iterator BB = f->begin(), end = f->end(); BB != end; ++BB) {
+            layout->block_starts[&(*BB)] = n;
+            for (llvm::BasicBlock::iterator it = BB->begin(), end2 = BB->end(); it != end2; ++it) {
+                layout->slots[&(*it)] = n++;
+            }
+        }
+        layout->nslots = n;
+    }
+    return layout;
+}
+
+struct Frame {
+    const FrameLayout* layout;
+    Val* vals;
+};
+
+static inline Val& frameSlot(const Frame &frame, llvm::Value* v) {
+    auto it = frame.layout->slots.find(v);
+    assert(it != frame.layout->slots.end());
+    return frame.vals[it->second];
+}
 
 int width(llvm::Type *t, const llvm::DataLayout &dl) {
     return dl.getTypeSizeInBits(t) / 8;
@@ -62,7 +104,7 @@ int width(llvm::Value *v, const llvm::DataLayout &dl) {
 //#define VERBOSITY(x) 2
 #define TIME_INTERPRETS
 
-Val fetch(llvm::Value* v, const llvm::DataLayout &dl, const SymMap &symbols) {
+Val fetch(llvm::Value* v, const llvm::DataLayout &dl, const Frame &frame) {
     assert(v);
 
     int opcode = v->getValueID();
@@ -73,14 +115,12 @@ Val fetch(llvm::Value* v, const llvm::DataLayout &dl, const SymMap &symbols) {
     //Stats::log(statid);
 
     if (opcode >= llvm::Value::InstructionVal) {
-        assert(symbols.count(v));
-        return symbols.find(v)->second;
+        return frameSlot(frame, v);
     }
 
     switch(opcode) {
         case llvm::Value::ArgumentVal: {
-            assert(symbols.count(v));
-            return symbols.find(v)->second;
+            return frameSlot(frame, v);
         }
         case llvm::Value::ConstantIntVal: {
             if (v->getType() == g.i1)
@@ -98,10 +138,10 @@ Val fetch(llvm::Value* v, const llvm::DataLayout &dl, const SymMap &symbols) {
             if (ce->isCast()) {
                 assert(width(ce->getOperand(0), dl) == 8 && width(ce, dl) == 8);
 
-                Val o = fetch(ce->getOperand(0), dl, symbols);
+                Val o = fetch(ce->getOperand(0), dl, frame);
                 return o;
             } else if (ce->getOpcode() == llvm::Instruction::GetElementPtr) {
-                int64_t base = (int64_t)fetch(ce->getOperand(0), dl, symbols).o;
+                int64_t base = (int64_t)fetch(ce->getOperand(0), dl, frame).o;
                 llvm::Type *t = ce->getOperand(0)->getType();
 
                 llvm::User::value_op_iterator begin = ce->value_op_begin();
@@ -179,22 +219,18 @@ Val fetch(llvm::Value* v, const llvm::DataLayout &dl, const SymMap &symbols) {
     }
 }
 
-static void set(SymMap &symbols, const llvm::BasicBlock::iterator &it, Val v) {
+static void set(const Frame &frame, int slot, const llvm::BasicBlock::iterator &it, Val v) {
     if (VERBOSITY() >= 2) {
         printf("Setting to %lx / %f: ", v.n, v.d);
         fflush(stdout);
         it->dump();
     }
 
-    SymMap::iterator f = symbols.find(it);
-    if (f != symbols.end())
-        f->second = v;
-    else
-        symbols.insert(std::make_pair(static_cast<llvm::Value*>(&(*it)), v));
-//#define SET(v) symbols.insert(std::make_pair(static_cast<llvm::Value*>(&(*it)), Val(v)))
+    assert(frame.layout->slots.lookup(it) == slot);
+    frame.vals[slot] = v;
 }
 
-static std::unordered_map<void*, const SymMap*> interpreter_roots;
+static std::unordered_map<void*, const Frame*> interpreter_roots;
 void gatherInterpreterRootsForFrame(GCVisitor *visitor, void* frame_ptr) {
     auto it = interpreter_roots.find(frame_ptr);
     if (it == interpreter_roots.end()) {
@@ -207,10 +243,17 @@ void gatherInterpreterRootsForFrame(GCVisitor *visitor, void* frame_ptr) {
     }
 
     //printf("Gathering roots for frame %p\n", frame_ptr);
-    const SymMap* symbols = it->second;
+    const Frame* frame = it->second;
+
+    for (int i = 0; i < frame->layout->nslots; i++) {
+        visitor->visitPotential(frame->vals[i].o);
+    }
+}
 
-    for (auto it2 : *symbols) {
-        visitor->visitPotential(it2.second.o);
+void gatherInterpreterRootsInRange(GCVisitor *visitor, void* start, void* end) {
+    for (auto p : interpreter_roots) {
+        if (p.first >= start && p.first < end)
+            gatherInterpreterRootsForFrame(visitor, p.first);
     }
 }
 
@@ -243,22 +286,24 @@ Box* interpretFunction(llvm::Function *f, int nargs, Box* arg1, Box* arg2, Box*
     //f->dump();
     //assert(nargs == f->getArgumentList().size());
 
-    SymMap symbols;
+    const FrameLayout* layout = getFrameLayout(f);
+    std::vector<Val> vals(layout->nslots);
+    Frame frame = { layout, &vals[0] };
 
     void* frame_ptr = __builtin_frame_address(0);
-    interpreter_roots[frame_ptr] = &symbols;
+    interpreter_roots[frame_ptr] = &frame;
     UnregisterHelper helper(frame_ptr);
 
     int i = 0;
     for (llvm::Function::arg_iterator AI = f->arg_begin(), end = f->arg_end(); AI != end; AI++, i++) {
-        if (i == 0) symbols.insert(std::make_pair(static_cast<llvm::Value*>(&(*AI)), Val(arg1)));
-        else if (i == 1) symbols.insert(std::make_pair(static_cast<llvm::Value*>(&(*AI)), Val(arg2)));
-        else if (i == 2) symbols.insert(std::make_pair(static_cast<llvm::Value*>(&(*AI)), Val(arg3)));
+        if (i == 0) frame.vals[i] = Val(arg1);
+        else if (i == 1) frame.vals[i] = Val(arg2);
+        else if (i == 2) frame.vals[i] = Val(arg3);
         else {
             assert(i == 3);
             assert(f->getArgumentList().size() == 4);
             assert(f->getArgumentList().back().getType() == g.llvm_value_type_ptr->getPointerTo());
-            symbols.insert(std::make_pair(static_cast<llvm::Value*>(&(*AI)), Val((int64_t)args)));
+            frame.vals[i] = Val((int64_t)args);
             //printf("loading %%4 with %p\n", (void*)args);
             break;
         }
@@ -269,7 +314,8 @@ Box* interpretFunction(llvm::Function *f, int nargs, Box* arg1, Box* arg2, Box*
 
 
     while (true) {
-        for (llvm::BasicBlock::iterator it = curblock->begin(), end = curblock->end(); it != end; ++it) {
+        int slot = layout->block_starts.lookup(curblock);
+        for (llvm::BasicBlock::iterator it = curblock->begin(), end = curblock->end(); it != end; ++it, ++slot) {
             if (VERBOSITY("interpreter") >= 2) {
                 printf("executing in %s: ", f->getName().data());
                 fflush(stdout);
@@ -277,10 +323,10 @@ Box* interpretFunction(llvm::Function *f, int nargs, Box* arg1, Box* arg2, Box*
                 //f->dump();
             }
 
-#define SET(v) set(symbols, it, (v))
+#define SET(v) set(frame, slot, it, (v))
             if (llvm::LoadInst *li = llvm::dyn_cast<llvm::LoadInst>(it)) {
                 llvm::Value *ptr = li->getOperand(0);
-                Val v = fetch(ptr, dl, symbols);
+                Val v = fetch(ptr, dl, frame);
                 //printf("loading from %p\n", v.o);
 
                 if (width(li, dl) == 1) {
@@ -298,8 +344,8 @@ Box* interpretFunction(llvm::Function *f, int nargs, Box* arg1, Box* arg2, Box*
             } else if (llvm::StoreInst *si = llvm::dyn_cast<llvm::StoreInst>(it)) {
                 llvm::Value *val = si->getOperand(0);
                 llvm::Value *ptr = si->getOperand(1);
-                Val v = fetch(val, dl, symbols);
-                Val p = fetch(ptr, dl, symbols);
+                Val v = fetch(val, dl, frame);
+                Val p = fetch(ptr, dl, frame);
 
                 //printf("storing %lx at %lx\n", v.n, p.n);
 
@@ -316,8 +362,8 @@ Box* interpretFunction(llvm::Function *f, int nargs, Box* arg1, Box* arg2, Box*
             } else if (llvm::CmpInst *ci = llvm::dyn_cast<llvm::CmpInst>(it)) {
                 assert(ci->getType() == g.i1);
 
-                Val a0 = fetch(ci->getOperand(0), dl, symbols);
-                Val a1 = fetch(ci->getOperand(1), dl, symbols);
+                Val a0 = fetch(ci->getOperand(0), dl, frame);
+                Val a1 = fetch(ci->getOperand(1), dl, frame);
                 llvm::CmpInst::Predicate pred = ci->getPredicate();
                 switch (pred) {
                     case llvm::CmpInst::ICMP_EQ:
@@ -366,8 +412,8 @@ Box* interpretFunction(llvm::Function *f, int nargs, Box* arg1, Box* arg2, Box*
                     //assert(bo->getOperand(0)->getType() == g.i64);
                     //assert(bo->getOperand(1)->getType() == g.i64);
 
-                    Val a0 = fetch(bo->getOperand(0), dl, symbols);
-                    Val a1 = fetch(bo->getOperand(1), dl, symbols);
+                    Val a0 = fetch(bo->getOperand(0), dl, frame);
+                    Val a1 = fetch(bo->getOperand(1), dl, frame);
                     llvm::Instruction::BinaryOps opcode = bo->getOpcode();
                     switch (opcode) {
                         case llvm::Instruction::Add:
@@ -403,8 +449,8 @@ Box* interpretFunction(llvm::Function *f, int nargs, Box* arg1, Box* arg2, Box*
                     //assert(bo->getOperand(0)->getType() == g.i64);
                     //assert(bo->getOperand(1)->getType() == g.i64);
 
-                    double lhs = fetch(bo->getOperand(0), dl, symbols).d;
-                    double rhs = fetch(bo->getOperand(1), dl, symbols).d;
+                    double lhs = fetch(bo->getOperand(0), dl, frame).d;
+                    double rhs = fetch(bo->getOperand(1), dl, frame).d;
                     llvm::Instruction::BinaryOps opcode = bo->getOpcode();
                     switch (opcode) {
                         case llvm::Instruction::FAdd:
@@ -426,7 +472,7 @@ Box* interpretFunction(llvm::Function *f, int nargs, Box* arg1, Box* arg2, Box*
                     RELEASE_ASSERT(0, "");
                 }
             } else if (llvm::GetElementPtrInst *gep = llvm::dyn_cast<llvm::GetElementPtrInst>(it)) {
-                int64_t base = fetch(gep->getPointerOperand(), dl, symbols).n;
+                int64_t base = fetch(gep->getPointerOperand(), dl, frame).n;
 
                 llvm::User::value_op_iterator begin = gep->value_op_begin();
                 ++begin;
@@ -438,7 +484,7 @@ Box* interpretFunction(llvm::Function *f, int nargs, Box* arg1, Box* arg2, Box*
                 SET(base + offset);
                 continue;
             } else if (llvm::AllocaInst *al = llvm::dyn_cast<llvm::AllocaInst>(it)) {
-                int size = fetch(al->getArraySize(), dl, symbols).n * width(al->getAllocatedType(), dl);
+                int size = fetch(al->getArraySize(), dl, frame).n * width(al->getAllocatedType(), dl);
                 void* ptr = alloca(size);
                 //void* ptr = malloc(size);
                 //printf("alloca()'d at %p\n", ptr);
@@ -446,25 +492,25 @@ Box* interpretFunction(llvm::Function *f, int nargs, Box* arg1, Box* arg2, Box*
                 continue;
             } else if (llvm::SIToFPInst *si = llvm::dyn_cast<llvm::SIToFPInst>(it)) {
                 assert(width(si->getOperand(0), dl) == 8);
-                SET((double)fetch(si->getOperand(0), dl, symbols).n);
+                SET((double)fetch(si->getOperand(0), dl, frame).n);
                 continue;
             } else if (llvm::BitCastInst *bc = llvm::dyn_cast<llvm::BitCastInst>(it)) {
                 assert(width(bc->getOperand(0), dl) == 8);
-                SET(fetch(bc->getOperand(0), dl, symbols));
+                SET(fetch(bc->getOperand(0), dl, frame));
                 continue;
             } else if (llvm::IntToPtrInst *bc = llvm::dyn_cast<llvm::IntToPtrInst>(it)) {
                 assert(width(bc->getOperand(0), dl) == 8);
-                SET(fetch(bc->getOperand(0), dl, symbols));
+                SET(fetch(bc->getOperand(0), dl, frame));
                 continue;
             } else if (llvm::CallInst *ci = llvm::dyn_cast<llvm::CallInst>(it)) {
                 void* f;
                 int arg_start;
                 if (ci->getCalledFunction() && (ci->getCalledFunction()->getName() == "llvm.experimental.patchpoint.void" || ci->getCalledFunction()->getName() == "llvm.experimental.patchpoint.i64")) {
                     //ci->dump();
-                    f = (void*)fetch(ci->getArgOperand(2), dl, symbols).n;
+                    f = (void*)fetch(ci->getArgOperand(2), dl, frame).n;
                     arg_start = 4;
                 } else {
-                    f = (void*)fetch(ci->getCalledValue(), dl, symbols).n;
+                    f = (void*)fetch(ci->getCalledValue(), dl, frame).n;
                     arg_start = 0;
                 }
 
@@ -474,7 +520,7 @@ Box* interpretFunction(llvm::Function *f, int nargs, Box* arg1, Box* arg2, Box*
                 int nargs = ci->getNumArgOperands();
                 for (int i = arg_start; i < nargs; i++) {
                     //ci->getArgOperand(i)->dump();
-                    args.push_back(fetch(ci->getArgOperand(i), dl, symbols));
+                    args.push_back(fetch(ci->getArgOperand(i), dl, frame));
                 }
 
                 int npassed_args = nargs - arg_start;
@@ -573,9 +619,9 @@ Box* interpretFunction(llvm::Function *f, int nargs, Box* arg1, Box* arg2, Box*
 #endif
                 continue;
             } else if (llvm::SelectInst *si = llvm::dyn_cast<llvm::SelectInst>(it)) {
-                Val test = fetch(si->getCondition(), dl, symbols);
-                Val vt = fetch(si->getTrueValue(), dl, symbols);
-                Val vf = fetch(si->getFalseValue(), dl, symbols);
+                Val test = fetch(si->getCondition(), dl, frame);
+                Val vt = fetch(si->getTrueValue(), dl, frame);
+                Val vf = fetch(si->getFalseValue(), dl, frame);
                 if (test.b)
                     SET(vt);
                 else
@@ -583,12 +629,12 @@ Box* interpretFunction(llvm::Function *f, int nargs, Box* arg1, Box* arg2, Box*
                 continue;
             } else if (llvm::PHINode *phi = llvm::dyn_cast<llvm::PHINode>(it)) {
                 assert(prevblock);
-                SET(fetch(phi->getIncomingValueForBlock(prevblock), dl, symbols));
+                SET(fetch(phi->getIncomingValueForBlock(prevblock), dl, frame));
                 continue;
             } else if (llvm::BranchInst *br = llvm::dyn_cast<llvm::BranchInst>(it)) {
                 prevblock = curblock;
                 if (br->isConditional()) {
-                    Val t = fetch(br->getCondition(), dl, symbols);
+                    Val t = fetch(br->getCondition(), dl, frame);
                     if (t.b) {
                         curblock = br->getSuccessor(0);
                     } else {
@@ -612,7 +658,7 @@ Box* interpretFunction(llvm::Function *f, int nargs, Box* arg1, Box* arg2, Box*
 
                 if (!r)
                     return NULL;
-                Val t = fetch(r, dl, symbols);
+                Val t = fetch(r, dl, frame);
                 return t.o;
             }
 
@@ -25,6 +25,8 @@ class Box;
 class GCVisitor;
 
 void gatherInterpreterRootsForFrame(GCVisitor *visitor, void* frame_ptr);
+// For the stacks of the other threads, which don't get unwound: every interpreter frame in [start, end).
+void gatherInterpreterRootsInRange(GCVisitor *visitor, void* start, void* end);
 Box* interpretFunction(llvm::Function *f, int nargs, Box* arg1, Box* arg2, Box* arg3, Box* *args);
 
 }
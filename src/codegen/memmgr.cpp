@@ -13,17 +13,24 @@
 // limitations under the License.
 
 
+#include <algorithm>
+#include <vector>
+
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
 #include "llvm/ExecutionEngine/RuntimeDyld.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/Memory.h"
+#include "llvm/Support/Process.h"
 
 #include "core/common.h"
+#include "core/options.h"
+#include "core/stats.h"
 
 #include "core/util.h"
 
 #include "codegen/memmgr.h"
+#include "codegen/irgen/util.h"
 
 // This code was copy-pasted from SectionMemoryManager.cpp;
 // TODO eventually I should remove this using directive
@@ -32,9 +39,13 @@ using namespace llvm;
 
 namespace pyston {
 
+// Sections get carved out of big slabs instead of getting their own mappings, so that lots of small
+// functions can share pages.  The code slabs start out rwx (we patch the code later anyway), so they
+// never need their permissions changed; the read-only data gets protected a page at a time, once
+// nothing more is going to get allocated into that page.
 class PystonMemoryManager : public RTDyldMemoryManager {
     public:
-        PystonMemoryManager() { }
+        PystonMemoryManager() : total_code_bytes(0), obsolete_code_bytes(0) { }
         virtual ~PystonMemoryManager();
 
         virtual uint8_t *allocateCodeSection(uintptr_t Size, unsigned Alignment,
@@ -50,26 +61,60 @@ class PystonMemoryManager : public RTDyldMemoryManager {
 
         virtual void invalidateInstructionCache();
 
+        void noteObsolete(void* code_addr);
+        uint8_t* allocateColdCode(uintptr_t Size);
+        uint8_t* allocateStubCode(uintptr_t Size);
+
     private:
-        struct MemoryGroup {
-            SmallVector<sys::MemoryBlock, 16> AllocatedMem;
-            SmallVector<sys::MemoryBlock, 16> FreeMem;
-            sys::MemoryBlock Near;
+        static const uintptr_t CODE_SLAB_SIZE = 1 << 20;
+        static const uintptr_t DATA_SLAB_SIZE = 256 << 10;
+
+        struct Slab {
+            sys::MemoryBlock mem;
+            uint8_t *cur;
+            // Everything before this has had its final permissions applied:
+            uint8_t *finalized_end;
+
+            Slab(sys::MemoryBlock mem) : mem(mem), cur((uint8_t*)mem.base()), finalized_end((uint8_t*)mem.base()) {}
+            uint8_t* end() { return (uint8_t*)mem.base() + mem.size(); }
         };
 
-        uint8_t *allocateSection(MemoryGroup &MemGroup, uintptr_t Size,
-                unsigned Alignment);
+        struct SlabGroup {
+            std::vector<Slab> slabs;
+            unsigned Permissions;
+            uintptr_t SlabSize;
+
+            SlabGroup(unsigned Permissions, uintptr_t SlabSize) : Permissions(Permissions), SlabSize(SlabSize) {}
+        };
 
-        error_code applyMemoryGroupPermissions(MemoryGroup &MemGroup,
-                unsigned Permissions);
+        // The code sections from each finalized module, so that we can tell how much of it is dead:
+        struct CodeRange {
+            uintptr_t start, end;
+            bool obsolete;
+        };
+
+        uint8_t *allocateSection(SlabGroup &Group, uintptr_t Size,
+                unsigned Alignment);
 
         virtual uint64_t getSymbolAddress(const std::string &Name);
 
-        MemoryGroup CodeMem;
-        MemoryGroup RWDataMem;
-        MemoryGroup RODataMem;
+        // All the slabs get allocated near each other, since the code refers to the data with 32-bit offsets.
+        sys::MemoryBlock Near;
+
+        SlabGroup CodeMem = SlabGroup(sys::Memory::MF_READ | sys::Memory::MF_WRITE | sys::Memory::MF_EXEC, CODE_SLAB_SIZE);
+        // Kept apart from CodeMem so that the hot code stays packed together:
+        SlabGroup ColdCodeMem = SlabGroup(sys::Memory::MF_READ | sys::Memory::MF_WRITE | sys::Memory::MF_EXEC, CODE_SLAB_SIZE);
+        // The IC stubs, which get small enough slabs to not spread out too much:
+        SlabGroup StubCodeMem = SlabGroup(sys::Memory::MF_READ | sys::Memory::MF_WRITE | sys::Memory::MF_EXEC, DATA_SLAB_SIZE);
+        SlabGroup RWDataMem = SlabGroup(sys::Memory::MF_READ | sys::Memory::MF_WRITE, DATA_SLAB_SIZE);
+        SlabGroup RODataMem = SlabGroup(sys::Memory::MF_READ | sys::Memory::MF_WRITE, DATA_SLAB_SIZE);
+
+        std::vector<CodeRange> pending_code, code_ranges;
+        uintptr_t total_code_bytes, obsolete_code_bytes;
 };
 
+static PystonMemoryManager* memory_manager = NULL;
+
 uint8_t *PystonMemoryManager::allocateDataSection(uintptr_t Size,
         unsigned Alignment,
         unsigned SectionID,
@@ -87,10 +132,31 @@ uint8_t *PystonMemoryManager::allocateCodeSection(uintptr_t Size,
         unsigned SectionID,
         StringRef SectionName) {
     //printf("allocating code section: %ld %d %d %s\n", Size, Alignment, SectionID, SectionName.data());
-    return allocateSection(CodeMem, Size, Alignment);
+    uint8_t* rtn = allocateSection(CodeMem, Size, Alignment);
+    if (rtn)
+        pending_code.push_back(CodeRange{(uintptr_t)rtn, (uintptr_t)rtn + Size, false});
+    return rtn;
+}
+
+uint8_t* PystonMemoryManager::allocateColdCode(uintptr_t Size) {
+    uint8_t* rtn = allocateSection(ColdCodeMem, Size, 16);
+    RELEASE_ASSERT(rtn, "couldn't allocate %ld bytes of cold code", (long)Size);
+
+    static StatCounter sc_cold_bytes("jit_cold_code_bytes");
+    sc_cold_bytes.log(Size);
+    return rtn;
 }
 
-uint8_t *PystonMemoryManager::allocateSection(MemoryGroup &MemGroup,
+uint8_t* PystonMemoryManager::allocateStubCode(uintptr_t Size) {
+    uint8_t* rtn = allocateSection(StubCodeMem, Size, 16);
+    RELEASE_ASSERT(rtn, "couldn't allocate %ld bytes of stub code", (long)Size);
+
+    static StatCounter sc_stub_bytes("jit_stub_code_bytes");
+    sc_stub_bytes.log(Size);
+    return rtn;
+}
+
+uint8_t *PystonMemoryManager::allocateSection(SlabGroup &Group,
         uintptr_t Size,
         unsigned Alignment) {
     if (!Alignment)
@@ -98,129 +164,111 @@ uint8_t *PystonMemoryManager::allocateSection(MemoryGroup &MemGroup,
 
     assert(!(Alignment & (Alignment - 1)) && "Alignment must be a power of two.");
 
-    uintptr_t RequiredSize = Alignment * ((Size + Alignment - 1)/Alignment + 1);
-    uintptr_t Addr = 0;
-
-    // Look in the list of free memory regions and use a block there if one
-    // is available.
-    for (int i = 0, e = MemGroup.FreeMem.size(); i != e; ++i) {
-        sys::MemoryBlock &MB = MemGroup.FreeMem[i];
-        if (MB.size() >= RequiredSize) {
-            Addr = (uintptr_t)MB.base();
-            uintptr_t EndOfBlock = Addr + MB.size();
-            // Align the address.
-            Addr = (Addr + Alignment - 1) & ~(uintptr_t)(Alignment - 1);
-            // Store cutted free memory block.
-            MemGroup.FreeMem[i] = sys::MemoryBlock((void*)(Addr + Size),
-                    EndOfBlock - Addr - Size);
+    // Only the newest slab gets allocated out of; the older ones are full enough not to bother with.
+    if (Group.slabs.size()) {
+        Slab &slab = Group.slabs.back();
+        uintptr_t Addr = ((uintptr_t)slab.cur + Alignment - 1) & ~(uintptr_t)(Alignment - 1);
+        if (Addr + Size <= (uintptr_t)slab.end()) {
+            slab.cur = (uint8_t*)(Addr + Size);
             return (uint8_t*)Addr;
         }
     }
 
-    // No pre-allocated free block was large enough. Allocate a new memory region.
-    // Note that all sections get allocated as read-write.  The permissions will
-    // be updated later based on memory group.
-    //
-    // FIXME: It would be useful to define a default allocation size (or add
-    // it as a constructor parameter) to minimize the number of allocations.
-    //
-    // FIXME: Initialize the Near member for each memory group to avoid
-    // interleaving.
+    uintptr_t RequiredSize = std::max(Group.SlabSize, Alignment * ((Size + Alignment - 1)/Alignment + 1));
+
     error_code ec;
     sys::MemoryBlock MB = sys::Memory::allocateMappedMemory(RequiredSize,
-            &MemGroup.Near,
-            sys::Memory::MF_READ |
-            sys::Memory::MF_WRITE,
+            &Near,
+            Group.Permissions,
             ec);
     if (ec) {
         // FIXME: Add error propogation to the interface.
         return NULL;
     }
-
-    // Save this address as the basis for our next request
-    MemGroup.Near = MB;
-
-    MemGroup.AllocatedMem.push_back(MB);
-    Addr = (uintptr_t)MB.base();
-    uintptr_t EndOfBlock = Addr + MB.size();
-
-    // Align the address.
-    Addr = (Addr + Alignment - 1) & ~(uintptr_t)(Alignment - 1);
-
-    // The allocateMappedMemory may allocate much more memory than we need. In
-    // this case, we store the unused memory as a free memory block.
-    unsigned FreeSize = EndOfBlock-Addr-Size;
-    if (FreeSize > 16)
-        MemGroup.FreeMem.push_back(sys::MemoryBlock((void*)(Addr + Size), FreeSize));
-
-    // Return aligned address
+    Near = MB;
+
+    static StatCounter sc_slabs("jit_memory_slabs");
+    sc_slabs.log();
+
+    // Something too big for a normal slab gets one to itself, and the current slab keeps getting used:
+    bool oversized = RequiredSize > Group.SlabSize && Group.slabs.size();
+    std::vector<Slab>::iterator it = Group.slabs.insert(oversized ? Group.slabs.end() - 1 : Group.slabs.end(), Slab(MB));
+    Slab &slab = *it;
+    uintptr_t Addr = ((uintptr_t)slab.cur + Alignment - 1) & ~(uintptr_t)(Alignment - 1);
+    assert(Addr + Size <= (uintptr_t)slab.end());
+    slab.cur = (uint8_t*)(Addr + Size);
     return (uint8_t*)Addr;
 }
 
 bool PystonMemoryManager::finalizeMemory(std::string *ErrMsg)
 {
-    // FIXME: Should in-progress permissions be reverted if an error occurs?
-    error_code ec;
-
-    // Don't allow free memory blocks to be used after setting protection flags.
-    CodeMem.FreeMem.clear();
-
-    // Make code memory executable.
-    // pyston: also make it writeable so we can patch it later
-    ec = applyMemoryGroupPermissions(CodeMem,
-            sys::Memory::MF_READ | sys::Memory::MF_EXEC | sys::Memory::MF_WRITE);
-    if (ec) {
-        if (ErrMsg) {
-            *ErrMsg = ec.message();
-        }
-        return true;
-    }
-
-    // Don't allow free memory blocks to be used after setting protection flags.
-    RODataMem.FreeMem.clear();
-
-    // Make read-only data memory read-only.
-    ec = applyMemoryGroupPermissions(RODataMem,
-            sys::Memory::MF_READ | sys::Memory::MF_EXEC);
-    if (ec) {
-        if (ErrMsg) {
-            *ErrMsg = ec.message();
+    // The code is already rwx, and the rw data is already rw.
+    //
+    // The read-only data gets protected in one go per slab, up to the last page that later
+    // allocations can't land in; the rest of it gets done once the slab fills up past it.
+    for (Slab &slab : RODataMem.slabs) {
+        uintptr_t page_size = sys::Process::getPageSize();
+        uint8_t* protect_end = &slab == &RODataMem.slabs.back()
+            ? (uint8_t*)((uintptr_t)slab.cur & ~(page_size - 1))
+            : slab.end();
+        if (protect_end <= slab.finalized_end)
+            continue;
+
+        sys::MemoryBlock block(slab.finalized_end, protect_end - slab.finalized_end);
+        error_code ec = sys::Memory::protectMappedMemory(block, sys::Memory::MF_READ | sys::Memory::MF_EXEC);
+        if (ec) {
+            if (ErrMsg) {
+                *ErrMsg = ec.message();
+            }
+            return true;
         }
-        return true;
+        slab.finalized_end = protect_end;
     }
 
-    // Read-write data memory already has the correct permissions
-
     // Some platforms with separate data cache and instruction cache require
     // explicit cache flush, otherwise JIT code manipulations (like resolved
     // relocations) will get to the data cache but not to the instruction cache.
     invalidateInstructionCache();
 
+    static StatCounter sc_code_bytes("jit_code_bytes");
+    for (const CodeRange &r : pending_code) {
+        sc_code_bytes.log(r.end - r.start);
+        total_code_bytes += r.end - r.start;
+        code_ranges.push_back(r);
+    }
+    pending_code.clear();
+
     return false;
 }
 
-error_code PystonMemoryManager::applyMemoryGroupPermissions(MemoryGroup &MemGroup,
-        unsigned Permissions) {
+void PystonMemoryManager::invalidateInstructionCache() {
+    for (const CodeRange &r : pending_code)
+        sys::Memory::InvalidateInstructionCache((void*)r.start, r.end - r.start);
+}
 
-    for (int i = 0, e = MemGroup.AllocatedMem.size(); i != e; ++i) {
-        error_code ec;
-        ec = sys::Memory::protectMappedMemory(MemGroup.AllocatedMem[i],
-                Permissions);
-        if (ec) {
-            return ec;
+// Just the bookkeeping for now: a replaced version can still be running, and other code can have
+// its address baked in, so the memory doesn't get handed back out.
+void PystonMemoryManager::noteObsolete(void* code_addr) {
+    for (CodeRange &r : code_ranges) {
+        if (r.start <= (uintptr_t)code_addr && (uintptr_t)code_addr < r.end) {
+            if (r.obsolete)
+                return;
+            r.obsolete = true;
+            obsolete_code_bytes += r.end - r.start;
+
+            static StatCounter sc_obsolete("jit_obsolete_code_bytes");
+            sc_obsolete.log(r.end - r.start);
+            if (VERBOSITY("irgen") >= 1)
+                printf("%ld of %ld bytes of jitted code are obsolete\n", (long)obsolete_code_bytes, (long)total_code_bytes);
+            return;
         }
     }
-
-    return error_code::success();
-}
-
-void PystonMemoryManager::invalidateInstructionCache() {
-    for (int i = 0, e = CodeMem.AllocatedMem.size(); i != e; ++i)
-        sys::Memory::InvalidateInstructionCache(CodeMem.AllocatedMem[i].base(),
-                CodeMem.AllocatedMem[i].size());
 }
 
 uint64_t PystonMemoryManager::getSymbolAddress(const std::string &name) {
+    uint64_t reloc = getRelocationAddress(name);
+    if (reloc) return reloc;
+
     uint64_t base = RTDyldMemoryManager::getSymbolAddress(name);
     if (base) return base;
 
@@ -233,16 +281,33 @@ uint64_t PystonMemoryManager::getSymbolAddress(const std::string &name) {
 }
 
 PystonMemoryManager::~PystonMemoryManager() {
-    for (unsigned i = 0, e = CodeMem.AllocatedMem.size(); i != e; ++i)
-        sys::Memory::releaseMappedMemory(CodeMem.AllocatedMem[i]);
-    for (unsigned i = 0, e = RWDataMem.AllocatedMem.size(); i != e; ++i)
-        sys::Memory::releaseMappedMemory(RWDataMem.AllocatedMem[i]);
-    for (unsigned i = 0, e = RODataMem.AllocatedMem.size(); i != e; ++i)
-        sys::Memory::releaseMappedMemory(RODataMem.AllocatedMem[i]);
+    for (SlabGroup* group : {&CodeMem, &ColdCodeMem, &StubCodeMem, &RWDataMem, &RODataMem}) {
+        for (Slab &slab : group->slabs)
+            sys::Memory::releaseMappedMemory(slab.mem);
+    }
+    if (memory_manager == this)
+        memory_manager = NULL;
 }
 
 llvm::RTDyldMemoryManager* createMemoryManager() {
-    return new PystonMemoryManager();
+    assert(memory_manager == NULL);
+    memory_manager = new PystonMemoryManager();
+    return memory_manager;
+}
+
+void noteObsoleteCode(void* code_addr) {
+    if (memory_manager)
+        memory_manager->noteObsolete(code_addr);
+}
+
+uint8_t* allocateColdCode(size_t size) {
+    RELEASE_ASSERT(memory_manager, "");
+    return memory_manager->allocateColdCode(size);
+}
+
+uint8_t* allocateStubCode(size_t size) {
+    RELEASE_ASSERT(memory_manager, "");
+    return memory_manager->allocateStubCode(size);
 }
 
 }
@@ -15,12 +15,25 @@
 #ifndef PYSTON_CODEGEN_MEMMGR_H
 #define PYSTON_CODEGEN_MEMMGR_H
 
+#include <cstddef>
+#include <cstdint>
+
 namespace llvm {
 class RTDyldMemoryManager;
 }
 
 namespace pyston {
 llvm::RTDyldMemoryManager* createMemoryManager();
+
+// For when a version of a function has been replaced and won't get called anymore:
+void noteObsoleteCode(void* code_addr);
+
+// Rarely-run code that gets written by hand rather than by llvm (ie the IC slowpath stubs), so that it
+// doesn't take up space in between the hot code.  It's rwx, and near enough the jitted code to be
+// reached with 32-bit jumps.
+uint8_t* allocateColdCode(size_t size);
+// Same, but for hand-written code that's shared between ICs, and so isn't cold.
+uint8_t* allocateStubCode(size_t size);
 }
 
 #endif
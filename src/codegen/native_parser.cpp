@@ -0,0 +1,1584 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "core/common.h"
+#include "core/ast.h"
+
+#include "codegen/native_parser.h"
+
+namespace pyston {
+
+static void __attribute__((noreturn)) parseError(const char* fn, int lineno, const char* kind, const char* msg) {
+    fprintf(stderr, "  File \"%s\", line %d\n%s: %s\n", fn, lineno, kind, msg);
+    exit(1);
+}
+
+static void __attribute__((noreturn)) syntaxError(const char* fn, int lineno, const char* msg) {
+    parseError(fn, lineno, "SyntaxError", msg);
+}
+
+static void __attribute__((noreturn)) unsupported(const char* fn, int lineno, const char* what) {
+    fprintf(stderr, "%s:%d: %s aren't supported yet\n", fn, lineno, what);
+    exit(1);
+}
+
+// Until there's unwinding, nothing can catch an exception, and a raise exits without running the finally blocks
+// that it's in; rather than silently doing that, the parser rejects the code that would depend on it.  This finds
+// the raises that are directly in a try/finally's body (ie not in a def or class that's defined there).
+class RaiseFinder : public NoopASTVisitor {
+    public:
+        AST_Raise* found;
+
+        RaiseFinder() : found(NULL) {}
+
+        virtual bool visit_classdef(AST_ClassDef *node) { return true; }
+        virtual bool visit_functiondef(AST_FunctionDef *node) { return true; }
+        virtual bool visit_raise(AST_Raise *node) {
+            if (!found)
+                found = node;
+            return true;
+        }
+};
+
+enum TokenType {
+    TOK_NAME,
+    TOK_NUMBER,
+    TOK_STRING,
+    TOK_OP,
+    TOK_NEWLINE,
+    TOK_INDENT,
+    TOK_DEDENT,
+    TOK_END,
+};
+
+struct Token {
+    TokenType type;
+    // The source text, except for strings, where it's the value with the escapes already processed.
+    std::string value;
+    int lineno, col_offset;
+    bool is_unicode;
+
+    Token(TokenType type, const std::string &value, int lineno, int col_offset) : type(type), value(value), lineno(lineno), col_offset(col_offset), is_unicode(false) {}
+};
+
+static bool isReservedWord(const std::string &s) {
+    static const char* words[] = {
+        "and", "as", "assert", "break", "class", "continue", "def", "del", "elif", "else", "except", "exec",
+        "finally", "for", "from", "global", "if", "import", "in", "is", "lambda", "not", "or", "pass", "print",
+        "raise", "return", "try", "while", "with", "yield", NULL,
+    };
+    for (int i = 0; words[i]; i++) {
+        if (s == words[i])
+            return true;
+    }
+    return false;
+}
+
+static bool isIdentStart(char c) {
+    return c == '_' || isalpha((unsigned char)c);
+}
+
+static bool isIdentChar(char c) {
+    return c == '_' || isalnum((unsigned char)c);
+}
+
+static bool isStringPrefix(const std::string &s) {
+    if (s.size() > 2)
+        return false;
+    for (char c : s) {
+        if (!strchr("rRuUbB", c))
+            return false;
+    }
+    // "r" has to come last ("ur" and "br" are valid, "ru" isn't):
+    return s.size() == 1 || ((s[1] == 'r' || s[1] == 'R') && s[0] != 'r' && s[0] != 'R');
+}
+
+class Tokenizer {
+    private:
+        const std::string &src;
+        const char* fn;
+        std::vector<Token> &tokens;
+
+        size_t pos, line_start;
+        int lineno;
+        int paren_depth;
+        std::vector<int> indents;
+
+        bool atEnd() {
+            return pos >= src.size();
+        }
+
+        char peek(int offset=0) {
+            return pos + offset < src.size() ? src[pos + offset] : '\0';
+        }
+
+        // Call this after consuming a '\n'
+        void newline() {
+            lineno++;
+            line_start = pos;
+        }
+
+        void add(TokenType type, const std::string &value, int tok_lineno, int col_offset) {
+            tokens.push_back(Token(type, value, tok_lineno, col_offset));
+        }
+
+        // Returns the column that the current line's first token is at, or -1 if the line is blank.
+        int readIndentation() {
+            int col = 0;
+            while (!atEnd()) {
+                char c = src[pos];
+                if (c == ' ')
+                    col++;
+                else if (c == '\t')
+                    col = (col / 8 + 1) * 8;
+                else if (c == '\014')
+                    col = 0;
+                else
+                    break;
+                pos++;
+            }
+
+            if (atEnd())
+                return -1;
+            if (src[pos] == '#' || src[pos] == '\n') {
+                while (!atEnd() && src[pos] != '\n')
+                    pos++;
+                if (!atEnd()) {
+                    pos++;
+                    newline();
+                }
+                return -1;
+            }
+            return col;
+        }
+
+        void readNumber() {
+            size_t start = pos;
+            int col_offset = pos - line_start;
+
+            char c1 = peek(1);
+            if (src[pos] == '0' && strchr("xXoObB", c1) && c1 != '\0') {
+                pos += 2;
+                while (isxdigit((unsigned char)peek()))
+                    pos++;
+            } else {
+                while (isdigit((unsigned char)peek()))
+                    pos++;
+                if (peek() == '.') {
+                    pos++;
+                    while (isdigit((unsigned char)peek()))
+                        pos++;
+                }
+                if (peek() == 'e' || peek() == 'E') {
+                    pos++;
+                    if (peek() == '+' || peek() == '-')
+                        pos++;
+                    if (!isdigit((unsigned char)peek()))
+                        syntaxError(fn, lineno, "invalid syntax");
+                    while (isdigit((unsigned char)peek()))
+                        pos++;
+                }
+            }
+            if (peek() && strchr("lLjJ", peek()))
+                pos++;
+
+            add(TOK_NUMBER, src.substr(start, pos - start), lineno, col_offset);
+        }
+
+        void readString(size_t start, const std::string &prefix) {
+            int start_lineno = lineno;
+            int col_offset = start - line_start;
+
+            bool raw = false, is_unicode = false;
+            for (char c : prefix) {
+                if (c == 'r' || c == 'R')
+                    raw = true;
+                if (c == 'u' || c == 'U')
+                    is_unicode = true;
+            }
+
+            char quote = src[pos];
+            bool triple = (peek(1) == quote && peek(2) == quote);
+            pos += triple ? 3 : 1;
+
+            std::string value;
+            while (true) {
+                if (atEnd())
+                    syntaxError(fn, start_lineno, triple ? "EOF while scanning triple-quoted string literal" : "EOL while scanning string literal");
+
+                char c = src[pos];
+                if (c == quote) {
+                    if (!triple) {
+                        pos++;
+                        break;
+                    }
+                    if (peek(1) == quote && peek(2) == quote) {
+                        pos += 3;
+                        break;
+                    }
+                    value.push_back(c);
+                    pos++;
+                    continue;
+                }
+
+                if (c == '\n') {
+                    if (!triple)
+                        syntaxError(fn, lineno, "EOL while scanning string literal");
+                    value.push_back(c);
+                    pos++;
+                    newline();
+                    continue;
+                }
+
+                if (c != '\\') {
+                    value.push_back(c);
+                    pos++;
+                    continue;
+                }
+
+                if (pos + 1 >= src.size())
+                    syntaxError(fn, lineno, "EOF while scanning string literal");
+                char next = src[pos + 1];
+                pos += 2;
+
+                if (raw) {
+                    // The backslash stays, it just keeps the next character from ending the string:
+                    value.push_back(c);
+                    value.push_back(next);
+                    if (next == '\n')
+                        newline();
+                    continue;
+                }
+
+                switch (next) {
+                    case '\n':
+                        newline();
+                        break;
+                    case '\\':
+                    case '\'':
+                    case '"':
+                        value.push_back(next);
+                        break;
+                    case 'a': value.push_back('\a'); break;
+                    case 'b': value.push_back('\b'); break;
+                    case 'f': value.push_back('\f'); break;
+                    case 'n': value.push_back('\n'); break;
+                    case 'r': value.push_back('\r'); break;
+                    case 't': value.push_back('\t'); break;
+                    case 'v': value.push_back('\v'); break;
+                    case '0': case '1': case '2': case '3':
+                    case '4': case '5': case '6': case '7': {
+                        int v = next - '0';
+                        for (int i = 0; i < 2 && peek() >= '0' && peek() <= '7'; i++)
+                            v = v * 8 + (src[pos++] - '0');
+                        value.push_back((char)v);
+                        break;
+                    }
+                    case 'x': {
+                        if (!isxdigit((unsigned char)peek()) || !isxdigit((unsigned char)peek(1)))
+                            syntaxError(fn, lineno, "invalid \\x escape");
+                        value.push_back((char)strtol(src.substr(pos, 2).c_str(), NULL, 16));
+                        pos += 2;
+                        break;
+                    }
+                    default:
+                        // Unknown escapes get left alone:
+                        value.push_back(c);
+                        value.push_back(next);
+                        break;
+                }
+            }
+
+            // Like cpython, strings that span multiple lines get the position of their last line and
+            // a col_offset of -1.
+            if (lineno != start_lineno)
+                add(TOK_STRING, value, lineno, -1);
+            else
+                add(TOK_STRING, value, start_lineno, col_offset);
+            tokens.back().is_unicode = is_unicode;
+        }
+
+        void readOperator() {
+            static const char* long_ops[] = {
+                "**=", "//=", ">>=", "<<=",
+                "**", "//", ">>", "<<", "<=", ">=", "==", "!=", "<>",
+                "+=", "-=", "*=", "/=", "%=", "&=", "|=", "^=", NULL,
+            };
+
+            int col_offset = pos - line_start;
+            for (int i = 0; long_ops[i]; i++) {
+                int len = strlen(long_ops[i]);
+                if (src.compare(pos, len, long_ops[i]) == 0) {
+                    add(TOK_OP, long_ops[i], lineno, col_offset);
+                    pos += len;
+                    return;
+                }
+            }
+
+            char c = src[pos];
+            if (!strchr("()[]{},:.;@=+-*/%&|^~<>`", c))
+                syntaxError(fn, lineno, "invalid syntax");
+
+            if (c == '(' || c == '[' || c == '{')
+                paren_depth++;
+            else if ((c == ')' || c == ']' || c == '}') && paren_depth > 0)
+                paren_depth--;
+
+            add(TOK_OP, std::string(1, c), lineno, col_offset);
+            pos++;
+        }
+
+    public:
+        Tokenizer(const std::string &src, const char* fn, std::vector<Token> &tokens) : src(src), fn(fn), tokens(tokens), pos(0), line_start(0), lineno(1), paren_depth(0) {
+        }
+
+        void tokenize() {
+            if (src.compare(0, 3, "\xef\xbb\xbf") == 0)
+                pos = line_start = 3;
+
+            indents.push_back(0);
+            bool at_line_start = true;
+
+            while (true) {
+                if (at_line_start) {
+                    int col = readIndentation();
+                    if (col == -1) {
+                        if (atEnd())
+                            break;
+                        continue;
+                    }
+                    at_line_start = false;
+
+                    if (col > indents.back()) {
+                        indents.push_back(col);
+                        add(TOK_INDENT, "", lineno, col);
+                    } else {
+                        while (col < indents.back()) {
+                            indents.pop_back();
+                            add(TOK_DEDENT, "", lineno, col);
+                        }
+                        if (col != indents.back())
+                            parseError(fn, lineno, "IndentationError", "unindent does not match any outer indentation level");
+                    }
+                }
+
+                while (!atEnd() && (src[pos] == ' ' || src[pos] == '\t' || src[pos] == '\014'))
+                    pos++;
+                if (atEnd())
+                    break;
+
+                char c = src[pos];
+                if (c == '#') {
+                    while (!atEnd() && src[pos] != '\n')
+                        pos++;
+                    continue;
+                }
+
+                if (c == '\\') {
+                    if (peek(1) != '\n')
+                        syntaxError(fn, lineno, "unexpected character after line continuation character");
+                    pos += 2;
+                    newline();
+                    continue;
+                }
+
+                if (c == '\n') {
+                    if (paren_depth == 0) {
+                        add(TOK_NEWLINE, "", lineno, pos - line_start);
+                        at_line_start = true;
+                    }
+                    pos++;
+                    newline();
+                    continue;
+                }
+
+                if (isIdentStart(c)) {
+                    size_t start = pos;
+                    while (!atEnd() && isIdentChar(src[pos]))
+                        pos++;
+                    std::string word = src.substr(start, pos - start);
+                    if ((peek() == '\'' || peek() == '"') && isStringPrefix(word))
+                        readString(start, word);
+                    else
+                        add(TOK_NAME, word, lineno, start - line_start);
+                    continue;
+                }
+
+                if (isdigit((unsigned char)c) || (c == '.' && isdigit((unsigned char)peek(1)))) {
+                    readNumber();
+                    continue;
+                }
+
+                if (c == '\'' || c == '"') {
+                    readString(pos, "");
+                    continue;
+                }
+
+                readOperator();
+            }
+
+            if (paren_depth > 0)
+                syntaxError(fn, lineno, "unexpected EOF while parsing");
+
+            if (!tokens.empty() && tokens.back().type != TOK_NEWLINE)
+                add(TOK_NEWLINE, "", lineno, pos - line_start);
+            while (indents.size() > 1) {
+                indents.pop_back();
+                add(TOK_DEDENT, "", lineno, 0);
+            }
+            add(TOK_END, "", lineno, 0);
+        }
+};
+
+// Which binary operators go at which precedence level, from loosest to tightest:
+static const struct {
+    const char* op;
+    AST_TYPE::AST_TYPE type;
+} binop_levels[][5] = {
+    {{"|", AST_TYPE::BitOr}},
+    {{"^", AST_TYPE::BitXor}},
+    {{"&", AST_TYPE::BitAnd}},
+    {{"<<", AST_TYPE::LShift}, {">>", AST_TYPE::RShift}},
+    {{"+", AST_TYPE::Add}, {"-", AST_TYPE::Sub}},
+    {{"*", AST_TYPE::Mult}, {"/", AST_TYPE::Div}, {"%", AST_TYPE::Mod}, {"//", AST_TYPE::FloorDiv}},
+};
+static const int NUM_BINOP_LEVELS = sizeof(binop_levels) / sizeof(binop_levels[0]);
+
+// A recursive-descent version of the Python 2.7 grammar.  The positions that get assigned are the ones that
+// Python/ast.c assigns, which in most cases means the first token of the grammar rule that produced the node.
+class Parser {
+    private:
+        const std::vector<Token> &tokens;
+        const char* fn;
+        int pos;
+        // The module's, which everything else gets allocated from:
+        Arena* arena;
+
+        const Token& tok() {
+            return tokens[pos];
+        }
+
+        const Token& next() {
+            return tokens[pos++];
+        }
+
+        bool isOp(const char* op) {
+            return tok().type == TOK_OP && tok().value == op;
+        }
+
+        bool isKeyword(const char* kw) {
+            return tok().type == TOK_NAME && tok().value == kw;
+        }
+
+        bool acceptOp(const char* op) {
+            if (!isOp(op))
+                return false;
+            pos++;
+            return true;
+        }
+
+        bool acceptKeyword(const char* kw) {
+            if (!isKeyword(kw))
+                return false;
+            pos++;
+            return true;
+        }
+
+        void __attribute__((noreturn)) error() {
+            syntaxError(fn, tok().lineno, "invalid syntax");
+        }
+
+        void expectOp(const char* op) {
+            if (!acceptOp(op))
+                error();
+        }
+
+        void expectNewline() {
+            if (tok().type != TOK_NEWLINE)
+                error();
+            pos++;
+        }
+
+        bool atEndOfStatement() {
+            return tok().type == TOK_NEWLINE || isOp(";");
+        }
+
+        // Whether the current token can start an expression; used to tell if there's anything after a
+        // trailing comma.
+        bool startsExpression() {
+            const Token &t = tok();
+            switch (t.type) {
+                case TOK_NAME:
+                    return !isReservedWord(t.value) || t.value == "not" || t.value == "lambda";
+                case TOK_NUMBER:
+                case TOK_STRING:
+                    return true;
+                case TOK_OP:
+                    return t.value == "(" || t.value == "[" || t.value == "{" || t.value == "`" || t.value == "-" || t.value == "+" || t.value == "~";
+                default:
+                    return false;
+            }
+        }
+
+        template <class T>
+        T* makeNode(const Token &t) {
+            T* rtn = arena->make<T>();
+            rtn->lineno = t.lineno;
+            rtn->col_offset = t.col_offset;
+            return rtn;
+        }
+
+        // For the trailers (calls, attributes, subscripts), which get the position of the expression they
+        // apply to:
+        template <class T>
+        T* makeNode(AST* position_from) {
+            T* rtn = arena->make<T>();
+            rtn->lineno = position_from->lineno;
+            rtn->col_offset = position_from->col_offset;
+            return rtn;
+        }
+
+        // For the nodes that don't have position information:
+        template <class T>
+        T* makeNode() {
+            T* rtn = arena->make<T>();
+            rtn->lineno = -1;
+            rtn->col_offset = -1;
+            return rtn;
+        }
+
+        AST_Name* makeName(const std::string &id, AST_TYPE::AST_TYPE ctx_type, const Token &t) {
+            AST_Name* rtn = makeNode<AST_Name>(t);
+            rtn->id = id;
+            rtn->ctx_type = ctx_type;
+            return rtn;
+        }
+
+        std::string parseName() {
+            const Token &t = tok();
+            if (t.type != TOK_NAME || isReservedWord(t.value))
+                error();
+            pos++;
+            return t.value;
+        }
+
+        AST_Num* makeNum(const Token &t, bool negate, const Token &position) {
+            const std::string &text = t.value;
+            AST_Num* rtn = makeNode<AST_Num>(position);
+
+            char last = text[text.size() - 1];
+            if (last == 'l' || last == 'L')
+                unsupported(fn, t.lineno, "long literals");
+            if (last == 'j' || last == 'J')
+                unsupported(fn, t.lineno, "complex literals");
+
+            int base = 10;
+            size_t start = 0;
+            if (text.size() > 1 && text[0] == '0') {
+                char c = tolower(text[1]);
+                if (c == 'x')
+                    base = 16, start = 2;
+                else if (c == 'o')
+                    base = 8, start = 2;
+                else if (c == 'b')
+                    base = 2, start = 2;
+            }
+
+            if (base == 10 && text.find_first_of(".eE") != std::string::npos) {
+                double d = strtod(text.c_str(), NULL);
+                rtn->num_type = AST_Num::FLOAT;
+                rtn->n_float = negate ? -d : d;
+                return rtn;
+            }
+
+            // Old-style octal literals:
+            if (base == 10 && text.size() > 1 && text[0] == '0')
+                base = 8, start = 1;
+
+            if (start == text.size())
+                syntaxError(fn, t.lineno, "invalid token");
+
+            uint64_t v = 0;
+            for (size_t i = start; i < text.size(); i++) {
+                char c = tolower(text[i]);
+                int digit = isdigit((unsigned char)c) ? c - '0' : c - 'a' + 10;
+                if (digit >= base)
+                    syntaxError(fn, t.lineno, "invalid token");
+                if (v > (UINT64_MAX - digit) / base)
+                    unsupported(fn, t.lineno, "long literals");
+                v = v * base + digit;
+            }
+
+            if (v > (negate ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX))
+                unsupported(fn, t.lineno, "long literals");
+
+            rtn->num_type = AST_Num::INT;
+            rtn->n_int = negate ? (int64_t)(0 - v) : (int64_t)v;
+            return rtn;
+        }
+
+        void setContext(AST_expr* e, AST_TYPE::AST_TYPE ctx_type) {
+            switch (e->type) {
+                case AST_TYPE::Name: {
+                    AST_Name* name = static_cast<AST_Name*>(e);
+                    if (ctx_type == AST_TYPE::Store && name->id == "None")
+                        syntaxError(fn, e->lineno, "cannot assign to None");
+                    name->ctx_type = ctx_type;
+                    return;
+                }
+                case AST_TYPE::Attribute:
+                    static_cast<AST_Attribute*>(e)->ctx_type = ctx_type;
+                    return;
+                case AST_TYPE::Subscript:
+                    static_cast<AST_Subscript*>(e)->ctx_type = ctx_type;
+                    return;
+                case AST_TYPE::Tuple: {
+                    AST_Tuple* tuple = static_cast<AST_Tuple*>(e);
+                    tuple->ctx_type = ctx_type;
+                    for (AST_expr* elt : tuple->elts)
+                        setContext(elt, ctx_type);
+                    return;
+                }
+                case AST_TYPE::List: {
+                    AST_List* list = static_cast<AST_List*>(e);
+                    list->ctx_type = ctx_type;
+                    for (AST_expr* elt : list->elts)
+                        setContext(elt, ctx_type);
+                    return;
+                }
+                case AST_TYPE::Call:
+                    syntaxError(fn, e->lineno, "can't assign to function call");
+                case AST_TYPE::BinOp:
+                case AST_TYPE::BoolOp:
+                case AST_TYPE::UnaryOp:
+                    syntaxError(fn, e->lineno, "can't assign to operator");
+                case AST_TYPE::Compare:
+                    syntaxError(fn, e->lineno, "can't assign to comparison");
+                case AST_TYPE::Num:
+                case AST_TYPE::Str:
+                case AST_TYPE::Dict:
+                    syntaxError(fn, e->lineno, "can't assign to literal");
+                default:
+                    syntaxError(fn, e->lineno, "invalid syntax");
+            }
+        }
+
+        //
+        // Expressions
+        //
+
+        // The arguments of a call, after the '(' and up to (not including) the ')'
+        void parseCallArgs(AST_Call* call) {
+            while (!isOp(")")) {
+                int lineno = tok().lineno;
+                if (acceptOp("*")) {
+                    call->starargs = parseTest();
+                } else if (acceptOp("**")) {
+                    call->kwargs = parseTest();
+                } else {
+                    AST_expr* e = parseTest();
+                    if (isKeyword("for"))
+                        unsupported(fn, lineno, "generator expressions");
+
+                    if (acceptOp("=")) {
+                        if (e->type != AST_TYPE::Name)
+                            syntaxError(fn, lineno, "keyword can't be an expression");
+                        AST_keyword* kw = makeNode<AST_keyword>();
+                        kw->arg = static_cast<AST_Name*>(e)->id;
+                        kw->value = parseTest();
+                        call->keywords.push_back(kw);
+                    } else {
+                        if (call->keywords.size())
+                            syntaxError(fn, lineno, "non-keyword arg after keyword arg");
+                        if (call->starargs)
+                            syntaxError(fn, lineno, "only named arguments may follow *expression");
+                        call->args.push_back(e);
+                    }
+                }
+
+                if (!acceptOp(","))
+                    break;
+            }
+        }
+
+        AST_expr* parseSubscript() {
+            if (isOp(".") && tokens[pos + 1].value == "." && tokens[pos + 2].value == ".")
+                unsupported(fn, tok().lineno, "ellipsis subscripts");
+
+            AST_expr* lower = NULL;
+            if (!isOp(":")) {
+                lower = parseTest();
+                if (!isOp(":")) {
+                    AST_Index* rtn = makeNode<AST_Index>();
+                    rtn->value = lower;
+                    return rtn;
+                }
+            }
+            expectOp(":");
+
+            AST_Slice* rtn = makeNode<AST_Slice>();
+            rtn->lower = lower;
+            rtn->upper = NULL;
+            rtn->step = NULL;
+            if (!isOp(":") && !isOp("]") && !isOp(","))
+                rtn->upper = parseTest();
+            if (isOp(":")) {
+                const Token &colon = next();
+                // cpython turns the empty step of "a[1:2:]" into a None:
+                if (isOp("]") || isOp(","))
+                    rtn->step = makeName("None", AST_TYPE::Load, colon);
+                else
+                    rtn->step = parseTest();
+            }
+            return rtn;
+        }
+
+        AST_expr* parseSubscriptList() {
+            const Token &start = tok();
+            AST_expr* first = parseSubscript();
+            if (!isOp(","))
+                return first;
+
+            std::vector<AST_expr*> items;
+            items.push_back(first);
+            while (acceptOp(",")) {
+                if (isOp("]"))
+                    break;
+                items.push_back(parseSubscript());
+            }
+
+            AST_Tuple* tuple = makeNode<AST_Tuple>(start);
+            tuple->ctx_type = AST_TYPE::Load;
+            for (AST_expr* item : items) {
+                if (item->type != AST_TYPE::Index)
+                    unsupported(fn, start.lineno, "extended slices");
+                tuple->elts.push_back(static_cast<AST_Index*>(item)->value);
+            }
+
+            AST_Index* rtn = makeNode<AST_Index>();
+            rtn->value = tuple;
+            return rtn;
+        }
+
+        AST_expr* parseAtom() {
+            const Token &t = tok();
+            switch (t.type) {
+                case TOK_NAME:
+                    if (isReservedWord(t.value))
+                        error();
+                    pos++;
+                    return makeName(t.value, AST_TYPE::Load, t);
+                case TOK_NUMBER:
+                    pos++;
+                    return makeNum(t, false, t);
+                case TOK_STRING: {
+                    AST_Str* rtn = makeNode<AST_Str>(t);
+                    while (tok().type == TOK_STRING) {
+                        if (tok().is_unicode)
+                            unsupported(fn, tok().lineno, "unicode literals");
+                        rtn->s += next().value;
+                    }
+                    return rtn;
+                }
+                case TOK_OP:
+                    break;
+                default:
+                    error();
+            }
+
+            if (acceptOp("(")) {
+                if (isOp(")")) {
+                    pos++;
+                    AST_Tuple* rtn = makeNode<AST_Tuple>(t);
+                    rtn->ctx_type = AST_TYPE::Load;
+                    return rtn;
+                }
+                if (isKeyword("yield"))
+                    unsupported(fn, tok().lineno, "yield expressions");
+
+                const Token &inner_start = tok();
+                AST_expr* rtn = parseTest();
+                if (isKeyword("for"))
+                    unsupported(fn, tok().lineno, "generator expressions");
+
+                if (isOp(",")) {
+                    AST_Tuple* tuple = makeNode<AST_Tuple>(inner_start);
+                    tuple->ctx_type = AST_TYPE::Load;
+                    tuple->elts.push_back(rtn);
+                    while (acceptOp(",")) {
+                        if (isOp(")"))
+                            break;
+                        tuple->elts.push_back(parseTest());
+                    }
+                    rtn = tuple;
+                }
+                expectOp(")");
+                return rtn;
+            }
+
+            if (acceptOp("[")) {
+                AST_List* rtn = makeNode<AST_List>(t);
+                rtn->ctx_type = AST_TYPE::Load;
+                if (acceptOp("]"))
+                    return rtn;
+
+                rtn->elts.push_back(parseTest());
+                if (isKeyword("for"))
+                    unsupported(fn, tok().lineno, "list comprehensions");
+                while (acceptOp(",")) {
+                    if (isOp("]"))
+                        break;
+                    rtn->elts.push_back(parseTest());
+                }
+                expectOp("]");
+                return rtn;
+            }
+
+            if (acceptOp("{")) {
+                AST_Dict* rtn = makeNode<AST_Dict>(t);
+                while (!isOp("}")) {
+                    rtn->keys.push_back(parseTest());
+                    if (!isOp(":"))
+                        unsupported(fn, tok().lineno, isKeyword("for") ? "set comprehensions" : "set literals");
+                    pos++;
+                    rtn->values.push_back(parseTest());
+                    if (isKeyword("for"))
+                        unsupported(fn, tok().lineno, "dict comprehensions");
+                    if (!acceptOp(","))
+                        break;
+                }
+                expectOp("}");
+                return rtn;
+            }
+
+            if (isOp("`"))
+                unsupported(fn, t.lineno, "backquote expressions");
+            error();
+        }
+
+        AST_expr* parsePower() {
+            const Token &start = tok();
+            AST_expr* rtn = parseAtom();
+
+            while (true) {
+                if (acceptOp("(")) {
+                    AST_Call* call = makeNode<AST_Call>(rtn);
+                    call->func = rtn;
+                    call->starargs = NULL;
+                    call->kwargs = NULL;
+                    parseCallArgs(call);
+                    expectOp(")");
+                    rtn = call;
+                } else if (acceptOp("[")) {
+                    AST_Subscript* subscript = makeNode<AST_Subscript>(rtn);
+                    subscript->value = rtn;
+                    subscript->slice = parseSubscriptList();
+                    subscript->ctx_type = AST_TYPE::Load;
+                    expectOp("]");
+                    rtn = subscript;
+                } else if (acceptOp(".")) {
+                    AST_Attribute* attr = makeNode<AST_Attribute>(rtn);
+                    attr->value = rtn;
+                    attr->attr = parseName();
+                    attr->ctx_type = AST_TYPE::Load;
+                    rtn = attr;
+                } else {
+                    break;
+                }
+            }
+
+            if (acceptOp("**")) {
+                AST_BinOp* binop = makeNode<AST_BinOp>(start);
+                binop->op_type = AST_TYPE::Pow;
+                binop->left = rtn;
+                binop->right = parseFactor();
+                rtn = binop;
+            }
+            return rtn;
+        }
+
+        AST_expr* parseFactor() {
+            const Token &start = tok();
+            AST_TYPE::AST_TYPE op_type;
+            if (isOp("-"))
+                op_type = AST_TYPE::USub;
+            else if (isOp("+"))
+                op_type = AST_TYPE::UAdd;
+            else if (isOp("~"))
+                op_type = AST_TYPE::Invert;
+            else
+                return parsePower();
+            pos++;
+
+            // Like cpython, a negated literal is parsed as a single (negative) number, so that
+            // -9223372036854775808 is still an int.
+            if (op_type == AST_TYPE::USub && tok().type == TOK_NUMBER) {
+                const Token &after = tokens[pos + 1];
+                bool has_trailer = after.type == TOK_OP && (after.value == "(" || after.value == "[" || after.value == "." || after.value == "**");
+                if (!has_trailer)
+                    return makeNum(next(), true, start);
+            }
+
+            AST_UnaryOp* rtn = makeNode<AST_UnaryOp>(start);
+            rtn->op_type = op_type;
+            rtn->operand = parseFactor();
+            return rtn;
+        }
+
+        AST_expr* parseBinOp(int level) {
+            if (level == NUM_BINOP_LEVELS)
+                return parseFactor();
+
+            const Token &start = tok();
+            AST_expr* rtn = parseBinOp(level + 1);
+            bool first = true;
+            while (true) {
+                AST_TYPE::AST_TYPE op_type = (AST_TYPE::AST_TYPE)0;
+                if (tok().type == TOK_OP) {
+                    for (int i = 0; i < 5 && binop_levels[level][i].op; i++) {
+                        if (tok().value == binop_levels[level][i].op)
+                            op_type = binop_levels[level][i].type;
+                    }
+                }
+                if (!op_type)
+                    break;
+
+                // The first operation in a chain like "a + b - c" gets the position of the whole thing, but the
+                // later ones get the position of their operator.
+                const Token &op = next();
+                AST_BinOp* binop = makeNode<AST_BinOp>(first ? start : op);
+                binop->op_type = op_type;
+                binop->left = rtn;
+                binop->right = parseBinOp(level + 1);
+                rtn = binop;
+                first = false;
+            }
+            return rtn;
+        }
+
+        AST_expr* parseExpr() {
+            return parseBinOp(0);
+        }
+
+        AST_expr* parseComparison() {
+            const Token &start = tok();
+            AST_expr* left = parseExpr();
+
+            AST_Compare* rtn = NULL;
+            while (true) {
+                AST_TYPE::AST_TYPE op_type;
+                const Token &t = tok();
+                if (t.type == TOK_OP) {
+                    if (t.value == "<")
+                        op_type = AST_TYPE::Lt;
+                    else if (t.value == ">")
+                        op_type = AST_TYPE::Gt;
+                    else if (t.value == "==")
+                        op_type = AST_TYPE::Eq;
+                    else if (t.value == ">=")
+                        op_type = AST_TYPE::GtE;
+                    else if (t.value == "<=")
+                        op_type = AST_TYPE::LtE;
+                    else if (t.value == "!=" || t.value == "<>")
+                        op_type = AST_TYPE::NotEq;
+                    else
+                        break;
+                    pos++;
+                } else if (isKeyword("in")) {
+                    op_type = AST_TYPE::In;
+                    pos++;
+                } else if (isKeyword("is")) {
+                    pos++;
+                    op_type = acceptKeyword("not") ? AST_TYPE::IsNot : AST_TYPE::Is;
+                } else if (isKeyword("not") && tokens[pos + 1].type == TOK_NAME && tokens[pos + 1].value == "in") {
+                    op_type = AST_TYPE::NotIn;
+                    pos += 2;
+                } else {
+                    break;
+                }
+
+                if (!rtn) {
+                    rtn = makeNode<AST_Compare>(start);
+                    rtn->left = left;
+                }
+                rtn->ops.push_back(op_type);
+                rtn->comparators.push_back(parseExpr());
+            }
+            return rtn ? rtn : left;
+        }
+
+        AST_expr* parseNotTest() {
+            if (!isKeyword("not"))
+                return parseComparison();
+
+            AST_UnaryOp* rtn = makeNode<AST_UnaryOp>(next());
+            rtn->op_type = AST_TYPE::Not;
+            rtn->operand = parseNotTest();
+            return rtn;
+        }
+
+        AST_expr* parseBoolOp(const char* keyword, AST_TYPE::AST_TYPE op_type) {
+            const Token &start = tok();
+            AST_expr* first = (op_type == AST_TYPE::Or) ? parseBoolOp("and", AST_TYPE::And) : parseNotTest();
+            if (!isKeyword(keyword))
+                return first;
+
+            AST_BoolOp* rtn = makeNode<AST_BoolOp>(start);
+            rtn->op_type = op_type;
+            rtn->values.push_back(first);
+            while (acceptKeyword(keyword))
+                rtn->values.push_back((op_type == AST_TYPE::Or) ? parseBoolOp("and", AST_TYPE::And) : parseNotTest());
+            return rtn;
+        }
+
+        AST_expr* parseTest() {
+            if (isKeyword("lambda"))
+                unsupported(fn, tok().lineno, "lambda expressions");
+            AST_expr* rtn = parseBoolOp("or", AST_TYPE::Or);
+            if (isKeyword("if"))
+                unsupported(fn, tok().lineno, "conditional expressions");
+            return rtn;
+        }
+
+        // A comma-separated list of items that becomes a tuple if there's more than one (or a trailing comma).
+        // The ones as for-loop targets are exprs, not tests.
+        AST_expr* parseList(bool exprs) {
+            const Token &start = tok();
+            AST_expr* first = exprs ? parseExpr() : parseTest();
+            if (!isOp(","))
+                return first;
+
+            AST_Tuple* rtn = makeNode<AST_Tuple>(start);
+            rtn->ctx_type = AST_TYPE::Load;
+            rtn->elts.push_back(first);
+            while (acceptOp(",")) {
+                if (!startsExpression())
+                    break;
+                rtn->elts.push_back(exprs ? parseExpr() : parseTest());
+            }
+            return rtn;
+        }
+
+        AST_expr* parseTestList() {
+            return parseList(false);
+        }
+
+        //
+        // Statements
+        //
+
+        void parseSuite(std::vector<AST_stmt*> &body) {
+            expectOp(":");
+            if (tok().type != TOK_NEWLINE) {
+                parseSimpleStatement(body);
+                return;
+            }
+            pos++;
+
+            if (tok().type != TOK_INDENT)
+                parseError(fn, tok().lineno, "IndentationError", "expected an indented block");
+            pos++;
+            while (tok().type != TOK_DEDENT)
+                parseStatement(body);
+            pos++;
+        }
+
+        AST_stmt* parsePrint() {
+            AST_Print* rtn = makeNode<AST_Print>(next());
+            rtn->dest = NULL;
+            rtn->nl = true;
+
+            if (acceptOp(">>")) {
+                rtn->dest = parseTest();
+                if (!acceptOp(","))
+                    return rtn;
+                if (atEndOfStatement())
+                    error();
+            }
+
+            while (!atEndOfStatement()) {
+                rtn->values.push_back(parseTest());
+                if (!acceptOp(",")) {
+                    rtn->nl = true;
+                    break;
+                }
+                rtn->nl = false;
+            }
+            return rtn;
+        }
+
+        AST_stmt* parseImport() {
+            AST_Import* rtn = makeNode<AST_Import>(next());
+            do {
+                AST_alias* alias = makeNode<AST_alias>();
+                alias->name = parseName();
+                while (acceptOp("."))
+                    alias->name += "." + parseName();
+                if (acceptKeyword("as"))
+                    alias->asname = parseName();
+                rtn->names.push_back(alias);
+            } while (acceptOp(","));
+            return rtn;
+        }
+
+        AST_stmt* parseRaise() {
+            AST_Raise* rtn = makeNode<AST_Raise>(next());
+            rtn->type = rtn->inst = rtn->tback = NULL;
+            if (atEndOfStatement())
+                return rtn;
+
+            rtn->type = parseTest();
+            if (acceptOp(",")) {
+                rtn->inst = parseTest();
+                if (acceptOp(","))
+                    rtn->tback = parseTest();
+            }
+            return rtn;
+        }
+
+        AST_stmt* parseExprStatement() {
+            const Token &start = tok();
+            AST_expr* first = parseTestList();
+
+            if (tok().type == TOK_OP && tok().value.size() >= 2 && tok().value[tok().value.size() - 1] == '=' && tok().value != "==" && tok().value != "<=" && tok().value != ">=" && tok().value != "!=")
+                unsupported(fn, tok().lineno, "augmented assignments");
+
+            if (!isOp("=")) {
+                AST_Expr* rtn = makeNode<AST_Expr>(start);
+                rtn->value = first;
+                return rtn;
+            }
+
+            std::vector<AST_expr*> exprs;
+            exprs.push_back(first);
+            while (acceptOp("=")) {
+                if (isKeyword("yield"))
+                    unsupported(fn, tok().lineno, "yield expressions");
+                exprs.push_back(parseTestList());
+            }
+
+            AST_Assign* rtn = makeNode<AST_Assign>(start);
+            rtn->value = exprs.back();
+            exprs.pop_back();
+            for (AST_expr* target : exprs) {
+                setContext(target, AST_TYPE::Store);
+                rtn->targets.push_back(target);
+            }
+            return rtn;
+        }
+
+        AST_stmt* parseSmallStatement() {
+            const Token &t = tok();
+            if (t.type == TOK_NAME) {
+                const std::string &word = t.value;
+                if (word == "print")
+                    return parsePrint();
+                if (word == "import")
+                    return parseImport();
+                if (word == "pass") {
+                    pos++;
+                    return makeNode<AST_Pass>(t);
+                }
+                if (word == "break") {
+                    pos++;
+                    return makeNode<AST_Break>(t);
+                }
+                if (word == "continue") {
+                    pos++;
+                    return makeNode<AST_Continue>(t);
+                }
+                if (word == "return") {
+                    pos++;
+                    AST_Return* rtn = makeNode<AST_Return>(t);
+                    rtn->value = atEndOfStatement() ? NULL : parseTestList();
+                    return rtn;
+                }
+                if (word == "global") {
+                    pos++;
+                    AST_Global* rtn = makeNode<AST_Global>(t);
+                    do {
+                        rtn->names.push_back(parseName());
+                    } while (acceptOp(","));
+                    return rtn;
+                }
+
+                if (word == "from")
+                    unsupported(fn, t.lineno, "'from' imports");
+                if (word == "del")
+                    unsupported(fn, t.lineno, "del statements");
+                if (word == "raise")
+                    return parseRaise();
+                if (word == "assert")
+                    unsupported(fn, t.lineno, "assert statements");
+                if (word == "exec")
+                    unsupported(fn, t.lineno, "exec statements");
+                if (word == "yield")
+                    unsupported(fn, t.lineno, "yield expressions");
+            }
+            return parseExprStatement();
+        }
+
+        void parseSimpleStatement(std::vector<AST_stmt*> &body) {
+            while (true) {
+                body.push_back(parseSmallStatement());
+                if (!acceptOp(";") || tok().type == TOK_NEWLINE)
+                    break;
+            }
+            expectNewline();
+        }
+
+        AST_stmt* parseIf() {
+            AST_If* rtn = makeNode<AST_If>(next());
+            rtn->test = parseTest();
+            parseSuite(rtn->body);
+
+            AST_If* cur = rtn;
+            while (acceptKeyword("elif")) {
+                // The elif gets the position of its condition:
+                AST_If* elif = makeNode<AST_If>(tok());
+                elif->test = parseTest();
+                parseSuite(elif->body);
+                cur->orelse.push_back(elif);
+                cur = elif;
+            }
+
+            if (acceptKeyword("else"))
+                parseSuite(cur->orelse);
+            return rtn;
+        }
+
+        AST_stmt* parseWhile() {
+            AST_While* rtn = makeNode<AST_While>(next());
+            rtn->test = parseTest();
+            parseSuite(rtn->body);
+            if (acceptKeyword("else"))
+                parseSuite(rtn->orelse);
+            return rtn;
+        }
+
+        AST_stmt* parseFor() {
+            AST_For* rtn = makeNode<AST_For>(next());
+            rtn->target = parseList(true);
+            setContext(rtn->target, AST_TYPE::Store);
+            if (!acceptKeyword("in"))
+                error();
+            rtn->iter = parseTestList();
+            parseSuite(rtn->body);
+            if (acceptKeyword("else"))
+                parseSuite(rtn->orelse);
+            return rtn;
+        }
+
+        AST_stmt* parseWith() {
+            pos++;
+
+            // "with a, b:" is the same as a "with b:" inside of a "with a:", and each one gets the position of
+            // its own item.
+            std::vector<AST_With*> items;
+            do {
+                AST_With* item = makeNode<AST_With>(tok());
+                item->context_expr = parseTest();
+                item->optional_vars = NULL;
+                if (acceptKeyword("as")) {
+                    item->optional_vars = parseExpr();
+                    setContext(item->optional_vars, AST_TYPE::Store);
+                }
+                items.push_back(item);
+            } while (acceptOp(","));
+
+            parseSuite(items.back()->body);
+            for (int i = items.size() - 1; i > 0; i--)
+                items[i - 1]->body.push_back(items[i]);
+            return items[0];
+        }
+
+        AST_stmt* parseTry() {
+            const Token &start = next();
+
+            std::vector<AST_stmt*> body;
+            parseSuite(body);
+
+            AST_TryExcept* try_except = NULL;
+            if (isKeyword("except")) {
+                try_except = makeNode<AST_TryExcept>(start);
+                try_except->body = body;
+
+                while (isKeyword("except")) {
+                    AST_ExceptHandler* handler = makeNode<AST_ExceptHandler>(next());
+                    handler->type = handler->name = NULL;
+                    if (try_except->handlers.size() && !try_except->handlers.back()->type)
+                        syntaxError(fn, handler->lineno, "default 'except:' must be last");
+
+                    if (!isOp(":")) {
+                        handler->type = parseTest();
+                        if (acceptKeyword("as") || acceptOp(",")) {
+                            handler->name = parseTest();
+                            setContext(handler->name, AST_TYPE::Store);
+                        }
+                    }
+                    parseSuite(handler->body);
+                    try_except->handlers.push_back(handler);
+                }
+
+                if (acceptKeyword("else"))
+                    parseSuite(try_except->orelse);
+            }
+
+            AST_TryFinally* try_finally = NULL;
+            if (acceptKeyword("finally")) {
+                try_finally = makeNode<AST_TryFinally>(start);
+                if (try_except)
+                    try_finally->body.push_back(try_except);
+                else
+                    try_finally->body = body;
+                parseSuite(try_finally->finalbody);
+            } else if (!try_except) {
+                error();
+            }
+
+            // (see RaiseFinder)
+            if (try_except)
+                unsupported(fn, try_except->handlers[0]->lineno, "except clauses");
+            RaiseFinder finder;
+            for (int i = 0; i < try_finally->body.size() && !finder.found; i++)
+                try_finally->body[i]->accept(&finder);
+            if (finder.found)
+                unsupported(fn, finder.found->lineno, "raise statements inside of try/finally blocks");
+            return try_finally;
+        }
+
+        // def f((a, b)) unpacks the argument into a and b; those targets use the Store context.
+        AST_expr* parseParameter(AST_TYPE::AST_TYPE ctx_type) {
+            if (!acceptOp("(")) {
+                const Token &t = tok();
+                return makeName(parseName(), ctx_type, t);
+            }
+
+            const Token &start = tok();
+            AST_expr* first = parseParameter(AST_TYPE::Store);
+            if (acceptOp(")")) {
+                // def f((x)) is the same as def f(x):
+                if (first->type == AST_TYPE::Name)
+                    static_cast<AST_Name*>(first)->ctx_type = ctx_type;
+                return first;
+            }
+
+            AST_Tuple* rtn = makeNode<AST_Tuple>(start);
+            rtn->ctx_type = AST_TYPE::Store;
+            rtn->elts.push_back(first);
+            while (acceptOp(",")) {
+                if (isOp(")"))
+                    break;
+                rtn->elts.push_back(parseParameter(AST_TYPE::Store));
+            }
+            expectOp(")");
+            return rtn;
+        }
+
+        AST_arguments* parseArguments() {
+            AST_arguments* rtn = makeNode<AST_arguments>();
+            rtn->kwarg = NULL;
+
+            while (!isOp(")")) {
+                if (acceptOp("*")) {
+                    rtn->vararg = parseName();
+                    if (!acceptOp(","))
+                        break;
+                    if (!isOp("**"))
+                        error();
+                }
+                if (acceptOp("**")) {
+                    const Token &t = tok();
+                    rtn->kwarg = makeName(parseName(), AST_TYPE::Param, t);
+                    break;
+                }
+
+                int lineno = tok().lineno;
+                rtn->args.push_back(parseParameter(AST_TYPE::Param));
+                if (acceptOp("="))
+                    rtn->defaults.push_back(parseTest());
+                else if (rtn->defaults.size())
+                    syntaxError(fn, lineno, "non-default argument follows default argument");
+
+                if (!acceptOp(","))
+                    break;
+            }
+            return rtn;
+        }
+
+        AST_FunctionDef* parseFunctionDef() {
+            AST_FunctionDef* rtn = makeNode<AST_FunctionDef>(next());
+            rtn->name = parseName();
+            expectOp("(");
+            rtn->args = parseArguments();
+            expectOp(")");
+            parseSuite(rtn->body);
+            return rtn;
+        }
+
+        AST_ClassDef* parseClassDef() {
+            AST_ClassDef* rtn = makeNode<AST_ClassDef>(next());
+            rtn->name = parseName();
+            if (acceptOp("(")) {
+                while (!isOp(")")) {
+                    rtn->bases.push_back(parseTest());
+                    if (!acceptOp(","))
+                        break;
+                }
+                expectOp(")");
+            }
+            parseSuite(rtn->body);
+            return rtn;
+        }
+
+        AST_stmt* parseDecorated() {
+            const Token &start = tok();
+
+            std::vector<AST_expr*> decorators;
+            while (acceptOp("@")) {
+                const Token &name_start = tok();
+                AST_expr* decorator = makeName(parseName(), AST_TYPE::Load, name_start);
+                while (acceptOp(".")) {
+                    AST_Attribute* attr = makeNode<AST_Attribute>(name_start);
+                    attr->value = decorator;
+                    attr->attr = parseName();
+                    attr->ctx_type = AST_TYPE::Load;
+                    decorator = attr;
+                }
+
+                if (acceptOp("(")) {
+                    AST_Call* call = makeNode<AST_Call>(name_start);
+                    call->func = decorator;
+                    call->starargs = NULL;
+                    call->kwargs = NULL;
+                    parseCallArgs(call);
+                    expectOp(")");
+                    decorator = call;
+                }
+                expectNewline();
+                decorators.push_back(decorator);
+            }
+
+            AST_stmt* rtn;
+            if (isKeyword("def")) {
+                AST_FunctionDef* func = parseFunctionDef();
+                func->decorator_list = decorators;
+                rtn = func;
+            } else if (isKeyword("class")) {
+                AST_ClassDef* cls = parseClassDef();
+                cls->decorator_list = decorators;
+                rtn = cls;
+            } else {
+                error();
+            }
+
+            // Decorated definitions start at the first decorator:
+            rtn->lineno = start.lineno;
+            rtn->col_offset = start.col_offset;
+            return rtn;
+        }
+
+        void parseStatement(std::vector<AST_stmt*> &body) {
+            const Token &t = tok();
+            if (t.type == TOK_INDENT)
+                parseError(fn, t.lineno, "IndentationError", "unexpected indent");
+
+            if (t.type == TOK_NAME) {
+                if (t.value == "if") {
+                    body.push_back(parseIf());
+                    return;
+                }
+                if (t.value == "while") {
+                    body.push_back(parseWhile());
+                    return;
+                }
+                if (t.value == "for") {
+                    body.push_back(parseFor());
+                    return;
+                }
+                if (t.value == "with") {
+                    body.push_back(parseWith());
+                    return;
+                }
+                if (t.value == "def") {
+                    body.push_back(parseFunctionDef());
+                    return;
+                }
+                if (t.value == "class") {
+                    body.push_back(parseClassDef());
+                    return;
+                }
+                if (t.value == "try") {
+                    body.push_back(parseTry());
+                    return;
+                }
+            }
+
+            if (isOp("@")) {
+                body.push_back(parseDecorated());
+                return;
+            }
+
+            parseSimpleStatement(body);
+        }
+
+    public:
+        Parser(const std::vector<Token> &tokens, const char* fn) : tokens(tokens), fn(fn), pos(0), arena(NULL) {
+        }
+
+        AST_Module* parseModule() {
+            AST_Module* rtn = new AST_Module();
+            rtn->lineno = -1;
+            rtn->col_offset = -1;
+            arena = &rtn->arena;
+            while (tok().type != TOK_END) {
+                if (tok().type == TOK_NEWLINE) {
+                    pos++;
+                    continue;
+                }
+                parseStatement(rtn->body);
+            }
+            return rtn;
+        }
+};
+
+AST_Module* parseSource(const std::string &source, const char* fn) {
+    // Translate the line endings, same as cpython does; this also makes "\r\n"s inside of triple-quoted
+    // strings show up as "\n"s.
+    std::string translated;
+    translated.reserve(source.size());
+    for (size_t i = 0; i < source.size(); i++) {
+        if (source[i] == '\r') {
+            translated.push_back('\n');
+            if (i + 1 < source.size() && source[i + 1] == '\n')
+                i++;
+        } else {
+            translated.push_back(source[i]);
+        }
+    }
+
+    std::vector<Token> tokens;
+    Tokenizer(translated, fn, tokens).tokenize();
+    return Parser(tokens, fn).parseModule();
+}
+
+}
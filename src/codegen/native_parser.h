@@ -0,0 +1,33 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CODEGEN_NATIVEPARSER_H
+#define PYSTON_CODEGEN_NATIVEPARSER_H
+
+#include <string>
+
+namespace pyston {
+
+class AST_Module;
+
+// Tokenizes and parses Python 2.7 source straight into our AST nodes.  The tree (including the
+// lineno/col_offset quirks) is the same one that cpython's ast module would give us.
+//
+// Syntax errors, and valid syntax that we don't have AST nodes for yet (lambdas, try, etc),
+// get reported to stderr and exit the process.  fn is only used for the error messages.
+AST_Module* parseSource(const std::string &source, const char* fn);
+
+}
+
+#endif
@@ -26,6 +26,7 @@
 #include "core/options.h"
 
 #include "codegen/codegen.h"
+#include "codegen/runtime_effects.h"
 
 #else
 #define VERBOSITY(...) 1
@@ -230,7 +231,9 @@ class PystonAA : public ImmutablePass, public AliasAnalysis {
         virtual ModRefResult getModRefInfo(ImmutableCallSite CS,
                 const Location &Loc) {
             ModRefResult base = AliasAnalysis::getModRefInfo(CS, Loc);
-            if (!CS.getCalledFunction())
+            // irgen calls the runtime through embedded function pointers, so only the inlined code calls
+            // Functions (but the runtime effects table knows about both):
+            if (!CS.getCalledFunction() && !isa<ConstantExpr>(CS.getCalledValue()))
                 return base;
 
             if (VERBOSITY("opt.aa") >= 2) {
@@ -242,14 +245,34 @@ class PystonAA : public ImmutablePass, public AliasAnalysis {
 
             ModRefResult mask = ModRef;
 
-            StringRef name = CS.getCalledFunction()->getName();
-            if (isAllocCall(name)) {
-                return NoModRef;
+            if (isa<Function>(CS.getCalledValue())) {
+                StringRef name = CS.getCalledFunction()->getName();
+                if (isAllocCall(name)) {
+                    return NoModRef;
+                }
+            }
+
+            const CallInst* call = dyn_cast<CallInst>(CS.getInstruction());
+            const RuntimeFunctionEffects* effects = call ? getRuntimeFunctionEffects(call) : NULL;
+            if (effects) {
+                if (!readsForAA(effects))
+                    mask = ModRefResult(mask & ~Ref);
+                if (!effects->writes())
+                    mask = ModRefResult(mask & ~Mod);
+                // (the ones that don't also allocate or capture get this from getModRefBehavior)
+                if (mask != NoModRef && argMemOnlyForAA(effects) && !aliasesAnyArg(CS, Loc))
+                    mask = NoModRef;
+                if (mask == NoModRef) {
+                    StatCounter num_improved("opt_modref_runtime_effects");
+                    num_improved.log();
+                    return NoModRef;
+                }
             }
 
             EscapeAnalysis &escape = getAnalysis<EscapeAnalysis>();
             EscapeAnalysis::EscapeResult escapes = escape.escapes(Loc.Ptr, CS.getInstruction());
-            if (escapes != EscapeAnalysis::Escaped) {
+            // A call that gets passed the pointer (but doesn't hold on to it) can still look at it:
+            if (escapes != EscapeAnalysis::Escaped && !escape.isPassedTo(Loc.Ptr, CS.getInstruction())) {
                 StatCounter num_improved("opt_modref_noescape");
                 num_improved.log();
                 if (VERBOSITY("opt.aa") >= 2) {
@@ -291,6 +314,47 @@ class PystonAA : public ImmutablePass, public AliasAnalysis {
             return ModRefResult(mask & base);
         }
 
+        // Raising has to stay ordered with the stores that come before it, since whatever handles the
+        // exception could look at them, so here it counts as reading everything:
+        static bool readsForAA(const RuntimeFunctionEffects* effects) {
+            return effects->reads() || effects->mayRaise();
+        }
+        static bool argMemOnlyForAA(const RuntimeFunctionEffects* effects) {
+            return effects->argMemOnly() && !effects->mayRaise();
+        }
+
+        bool aliasesAnyArg(ImmutableCallSite CS, const Location &Loc) {
+            for (ImmutableCallSite::arg_iterator it = CS.arg_begin(), end = CS.arg_end(); it != end; ++it) {
+                if (!(*it)->getType()->isPointerTy())
+                    continue;
+                if (alias(Loc, Location(*it)) != NoAlias)
+                    return true;
+            }
+            return false;
+        }
+
+        using AliasAnalysis::getModRefBehavior;
+        virtual ModRefBehavior getModRefBehavior(ImmutableCallSite CS) {
+            ModRefBehavior base = AliasAnalysis::getModRefBehavior(CS);
+
+            const CallInst* call = dyn_cast<CallInst>(CS.getInstruction());
+            const RuntimeFunctionEffects* effects = call ? getRuntimeFunctionEffects(call) : NULL;
+            // New memory doesn't fit in to any of these, and neither do calls that capture their arguments
+            // (which getModRefInfo and the escape analysis deal with instead):
+            if (!effects || effects->allocates() || effects->captures())
+                return base;
+
+            int rtn = Nowhere;
+            if (readsForAA(effects) || effects->writes()) {
+                rtn = argMemOnlyForAA(effects) ? ArgumentPointees : Anywhere;
+                if (readsForAA(effects))
+                    rtn |= Ref;
+                if (effects->writes())
+                    rtn |= Mod;
+            }
+            return ModRefBehavior(base & rtn);
+        }
+
         virtual void *getAdjustedAnalysisPointer(const void *ID) {
           if (ID == &AliasAnalysis::ID)
             return (AliasAnalysis*)this;
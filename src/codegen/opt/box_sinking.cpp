@@ -0,0 +1,370 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unordered_map>
+#include <vector>
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/InstIterator.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "core/common.h"
+#include "core/options.h"
+#include "core/stats.h"
+
+#include "codegen/codegen.h"
+#include "codegen/irgen/util.h"
+#include "codegen/opt/passes.h"
+
+#include "runtime/types.h"
+
+using namespace llvm;
+
+//#undef VERBOSITY
+//#define VERBOSITY(...) 2
+
+namespace pyston {
+
+// Scalar replacement of the boxes that irgen wraps around unboxed values.  This has to run before
+// the stdlib gets inlined, while boxing is still a call to boxInt / boxFloat / boxInstanceMethod:
+// those don't do anything other than create a new immutable object, so we can forward unboxes
+// and class checks of the result straight to the original values, treat phis of boxes as boxes
+// of phis (including around loop backedges), and only create the box on the paths where it escapes.
+//
+// A box that escapes in more than one block still gets created once, where it originally was
+// (or right after its phis); we only sink it if all of its escapes are in a single block, and
+// never into a loop that it wasn't already in.
+class BoxSinkingPass : public FunctionPass {
+    private:
+        struct BoxKind {
+            Value* box_func;
+            // NULL if there's no unboxing function for this kind of box:
+            Value* unbox_func;
+            BoxedClass* cls;
+        };
+        std::vector<BoxKind> kinds;
+
+        // A box call, or a phi of them, along with what got boxed:
+        struct VirtualBox {
+            const BoxKind* kind;
+            Instruction* inst;
+            std::vector<Value*> contents;
+        };
+
+        void initKinds() {
+            if (kinds.size())
+                return;
+            kinds.push_back(BoxKind({g.funcs.boxInt, g.funcs.unboxInt, int_cls}));
+            kinds.push_back(BoxKind({g.funcs.boxFloat, g.funcs.unboxFloat, float_cls}));
+            kinds.push_back(BoxKind({g.funcs.boxInstanceMethod, NULL, instancemethod_cls}));
+        }
+
+        const BoxKind* getBoxKind(Value* v) {
+            CallInst* ci = dyn_cast<CallInst>(v);
+            if (!ci)
+                return NULL;
+            for (int i = 0; i < kinds.size(); i++) {
+                if (ci->getCalledValue() == kinds[i].box_func)
+                    return &kinds[i];
+            }
+            return NULL;
+        }
+
+        typedef std::unordered_map<PHINode*, const BoxKind*> PhiKinds;
+
+        const BoxKind* getIncomingKind(Value* v, const PhiKinds &phi_kinds) {
+            const BoxKind* kind = getBoxKind(v);
+            if (kind)
+                return kind;
+            if (PHINode* phi = dyn_cast<PHINode>(v)) {
+                PhiKinds::const_iterator it = phi_kinds.find(phi);
+                if (it != phi_kinds.end())
+                    return it->second;
+            }
+            return NULL;
+        }
+
+        // Finds the phis whose incoming values are all boxes of the same kind, or other such phis.
+        void findBoxPhis(Function &F, PhiKinds &phi_kinds) {
+            std::vector<PHINode*> phis;
+            for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+                PHINode* phi = dyn_cast<PHINode>(&*I);
+                if (phi && phi->getType() == g.llvm_value_type_ptr)
+                    phis.push_back(phi);
+            }
+
+            // Be optimistic to start with (so that loops can work), by including any phi that could
+            // be merging boxes...
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (PHINode* phi : phis) {
+                    if (phi_kinds.count(phi))
+                        continue;
+                    for (int i = 0, e = phi->getNumIncomingValues(); i < e; i++) {
+                        const BoxKind* kind = getIncomingKind(phi->getIncomingValue(i), phi_kinds);
+                        if (kind) {
+                            phi_kinds[phi] = kind;
+                            changed = true;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            // ...and then throw out the ones that merge anything else, until there's nothing left to throw out.
+            changed = true;
+            while (changed) {
+                changed = false;
+                for (PhiKinds::iterator it = phi_kinds.begin(); it != phi_kinds.end(); ) {
+                    PHINode* phi = it->first;
+                    bool all_boxes = true;
+                    for (int i = 0, e = phi->getNumIncomingValues(); i < e; i++) {
+                        if (getIncomingKind(phi->getIncomingValue(i), phi_kinds) != it->second) {
+                            all_boxes = false;
+                            break;
+                        }
+                    }
+
+                    if (all_boxes) {
+                        ++it;
+                    } else {
+                        it = phi_kinds.erase(it);
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        // Uses in phis count as happening at the end of the incoming block.
+        static Instruction* getUseLocation(Use *u) {
+            Instruction* user = cast<Instruction>(u->getUser());
+            if (PHINode* phi = dyn_cast<PHINode>(user))
+                return phi->getIncomingBlock(*u)->getTerminator();
+            return user;
+        }
+
+        // Returns where to create the box so that it only happens on the path where it escapes,
+        // or NULL if it should just stay where it was.
+        Instruction* pickSinkPoint(const VirtualBox &vb, const std::vector<Use*> &escapes, LoopInfo &loops) {
+            BasicBlock* bb = NULL;
+            for (Use* u : escapes) {
+                BasicBlock* use_bb = getUseLocation(u)->getParent();
+                if (bb != NULL && use_bb != bb)
+                    return NULL;
+                bb = use_bb;
+            }
+            assert(bb);
+
+            BasicBlock* def_bb = vb.inst->getParent();
+            if (bb == def_bb)
+                return NULL;
+
+            Loop* loop = loops.getLoopFor(bb);
+            if (loop && !loop->contains(def_bb))
+                return NULL;
+
+            for (BasicBlock::iterator it = bb->begin(), end = bb->end(); it != end; ++it) {
+                for (Use* u : escapes) {
+                    if (getUseLocation(u) == &*it)
+                        return &*it;
+                }
+            }
+            RELEASE_ASSERT(0, "");
+        }
+
+        static bool isClassLoadGEP(GetElementPtrInst* gep) {
+            // This is the pattern that makeClassCheck uses:
+            if (gep->getNumIndices() != 2 || !gep->hasAllConstantIndices())
+                return false;
+            if (cast<ConstantInt>(gep->getOperand(1))->getSExtValue() != 0 || cast<ConstantInt>(gep->getOperand(2))->getSExtValue() != 1)
+                return false;
+            for (Value::use_iterator use_it = gep->use_begin(), use_end = gep->use_end(); use_it != use_end; ++use_it) {
+                if (!isa<LoadInst>(*use_it))
+                    return false;
+            }
+            return true;
+        }
+
+    public:
+        static char ID;
+        BoxSinkingPass() : FunctionPass(ID) {}
+
+        virtual void getAnalysisUsage(AnalysisUsage &info) const {
+            info.setPreservesCFG();
+            info.addRequired<LoopInfo>();
+        }
+
+        virtual bool runOnFunction(Function &F) {
+            initKinds();
+            LoopInfo &loops = getAnalysis<LoopInfo>();
+
+            StatCounter sc_forwarded("opt_box_sinking_forwarded");
+            StatCounter sc_removed("opt_box_sinking_removed");
+            StatCounter sc_sunk("opt_box_sinking_sunk");
+
+            std::vector<VirtualBox> boxes;
+            std::unordered_map<Value*, int> box_idx;
+            for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+                const BoxKind* kind = getBoxKind(&*I);
+                if (!kind)
+                    continue;
+
+                CallInst* ci = cast<CallInst>(&*I);
+                VirtualBox vb;
+                vb.kind = kind;
+                vb.inst = ci;
+                for (int i = 0; i < ci->getNumArgOperands(); i++) {
+                    vb.contents.push_back(ci->getArgOperand(i));
+                }
+                box_idx[ci] = boxes.size();
+                boxes.push_back(vb);
+            }
+
+            if (boxes.empty())
+                return false;
+
+            PhiKinds phi_kinds;
+            findBoxPhis(F, phi_kinds);
+
+            // Give each phi of boxes a phi of whatever got boxed; the incoming values get filled in
+            // once they've all been created, since they can refer to each other.
+            for (PhiKinds::iterator it = phi_kinds.begin(), end = phi_kinds.end(); it != end; ++it) {
+                PHINode* phi = it->first;
+                FunctionType* ft = cast<FunctionType>(cast<PointerType>(it->second->box_func->getType())->getElementType());
+
+                VirtualBox vb;
+                vb.kind = it->second;
+                vb.inst = phi;
+                for (int i = 0; i < ft->getNumParams(); i++) {
+                    vb.contents.push_back(PHINode::Create(ft->getParamType(i), phi->getNumIncomingValues(), "unboxed", phi));
+                }
+                box_idx[phi] = boxes.size();
+                boxes.push_back(vb);
+            }
+            for (PhiKinds::iterator it = phi_kinds.begin(), end = phi_kinds.end(); it != end; ++it) {
+                PHINode* phi = it->first;
+                const VirtualBox &vb = boxes[box_idx[phi]];
+                for (int i = 0, e = phi->getNumIncomingValues(); i < e; i++) {
+                    assert(box_idx.count(phi->getIncomingValue(i)));
+                    const VirtualBox &incoming = boxes[box_idx[phi->getIncomingValue(i)]];
+                    for (int j = 0; j < vb.contents.size(); j++) {
+                        cast<PHINode>(vb.contents[j])->addIncoming(incoming.contents[j], phi->getIncomingBlock(i));
+                    }
+                }
+            }
+
+            bool changed = phi_kinds.size() > 0;
+
+            for (int i = 0; i < boxes.size(); i++) {
+                const VirtualBox &vb = boxes[i];
+
+                std::vector<Instruction*> to_erase;
+                std::vector<Use*> escapes;
+                for (Value::use_iterator use_it = vb.inst->use_begin(), use_end = vb.inst->use_end(); use_it != use_end; ++use_it) {
+                    Instruction* user = cast<Instruction>(*use_it);
+
+                    // These will be going away:
+                    if (PHINode* phi = dyn_cast<PHINode>(user)) {
+                        if (phi_kinds.count(phi))
+                            continue;
+                    }
+
+                    if (CallInst* ci = dyn_cast<CallInst>(user)) {
+                        if (vb.kind->unbox_func && ci->getCalledValue() == vb.kind->unbox_func) {
+                            if (VERBOSITY("opt") >= 1) errs() << "Forwarding unbox: " << *ci << '\n';
+                            ci->replaceAllUsesWith(vb.contents[0]);
+                            to_erase.push_back(ci);
+                            sc_forwarded.log();
+                            continue;
+                        }
+                    }
+
+                    if (GetElementPtrInst* gep = dyn_cast<GetElementPtrInst>(user)) {
+                        if (gep->getPointerOperand() == vb.inst && isClassLoadGEP(gep)) {
+                            for (Value::use_iterator gep_use_it = gep->use_begin(), gep_use_end = gep->use_end(); gep_use_it != gep_use_end; ++gep_use_it) {
+                                LoadInst* li = cast<LoadInst>(*gep_use_it);
+                                li->replaceAllUsesWith(embedConstantPtr(vb.kind->cls, li->getType()));
+                                to_erase.push_back(li);
+                            }
+                            to_erase.push_back(gep);
+                            sc_forwarded.log();
+                            continue;
+                        }
+                    }
+
+                    escapes.push_back(&use_it.getUse());
+                }
+
+                for (Instruction* I : to_erase) {
+                    I->eraseFromParent();
+                }
+                if (to_erase.size())
+                    changed = true;
+
+                if (escapes.empty())
+                    continue;
+
+                Instruction* insert_before = pickSinkPoint(vb, escapes, loops);
+                if (insert_before == NULL) {
+                    if (isa<CallInst>(vb.inst))
+                        continue;
+                    insert_before = vb.inst->getParent()->getFirstInsertionPt();
+                } else {
+                    sc_sunk.log();
+                }
+
+                CallInst* boxed = CallInst::Create(vb.kind->box_func, vb.contents, "boxed", insert_before);
+                boxed->setDebugLoc(insert_before->getDebugLoc());
+                if (VERBOSITY("opt") >= 1) errs() << "Boxing " << *vb.inst << " at " << *boxed << '\n';
+                for (Use* u : escapes) {
+                    u->set(boxed);
+                }
+                changed = true;
+            }
+
+            // Now the phis of boxes are only used by each other:
+            for (PhiKinds::iterator it = phi_kinds.begin(), end = phi_kinds.end(); it != end; ++it) {
+                it->first->replaceAllUsesWith(UndefValue::get(it->first->getType()));
+            }
+            for (PhiKinds::iterator it = phi_kinds.begin(), end = phi_kinds.end(); it != end; ++it) {
+                it->first->eraseFromParent();
+            }
+
+            for (int i = 0; i < boxes.size(); i++) {
+                Instruction* I = boxes[i].inst;
+                if (isa<PHINode>(I))
+                    continue;
+                if (I->use_empty()) {
+                    I->eraseFromParent();
+                    sc_removed.log();
+                    changed = true;
+                }
+            }
+
+            return changed;
+        }
+};
+char BoxSinkingPass::ID = 0;
+
+FunctionPass* createBoxSinkingPass() {
+    return new BoxSinkingPass();
+}
+
+}
+
+static RegisterPass<pyston::BoxSinkingPass> X("box_sinking", "Scalar-replace boxes, only boxing on the paths where they escape", true, false);
@@ -46,6 +46,7 @@ namespace pyston {
 #define CLS_DTOR_OFFSET ((const char*)&(((BoxedClass*)0x01)->dtor) - (const char*)0x1)
 #define CLS_HASATTRS_OFFSET ((const char*)&(((BoxedClass*)0x01)->hasattrs) - (const char*)0x1)
 #define FLAVOR_KINDID_OFFSET ((const char*)&(((ObjectFlavor*)0x01)->kind_id) - (const char*)0x1)
+#define FLAVOR_FINALIZER_OFFSET ((const char*)&(((ObjectFlavor*)0x01)->finalizer) - (const char*)0x1)
 
 class ConstClassesPass : public FunctionPass {
     private:
@@ -99,6 +100,11 @@ class ConstClassesPass : public FunctionPass {
                 ObjectFlavor* flavor = getFlavorFromGV(cast<GlobalVariable>(gepce->getOperand(0)));
                 replaceUsesWithConstant(li, flavor->kind_id);
                 return true;
+            } else if (offset == FLAVOR_FINALIZER_OFFSET) {
+                // The Box constructor checks this to see whether to set the finalizable bit:
+                ObjectFlavor* flavor = getFlavorFromGV(cast<GlobalVariable>(gepce->getOperand(0)));
+                replaceUsesWithConstant(li, (uintptr_t)flavor->finalizer);
+                return true;
             } else {
                 ASSERT(0, "%ld", offset);
                 return false;
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <unordered_set>
 #include <queue>
 #include <set>
@@ -37,6 +38,7 @@
 
 #include "codegen/irgen/util.h"
 #include "codegen/opt/util.h"
+#include "codegen/runtime_effects.h"
 
 using namespace llvm;
 
@@ -57,6 +59,11 @@ class DeadAllocsPass : public FunctionPass {
             std::vector<LoadInst*> loads;
         };
 
+        static bool isRemovableUse(CallInst* call) {
+            const RuntimeFunctionEffects* effects = getRuntimeFunctionEffects(call);
+            return effects && effects->removableIfUnused() && call->use_empty();
+        }
+
         bool canBeRead(llvm::Instruction *v, ChainInfo &chain) {
             if (chain.seen.count(v))
                 return false;
@@ -102,6 +109,14 @@ class DeadAllocsPass : public FunctionPass {
                 }
 
                 if (CallInst *si = dyn_cast<CallInst>(*use_it)) {
+                    // Calls that only look at the allocation (ex the write barriers for stores into it) can go
+                    // along with it:
+                    if (isRemovableUse(si)) {
+                        if (std::find(chain.deletions.begin(), chain.deletions.end(), si) == chain.deletions.end())
+                            chain.deletions.push_back(si);
+                        continue;
+                    }
+
                     if (VERBOSITY() >= 2) errs() << "Not dead; used here: " << *si << '\n';
                     return true;
                 }
@@ -37,6 +37,7 @@
 
 #include "codegen/opt/escape_analysis.h"
 #include "codegen/opt/util.h"
+#include "codegen/runtime_effects.h"
 
 using namespace llvm;
 
@@ -130,6 +131,12 @@ bool EscapeAnalysis::runOnFunction(Function &F) {
                     }
 
                     if (CallInst *si = dyn_cast<CallInst>(*use_it)) {
+                        const RuntimeFunctionEffects* effects = getRuntimeFunctionEffects(si);
+                        if (effects && !effects->captures()) {
+                            chain->passed_to.insert(si);
+                            continue;
+                        }
+
                         if (VERBOSITY() >= 2) errs() << "Escapes here: " << *si << '\n';
                         chain->escape_points.insert(si);
                         continue;
@@ -211,6 +218,12 @@ EscapeAnalysis::EscapeResult EscapeAnalysis::escapes(const Value* ptr, const Ins
 }
 
 
+bool EscapeAnalysis::isPassedTo(const Value* ptr, const Instruction *call) {
+    auto it = chain_by_pointer.find(ptr);
+    if (it == chain_by_pointer.end())
+        return false;
+    return it->second->passed_to.count(call) != 0;
+}
 
 char EscapeAnalysis::ID = 0;
 static RegisterPass<EscapeAnalysis> X("escape_analysis", "Escape analysis", false, true);
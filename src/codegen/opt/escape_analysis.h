@@ -33,6 +33,9 @@ class EscapeAnalysis : public llvm::FunctionPass {
             std::unordered_set<llvm::Value*> derived;
 
             std::unordered_set<const llvm::Instruction*> escape_points;
+            // Calls that get passed the pointer, but that the runtime effects table says don't hold on
+            // to it, so don't count as escapes:
+            std::unordered_set<const llvm::Instruction*> passed_to;
 
             //// Instructions that are free to be deleted if the chain is dead:
             //std::vector<Instruction*> deletions;
@@ -65,6 +68,9 @@ class EscapeAnalysis : public llvm::FunctionPass {
         };
 
         EscapeResult escapes(const llvm::Value* ptr, const llvm::Instruction *at_instruction);
+        // Whether the (not yet escaped) pointer is one of the call's arguments; the call can't keep
+        // it, but it can still read or write it.
+        bool isPassedTo(const llvm::Value* ptr, const llvm::Instruction *call);
 };
 
 }
@@ -0,0 +1,287 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CFG.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "core/common.h"
+#include "core/options.h"
+#include "core/stats.h"
+
+#include "codegen/codegen.h"
+#include "codegen/irgen/util.h"
+#include "codegen/patchpoints.h"
+
+using namespace llvm;
+
+namespace pyston {
+
+// Rewrites calls in jitted code into patchpoints, with the gc pointers that are live across the call
+// attached as live values.  The resulting stackmap records tell the collector exactly where to find
+// the roots of the frame while it is stopped at that call, so it doesn't have to scan the whole frame
+// conservatively.
+//
+// Stack allocations get passed along too (as "Direct" locations); we don't track what gets stored
+// into them, so the collector scans them conservatively.
+//
+// Pointers don't always stay pointer-typed: they get ptrtoint'd into i64s (the unboxed fast paths, the
+// vectorizers), or end up in vector lanes, so those are tracked too.  A live i64 that isn't a pointer is
+// harmless, since the collector checks whether each value points into the heap, same as it does for
+// the conservatively-scanned frames.  Vectors get passed as their lanes, since stackmaps only take scalars.
+class GCRootsPass : public FunctionPass {
+    private:
+        typedef std::unordered_set<Value*> ValueSet;
+
+        CompiledFunction* cf;
+
+        static bool canHoldPointer(Type* t) {
+            return t->isPointerTy() || (t->isIntegerTy() && t->getIntegerBitWidth() == 64);
+        }
+
+        static bool isTracked(Value* v) {
+            Type* t = v->getType();
+            if (VectorType* vt = dyn_cast<VectorType>(t))
+                t = vt->getElementType();
+            if (!canHoldPointer(t))
+                return false;
+            if (isa<AllocaInst>(v))
+                return false;
+            return isa<Instruction>(v) || isa<Argument>(v);
+        }
+
+        static bool isSimpleType(Type* t) {
+            if (t->isPointerTy())
+                return true;
+            if (t->isIntegerTy() && t->getIntegerBitWidth() <= 64)
+                return true;
+            return false;
+        }
+
+        static bool canRewrite(CallInst* ci) {
+            if (isa<IntrinsicInst>(ci))
+                return false;
+            if (ci->isInlineAsm())
+                return false;
+            // Calls in tail position can turn into sibling calls that don't leave our frame on the
+            // stack, so there's nothing to record; converting them would also disable that.
+            // (Plenty of other calls get the "tail" marker, which doesn't matter here.)
+            if (ci->isTailCall() && isa<ReturnInst>(ci->getNextNode()))
+                return false;
+            // Can't allocate, so the collector will never see us stopped here:
+            if (ci->doesNotAccessMemory())
+                return false;
+            if (ci->getCallingConv() != CallingConv::C)
+                return false;
+
+            Function *callee = ci->getCalledFunction();
+            if (callee && callee->isIntrinsic())
+                return false;
+
+            FunctionType* ft = cast<FunctionType>(cast<PointerType>(ci->getCalledValue()->getType())->getElementType());
+            if (ft->isVarArg())
+                return false;
+
+            if (!ci->getType()->isVoidTy() && !isSimpleType(ci->getType()))
+                return false;
+
+            for (int i = 0; i < ci->getNumArgOperands(); i++) {
+                if (!isSimpleType(ci->getArgOperand(i)->getType()))
+                    return false;
+                if (ci->paramHasAttr(i + 1, Attribute::ByVal) || ci->paramHasAttr(i + 1, Attribute::StructRet)
+                        || ci->paramHasAttr(i + 1, Attribute::InReg))
+                    return false;
+            }
+            return true;
+        }
+
+        static void transfer(Instruction* I, ValueSet &live) {
+            live.erase(I);
+            // phi operands are live-out of the corresponding predecessor, not live-in here
+            if (isa<PHINode>(I))
+                return;
+            for (User::op_iterator op = I->op_begin(), end = I->op_end(); op != end; ++op) {
+                if (isTracked(*op))
+                    live.insert(*op);
+            }
+        }
+
+        static ValueSet liveOut(BasicBlock* BB, std::unordered_map<BasicBlock*, ValueSet> &live_in) {
+            ValueSet rtn;
+            TerminatorInst* term = BB->getTerminator();
+            for (int i = 0; i < term->getNumSuccessors(); i++) {
+                BasicBlock* succ = term->getSuccessor(i);
+                for (Value* v : live_in[succ]) {
+                    if (isa<PHINode>(v) && cast<PHINode>(v)->getParent() == succ)
+                        continue;
+                    rtn.insert(v);
+                }
+
+                for (BasicBlock::iterator it = succ->begin(); isa<PHINode>(it); ++it) {
+                    Value* incoming = cast<PHINode>(it)->getIncomingValueForBlock(BB);
+                    if (isTracked(incoming))
+                        rtn.insert(incoming);
+                }
+            }
+            return rtn;
+        }
+
+        static void computeLiveIns(Function &F, std::unordered_map<BasicBlock*, ValueSet> &live_in) {
+            // The sets only ever grow, so comparing sizes is enough to detect convergence:
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (Function::iterator bb_it = F.end(), bb_begin = F.begin(); bb_it != bb_begin; ) {
+                    --bb_it;
+                    BasicBlock* BB = bb_it;
+
+                    ValueSet live = liveOut(BB, live_in);
+                    for (BasicBlock::iterator it = BB->end(), begin = BB->begin(); it != begin; ) {
+                        --it;
+                        transfer(it, live);
+                    }
+
+                    ValueSet &prev = live_in[BB];
+                    if (live.size() != prev.size()) {
+                        prev = std::move(live);
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        void rewriteCall(CallInst* ci, const std::vector<Value*> &live, const std::vector<AllocaInst*> &allocas, const std::vector<int> &alloca_sizes) {
+            std::vector<Value*> live_values;
+            for (Value* v : live) {
+                VectorType* vt = dyn_cast<VectorType>(v->getType());
+                if (!vt) {
+                    live_values.push_back(v);
+                    continue;
+                }
+                // (the copies are fine, since the collector doesn't move anything)
+                for (int i = 0; i < vt->getNumElements(); i++)
+                    live_values.push_back(ExtractElementInst::Create(v, getConstantInt(i, g.i32), "", ci));
+            }
+
+            std::vector<int> range_sizes(live_values.size(), 0);
+            range_sizes.insert(range_sizes.end(), alloca_sizes.begin(), alloca_sizes.end());
+            int64_t id = patchpoints::registerGCRootCallsite(cf, range_sizes);
+
+            Value* target = ci->getCalledValue();
+            if (Constant* c = dyn_cast<Constant>(target))
+                target = ConstantExpr::getBitCast(c, g.i8_ptr);
+            else
+                target = new BitCastInst(target, g.i8_ptr, "", ci);
+
+            std::vector<Value*> pp_args;
+            pp_args.push_back(getConstantInt(id, g.i64));
+            pp_args.push_back(getConstantInt(patchpoints::GC_ROOT_CALLSITE_SIZE, g.i32));
+            pp_args.push_back(target);
+            pp_args.push_back(getConstantInt(ci->getNumArgOperands(), g.i32));
+            for (int i = 0; i < ci->getNumArgOperands(); i++) {
+                pp_args.push_back(ci->getArgOperand(i));
+            }
+            pp_args.insert(pp_args.end(), live_values.begin(), live_values.end());
+            pp_args.insert(pp_args.end(), allocas.begin(), allocas.end());
+
+            Type* rtn_type = ci->getType();
+            Intrinsic::ID intrinsic_id = rtn_type->isVoidTy() ? Intrinsic::experimental_patchpoint_void : Intrinsic::experimental_patchpoint_i64;
+            Function* patchpoint = Intrinsic::getDeclaration(ci->getParent()->getParent()->getParent(), intrinsic_id);
+            CallInst* pp = CallInst::Create(patchpoint, pp_args, "", ci);
+            pp->setCallingConv(ci->getCallingConv());
+            pp->setDebugLoc(ci->getDebugLoc());
+
+            Value* rtn = pp;
+            if (rtn_type->isPointerTy())
+                rtn = new IntToPtrInst(pp, rtn_type, "", ci);
+            else if (rtn_type->isIntegerTy() && rtn_type->getIntegerBitWidth() < 64)
+                rtn = new TruncInst(pp, rtn_type, "", ci);
+
+            if (!rtn_type->isVoidTy()) {
+                rtn->takeName(ci);
+                ci->replaceAllUsesWith(rtn);
+            }
+            ci->eraseFromParent();
+        }
+
+    public:
+        static char ID;
+        GCRootsPass(CompiledFunction* cf) : FunctionPass(ID), cf(cf) {
+        }
+
+        virtual void getAnalysisUsage(AnalysisUsage &info) const {
+            info.setPreservesCFG();
+        }
+
+        virtual bool runOnFunction(Function &F) {
+            static StatCounter num_rewritten("opt_gcroots_callsites");
+            static StatCounter num_live("opt_gcroots_live_values");
+
+            const DataLayout* dl = g.tm->getDataLayout();
+
+            std::vector<AllocaInst*> allocas;
+            std::vector<int> alloca_sizes;
+            for (Instruction &I : F.getEntryBlock()) {
+                AllocaInst* ai = dyn_cast<AllocaInst>(&I);
+                if (!ai || !ai->isStaticAlloca())
+                    continue;
+                uint64_t count = cast<ConstantInt>(ai->getArraySize())->getZExtValue();
+                allocas.push_back(ai);
+                alloca_sizes.push_back(dl->getTypeAllocSize(ai->getAllocatedType()) * count);
+            }
+
+            std::unordered_map<BasicBlock*, ValueSet> live_in;
+            computeLiveIns(F, live_in);
+
+            std::vector<std::pair<CallInst*, std::vector<Value*> > > to_rewrite;
+            for (BasicBlock &BB : F) {
+                ValueSet live = liveOut(&BB, live_in);
+                for (BasicBlock::iterator it = BB.end(), begin = BB.begin(); it != begin; ) {
+                    --it;
+                    CallInst* ci = dyn_cast<CallInst>(it);
+                    if (ci && canRewrite(ci)) {
+                        // The result of the call isn't live across it:
+                        ValueSet across(live);
+                        across.erase(ci);
+                        to_rewrite.push_back(std::make_pair(ci, std::vector<Value*>(across.begin(), across.end())));
+                    }
+                    transfer(it, live);
+                }
+            }
+
+            for (auto &p : to_rewrite) {
+                num_rewritten.log();
+                num_live.log(p.second.size());
+                rewriteCall(p.first, p.second, allocas, alloca_sizes);
+            }
+
+            return !to_rewrite.empty();
+        }
+};
+char GCRootsPass::ID = 0;
+
+FunctionPass* createGCRootsPass(CompiledFunction* cf) {
+    return new GCRootsPass(cf);
+}
+
+}
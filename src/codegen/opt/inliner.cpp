@@ -87,8 +87,9 @@ class MyMaterializer : public llvm::ValueMaterializer {
 class MyInliningPass : public llvm::FunctionPass {
     public:
         static char ID;
-        static bool initialized;
-        static llvm::Module *fake_module;
+        // Per-thread, since fake_module has to be in the thread's llvm context:
+        static __thread bool initialized;
+        static __thread llvm::Module *fake_module;
 
         int threshold;
         MyInliningPass(int threshold=275) : FunctionPass(ID), threshold(threshold) {}
@@ -99,7 +100,7 @@ class MyInliningPass : public llvm::FunctionPass {
                 llvm::initializeSimpleInlinerPass(*llvm::PassRegistry::getPassRegistry());
                 llvm::initializeTargetTransformInfoAnalysisGroup(*llvm::PassRegistry::getPassRegistry());
 
-                fake_module = new llvm::Module("fake", g.context);
+                fake_module = new llvm::Module("fake", *g.context);
 
                 initialized = true;
             }
@@ -317,8 +318,8 @@ class MyInliningPass : public llvm::FunctionPass {
         }
 };
 char MyInliningPass::ID = 0;
-bool MyInliningPass::initialized = false;
-llvm::Module* MyInliningPass::fake_module = 0;
+__thread bool MyInliningPass::initialized = false;
+__thread llvm::Module* MyInliningPass::fake_module = 0;
 static llvm::RegisterPass<MyInliningPass> X("myinliner", "Function-level inliner", false, false);
 
 llvm::FunctionPass *makeFPInliner(int threshold) {
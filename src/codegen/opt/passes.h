@@ -21,10 +21,15 @@ class ImmutablePass;
 }
 
 namespace pyston {
+class CompiledFunction;
+
 llvm::ImmutablePass* createPystonAAPass();
 llvm::FunctionPass* createMallocsNonNullPass();
 llvm::FunctionPass* createConstClassesPass();
 llvm::FunctionPass* createDeadAllocsPass();
+llvm::FunctionPass* createBoxSinkingPass();
+llvm::FunctionPass* createStackAllocsPass();
+llvm::FunctionPass* createGCRootsPass(CompiledFunction* cf);
 }
 
 #endif
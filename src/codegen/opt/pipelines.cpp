@@ -0,0 +1,303 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <sys/time.h>
+#include <vector>
+
+#include "llvm/PassManager.h"
+#include "llvm/Analysis/LoopPass.h"
+#include "llvm/Analysis/Passes.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Vectorize.h"
+
+#include "core/common.h"
+#include "core/options.h"
+#include "core/stats.h"
+#include "core/trace.h"
+
+#include "codegen/irgen/tiering.h"
+#include "codegen/opt/escape_analysis.h"
+#include "codegen/opt/inliner.h"
+#include "codegen/opt/passes.h"
+#include "codegen/opt/pipelines.h"
+
+namespace pyston {
+
+enum PassGate {
+    ALWAYS,
+    PYSTON_PASS,
+    INLINING,
+    VECTORIZE,
+};
+
+struct PassInfo {
+    const char* name;
+    llvm::Pass* (*create)();
+    PassGate gate;
+};
+
+static const PassInfo all_passes[] = {
+    {"box_sinking", []() -> llvm::Pass* { return createBoxSinkingPass(); }, PYSTON_PASS},
+    {"stack_allocs", []() -> llvm::Pass* { return createStackAllocsPass(); }, PYSTON_PASS},
+    {"inline", []() -> llvm::Pass* { return makeFPInliner(275); }, INLINING},
+    {"basicaa", []() -> llvm::Pass* { return llvm::createBasicAliasAnalysisPass(); }, ALWAYS},
+    {"tbaa", []() -> llvm::Pass* { return llvm::createTypeBasedAliasAnalysisPass(); }, ALWAYS},
+    {"escape_analysis", []() -> llvm::Pass* { return new EscapeAnalysis(); }, PYSTON_PASS},
+    {"pyston_aa", []() -> llvm::Pass* { return createPystonAAPass(); }, PYSTON_PASS},
+    {"mallocs_nonnull", []() -> llvm::Pass* { return createMallocsNonNullPass(); }, PYSTON_PASS},
+    {"const_classes", []() -> llvm::Pass* { return createConstClassesPass(); }, PYSTON_PASS},
+    {"dead_allocs", []() -> llvm::Pass* { return createDeadAllocsPass(); }, PYSTON_PASS},
+
+    {"simplifycfg", []() -> llvm::Pass* { return llvm::createCFGSimplificationPass(); }, ALWAYS},
+    {"early_cse", []() -> llvm::Pass* { return llvm::createEarlyCSEPass(); }, ALWAYS},
+    {"jump_threading", []() -> llvm::Pass* { return llvm::createJumpThreadingPass(); }, ALWAYS},
+    {"cvp", []() -> llvm::Pass* { return llvm::createCorrelatedValuePropagationPass(); }, ALWAYS},
+    {"instcombine", []() -> llvm::Pass* { return llvm::createInstructionCombiningPass(); }, ALWAYS},
+    {"tailcallelim", []() -> llvm::Pass* { return llvm::createTailCallEliminationPass(); }, ALWAYS},
+    {"reassociate", []() -> llvm::Pass* { return llvm::createReassociatePass(); }, ALWAYS},
+    {"loop_rotate", []() -> llvm::Pass* { return llvm::createLoopRotatePass(); }, ALWAYS},
+    {"licm", []() -> llvm::Pass* { return llvm::createLICMPass(); }, ALWAYS},
+    {"loop_unswitch", []() -> llvm::Pass* { return llvm::createLoopUnswitchPass(true /*optimize_for_size*/); }, ALWAYS},
+    {"indvars", []() -> llvm::Pass* { return llvm::createIndVarSimplifyPass(); }, ALWAYS},
+    {"loop_idiom", []() -> llvm::Pass* { return llvm::createLoopIdiomPass(); }, ALWAYS},
+    {"loop_deletion", []() -> llvm::Pass* { return llvm::createLoopDeletionPass(); }, ALWAYS},
+    {"loop_unroll", []() -> llvm::Pass* { return llvm::createLoopUnrollPass(); }, ALWAYS},
+    {"loop_reroll", []() -> llvm::Pass* { return llvm::createLoopRerollPass(); }, ALWAYS},
+    {"gvn", []() -> llvm::Pass* { return llvm::createGVNPass(); }, ALWAYS},
+    {"memcpyopt", []() -> llvm::Pass* { return llvm::createMemCpyOptPass(); }, ALWAYS},
+    {"sccp", []() -> llvm::Pass* { return llvm::createSCCPPass(); }, ALWAYS},
+    {"dse", []() -> llvm::Pass* { return llvm::createDeadStoreEliminationPass(); }, ALWAYS},
+    {"adce", []() -> llvm::Pass* { return llvm::createAggressiveDCEPass(); }, ALWAYS},
+    {"loop_vectorize", []() -> llvm::Pass* { return llvm::createLoopVectorizePass(); }, VECTORIZE},
+    {"slp_vectorize", []() -> llvm::Pass* { return llvm::createSLPVectorizerPass(); }, VECTORIZE},
+};
+
+static const PassInfo* findPass(const std::string &name) {
+    for (const PassInfo &info : all_passes) {
+        if (name == info.name)
+            return &info;
+    }
+    return NULL;
+}
+
+// The MAXIMAL one is what we've always run; the llvm part of it is copied + slightly modified from
+// llvm/lib/Transforms/IPO/PassManagerBuilder.cpp::populateModulePassManager.  The box_sinking and stack_allocs
+// passes have to go before the inliner, which turns the runtime calls they look for into allocations.
+// The vectorizers go where populateModulePassManager puts them, after the loops have been cleaned up.
+static const char* default_pipelines[] = {
+    // INTERPRETED (only matters for the llvm interpreter):
+    "",
+    // MINIMAL:
+    "simplifycfg",
+    // MODERATE (inlining the stdlib fast paths is cheap, and most of what lets the rest of it do anything):
+    "inline,early_cse,simplifycfg,instcombine,simplifycfg",
+    // MAXIMAL:
+    "box_sinking,stack_allocs,inline,simplifycfg,"
+    "basicaa,tbaa,escape_analysis,pyston_aa,mallocs_nonnull,gvn,const_classes,"
+    "early_cse,jump_threading,cvp,simplifycfg,instcombine,"
+    "tailcallelim,simplifycfg,reassociate,loop_rotate,licm,loop_unswitch,instcombine,"
+    "indvars,loop_idiom,loop_deletion,loop_unroll,"
+    "gvn,memcpyopt,sccp,instcombine,jump_threading,cvp,dse,loop_reroll,"
+    "adce,simplifycfg,instcombine,loop_vectorize,instcombine,slp_vectorize,instcombine,simplifycfg,"
+    "const_classes,instcombine,simplifycfg,const_classes,dead_allocs",
+};
+
+static const int NUM_PASSES = sizeof(all_passes) / sizeof(all_passes[0]);
+
+static std::vector<const PassInfo*> pipelines[EffortLevel::MAXIMAL + 1];
+// Indexed the same way as all_passes:
+static StatCounter* pass_counters[NUM_PASSES];
+
+static bool parsePassList(const std::string &s, std::vector<const PassInfo*> *rtn) {
+    rtn->clear();
+    if (s.empty())
+        return true;
+
+    std::istringstream ss(s);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        const PassInfo* info = findPass(name);
+        if (!info) {
+            fprintf(stderr, "Error: unknown optimization pass '%s'\n", name.c_str());
+            return false;
+        }
+        rtn->push_back(info);
+    }
+    return true;
+}
+
+// The compile threads can get here too, so only set things up once:
+static std::once_flag pipelines_initialized;
+static void initPipelines() {
+    std::call_once(pipelines_initialized, []() {
+        for (int i = 0; i <= EffortLevel::MAXIMAL; i++) {
+            bool ok = parsePassList(default_pipelines[i], &pipelines[i]);
+            RELEASE_ASSERT(ok, "");
+        }
+        for (int i = 0; i < NUM_PASSES; i++)
+            pass_counters[i] = new StatCounter(std::string("us_compiling_pass_") + all_passes[i].name);
+    });
+}
+
+bool parsePassPipelineSetting(const std::string &s) {
+    initPipelines();
+
+    size_t eq = s.find('=');
+    EffortLevel::EffortLevel effort;
+    if (eq == std::string::npos || !parseEffortLevel(s.substr(0, eq), &effort)) {
+        fprintf(stderr, "Error: pass pipelines are given as <effort level>=<passes>, not '%s'\n", s.c_str());
+        return false;
+    }
+    return parsePassList(s.substr(eq + 1), &pipelines[effort]);
+}
+
+static bool isEnabled(const PassInfo* info) {
+    switch (info->gate) {
+        case ALWAYS:
+            return true;
+        case PYSTON_PASS:
+            return ENABLE_PYSTON_PASSES;
+        case INLINING:
+            return ENABLE_INLINING;
+        case VECTORIZE:
+            return ENABLE_VECTORIZATION;
+    }
+    abort();
+}
+
+bool hasPassPipeline(EffortLevel::EffortLevel effort) {
+    initPipelines();
+    for (const PassInfo* info : pipelines[effort]) {
+        if (isEnabled(info))
+            return true;
+    }
+    return false;
+}
+
+// Shared by all the markers in one pass manager:
+struct PassTimes {
+    timeval last;
+    long last_trace_us;
+};
+
+static long usSince(PassTimes &times) {
+    timeval now;
+    gettimeofday(&now, NULL);
+    long us = 1000000L * (now.tv_sec - times.last.tv_sec) + (now.tv_usec - times.last.tv_usec);
+    times.last = now;
+    return us;
+}
+
+static void tracePass(PassTimes &times, const char* pass_name, llvm::Function &F) {
+    if (!TRACING)
+        return;
+
+    // The first marker just starts the clock:
+    if (pass_name) {
+        TraceArgs args;
+        addTraceArg(args, "function", F.getName().str());
+        traceComplete("llvm_pass", pass_name, times.last_trace_us, args);
+    }
+    times.last_trace_us = traceNow();
+}
+
+// Loop passes that are next to each other get run together, one loop at a time, by a single loop pass manager,
+// so the markers after them have to be loop passes too, or they'd split that up.
+class FunctionTimingMarker : public llvm::FunctionPass {
+    private:
+        std::shared_ptr<PassTimes> times;
+        // Both NULL for the marker at the start of the pipeline, which only resets the clock.
+        StatCounter* counter;
+        const char* pass_name;
+
+    public:
+        static char ID;
+        FunctionTimingMarker(std::shared_ptr<PassTimes> times, StatCounter* counter, const char* pass_name) : llvm::FunctionPass(ID), times(times), counter(counter), pass_name(pass_name) {}
+
+        virtual const char* getPassName() const {
+            return "Pyston pass timing marker";
+        }
+
+        virtual void getAnalysisUsage(llvm::AnalysisUsage &info) const {
+            info.setPreservesAll();
+        }
+
+        virtual bool runOnFunction(llvm::Function &F) {
+            long us = usSince(*times);
+            if (counter)
+                counter->log(us);
+            tracePass(*times, pass_name, F);
+            return false;
+        }
+};
+char FunctionTimingMarker::ID = 0;
+
+class LoopTimingMarker : public llvm::LoopPass {
+    private:
+        std::shared_ptr<PassTimes> times;
+        StatCounter* counter;
+        const char* pass_name;
+
+    public:
+        static char ID;
+        LoopTimingMarker(std::shared_ptr<PassTimes> times, StatCounter* counter, const char* pass_name) : llvm::LoopPass(ID), times(times), counter(counter), pass_name(pass_name) {}
+
+        virtual const char* getPassName() const {
+            return "Pyston loop pass timing marker";
+        }
+
+        virtual void getAnalysisUsage(llvm::AnalysisUsage &info) const {
+            info.setPreservesAll();
+        }
+
+        virtual bool runOnLoop(llvm::Loop *L, llvm::LPPassManager &LPM) {
+            counter->log(usSince(*times));
+            tracePass(*times, pass_name, *L->getHeader()->getParent());
+            return false;
+        }
+};
+char LoopTimingMarker::ID = 0;
+
+void addPassPipeline(llvm::FunctionPassManager &fpm, EffortLevel::EffortLevel effort) {
+    initPipelines();
+
+    std::shared_ptr<PassTimes> times(new PassTimes());
+    fpm.add(new FunctionTimingMarker(times, NULL, NULL));
+
+    for (const PassInfo* info : pipelines[effort]) {
+        if (!isEnabled(info))
+            continue;
+
+        llvm::Pass* pass = info->create();
+        llvm::PassKind kind = pass->getPassKind();
+        fpm.add(pass);
+
+        // Immutable passes (the alias analyses) don't run on the function, so there's nothing to time.
+        if (kind == llvm::PT_ImmutablePass)
+            continue;
+
+        StatCounter* counter = pass_counters[info - all_passes];
+        if (kind == llvm::PT_Loop)
+            fpm.add(new LoopTimingMarker(times, counter, info->name));
+        else
+            fpm.add(new FunctionTimingMarker(times, counter, info->name));
+    }
+}
+
+}
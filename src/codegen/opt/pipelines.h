@@ -0,0 +1,45 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CODEGEN_OPT_PIPELINES_H
+#define PYSTON_CODEGEN_OPT_PIPELINES_H
+
+#include <string>
+
+#include "core/types.h"
+
+namespace llvm {
+class FunctionPassManager;
+}
+
+namespace pyston {
+
+// The llvm passes that get run on a function depend on its effort level.  Each level's pipeline is a
+// comma-separated list of pass names (ex "early_cse,instcombine,simplifycfg"); the pyston passes and the inliner
+// get skipped if they've been turned off with ENABLE_PYSTON_PASSES / ENABLE_INLINING.
+
+// Parses "<effort>=<passes>", ex "moderate=early_cse,instcombine".  An empty list turns off optimization at
+// that level.  Returns false (after printing an error) if it couldn't be parsed.
+bool parsePassPipelineSetting(const std::string &s);
+
+bool hasPassPipeline(EffortLevel::EffortLevel effort);
+
+// Adds the effort level's passes to fpm.  Each one gets followed by a marker pass that adds the time since
+// the previous marker to the us_compiling_pass_<name> stat, so the time for any analyses that a pass
+// needed gets counted towards it.
+void addPassPipeline(llvm::FunctionPassManager &fpm, EffortLevel::EffortLevel effort);
+
+}
+
+#endif
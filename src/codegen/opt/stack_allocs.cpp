@@ -0,0 +1,138 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unordered_set>
+#include <vector>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/InstIterator.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "core/common.h"
+#include "core/options.h"
+#include "core/stats.h"
+
+#include "codegen/codegen.h"
+#include "codegen/irgen/util.h"
+#include "codegen/opt/passes.h"
+
+#include "runtime/types.h"
+
+using namespace llvm;
+
+namespace pyston {
+
+// Puts tuples that never leave the frame on the native stack instead of the gc heap.  Like
+// box_sinking, this looks at the createTuple calls before the stdlib gets inlined.
+//
+// The tuple only counts as not escaping if all it ever gets used for is loads (and pointer
+// comparisons); passing it to anything, including the runtime, is an escape.  Without phis, a
+// later execution of the createTuple can't overlap with the previous one being used, so each
+// site only needs one slot.
+//
+// The slot goes in the entry block, so the gc_roots pass will tell the collector to scan it
+// conservatively at every call, which keeps the elements alive.  The collector never has to
+// know about the tuple itself, since nothing outside the frame can point to it.
+class StackAllocsPass : public FunctionPass {
+    private:
+        static const int MAX_STACK_TUPLE_SIZE = 16;
+
+        static bool escapes(Instruction* ptr) {
+            std::vector<Instruction*> queue;
+            std::unordered_set<Instruction*> checked;
+            queue.push_back(ptr);
+
+            while (queue.size()) {
+                Instruction* next = queue.back();
+                queue.pop_back();
+
+                if (!checked.insert(next).second)
+                    continue;
+
+                for (Value::use_iterator use_it = next->use_begin(), use_end = next->use_end(); use_it != use_end; ++use_it) {
+                    Instruction* user = cast<Instruction>(*use_it);
+                    if (isa<BitCastInst>(user) || isa<GetElementPtrInst>(user)) {
+                        queue.push_back(user);
+                        continue;
+                    }
+
+                    if (isa<LoadInst>(user) || isa<ICmpInst>(user))
+                        continue;
+
+                    if (VERBOSITY("opt") >= 2) errs() << "Escapes here: " << *user << '\n';
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    public:
+        static char ID;
+        StackAllocsPass() : FunctionPass(ID) {}
+
+        virtual void getAnalysisUsage(AnalysisUsage &info) const {
+            info.setPreservesCFG();
+        }
+
+        virtual bool runOnFunction(Function &F) {
+            StatCounter sc_stack_tuples("opt_stack_tuples");
+
+            std::vector<CallInst*> to_replace;
+            for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+                CallInst* ci = dyn_cast<CallInst>(&*I);
+                if (!ci || ci->getCalledValue() != g.funcs.createTuple)
+                    continue;
+
+                ConstantInt* nelts = dyn_cast<ConstantInt>(ci->getArgOperand(0));
+                if (!nelts || nelts->getSExtValue() > MAX_STACK_TUPLE_SIZE)
+                    continue;
+
+                if (escapes(ci))
+                    continue;
+
+                to_replace.push_back(ci);
+            }
+
+            BasicBlock &entry = F.getEntryBlock();
+            for (CallInst* ci : to_replace) {
+                if (VERBOSITY("opt") >= 1) errs() << "Moving to the stack: " << *ci << '\n';
+
+                int64_t nelts = cast<ConstantInt>(ci->getArgOperand(0))->getSExtValue();
+                int nwords = (sizeof(BoxedTuple) + nelts * sizeof(Box*) + sizeof(int64_t) - 1) / sizeof(int64_t);
+                AllocaInst* slot = new AllocaInst(ArrayType::get(g.i64, nwords), "stack_tuple", entry.getFirstInsertionPt());
+
+                Value* args[] = {new BitCastInst(slot, g.i8_ptr, "", ci), ci->getArgOperand(0), ci->getArgOperand(1)};
+                CallInst* init = CallInst::Create(g.funcs.createTupleInPlace, args, "", ci);
+                init->setDebugLoc(ci->getDebugLoc());
+                init->takeName(ci);
+                ci->replaceAllUsesWith(init);
+                ci->eraseFromParent();
+
+                sc_stack_tuples.log();
+            }
+
+            return !to_replace.empty();
+        }
+};
+char StackAllocsPass::ID = 0;
+
+FunctionPass* createStackAllocsPass() {
+    return new StackAllocsPass();
+}
+
+}
+
+static RegisterPass<pyston::StackAllocsPass> X("stack_allocs", "Move non-escaping tuples to the stack", true, false);
@@ -13,11 +13,17 @@
 // limitations under the License.
 
 #include <cassert>
-#include <stdint.h>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
 
 #include "core/options.h"
 #include "core/stats.h"
@@ -26,759 +32,849 @@
 #include "core/ast.h"
 #include "core/util.h"
 
-//#undef VERBOSITY
-//#define VERBOSITY(x) 2
+#include "codegen/compile_cache.h"
+#include "codegen/native_parser.h"
 
 namespace pyston {
 
-class BufferedReader {
+// The parse cache is a flat image of the AST, which gets mmapped and decoded in one pass.  It gets stored in the
+// compile cache under the hash of the source, or if that's off, as "foo.pyc" next to "foo.py".
+//
+//   a CacheHeader, which includes the hash of the source it came from
+//   the string table: every distinct string once, as a u32 length and the bytes (padded to 4 bytes)
+//   the node records: fixed-size CacheRecords, whose fields refer to other records, strings, and lists by index
+//   the list words: each list is a count followed by that many indices
+//
+// Record 0 means NULL and list 0 is the empty list.  Everything is in native byte order and there are
+// no pointers, so it doesn't matter where the file gets mapped.
+
+#define CACHE_MAGIC "PYAC"
+// Bump this whenever the format or the AST node types change:
+#define CACHE_VERSION 4
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    char source_key[32];
+    uint32_t num_strings, strings_bytes;
+    uint32_t num_records, num_list_words;
+};
+
+struct CacheRecord {
+    uint8_t type;
+    // The ctx_type, op_type, num_type, or nl, depending on the node type:
+    uint8_t flag;
+    uint16_t unused;
+    uint32_t lineno, col_offset;
+    uint32_t fields[5];
+};
+static_assert(sizeof(CacheRecord) == 32, "");
+
+class CacheWriter {
     private:
-        static const int BUFSIZE = 1024;
-        char buf[BUFSIZE];
-        int start, end;
-        FILE *fp;
-
-        void ensure(int num) {
-            if (end - start < num) {
-                fill();
-            }
+        std::vector<CacheRecord> records;
+        std::vector<uint32_t> lists;
+        std::vector<char> string_data;
+        std::unordered_map<std::string, uint32_t> string_ids;
+
+        uint32_t addString(const std::string &s) {
+            auto it = string_ids.find(s);
+            if (it != string_ids.end())
+                return it->second;
+
+            uint32_t id = string_ids.size();
+            string_ids[s] = id;
+
+            uint32_t len = s.size();
+            string_data.insert(string_data.end(), (char*)&len, (char*)&len + sizeof(len));
+            string_data.insert(string_data.end(), s.begin(), s.end());
+            while (string_data.size() % 4)
+                string_data.push_back(0);
+            return id;
         }
 
-    public:
-        void fill() {
-            memmove(buf, buf+start, end-start);
-            end -= start;
-            start = 0;
-            end += fread(buf + end, 1, BUFSIZE - end, fp);
-            if (VERBOSITY("parsing") >= 2)
-                printf("filled, now at %d-%d\n", start, end);
+        uint32_t addList(const std::vector<uint32_t> &ids) {
+            if (ids.empty())
+                return 0;
+            uint32_t rtn = lists.size();
+            lists.push_back(ids.size());
+            lists.insert(lists.end(), ids.begin(), ids.end());
+            return rtn;
         }
 
-        BufferedReader(FILE* fp) : start(0), end(0), fp(fp) {
+        template <class T>
+        uint32_t addNodeList(const std::vector<T*> &nodes) {
+            std::vector<uint32_t> ids;
+            for (T* node : nodes)
+                ids.push_back(addNode(node));
+            return addList(ids);
         }
 
-        int bytesBuffered() {
-            return (end - start);
+        uint32_t addStringList(const std::vector<std::string> &strs) {
+            std::vector<uint32_t> ids;
+            for (const std::string &s : strs)
+                ids.push_back(addString(s));
+            return addList(ids);
         }
 
-        uint8_t readByte() {
-            ensure(1);
-            assert(end > start);
-            if (VERBOSITY("parsing") >= 2)
-                printf("readByte, now %d %d\n", start+1, end);
-            return buf[start++];
-        }
-        uint16_t readShort() {
-            return (readByte() << 8) | (readByte());
-        }
-        uint32_t readUInt() {
-            return (readShort() << 16) | (readShort());
+        // Nodes get added in pre-order, so children always come after their parent.
+        uint32_t addNode(AST* node) {
+            if (node == NULL)
+                return 0;
+
+            uint32_t idx = records.size();
+            records.push_back(CacheRecord());
+
+            // Adding the children can move the records around, so fill this in separately:
+            CacheRecord r;
+            memset(&r, 0, sizeof(r));
+            r.type = node->type;
+            r.lineno = node->lineno;
+            r.col_offset = node->col_offset;
+            uint32_t *f = r.fields;
+
+            switch (node->type) {
+                case AST_TYPE::alias: {
+                    AST_alias *n = static_cast<AST_alias*>(node);
+                    f[0] = addString(n->name);
+                    f[1] = addString(n->asname);
+                    break;
+                }
+                case AST_TYPE::arguments: {
+                    AST_arguments *n = static_cast<AST_arguments*>(node);
+                    f[0] = addNodeList(n->args);
+                    f[1] = addNodeList(n->defaults);
+                    f[2] = addNode(n->kwarg);
+                    f[3] = addString(n->vararg);
+                    break;
+                }
+                case AST_TYPE::Assign: {
+                    AST_Assign *n = static_cast<AST_Assign*>(node);
+                    f[0] = addNodeList(n->targets);
+                    f[1] = addNode(n->value);
+                    break;
+                }
+                case AST_TYPE::Attribute: {
+                    AST_Attribute *n = static_cast<AST_Attribute*>(node);
+                    r.flag = n->ctx_type;
+                    f[0] = addNode(n->value);
+                    f[1] = addString(n->attr);
+                    break;
+                }
+                case AST_TYPE::BinOp: {
+                    AST_BinOp *n = static_cast<AST_BinOp*>(node);
+                    r.flag = n->op_type;
+                    f[0] = addNode(n->left);
+                    f[1] = addNode(n->right);
+                    break;
+                }
+                case AST_TYPE::BoolOp: {
+                    AST_BoolOp *n = static_cast<AST_BoolOp*>(node);
+                    r.flag = n->op_type;
+                    f[0] = addNodeList(n->values);
+                    break;
+                }
+                case AST_TYPE::Break:
+                case AST_TYPE::Continue:
+                case AST_TYPE::Pass:
+                    break;
+                case AST_TYPE::Call: {
+                    AST_Call *n = static_cast<AST_Call*>(node);
+                    f[0] = addNode(n->func);
+                    f[1] = addNodeList(n->args);
+                    f[2] = addNodeList(n->keywords);
+                    f[3] = addNode(n->starargs);
+                    f[4] = addNode(n->kwargs);
+                    break;
+                }
+                case AST_TYPE::Compare: {
+                    AST_Compare *n = static_cast<AST_Compare*>(node);
+                    f[0] = addNode(n->left);
+                    f[1] = addNodeList(n->comparators);
+                    f[2] = addList(std::vector<uint32_t>(n->ops.begin(), n->ops.end()));
+                    break;
+                }
+                case AST_TYPE::ClassDef: {
+                    AST_ClassDef *n = static_cast<AST_ClassDef*>(node);
+                    f[0] = addString(n->name);
+                    f[1] = addNodeList(n->bases);
+                    f[2] = addNodeList(n->body);
+                    f[3] = addNodeList(n->decorator_list);
+                    break;
+                }
+                case AST_TYPE::Dict: {
+                    AST_Dict *n = static_cast<AST_Dict*>(node);
+                    f[0] = addNodeList(n->keys);
+                    f[1] = addNodeList(n->values);
+                    break;
+                }
+                case AST_TYPE::ExceptHandler: {
+                    AST_ExceptHandler *n = static_cast<AST_ExceptHandler*>(node);
+                    f[0] = addNode(n->type);
+                    f[1] = addNode(n->name);
+                    f[2] = addNodeList(n->body);
+                    break;
+                }
+                case AST_TYPE::Expr: {
+                    AST_Expr *n = static_cast<AST_Expr*>(node);
+                    f[0] = addNode(n->value);
+                    break;
+                }
+                case AST_TYPE::For: {
+                    AST_For *n = static_cast<AST_For*>(node);
+                    f[0] = addNode(n->target);
+                    f[1] = addNode(n->iter);
+                    f[2] = addNodeList(n->body);
+                    f[3] = addNodeList(n->orelse);
+                    break;
+                }
+                case AST_TYPE::FunctionDef: {
+                    AST_FunctionDef *n = static_cast<AST_FunctionDef*>(node);
+                    f[0] = addString(n->name);
+                    f[1] = addNode(n->args);
+                    f[2] = addNodeList(n->body);
+                    f[3] = addNodeList(n->decorator_list);
+                    break;
+                }
+                case AST_TYPE::Global: {
+                    AST_Global *n = static_cast<AST_Global*>(node);
+                    f[0] = addStringList(n->names);
+                    break;
+                }
+                case AST_TYPE::If: {
+                    AST_If *n = static_cast<AST_If*>(node);
+                    f[0] = addNode(n->test);
+                    f[1] = addNodeList(n->body);
+                    f[2] = addNodeList(n->orelse);
+                    break;
+                }
+                case AST_TYPE::Import: {
+                    AST_Import *n = static_cast<AST_Import*>(node);
+                    f[0] = addNodeList(n->names);
+                    break;
+                }
+                case AST_TYPE::Index: {
+                    AST_Index *n = static_cast<AST_Index*>(node);
+                    f[0] = addNode(n->value);
+                    break;
+                }
+                case AST_TYPE::keyword: {
+                    AST_keyword *n = static_cast<AST_keyword*>(node);
+                    f[0] = addString(n->arg);
+                    f[1] = addNode(n->value);
+                    break;
+                }
+                case AST_TYPE::List: {
+                    AST_List *n = static_cast<AST_List*>(node);
+                    r.flag = n->ctx_type;
+                    f[0] = addNodeList(n->elts);
+                    break;
+                }
+                case AST_TYPE::Module: {
+                    AST_Module *n = static_cast<AST_Module*>(node);
+                    f[0] = addNodeList(n->body);
+                    break;
+                }
+                case AST_TYPE::Name: {
+                    AST_Name *n = static_cast<AST_Name*>(node);
+                    r.flag = n->ctx_type;
+                    f[0] = addString(n->id);
+                    break;
+                }
+                case AST_TYPE::Num: {
+                    AST_Num *n = static_cast<AST_Num*>(node);
+                    r.flag = n->num_type;
+                    static_assert(sizeof(n->n_int) == sizeof(n->n_float), "");
+                    memcpy(&f[0], &n->n_int, sizeof(n->n_int));
+                    break;
+                }
+                case AST_TYPE::Print: {
+                    AST_Print *n = static_cast<AST_Print*>(node);
+                    r.flag = n->nl;
+                    f[0] = addNode(n->dest);
+                    f[1] = addNodeList(n->values);
+                    break;
+                }
+                case AST_TYPE::Raise: {
+                    AST_Raise *n = static_cast<AST_Raise*>(node);
+                    f[0] = addNode(n->type);
+                    f[1] = addNode(n->inst);
+                    f[2] = addNode(n->tback);
+                    break;
+                }
+                case AST_TYPE::Return: {
+                    AST_Return *n = static_cast<AST_Return*>(node);
+                    f[0] = addNode(n->value);
+                    break;
+                }
+                case AST_TYPE::Slice: {
+                    AST_Slice *n = static_cast<AST_Slice*>(node);
+                    f[0] = addNode(n->lower);
+                    f[1] = addNode(n->upper);
+                    f[2] = addNode(n->step);
+                    break;
+                }
+                case AST_TYPE::Str: {
+                    AST_Str *n = static_cast<AST_Str*>(node);
+                    f[0] = addString(n->s);
+                    break;
+                }
+                case AST_TYPE::Subscript: {
+                    AST_Subscript *n = static_cast<AST_Subscript*>(node);
+                    r.flag = n->ctx_type;
+                    f[0] = addNode(n->value);
+                    f[1] = addNode(n->slice);
+                    break;
+                }
+                case AST_TYPE::TryExcept: {
+                    AST_TryExcept *n = static_cast<AST_TryExcept*>(node);
+                    f[0] = addNodeList(n->body);
+                    f[1] = addNodeList(n->handlers);
+                    f[2] = addNodeList(n->orelse);
+                    break;
+                }
+                case AST_TYPE::TryFinally: {
+                    AST_TryFinally *n = static_cast<AST_TryFinally*>(node);
+                    f[0] = addNodeList(n->body);
+                    f[1] = addNodeList(n->finalbody);
+                    break;
+                }
+                case AST_TYPE::Tuple: {
+                    AST_Tuple *n = static_cast<AST_Tuple*>(node);
+                    r.flag = n->ctx_type;
+                    f[0] = addNodeList(n->elts);
+                    break;
+                }
+                case AST_TYPE::UnaryOp: {
+                    AST_UnaryOp *n = static_cast<AST_UnaryOp*>(node);
+                    r.flag = n->op_type;
+                    f[0] = addNode(n->operand);
+                    break;
+                }
+                case AST_TYPE::While: {
+                    AST_While *n = static_cast<AST_While*>(node);
+                    f[0] = addNode(n->test);
+                    f[1] = addNodeList(n->body);
+                    f[2] = addNodeList(n->orelse);
+                    break;
+                }
+                case AST_TYPE::With: {
+                    AST_With *n = static_cast<AST_With*>(node);
+                    f[0] = addNode(n->context_expr);
+                    f[1] = addNode(n->optional_vars);
+                    f[2] = addNodeList(n->body);
+                    break;
+                }
+                default:
+                    RELEASE_ASSERT(0, "%d", node->type);
+            }
+
+            records[idx] = r;
+            return idx;
         }
-        uint64_t readULL() {
-            return ((uint64_t)readUInt() << 32) | (readUInt());
+
+    public:
+        CacheWriter() {
+            records.push_back(CacheRecord());
+            memset(&records[0], 0, sizeof(CacheRecord));
+            lists.push_back(0);
         }
-        double readDouble() {
-            union {
-                uint64_t raw;
-                double d;
-            };
-            raw = readULL();
-            return d;
+
+        std::string write(AST_Module *m, const std::string &source_key) {
+            uint32_t root = addNode(m);
+            assert(root == 1);
+
+            CacheHeader header;
+            memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+            header.version = CACHE_VERSION;
+            assert(source_key.size() == sizeof(header.source_key));
+            memcpy(header.source_key, source_key.data(), sizeof(header.source_key));
+            header.num_strings = string_ids.size();
+            header.strings_bytes = string_data.size();
+            header.num_records = records.size();
+            header.num_list_words = lists.size();
+
+            std::string rtn;
+            rtn.reserve(sizeof(header) + string_data.size() + records.size() * sizeof(CacheRecord) + lists.size() * sizeof(uint32_t));
+            rtn.append((const char*)&header, sizeof(header));
+            rtn.append(string_data.begin(), string_data.end());
+            rtn.append((const char*)&records[0], records.size() * sizeof(CacheRecord));
+            rtn.append((const char*)&lists[0], lists.size() * sizeof(uint32_t));
+            return rtn;
         }
 };
 
-AST* readASTMisc(BufferedReader *reader);
-AST_expr* readASTExpr(BufferedReader *reader);
-AST_stmt* readASTStmt(BufferedReader *reader);
-
-static std::string readString(BufferedReader *reader) {
-    int strlen = reader->readShort();
-    std::vector<char> chars;
-    for (int i = 0; i < strlen; i++) {
-        chars.push_back(reader->readByte());
-    }
-    return std::string(chars.begin(), chars.end());
-}
-
-static void readStringVector(std::vector<std::string> &vec, BufferedReader *reader) {
-    int num_elts = reader->readShort();
-    if (VERBOSITY("parsing") >= 2)
-        printf("%d elts to read\n", num_elts);
-    for (int i = 0; i < num_elts; i++) {
-        vec.push_back(readString(reader));
-    }
-}
-
-static void readStmtVector(std::vector<AST_stmt*> &vec, BufferedReader *reader) {
-    int num_elts = reader->readShort();
-    if (VERBOSITY("parsing") >= 2)
-        printf("%d elts to read\n", num_elts);
-    for (int i = 0; i < num_elts; i++) {
-        vec.push_back(readASTStmt(reader));
-    }
-}
-
-static void readExprVector(std::vector<AST_expr*> &vec, BufferedReader *reader) {
-    int num_elts = reader->readShort();
-    if (VERBOSITY("parsing") >= 2)
-        printf("%d elts to read\n", num_elts);
-    for (int i = 0; i < num_elts; i++) {
-        vec.push_back(readASTExpr(reader));
-    }
-}
-
-static void readMiscVector(std::vector<AST*> &vec, BufferedReader *reader) {
-    int num_elts = reader->readShort();
-    if (VERBOSITY("parsing") >= 2)
-        printf("%d elts to read\n", num_elts);
-    for (int i = 0; i < num_elts; i++) {
-        vec.push_back(readASTMisc(reader));
-    }
-}
-
-static int readColOffset(BufferedReader *reader) {
-    int rtn = reader->readULL();
-    // offsets out of this range are almost certainly parse bugs:
-    ASSERT(rtn >= 0 && rtn < 100000, "%d", rtn);
-    return rtn;
-}
-
-AST_alias* read_alias(BufferedReader *reader) {
-    AST_alias *rtn = new AST_alias();
-
-    rtn->asname = readString(reader);
-    rtn->col_offset = -1;
-    rtn->lineno = -1;
-    rtn->name = readString(reader);
-
-    return rtn;
-}
-
-AST_arguments* read_arguments(BufferedReader *reader) {
-    if (VERBOSITY("parsing") >= 2)
-        printf("reading arguments\n");
-    AST_arguments *rtn = new AST_arguments();
-
-    readExprVector(rtn->args, reader);
-    rtn->col_offset = -1;
-    readExprVector(rtn->defaults, reader);
-    rtn->kwarg = readASTExpr(reader);
-    rtn->lineno = -1;
-    //rtn->vararg = readASTExpr(reader);
-    rtn->vararg = readString(reader);
-    return rtn;
-}
-
-AST_Assign* read_assign(BufferedReader *reader) {
-    AST_Assign *rtn = new AST_Assign();
-
-    rtn->col_offset = readColOffset(reader);
-    rtn->lineno = reader->readULL();
-    readExprVector(rtn->targets, reader);
-    rtn->value = readASTExpr(reader);
-    return rtn;
-}
-
-AST_Attribute* read_attribute(BufferedReader *reader) {
-    AST_Attribute *rtn = new AST_Attribute();
-
-    rtn->attr = readString(reader);
-    rtn->col_offset = readColOffset(reader);
-    rtn->ctx_type = (AST_TYPE::AST_TYPE)reader->readByte();
-    rtn->lineno = reader->readULL();
-    rtn->value = readASTExpr(reader);
-    return rtn;
-}
-
-AST_expr* read_binop(BufferedReader *reader) {
-    AST_BinOp *rtn = new AST_BinOp();
-
-    rtn->col_offset = readColOffset(reader);
-    rtn->left = readASTExpr(reader);
-    rtn->lineno = reader->readULL();
-    rtn->op_type = (AST_TYPE::AST_TYPE)reader->readByte();
-    rtn->right = readASTExpr(reader);
-
-    return rtn;
-}
-
-AST_expr* read_boolop(BufferedReader *reader) {
-    AST_BoolOp *rtn = new AST_BoolOp();
-
-    rtn->col_offset = readColOffset(reader);
-    rtn->lineno = reader->readULL();
-    rtn->op_type = (AST_TYPE::AST_TYPE)reader->readByte();
-    readExprVector(rtn->values, reader);
-
-    return rtn;
-}
-
-AST_Break* read_break(BufferedReader *reader) {
-    AST_Break *rtn = new AST_Break();
-
-    rtn->col_offset = readColOffset(reader);
-    rtn->lineno = reader->readULL();
-
-    return rtn;
-}
-
-AST_Call* read_call(BufferedReader *reader) {
-    AST_Call *rtn = new AST_Call();
-
-    readExprVector(rtn->args, reader);
-    rtn->col_offset = readColOffset(reader);
-    rtn->func = readASTExpr(reader);
-
-    std::vector<AST*> keyword_vec;
-    readMiscVector(keyword_vec, reader);
-    for (int i = 0; i < keyword_vec.size(); i++) {
-        assert(keyword_vec[i]->type == AST_TYPE::keyword);
-        rtn->keywords.push_back(static_cast<AST_keyword*>(keyword_vec[i]));
-    }
-
-    rtn->kwargs = readASTExpr(reader);
-    rtn->lineno = reader->readULL();
-    rtn->starargs = readASTExpr(reader);
-    return rtn;
-}
-
-AST_expr* read_compare(BufferedReader *reader) {
-    AST_Compare *rtn = new AST_Compare();
-
-    rtn->col_offset = readColOffset(reader);
-    readExprVector(rtn->comparators, reader);
-    rtn->left = readASTExpr(reader);
-    rtn->lineno = reader->readULL();
-
-    int num_ops = reader->readShort();
-    assert(num_ops == rtn->comparators.size());
-    for (int i = 0; i < num_ops; i++) {
-        rtn->ops.push_back((AST_TYPE::AST_TYPE)reader->readByte());
-    }
-
-    /*{
-        assert(rtn->ops.size() == 1);
-        AST_Attribute *func = new AST_Attribute();
-        func->type = AST_TYPE::Attribute;
-        func->attr = getOpName(rtn->ops[0]);
-        func->col_offset = rtn->col_offset;
-        func->ctx_type = AST_TYPE::Load;
-        func->lineno = rtn->lineno;
-        func->value = rtn->left;
-
-        AST_Call *call = new AST_Call();
-        call->type = AST_TYPE::Call;
-        call->args.push_back(rtn->comparators[0]);
-        call->col_offset = rtn->col_offset;
-        call->func = func;
-        call->kwargs = NULL;
-        call->lineno = rtn->lineno;
-        call->starargs = NULL;
-        return call;
-    }*/
-
-    return rtn;
-}
-
-AST_ClassDef* read_classdef(BufferedReader *reader) {
-    AST_ClassDef *rtn = new AST_ClassDef();
-
-    readExprVector(rtn->bases, reader);
-    readStmtVector(rtn->body, reader);
-    rtn->col_offset = readColOffset(reader);
-    readExprVector(rtn->decorator_list, reader);
-    rtn->lineno = reader->readULL();
-    rtn->name = readString(reader);
-
-    return rtn;
-}
-
-AST_Continue* read_continue(BufferedReader *reader) {
-    AST_Continue *rtn = new AST_Continue();
-
-    rtn->col_offset = readColOffset(reader);
-    rtn->lineno = reader->readULL();
-
-    return rtn;
-}
-
-AST_Dict* read_dict(BufferedReader *reader) {
-    AST_Dict *rtn = new AST_Dict();
-
-    rtn->col_offset = readColOffset(reader);
-    readExprVector(rtn->keys, reader);
-    rtn->lineno = reader->readULL();
-    readExprVector(rtn->values, reader);
-
-    assert(rtn->keys.size() == rtn->values.size());
-    return rtn;
-}
-
-AST_Expr* read_expr(BufferedReader *reader) {
-    AST_Expr *rtn = new AST_Expr();
-
-    rtn->col_offset = readColOffset(reader);
-    rtn->lineno = reader->readULL();
-    rtn->value = readASTExpr(reader);
-    return rtn;
-}
-
-AST_For* read_for(BufferedReader *reader) {
-    AST_For *rtn = new AST_For();
-
-    readStmtVector(rtn->body, reader);
-    rtn->col_offset = readColOffset(reader);
-    rtn->iter = readASTExpr(reader);
-    rtn->lineno = reader->readULL();
-    readStmtVector(rtn->orelse, reader);
-    rtn->target = readASTExpr(reader);
-    return rtn;
-}
-
-AST_FunctionDef* read_functiondef(BufferedReader *reader) {
-    if (VERBOSITY("parsing") >= 2)
-        printf("reading functiondef\n");
-    AST_FunctionDef *rtn = new AST_FunctionDef();
-
-    rtn->args = static_cast<AST_arguments*>(readASTMisc(reader));
-    readStmtVector(rtn->body, reader);
-    rtn->col_offset = readColOffset(reader);
-    readExprVector(rtn->decorator_list, reader);
-    rtn->lineno = reader->readULL();
-    rtn->name = readString(reader);
-    return rtn;
-}
-
-AST_Global* read_global(BufferedReader *reader) {
-    AST_Global *rtn = new AST_Global();
-
-    rtn->col_offset = readColOffset(reader);
-    rtn->lineno = reader->readULL();
-    readStringVector(rtn->names, reader);
-    return rtn;
-}
-
-AST_If* read_if(BufferedReader *reader) {
-    AST_If *rtn = new AST_If();
-
-    readStmtVector(rtn->body, reader);
-    rtn->col_offset = readColOffset(reader);
-    rtn->lineno = reader->readULL();
-    readStmtVector(rtn->orelse, reader);
-    rtn->test = readASTExpr(reader);
-    return rtn;
-}
-
-AST_Import* read_import(BufferedReader *reader) {
-    AST_Import *rtn = new AST_Import();
-
-    rtn->col_offset = readColOffset(reader);
-    rtn->lineno = reader->readULL();
-
-    int num_elts = reader->readShort();
-    for (int i = 0; i < num_elts; i++) {
-        AST* elt = readASTMisc(reader);
-        assert(elt->type == AST_TYPE::alias);
-        rtn->names.push_back(static_cast<AST_alias*>(elt));
-    }
-    return rtn;
-}
-
-AST_Index* read_index(BufferedReader *reader) {
-    AST_Index *rtn = new AST_Index();
-
-    rtn->col_offset = -1;
-    rtn->lineno = -1;
-    rtn->value = readASTExpr(reader);
-    assert(rtn->value);
-    return rtn;
-}
-
-AST_keyword* read_keyword(BufferedReader *reader) {
-    AST_keyword *rtn = new AST_keyword();
+// Turns the mapped records back into AST nodes.  The file could be truncated or corrupted, so every index
+// gets checked; if anything is off, ok gets cleared and we fall back to reparsing the source.
+class CacheReader {
+    private:
+        const CacheRecord *records;
+        uint32_t num_records;
+        const uint32_t *lists;
+        uint32_t num_list_words;
+        std::vector<std::string> strings;
+        bool ok;
+        Arena* arena;
+
+        const std::string& getString(uint32_t idx) {
+            static const std::string empty;
+            if (idx >= strings.size()) {
+                ok = false;
+                return empty;
+            }
+            return strings[idx];
+        }
 
-    rtn->arg = readString(reader);
-    rtn->col_offset = -1;
-    rtn->lineno = -1;
-    rtn->value = readASTExpr(reader);
-    return rtn;
-}
+        const uint32_t* getList(uint32_t idx, uint32_t *count) {
+            if (idx >= num_list_words || lists[idx] > num_list_words - idx - 1) {
+                ok = false;
+                *count = 0;
+                return NULL;
+            }
+            *count = lists[idx];
+            return &lists[idx + 1];
+        }
 
-AST_List* read_list(BufferedReader *reader) {
-    AST_List *rtn = new AST_List();
+        template <class T>
+        void readList(uint32_t idx, uint32_t parent, std::vector<T*> &into) {
+            uint32_t count;
+            const uint32_t *ids = getList(idx, &count);
+            into.reserve(count);
+            for (uint32_t i = 0; i < count; i++)
+                into.push_back(static_cast<T*>(readNode(ids[i], parent)));
+        }
 
-    rtn->col_offset = readColOffset(reader);
-    rtn->ctx_type = (AST_TYPE::AST_TYPE)reader->readByte();
-    readExprVector(rtn->elts, reader);
-    rtn->lineno = reader->readULL();
-    return rtn;
-}
+        void readStringList(uint32_t idx, std::vector<std::string> &into) {
+            uint32_t count;
+            const uint32_t *ids = getList(idx, &count);
+            into.reserve(count);
+            for (uint32_t i = 0; i < count; i++)
+                into.push_back(getString(ids[i]));
+        }
 
-AST_Module* read_module(BufferedReader *reader) {
-    if (VERBOSITY("parsing") >= 2)
-        printf("reading module\n");
-    AST_Module *rtn = new AST_Module();
+        template <class T>
+        T* create(const CacheRecord &r) {
+            T* rtn = arena->make<T>();
+            rtn->lineno = r.lineno;
+            rtn->col_offset = r.col_offset;
+            return rtn;
+        }
 
-    readStmtVector(rtn->body, reader);
-    rtn->col_offset = -1;
-    rtn->lineno = -1;
-    return rtn;
-}
+        // Children always come after their parents, which also rules out cycles.
+        AST* readNode(uint32_t idx, uint32_t parent) {
+            if (idx == 0)
+                return NULL;
+            if (!ok || idx <= parent || idx >= num_records) {
+                ok = false;
+                return NULL;
+            }
 
-AST_Name* read_name(BufferedReader *reader) {
-    AST_Name *rtn = new AST_Name();
+            const CacheRecord &r = records[idx];
+            const uint32_t *f = r.fields;
+            AST_TYPE::AST_TYPE flag = (AST_TYPE::AST_TYPE)r.flag;
+
+            switch (r.type) {
+                case AST_TYPE::alias: {
+                    AST_alias *rtn = create<AST_alias>(r);
+                    rtn->name = getString(f[0]);
+                    rtn->asname = getString(f[1]);
+                    return rtn;
+                }
+                case AST_TYPE::arguments: {
+                    AST_arguments *rtn = create<AST_arguments>(r);
+                    readList(f[0], idx, rtn->args);
+                    readList(f[1], idx, rtn->defaults);
+                    rtn->kwarg = static_cast<AST_expr*>(readNode(f[2], idx));
+                    rtn->vararg = getString(f[3]);
+                    return rtn;
+                }
+                case AST_TYPE::Assign: {
+                    AST_Assign *rtn = create<AST_Assign>(r);
+                    readList(f[0], idx, rtn->targets);
+                    rtn->value = static_cast<AST_expr*>(readNode(f[1], idx));
+                    return rtn;
+                }
+                case AST_TYPE::Attribute: {
+                    AST_Attribute *rtn = create<AST_Attribute>(r);
+                    rtn->ctx_type = flag;
+                    rtn->value = static_cast<AST_expr*>(readNode(f[0], idx));
+                    rtn->attr = getString(f[1]);
+                    return rtn;
+                }
+                case AST_TYPE::BinOp: {
+                    AST_BinOp *rtn = create<AST_BinOp>(r);
+                    rtn->op_type = flag;
+                    rtn->left = static_cast<AST_expr*>(readNode(f[0], idx));
+                    rtn->right = static_cast<AST_expr*>(readNode(f[1], idx));
+                    return rtn;
+                }
+                case AST_TYPE::BoolOp: {
+                    AST_BoolOp *rtn = create<AST_BoolOp>(r);
+                    rtn->op_type = flag;
+                    readList(f[0], idx, rtn->values);
+                    return rtn;
+                }
+                case AST_TYPE::Break:
+                    return create<AST_Break>(r);
+                case AST_TYPE::Continue:
+                    return create<AST_Continue>(r);
+                case AST_TYPE::Pass:
+                    return create<AST_Pass>(r);
+                case AST_TYPE::Call: {
+                    AST_Call *rtn = create<AST_Call>(r);
+                    rtn->func = static_cast<AST_expr*>(readNode(f[0], idx));
+                    readList(f[1], idx, rtn->args);
+                    readList(f[2], idx, rtn->keywords);
+                    rtn->starargs = static_cast<AST_expr*>(readNode(f[3], idx));
+                    rtn->kwargs = static_cast<AST_expr*>(readNode(f[4], idx));
+                    return rtn;
+                }
+                case AST_TYPE::Compare: {
+                    AST_Compare *rtn = create<AST_Compare>(r);
+                    rtn->left = static_cast<AST_expr*>(readNode(f[0], idx));
+                    readList(f[1], idx, rtn->comparators);
+                    uint32_t num_ops;
+                    const uint32_t *ops = getList(f[2], &num_ops);
+                    for (uint32_t i = 0; i < num_ops; i++)
+                        rtn->ops.push_back((AST_TYPE::AST_TYPE)ops[i]);
+                    if (rtn->ops.size() != rtn->comparators.size())
+                        ok = false;
+                    return rtn;
+                }
+                case AST_TYPE::ClassDef: {
+                    AST_ClassDef *rtn = create<AST_ClassDef>(r);
+                    rtn->name = getString(f[0]);
+                    readList(f[1], idx, rtn->bases);
+                    readList(f[2], idx, rtn->body);
+                    readList(f[3], idx, rtn->decorator_list);
+                    return rtn;
+                }
+                case AST_TYPE::Dict: {
+                    AST_Dict *rtn = create<AST_Dict>(r);
+                    readList(f[0], idx, rtn->keys);
+                    readList(f[1], idx, rtn->values);
+                    if (rtn->keys.size() != rtn->values.size())
+                        ok = false;
+                    return rtn;
+                }
+                case AST_TYPE::ExceptHandler: {
+                    AST_ExceptHandler *rtn = create<AST_ExceptHandler>(r);
+                    rtn->type = static_cast<AST_expr*>(readNode(f[0], idx));
+                    rtn->name = static_cast<AST_expr*>(readNode(f[1], idx));
+                    readList(f[2], idx, rtn->body);
+                    return rtn;
+                }
+                case AST_TYPE::Expr: {
+                    AST_Expr *rtn = create<AST_Expr>(r);
+                    rtn->value = static_cast<AST_expr*>(readNode(f[0], idx));
+                    return rtn;
+                }
+                case AST_TYPE::For: {
+                    AST_For *rtn = create<AST_For>(r);
+                    rtn->target = static_cast<AST_expr*>(readNode(f[0], idx));
+                    rtn->iter = static_cast<AST_expr*>(readNode(f[1], idx));
+                    readList(f[2], idx, rtn->body);
+                    readList(f[3], idx, rtn->orelse);
+                    return rtn;
+                }
+                case AST_TYPE::FunctionDef: {
+                    AST_FunctionDef *rtn = create<AST_FunctionDef>(r);
+                    rtn->name = getString(f[0]);
+                    rtn->args = static_cast<AST_arguments*>(readNode(f[1], idx));
+                    readList(f[2], idx, rtn->body);
+                    readList(f[3], idx, rtn->decorator_list);
+                    return rtn;
+                }
+                case AST_TYPE::Global: {
+                    AST_Global *rtn = create<AST_Global>(r);
+                    readStringList(f[0], rtn->names);
+                    return rtn;
+                }
+                case AST_TYPE::If: {
+                    AST_If *rtn = create<AST_If>(r);
+                    rtn->test = static_cast<AST_expr*>(readNode(f[0], idx));
+                    readList(f[1], idx, rtn->body);
+                    readList(f[2], idx, rtn->orelse);
+                    return rtn;
+                }
+                case AST_TYPE::Import: {
+                    AST_Import *rtn = create<AST_Import>(r);
+                    readList(f[0], idx, rtn->names);
+                    return rtn;
+                }
+                case AST_TYPE::Index: {
+                    AST_Index *rtn = create<AST_Index>(r);
+                    rtn->value = static_cast<AST_expr*>(readNode(f[0], idx));
+                    return rtn;
+                }
+                case AST_TYPE::keyword: {
+                    AST_keyword *rtn = create<AST_keyword>(r);
+                    rtn->arg = getString(f[0]);
+                    rtn->value = static_cast<AST_expr*>(readNode(f[1], idx));
+                    return rtn;
+                }
+                case AST_TYPE::List: {
+                    AST_List *rtn = create<AST_List>(r);
+                    rtn->ctx_type = flag;
+                    readList(f[0], idx, rtn->elts);
+                    return rtn;
+                }
+                case AST_TYPE::Module:
+                    // Only the root can be a module:
+                    ok = false;
+                    return NULL;
+                case AST_TYPE::Name: {
+                    AST_Name *rtn = create<AST_Name>(r);
+                    rtn->ctx_type = flag;
+                    rtn->id = getString(f[0]);
+                    return rtn;
+                }
+                case AST_TYPE::Num: {
+                    AST_Num *rtn = create<AST_Num>(r);
+                    rtn->num_type = (AST_Num::NumType)r.flag;
+                    if (rtn->num_type != AST_Num::INT && rtn->num_type != AST_Num::FLOAT)
+                        ok = false;
+                    memcpy(&rtn->n_int, &f[0], sizeof(rtn->n_int));
+                    return rtn;
+                }
+                case AST_TYPE::Print: {
+                    AST_Print *rtn = create<AST_Print>(r);
+                    rtn->nl = r.flag;
+                    rtn->dest = static_cast<AST_expr*>(readNode(f[0], idx));
+                    readList(f[1], idx, rtn->values);
+                    return rtn;
+                }
+                case AST_TYPE::Raise: {
+                    AST_Raise *rtn = create<AST_Raise>(r);
+                    rtn->type = static_cast<AST_expr*>(readNode(f[0], idx));
+                    rtn->inst = static_cast<AST_expr*>(readNode(f[1], idx));
+                    rtn->tback = static_cast<AST_expr*>(readNode(f[2], idx));
+                    return rtn;
+                }
+                case AST_TYPE::Return: {
+                    AST_Return *rtn = create<AST_Return>(r);
+                    rtn->value = static_cast<AST_expr*>(readNode(f[0], idx));
+                    return rtn;
+                }
+                case AST_TYPE::Slice: {
+                    AST_Slice *rtn = create<AST_Slice>(r);
+                    rtn->lower = static_cast<AST_expr*>(readNode(f[0], idx));
+                    rtn->upper = static_cast<AST_expr*>(readNode(f[1], idx));
+                    rtn->step = static_cast<AST_expr*>(readNode(f[2], idx));
+                    return rtn;
+                }
+                case AST_TYPE::Str: {
+                    AST_Str *rtn = create<AST_Str>(r);
+                    rtn->s = getString(f[0]);
+                    return rtn;
+                }
+                case AST_TYPE::Subscript: {
+                    AST_Subscript *rtn = create<AST_Subscript>(r);
+                    rtn->ctx_type = flag;
+                    rtn->value = static_cast<AST_expr*>(readNode(f[0], idx));
+                    rtn->slice = static_cast<AST_expr*>(readNode(f[1], idx));
+                    return rtn;
+                }
+                case AST_TYPE::TryExcept: {
+                    AST_TryExcept *rtn = create<AST_TryExcept>(r);
+                    readList(f[0], idx, rtn->body);
+                    readList(f[1], idx, rtn->handlers);
+                    readList(f[2], idx, rtn->orelse);
+                    return rtn;
+                }
+                case AST_TYPE::TryFinally: {
+                    AST_TryFinally *rtn = create<AST_TryFinally>(r);
+                    readList(f[0], idx, rtn->body);
+                    readList(f[1], idx, rtn->finalbody);
+                    return rtn;
+                }
+                case AST_TYPE::Tuple: {
+                    AST_Tuple *rtn = create<AST_Tuple>(r);
+                    rtn->ctx_type = flag;
+                    readList(f[0], idx, rtn->elts);
+                    return rtn;
+                }
+                case AST_TYPE::UnaryOp: {
+                    AST_UnaryOp *rtn = create<AST_UnaryOp>(r);
+                    rtn->op_type = flag;
+                    rtn->operand = static_cast<AST_expr*>(readNode(f[0], idx));
+                    return rtn;
+                }
+                case AST_TYPE::While: {
+                    AST_While *rtn = create<AST_While>(r);
+                    rtn->test = static_cast<AST_expr*>(readNode(f[0], idx));
+                    readList(f[1], idx, rtn->body);
+                    readList(f[2], idx, rtn->orelse);
+                    return rtn;
+                }
+                case AST_TYPE::With: {
+                    AST_With *rtn = create<AST_With>(r);
+                    rtn->context_expr = static_cast<AST_expr*>(readNode(f[0], idx));
+                    rtn->optional_vars = static_cast<AST_expr*>(readNode(f[1], idx));
+                    readList(f[2], idx, rtn->body);
+                    return rtn;
+                }
+                default:
+                    ok = false;
+                    return NULL;
+            }
+        }
 
-    rtn->col_offset = readColOffset(reader);
-    rtn->ctx_type = (AST_TYPE::AST_TYPE)reader->readByte();
-    rtn->id = readString(reader);
-    rtn->lineno = reader->readULL();
-    return rtn;
-}
+    public:
+        CacheReader() : records(NULL), num_records(0), lists(NULL), num_list_words(0), ok(true), arena(NULL) {
+        }
 
-AST_Num* read_num(BufferedReader *reader) {
-    AST_Num *rtn = new AST_Num();
+        // Returns NULL if the data isn't a valid cache of the source with that key.
+        AST_Module* read(const char* data, size_t size, const std::string &source_key) {
+            const CacheHeader *header = reinterpret_cast<const CacheHeader*>(data);
+            if (size < sizeof(CacheHeader) || memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0
+                    || header->version != CACHE_VERSION
+                    || source_key.compare(0, std::string::npos, header->source_key, sizeof(header->source_key)) != 0)
+                return NULL;
+
+            uint64_t expected_size = sizeof(CacheHeader) + (uint64_t)header->strings_bytes
+                + (uint64_t)header->num_records * sizeof(CacheRecord) + (uint64_t)header->num_list_words * sizeof(uint32_t);
+            if (size != expected_size || header->strings_bytes % 4 != 0 || header->num_records < 2 || header->num_list_words < 1)
+                return NULL;
+
+            const char *p = data + sizeof(CacheHeader);
+            const char *strings_end = p + header->strings_bytes;
+            strings.reserve(header->num_strings);
+            for (uint32_t i = 0; i < header->num_strings; i++) {
+                if (strings_end - p < 4)
+                    return NULL;
+                uint32_t len = *reinterpret_cast<const uint32_t*>(p);
+                p += 4;
+                if ((uint64_t)(strings_end - p) < len)
+                    return NULL;
+                strings.push_back(std::string(p, len));
+                p += (len + 3) & ~3;
+            }
 
-    rtn->num_type = (AST_Num::NumType)reader->readByte();
+            records = reinterpret_cast<const CacheRecord*>(strings_end);
+            num_records = header->num_records;
+            lists = reinterpret_cast<const uint32_t*>(records + num_records);
+            num_list_words = header->num_list_words;
+
+            if (records[1].type != AST_TYPE::Module)
+                return NULL;
+            AST_Module *rtn = new AST_Module();
+            rtn->lineno = records[1].lineno;
+            rtn->col_offset = records[1].col_offset;
+            arena = &rtn->arena;
+            readList(records[1].fields[0], 1, rtn->body);
+            if (!ok) {
+                delete rtn;
+                return NULL;
+            }
+            return rtn;
+        }
+};
 
-    rtn->col_offset = readColOffset(reader);
-    rtn->lineno = reader->readULL();
+static AST_Module* readCache(const std::string &cache_fn, const std::string &source_key) {
+    int fd = open(cache_fn.c_str(), O_RDONLY);
+    if (fd == -1)
+        return NULL;
 
-    if (rtn->num_type == AST_Num::INT) {
-        rtn->n_int = reader->readULL(); // automatic conversion to signed
-    } else if (rtn->num_type == AST_Num::FLOAT) {
-        rtn->n_float = reader->readDouble();
-    } else {
-        RELEASE_ASSERT(0, "%d", rtn->num_type);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
     }
-    return rtn;
-}
-
-AST_Pass* read_pass(BufferedReader *reader) {
-    AST_Pass *rtn = new AST_Pass();
-
-    rtn->col_offset = readColOffset(reader);
-    rtn->lineno = reader->readULL();
-    return rtn;
-}
-
-AST_Print* read_print(BufferedReader *reader) {
-    AST_Print *rtn = new AST_Print();
-
-    rtn->col_offset = readColOffset(reader);
-    rtn->dest = readASTExpr(reader);
-    rtn->lineno = reader->readULL();
-    rtn->nl = reader->readByte();
-    readExprVector(rtn->values, reader);
-    return rtn;
-}
-
-AST_Return* read_return(BufferedReader *reader) {
-    AST_Return *rtn = new AST_Return();
-
-    rtn->col_offset = readColOffset(reader);
-    rtn->lineno = reader->readULL();
-    rtn->value = readASTExpr(reader);
-    return rtn;
-}
-
-AST_Slice* read_slice(BufferedReader *reader) {
-    AST_Slice *rtn = new AST_Slice();
-
-    rtn->col_offset = -1;
-    rtn->lineno = -1;
-    rtn->lower = readASTExpr(reader);
-    rtn->step = readASTExpr(reader);
-    rtn->upper = readASTExpr(reader);
-
-    return rtn;
-}
-
-AST_Str* read_str(BufferedReader *reader) {
-    AST_Str *rtn = new AST_Str();
-
-    rtn->col_offset = readColOffset(reader);
-    rtn->lineno = reader->readULL();
-    rtn->s = readString(reader);
-
-    return rtn;
-}
-
-AST_Subscript* read_subscript(BufferedReader *reader) {
-    AST_Subscript *rtn = new AST_Subscript();
-
-    rtn->col_offset = readColOffset(reader);
-    rtn->ctx_type = (AST_TYPE::AST_TYPE)reader->readByte();
-    rtn->lineno = reader->readULL();
-    rtn->slice = readASTExpr(reader);
-    rtn->value = readASTExpr(reader);
-
-    return rtn;
-}
-
-AST_Tuple* read_tuple(BufferedReader *reader) {
-    AST_Tuple *rtn = new AST_Tuple();
-
-    rtn->col_offset = readColOffset(reader);
-    rtn->ctx_type = (AST_TYPE::AST_TYPE)reader->readByte();
-    readExprVector(rtn->elts, reader);
-    rtn->lineno = reader->readULL();
-
-    return rtn;
-}
-
-AST_UnaryOp* read_unaryop(BufferedReader *reader) {
-    AST_UnaryOp *rtn = new AST_UnaryOp();
-
-    rtn->col_offset = readColOffset(reader);
-    rtn->lineno = reader->readULL();
-    rtn->op_type = (AST_TYPE::AST_TYPE)reader->readByte();
-    rtn->operand = readASTExpr(reader);
-
-    return rtn;
-}
-
-AST_While* read_while(BufferedReader *reader) {
-    AST_While *rtn = new AST_While();
-
-    readStmtVector(rtn->body, reader);
-    rtn->col_offset = readColOffset(reader);
-    rtn->lineno = reader->readULL();
-    readStmtVector(rtn->orelse, reader);
-    rtn->test = readASTExpr(reader);
-
-    return rtn;
-}
 
-AST_With* read_with(BufferedReader *reader) {
-    AST_With *rtn = new AST_With();
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
 
-    readStmtVector(rtn->body, reader);
-    rtn->col_offset = readColOffset(reader);
-    rtn->context_expr = readASTExpr(reader);
-    rtn->lineno = reader->readULL();
-    rtn->optional_vars = readASTExpr(reader);
+    CacheReader reader;
+    AST_Module *rtn = reader.read(static_cast<const char*>(data), st.st_size, source_key);
+    munmap(data, st.st_size);
 
+    if (!rtn && VERBOSITY("parsing") >= 1)
+        printf("Ignoring invalid parse cache %s\n", cache_fn.c_str());
     return rtn;
 }
 
-AST_expr* readASTExpr(BufferedReader *reader) {
-    uint8_t type = reader->readByte();
-    if (VERBOSITY("parsing") >= 2)
-        printf("type = %d\n", type);
-    if (type == 0)
-        return NULL;
-
-    uint8_t checkbyte = reader->readByte();
-    assert(checkbyte == 0xae);
-
-    switch (type) {
-        case AST_TYPE::Attribute:
-            return read_attribute(reader);
-        case AST_TYPE::BinOp:
-            return read_binop(reader);
-        case AST_TYPE::BoolOp:
-            return read_boolop(reader);
-        case AST_TYPE::Call:
-            return read_call(reader);
-        case AST_TYPE::Compare:
-            return read_compare(reader);
-        case AST_TYPE::Dict:
-            return read_dict(reader);
-        case AST_TYPE::Index:
-            return read_index(reader);
-        case AST_TYPE::List:
-            return read_list(reader);
-        case AST_TYPE::Name:
-            return read_name(reader);
-        case AST_TYPE::Num:
-            return read_num(reader);
-        case AST_TYPE::Slice:
-            return read_slice(reader);
-        case AST_TYPE::Str:
-            return read_str(reader);
-        case AST_TYPE::Subscript:
-            return read_subscript(reader);
-        case AST_TYPE::Tuple:
-            return read_tuple(reader);
-        case AST_TYPE::UnaryOp:
-            return read_unaryop(reader);
-        default:
-            fprintf(stderr, "Unknown expr node type (parser.cpp:" STRINGIFY(__LINE__) "): %d\n", type);
-            abort();
-            break;
+static std::string readFile(const char* fn) {
+    FILE *fp = fopen(fn, "r");
+    if (!fp) {
+        fprintf(stderr, "Error: couldn't open %s\n", fn);
+        exit(1);
     }
-}
-
-AST_stmt* readASTStmt(BufferedReader *reader) {
-    uint8_t type = reader->readByte();
-    if (VERBOSITY("parsing") >= 2)
-        printf("type = %d\n", type);
-    if (type == 0)
-        return NULL;
-
-    uint8_t checkbyte = reader->readByte();
-    assert(checkbyte == 0xae);
-
-    switch (type) {
-        case AST_TYPE::Assign:
-            return read_assign(reader);
-        case AST_TYPE::Break:
-            return read_break(reader);
-        case AST_TYPE::ClassDef:
-            return read_classdef(reader);
-        case AST_TYPE::Continue:
-            return read_continue(reader);
-        case AST_TYPE::Expr:
-            return read_expr(reader);
-        case AST_TYPE::For:
-            return read_for(reader);
-        case AST_TYPE::FunctionDef:
-            return read_functiondef(reader);
-        case AST_TYPE::Global:
-            return read_global(reader);
-        case AST_TYPE::If:
-            return read_if(reader);
-        case AST_TYPE::Import:
-            return read_import(reader);
-        case AST_TYPE::Pass:
-            return read_pass(reader);
-        case AST_TYPE::Print:
-            return read_print(reader);
-        case AST_TYPE::Return:
-            return read_return(reader);
-        case AST_TYPE::While:
-            return read_while(reader);
-        case AST_TYPE::With:
-            return read_with(reader);
-        default:
-            fprintf(stderr, "Unknown stmt node type (parser.cpp:" STRINGIFY(__LINE__) "): %d\n", type);
-            exit(1);
-            break;
-    }
-}
-
-AST* readASTMisc(BufferedReader *reader) {
-    uint8_t type = reader->readByte();
-    if (VERBOSITY("parsing") >= 2)
-        printf("type = %d\n", type);
-    if (type == 0)
-        return NULL;
 
-    uint8_t checkbyte = reader->readByte();
-    assert(checkbyte == 0xae);
-
-    switch (type) {
-        case AST_TYPE::alias:
-            return read_alias(reader);
-        case AST_TYPE::arguments:
-            return read_arguments(reader);
-        case AST_TYPE::keyword:
-            return read_keyword(reader);
-        case AST_TYPE::Module:
-            return read_module(reader);
-        default:
-            fprintf(stderr, "Unknown node type (parser.cpp:" STRINGIFY(__LINE__) "): %d\n", type);
-            exit(1);
+    std::string rtn;
+    char buf[4096];
+    while (true) {
+        int nread = fread(buf, 1, sizeof(buf), fp);
+        if (nread == 0)
             break;
+        rtn.append(buf, nread);
     }
+    fclose(fp);
+    return rtn;
 }
 
 AST_Module* parse(const char* fn) {
     Timer _t("parsing");
 
-    std::string cmdline = "python codegen/parse_ast.py ";
-    cmdline += fn;
-    FILE *fp = popen(cmdline.c_str(), "r");
-
-    BufferedReader *reader = new BufferedReader(fp);
-    AST* rtn = readASTMisc(reader);
-    reader->fill();
-    ASSERT(reader->bytesBuffered() == 0, "%d", reader->bytesBuffered());
-    delete reader;
-
-    int code = pclose(fp);
-    assert(code == 0);
-
-    assert(rtn->type == AST_TYPE::Module);
+    AST_Module* rtn = parseSource(readFile(fn), fn);
 
     long us = _t.end();
     static StatCounter us_parsing("us_parsing");
     us_parsing.log(us);
 
-    return static_cast<AST_Module*>(rtn);
-}
-
-#define MAGIC_STRING "a\ncf"
-#define MAGIC_STRING_LENGTH 4
-
-static void _reparse(const char* fn, const std::string &cache_fn) {
-    std::string cmdline = std::string("python -S codegen/parse_ast.py ") + fn;
-    FILE *parser = popen(cmdline.c_str(), "r");
-    FILE *cache_fp = fopen(cache_fn.c_str(), "w");
-    assert(cache_fp);
-
-    fwrite(MAGIC_STRING, 1, MAGIC_STRING_LENGTH, cache_fp);
-
-    char buf[80];
-    while (true) {
-        int nread = fread(buf, 1, 80, parser);
-        if (nread == 0)
-            break;
-        fwrite(buf, 1, nread, cache_fp);
-    }
-    int code = pclose(parser);
-    assert(code == 0);
-    fclose(cache_fp);
+    return rtn;
 }
 
-// Parsing the file is somewhat expensive since we have to shell out to cpython;
-// it's not a huge deal right now, but this caching version can significantly cut down
-// on the startup time (40ms -> 10ms).
+// The cache goes by the contents of the source rather than by mtimes, so copied or touched files still hit, and an
+// out-of-date cache file never gets used just because it happens to look newer than the source.
 AST_Module* caching_parse(const char* fn) {
     Timer _t("parsing");
 
-    int code;
-    std::string cache_fn = std::string(fn) + "c";
-
-    struct stat source_stat, cache_stat;
-    code = stat(fn, &source_stat);
-    assert(code == 0);
-    code = stat(cache_fn.c_str(), &cache_stat);
-    if (code != 0 || cache_stat.st_mtime < source_stat.st_mtime ||
-            (cache_stat.st_mtime == source_stat.st_mtime && cache_stat.st_mtim.tv_nsec < source_stat.st_mtim.tv_nsec)) {
-        _reparse(fn, cache_fn);
-    }
+    std::string source = readFile(fn);
+    std::string source_key = cacheKey(source);
 
-    FILE *fp = fopen(cache_fn.c_str(), "r");
-    assert(fp);
+    std::string cache_fn;
+    if (compileCacheEnabled())
+        cache_fn = findCacheEntry(source_key + ".ast");
+    else
+        cache_fn = std::string(fn) + "c";
 
-    while (true) {
-        char buf[MAGIC_STRING_LENGTH];
-        int read = fread(buf, 1, MAGIC_STRING_LENGTH, fp);
-        if (read != 4 || strncmp(buf, MAGIC_STRING, MAGIC_STRING_LENGTH) != 0) {
-            fclose(fp);
-            _reparse(fn, cache_fn);
-
-            fp = fopen(cache_fn.c_str(), "r");
-            assert(fp);
-        } else {
-            break;
-        }
-    }
+    AST_Module* rtn = NULL;
+    if (!cache_fn.empty())
+        rtn = readCache(cache_fn, source_key);
 
-    BufferedReader *reader = new BufferedReader(fp);
-    AST* rtn = readASTMisc(reader);
-    reader->fill();
-    assert(reader->bytesBuffered() == 0);
-    delete reader;
+    if (!rtn) {
+        rtn = parseSource(source, fn);
 
-    assert(rtn->type == AST_TYPE::Module);
+        // Not being able to write the cache (ex a read-only directory) just means we'll parse it again next time.
+        std::string data = CacheWriter().write(rtn, source_key);
+        if (compileCacheEnabled())
+            writeCacheEntry(source_key + ".ast", data);
+        else
+            writeFileAtomically(std::string(fn) + "c", data);
+    }
 
     long us = _t.end();
     static StatCounter us_parsing("us_parsing");
     us_parsing.log(us);
 
-    return static_cast<AST_Module*>(rtn);
+    return rtn;
+}
+
+AST_Module* read_parse_cache(const char* fn) {
+    std::string source_key = cacheKey(readFile(fn));
+
+    std::string cache_fn;
+    if (compileCacheEnabled())
+        cache_fn = findCacheEntry(source_key + ".ast");
+    else
+        cache_fn = std::string(fn) + "c";
+
+    if (cache_fn.empty())
+        return NULL;
+    return readCache(cache_fn, source_key);
 }
 
 }
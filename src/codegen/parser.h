@@ -21,6 +21,9 @@ class AST_Module;
 
 AST_Module* parse(const char* fn);
 AST_Module* caching_parse(const char* fn);
+// Just the cache lookup of caching_parse, returning NULL if there's no valid cache entry for the file.
+// Unlike the other two this doesn't log any stats, so it's safe to call from other threads.
+AST_Module* read_parse_cache(const char* fn);
 
 }
 
@@ -12,7 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 
 #include "core/common.h"
@@ -25,6 +28,8 @@
 #include "codegen/patchpoints.h"
 #include "codegen/stackmaps.h"
 
+#include "gc/root_finder.h"
+
 namespace pyston {
 
 int PatchpointSetupInfo::totalSize() const {
@@ -32,6 +37,9 @@ int PatchpointSetupInfo::totalSize() const {
     if (getCallingConvention() != llvm::CallingConv::C) {
         // have no idea what the precise number is:
         call_size = 128;
+        // When the spills + call live in a cold stub, all that's left in here is the jump to it:
+        if (ENABLE_COLD_SLOWPATHS)
+            call_size = 16;
     }
     return num_slots * slot_size + call_size;
 }
@@ -39,24 +47,116 @@ int64_t PatchpointSetupInfo::getPatchpointId() const {
     return pp_id;
 }
 
+// The gc_roots pass registers callsites from the compile threads, so everything here is behind this:
+static std::mutex patchpoints_lock;
+static int64_t next_patchpoint_id = 100;
 static std::unordered_map<int64_t, PatchpointSetupInfo*> new_patchpoints_by_id;
 
+struct GCRootCallsite {
+    CompiledFunction* parent_cf;
+    std::vector<int> range_sizes;
+};
+static std::unordered_map<int64_t, GCRootCallsite> new_gc_callsites_by_id;
+
+// Keyed by the type and the default slot size, since that's what the callsite slots scale with the
+// number of arguments by.  Also behind patchpoints_lock, since the rewrites happen on the main thread.
+static std::map<std::pair<int, int>, patchpoints::RewriteSizeStats> rewrite_size_stats;
+
+// Once a kind of IC has had this many rewrites, MAXIMAL compiles size its slots off of them:
+static const int MIN_REWRITES_FOR_SIZING = 20;
+
+static int pickSlotSize(const patchpoints::RewriteSizeStats &stats, int default_size, CompiledFunction* parent_cf) {
+    if (!ENABLE_ADAPTIVE_SLOT_SIZES || parent_cf == NULL || parent_cf->effort != EffortLevel::MAXIMAL)
+        return default_size;
+    if (stats.num_rewrites < MIN_REWRITES_FOR_SIZING)
+        return default_size;
+
+    // Leave some room for the guards of types that haven't shown up yet:
+    int size = (stats.max_bytes + 16 + 15) & ~15;
+    return std::max(32, std::min(size, default_size * 4));
+}
+
 PatchpointSetupInfo* PatchpointSetupInfo::initialize(bool has_return_value, int num_slots, int slot_size, CompiledFunction *parent_cf, patchpoints::PatchpointType type) {
-    static int64_t next_id = 100;
-    int64_t id = next_id++;
+    std::lock_guard<std::mutex> _lock(patchpoints_lock);
+    int64_t id = next_patchpoint_id++;
+
+    patchpoints::RewriteSizeStats* stats = &rewrite_size_stats[std::make_pair((int)type, slot_size)];
+    int picked_size = pickSlotSize(*stats, slot_size, parent_cf);
+    if (picked_size != slot_size) {
+        static StatCounter sc_resized("ic_slots_resized");
+        sc_resized.log();
+        static StatCounter sc_saved("ic_slot_bytes_saved");
+        sc_saved.log((slot_size - picked_size) * num_slots);
+    }
 
-    PatchpointSetupInfo* rtn = new PatchpointSetupInfo(id, type, num_slots, slot_size, parent_cf, has_return_value);
+    PatchpointSetupInfo* rtn = new PatchpointSetupInfo(id, type, num_slots, picked_size, parent_cf, has_return_value, stats);
     new_patchpoints_by_id[id] = rtn;
     return rtn;
 }
 
 namespace patchpoints {
 
-void processStackmap(StackMap* stackmap) {
-    int nrecords = stackmap ? stackmap->records.size() : 0;
+void noteRewriteSize(RewriteSizeStats* stats, int bytes_needed, bool fit) {
+    std::lock_guard<std::mutex> _lock(patchpoints_lock);
+    stats->num_rewrites++;
+    stats->max_bytes = std::max(stats->max_bytes, bytes_needed);
+    if (!fit)
+        stats->num_too_big++;
+}
+
+int64_t registerGCRootCallsite(CompiledFunction* parent_cf, const std::vector<int> &range_sizes) {
+    std::lock_guard<std::mutex> _lock(patchpoints_lock);
+    int64_t id = next_patchpoint_id++;
+    new_gc_callsites_by_id[id] = GCRootCallsite({parent_cf, range_sizes});
+    return id;
+}
 
-    for (int i = 0; i < nrecords; i++) {
-        StackMap::Record *r = stackmap->records[i];
+static void processGCRootCallsite(const StackMap::Record* r, const GCRootCallsite &callsite) {
+    assert(r->num_locations == callsite.range_sizes.size());
+
+    std::vector<gc::FrameRootLocation> roots;
+    for (int i = 0; i < r->num_locations; i++) {
+        const StackMap::Record::Location &l = r->locations[i];
+        int size = callsite.range_sizes[i];
+
+        if (l.type == 1) { // "Register"
+            assert(size == 0);
+            roots.push_back(gc::FrameRootLocation({gc::FrameRootLocation::Register, l.regnum, 0, 0}));
+        } else if (l.type == 2) { // "Direct"
+            // Only stack allocations should end up as direct references:
+            assert(size > 0);
+            roots.push_back(gc::FrameRootLocation({gc::FrameRootLocation::Range, l.regnum, l.offset, size}));
+        } else if (l.type == 3) { // "Indirect"
+            assert(size == 0);
+            roots.push_back(gc::FrameRootLocation({gc::FrameRootLocation::Indirect, l.regnum, l.offset, 0}));
+        } else {
+            // Constants; anything embedded in the code has to be kept alive some other way.
+            assert(l.type == 4 || l.type == 5);
+        }
+    }
+
+    uint8_t* func_addr = (uint8_t*)callsite.parent_cf->code;
+    assert(func_addr);
+    // The call is emitted at the start of the patchpoint, so the return address is right after it:
+    void* return_addr = func_addr + r->offset + GC_ROOT_CALLSITE_SIZE;
+    gc::registerFrameRoots(return_addr, std::move(roots));
+}
+
+void processStackmap(StackMap* stackmap) {
+    std::lock_guard<std::mutex> _lock(patchpoints_lock);
+    if (!stackmap)
+        return;
+
+    StackMap::Record record;
+    StackMap::RecordIterator iter(stackmap);
+    while (iter.next(record)) {
+        const StackMap::Record *r = &record;
+
+        auto gc_it = new_gc_callsites_by_id.find(r->id);
+        if (gc_it != new_gc_callsites_by_id.end()) {
+            processGCRootCallsite(r, gc_it->second);
+            continue;
+        }
 
         assert(stackmap->stack_size_records.size() == 1);
         const StackMap::StackSizeRecord &stack_size_record = stackmap->stack_size_records[0];
@@ -68,7 +168,7 @@ void processStackmap(StackMap* stackmap) {
         bool has_scratch = (pp->numScratchBytes() != 0);
         int scratch_rbp_offset = 0;
         if (has_scratch) {
-            assert(r->locations.size() == 1);
+            assert(r->num_locations == 1);
 
             StackMap::Record::Location l = r->locations[0];
 
@@ -78,16 +178,16 @@ void processStackmap(StackMap* stackmap) {
             assert(l.regnum == DWARF_RBP_REGNUM);
             scratch_rbp_offset = l.offset;
         } else {
-            assert(r->locations.size() == 0);
+            assert(r->num_locations == 0);
         }
 
         uint8_t* func_addr = (uint8_t*)pp->parent_cf->code;
         assert(func_addr);
         uint8_t* start_addr = func_addr + r->offset;
 
-        std::unordered_set<int> live_outs;
-        for (auto live_out : r->live_outs) {
-            live_outs.insert(live_out.regnum);
+        LiveOutSet live_outs;
+        for (int j = 0; j < r->num_live_outs; j++) {
+            live_outs.insert(r->live_outs[j].regnum);
         }
 
         // llvm doesn't consider callee-save registers to be live
@@ -101,14 +201,25 @@ void processStackmap(StackMap* stackmap) {
         live_outs.insert(14);
         live_outs.insert(15);
 
-        registerCompiledPatchpoint(start_addr, pp, StackInfo({stack_size, has_scratch, pp->numScratchBytes(), scratch_rbp_offset}), std::move(live_outs));
+        registerCompiledPatchpoint(start_addr, pp, StackInfo({stack_size, has_scratch, pp->numScratchBytes(), scratch_rbp_offset}), live_outs);
     }
 
-    for (std::unordered_map<int64_t, PatchpointSetupInfo*>::iterator it =
-            new_patchpoints_by_id.begin(), end = new_patchpoints_by_id.end(); it != end; ++it) {
-        delete it->second;
+    // Only remove the entries that this stackmap covered: the ones for compiles that are still going on in
+    // the background have to stick around until their code gets installed.  (Patchpoints that got optimized
+    // out never show up in a stackmap, and just stay here.)
+    StackMap::RecordIterator iter2(stackmap);
+    while (iter2.next(record)) {
+        int64_t id = record.id;
+        new_gc_callsites_by_id.erase(id);
+
+        auto it = new_patchpoints_by_id.find(id);
+        if (it != new_patchpoints_by_id.end()) {
+            delete it->second;
+            new_patchpoints_by_id.erase(it);
+        }
     }
-    new_patchpoints_by_id.clear();
+
+    delete stackmap;
 }
 
 PatchpointSetupInfo* createGenericPatchpoint(CompiledFunction *parent_cf, bool has_return_value, int size) {
@@ -147,6 +258,10 @@ PatchpointSetupInfo* createNonzeroPatchpoint(CompiledFunction *parent_cf) {
     return PatchpointSetupInfo::initialize(true, 1, 64, parent_cf, Nonzero);
 }
 
+PatchpointSetupInfo* createIterNextPatchpoint(CompiledFunction *parent_cf) {
+    return PatchpointSetupInfo::initialize(true, 1, 64, parent_cf, IterNext);
+}
+
 } // namespace patchpoints
 
 } // namespace pyston
@@ -17,6 +17,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <vector>
 
 #include "llvm/IR/CallingConv.h"
 
@@ -34,16 +35,30 @@ enum PatchpointType {
     Setitem,
     Binexp,
     Nonzero,
+    IterNext,
 };
 
+// How much space the rewrites of one kind of IC have ended up needing, so that the slots of later
+// compiles can be sized off of that instead of the defaults:
+struct RewriteSizeStats {
+    int64_t num_rewrites;
+    // Including the ones that didn't fit:
+    int max_bytes;
+    int64_t num_too_big;
+
+    RewriteSizeStats() : num_rewrites(0), max_bytes(0), num_too_big(0) {}
+};
+
+void noteRewriteSize(RewriteSizeStats* stats, int bytes_needed, bool fit);
+
 }
 
 class CompiledFunction;
 
 class PatchpointSetupInfo {
     private:
-        PatchpointSetupInfo(int64_t pp_id, patchpoints::PatchpointType type, int num_slots, int slot_size, CompiledFunction* parent_cf, bool has_return_value) :
-            pp_id(pp_id), type(type), num_slots(num_slots), slot_size(slot_size), has_return_value(has_return_value), parent_cf(parent_cf) {
+        PatchpointSetupInfo(int64_t pp_id, patchpoints::PatchpointType type, int num_slots, int slot_size, CompiledFunction* parent_cf, bool has_return_value, patchpoints::RewriteSizeStats* size_stats) :
+            pp_id(pp_id), type(type), num_slots(num_slots), slot_size(slot_size), has_return_value(has_return_value), parent_cf(parent_cf), size_stats(size_stats), lineno(0) {
         }
 
         const int64_t pp_id;
@@ -53,7 +68,11 @@ class PatchpointSetupInfo {
         const int num_slots, slot_size;
         const bool has_return_value;
         CompiledFunction * const parent_cf;
+        // Shared by all the patchpoints of this type and default size:
+        patchpoints::RewriteSizeStats * const size_stats;
         void* metadata;
+        // The line of the Python code that it's for, or 0 if we don't know:
+        int lineno;
 
         int totalSize() const;
         int64_t getPatchpointId() const;
@@ -77,8 +96,15 @@ struct StackMap;
 
 namespace patchpoints {
 
+// Registers the GC roots and ICs that the stackmap describes, and then frees it.
 void processStackmap(StackMap* stackmap);
 
+// Calls that were turned into patchpoints just so that we get a stackmap record of the gc roots
+// that are live across them.  range_sizes has an entry for each live value: 0 for a plain pointer,
+// or the size of the stack allocation that it refers to.
+static const int GC_ROOT_CALLSITE_SIZE = 13;
+int64_t registerGCRootCallsite(CompiledFunction* parent_cf, const std::vector<int> &range_sizes);
+
 PatchpointSetupInfo* createGenericPatchpoint(CompiledFunction* parent_cf, bool has_return_value, int size);
 PatchpointSetupInfo* createCallsitePatchpoint(CompiledFunction* parent_cf, int num_args);
 PatchpointSetupInfo* createGetGlobalPatchpoint(CompiledFunction* parent_cf);
@@ -88,6 +114,7 @@ PatchpointSetupInfo* createGetitemPatchpoint(CompiledFunction* parent_cf);
 PatchpointSetupInfo* createSetitemPatchpoint(CompiledFunction* parent_cf);
 PatchpointSetupInfo* createBinexpPatchpoint(CompiledFunction* parent_cf);
 PatchpointSetupInfo* createNonzeroPatchpoint(CompiledFunction* parent_cf);
+PatchpointSetupInfo* createIterNextPatchpoint(CompiledFunction* parent_cf);
 
 }
 
@@ -0,0 +1,240 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "core/common.h"
+#include "core/util.h"
+
+#include "codegen/perf_map.h"
+
+namespace pyston {
+
+// The jitdump format is described in linux's tools/perf/Documentation/jitdump-specification.txt.
+static const uint32_t JITDUMP_MAGIC = 0x4A695444;
+static const uint32_t JITDUMP_VERSION = 1;
+static const uint32_t EM_X86_64_MACHINE = 62;
+enum JitdumpRecordType {
+    JIT_CODE_LOAD = 0,
+    JIT_CODE_DEBUG_INFO = 2,
+};
+
+struct JitdumpHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+};
+
+struct JitdumpRecordHeader {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+};
+
+// Followed by the null-terminated name, and then the code:
+struct JitdumpCodeLoad {
+    JitdumpRecordHeader header;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+};
+
+// Followed by nr_entry entries, each of which is an address, a line number, a discriminator, and
+// the null-terminated file name.  Has to come before the JIT_CODE_LOAD for the same code.
+struct JitdumpDebugInfo {
+    JitdumpRecordHeader header;
+    uint64_t code_addr;
+    uint64_t nr_entry;
+};
+
+struct JitdumpDebugEntry {
+    uint64_t addr;
+    int32_t lineno;
+    int32_t discrim;
+};
+
+struct PerfFunction {
+    std::string name;
+    void* addr;
+    int length;
+};
+
+static std::mutex perf_map_lock;
+// The process that the per-pid files belong to, so that a forked child can tell that it should start its own:
+static pid_t files_pid = 0;
+static FILE *map_f = NULL, *index_f = NULL, *jitdump_f = NULL;
+// perf only notices the jitdump file if it sees us mmap it:
+static void* jitdump_marker = NULL;
+static long jitdump_marker_size = 0;
+static uint64_t next_code_index = 0;
+// Everything that got written out, in case we fork:
+static std::vector<PerfFunction> functions;
+
+static const std::string PERF_MAP_DIR = "perf_map";
+
+static uint64_t perfTimestamp() {
+    // Has to match perf's clock, which is what "-k mono" is for:
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void writeCodeLoad(const std::string &name, void* addr, int length) {
+    JitdumpCodeLoad rec;
+    rec.header.id = JIT_CODE_LOAD;
+    rec.header.total_size = sizeof(rec) + name.size() + 1 + length;
+    rec.header.timestamp = perfTimestamp();
+    rec.pid = getpid();
+    rec.tid = syscall(SYS_gettid);
+    rec.vma = rec.code_addr = (uint64_t)addr;
+    rec.code_size = length;
+    rec.code_index = next_code_index++;
+
+    fwrite(&rec, sizeof(rec), 1, jitdump_f);
+    fwrite(name.c_str(), 1, name.size() + 1, jitdump_f);
+    fwrite(addr, 1, length, jitdump_f);
+}
+
+static void writeDebugInfo(void* addr, const std::vector<PerfLineInfo> &lines) {
+    JitdumpDebugInfo rec;
+    rec.header.id = JIT_CODE_DEBUG_INFO;
+    rec.header.total_size = sizeof(rec);
+    for (const PerfLineInfo &l : lines)
+        rec.header.total_size += sizeof(JitdumpDebugEntry) + l.file.size() + 1;
+    rec.header.timestamp = perfTimestamp();
+    rec.code_addr = (uint64_t)addr;
+    rec.nr_entry = lines.size();
+
+    fwrite(&rec, sizeof(rec), 1, jitdump_f);
+    for (const PerfLineInfo &l : lines) {
+        JitdumpDebugEntry entry;
+        entry.addr = l.addr;
+        entry.lineno = l.line;
+        entry.discrim = 0;
+        fwrite(&entry, sizeof(entry), 1, jitdump_f);
+        fwrite(l.file.c_str(), 1, l.file.size() + 1, jitdump_f);
+    }
+}
+
+static void openPidFiles() {
+    pid_t pid = getpid();
+
+    char buf[80];
+    snprintf(buf, sizeof(buf), "/tmp/perf-%d.map", pid);
+    map_f = fopen(buf, "w");
+    if (!map_f) {
+        fprintf(stderr, "Error: couldn't open %s for writing\n", buf);
+        exit(1);
+    }
+
+    snprintf(buf, sizeof(buf), "/tmp/jit-%d.dump", pid);
+    jitdump_f = fopen(buf, "w+");
+    if (!jitdump_f) {
+        fprintf(stderr, "Error: couldn't open %s for writing\n", buf);
+        exit(1);
+    }
+    jitdump_marker_size = sysconf(_SC_PAGESIZE);
+    jitdump_marker = mmap(NULL, jitdump_marker_size, PROT_READ | PROT_EXEC, MAP_PRIVATE, fileno(jitdump_f), 0);
+    RELEASE_ASSERT(jitdump_marker != MAP_FAILED, "");
+
+    JitdumpHeader header;
+    header.magic = JITDUMP_MAGIC;
+    header.version = JITDUMP_VERSION;
+    header.total_size = sizeof(header);
+    header.elf_mach = EM_X86_64_MACHINE;
+    header.pad1 = 0;
+    header.pid = pid;
+    header.timestamp = perfTimestamp();
+    header.flags = 0;
+    fwrite(&header, sizeof(header), 1, jitdump_f);
+
+    files_pid = pid;
+}
+
+static void ensureFilesOpen() {
+    if (files_pid == getpid())
+        return;
+
+    if (files_pid == 0) {
+        removeDirectoryIfExists(PERF_MAP_DIR);
+        if (mkdir(PERF_MAP_DIR.c_str(), 0777) != 0) {
+            fprintf(stderr, "Error: couldn't create %s/\n", PERF_MAP_DIR.c_str());
+            exit(1);
+        }
+        index_f = fopen((PERF_MAP_DIR + "/index.txt").c_str(), "w");
+        RELEASE_ASSERT(index_f, "");
+
+        openPidFiles();
+        return;
+    }
+
+    // We're a forked child: the code (and perf_map/, which is shared) is still good, but perf
+    // goes by pid, so re-announce everything in files of our own.
+    fclose(map_f);
+    fclose(jitdump_f);
+    munmap(jitdump_marker, jitdump_marker_size);
+    openPidFiles();
+
+    for (const PerfFunction &func : functions) {
+        fprintf(map_f, "%lx %x %s\n", (uintptr_t)func.addr, func.length, func.name.c_str());
+        writeCodeLoad(func.name, func.addr, func.length);
+    }
+}
+
+void perfMapAddFunction(const std::string &name, void* addr, int length, const std::vector<PerfLineInfo> &lines) {
+    assert(length > 0);
+
+    std::lock_guard<std::mutex> _lock(perf_map_lock);
+    ensureFilesOpen();
+
+    fprintf(map_f, "%lx %x %s\n", (uintptr_t)addr, length, name.c_str());
+    fflush(map_f);
+
+    fprintf(index_f, "%lx %s\n", (uintptr_t)addr, name.c_str());
+    fflush(index_f);
+
+    FILE *data_f = fopen((PERF_MAP_DIR + "/" + name).c_str(), "wb");
+    RELEASE_ASSERT(data_f, "");
+    int written = fwrite(addr, 1, length, data_f);
+    assert(written == length);
+    fclose(data_f);
+
+    if (lines.size())
+        writeDebugInfo(addr, lines);
+    writeCodeLoad(name, addr, length);
+    fflush(jitdump_f);
+
+    PerfFunction func;
+    func.name = name;
+    func.addr = addr;
+    func.length = length;
+    functions.push_back(func);
+}
+
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CODEGEN_PERFMAP_H
+#define PYSTON_CODEGEN_PERFMAP_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace pyston {
+
+// With PROFILE on, every function gets written out as soon as it's jitted, so that perf can make
+// sense of samples from a process that's still running (or that crashed):
+//  - /tmp/perf-<pid>.map, the symbol table that perf falls back to for anonymous code;
+//  - perf_map/, a copy of each function's code plus an index.txt, for tools/annotate.py;
+//  - /tmp/jit-<pid>.dump, perf's jitdump format (the code and its python line numbers), which
+//    "perf inject --jit" turns into something that perf report / annotate can use.  That one
+//    needs the samples to be timestamped the same way, ie "perf record -k mono".
+//
+// Everything gets flushed as it goes.  A forked child starts its own set of files, with the
+// functions that it inherited from its parent.
+
+struct PerfLineInfo {
+    uint64_t addr;
+    int line;
+    std::string file;
+};
+
+void perfMapAddFunction(const std::string &name, void* addr, int length, const std::vector<PerfLineInfo> &lines);
+
+}
+
+#endif
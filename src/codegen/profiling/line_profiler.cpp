@@ -0,0 +1,200 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "core/ast.h"
+#include "core/cfg.h"
+#include "core/common.h"
+#include "core/stats.h"
+#include "core/threading.h"
+#include "core/types.h"
+
+#include "codegen/irgen/hooks.h"
+#include "codegen/profiling/line_profiler.h"
+
+#include "runtime/types.h"
+
+namespace pyston {
+
+// All of this is protected by the GIL.
+static bool profiling = false;
+static bool profile_all = false;
+static std::unordered_set<std::string> profile_names;
+
+// The entries never get freed, since code that's been replaced can still be running and calling
+// lineProfilerHit with them; starting the profiler over just zeroes them.
+static std::unordered_map<SourceInfo*, std::map<int, LineProfileEntry*> > entries;
+// The functions whose current code is calling lineProfilerHit:
+static std::unordered_set<SourceInfo*> instrumented;
+
+// The statement that the thread was in the last time it called lineProfilerHit, and when that was:
+static __thread LineProfileEntry* cur_entry = NULL;
+static __thread int64_t cur_entry_start_ns;
+
+static const char* report_filename;
+
+static int64_t nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+extern "C" void lineProfilerHit(LineProfileEntry* entry) {
+    if (!profiling) {
+        // Old code that's still running
+        cur_entry = NULL;
+        return;
+    }
+
+    int64_t now = nowNs();
+    if (cur_entry)
+        cur_entry->ns += now - cur_entry_start_ns;
+    entry->count++;
+    cur_entry = entry;
+    cur_entry_start_ns = now;
+}
+
+static bool shouldProfile(SourceInfo* source) {
+    return profiling && (profile_all || profile_names.count(source->getName()));
+}
+
+LineProfileEntry* getLineProfileEntry(SourceInfo* source, int lineno) {
+    if (!shouldProfile(source))
+        return NULL;
+
+    instrumented.insert(source);
+    LineProfileEntry* &entry = entries[source][lineno];
+    if (entry == NULL)
+        entry = new LineProfileEntry();
+    return entry;
+}
+
+bool startsProfiledLine(CFGBlock* block, int i) {
+    AST_stmt* stmt = block->body[i];
+    if (stmt->type == AST_TYPE::Jump || (int)stmt->lineno <= 0)
+        return false;
+    return i == 0 || block->body[i - 1]->lineno != stmt->lineno;
+}
+
+static bool needsRecompile(CLFunction* clfunc) {
+    return shouldProfile(clfunc->source) != (instrumented.count(clfunc->source) != 0);
+}
+
+// Swaps in instrumented code for the functions that are now getting profiled, and uninstrumented code for the
+// ones that aren't any more:
+static void updateCode() {
+    recompileFunctions(needsRecompile);
+
+    for (auto it = instrumented.begin(); it != instrumented.end();) {
+        if (shouldProfile(*it))
+            ++it;
+        else
+            it = instrumented.erase(it);
+    }
+}
+
+void startLineProfiling(const std::vector<std::string> &names) {
+    static StatCounter num_starts("line_profiler_starts");
+    num_starts.log();
+
+    for (auto &p : entries) {
+        for (auto &e : p.second)
+            *e.second = LineProfileEntry();
+    }
+    cur_entry = NULL;
+
+    profiling = true;
+    profile_all = names.empty();
+    profile_names = std::unordered_set<std::string>(names.begin(), names.end());
+    updateCode();
+}
+
+void stopLineProfiling() {
+    profiling = false;
+    updateCode();
+}
+
+bool isLineProfiling() {
+    return profiling;
+}
+
+std::vector<LineProfileResult> getLineProfile() {
+    std::vector<LineProfileResult> rtn;
+    for (auto &p : entries) {
+        for (auto &e : p.second) {
+            if (e.second->count == 0)
+                continue;
+            LineProfileResult r;
+            r.function = p.first->getName();
+            r.filename = p.first->parent_module->fn;
+            r.lineno = e.first;
+            r.count = e.second->count;
+            r.ns = e.second->ns;
+            rtn.push_back(r);
+        }
+    }
+    std::sort(rtn.begin(), rtn.end(), [](const LineProfileResult &lhs, const LineProfileResult &rhs) {
+        return lhs.ns > rhs.ns;
+    });
+    return rtn;
+}
+
+static void writeReport() {
+    FILE* f = fopen(report_filename, "w");
+    if (!f) {
+        fprintf(stderr, "Couldn't open %s to write the line profile: %s\n", report_filename, strerror(errno));
+        return;
+    }
+    fprintf(f, "%14s %12s  %s\n", "ns", "hits", "line");
+    for (const LineProfileResult &r : getLineProfile())
+        fprintf(f, "%14ld %12ld  %s:%d (%s)\n", r.ns, r.count, r.filename.c_str(), r.lineno, r.function.c_str());
+    fclose(f);
+}
+
+// Runs at a safepoint, which is somewhere that the code can get swapped out:
+static void toggleFromSignal() {
+    if (isLineProfiling()) {
+        stopLineProfiling();
+        writeReport();
+    } else {
+        startLineProfiling(std::vector<std::string>());
+    }
+}
+
+static void handleSigusr1(int signum) {
+    threading::requestSafepointCallback(toggleFromSignal);
+}
+
+void setupLineProfilerSignal(const char* filename) {
+    report_filename = filename;
+
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = handleSigusr1;
+    act.sa_flags = SA_RESTART;
+    sigemptyset(&act.sa_mask);
+    int code = sigaction(SIGUSR1, &act, NULL);
+    RELEASE_ASSERT(code == 0, "");
+}
+
+}
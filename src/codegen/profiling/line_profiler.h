@@ -0,0 +1,75 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CODEGEN_PROFILING_LINE_PROFILER_H
+#define PYSTON_CODEGEN_PROFILING_LINE_PROFILER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pyston {
+
+class CFGBlock;
+class SourceInfo;
+
+// An on-demand line profiler, for finding out where a process that's already running is spending its time.
+// While it's on, the functions that it's profiling get recompiled (at the same effort levels) with a call
+// to lineProfilerHit before each statement, which counts how many times each line runs and how long it
+// takes until the next profiled statement starts; turning it off recompiles them back to how they were.
+// The AST interpreter counts lines the same way (it has to look the entries up each time, but only while
+// the profiler is on); the threaded dispatch (-J) doesn't count them.
+//
+// It can get turned on and off from python, through the pyston_stats module, or with SIGUSR1 if it was
+// set up with setupLineProfilerSignal (which profiles every function, and writes the report out when it
+// turns the profiler back off).
+
+struct LineProfileEntry {
+    int64_t count;
+    // Time until the next profiled statement, which includes the calls into code that isn't getting profiled:
+    int64_t ns;
+
+    LineProfileEntry() : count(0), ns(0) {}
+};
+extern "C" void lineProfilerHit(LineProfileEntry* entry);
+
+// What irgen calls for each statement of the function: returns the entry that the statement's calls to
+// lineProfilerHit should pass, or NULL if the function isn't getting profiled.
+LineProfileEntry* getLineProfileEntry(SourceInfo* source, int lineno);
+// Whether the i'th statement of the block is where a line starts, ie whether it should count as a hit.  The
+// cfg turns some lines into several statements, which should only count once (and Jumps don't count at all).
+bool startsProfiledLine(CFGBlock* block, int i);
+
+// Starts profiling the functions with the given names, or every function if names is empty; if it's
+// already on, this changes which functions are being profiled.  The counts start over from zero.
+// These have to be called with the GIL held, from somewhere that it's safe to recompile things.
+void startLineProfiling(const std::vector<std::string> &names);
+void stopLineProfiling();
+bool isLineProfiling();
+
+struct LineProfileResult {
+    std::string function, filename;
+    int lineno;
+    int64_t count, ns;
+};
+// The counts so far (or from the last time the profiler was on), sorted by time, most first:
+std::vector<LineProfileResult> getLineProfile();
+
+// Makes SIGUSR1 turn the profiler on for every function, and the next one turn it off again and write the
+// hottest lines to filename.
+void setupLineProfilerSignal(const char* filename);
+
+}
+
+#endif
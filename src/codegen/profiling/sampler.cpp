@@ -0,0 +1,275 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unordered_map>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "core/common.h"
+
+#include "codegen/codegen.h"
+#include "codegen/profiling/sampler.h"
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace pyston {
+
+static const long SAMPLE_INTERVAL_NS = 10 * 1000 * 1000;
+static const int MAX_FRAMES = 64;
+// The handler drops samples if the background thread falls this far behind:
+static const int NUM_SAMPLE_SLOTS = 4096;
+
+struct Sample {
+    int nframes;
+    // frames[0] is the pc, the rest are return addresses:
+    void* frames[MAX_FRAMES];
+};
+
+// Written by the signal handler, read by the background thread:
+static Sample* samples;
+static std::atomic<uint64_t> samples_written(0), samples_read(0);
+static std::atomic<int64_t> samples_dropped(0);
+static std::atomic<bool> dump_requested(false);
+
+static uintptr_t stack_lo, stack_hi;
+
+static const char* profile_filename;
+static pid_t profiler_pid;
+static timer_t timer;
+
+// Guards the totals, and draining the samples:
+static std::mutex sampler_lock;
+// Never freed, since the background thread could still be around while the static destructors run:
+static std::map<std::string, int64_t>* stack_counts;
+// Set once we've written the profile at exit, to tell the background thread to leave things alone:
+static bool stopped = false;
+
+static void handleSigprof(int signum, siginfo_t* info, void* _context) {
+    uint64_t idx = samples_written.load(std::memory_order_relaxed);
+    if (idx - samples_read.load(std::memory_order_acquire) >= NUM_SAMPLE_SLOTS) {
+        samples_dropped++;
+        return;
+    }
+
+    Sample &s = samples[idx % NUM_SAMPLE_SLOTS];
+    ucontext_t* context = static_cast<ucontext_t*>(_context);
+    s.frames[0] = (void*)context->uc_mcontext.gregs[REG_RIP];
+    s.nframes = 1;
+
+    // Everything (including the jitted code) keeps frame pointers:
+    uintptr_t fp = context->uc_mcontext.gregs[REG_RBP];
+    while (s.nframes < MAX_FRAMES && fp >= stack_lo && fp + 16 <= stack_hi && (fp & 7) == 0) {
+        uintptr_t* frame = (uintptr_t*)fp;
+        s.frames[s.nframes++] = (void*)frame[1];
+        if (frame[0] <= fp)
+            break;
+        fp = frame[0];
+    }
+
+    samples_written.store(idx + 1, std::memory_order_release);
+}
+
+static void handleSigusr2(int signum) {
+    dump_requested = true;
+}
+
+// Jitted functions are named <python name>_e<effort>[_osr<block>_from_<parent's name>]_<n>, by
+// getUniqueFunctionName() in irgen.cpp; checks whether the part of name starting at i is that suffix.
+static bool isCompiledSuffix(const std::string &name, size_t i) {
+    if (i + 3 > name.size() || !isdigit(name[i + 2]))
+        return false;
+    size_t effort_end = i + 3;
+
+    size_t last = name.rfind('_');
+    if (last < effort_end || last + 1 == name.size())
+        return false;
+    for (size_t j = last + 1; j < name.size(); j++) {
+        if (!isdigit(name[j]))
+            return false;
+    }
+
+    return last == effort_end || name.compare(effort_end, 4, "_osr") == 0;
+}
+
+static std::string pythonFunctionName(const std::string &jitted_name) {
+    for (size_t i = jitted_name.find("_e"); i != std::string::npos; i = jitted_name.find("_e", i + 1)) {
+        if (isCompiledSuffix(jitted_name, i))
+            return jitted_name.substr(0, i);
+    }
+    return jitted_name;
+}
+
+// Has to be called with sampler_lock held.
+static void drainSamples() {
+    uint64_t end = samples_written.load(std::memory_order_acquire);
+    uint64_t idx = samples_read.load(std::memory_order_relaxed);
+
+    std::unordered_map<void*, std::string> python_names;
+    std::vector<std::string> frames;
+    for (; idx < end; idx++) {
+        Sample &s = samples[idx % NUM_SAMPLE_SLOTS];
+
+        frames.clear();
+        for (int i = 0; i < s.nframes; i++) {
+            // Return addresses point to the instruction after the call, which could be in the next function:
+            void* addr = (char*)s.frames[i] - (i > 0 ? 1 : 0);
+
+            auto it = python_names.find(addr);
+            if (it == python_names.end()) {
+                std::string name;
+                if (g.func_addr_registry.getFuncNameContaining(addr, &name))
+                    name = pythonFunctionName(name);
+                else
+                    name.clear();
+                it = python_names.insert(std::make_pair(addr, name)).first;
+            }
+
+            if (it->second.size()) {
+                frames.push_back(it->second);
+            } else if (i == 0) {
+                bool found;
+                std::string native = g.func_addr_registry.getFuncNameAtAddress(addr, true, &found);
+                frames.push_back("[" + native + "]");
+            }
+        }
+
+        std::string stack;
+        for (int i = frames.size() - 1; i >= 0; i--) {
+            if (stack.size())
+                stack += ';';
+            stack += frames[i];
+        }
+        (*stack_counts)[stack]++;
+
+        samples_read.store(idx + 1, std::memory_order_release);
+    }
+}
+
+// Has to be called with sampler_lock held.
+static void writeProfile() {
+    FILE* f = fopen(profile_filename, "w");
+    if (!f) {
+        fprintf(stderr, "Error: couldn't write the profile to %s\n", profile_filename);
+        return;
+    }
+    for (auto &p : *stack_counts)
+        fprintf(f, "%s %ld\n", p.first.c_str(), p.second);
+    int64_t dropped = samples_dropped.load();
+    if (dropped)
+        fprintf(f, "[dropped samples] %ld\n", dropped);
+    fclose(f);
+}
+
+static void samplerThread() {
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        std::lock_guard<std::mutex> _lock(sampler_lock);
+        if (stopped)
+            return;
+        drainSamples();
+        if (dump_requested.exchange(false))
+            writeProfile();
+    }
+}
+
+static void writeProfileAtExit() {
+    if (getpid() != profiler_pid)
+        return;
+
+    timer_delete(timer);
+
+    std::lock_guard<std::mutex> _lock(sampler_lock);
+    drainSamples();
+    writeProfile();
+    stopped = true;
+}
+
+void startSamplingProfiler(const char* filename) {
+    RELEASE_ASSERT(profile_filename == NULL, "can only start the profiler once");
+    profile_filename = filename;
+    profiler_pid = getpid();
+    stack_counts = new std::map<std::string, int64_t>();
+
+    // Only pages that the handler touches get used:
+    samples = (Sample*)mmap(NULL, sizeof(Sample) * NUM_SAMPLE_SLOTS, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    RELEASE_ASSERT(samples != MAP_FAILED, "");
+
+    pthread_attr_t attr;
+    int code = pthread_getattr_np(pthread_self(), &attr);
+    RELEASE_ASSERT(code == 0, "");
+    void* stack_addr;
+    size_t stack_size;
+    code = pthread_attr_getstack(&attr, &stack_addr, &stack_size);
+    RELEASE_ASSERT(code == 0, "");
+    pthread_attr_destroy(&attr);
+    stack_lo = (uintptr_t)stack_addr;
+    stack_hi = stack_lo + stack_size;
+
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    act.sa_sigaction = handleSigprof;
+    act.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&act.sa_mask);
+    code = sigaction(SIGPROF, &act, NULL);
+    RELEASE_ASSERT(code == 0, "");
+
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = handleSigusr2;
+    act.sa_flags = SA_RESTART;
+    sigemptyset(&act.sa_mask);
+    code = sigaction(SIGUSR2, &act, NULL);
+    RELEASE_ASSERT(code == 0, "");
+
+    // Count the cpu time of just this thread, and send the signals to it, so that samples don't end up
+    // on the compile threads (or get taken when we're just waiting around):
+    clockid_t clock;
+    code = pthread_getcpuclockid(pthread_self(), &clock);
+    RELEASE_ASSERT(code == 0, "");
+
+    sigevent sev;
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = SIGPROF;
+    sev.sigev_notify_thread_id = syscall(SYS_gettid);
+    code = timer_create(clock, &sev, &timer);
+    RELEASE_ASSERT(code == 0, "%s", strerror(errno));
+
+    std::thread(samplerThread).detach();
+    atexit(writeProfileAtExit);
+
+    itimerspec spec;
+    spec.it_interval.tv_sec = spec.it_value.tv_sec = 0;
+    spec.it_interval.tv_nsec = spec.it_value.tv_nsec = SAMPLE_INTERVAL_NS;
+    code = timer_settime(timer, 0, &spec, NULL);
+    RELEASE_ASSERT(code == 0, "");
+}
+
+}
@@ -0,0 +1,31 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CODEGEN_PROFILING_SAMPLER_H
+#define PYSTON_CODEGEN_PROFILING_SAMPLER_H
+
+namespace pyston {
+
+// A sampling profiler that's cheap enough to leave on in production.  Every 10ms of cpu time that the
+// main thread uses, a SIGPROF handler walks its frame pointers and stashes the return addresses away;
+// a background thread then turns those into python-level stacks: the jitted frames, by the name of
+// the python function, plus the native function on top if that's where we were.
+//
+// The totals get written to filename in the "collapsed stacks" format that flamegraph.pl takes, at
+// exit and whenever the process gets a SIGUSR2.  Forked children don't get profiled.
+void startSamplingProfiler(const char* filename);
+
+}
+
+#endif
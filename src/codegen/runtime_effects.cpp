@@ -0,0 +1,225 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+#include "core/common.h"
+#include "core/threading.h"
+#include "core/types.h"
+
+#include "codegen/codegen.h"
+#include "codegen/irgen/hooks.h"
+#include "codegen/runtime_effects.h"
+#include "codegen/type_recording.h"
+#include "codegen/profiling/line_profiler.h"
+
+#include "runtime/int.h"
+#include "runtime/float.h"
+#include "runtime/gc_runtime.h"
+#include "runtime/types.h"
+#include "runtime/objmodel.h"
+#include "runtime/str.h"
+
+#include "runtime/inline/boxing.h"
+
+namespace pyston {
+
+#define R EFFECT_READS
+#define W EFFECT_WRITES
+#define ARGMEM EFFECT_ARGMEM_ONLY
+#define CAPTURES EFFECT_CAPTURES
+#define ALLOCATES EFFECT_ALLOCATES
+#define RAISES EFFECT_MAY_RAISE
+#define ANYTHING EFFECT_ANYTHING
+#define NONE 0
+#define E(func, effects) { (void*)func, STRINGIFY(func), effects }
+
+// Grouped the same way as initGlobalFuncs.  When in doubt, say more: getting one of these wrong lets
+// the optimizer move loads and stores across calls that can see them.
+static const RuntimeFunctionEffects effects_table[] = {
+    E(printf, R | W),
+    E(my_assert, RAISES),
+    E(malloc, ALLOCATES),
+    E(free, R | W | ARGMEM),
+
+    // The boxing functions only write to the objects they create; the ones that box pointers keep them:
+    E(boxCLFunction, ALLOCATES | CAPTURES),
+    E(boxCLFunctionDefaults, R | ALLOCATES | CAPTURES),
+    E(boxCLFunctionClosure, R | ALLOCATES | CAPTURES),
+    E(unboxCLFunction, R | ARGMEM),
+    // (gives the class its __name__ and __module__, which get looked up on the module)
+    E(createClass, R | ALLOCATES | CAPTURES),
+    // The small ints and the bools are preallocated, and get read out of a table:
+    E(boxInt, R | ALLOCATES),
+    E(unboxInt, R | ARGMEM),
+    E(boxFloat, ALLOCATES),
+    E(unboxFloat, R | ARGMEM),
+    E(boxStringPtr, R | ALLOCATES),
+    E(boxInstanceMethod, ALLOCATES | CAPTURES),
+    E(boxBool, R),
+    E(unboxBool, R | ARGMEM),
+    // These copy the elements out of the array they're passed, so that doesn't escape (the elements
+    // already have, by getting stored there):
+    E(createTuple, R | ALLOCATES),
+    // (returns its first argument)
+    E(createTupleInPlace, R | W | CAPTURES),
+    E(createList, ALLOCATES),
+    E(createListSized, ALLOCATES),
+    E(createDict, ALLOCATES),
+    E(createSlice, ALLOCATES | CAPTURES),
+    E(listSliceUnboxed, R | ALLOCATES),
+    E(strSliceUnboxed, R | ALLOCATES),
+    E(listNonzeroUnboxed, R | ARGMEM),
+    E(tupleNonzeroUnboxed, R | ARGMEM),
+    E(dictNonzeroUnboxed, R | ARGMEM),
+    E(strNonzeroUnboxed, R | ARGMEM),
+    E(listLenUnboxed, R | ARGMEM),
+    E(tupleLenUnboxed, R | ARGMEM),
+    E(dictLenUnboxed, R | ARGMEM),
+    E(strLenUnboxed, R | ARGMEM),
+    // (compares the strings' buffers, which aren't argument memory)
+    E(strEqUnboxed, R),
+    // (raises if the sum overflows)
+    E(xrangeSumUnboxed, R | ARGMEM),
+    E(createClosure, ALLOCATES | CAPTURES),
+
+    // Everything that can dispatch to Python-level methods:
+    E(getattr, ANYTHING),
+    E(setattr, ANYTHING),
+    E(getitem, ANYTHING),
+    E(setitem, ANYTHING),
+    // (creates the name's global cell the first time, and patches ICs)
+    E(getGlobal, ANYTHING),
+    E(binop, ANYTHING),
+    E(compare, ANYTHING),
+    E(nonzero, ANYTHING),
+    E(print, ANYTHING),
+    E(unboxedLen, ANYTHING),
+    E(getclsattr, ANYTHING),
+    E(unaryop, ANYTHING),
+    E(import, ANYTHING),
+    E(iterNext, ANYTHING),
+    // (it calls the exception's constructor)
+    E(raise3, ANYTHING),
+
+    // These only look at their arguments, to make the error message:
+    E(checkUnpackingLength, RAISES),
+    E(raiseAttributeError, R | RAISES),
+    E(raiseAttributeErrorStr, R | RAISES),
+    E(raiseNotIterableError, R | RAISES),
+    E(assertNameDefined, R | RAISES),
+    E(raiseUndefinedClosureName, R | RAISES),
+
+    E(printFloat, R | W),
+    E(listAppendInternal, R | W | CAPTURES | ALLOCATES),
+
+    // The barrier only writes to the collector's data structures, which jitted code never looks at, but
+    // it has to stay after the store that it's for, so it counts as reading the parent object:
+    E(rt_write_barrier, R | ARGMEM),
+
+    E(dump, R | W),
+
+    E(runtimeCall, ANYTHING),
+    E(runtimeCallKeywords, ANYTHING),
+    E(callattr, ANYTHING),
+
+    E(reoptCompiledFunc, ANYTHING),
+    E(compilePartialFunc, ANYTHING),
+    E(guardFailed, ANYTHING),
+    E(recordType, R | W | ARGMEM),
+    E(recordCallee, R | W | ARGMEM),
+    // Lets the other threads run:
+    E(gilYield, ANYTHING),
+    // (remembers the entry until the next call, and adds the time since the last one to that one's)
+    E(lineProfilerHit, R | W | CAPTURES),
+    E(strModCompiled, ANYTHING),
+
+    E(add_i64_i64, RAISES),
+    E(sub_i64_i64, RAISES),
+    E(mul_i64_i64, RAISES),
+    E(div_i64_i64, RAISES),
+    E(mod_i64_i64, RAISES),
+    E(pow_i64_i64, RAISES),
+
+    E(div_float_float, RAISES),
+    E(floordiv_float_float, RAISES),
+    E(mod_float_float, RAISES),
+    E(pow_float_float, NONE),
+};
+
+#undef R
+#undef W
+#undef ARGMEM
+#undef CAPTURES
+#undef ALLOCATES
+#undef RAISES
+#undef ANYTHING
+#undef NONE
+#undef E
+
+static std::once_flag index_built;
+static std::unordered_map<void*, const RuntimeFunctionEffects*> by_address;
+static std::unordered_map<std::string, const RuntimeFunctionEffects*> by_name;
+
+static void buildIndex() {
+    std::call_once(index_built, []() {
+        for (const RuntimeFunctionEffects &e : effects_table) {
+            by_address[e.func] = &e;
+            by_name[e.name] = &e;
+            // The C++ functions are in the stdlib module under their mangled names:
+            bool found;
+            std::string symbol = g.func_addr_registry.getFuncNameAtAddress(e.func, false, &found);
+            if (found)
+                by_name[symbol] = &e;
+        }
+    });
+}
+
+const RuntimeFunctionEffects* getRuntimeFunctionEffects(void* func) {
+    buildIndex();
+    auto it = by_address.find(func);
+    if (it == by_address.end())
+        return NULL;
+    return it->second;
+}
+
+const RuntimeFunctionEffects* getRuntimeFunctionEffects(const llvm::CallInst* call) {
+    const llvm::Value* callee = call->getCalledValue();
+    if (const llvm::Function* f = llvm::dyn_cast<llvm::Function>(callee)) {
+        buildIndex();
+        auto it = by_name.find(f->getName());
+        if (it == by_name.end())
+            return NULL;
+        return it->second;
+    }
+
+    // irgen calls through the functions' addresses, cast to the right function type:
+    const llvm::ConstantExpr* ce = llvm::dyn_cast<llvm::ConstantExpr>(callee);
+    if (!ce || !ce->isCast())
+        return NULL;
+    const llvm::ConstantInt* addr = llvm::dyn_cast<llvm::ConstantInt>(ce->getOperand(0));
+    if (!addr)
+        return NULL;
+    return getRuntimeFunctionEffects((void*)addr->getSExtValue());
+}
+
+}
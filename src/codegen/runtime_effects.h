@@ -0,0 +1,74 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CODEGEN_RUNTIMEEFFECTS_H
+#define PYSTON_CODEGEN_RUNTIMEEFFECTS_H
+
+namespace llvm {
+class CallInst;
+class Value;
+}
+
+namespace pyston {
+
+// What the runtime functions that jitted code calls are able to do, as far as the optimization passes
+// (PystonAA, escape analysis, dead_allocs) are concerned; anything that isn't in the table gets treated
+// as doing everything.  Every function that initGlobalFuncs hands to irgen has to have an entry
+// (which getFunc and addFunc check).
+enum RuntimeEffect {
+    // Loads from memory that existed before the call:
+    EFFECT_READS = 1,
+    // Stores to memory that existed before the call:
+    EFFECT_WRITES = 2,
+    // Only reads/writes memory that its pointer arguments point into:
+    EFFECT_ARGMEM_ONLY = 4,
+    // Holds on to (or returns) one of its pointer arguments, so it escapes:
+    EFFECT_CAPTURES = 8,
+    // Allocates new objects, which could trigger a collection; the memory is new, so this on its own
+    // doesn't count as writing:
+    EFFECT_ALLOCATES = 16,
+    // Can raise an exception (which, for now, means exiting):
+    EFFECT_MAY_RAISE = 32,
+
+    // For the functions that can end up running arbitrary Python code (or letting other threads run):
+    EFFECT_ANYTHING = EFFECT_READS | EFFECT_WRITES | EFFECT_CAPTURES | EFFECT_ALLOCATES | EFFECT_MAY_RAISE,
+};
+
+struct RuntimeFunctionEffects {
+    void* func;
+    const char* name;
+    int effects;
+
+    bool reads() const { return effects & EFFECT_READS; }
+    bool writes() const { return effects & EFFECT_WRITES; }
+    bool argMemOnly() const { return effects & EFFECT_ARGMEM_ONLY; }
+    bool captures() const { return effects & EFFECT_CAPTURES; }
+    bool allocates() const { return effects & EFFECT_ALLOCATES; }
+    bool mayRaise() const { return effects & EFFECT_MAY_RAISE; }
+
+    // Whether a call can be deleted if nothing uses its result:
+    bool removableIfUnused() const {
+        return !(effects & (EFFECT_WRITES | EFFECT_CAPTURES | EFFECT_ALLOCATES | EFFECT_MAY_RAISE));
+    }
+};
+
+// Looks up the function at that address; returns NULL if it's not in the table.
+const RuntimeFunctionEffects* getRuntimeFunctionEffects(void* func);
+// Looks up whatever's being called, which can be either an embedded function pointer (what irgen
+// emits) or a declaration from the stdlib module (what shows up once things get inlined).
+const RuntimeFunctionEffects* getRuntimeFunctionEffects(const llvm::CallInst* call);
+
+}
+
+#endif
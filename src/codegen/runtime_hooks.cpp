@@ -24,6 +24,7 @@
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/PassManager.h"
 
+#include "core/threading.h"
 #include "core/types.h"
 
 #include "codegen/runtime_hooks.h"
@@ -31,12 +32,16 @@
 #include "codegen/irgen.h"
 #include "codegen/irgen/hooks.h"
 #include "codegen/irgen/util.h"
+#include "codegen/runtime_effects.h"
+#include "codegen/type_recording.h"
+#include "codegen/profiling/line_profiler.h"
 
 #include "runtime/int.h"
 #include "runtime/float.h"
 #include "runtime/gc_runtime.h"
 #include "runtime/types.h"
 #include "runtime/objmodel.h"
+#include "runtime/str.h"
 
 #include "runtime/inline/boxing.h"
 
@@ -51,11 +56,16 @@ static llvm::Function* lookupFunction(const std::string &name) {
 static llvm::Value* getFunc(void* func, const char* name) {
     llvm::Function *f = lookupFunction(name);
     ASSERT(f, "%s", name);
-    g.func_addr_registry.registerFunction(name, func, 0, f);
+    ASSERT(getRuntimeFunctionEffects(func), "%s needs an entry in codegen/runtime_effects.cpp", name);
+    // Compile threads make their own copies of these, but the registry is shared (and will translate
+    // the function into the asking thread's context):
+    if (g.context == &llvm::getGlobalContext())
+        g.func_addr_registry.registerFunction(name, func, 0, f);
     return embedConstantPtr(func, f->getType());
 }
 
 static llvm::Value* addFunc(void *func, llvm::Type* rtn_type, llvm::ArrayRef<llvm::Type*> arg_types, bool varargs=false) {
+    ASSERT(getRuntimeFunctionEffects(func), "%p needs an entry in codegen/runtime_effects.cpp", func);
     llvm::FunctionType *ft = llvm::FunctionType::get(rtn_type, arg_types, varargs);
     return embedConstantPtr(func, ft->getPointerTo());
 }
@@ -100,7 +110,7 @@ static llvm::Value* addFunc(void *func, llvm::Type* rtn_type, llvm::Type* arg1,
 }
 
 void initGlobalFuncs(GlobalState &g) {
-    g.llvm_opaque_type = llvm::StructType::create(g.context, "opaque");
+    g.llvm_opaque_type = llvm::StructType::create(*g.context, "opaque");
 
     g.llvm_clfunction_type_ptr = lookupFunction("boxCLFunction")->arg_begin()->getType();
     g.llvm_module_type_ptr = lookupFunction("createModule")->getReturnType();
@@ -120,6 +130,13 @@ void initGlobalFuncs(GlobalState &g) {
 
     g.llvm_str_type_ptr = lookupFunction("boxStringPtr")->arg_begin()->getType();
 
+    llvm::Type* list_type = g.stdlib_module->getTypeByName("struct.pyston::BoxedList");
+    assert(list_type);
+    g.llvm_list_type_ptr = list_type->getPointerTo();
+    llvm::Type* list_iterator_type = g.stdlib_module->getTypeByName("struct.pyston::BoxedListIterator");
+    assert(list_iterator_type);
+    g.llvm_list_iterator_type_ptr = list_iterator_type->getPointerTo();
+
 
 #define GET(N) g.funcs.N = getFunc((void*)N, STRINGIFY(N))
 
@@ -129,6 +146,8 @@ void initGlobalFuncs(GlobalState &g) {
     g.funcs.free = addFunc((void*)free, g.void_, g.i8_ptr);
 
     GET(boxCLFunction);
+    GET(boxCLFunctionDefaults);
+    GET(boxCLFunctionClosure);
     GET(unboxCLFunction);
     GET(createClass);
     GET(boxInt);
@@ -140,9 +159,24 @@ void initGlobalFuncs(GlobalState &g) {
     GET(boxBool);
     GET(unboxBool);
     GET(createTuple);
+    GET(createTupleInPlace);
     GET(createList);
+    GET(createListSized);
     GET(createDict);
     GET(createSlice);
+    GET(listSliceUnboxed);
+    GET(strSliceUnboxed);
+    GET(listNonzeroUnboxed);
+    GET(tupleNonzeroUnboxed);
+    GET(dictNonzeroUnboxed);
+    GET(strNonzeroUnboxed);
+    GET(listLenUnboxed);
+    GET(tupleLenUnboxed);
+    GET(dictLenUnboxed);
+    GET(strLenUnboxed);
+    GET(strEqUnboxed);
+    GET(xrangeSumUnboxed);
+    GET(createClosure);
 
     GET(getattr);
     GET(setattr);
@@ -157,16 +191,21 @@ void initGlobalFuncs(GlobalState &g) {
     GET(getclsattr);
     GET(unaryop);
     GET(import);
+    GET(iterNext);
 
     GET(checkUnpackingLength);
     GET(raiseAttributeError);
     GET(raiseAttributeErrorStr);
     GET(raiseNotIterableError);
+    GET(raise3);
     GET(assertNameDefined);
+    GET(raiseUndefinedClosureName);
 
     GET(printFloat);
     GET(listAppendInternal);
 
+    GET(rt_write_barrier);
+
     GET(dump);
 
     g.funcs.runtimeCall = getFunc((void*)runtimeCall, "runtimeCall");
@@ -174,6 +213,7 @@ void initGlobalFuncs(GlobalState &g) {
     g.funcs.runtimeCall1 = addFunc((void*)runtimeCall, g.llvm_value_type_ptr, g.llvm_value_type_ptr, g.i64, g.llvm_value_type_ptr);
     g.funcs.runtimeCall2 = addFunc((void*)runtimeCall, g.llvm_value_type_ptr, g.llvm_value_type_ptr, g.i64, g.llvm_value_type_ptr, g.llvm_value_type_ptr);
     g.funcs.runtimeCall3 = addFunc((void*)runtimeCall, g.llvm_value_type_ptr, g.llvm_value_type_ptr, g.i64, g.llvm_value_type_ptr, g.llvm_value_type_ptr, g.llvm_value_type_ptr);
+    g.funcs.runtimeCallKeywords = addFunc((void*)runtimeCallKeywords, g.llvm_value_type_ptr, g.llvm_value_type_ptr, g.i8_ptr, g.llvm_value_type_ptr->getPointerTo());
 
     g.funcs.callattr = getFunc((void*)callattr, "callattr");
     g.funcs.callattr0 = addFunc((void*)callattr, g.llvm_value_type_ptr, g.llvm_value_type_ptr, g.llvm_str_type_ptr, g.i1, g.i64);
@@ -183,12 +223,22 @@ void initGlobalFuncs(GlobalState &g) {
 
     g.funcs.reoptCompiledFunc = addFunc((void*)reoptCompiledFunc, g.i8_ptr, g.i8_ptr);
     g.funcs.compilePartialFunc = addFunc((void*)compilePartialFunc, g.i8_ptr, g.i8_ptr);
-
+    g.funcs.guardFailed = addFunc((void*)guardFailed, g.void_, g.i8_ptr);
+    g.funcs.recordType = addFunc((void*)recordType, g.void_, g.i8_ptr, g.llvm_value_type_ptr);
+    g.funcs.recordCallee = addFunc((void*)recordCallee, g.void_, g.i8_ptr, g.llvm_value_type_ptr);
+    g.funcs.gilYield = addFunc((void*)gilYield, g.void_);
+    g.funcs.lineProfilerHit = addFunc((void*)lineProfilerHit, g.void_, g.i8_ptr);
+    g.funcs.strModCompiled = addFunc((void*)strModCompiled, g.llvm_value_type_ptr, g.i8_ptr, g.i64->getPointerTo());
+
+    g.funcs.add_i64_i64 = getFunc((void*)add_i64_i64, "add_i64_i64");
+    g.funcs.sub_i64_i64 = getFunc((void*)sub_i64_i64, "sub_i64_i64");
+    g.funcs.mul_i64_i64 = getFunc((void*)mul_i64_i64, "mul_i64_i64");
     g.funcs.div_i64_i64 = getFunc((void*)div_i64_i64, "div_i64_i64");
     g.funcs.mod_i64_i64 = getFunc((void*)mod_i64_i64, "mod_i64_i64");
     g.funcs.pow_i64_i64 = getFunc((void*)pow_i64_i64, "pow_i64_i64");
 
     GET(div_float_float);
+    GET(floordiv_float_float);
     GET(mod_float_float);
     GET(pow_float_float);
 }
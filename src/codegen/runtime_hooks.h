@@ -20,17 +20,21 @@ namespace pyston {
 struct GlobalFuncs {
     llvm::Value *printf, *my_assert, *malloc, *free;
 
-    llvm::Value *boxInt, *unboxInt, *boxFloat, *unboxFloat, *boxStringPtr, *boxCLFunction, *unboxCLFunction, *boxInstanceMethod, *boxBool, *unboxBool, *createTuple, *createDict, *createList, *createSlice, *createClass;
-    llvm::Value *getattr, *setattr, *print, *nonzero, *binop, *compare, *unboxedLen, *getitem, *getclsattr, *getGlobal, *setitem, *unaryop, *import;
-    llvm::Value *checkUnpackingLength, *raiseAttributeError, *raiseAttributeErrorStr, *raiseNotIterableError, *assertNameDefined;
+    llvm::Value *boxInt, *unboxInt, *boxFloat, *unboxFloat, *boxStringPtr, *boxCLFunction, *boxCLFunctionDefaults, *boxCLFunctionClosure, *unboxCLFunction, *boxInstanceMethod, *boxBool, *unboxBool, *createTuple, *createTupleInPlace, *createDict, *createList, *createListSized, *createSlice, *listSliceUnboxed, *strSliceUnboxed, *listNonzeroUnboxed, *tupleNonzeroUnboxed, *dictNonzeroUnboxed, *strNonzeroUnboxed, *listLenUnboxed, *tupleLenUnboxed, *dictLenUnboxed, *strLenUnboxed, *strEqUnboxed, *xrangeSumUnboxed, *createClosure, *createClass;
+    llvm::Value *getattr, *setattr, *print, *nonzero, *binop, *compare, *unboxedLen, *getitem, *getclsattr, *getGlobal, *setitem, *unaryop, *import, *iterNext;
+    llvm::Value *checkUnpackingLength, *raiseAttributeError, *raiseAttributeErrorStr, *raiseNotIterableError, *raise3, *assertNameDefined, *raiseUndefinedClosureName;
     llvm::Value *printFloat, *listAppendInternal;
+    llvm::Value *rt_write_barrier;
     llvm::Value *dump;
-    llvm::Value *runtimeCall0, *runtimeCall1, *runtimeCall2, *runtimeCall3, *runtimeCall;
+    llvm::Value *runtimeCall0, *runtimeCall1, *runtimeCall2, *runtimeCall3, *runtimeCall, *runtimeCallKeywords;
     llvm::Value *callattr0, *callattr1, *callattr2, *callattr3, *callattr;
-    llvm::Value *reoptCompiledFunc, *compilePartialFunc;
+    llvm::Value *reoptCompiledFunc, *compilePartialFunc, *recordType, *recordCallee, *guardFailed;
+    llvm::Value *gilYield;
+    llvm::Value *lineProfilerHit;
+    llvm::Value *strModCompiled;
 
-    llvm::Value *div_i64_i64, *mod_i64_i64, *pow_i64_i64;
-    llvm::Value *div_float_float, *mod_float_float, *pow_float_float;
+    llvm::Value *add_i64_i64, *sub_i64_i64, *mul_i64_i64, *div_i64_i64, *mod_i64_i64, *pow_i64_i64;
+    llvm::Value *div_float_float, *floordiv_float_float, *mod_float_float, *pow_float_float;
 };
 
 }
@@ -40,6 +40,79 @@ StackMap* parseStackMap() {
     return rtn;
 }
 
+bool StackMap::RecordIterator::next(Record &r) {
+    if (remaining == 0)
+        return false;
+    remaining--;
+
+    union {
+        const uint8_t* u8;
+        const uint16_t* u16;
+        const uint32_t* u32;
+        const uint64_t* u64;
+        const Record::Location* record_loc;
+        const Record::LiveOut* record_liveout;
+    } p;
+    p.u8 = ptr;
+
+    r.id = *p.u64++;
+    r.offset = *p.u32++;
+    r.flags = *p.u16++; // reserved (record flags)
+
+    r.num_locations = *p.u16++;
+    assert(sizeof(Record::Location) == sizeof(*p.u64));
+    r.locations = p.record_loc;
+    p.record_loc += r.num_locations;
+
+    p.u16++; // padding
+    r.num_live_outs = *p.u16++;
+    r.live_outs = p.record_liveout;
+    p.record_liveout += r.num_live_outs;
+    if (r.num_live_outs % 2 == 0)
+        p.u32++; // pad to 8-byte boundary
+
+    ptr = p.u8;
+    return true;
+}
+
+static void dumpRecord(const StackMap::Record &record) {
+    // from http://lxr.free-electrons.com/source/tools/perf/arch/x86/util/dwarf-regs.c
+    // TODO this probably can be fetched more portably from the llvm target files
+    const char *dwarf_reg_names[] = {
+        "%rax",
+        "%rdx",
+        "%rcx",
+        "%rbx",
+        "%rsi",
+        "%rdi",
+        "%rbp",
+        "%rsp",
+        "%r8",
+        "%r9",
+        "%r10",
+        "%r11",
+        "%r12",
+        "%r13",
+        "%r14",
+        "%r15",
+    };
+
+    printf("Stackmap record %ld at 0x%x has %d locations:\n", record.id, record.offset, record.num_locations);
+    for (int j = 0; j < record.num_locations; j++) {
+        const StackMap::Record::Location &r = record.locations[j];
+        if (r.type == 1) {
+            printf("Location %d: type %d (reg), reg %d (%s), offset %d\n", j, r.type, r.regnum, dwarf_reg_names[r.regnum], r.offset);
+        } else {
+            printf("Location %d: type %d, reg %d, offset %d\n", j, r.type, r.regnum, r.offset);
+        }
+    }
+
+    for (int i = 0; i < record.num_live_outs; i++) {
+        const StackMap::Record::LiveOut &r = record.live_outs[i];
+        printf("Live out %d: reg #%d (?), size %d\n", i, r.regnum, r.size);
+    }
+}
+
 class StackmapJITEventListener : public llvm::JITEventListener {
     private:
     public:
@@ -77,8 +150,6 @@ void StackmapJITEventListener::NotifyObjectEmitted(const llvm::ObjectImage &Obj)
                 const uint16_t* u16;
                 const uint32_t* u32;
                 const uint64_t* u64;
-                const StackMap::Record::Location* record_loc;
-                const StackMap::Record::LiveOut* record_liveout;
                 const StackMap::StackSizeRecord* size_record;
             } ptr;
             const int8_t* start_ptr = ptr.i8 = (const int8_t*)Obj.getData().data() + stackmap_offset;
@@ -110,66 +181,6 @@ void StackmapJITEventListener::NotifyObjectEmitted(const llvm::ObjectImage &Obj)
 
             if (VERBOSITY() >= 2) printf("%d records\n", nrecords);
 
-            for (int i = 0; i < nrecords; i++) {
-                StackMap::Record *record = new StackMap::Record();
-                cur_map->records.push_back(record);
-
-                record->id = *ptr.u64++;
-                record->offset = *ptr.u32++;
-                record->flags = *ptr.u16++; // reserved (record flags)
-
-                int numlocations = *ptr.u16++;
-
-                if (VERBOSITY() >= 2) printf("Stackmap record %ld at 0x%x has %d locations:\n", record->id, record->offset, numlocations);
-                for (int j = 0; j < numlocations; j++) {
-                    assert(sizeof(StackMap::Record::Location) == sizeof(*ptr.u64));
-                    const StackMap::Record::Location &r = *ptr.record_loc++;
-                    record->locations.push_back(r);
-
-                    // from http://lxr.free-electrons.com/source/tools/perf/arch/x86/util/dwarf-regs.c
-                    // TODO this probably can be fetched more portably from the llvm target files
-                    const char *dwarf_reg_names[] = {
-                        "%rax",
-                        "%rdx",
-                        "%rcx",
-                        "%rbx",
-                        "%rsi",
-                        "%rdi",
-                        "%rbp",
-                        "%rsp",
-                        "%r8",
-                        "%r9",
-                        "%r10",
-                        "%r11",
-                        "%r12",
-                        "%r13",
-                        "%r14",
-                        "%r15",
-                    };
-                    if (VERBOSITY() >= 2) {
-                        if (r.type == 1) {
-                            printf("Location %d: type %d (reg), reg %d (%s), offset %d\n", j, r.type, r.regnum, dwarf_reg_names[r.regnum], r.offset);
-                        } else {
-                            printf("Location %d: type %d, reg %d, offset %d\n", j, r.type, r.regnum, r.offset);
-                        }
-                    }
-                }
-
-                ptr.u16++; // padding
-                int num_live_outs = *ptr.u16++;
-                for (int i = 0; i < num_live_outs; i++) {
-                    const StackMap::Record::LiveOut &r = *ptr.record_liveout++;
-                    record->live_outs.push_back(r);
-
-                    if (VERBOSITY() >= 2) {
-                        printf("Live out %d: reg #%d (?), size %d\n", i, r.regnum, r.size);
-                    }
-                }
-                if (num_live_outs % 2 == 0)
-                    ptr.u32++; // pad to 8-byte boundary
-            }
-
-#ifndef NDEBUG
             uint64_t stackmap_size;
             llvm::object::section_iterator section(Obj.end_sections());
             code = I->getSection(section);
@@ -178,7 +189,29 @@ void StackmapJITEventListener::NotifyObjectEmitted(const llvm::ObjectImage &Obj)
             assert(stackmap_size > 0);
             assert(!code);
 
-            ASSERT(ptr.i8 - start_ptr == stackmap_size, "%ld %ld", ptr.i8 - start_ptr, stackmap_size);
+            // The records get decoded lazily, whenever someone goes through them, so all that has to happen
+            // here is to copy them out of the object image (which doesn't stick around).
+            int header_bytes = ptr.i8 - start_ptr;
+            assert(header_bytes <= stackmap_size);
+            cur_map->num_records = nrecords;
+            cur_map->record_data.assign(ptr.u8, ptr.u8 + (stackmap_size - header_bytes));
+
+            if (VERBOSITY() >= 2) {
+                StackMap::RecordIterator it(cur_map);
+                StackMap::Record record;
+                while (it.next(record))
+                    dumpRecord(record);
+            }
+
+#ifndef NDEBUG
+            {
+                StackMap::RecordIterator it(cur_map);
+                StackMap::Record record;
+                while (it.next(record)) {
+                }
+                const uint8_t* end = it.position();
+                ASSERT(end - cur_map->record_data.data() == cur_map->record_data.size(), "%ld %ld", end - cur_map->record_data.data(), cur_map->record_data.size());
+            }
 #endif
         }
 
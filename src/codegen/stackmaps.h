@@ -15,6 +15,7 @@
 #ifndef PYSTON_CODEGEN_STACKMAPS_H
 #define PYSTON_CODEGEN_STACKMAPS_H
 
+#include <cstdint>
 #include <vector>
 
 namespace llvm {
@@ -29,6 +30,8 @@ struct StackMap {
         uint64_t stack_size;
     };
 
+    // Records point straight into the copy of the section that the StackMap holds on to, rather than
+    // each getting unpacked into their own vectors; they get decoded one at a time by RecordIterator.
     struct Record {
         struct __attribute__((__packed__)) Location {
             uint8_t type;
@@ -46,14 +49,29 @@ struct StackMap {
         uint64_t id;
         uint32_t offset;
         uint16_t flags;
-        std::vector<Location> locations;
-        std::vector<LiveOut> live_outs;
+        int num_locations;
+        const Location* locations;
+        int num_live_outs;
+        const LiveOut* live_outs;
+    };
+
+    class RecordIterator {
+        private:
+            const uint8_t* ptr;
+            int remaining;
+
+        public:
+            RecordIterator(const StackMap* map) : ptr(map->record_data.data()), remaining(map->num_records) {}
+            // Fills in r and returns true, or returns false once all the records have been gone through.
+            bool next(Record &r);
+            const uint8_t* position() const { return ptr; }
     };
 
     std::vector<StackSizeRecord> stack_size_records;
     uint32_t header;
     std::vector<uint64_t> constants;
-    std::vector<Record*> records;
+    int num_records;
+    std::vector<uint8_t> record_data;
 };
 
 StackMap* parseStackMap();
@@ -0,0 +1,261 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <stdint.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "core/common.h"
+#include "core/stats.h"
+#include "core/threading.h"
+
+#include "codegen/startup_server.h"
+#include "codegen/irgen/hooks.h"
+
+#include "gc/collector.h"
+
+namespace pyston {
+
+// A request is the working directory and the script's path, each nul-terminated, sent along with the client's
+// stdin, stdout and stderr.  The reply is the script's exit code, as an int32_t, once it's done.
+static const int NUM_PASSED_FDS = 3;
+static const int MAX_REQUEST_SIZE = 2 * PATH_MAX;
+
+static void fillSocketAddress(const char* socket_path, sockaddr_un *addr) {
+    if (strlen(socket_path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Error: the startup server's socket path is too long: %s\n", socket_path);
+        exit(1);
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, socket_path);
+}
+
+static void serverError(const char* what) __attribute__((__noreturn__));
+static void serverError(const char* what) {
+    fprintf(stderr, "Error: startup server: %s: %s\n", what, strerror(errno));
+    exit(1);
+}
+
+static bool readRequest(int conn, std::string *cwd, std::string *fn, int *fds) {
+    char buf[MAX_REQUEST_SIZE];
+    iovec iov = {buf, sizeof(buf)};
+    char control[CMSG_SPACE(NUM_PASSED_FDS * sizeof(int))];
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = recvmsg(conn, &msg, 0);
+    cmsghdr *cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+            || cmsg->cmsg_len != CMSG_LEN(NUM_PASSED_FDS * sizeof(int)))
+        return false;
+    memcpy(fds, CMSG_DATA(cmsg), NUM_PASSED_FDS * sizeof(int));
+
+    // The fds come with the first part; the rest of the paths might take a few more reads:
+    size_t size = n;
+    while (std::count(buf, buf + size, '\0') < 2) {
+        if (size == sizeof(buf) || (n = read(conn, buf + size, sizeof(buf) - size)) <= 0) {
+            for (int i = 0; i < NUM_PASSED_FDS; i++)
+                close(fds[i]);
+            return false;
+        }
+        size += n;
+    }
+    *cwd = buf;
+    *fn = buf + cwd->size() + 1;
+    return true;
+}
+
+// Tells the clients of the workers that have exited how it went:
+static void reapWorkers(std::unordered_map<pid_t, int> &running) {
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        std::unordered_map<pid_t, int>::iterator it = running.find(pid);
+        if (it == running.end())
+            continue;
+        int32_t code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        // (if the client has gone away already, there's no one left to tell)
+        send(it->second, &code, sizeof(code), MSG_NOSIGNAL);
+        close(it->second);
+        running.erase(it);
+    }
+}
+
+const char* serveStartupRequests(const char* socket_path) {
+    sockaddr_un addr;
+    fillSocketAddress(socket_path, &addr);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1)
+        serverError("socket");
+    // (a leftover from a server that didn't get to clean up)
+    unlink(socket_path);
+    mode_t old_umask = umask(0077);
+    int r = bind(listen_fd, (sockaddr*)&addr, sizeof(addr));
+    umask(old_umask);
+    if (r == -1)
+        serverError("bind");
+    if (listen(listen_fd, 16) == -1)
+        serverError("listen");
+
+    // Same as for os.fork: collecting now means that the workers don't each end up sweeping (and so copying)
+    // whatever garbage the initialization left behind.
+    gc::runCollection();
+
+    static StatCounter num_startup_requests("num_startup_requests");
+
+    // The connections of the workers that are still running, by pid:
+    std::unordered_map<pid_t, int> running;
+    while (true) {
+        reapWorkers(running);
+
+        pollfd pfd = {listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+        int conn = accept(listen_fd, NULL, NULL);
+        if (conn == -1)
+            continue;
+
+        std::string cwd, fn;
+        int fds[NUM_PASSED_FDS];
+        if (!readRequest(conn, &cwd, &fn, fds)) {
+            close(conn);
+            continue;
+        }
+        num_startup_requests.log();
+
+        // Otherwise anything that's still buffered would get written out by the server and the worker:
+        fflush(NULL);
+
+        beforeFork();
+        threading::beforeFork();
+        pid_t pid = fork();
+        threading::afterFork(pid == 0);
+        afterFork(pid == 0);
+
+        if (pid == 0) {
+            close(listen_fd);
+            close(conn);
+            for (std::unordered_map<pid_t, int>::iterator it = running.begin(), end = running.end(); it != end; ++it)
+                close(it->second);
+
+            // The received fds got the lowest free numbers, in order, so fds[i] >= i, and this never clobbers one
+            // that's still needed:
+            for (int i = 0; i < NUM_PASSED_FDS; i++) {
+                if (fds[i] != i) {
+                    dup2(fds[i], i);
+                    close(fds[i]);
+                }
+            }
+            // The server decided stdout's buffering based on its own stdout:
+            if (isatty(fileno(stdout)))
+                setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+
+            if (chdir(cwd.c_str()) == -1) {
+                fprintf(stderr, "Error: couldn't change to %s: %s\n", cwd.c_str(), strerror(errno));
+                exit(1);
+            }
+            return strdup(fn.c_str());
+        }
+
+        for (int i = 0; i < NUM_PASSED_FDS; i++)
+            close(fds[i]);
+        if (pid == -1) {
+            int32_t code = 1;
+            send(conn, &code, sizeof(code), MSG_NOSIGNAL);
+            close(conn);
+            continue;
+        }
+        running[pid] = conn;
+    }
+}
+
+int runOnStartupServer(const char* socket_path, const char* fn) {
+    sockaddr_un addr;
+    fillSocketAddress(socket_path, &addr);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (sockaddr*)&addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "Error: couldn't connect to the startup server at %s: %s\n", socket_path, strerror(errno));
+        return 1;
+    }
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        fprintf(stderr, "Error: couldn't get the working directory: %s\n", strerror(errno));
+        return 1;
+    }
+    std::string request = std::string(cwd) + '\0' + fn + '\0';
+    if (request.size() > MAX_REQUEST_SIZE) {
+        fprintf(stderr, "Error: the script's path is too long for the startup server\n");
+        return 1;
+    }
+
+    iovec iov = {(void*)request.data(), request.size()};
+    int fds[NUM_PASSED_FDS] = {0, 1, 2};
+    char control[CMSG_SPACE(sizeof(fds))];
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t sent = sendmsg(fd, &msg, 0);
+    size_t total = sent > 0 ? sent : 0;
+    while (sent > 0 && total < request.size()) {
+        sent = write(fd, request.data() + total, request.size() - total);
+        total += sent > 0 ? sent : 0;
+    }
+    if (sent <= 0) {
+        fprintf(stderr, "Error: couldn't send the request to the startup server: %s\n", strerror(errno));
+        return 1;
+    }
+
+    int32_t code;
+    size_t got = 0;
+    ssize_t n;
+    while (got < sizeof(code) && (n = read(fd, (char*)&code + got, sizeof(code) - got)) > 0)
+        got += n;
+    close(fd);
+    if (got < sizeof(code)) {
+        fprintf(stderr, "Error: the startup server didn't say how the script exited\n");
+        return 1;
+    }
+    return code;
+}
+
+}
@@ -0,0 +1,39 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CODEGEN_STARTUPSERVER_H
+#define PYSTON_CODEGEN_STARTUPSERVER_H
+
+namespace pyston {
+
+// The startup server (-Z <socket>) is a preinitialized runtime that stays resident: it does the runtime setup
+// and initCodegen once, and then every script that gets sent to it runs in a fork of it, which starts out with
+// the initialized heap, classes and stdlib already there (and shared with the server until they get written
+// to).  That's the snapshot; there's no file, since the runtime's state isn't all in the gc heap (there are
+// std::strings, hash maps, llvm objects...) and wouldn't be at the same addresses in another process anyway.
+//
+// The client (-z <socket>) connects before doing any initialization of its own, and passes the script's path,
+// its working directory and its stdin/stdout/stderr; it exits with whatever the script exited with.  The
+// server's other options are what apply to the scripts, and only the same user can connect (the socket is
+// created 0600).
+
+// Only returns in the forked children, with the path of the script that it should run.
+const char* serveStartupRequests(const char* socket_path);
+
+// Runs fn on the server listening at socket_path, and returns its exit code.
+int runOnStartupServer(const char* socket_path, const char* fn);
+
+}
+
+#endif
@@ -0,0 +1,131 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "codegen/type_recording.h"
+
+#include "core/common.h"
+
+#include "codegen/irgen/tiering.h"
+
+#include "runtime/types.h"
+
+namespace pyston {
+
+// how many times in a row we have to have seen a class before we'll speculate on it:
+static const int64_t MIN_OBSERVATIONS = 100;
+
+BoxedClass* TypeRecorder::predict() {
+    if (last_count < MIN_OBSERVATIONS)
+        return NULL;
+    // The compiled code is going to embed the class pointer; only the (frozen) builtin classes
+    // are guaranteed to stick around, so don't bother with user classes.
+    if (!last_seen->is_constant)
+        return NULL;
+    return last_seen;
+}
+
+TypeRecorder* TypeFeedback::getRecorder(AST* node) {
+    TypeRecorder* &r = recorders[node];
+    if (r == NULL)
+        r = new TypeRecorder();
+    return r;
+}
+
+BoxedClass* TypeFeedback::predictClassFor(AST* node) {
+    auto it = recorders.find(node);
+    if (it == recorders.end())
+        return NULL;
+    return it->second->predict();
+}
+
+int64_t TypeFeedback::observationsFor(AST* node) {
+    auto it = recorders.find(node);
+    if (it == recorders.end())
+        return 0;
+    return it->second->observations();
+}
+
+CLFunction* CalleeRecorder::predict() {
+    if (last_count < MIN_OBSERVATIONS)
+        return NULL;
+    return last_seen;
+}
+
+CalleeRecorder* TypeFeedback::getCalleeRecorder(AST_Call* node) {
+    CalleeRecorder* &r = callee_recorders[node];
+    if (r == NULL)
+        r = new CalleeRecorder();
+    return r;
+}
+
+CLFunction* TypeFeedback::predictCallee(AST_Call* node) {
+    auto it = callee_recorders.find(node);
+    if (it == callee_recorders.end())
+        return NULL;
+    return it->second->predict();
+}
+
+void TypeFeedback::markSpeculationFailed(AST* node) {
+    if (node == NULL)
+        all_speculations_failed = true;
+    else
+        failed_speculations.insert(node);
+}
+
+bool TypeFeedback::speculationFailed(AST* node) {
+    return all_speculations_failed || failed_speculations.count(node);
+}
+
+int TypeFeedback::speculationBudget() {
+    if (all_speculations_failed)
+        return 0;
+    int nfailed = failed_speculations.size();
+    if (nfailed >= 31)
+        return 0;
+    return getTieringPolicy()->speculation_budget >> nfailed;
+}
+
+int64_t* TypeFeedback::getBlockCounter(CFGBlock* block) {
+    int64_t* &c = block_counts[block];
+    if (c == NULL)
+        c = new int64_t(0);
+    return c;
+}
+
+int64_t TypeFeedback::blockCount(CFGBlock* block) {
+    auto it = block_counts.find(block);
+    if (it == block_counts.end())
+        return -1;
+    return *it->second;
+}
+
+TypeFeedback* getTypeFeedback(SourceInfo* source) {
+    if (source->type_feedback == NULL)
+        source->type_feedback = new TypeFeedback();
+    return source->type_feedback;
+}
+
+extern "C" void recordType(TypeRecorder* recorder, Box* obj) {
+    recorder->record(obj->cls);
+}
+
+extern "C" void recordCallee(CalleeRecorder* recorder, Box* func) {
+    if (func->cls == function_cls)
+        recorder->record(static_cast<BoxedFunction*>(func)->f);
+    else
+        recorder->record(NULL);
+}
+
+}
@@ -0,0 +1,125 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef PYSTON_CODEGEN_TYPERECORDING_H
+#define PYSTON_CODEGEN_TYPERECORDING_H
+
+#include <unordered_map>
+#include <unordered_set>
+
+#include "core/types.h"
+
+namespace pyston {
+
+class AST_Call;
+class CFGBlock;
+
+// Records the classes that get seen at one expression, for the lower tiers to pass on to the
+// speculation done by the higher ones.  We only keep track of the most recent class and how many
+// times in a row we've seen it: anything polymorphic isn't worth speculating on anyway.
+class TypeRecorder {
+    private:
+        BoxedClass* last_seen;
+        int64_t last_count;
+
+    public:
+        TypeRecorder() : last_seen(NULL), last_count(0) {}
+
+        void record(BoxedClass* cls) {
+            if (cls == last_seen) {
+                last_count++;
+            } else {
+                last_seen = cls;
+                last_count = 1;
+            }
+        }
+
+        // Returns NULL if there isn't a class we're confident about.
+        BoxedClass* predict();
+        // How many times in a row we've seen the predicted class:
+        int64_t observations() { return last_count; }
+};
+
+// Records which function gets called at a call site, for the inliner, the same way that TypeRecorder
+// keeps track of classes.  We record the CLFunction rather than the function object since those
+// never get freed.
+class CalleeRecorder {
+    private:
+        CLFunction* last_seen;
+        int64_t last_count;
+
+    public:
+        CalleeRecorder() : last_seen(NULL), last_count(0) {}
+
+        void record(CLFunction* f) {
+            if (f == last_seen) {
+                last_count++;
+            } else {
+                last_seen = f;
+                last_count = 1;
+            }
+        }
+
+        // Returns NULL if this call site isn't (yet) monomorphic.
+        CLFunction* predict();
+};
+
+// The type feedback for one function, shared by all of its versions.  The recorders are
+// embedded into the generated code, so they never get moved or freed.
+class TypeFeedback {
+    private:
+        std::unordered_map<AST*, TypeRecorder*> recorders;
+        std::unordered_map<AST_Call*, CalleeRecorder*> callee_recorders;
+        // Speculations whose guards kept failing, which we shouldn't make again:
+        std::unordered_set<AST*> failed_speculations;
+        bool all_speculations_failed;
+        // How many times each block ran, in the versions that count that (see ENABLE_BLOCK_COUNTS):
+        std::unordered_map<CFGBlock*, int64_t*> block_counts;
+
+    public:
+        TypeFeedback() : all_speculations_failed(false) {}
+
+        TypeRecorder* getRecorder(AST* node);
+        BoxedClass* predictClassFor(AST* node);
+        int64_t observationsFor(AST* node);
+
+        CalleeRecorder* getCalleeRecorder(AST_Call* node);
+        CLFunction* predictCallee(AST_Call* node);
+
+        // Passing NULL means we couldn't tell which speculation was the problem, so don't make any.
+        void markSpeculationFailed(AST* node);
+        bool speculationFailed(AST* node);
+
+        // How many speculations a compile of this function gets to make: the tiering policy's
+        // speculation_budget, halved for each speculation of ours that has failed.
+        int speculationBudget();
+
+        // The counter that the generated code increments every time it enters the block.
+        int64_t* getBlockCounter(CFGBlock* block);
+        // -1 if nothing has been counting the block.
+        int64_t blockCount(CFGBlock* block);
+        // Whether the block got counted, but never ran; speculating or inlining there isn't worth the
+        // guards and the code size.
+        bool isColdBlock(CFGBlock* block) { return blockCount(block) == 0; }
+};
+
+TypeFeedback* getTypeFeedback(SourceInfo* source);
+
+extern "C" void recordType(TypeRecorder* recorder, Box* obj);
+extern "C" void recordCallee(CalleeRecorder* recorder, Box* func);
+
+}
+
+#endif
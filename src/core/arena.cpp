@@ -0,0 +1,49 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdlib>
+
+#include "core/common.h"
+
+#include "core/arena.h"
+
+namespace pyston {
+
+void* Arena::allocateSlowpath(size_t size) {
+    // Big things get a chunk to themselves, so that they don't waste the rest of the current one:
+    if (size > CHUNK_SIZE / 4) {
+        char* rtn = (char*)malloc(size);
+        RELEASE_ASSERT(rtn, "");
+        chunks.push_back(rtn);
+        return rtn;
+    }
+
+    cur = (char*)malloc(CHUNK_SIZE);
+    RELEASE_ASSERT(cur, "");
+    end = cur + CHUNK_SIZE;
+    chunks.push_back(cur);
+
+    void* rtn = cur;
+    cur += size;
+    return rtn;
+}
+
+Arena::~Arena() {
+    for (auto it = destructors.rbegin(); it != destructors.rend(); ++it)
+        it->destruct(it->obj);
+    for (char* chunk : chunks)
+        free(chunk);
+}
+
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CORE_ARENA_H
+#define PYSTON_CORE_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace pyston {
+
+// A bump allocator for objects that all go away at the same time, like the nodes of an AST or a CFG.
+// Things come out of big chunks, so they end up packed next to each other and allocating them is just a
+// pointer increment.  Everything gets destructed (newest first) and freed along with the arena; there's
+// no way to free anything individually.
+//
+// Not thread-safe: an arena belongs to whatever is building the tree.
+class Arena {
+    private:
+        static const size_t CHUNK_SIZE = 64 * 1024;
+
+        struct Destructor {
+            void* obj;
+            void (*destruct)(void*);
+        };
+
+        char *cur, *end;
+        std::vector<char*> chunks;
+        std::vector<Destructor> destructors;
+
+        void* allocateSlowpath(size_t size);
+
+        template <class T>
+        static void destruct(void* obj) {
+            static_cast<T*>(obj)->~T();
+        }
+
+    public:
+        Arena() : cur(NULL), end(NULL) {}
+        ~Arena();
+
+        Arena(const Arena&) = delete;
+        void operator=(const Arena&) = delete;
+
+        void* allocate(size_t size) {
+            size = (size + 7) & ~(size_t)7;
+            if (size > (size_t)(end - cur))
+                return allocateSlowpath(size);
+            void* rtn = cur;
+            cur += size;
+            return rtn;
+        }
+
+        template <class T, class... Args>
+        T* make(Args&&... args) {
+            T* rtn = new (allocate(sizeof(T))) T(std::forward<Args>(args)...);
+            if (!std::is_trivially_destructible<T>::value)
+                destructors.push_back(Destructor{rtn, &destruct<T>});
+            return rtn;
+        }
+};
+
+}
+
+#endif
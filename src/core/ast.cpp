@@ -51,6 +51,8 @@ std::string getOpSymbol(int op_type) {
             return ">";
         case AST_TYPE::GtE:
             return ">=";
+        case AST_TYPE::In:
+            return "in";
         case AST_TYPE::Invert:
             return "~";
         case AST_TYPE::Is:
@@ -65,6 +67,8 @@ std::string getOpSymbol(int op_type) {
             return "not";
         case AST_TYPE::NotEq:
             return "!=";
+        case AST_TYPE::NotIn:
+            return "not in";
         case AST_TYPE::Pow:
             return "**";
         case AST_TYPE::RShift:
@@ -113,6 +117,9 @@ std::string getOpName(int op_type) {
             return "__gt__";
         case AST_TYPE::GtE:
             return "__ge__";
+        case AST_TYPE::In:
+        case AST_TYPE::NotIn:
+            return "__contains__";
         case AST_TYPE::Invert:
             return "__invert__";
         case AST_TYPE::Mod:
@@ -140,14 +147,15 @@ std::string getOpName(int op_type) {
 }
 
 std::string getReverseOpName(int op_type) {
+    // The reflected comparison gets called with the operands swapped, so a < b becomes b > a:
     if (op_type == AST_TYPE::Lt)
-        return getOpName(AST_TYPE::GtE);
-    if (op_type == AST_TYPE::LtE)
         return getOpName(AST_TYPE::Gt);
+    if (op_type == AST_TYPE::LtE)
+        return getOpName(AST_TYPE::GtE);
     if (op_type == AST_TYPE::Gt)
-        return getOpName(AST_TYPE::LtE);
-    if (op_type == AST_TYPE::GtE)
         return getOpName(AST_TYPE::Lt);
+    if (op_type == AST_TYPE::GtE)
+        return getOpName(AST_TYPE::LtE);
     if (op_type == AST_TYPE::NotEq)
         return getOpName(AST_TYPE::NotEq);
     if (op_type == AST_TYPE::Eq)
@@ -302,6 +310,15 @@ void* AST_Dict::accept_expr(ExprVisitor *v) {
     return v->visit_dict(this);
 }
 
+void AST_ExceptHandler::accept(ASTVisitor *v) {
+    bool skip = v->visit_excepthandler(this);
+    if (skip) return;
+
+    if (type) type->accept(v);
+    if (name) name->accept(v);
+    visitVector(body, v);
+}
+
 void AST_Expr::accept(ASTVisitor *v) {
     bool skip = v->visit_expr(this);
     if (skip) return;
@@ -445,6 +462,19 @@ void AST_Print::accept_stmt(StmtVisitor *v) {
     v->visit_print(this);
 }
 
+void AST_Raise::accept(ASTVisitor *v) {
+    bool skip = v->visit_raise(this);
+    if (skip) return;
+
+    if (type) type->accept(v);
+    if (inst) inst->accept(v);
+    if (tback) tback->accept(v);
+}
+
+void AST_Raise::accept_stmt(StmtVisitor *v) {
+    v->visit_raise(this);
+}
+
 void AST_Return::accept(ASTVisitor *v) {
     bool skip = v->visit_return(this);
     if (skip) return;
@@ -490,6 +520,31 @@ void* AST_Subscript::accept_expr(ExprVisitor *v) {
     return v->visit_subscript(this);
 }
 
+void AST_TryExcept::accept(ASTVisitor *v) {
+    bool skip = v->visit_tryexcept(this);
+    if (skip) return;
+
+    visitVector(body, v);
+    visitVector(orelse, v);
+    visitVector(handlers, v);
+}
+
+void AST_TryExcept::accept_stmt(StmtVisitor *v) {
+    v->visit_tryexcept(this);
+}
+
+void AST_TryFinally::accept(ASTVisitor *v) {
+    bool skip = v->visit_tryfinally(this);
+    if (skip) return;
+
+    visitVector(body, v);
+    visitVector(finalbody, v);
+}
+
+void AST_TryFinally::accept_stmt(StmtVisitor *v) {
+    v->visit_tryfinally(this);
+}
+
 void AST_Tuple::accept(ASTVisitor *v) {
     bool skip = v->visit_tuple(this);
     if (skip) return;
@@ -571,6 +626,17 @@ void* AST_ClsAttribute::accept_expr(ExprVisitor *v) {
     return v->visit_clsattribute(this);
 }
 
+void AST_LangPrimitive::accept(ASTVisitor *v) {
+    bool skip = v->visit_langprimitive(this);
+    if (skip) return;
+
+    visitVector(args, v);
+}
+
+void* AST_LangPrimitive::accept_expr(ExprVisitor *v) {
+    return v->visit_langprimitive(this);
+}
+
 
 
 
@@ -777,6 +843,28 @@ bool PrintVisitor::visit_dict(AST_Dict *node) {
     return true;
 }
 
+bool PrintVisitor::visit_excepthandler(AST_ExceptHandler *node) {
+    printf("except");
+    if (node->type) {
+        printf(" ");
+        node->type->accept(this);
+    }
+    if (node->name) {
+        printf(" as ");
+        node->name->accept(this);
+    }
+    printf(":\n");
+
+    indent += 4;
+    for (int i = 0; i < node->body.size(); i++) {
+        if (i > 0) printf("\n");
+        printIndent();
+        node->body[i]->accept(this);
+    }
+    indent -= 4;
+    return true;
+}
+
 bool PrintVisitor::visit_expr(AST_Expr *node) {
     return false;
 }
@@ -925,6 +1013,23 @@ bool PrintVisitor::visit_print(AST_Print *node) {
     return true;
 }
 
+bool PrintVisitor::visit_raise(AST_Raise *node) {
+    printf("raise");
+    if (node->type) {
+        printf(" ");
+        node->type->accept(this);
+    }
+    if (node->inst) {
+        printf(", ");
+        node->inst->accept(this);
+    }
+    if (node->tback) {
+        printf(", ");
+        node->tback->accept(this);
+    }
+    return true;
+}
+
 bool PrintVisitor::visit_return(AST_Return *node) {
     printf("return ");
     return false;
@@ -957,6 +1062,60 @@ bool PrintVisitor::visit_subscript(AST_Subscript *node) {
     return true;
 }
 
+bool PrintVisitor::visit_tryexcept(AST_TryExcept *node) {
+    printf("try:\n");
+    indent += 4;
+    for (int i = 0; i < node->body.size(); i++) {
+        printIndent();
+        node->body[i]->accept(this);
+        printf("\n");
+    }
+    indent -= 4;
+
+    for (int i = 0; i < node->handlers.size(); i++) {
+        if (i > 0) printf("\n");
+        printIndent();
+        node->handlers[i]->accept(this);
+    }
+
+    if (node->orelse.size()) {
+        printf("\n");
+        printIndent();
+        printf("else:\n");
+        indent += 4;
+        for (int i = 0; i < node->orelse.size(); i++) {
+            if (i > 0) printf("\n");
+            printIndent();
+            node->orelse[i]->accept(this);
+        }
+        indent -= 4;
+    }
+    return true;
+}
+
+bool PrintVisitor::visit_tryfinally(AST_TryFinally *node) {
+    // A try/except/finally prints as a try/except nested in a try/finally, which is what it is:
+    printf("try:\n");
+    indent += 4;
+    for (int i = 0; i < node->body.size(); i++) {
+        printIndent();
+        node->body[i]->accept(this);
+        printf("\n");
+    }
+    indent -= 4;
+
+    printIndent();
+    printf("finally:\n");
+    indent += 4;
+    for (int i = 0; i < node->finalbody.size(); i++) {
+        if (i > 0) printf("\n");
+        printIndent();
+        node->finalbody[i]->accept(this);
+    }
+    indent -= 4;
+    return true;
+}
+
 bool PrintVisitor::visit_tuple(AST_Tuple *node) {
     printf("(");
     int n = node->elts.size();
@@ -1060,6 +1219,29 @@ bool PrintVisitor::visit_clsattribute(AST_ClsAttribute *node) {
     return true;
 }
 
+bool PrintVisitor::visit_langprimitive(AST_LangPrimitive *node) {
+    switch (node->opcode) {
+        case AST_LangPrimitive::ITER_NEXT:
+            printf(":ITER_NEXT(");
+            break;
+        case AST_LangPrimitive::ITER_HAS_VALUE:
+            printf(":ITER_HAS_VALUE(");
+            break;
+        case AST_LangPrimitive::RAISE:
+            printf(":RAISE(");
+            break;
+        default:
+            RELEASE_ASSERT(0, "%d", node->opcode);
+    }
+    for (int i = 0; i < node->args.size(); i++) {
+        if (i > 0)
+            printf(", ");
+        node->args[i]->accept(this);
+    }
+    printf(")");
+    return true;
+}
+
 class FlattenVisitor : public ASTVisitor {
     private:
         std::vector<AST*> *output;
@@ -1080,9 +1262,11 @@ class FlattenVisitor : public ASTVisitor {
         virtual bool visit_compare(AST_Compare *node) { output->push_back(node); return false; }
         virtual bool visit_continue(AST_Continue *node) { output->push_back(node); return false; }
         virtual bool visit_dict(AST_Dict *node) { output->push_back(node); return false; }
+        virtual bool visit_excepthandler(AST_ExceptHandler *node) { output->push_back(node); return false; }
         virtual bool visit_expr(AST_Expr *node) { output->push_back(node); return false; }
         virtual bool visit_for(AST_For *node) { output->push_back(node); return !expand_scopes; }
         virtual bool visit_functiondef(AST_FunctionDef *node) { output->push_back(node); return !expand_scopes; }
+        virtual bool visit_global(AST_Global *node) { output->push_back(node); return false; }
         virtual bool visit_if(AST_If *node) { output->push_back(node); return false; }
         virtual bool visit_import(AST_Import *node) { output->push_back(node); return false; }
         virtual bool visit_index(AST_Index *node) { output->push_back(node); return false; }
@@ -1093,10 +1277,13 @@ class FlattenVisitor : public ASTVisitor {
         virtual bool visit_num(AST_Num *node) { output->push_back(node); return false; }
         virtual bool visit_pass(AST_Pass *node) { output->push_back(node); return false; }
         virtual bool visit_print(AST_Print *node) { output->push_back(node); return false; }
+        virtual bool visit_raise(AST_Raise *node) { output->push_back(node); return false; }
         virtual bool visit_return(AST_Return *node) { output->push_back(node); return false; }
         virtual bool visit_slice(AST_Slice *node) { output->push_back(node); return false; }
         virtual bool visit_str(AST_Str *node) { output->push_back(node); return false; }
         virtual bool visit_subscript(AST_Subscript *node) { output->push_back(node); return false; }
+        virtual bool visit_tryexcept(AST_TryExcept *node) { output->push_back(node); return false; }
+        virtual bool visit_tryfinally(AST_TryFinally *node) { output->push_back(node); return false; }
         virtual bool visit_tuple(AST_Tuple *node) { output->push_back(node); return false; }
         virtual bool visit_unaryop(AST_UnaryOp *node) { output->push_back(node); return false; }
         virtual bool visit_while(AST_While *node) { output->push_back(node); return false; }
@@ -1105,6 +1292,7 @@ class FlattenVisitor : public ASTVisitor {
         virtual bool visit_branch(AST_Branch *node) { output->push_back(node); return false; }
         virtual bool visit_jump(AST_Jump *node) { output->push_back(node); return false; }
         virtual bool visit_clsattribute(AST_ClsAttribute *node) { output->push_back(node); return false; }
+        virtual bool visit_langprimitive(AST_LangPrimitive *node) { output->push_back(node); return false; }
 };
 
 std::vector<AST*>* flatten(std::vector<AST_stmt*> &roots, bool expand_scopes) {
@@ -21,11 +21,13 @@
 #include <vector>
 #include <string>
 
+#include "core/arena.h"
+
 namespace pyston {
 
 namespace AST_TYPE {
     // These are in a pretty random order (started off alphabetical but then I had to add more).
-    // These can be changed freely as long as parse_ast.py is also updated
+    // These get saved in the parse cache files, so changing them means bumping CACHE_VERSION in parser.cpp
     enum AST_TYPE {
         alias = 1,
         arguments = 2,
@@ -119,6 +121,7 @@ namespace AST_TYPE {
         Branch = 200,
         Jump = 201,
         ClsAttribute = 202,
+        LangPrimitive = 203,
     };
 };
 
@@ -291,6 +294,17 @@ class AST_Expr : public AST_stmt {
         AST_Expr() : AST_stmt(AST_TYPE::Expr) {}
 };
 
+class AST_ExceptHandler : public AST {
+    public:
+        std::vector<AST_stmt*> body;
+        // (either can be NULL)
+        AST_expr *type, *name;
+
+        virtual void accept(ASTVisitor *v);
+
+        AST_ExceptHandler() : AST(AST_TYPE::ExceptHandler) {}
+};
+
 class AST_For : public AST_stmt {
     public:
         const static int TYPE = AST_TYPE::For;
@@ -388,6 +402,8 @@ class AST_Module : public AST {
         // no lineno, col_offset attributes
         const static AST_TYPE::AST_TYPE TYPE = AST_TYPE::Module;
         std::vector<AST_stmt*> body;
+        // All the other nodes in the tree get allocated out of this, so they go away with the module:
+        Arena arena;
 
         virtual void accept(ASTVisitor *v);
 
@@ -409,7 +425,7 @@ class AST_Name : public AST_expr {
 class AST_Num : public AST_expr {
     public:
         enum NumType {
-            // These values must correspond to the values in parse_ast.py
+            // These get saved in the parse cache files too
             INT = 0x10,
             FLOAT = 0x20,
         } num_type;
@@ -445,6 +461,17 @@ class AST_Print : public AST_stmt {
         AST_Print() : AST_stmt(AST_TYPE::Print) {}
 };
 
+class AST_Raise : public AST_stmt {
+    public:
+        // "raise" on its own has all three NULL:
+        AST_expr *type, *inst, *tback;
+
+        virtual void accept(ASTVisitor *v);
+        virtual void accept_stmt(StmtVisitor *v);
+
+        AST_Raise() : AST_stmt(AST_TYPE::Raise) {}
+};
+
 class AST_Return : public AST_stmt {
     public:
         AST_expr* value;
@@ -486,6 +513,28 @@ class AST_Subscript : public AST_expr {
         AST_Subscript() : AST_expr(AST_TYPE::Subscript) {}
 };
 
+class AST_TryExcept : public AST_stmt {
+    public:
+        std::vector<AST_stmt*> body, orelse;
+        std::vector<AST_ExceptHandler*> handlers;
+
+        virtual void accept(ASTVisitor *v);
+        virtual void accept_stmt(StmtVisitor *v);
+
+        AST_TryExcept() : AST_stmt(AST_TYPE::TryExcept) {}
+};
+
+// A try with both except clauses and a finally is one of these, with the TryExcept as its body:
+class AST_TryFinally : public AST_stmt {
+    public:
+        std::vector<AST_stmt*> body, finalbody;
+
+        virtual void accept(ASTVisitor *v);
+        virtual void accept_stmt(StmtVisitor *v);
+
+        AST_TryFinally() : AST_stmt(AST_TYPE::TryFinally) {}
+};
+
 class AST_Tuple : public AST_expr {
     public:
         std::vector<AST_expr*> elts;
@@ -568,6 +617,25 @@ class AST_ClsAttribute : public AST_expr {
         AST_ClsAttribute() : AST_expr(AST_TYPE::ClsAttribute) {}
 };
 
+// Operations that the CFG lowers things into, but that don't exist at the python level:
+class AST_LangPrimitive : public AST_expr {
+    public:
+        enum Opcode {
+            // The next value from the iterator args[0], or NULL if it's exhausted; ie __hasnext__ followed by next.
+            ITER_NEXT,
+            // Whether args[1], which an ITER_NEXT of the iterator args[0] got assigned to, is a value.
+            ITER_HAS_VALUE,
+            // A raise statement; args are its type, inst and tback, with None for the ones that it left out.
+            RAISE,
+        } opcode;
+        std::vector<AST_expr*> args;
+
+        virtual void accept(ASTVisitor *v);
+        virtual void* accept_expr(ExprVisitor *v);
+
+        AST_LangPrimitive(Opcode opcode) : AST_expr(AST_TYPE::LangPrimitive), opcode(opcode) {}
+};
+
 
 class ASTVisitor {
     protected:
@@ -583,10 +651,12 @@ class ASTVisitor {
         virtual bool visit_break(AST_Break *node) { assert(0); abort(); }
         virtual bool visit_call(AST_Call *node) { assert(0); abort(); }
         virtual bool visit_clsattribute(AST_ClsAttribute *node) { assert(0); abort(); }
+        virtual bool visit_langprimitive(AST_LangPrimitive *node) { assert(0); abort(); }
         virtual bool visit_compare(AST_Compare *node) { assert(0); abort(); }
         virtual bool visit_classdef(AST_ClassDef *node) { assert(0); abort(); }
         virtual bool visit_continue(AST_Continue *node) { assert(0); abort(); }
         virtual bool visit_dict(AST_Dict *node) { assert(0); abort(); }
+        virtual bool visit_excepthandler(AST_ExceptHandler *node) { assert(0); abort(); }
         virtual bool visit_expr(AST_Expr *node) { assert(0); abort(); }
         virtual bool visit_for(AST_For *node) { assert(0); abort(); }
         virtual bool visit_functiondef(AST_FunctionDef *node) { assert(0); abort(); }
@@ -601,10 +671,13 @@ class ASTVisitor {
         virtual bool visit_num(AST_Num *node) { assert(0); abort(); }
         virtual bool visit_pass(AST_Pass *node) { assert(0); abort(); }
         virtual bool visit_print(AST_Print *node) { assert(0); abort(); }
+        virtual bool visit_raise(AST_Raise *node) { assert(0); abort(); }
         virtual bool visit_return(AST_Return *node) { assert(0); abort(); }
         virtual bool visit_slice(AST_Slice *node) { assert(0); abort(); }
         virtual bool visit_str(AST_Str *node) { assert(0); abort(); }
         virtual bool visit_subscript(AST_Subscript *node) { assert(0); abort(); }
+        virtual bool visit_tryexcept(AST_TryExcept *node) { assert(0); abort(); }
+        virtual bool visit_tryfinally(AST_TryFinally *node) { assert(0); abort(); }
         virtual bool visit_tuple(AST_Tuple *node) { assert(0); abort(); }
         virtual bool visit_unaryop(AST_UnaryOp *node) { assert(0); abort(); }
         virtual bool visit_while(AST_While *node) { assert(0); abort(); }
@@ -628,10 +701,12 @@ class NoopASTVisitor : public ASTVisitor {
         virtual bool visit_break(AST_Break *node) { return false; }
         virtual bool visit_call(AST_Call *node) { return false; }
         virtual bool visit_clsattribute(AST_ClsAttribute *node) { return false; }
+        virtual bool visit_langprimitive(AST_LangPrimitive *node) { return false; }
         virtual bool visit_compare(AST_Compare *node) { return false; }
         virtual bool visit_classdef(AST_ClassDef *node) { return false; }
         virtual bool visit_continue(AST_Continue *node) { return false; }
         virtual bool visit_dict(AST_Dict *node) { return false; }
+        virtual bool visit_excepthandler(AST_ExceptHandler *node) { return false; }
         virtual bool visit_expr(AST_Expr *node) { return false; }
         virtual bool visit_for(AST_For *node) { return false; }
         virtual bool visit_functiondef(AST_FunctionDef *node) { return false; }
@@ -646,10 +721,13 @@ class NoopASTVisitor : public ASTVisitor {
         virtual bool visit_num(AST_Num *node) { return false; }
         virtual bool visit_pass(AST_Pass *node) { return false; }
         virtual bool visit_print(AST_Print *node) { return false; }
+        virtual bool visit_raise(AST_Raise *node) { return false; }
         virtual bool visit_return(AST_Return *node) { return false; }
         virtual bool visit_slice(AST_Slice *node) { return false; }
         virtual bool visit_str(AST_Str *node) { return false; }
         virtual bool visit_subscript(AST_Subscript *node) { return false; }
+        virtual bool visit_tryexcept(AST_TryExcept *node) { return false; }
+        virtual bool visit_tryfinally(AST_TryFinally *node) { return false; }
         virtual bool visit_tuple(AST_Tuple *node) { return false; }
         virtual bool visit_unaryop(AST_UnaryOp *node) { return false; }
         virtual bool visit_while(AST_While *node) { return false; }
@@ -669,6 +747,7 @@ class ExprVisitor {
         virtual void* visit_boolop(AST_BoolOp *node) { assert(0); abort(); }
         virtual void* visit_call(AST_Call *node) { assert(0); abort(); }
         virtual void* visit_clsattribute(AST_ClsAttribute *node) { assert(0); abort(); }
+        virtual void* visit_langprimitive(AST_LangPrimitive *node) { assert(0); abort(); }
         virtual void* visit_compare(AST_Compare *node) { assert(0); abort(); }
         virtual void* visit_dict(AST_Dict *node) { assert(0); abort(); }
         virtual void* visit_index(AST_Index *node) { assert(0); abort(); }
@@ -699,7 +778,10 @@ class StmtVisitor {
         virtual void visit_import(AST_Import *node) { assert(0); abort(); }
         virtual void visit_pass(AST_Pass *node) { assert(0); abort(); }
         virtual void visit_print(AST_Print *node) { assert(0); abort(); }
+        virtual void visit_raise(AST_Raise *node) { assert(0); abort(); }
         virtual void visit_return(AST_Return *node) { assert(0); abort(); }
+        virtual void visit_tryexcept(AST_TryExcept *node) { assert(0); abort(); }
+        virtual void visit_tryfinally(AST_TryFinally *node) { assert(0); abort(); }
         virtual void visit_while(AST_While *node) { assert(0); abort(); }
         virtual void visit_with(AST_With *node) { assert(0); abort(); }
 
@@ -727,8 +809,10 @@ class PrintVisitor : public ASTVisitor {
         virtual bool visit_compare(AST_Compare *node);
         virtual bool visit_classdef(AST_ClassDef *node);
         virtual bool visit_clsattribute(AST_ClsAttribute *node);
+        virtual bool visit_langprimitive(AST_LangPrimitive *node);
         virtual bool visit_continue(AST_Continue *node);
         virtual bool visit_dict(AST_Dict *node);
+        virtual bool visit_excepthandler(AST_ExceptHandler *node);
         virtual bool visit_expr(AST_Expr *node);
         virtual bool visit_for(AST_For *node);
         virtual bool visit_functiondef(AST_FunctionDef *node);
@@ -743,10 +827,13 @@ class PrintVisitor : public ASTVisitor {
         virtual bool visit_num(AST_Num *node);
         virtual bool visit_pass(AST_Pass *node);
         virtual bool visit_print(AST_Print *node);
+        virtual bool visit_raise(AST_Raise *node);
         virtual bool visit_return(AST_Return *node);
         virtual bool visit_slice(AST_Slice *node);
         virtual bool visit_str(AST_Str *node);
         virtual bool visit_subscript(AST_Subscript *node);
+        virtual bool visit_tryexcept(AST_TryExcept *node);
+        virtual bool visit_tryfinally(AST_TryFinally *node);
         virtual bool visit_tuple(AST_Tuple *node);
         virtual bool visit_unaryop(AST_UnaryOp *node);
         virtual bool visit_while(AST_While *node);
@@ -16,6 +16,8 @@
 #include <cstdio>
 #include <cassert>
 #include <cstdlib>
+#include <set>
+#include <unordered_set>
 
 #include "core/options.h"
 
@@ -45,6 +47,9 @@ class CFGVisitor : public ASTVisitor {
         std::vector<LoopInfo> loops;
         std::vector<CFGBlock*> returns;
 
+        // The ways of leaving the body of a try/finally; see visit_tryfinally.
+        enum FinallyWhy { WHY_NORMAL, WHY_RETURN, WHY_BREAK, WHY_CONTINUE, NUM_WHYS };
+
         void pushLoop(CFGBlock *continue_dest, CFGBlock *break_dest) {
             LoopInfo loop;
             loop.continue_dest = continue_dest;
@@ -75,7 +80,7 @@ class CFGVisitor : public ASTVisitor {
                 curblock->connectTo(rtn_dest);
                 push_back(j);
             } else {
-                AST_Return *node = new AST_Return();
+                AST_Return *node = cfg->arena.make<AST_Return>();
                 node->value = value;
                 node->col_offset = value->col_offset;
                 node->lineno = value->lineno;
@@ -100,10 +105,33 @@ class CFGVisitor : public ASTVisitor {
             return NULL;
         }
 
+        // Where the end of a finally block goes, for each of the ways that its try body could have been left:
+        void doFinallyExit(int why) {
+            switch (why) {
+                case WHY_NORMAL:
+                    // falling off the end just continues on from here
+                    break;
+                case WHY_RETURN:
+                    doReturn(makeName("#rtnval", AST_TYPE::Load));
+                    break;
+                case WHY_BREAK:
+                case WHY_CONTINUE: {
+                    AST_Jump *j = makeJump();
+                    j->target = why == WHY_BREAK ? getBreak() : getContinue();
+                    curblock->connectTo(j->target, true);
+                    push_back(j);
+                    curblock = NULL;
+                    break;
+                }
+                default:
+                    RELEASE_ASSERT(0, "%d", why);
+            }
+        }
+
 
 
         AST_expr* makeNum(int n) {
-            AST_Num* node = new AST_Num();
+            AST_Num* node = cfg->arena.make<AST_Num>();
             node->col_offset = -1;
             node->lineno = -1;
             node->num_type = AST_Num::INT;
@@ -112,27 +140,56 @@ class CFGVisitor : public ASTVisitor {
         }
 
         AST_Jump* makeJump() {
-            AST_Jump* rtn = new AST_Jump();
+            AST_Jump* rtn = cfg->arena.make<AST_Jump>();
             return rtn;
         }
 
         AST_Branch* makeBranch(AST_expr* test) {
-            AST_Branch* rtn = new AST_Branch();
+            AST_Branch* rtn = cfg->arena.make<AST_Branch>();
             rtn->test = test;
             rtn->col_offset = test->col_offset;
             rtn->lineno = test->lineno;
             return rtn;
         }
 
+        // Assigns the next value from the iterator to next_name, and branches on whether there was one;
+        // the branch's targets are left to the caller.
+        AST_Branch* makeIterStep(const std::string &iter_name, const std::string &next_name, int lineno) {
+            AST_LangPrimitive *iter_next = cfg->arena.make<AST_LangPrimitive>(AST_LangPrimitive::ITER_NEXT);
+            iter_next->args.push_back(makeName(iter_name, AST_TYPE::Load, lineno, 0));
+            iter_next->lineno = lineno;
+            iter_next->col_offset = 0;
+            push_back(makeAssign(next_name, iter_next));
+
+            AST_LangPrimitive *has_value = cfg->arena.make<AST_LangPrimitive>(AST_LangPrimitive::ITER_HAS_VALUE);
+            has_value->args.push_back(makeName(iter_name, AST_TYPE::Load, lineno, 0));
+            has_value->args.push_back(makeName(next_name, AST_TYPE::Load, lineno, 0));
+            has_value->lineno = lineno;
+            has_value->col_offset = 0;
+            AST_Branch *br = makeBranch(has_value);
+            push_back(br);
+            return br;
+        }
+
+        AST_expr* makeCompare(AST_TYPE::AST_TYPE op_type, AST_expr* left, AST_expr* right) {
+            AST_Compare *compare = cfg->arena.make<AST_Compare>();
+            compare->ops.push_back(op_type);
+            compare->left = left;
+            compare->comparators.push_back(right);
+            compare->col_offset = left->col_offset;
+            compare->lineno = left->lineno;
+            return compare;
+        }
+
         AST_expr* makeLoadAttribute(AST_expr* base, const std::string &name, bool clsonly) {
             AST_expr* rtn;
             if (clsonly) {
-                AST_ClsAttribute *attr = new AST_ClsAttribute();
+                AST_ClsAttribute *attr = cfg->arena.make<AST_ClsAttribute>();
                 attr->value = base;
                 attr->attr = name;
                 rtn = attr;
             } else {
-                AST_Attribute *attr = new AST_Attribute();
+                AST_Attribute *attr = cfg->arena.make<AST_Attribute>();
                 attr->ctx_type = AST_TYPE::Load;
                 attr->value = base;
                 attr->attr = name;
@@ -144,7 +201,7 @@ class CFGVisitor : public ASTVisitor {
         }
 
         AST_Call* makeCall(AST_expr* func) {
-            AST_Call *call = new AST_Call();
+            AST_Call *call = cfg->arena.make<AST_Call>();
             call->starargs = NULL;
             call->kwargs = NULL;
             call->func = func;
@@ -154,7 +211,7 @@ class CFGVisitor : public ASTVisitor {
         }
 
         AST_expr* makeName(const std::string &id, AST_TYPE::AST_TYPE ctx_type, int lineno=-1, int col_offset=-1) {
-            AST_Name *name = new AST_Name();
+            AST_Name *name = cfg->arena.make<AST_Name>();
             name->id = id;
             name->col_offset = col_offset;
             name->lineno = lineno;
@@ -163,7 +220,7 @@ class CFGVisitor : public ASTVisitor {
         }
 
         AST_stmt* makeAssign(AST_expr *target, AST_expr *val) {
-            AST_Assign *assign = new AST_Assign();
+            AST_Assign *assign = cfg->arena.make<AST_Assign>();
             assign->targets.push_back(target);
             assign->value = val;
             assign->col_offset = val->col_offset;
@@ -178,7 +235,7 @@ class CFGVisitor : public ASTVisitor {
         }
 
         AST_stmt* makeExpr(AST_expr* expr) {
-            AST_Expr *stmt = new AST_Expr();
+            AST_Expr *stmt = cfg->arena.make<AST_Expr>();
             stmt->value = expr;
             stmt->lineno = expr->lineno;
             stmt->col_offset = expr->col_offset;
@@ -201,6 +258,12 @@ class CFGVisitor : public ASTVisitor {
                 curblock->push_back(node);
         }
 
+        void pushHoistedLoad(const std::string &id, int lineno) {
+            AST_Name *load = static_cast<AST_Name*>(makeName(id, AST_TYPE::Load, lineno, 0));
+            cfg->speculated_loads.insert(load);
+            push_back(makeAssign(id, load));
+        }
+
         virtual bool visit_assign(AST_Assign* node) { push_back(node); return true; }
         virtual bool visit_classdef(AST_ClassDef* node) { push_back(node); return true; }
         virtual bool visit_expr(AST_Expr* node) { push_back(node); return true; }
@@ -223,10 +286,140 @@ class CFGVisitor : public ASTVisitor {
             return true;
         }
 
+        virtual bool visit_raise(AST_Raise* node) {
+            if (!curblock) return true;
+
+            AST_LangPrimitive *raise = cfg->arena.make<AST_LangPrimitive>(AST_LangPrimitive::RAISE);
+            raise->lineno = node->lineno;
+            raise->col_offset = node->col_offset;
+            AST_expr* parts[] = {node->type, node->inst, node->tback};
+            for (int i = 0; i < 3; i++)
+                raise->args.push_back(parts[i] ? parts[i] : makeName("None", AST_TYPE::Load, node->lineno));
+            push_back(makeExpr(raise));
+
+            // The raise doesn't return, but the block still has to end in something:
+            AST_Return *rtn = cfg->arena.make<AST_Return>();
+            rtn->value = NULL;
+            rtn->lineno = node->lineno;
+            rtn->col_offset = node->col_offset;
+            push_back(rtn);
+            curblock = NULL;
+            return true;
+        }
+
+        virtual bool visit_tryexcept(AST_TryExcept* node) {
+            // Nothing could get to the handlers without unwinding, so the parser doesn't accept these yet:
+            RELEASE_ASSERT(0, "except clauses aren't supported yet");
+        }
+
+        // Every way out of the body (falling off the end, return, break and continue) goes through the finally
+        // block, of which there's only the one copy since the analyses key things off of the AST nodes; if more
+        // than one of them gets used, #why_ records which it was, and the end of the finally block dispatches on it.
+        virtual bool visit_tryfinally(AST_TryFinally* node) {
+            if (!curblock) return true;
+
+            char why_name_buf[80];
+            snprintf(why_name_buf, 80, "#why_%p", node);
+
+            CFGBlock *finally_block = cfg->addDeferredBlock();
+            finally_block->info = "finally";
+
+            CFGBlock *continue_dest = NULL, *break_dest = NULL;
+            if (loops.size()) {
+                continue_dest = cfg->addDeferredBlock();
+                continue_dest->info = "finally_continue";
+                break_dest = cfg->addDeferredBlock();
+                break_dest->info = "finally_break";
+                pushLoop(continue_dest, break_dest);
+            }
+
+            CFGBlock *return_dest = cfg->addDeferredBlock();
+            return_dest->info = "finally_return";
+            pushReturn(return_dest);
+
+            for (int i = 0; i < node->body.size(); i++) {
+                node->body[i]->accept(this);
+            }
+
+            popReturn();
+            if (continue_dest)
+                popLoop();
+
+            // (Blocks that didn't end up getting used just stay in the cfg's arena.)
+            CFGBlock *exits[NUM_WHYS] = {curblock, return_dest, break_dest, continue_dest};
+            int nexits = 0;
+            for (int why = 0; why < NUM_WHYS; why++) {
+                if (why != WHY_NORMAL && (exits[why] == NULL || exits[why]->predecessors.size() == 0))
+                    exits[why] = NULL;
+                if (exits[why])
+                    nexits++;
+            }
+
+            for (int why = 0; why < NUM_WHYS; why++) {
+                if (!exits[why])
+                    continue;
+                curblock = exits[why];
+                if (why != WHY_NORMAL)
+                    cfg->placeBlock(curblock);
+                if (nexits > 1)
+                    push_back(makeAssign(why_name_buf, makeNum(why)));
+
+                AST_Jump *j = makeJump();
+                j->target = finally_block;
+                curblock->connectTo(finally_block);
+                push_back(j);
+            }
+
+            if (nexits == 0) {
+                curblock = NULL;
+                return true;
+            }
+
+            cfg->placeBlock(finally_block);
+            curblock = finally_block;
+            for (int i = 0; i < node->finalbody.size(); i++) {
+                node->finalbody[i]->accept(this);
+            }
+
+            // The normal exit goes last, so that whatever comes after the try continues on from there:
+            static const int dispatch_order[NUM_WHYS] = {WHY_RETURN, WHY_BREAK, WHY_CONTINUE, WHY_NORMAL};
+            int remaining = nexits;
+            for (int i = 0; i < NUM_WHYS && curblock; i++) {
+                int why = dispatch_order[i];
+                if (!exits[why])
+                    continue;
+
+                remaining--;
+                if (remaining == 0) {
+                    doFinallyExit(why);
+                    break;
+                }
+
+                AST_Branch *br = makeBranch(makeCompare(AST_TYPE::Eq, makeName(why_name_buf, AST_TYPE::Load), makeNum(why)));
+                push_back(br);
+                CFGBlock *starting_block = curblock;
+
+                CFGBlock *iftrue = cfg->addBlock();
+                iftrue->info = "finally_exit";
+                br->iftrue = iftrue;
+                starting_block->connectTo(iftrue);
+                curblock = iftrue;
+                doFinallyExit(why);
+
+                CFGBlock *iffalse = cfg->addBlock();
+                iffalse->info = "finally_dispatch";
+                br->iffalse = iffalse;
+                starting_block->connectTo(iffalse);
+                curblock = iffalse;
+            }
+
+            return true;
+        }
+
         virtual bool visit_if(AST_If* node) {
             if (!curblock) return true;
 
-            AST_Branch *br = new AST_Branch();
+            AST_Branch *br = cfg->arena.make<AST_Branch>();
             br->col_offset = node->col_offset;
             br->lineno = node->lineno;
             br->test = node->test;
@@ -245,7 +438,7 @@ class CFGVisitor : public ASTVisitor {
                 node->body[i]->accept(this);
             }
             if (curblock) {
-                AST_Jump *jtrue = new AST_Jump();
+                AST_Jump *jtrue = cfg->arena.make<AST_Jump>();
                 push_back(jtrue);
                 jtrue->target = exit;
                 curblock->connectTo(exit);
@@ -261,7 +454,7 @@ class CFGVisitor : public ASTVisitor {
                 node->orelse[i]->accept(this);
             }
             if (curblock) {
-                AST_Jump *jfalse = new AST_Jump();
+                AST_Jump *jfalse = cfg->arena.make<AST_Jump>();
                 push_back(jfalse);
                 jfalse->target = exit;
                 curblock->connectTo(exit);
@@ -388,18 +581,9 @@ class CFGVisitor : public ASTVisitor {
             AST_stmt *iter_assign = makeAssign(itername_buf, iter_call);
             push_back(iter_assign);
 
-            AST_expr *hasnext_attr = makeLoadAttribute(makeName(itername_buf, AST_TYPE::Load), "__hasnext__", true);
-            AST_expr *next_attr = makeLoadAttribute(makeName(itername_buf, AST_TYPE::Load), "next", true);
-//#define SAVE_ATTRS
-#ifdef SAVE_ATTRS
-            char hasnextname_buf[80];
-            snprintf(hasnextname_buf, 80, "#hasnext_%p", node);
-            AST_stmt *hasnext_assign = makeAssign(hasnextname_buf, hasnext_attr);
-            push_back(hasnext_assign);
+            // Each step gets the next value (or the end) in one go rather than calling __hasnext__ and then next:
             char nextname_buf[80];
             snprintf(nextname_buf, 80, "#next_%p", node);
-            push_back(makeAssign(nextname_buf, next_attr));
-#endif
 
             CFGBlock *test_block = cfg->addBlock();
             AST_Jump* jump_to_test = makeJump();
@@ -408,13 +592,7 @@ class CFGVisitor : public ASTVisitor {
             curblock->connectTo(test_block);
             curblock = test_block;
 
-#ifdef SAVE_ATTRS
-            AST_expr *test_call = makeCall(makeName(hasnextname_buf, AST_TYPE::Load));
-#else
-            AST_expr *test_call = makeCall(hasnext_attr);
-#endif
-            AST_Branch *test_br = makeBranch(test_call);
-            push_back(test_br);
+            AST_Branch *test_br = makeIterStep(itername_buf, nextname_buf, node->lineno);
 
             CFGBlock *test_true = cfg->addBlock();
             CFGBlock *test_false = cfg->addBlock();
@@ -444,11 +622,10 @@ class CFGVisitor : public ASTVisitor {
             pushLoop(test_block, end_block);
 
             curblock = loop_block;
-#ifdef SAVE_ATTRS
-            push_back(makeAssign(node->target, makeCall(makeName(nextname_buf, AST_TYPE::Load))));
-#else
-            push_back(makeAssign(node->target, makeCall(next_attr)));
-#endif
+            // (this is where the loop variable's class gets speculated on, as the next call was before)
+            AST_Name *next_load = static_cast<AST_Name*>(makeName(nextname_buf, AST_TYPE::Load, node->lineno, 0));
+            cfg->speculated_loads.insert(next_load);
+            push_back(makeAssign(node->target, next_load));
 
             for (int i = 0; i < node->body.size(); i++) {
                 node->body[i]->accept(this);
@@ -456,13 +633,7 @@ class CFGVisitor : public ASTVisitor {
             popLoop();
 
             if (curblock) {
-#ifdef SAVE_ATTRS
-                AST_expr *end_call = makeCall(makeName(hasnextname_buf, AST_TYPE::Load));
-#else
-                AST_expr *end_call = makeCall(hasnext_attr);
-#endif
-                AST_Branch *end_br = makeBranch(end_call);
-                push_back(end_br);
+                AST_Branch *end_br = makeIterStep(itername_buf, nextname_buf, node->lineno);
 
                 CFGBlock *end_true = cfg->addBlock();
                 CFGBlock *end_false = cfg->addBlock();
@@ -553,10 +724,9 @@ class CFGVisitor : public ASTVisitor {
 
             CFGBlock *orig_ending_block = curblock;
 
+            // (Blocks that didn't end up getting used just stay in the cfg's arena.)
             if (continue_dest) {
-                if (continue_dest->predecessors.size() == 0) {
-                    delete continue_dest;
-                } else {
+                if (continue_dest->predecessors.size() != 0) {
                     curblock = continue_dest;
 
                     AST_Call* exit_call = makeCall(makeName(exitname_buf, AST_TYPE::Load));
@@ -572,9 +742,7 @@ class CFGVisitor : public ASTVisitor {
                     continue_dest->connectTo(orig_continue_dest, true);
                 }
 
-                if (break_dest->predecessors.size() == 0) {
-                    delete break_dest;
-                } else {
+                if (break_dest->predecessors.size() != 0) {
                     curblock = break_dest;
 
                     AST_Call* exit_call = makeCall(makeName(exitname_buf, AST_TYPE::Load));
@@ -594,9 +762,7 @@ class CFGVisitor : public ASTVisitor {
             }
 
             popReturn();
-            if (return_dest->predecessors.size() == 0) {
-                delete return_dest;
-            } else {
+            if (return_dest->predecessors.size() != 0) {
                 cfg->placeBlock(return_dest);
                 curblock = return_dest;
 
@@ -643,17 +809,95 @@ void CFG::print() {
     delete pv;
 }
 
+// Reloads the locals that a top-level loop of a function uses but never changes, right before the loop;
+// see CFG::speculated_loads.  Only names that an earlier top-level statement assigned get this, since
+// those are definitely defined by the time the loop runs, so the extra load can't raise.
+static void hoistLoopInvariantLoads(CFGVisitor &visitor, AST_stmt *loop, const std::unordered_set<std::string> &assigned) {
+    std::vector<AST_stmt*> roots(1, loop);
+    std::vector<AST*> *nodes = flatten(roots, true);
+
+    // (ordered, so that the reloads come out the same way each time)
+    std::set<std::string> loaded;
+    std::unordered_set<std::string> stored;
+    for (int i = 0; i < nodes->size(); i++) {
+        AST *n = (*nodes)[i];
+        switch (n->type) {
+            case AST_TYPE::Name: {
+                AST_Name *name = static_cast<AST_Name*>(n);
+                if (name->ctx_type == AST_TYPE::Load)
+                    loaded.insert(name->id);
+                else
+                    stored.insert(name->id);
+                break;
+            }
+            case AST_TYPE::FunctionDef:
+                stored.insert(static_cast<AST_FunctionDef*>(n)->name);
+                break;
+            case AST_TYPE::ClassDef:
+                stored.insert(static_cast<AST_ClassDef*>(n)->name);
+                break;
+            case AST_TYPE::Import: {
+                AST_Import *import = static_cast<AST_Import*>(n);
+                for (int j = 0; j < import->names.size(); j++) {
+                    AST_alias *alias = import->names[j];
+                    stored.insert(alias->asname.size() ? alias->asname : alias->name.substr(0, alias->name.find('.')));
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    delete nodes;
+
+    for (std::set<std::string>::iterator it = loaded.begin(), end = loaded.end(); it != end; ++it) {
+        if (assigned.count(*it) && !stored.count(*it))
+            visitor.pushHoistedLoad(*it, loop->lineno);
+    }
+}
+
 CFG* computeCFG(AST_TYPE::AST_TYPE root_type, std::vector<AST_stmt*> body) {
     CFG *rtn = new CFG();
     CFGVisitor visitor(root_type, rtn);
+
+    // Names declared global can't be reloaded like locals:
+    std::unordered_set<std::string> globals;
+    if (root_type == AST_TYPE::FunctionDef) {
+        std::vector<AST*> *nodes = flatten(body, true);
+        for (int i = 0; i < nodes->size(); i++) {
+            if ((*nodes)[i]->type != AST_TYPE::Global)
+                continue;
+            AST_Global *g = static_cast<AST_Global*>((*nodes)[i]);
+            globals.insert(g->names.begin(), g->names.end());
+        }
+        delete nodes;
+    }
+
+    // The locals that the top-level statements so far have assigned:
+    std::unordered_set<std::string> assigned;
     for (int i = 0; i < body.size(); i++) {
-        body[i]->accept(&visitor);
+        AST_stmt *stmt = body[i];
+        if (root_type == AST_TYPE::FunctionDef && (stmt->type == AST_TYPE::For || stmt->type == AST_TYPE::While))
+            hoistLoopInvariantLoads(visitor, stmt, assigned);
+
+        stmt->accept(&visitor);
+
+        if (stmt->type == AST_TYPE::Assign) {
+            AST_Assign *assign = static_cast<AST_Assign*>(stmt);
+            for (int j = 0; j < assign->targets.size(); j++) {
+                if (assign->targets[j]->type != AST_TYPE::Name)
+                    continue;
+                const std::string &id = static_cast<AST_Name*>(assign->targets[j])->id;
+                if (!globals.count(id))
+                    assigned.insert(id);
+            }
+        }
     }
 
     // Put a fake "return" statement at the end of every function just to make sure they all have one;
     // we already have to support multiple return statements in a function, but this way we can avoid
     // having to support not having a return statement:
-    AST_Return *return_stmt = new AST_Return();
+    AST_Return *return_stmt = rtn->arena.make<AST_Return>();
     return_stmt->value = NULL;
     visitor.push_back(return_stmt);
 
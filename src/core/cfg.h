@@ -23,13 +23,16 @@
  * as type analysis, liveness, etc, and then using as the source representation for the next lowering pass (emitting llvm SSA)
  */
 
+#include <unordered_set>
 #include <vector>
 
+#include "core/arena.h"
 #include "core/common.h"
 
 namespace pyston {
 
 class AST_stmt;
+class AST_Name;
 
 namespace AST_TYPE {
 enum AST_TYPE;
@@ -50,6 +53,10 @@ class CFGBlock {
         CFGBlock(CFG *cfg, int idx) : cfg(cfg), idx(idx), info(NULL) {
         }
 
+        CFG* getCFG() {
+            return cfg;
+        }
+
         void connectTo(CFGBlock *successor, bool allow_backedge=false);
 
         void push_back(AST_stmt* node) {
@@ -62,17 +69,24 @@ class CFG {
     private:
     public:
         std::vector<CFGBlock*> blocks;
+        // The blocks, and the AST nodes that computeCFG makes up, live in here:
+        Arena arena;
+        // The name loads that the type analysis speculates on the class of (it doesn't for any others):
+        // the loads of the "x = x" statements that computeCFG puts in front of a loop, for the locals that
+        // the loop uses but never changes, so the guard happens once before the loop instead of at each
+        // use inside it; and the loads of each for loop's next value.
+        std::unordered_set<AST_Name*> speculated_loads;
 
         CFGBlock* addBlock() {
             int idx = blocks.size();
-            CFGBlock* block = new CFGBlock(this, idx);
+            CFGBlock* block = arena.make<CFGBlock>(this, idx);
             blocks.push_back(block);
 
             return block;
         }
 
         CFGBlock* addDeferredBlock() {
-            CFGBlock* block = new CFGBlock(this, -1);
+            CFGBlock* block = arena.make<CFGBlock>(this, -1);
             return block;
         }
 
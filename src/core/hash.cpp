@@ -0,0 +1,44 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/hash.h"
+
+namespace pyston {
+namespace hash_internal {
+
+uint64_t hashLong(const char* p, size_t len, uint64_t seed) {
+    size_t i = len;
+    if (i > 48) {
+        // Three independent lanes, so that the multiplies can overlap:
+        uint64_t seed1 = seed, seed2 = seed;
+        do {
+            seed = mix(read8(p) ^ SECRET1, read8(p + 8) ^ seed);
+            seed1 = mix(read8(p + 16) ^ SECRET2, read8(p + 24) ^ seed1);
+            seed2 = mix(read8(p + 32) ^ SECRET3, read8(p + 40) ^ seed2);
+            p += 48;
+            i -= 48;
+        } while (i > 48);
+        seed ^= seed1 ^ seed2;
+    }
+    while (i > 16) {
+        seed = mix(read8(p) ^ SECRET1, read8(p + 8) ^ seed);
+        p += 16;
+        i -= 16;
+    }
+    // The last 16 bytes, which can overlap with what's already been hashed:
+    return finish(read8(p + i - 16), read8(p + i - 8), seed, len);
+}
+
+}
+}
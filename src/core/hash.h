@@ -0,0 +1,88 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CORE_HASH_H
+#define PYSTON_CORE_HASH_H
+
+#include <cstdint>
+#include <cstring>
+
+namespace pyston {
+
+// A wyhash-style hash: each step multiplies two 64-bit words into 128 bits and folds the halves
+// together, which mixes well and goes through long inputs 48 bytes per round.  Strings of up to 16
+// bytes are the common case for dict keys, so that part is inline.
+namespace hash_internal {
+const uint64_t SECRET0 = 0xa0761d6478bd642full, SECRET1 = 0xe7037ed1a0b428dbull,
+      SECRET2 = 0x8ebc6af09c88c6e3ull, SECRET3 = 0x589965cc75374cc3ull;
+
+inline void mum(uint64_t &a, uint64_t &b) {
+    __uint128_t r = (__uint128_t)a * b;
+    a = (uint64_t)r;
+    b = (uint64_t)(r >> 64);
+}
+
+inline uint64_t mix(uint64_t a, uint64_t b) {
+    mum(a, b);
+    return a ^ b;
+}
+
+inline uint64_t read8(const char* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint64_t read4(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t finish(uint64_t a, uint64_t b, uint64_t seed, size_t len) {
+    a ^= SECRET1;
+    b ^= seed;
+    mum(a, b);
+    return mix(a ^ SECRET0 ^ len, b ^ SECRET1);
+}
+
+// The part for more than 16 bytes:
+uint64_t hashLong(const char* p, size_t len, uint64_t seed);
+}
+
+inline uint64_t hashBytes(const char* p, size_t len) {
+    using namespace hash_internal;
+
+    uint64_t seed = mix(SECRET0, SECRET1);
+    if (len > 16)
+        return hashLong(p, len, seed);
+
+    uint64_t a, b;
+    if (len >= 4) {
+        // Two possibly-overlapping reads from each end cover everything from 4 to 16 bytes:
+        size_t off = (len >> 3) << 2;
+        a = (read4(p) << 32) | read4(p + off);
+        b = (read4(p + len - 4) << 32) | read4(p + len - 4 - off);
+    } else if (len > 0) {
+        a = ((uint64_t)(unsigned char)p[0] << 16) | ((uint64_t)(unsigned char)p[len >> 1] << 8) | (unsigned char)p[len - 1];
+        b = 0;
+    } else {
+        a = b = 0;
+    }
+    return finish(a, b, seed, len);
+}
+
+}
+
+#endif
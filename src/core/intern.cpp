@@ -0,0 +1,57 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unordered_map>
+#include <unordered_set>
+
+#include "core/intern.h"
+
+#include "core/common.h"
+
+namespace pyston {
+
+// Allocated on first use, so that names can be interned from static initializers:
+static std::unordered_set<std::string>* interned_strings;
+// Maps the address of each interned string, as well as the address of its characters, to itself:
+static std::unordered_map<const void*, const std::string*>* interned_by_addr;
+
+const std::string* internString(const std::string &s) {
+    if (!interned_strings) {
+        interned_strings = new std::unordered_set<std::string>();
+        interned_by_addr = new std::unordered_map<const void*, const std::string*>();
+    }
+
+    auto it = interned_by_addr->find(&s);
+    if (it != interned_by_addr->end())
+        return it->second;
+
+    auto r = interned_strings->insert(s);
+    const std::string* rtn = &*r.first;
+    if (r.second) {
+        (*interned_by_addr)[rtn] = rtn;
+        (*interned_by_addr)[rtn->c_str()] = rtn;
+    }
+    return rtn;
+}
+
+const std::string* internString(const char* s) {
+    if (interned_by_addr) {
+        auto it = interned_by_addr->find(s);
+        if (it != interned_by_addr->end())
+            return it->second;
+    }
+    return internString(std::string(s));
+}
+
+}
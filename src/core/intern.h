@@ -0,0 +1,33 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CORE_INTERN_H
+#define PYSTON_CORE_INTERN_H
+
+#include <string>
+
+namespace pyston {
+
+// Returns the canonical copy of s.  Interned strings live forever, and two of them are equal iff
+// they're the same pointer, so attribute and variable names can be hashed and compared by address.
+//
+// Looking up the interned string itself, or its c_str(), only has to hash the pointer, so things
+// that were interned up front (like the names that get embedded into jitted code) are cheap to
+// re-intern at runtime.
+const std::string* internString(const std::string &s);
+const std::string* internString(const char* s);
+
+}
+
+#endif
@@ -24,6 +24,32 @@ int PYTHON_VERSION_MICRO = DEFAULT_PYTHON_MICRO_VERSION;
 
 int MAX_OPT_ITERATIONS = 1;
 
+int MAX_INLINE_ATTRS = 8;
+int MAX_HIDDEN_CLASS_ATTRS = 128;
+
+int MAX_SPECIALIZED_VERSIONS = 4;
+
+int GC_MARK_THREADS = 1;
+
+double GC_HEAP_GROWTH_FACTOR = 2.0;
+long GC_MIN_HEAP_SIZE = 0;
+long GC_MAX_HEAP_SIZE = 0;
+long GC_BLOCK_RELEASE_DELAY_MS = 1000;
+bool GC_INCREMENTAL_MARKING = false;
+bool GC_USE_HUGE_PAGES = false;
+bool GC_NUMA_AWARE = false;
+
+int ALLOC_PROFILE_RATE = 0;
+
+bool IC_REPORT = false;
+
+const char* COMPILE_CACHE_DIR = NULL;
+const char* COMPILE_CACHE_SHARED_DIRS = NULL;
+
+const char* WARMUP_MANIFEST = NULL;
+
+bool BACKGROUND_COMPILE = false;
+
 bool FORCE_OPTIMIZE = false;
 bool SHOW_DISASM = false;
 bool BENCH = false;
@@ -32,6 +58,10 @@ bool DUMPJIT = false;
 bool TRAP = false;
 bool USE_STRIPPED_STDLIB = false;
 bool ENABLE_INTERPRETER = true;
+// Interpret the generated IR for the INTERPRETED tier, instead of running the CFG directly:
+bool ENABLE_LLVM_INTERPRETER = false;
+// Run the INTERPRETED tier as calls from generated machine code rather than from the interpreter loop:
+bool ENABLE_THREADED_INTERPRETER = false;
 
 static bool _GLOBAL_ENABLE = 1;
 bool ENABLE_ICS = 1 && _GLOBAL_ENABLE;
@@ -44,11 +74,33 @@ bool ENABLE_ICGETATTRS = 1 && ENABLE_ICS;
 bool ENABLE_ICGETGLOBALS = 1 && ENABLE_ICS;
 bool ENABLE_ICBINEXPS = 1 && ENABLE_ICS;
 bool ENABLE_ICNONZEROS = 1 && ENABLE_ICS;
+bool ENABLE_ICITERNEXTS = 1 && ENABLE_ICS;
 bool ENABLE_SPECULATION = 1 && _GLOBAL_ENABLE;
 bool ENABLE_OSR = 1 && _GLOBAL_ENABLE;
 bool ENABLE_LLVMOPTS = 1 && _GLOBAL_ENABLE;
 bool ENABLE_INLINING = 1 && _GLOBAL_ENABLE;
+// Inline small Python functions at monomorphic call sites, in MAXIMAL-effort code:
+bool ENABLE_PYTHON_INLINING = 1 && ENABLE_INLINING;
 bool ENABLE_REOPT = 1 && _GLOBAL_ENABLE;
 bool ENABLE_PYSTON_PASSES = 1 && _GLOBAL_ENABLE;
+bool ENABLE_PRECISE_STACK_ROOTS = 1 && _GLOBAL_ENABLE;
+// Throw away a function's IR once it's been turned into machine code:
+bool ENABLE_IR_FREEING = 1 && _GLOBAL_ENABLE;
+// Have the lower tiers count how often each block runs, for MAXIMAL compiles to lay out their branches
+// and pick their speculations and inlining sites with:
+bool ENABLE_BLOCK_COUNTS = 1 && _GLOBAL_ENABLE;
+// Move the register spills + call of the IC slowpaths out of the patchpoints, into code of their own
+// away from the function bodies:
+bool ENABLE_COLD_SLOWPATHS = 1 && _GLOBAL_ENABLE;
+// Size the IC slots of MAXIMAL compiles off of how big the rewrites of that kind of IC have been:
+bool ENABLE_ADAPTIVE_SLOT_SIZES = 1 && ENABLE_ICS;
+// Have ICs whose rewrites come out identical call a shared copy of the code instead of each having their
+// own.  Saves code memory, but costs a call + ret on the fast path, so it's off by default (-X turns it on):
+bool ENABLE_SHARED_IC_STUBS = 0 && ENABLE_ICS;
+// In MAXIMAL compiles, read and write the elements of lists that store unboxed floats / ints directly,
+// after checking the list's strategy:
+bool ENABLE_UNBOXED_LIST_ACCESS = 1 && _GLOBAL_ENABLE;
+// Run llvm's loop and SLP vectorizers in the MAXIMAL pipeline:
+bool ENABLE_VECTORIZATION = 1 && ENABLE_LLVMOPTS;
 
 }
@@ -26,9 +26,54 @@ extern int PYTHON_VERSION_MAJOR, PYTHON_VERSION_MINOR, PYTHON_VERSION_MICRO;
 
 extern int MAX_OPT_ITERATIONS;
 
-extern bool SHOW_DISASM, FORCE_OPTIMIZE, BENCH, PROFILE, DUMPJIT, TRAP, USE_STRIPPED_STDLIB, ENABLE_INTERPRETER;
+// Upper limit on the number of attribute slots that instances of user classes get inside the object:
+extern int MAX_INLINE_ATTRS;
+// Objects that would need a hidden class with more attributes than this switch to storing them in a hash table:
+extern int MAX_HIDDEN_CLASS_ATTRS;
 
-extern bool ENABLE_ICS, ENABLE_ICGENERICS, ENABLE_ICGETITEMS, ENABLE_ICSETITEMS, ENABLE_ICBINEXPS, ENABLE_ICNONZEROS, ENABLE_ICCALLSITES, ENABLE_ICSETATTRS, ENABLE_ICGETATTRS, ENABLE_ICGETGLOBALS, ENABLE_SPECULATION, ENABLE_OSR, ENABLE_LLVMOPTS, ENABLE_INLINING, ENABLE_REOPT, ENABLE_PYSTON_PASSES;
+// Once a function has this many versions specialized on its argument types, it gets a generic one instead of more:
+extern int MAX_SPECIALIZED_VERSIONS;
+
+// Number of threads to use for the mark phase of the gc:
+extern int GC_MARK_THREADS;
+
+// Collections are scheduled so that the heap can grow to GC_HEAP_GROWTH_FACTOR times the size it had
+// after the last collection.  The heap size limits (in bytes) are ignored if they're 0.
+extern double GC_HEAP_GROWTH_FACTOR;
+extern long GC_MIN_HEAP_SIZE, GC_MAX_HEAP_SIZE;
+// Empty heap blocks get returned to the OS once they've gone unused for this long:
+extern long GC_BLOCK_RELEASE_DELAY_MS;
+// Do the marking for (automatically-triggered) full collections a bit at a time, interleaved with
+// the program, instead of in one long pause:
+extern bool GC_INCREMENTAL_MARKING;
+// Commit the gc arenas in 2MB chunks and ask for them to be backed by transparent huge pages:
+extern bool GC_USE_HUGE_PAGES;
+// On machines with more than one NUMA node, give each node its own part of the gc arenas, have threads
+// allocate out of their own node's part, and spread the marking threads out between the nodes:
+extern bool GC_NUMA_AWARE;
+
+// If nonzero, one out of every ALLOC_PROFILE_RATE object allocations gets recorded by the allocation profiler:
+extern int ALLOC_PROFILE_RATE;
+
+// Print the ICs that went to their slowpaths the most at exit, along with how often they got rewritten and invalidated:
+extern bool IC_REPORT;
+
+// If set, parsed ASTs and the object files for jitted code get saved here, and reused by later runs (see codegen/compile_cache.h).
+// The colon-separated COMPILE_CACHE_SHARED_DIRS only get read from.
+extern const char* COMPILE_CACHE_DIR;
+extern const char* COMPILE_CACHE_SHARED_DIRS;
+
+// If set, which functions got compiled at which effort levels gets saved here, and the next run compiles them at
+// those levels from the start (see codegen/irgen/warmup.h).
+extern const char* WARMUP_MANIFEST;
+
+// Do the MINIMAL->MODERATE->MAXIMAL reoptimizations on a background thread; the old version keeps
+// getting used until the new one is ready:
+extern bool BACKGROUND_COMPILE;
+
+extern bool SHOW_DISASM, FORCE_OPTIMIZE, BENCH, PROFILE, DUMPJIT, TRAP, USE_STRIPPED_STDLIB, ENABLE_INTERPRETER, ENABLE_LLVM_INTERPRETER, ENABLE_THREADED_INTERPRETER;
+
+extern bool ENABLE_ICS, ENABLE_ICGENERICS, ENABLE_ICGETITEMS, ENABLE_ICSETITEMS, ENABLE_ICBINEXPS, ENABLE_ICNONZEROS, ENABLE_ICITERNEXTS, ENABLE_ICCALLSITES, ENABLE_ICSETATTRS, ENABLE_ICGETATTRS, ENABLE_ICGETGLOBALS, ENABLE_SPECULATION, ENABLE_OSR, ENABLE_LLVMOPTS, ENABLE_INLINING, ENABLE_PYTHON_INLINING, ENABLE_REOPT, ENABLE_PYSTON_PASSES, ENABLE_PRECISE_STACK_ROOTS, ENABLE_IR_FREEING, ENABLE_BLOCK_COUNTS, ENABLE_COLD_SLOWPATHS, ENABLE_ADAPTIVE_SLOT_SIZES, ENABLE_SHARED_IC_STUBS, ENABLE_UNBOXED_LIST_ACCESS, ENABLE_VECTORIZATION;
 }
 
 }
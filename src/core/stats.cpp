@@ -13,47 +13,283 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
 
+#include "core/common.h"
 #include "core/stats.h"
+#include "core/util.h"
 
 namespace pyston {
 
-std::vector<long>* Stats::counts;
-std::unordered_map<int, std::string>* Stats::names;
-StatCounter::StatCounter(const std::string &name) : id(Stats::getStatId(name)) {
+enum StatKind {
+    COUNTER,
+    GAUGE,
+    HISTOGRAM,
+};
+
+struct StatInfo {
+    std::string name;
+    StatKind kind;
+    int id;
+};
+
+// hacky but easy way of getting around static constructor ordering issues for now: these all get set
+// up the first time that anything gets registered.
+static std::mutex *stats_lock;
+static std::vector<StatInfo> *stats;
+static std::unordered_map<std::string, int> *stat_ids;
+// Every thread's slots that have ever been logged to, including ones from threads that have exited:
+static std::vector<long*> *all_thread_counts;
+static int num_slots = 0;
+
+__thread long* Stats::thread_counts;
+std::atomic<long>* Stats::gauges;
+
+static void initStats() {
+    static std::once_flag once;
+    std::call_once(once, []() {
+        stats_lock = new std::mutex();
+        stats = new std::vector<StatInfo>();
+        stat_ids = new std::unordered_map<std::string, int>();
+        all_thread_counts = new std::vector<long*>();
+    });
+}
+
+long* Stats::initThreadCounts() {
+    initStats();
+
+    long *counts = new long[MAX_SLOTS]();
+    {
+        std::lock_guard<std::mutex> _lock(*stats_lock);
+        all_thread_counts->push_back(counts);
+    }
+    thread_counts = counts;
+    return counts;
+}
+
+int Stats::registerStat(const std::string &name, int kind, int nslots) {
+    initStats();
+
+    std::lock_guard<std::mutex> _lock(*stats_lock);
+    auto it = stat_ids->find(name);
+    if (it != stat_ids->end()) {
+        RELEASE_ASSERT((*stats)[it->second].kind == kind, "%s was already registered as a different kind of stat", name.c_str());
+        return (*stats)[it->second].id;
+    }
+
+    RELEASE_ASSERT(num_slots + nslots <= MAX_SLOTS, "too many stats");
+
+    StatInfo info;
+    info.name = name;
+    info.kind = (StatKind)kind;
+    info.id = num_slots;
+    num_slots += nslots;
+
+    (*stat_ids)[name] = stats->size();
+    stats->push_back(info);
+    return info.id;
 }
 
 int Stats::getStatId(const std::string &name) {
-    // hacky but easy way of getting around static constructor ordering issues for now:
-    static std::unordered_map<int, std::string> names;
-    Stats::names = &names;
-    static std::vector<long> counts;
-    Stats::counts = &counts;
-    static std::unordered_map<std::string, int> made;
+    return registerStat(name, COUNTER, 1);
+}
+
+int Stats::getGaugeId(const std::string &name) {
+    initStats();
+    {
+        std::lock_guard<std::mutex> _lock(*stats_lock);
+        if (!gauges)
+            gauges = new std::atomic<long>[MAX_SLOTS]();
+    }
+    return registerStat(name, GAUGE, 1);
+}
+
+int Stats::getHistogramId(const std::string &name) {
+    return registerStat(name, HISTOGRAM, HISTOGRAM_SLOTS);
+}
 
-    if (made.count(name))
-        return made[name];
+StatCounter::StatCounter(const std::string &name) : id(Stats::getStatId(name)) {
+}
+
+StatGauge::StatGauge(const std::string &name) : id(Stats::getGaugeId(name)) {
+}
 
-    int rtn = names.size();
-    names[rtn] = name;
-    made[name] = rtn;
-    counts.push_back(0);
-    return rtn;
+StatHistogram::StatHistogram(const std::string &name) : id(Stats::getHistogramId(name)) {
+}
+
+void StatCounterFamily::log(const std::string &name, int count) {
+    int id;
+    {
+        std::lock_guard<std::mutex> _lock(lock);
+        auto it = ids.find(name);
+        if (it == ids.end())
+            it = ids.insert(std::make_pair(name, Stats::getStatId(prefix + name))).first;
+        id = it->second;
+    }
+    Stats::log(id, count);
+}
+
+// The value that at least frac of the logged values are below, to within the bucket:
+static long histogramPercentile(const long *buckets, long count, long max, double frac) {
+    long seen = 0;
+    for (int i = 0; i < Stats::HISTOGRAM_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= frac * count) {
+            if (i == 0)
+                return 0;
+            return std::min(max, (1L << i) - 1);
+        }
+    }
+    return max;
+}
+
+std::vector<std::pair<std::string, long> > Stats::snapshot() {
+    initStats();
+    std::lock_guard<std::mutex> _lock(*stats_lock);
+
+    // The other threads could still be logging while we read this, but that's fine for stats:
+    std::vector<long> totals(num_slots, 0);
+    for (long *counts : *all_thread_counts) {
+        for (const StatInfo &info : *stats) {
+            if (info.kind == COUNTER) {
+                totals[info.id] += counts[info.id];
+            } else if (info.kind == HISTOGRAM) {
+                totals[info.id] += counts[info.id];
+                totals[info.id + 1] = std::max(totals[info.id + 1], counts[info.id + 1]);
+                for (int i = 2; i < HISTOGRAM_SLOTS; i++)
+                    totals[info.id + i] += counts[info.id + i];
+            }
+        }
+    }
+
+    std::vector<std::pair<std::string, long> > lines;
+    for (const StatInfo &info : *stats) {
+        if (info.kind == COUNTER) {
+            lines.push_back(make_pair(info.name, totals[info.id]));
+        } else if (info.kind == GAUGE) {
+            lines.push_back(make_pair(info.name, gauges[info.id].load()));
+        } else {
+            const long *buckets = &totals[info.id + 2];
+            long count = 0;
+            for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+                count += buckets[i];
+            long max = totals[info.id + 1];
+
+            lines.push_back(make_pair(info.name, totals[info.id]));
+            lines.push_back(make_pair(info.name + "_count", count));
+            lines.push_back(make_pair(info.name + "_p50", histogramPercentile(buckets, count, max, 0.5)));
+            lines.push_back(make_pair(info.name + "_p99", histogramPercentile(buckets, count, max, 0.99)));
+            lines.push_back(make_pair(info.name + "_max", max));
+        }
+    }
+
+    std::sort(lines.begin(), lines.end());
+    return lines;
 }
 
 void Stats::dump() {
     printf("Stats:\n");
 
-    std::vector<std::pair<std::string, int> > pairs;
-    for (std::unordered_map<int, std::string>::iterator it = names->begin(), end = names->end(); it != end; ++it) {
-        pairs.push_back(make_pair(it->second, it->first));
+    std::vector<std::pair<std::string, long> > lines = snapshot();
+    for (int i = 0; i < lines.size(); i++) {
+        printf("%s: %ld\n", lines[i].first.c_str(), lines[i].second);
+    }
+}
+
+static void writeJSONString(FILE* f, const std::string &s) {
+    fputc('"', f);
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if ((unsigned char)c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
     }
+    fputc('"', f);
+}
+
+void Stats::dumpJSON(FILE* f) {
+    timeval now;
+    gettimeofday(&now, NULL);
+    fprintf(f, "{\"pid\": %d, \"time\": %.3f, \"stats\": {", getpid(), now.tv_sec + .000001 * now.tv_usec);
+
+    std::vector<std::pair<std::string, long> > lines = snapshot();
+    for (int i = 0; i < lines.size(); i++) {
+        if (i)
+            fprintf(f, ", ");
+        writeJSONString(f, lines[i].first);
+        fprintf(f, ": %ld", lines[i].second);
+    }
+    fprintf(f, "}}\n");
+}
+
+// Never freed, since the export thread could still be running while the static destructors are:
+static std::string *export_dest;
+static std::mutex *export_lock;
+static pid_t export_pid;
+
+static void exportSnapshot() {
+    if (getpid() != export_pid)
+        return;
 
-    std::sort(pairs.begin(), pairs.end());
+    std::lock_guard<std::mutex> _lock(*export_lock);
+    const std::string &dest = *export_dest;
 
-    for (int i = 0; i < pairs.size(); i++) {
-        printf("%s: %ld\n", pairs[i].first.c_str(), (*counts)[pairs[i].second]);
+    if (startswith(dest, "unix:")) {
+        char* buf;
+        size_t size;
+        FILE* f = open_memstream(&buf, &size);
+        Stats::dumpJSON(f);
+        fclose(f);
+
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, dest.c_str() + 5, sizeof(addr.sun_path) - 1);
+
+        // Nobody listening is fine; the metrics just get dropped.
+        int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+        if (fd >= 0) {
+            sendto(fd, buf, size, MSG_DONTWAIT, (sockaddr*)&addr, sizeof(addr));
+            close(fd);
+        }
+        free(buf);
+        return;
+    }
+
+    std::string tmp_name = dest + ".tmp";
+    FILE* f = fopen(tmp_name.c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "Error: couldn't write the stats to %s\n", tmp_name.c_str());
+        return;
     }
+    Stats::dumpJSON(f);
+    fclose(f);
+    rename(tmp_name.c_str(), dest.c_str());
+}
+
+void Stats::startPeriodicExport(const std::string &dest, int interval_ms) {
+    RELEASE_ASSERT(export_dest == NULL, "can only export the stats to one place");
+    RELEASE_ASSERT(interval_ms > 0, "");
+    export_dest = new std::string(dest);
+    export_lock = new std::mutex();
+    export_pid = getpid();
+
+    std::thread([interval_ms]() {
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+            exportSnapshot();
+        }
+    }).detach();
+    atexit(exportSnapshot);
 }
 
 }
@@ -15,8 +15,11 @@
 #ifndef PYSTON_CORE_STATS_H
 #define PYSTON_CORE_STATS_H
 
+#include <atomic>
 #include <cstdio>
+#include <mutex>
 #include <string>
+#include <sys/time.h>
 #include <vector>
 #include <unordered_map>
 
@@ -24,19 +27,64 @@
 
 namespace pyston {
 
+// Each thread logs into its own array of slots, which get added up (or max'd, for the histograms'
+// maximums) when we dump; so logging is just an increment, with no locking or shared cache lines.
 struct Stats {
+    public:
+        static const int MAX_SLOTS = 8192;
+        // A histogram takes up this many slots: the total, the max, and then the counts of the values
+        // in [2**(i-1), 2**i) for each bucket i (bucket 0 gets everything that's <= 0).
+        static const int HISTOGRAM_BUCKETS = 64;
+        static const int HISTOGRAM_SLOTS = 2 + HISTOGRAM_BUCKETS;
+
     private:
-        static std::vector<long> *counts;
-        static std::unordered_map<int, std::string> *names;
+        static __thread long *thread_counts;
+        static long* initThreadCounts();
+        static long* getThreadCounts() {
+            long *counts = thread_counts;
+            if (!counts)
+                counts = initThreadCounts();
+            return counts;
+        }
+
+        // Gauges just hold whatever they got set to last, so they aren't per-thread:
+        static std::atomic<long> *gauges;
+
+        static int registerStat(const std::string &name, int kind, int nslots);
 
     public:
+        // Looking a stat up by name locks a global lock; anything that's going to get logged a lot should
+        // do it once, ie by using the classes below.
         static int getStatId(const std::string &name);
+        static int getGaugeId(const std::string &name);
+        static int getHistogramId(const std::string &name);
 
         static void log(int id, int count=1) {
-            (*counts)[id] += count;
+            getThreadCounts()[id] += count;
+        }
+
+        static void setGauge(int id, long value) {
+            gauges[id].store(value, std::memory_order_relaxed);
+        }
+
+        static void logHistogram(int id, long value) {
+            long *counts = getThreadCounts() + id;
+            counts[0] += value;
+            if (value > counts[1])
+                counts[1] = value;
+            int bucket = value <= 0 ? 0 : 64 - __builtin_clzl(value);
+            counts[2 + bucket]++;
         }
 
+        // Every stat's current value, sorted by name; histograms get expanded the same way as in dump().
+        static std::vector<std::pair<std::string, long> > snapshot();
         static void dump();
+        // Writes a snapshot as a json object, along with the pid and the time.
+        static void dumpJSON(FILE* f);
+        // Exports a json snapshot every interval_ms, and once more at exit.  dest is either a file, which
+        // gets atomically replaced each time, or "unix:<path>", a unix datagram socket that gets sent
+        // each snapshot as a single message.  Forked children don't keep exporting.
+        static void startPeriodicExport(const std::string &dest, int interval_ms);
 };
 
 struct StatCounter {
@@ -50,6 +98,60 @@ struct StatCounter {
         }
 };
 
+struct StatGauge {
+    private:
+        int id;
+    public:
+        StatGauge(const std::string &name);
+
+        void set(long value) {
+            Stats::setGauge(id, value);
+        }
+};
+
+// Gets dumped as the total (under the name itself, so it looks just like a counter), plus the number
+// of values and their median, 99th percentile and max; the percentiles are only accurate to a power of 2.
+struct StatHistogram {
+    private:
+        int id;
+    public:
+        StatHistogram(const std::string &name);
+
+        void log(long value) {
+            Stats::logHistogram(id, value);
+        }
+};
+
+// Logs the number of microseconds that it was alive for into a histogram.
+class StatTimer {
+    private:
+        StatHistogram &histogram;
+        timeval start_time;
+    public:
+        StatTimer(StatHistogram &histogram) : histogram(histogram) {
+            gettimeofday(&start_time, NULL);
+        }
+        ~StatTimer() {
+            timeval end;
+            gettimeofday(&end, NULL);
+            histogram.log(1000000L * (end.tv_sec - start_time.tv_sec) + (end.tv_usec - start_time.tv_usec));
+        }
+};
+
+// For counters that are named by something that's only known at runtime, like "getglobal__<name>":
+// each name gets registered the first time it's seen, and after that it's a single hash lookup.
+struct StatCounterFamily {
+    private:
+        const std::string prefix;
+        std::unordered_map<std::string, int> ids;
+        std::mutex lock;
+    public:
+        StatCounterFamily(const std::string &prefix) : prefix(prefix) {
+        }
+
+        void log(const std::string &name, int count=1);
+};
+
 }
 
 #endif
@@ -0,0 +1,197 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
+#include "core/common.h"
+#include "core/threading.h"
+
+namespace pyston {
+namespace threading {
+
+std::atomic<int64_t> threads_waiting_on_gil(0);
+static std::atomic<void (*)()> safepoint_callback(NULL);
+
+static std::mutex gil_mutex;
+static std::condition_variable gil_cv;
+static bool gil_held = false;
+// Bumped every time someone takes the GIL, so that a yielding thread can tell that somebody else got it:
+static int64_t gil_acquisitions = 0;
+
+// Protected by the GIL:
+static std::vector<ThreadState*> threads;
+static __thread ThreadState* current_thread = NULL;
+
+static void getStackBounds(ThreadState* state) {
+    pthread_attr_t attr;
+    int code = pthread_getattr_np(pthread_self(), &attr);
+    RELEASE_ASSERT(code == 0, "");
+    void* stack_addr;
+    size_t stack_size;
+    code = pthread_attr_getstack(&attr, &stack_addr, &stack_size);
+    RELEASE_ASSERT(code == 0, "");
+    pthread_attr_destroy(&attr);
+    state->stack_end = (char*)stack_addr + stack_size;
+}
+
+std::vector<ThreadState*> getOtherThreads() {
+    std::vector<ThreadState*> rtn;
+    for (ThreadState* t : threads) {
+        if (t != current_thread)
+            rtn.push_back(t);
+    }
+    return rtn;
+}
+
+void acquireGIL() {
+    std::unique_lock<std::mutex> l(gil_mutex);
+    if (gil_held) {
+        threads_waiting_on_gil++;
+        while (gil_held)
+            gil_cv.wait(l);
+        threads_waiting_on_gil--;
+    }
+    gil_held = true;
+    gil_acquisitions++;
+}
+
+// Not inlined, so that the saved registers and stack_start cover everything the caller has live:
+void __attribute__((noinline)) releaseGIL() {
+    ThreadState* state = current_thread;
+    if (state) {
+        setjmp(state->registers);
+        state->stack_start = __builtin_frame_address(0);
+    }
+
+    {
+        std::lock_guard<std::mutex> l(gil_mutex);
+        assert(gil_held);
+        gil_held = false;
+    }
+    gil_cv.notify_all();
+}
+
+void registerMainThread() {
+    assert(!current_thread);
+    ThreadState* state = new ThreadState();
+    state->pthread_id = pthread_self();
+    getStackBounds(state);
+    current_thread = state;
+    threads.push_back(state);
+
+    acquireGIL();
+}
+
+static void* threadStart(void* arg) {
+    ThreadState* state = static_cast<ThreadState*>(arg);
+    current_thread = state;
+
+    acquireGIL();
+    getStackBounds(state);
+    state->stack_start = NULL;
+
+    Box* (*func)(Box*, Box*) = state->start_func;
+    Box* arg1 = state->start_arg1;
+    Box* arg2 = state->start_arg2;
+    state->start_func = NULL;
+    state->start_arg1 = state->start_arg2 = NULL;
+
+    func(arg1, arg2);
+
+    threads.erase(std::find(threads.begin(), threads.end(), state));
+    current_thread = NULL;
+    releaseGIL();
+
+    delete state;
+    return NULL;
+}
+
+intptr_t startThread(Box* (*func)(Box*, Box*), Box* arg1, Box* arg2) {
+    ThreadState* state = new ThreadState();
+    state->start_func = func;
+    state->start_arg1 = arg1;
+    state->start_arg2 = arg2;
+    // Registered now, so that the collector can see the arguments until the thread has picked them up;
+    // with stack_start still NULL it won't try to scan the stack.
+    threads.push_back(state);
+
+    pthread_attr_t attr;
+    int code = pthread_attr_init(&attr);
+    RELEASE_ASSERT(code == 0, "");
+    code = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    RELEASE_ASSERT(code == 0, "");
+
+    code = pthread_create(&state->pthread_id, &attr, threadStart, state);
+    RELEASE_ASSERT(code == 0, "");
+    pthread_attr_destroy(&attr);
+
+    return (intptr_t)state->pthread_id;
+}
+
+void requestSafepointCallback(void (*f)()) {
+    void (*expected)() = NULL;
+    if (safepoint_callback.compare_exchange_strong(expected, f))
+        threads_waiting_on_gil++;
+}
+
+void beforeFork() {
+    gil_mutex.lock();
+}
+
+void afterFork(bool in_child) {
+    if (in_child) {
+        // Only this thread made it over; the others' states just get leaked:
+        threads.clear();
+        threads.push_back(current_thread);
+        threads_waiting_on_gil = safepoint_callback.load() ? 1 : 0;
+    }
+    gil_mutex.unlock();
+}
+
+} // namespace threading
+
+extern "C" void gilYield() {
+    using namespace threading;
+
+    void (*callback)() = safepoint_callback.exchange(NULL);
+    if (callback) {
+        threads_waiting_on_gil--;
+        callback();
+        if (threads_waiting_on_gil.load() == 0)
+            return;
+    }
+
+    int64_t saved;
+    {
+        std::lock_guard<std::mutex> l(gil_mutex);
+        saved = gil_acquisitions;
+    }
+
+    releaseGIL();
+
+    {
+        threads_waiting_on_gil++;
+        std::unique_lock<std::mutex> l(gil_mutex);
+        // Wait until somebody else has had it, so that we don't just take it right back:
+        while (gil_held || gil_acquisitions == saved)
+            gil_cv.wait(l);
+        gil_held = true;
+        gil_acquisitions++;
+        threads_waiting_on_gil--;
+    }
+}
+
+} // namespace pyston
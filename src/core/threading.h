@@ -0,0 +1,100 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CORE_THREADING_H
+#define PYSTON_CORE_THREADING_H
+
+#include <atomic>
+#include <csetjmp>
+#include <cstdint>
+#include <pthread.h>
+#include <vector>
+
+namespace pyston {
+
+class Box;
+
+namespace threading {
+
+// Python code only runs while holding the global interpreter lock.  Threads give it up around blocking
+// calls, and at the safepoints (loop backedges and function entries in the jitted code, backedges in the
+// interpreters) whenever another thread is waiting for it.
+//
+// The GIL is also what makes collections stop-the-world: every other thread is either waiting for it, or
+// is blocked somewhere that doesn't touch python objects, and it saved its registers when it gave the lock
+// up so that the collector can scan its stack conservatively from there.
+struct ThreadState {
+    pthread_t pthread_id;
+
+    // Saved by releaseGIL; stack_start is NULL until the thread has gotten going.
+    jmp_buf registers;
+    void* stack_start;
+    // The highest address of the thread's stack:
+    void* stack_end;
+
+    // What a new thread got started with, until it's gotten the GIL and picked them up:
+    Box* (*start_func)(Box*, Box*);
+    Box *start_arg1, *start_arg2;
+};
+
+// Every thread apart from the calling one; can only be used while holding the GIL.
+std::vector<ThreadState*> getOtherThreads();
+
+// Has to be called before anything else, on the main thread; it also takes the GIL.
+void registerMainThread();
+// Runs func(arg1, arg2) on a new thread, which gets the GIL before it starts.  Returns the thread's id.
+intptr_t startThread(Box* (*func)(Box*, Box*), Box* arg1, Box* arg2);
+
+void acquireGIL();
+void releaseGIL();
+
+// How many threads are waiting for the GIL; the safepoints only call gilYield if this is nonzero.
+// A pending safepoint callback (see below) counts as one more.
+extern std::atomic<int64_t> threads_waiting_on_gil;
+
+// Has the next safepoint that gets reached call f, with the GIL held; meant for signal handlers, which can't
+// do much themselves.  Only one callback can be pending at a time; requests made while one is are dropped.
+void requestSafepointCallback(void (*f)());
+
+// For blocking calls: gives up the GIL for the lifetime of the object.  The code in between can't touch
+// python objects or allocate from the gc heap.
+class GLAllowThreadsRegion {
+    public:
+        GLAllowThreadsRegion() {
+            releaseGIL();
+        }
+        ~GLAllowThreadsRegion() {
+            acquireGIL();
+        }
+};
+
+// fork() only copies the calling thread, so the others have to be dropped in the child.
+void beforeFork();
+void afterFork(bool in_child);
+
+} // namespace threading
+
+// What the safepoints call: lets the threads that are waiting for the GIL have it, and then takes it back.
+extern "C" void gilYield();
+
+namespace threading {
+inline void allowGLPreemption() {
+    if (threads_waiting_on_gil.load(std::memory_order_relaxed))
+        gilYield();
+}
+}
+
+} // namespace pyston
+
+#endif
@@ -0,0 +1,126 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <mutex>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "core/common.h"
+#include "core/trace.h"
+
+namespace pyston {
+
+bool TRACING = false;
+
+static FILE* trace_f;
+static pid_t trace_pid;
+// Never freed, since the compile threads could still be tracing while the static destructors run:
+static std::mutex *trace_lock;
+static bool first_event = true;
+
+static std::string jsonString(const std::string &s) {
+    std::string rtn = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            rtn += '\\';
+            rtn += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            rtn += buf;
+        } else {
+            rtn += c;
+        }
+    }
+    rtn += '"';
+    return rtn;
+}
+
+void addTraceArg(TraceArgs &args, const char* key, const std::string &value) {
+    args.push_back(std::make_pair(key, jsonString(value)));
+}
+
+void addTraceArg(TraceArgs &args, const char* key, long value) {
+    args.push_back(std::make_pair(key, std::to_string(value)));
+}
+
+long traceNow() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+static void writeEvent(const char* category, const std::string &name, char phase, long ts, long dur, const TraceArgs &args) {
+    std::lock_guard<std::mutex> _lock(*trace_lock);
+    // Forked children would just be writing into the parent's file:
+    if (trace_f == NULL || getpid() != trace_pid)
+        return;
+
+    fprintf(trace_f, "%s{\"name\": %s, \"cat\": \"%s\", \"ph\": \"%c\", \"ts\": %ld, ", first_event ? "" : ",\n",
+            jsonString(name).c_str(), category, phase, ts);
+    if (phase == 'X')
+        fprintf(trace_f, "\"dur\": %ld, ", dur);
+    else
+        fprintf(trace_f, "\"s\": \"t\", ");
+    fprintf(trace_f, "\"pid\": %d, \"tid\": %ld", trace_pid, syscall(SYS_gettid));
+    if (args.size()) {
+        fprintf(trace_f, ", \"args\": {");
+        for (int i = 0; i < args.size(); i++)
+            fprintf(trace_f, "%s\"%s\": %s", i ? ", " : "", args[i].first, args[i].second.c_str());
+        fprintf(trace_f, "}");
+    }
+    fprintf(trace_f, "}");
+    first_event = false;
+}
+
+void traceComplete(const char* category, const std::string &name, long start_us, const TraceArgs &args) {
+    if (!TRACING)
+        return;
+    writeEvent(category, name, 'X', start_us, traceNow() - start_us, args);
+}
+
+void traceInstant(const char* category, const std::string &name, const TraceArgs &args) {
+    if (!TRACING)
+        return;
+    writeEvent(category, name, 'i', traceNow(), 0, args);
+}
+
+static void finishTrace() {
+    std::lock_guard<std::mutex> _lock(*trace_lock);
+    if (trace_f == NULL || getpid() != trace_pid)
+        return;
+    fprintf(trace_f, "\n]\n");
+    fclose(trace_f);
+    trace_f = NULL;
+}
+
+void startTracing(const char* filename) {
+    RELEASE_ASSERT(!TRACING, "can only start tracing once");
+
+    trace_f = fopen(filename, "w");
+    if (!trace_f) {
+        fprintf(stderr, "Error: couldn't open %s for writing\n", filename);
+        exit(1);
+    }
+    fprintf(trace_f, "[\n");
+    trace_pid = getpid();
+    trace_lock = new std::mutex();
+    TRACING = true;
+    atexit(finishTrace);
+}
+
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CORE_TRACE_H
+#define PYSTON_CORE_TRACE_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pyston {
+
+// A timeline of what the runtime is spending its time on (compiles and their phases, llvm passes, IC
+// rewrites, OSR exits, gc pauses, and everything that's timed with a Timer), in the trace event format
+// that chrome://tracing and the like can load.  Nothing gets recorded unless startTracing() was called.
+extern bool TRACING;
+
+void startTracing(const char* filename);
+
+// Each value is already json-encoded:
+typedef std::vector<std::pair<const char*, std::string> > TraceArgs;
+void addTraceArg(TraceArgs &args, const char* key, const std::string &value);
+void addTraceArg(TraceArgs &args, const char* key, long value);
+
+// In microseconds; what the event timestamps are relative to.
+long traceNow();
+// Records something that ran on this thread from start_us until now.
+void traceComplete(const char* category, const std::string &name, long start_us, const TraceArgs &args = TraceArgs());
+void traceInstant(const char* category, const std::string &name, const TraceArgs &args = TraceArgs());
+
+// Records the scope that it's in as a single event.
+class TraceScope {
+    private:
+        const char* category;
+        std::string name;
+        long start_us;
+        TraceArgs args;
+    public:
+        TraceScope(const char* category, const std::string &name) : category(category), start_us(-1) {
+            if (TRACING) {
+                this->name = name;
+                start_us = traceNow();
+            }
+        }
+        ~TraceScope() {
+            if (start_us >= 0)
+                traceComplete(category, name, start_us, args);
+        }
+
+        template <typename T> void addArg(const char* key, const T &value) {
+            if (start_us >= 0)
+                addTraceArg(args, key, value);
+        }
+};
+
+}
+
+#endif
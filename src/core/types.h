@@ -19,7 +19,10 @@
 // over having them spread randomly in different files, this should probably be split again
 // but in a way that makes more sense.
 
+#include <map>
+
 #include "core/common.h"
+#include "core/intern.h"
 #include "core/stats.h"
 
 namespace llvm {
@@ -61,7 +64,7 @@ class AllocationKind {
                 gc_handler(gc_handler), finalizer(finalizer), kind_id(registerKind(this)) {
         }
 };
-extern "C" const AllocationKind untracked_kind, conservative_kind;
+extern "C" const AllocationKind untracked_kind;
 
 class ObjectFlavor;
 extern "C" const ObjectFlavor user_flavor;
@@ -112,9 +115,11 @@ class AST_stmt;
 class PhiAnalysis;
 class LivenessAnalysis;
 class ScopingAnalysis;
+class TypeAnalysis;
 
 class CLFunction;
 class OSREntryDescriptor;
+class TypeFeedback;
 
 class ICInvalidator {
     private:
@@ -160,7 +165,7 @@ struct CompiledFunction {
             Box* (*call)(Box*, Box*, Box*, Box**);
             void* code;
         };
-        llvm::Value *llvm_code; // the llvm callable.
+        llvm::Value *llvm_code; // the llvm callable; only set for jitted code.
 
         EffortLevel::EffortLevel effort;
 
@@ -173,6 +178,10 @@ struct CompiledFunction {
 };
 
 class BoxedModule;
+// Not a valid Python identifier, so it can't collide with any of the function's own names.  This is also
+// what the closure gets passed as through OSR.
+#define CLOSURE_ARG_NAME "#closure"
+
 class SourceInfo {
     public:
         BoxedModule *parent_module;
@@ -181,6 +190,13 @@ class SourceInfo {
         CFG *cfg;
         LivenessAnalysis *liveness;
         PhiAnalysis *phis;
+        // The non-speculative type analyses, by argument types; see getTypeAnalysis() in irgen.cpp.
+        std::map<std::vector<ConcreteCompilerType*>, TypeAnalysis*> type_analyses;
+        // Filled in by the lower tiers, for the higher ones to speculate with:
+        TypeFeedback *type_feedback;
+        // The parameters that the function's code takes: the named ones, then the *args and **kwargs
+        // ones if it has those, then a CLOSURE_ARG_NAME one if it takes a closure.
+        std::vector<AST_expr*> arg_names;
 
         const std::string getName();
         AST_arguments* getArgsAST();
@@ -188,7 +204,10 @@ class SourceInfo {
         const std::vector<AST_stmt*>& getBody();
 
         SourceInfo(BoxedModule* m, ScopingAnalysis *scoping) : parent_module(m), scoping(scoping),
-                ast(NULL), cfg(NULL), liveness(NULL), phis(NULL) {}
+                ast(NULL), cfg(NULL), liveness(NULL), phis(NULL), type_feedback(NULL) {}
+        // Frees the cfg (all of it at once, since it's arena-allocated) and the analyses of it; the ast and
+        // the scoping analysis belong to the module.
+        ~SourceInfo();
 };
 typedef std::vector<CompiledFunction*> FunctionList;
 struct CLFunction {
@@ -196,21 +215,79 @@ struct CLFunction {
     FunctionList versions; // any compiled versions along with their type parameters; in order from most preferred to least
     std::unordered_map<const OSREntryDescriptor*, CompiledFunction*> osr_versions;
 
-    CLFunction(SourceInfo *source) : source(source) {
+    // resolveCLFunc's recent choices, keyed by the classes of the arguments, so that calls from polymorphic
+    // sites don't have to rescan the versions every time.  Only calls with up to VERSION_CACHE_MAX_ARGS
+    // arguments get cached.  Anything that changes versions has to go through addVersion/removeVersion,
+    // which clear it.
+    static const int VERSION_CACHE_SIZE = 4;
+    static const int VERSION_CACHE_MAX_ARGS = 4;
+    struct VersionCacheEntry {
+        CompiledFunction *cf;
+        int64_t nargs;
+        BoxedClass* arg_classes[VERSION_CACHE_MAX_ARGS];
+    };
+    VersionCacheEntry version_cache[VERSION_CACHE_SIZE];
+    int version_cache_next;
+
+    CLFunction(SourceInfo *source) : source(source), version_cache_next(0) {
+        clearVersionCache();
+    }
+
+    void clearVersionCache() {
+        for (int i = 0; i < VERSION_CACHE_SIZE; i++)
+            version_cache[i].cf = NULL;
+    }
+
+    CompiledFunction* lookupVersionCache(int64_t nargs, BoxedClass* const* arg_classes) {
+        assert(nargs <= VERSION_CACHE_MAX_ARGS);
+        for (int i = 0; i < VERSION_CACHE_SIZE; i++) {
+            VersionCacheEntry &e = version_cache[i];
+            if (e.cf == NULL || e.nargs != nargs)
+                continue;
+            bool match = true;
+            for (int j = 0; j < nargs; j++) {
+                if (e.arg_classes[j] != arg_classes[j]) {
+                    match = false;
+                    break;
+                }
+            }
+            if (match)
+                return e.cf;
+        }
+        return NULL;
+    }
+
+    void addToVersionCache(int64_t nargs, BoxedClass* const* arg_classes, CompiledFunction *cf) {
+        assert(nargs <= VERSION_CACHE_MAX_ARGS);
+        VersionCacheEntry &e = version_cache[version_cache_next];
+        version_cache_next = (version_cache_next + 1) % VERSION_CACHE_SIZE;
+        e.cf = cf;
+        e.nargs = nargs;
+        for (int j = 0; j < nargs; j++)
+            e.arg_classes[j] = arg_classes[j];
     }
 
     void addVersion(CompiledFunction *compiled) {
         assert(compiled);
-        assert((source == NULL) == (compiled->func == NULL));
+        // (versions run by the AST interpreter don't have any IR)
+        assert((source == NULL) == (compiled->func == NULL) || (compiled->is_interpreted && compiled->func == NULL));
         assert(compiled->sig);
         assert(compiled->clfunc == NULL);
         assert(compiled->is_interpreted == (compiled->code == NULL));
-        assert(compiled->is_interpreted == (compiled->llvm_code == NULL));
+        assert(compiled->llvm_code == NULL || !compiled->is_interpreted);
         compiled->clfunc = this;
-        if (compiled->entry_descriptor == NULL)
+        if (compiled->entry_descriptor == NULL) {
             versions.push_back(compiled);
-        else
+            clearVersionCache();
+        } else {
             osr_versions[compiled->entry_descriptor] = compiled;
+        }
+    }
+
+    void removeVersion(int idx) {
+        assert(0 <= idx && idx < versions.size());
+        versions.erase(versions.begin() + idx);
+        clearVersionCache();
     }
 };
 
@@ -238,12 +315,17 @@ extern "C" const std::string* getNameOfClass(BoxedClass* cls);
 class Rewriter;
 class RewriterVar;
 
+extern "C" void rt_set_finalizable(void*);
+
+// Everything in the gc heap apart from Boxes starts with one of these; Boxes get their kind from their
+// class instead (see BoxedClass::instance_flavor).  Kind ids are always odd, so that the collector can tell
+// the two apart from the low bit of the first word.  The collector's per-object bits (mark, remembered,
+// etc) live in the heap's side tables.
 struct GCObjectHeader {
     kindid_t kind_id;
     uint16_t kind_data; // this part of the header is free for the kind to set as it wishes.
-    uint8_t gc_flags;
 
-    constexpr GCObjectHeader(const AllocationKind *kind) : kind_id(kind->kind_id), kind_data(0), gc_flags(0) {}
+    constexpr GCObjectHeader(const AllocationKind *kind) : kind_id(kind->kind_id), kind_data(0) {}
 };
 static_assert(sizeof(GCObjectHeader) <= sizeof(void*), "");
 
@@ -265,35 +347,106 @@ class GCObject {
 extern "C" const AllocationKind hc_kind;
 class HiddenClass : public GCObject {
     private:
-        HiddenClass() : GCObject(&hc_kind) {}
-        HiddenClass(const HiddenClass* parent) : GCObject(&hc_kind), attr_offsets(parent->attr_offsets) {}
+        HiddenClass(int num_inline_slots, int num_list_slots, bool is_dict_mode=false) : GCObject(&hc_kind), attr_index(NULL), children_index(NULL), num_inline_slots(num_inline_slots), num_list_slots(num_list_slots), is_dict_mode(is_dict_mode), parent(NULL) {}
+        HiddenClass(HiddenClass* parent) : GCObject(&hc_kind), attr_index(NULL), children_index(NULL), num_inline_slots(parent->num_inline_slots), num_list_slots(parent->num_list_slots), is_dict_mode(false), parent(parent), attr_names(parent->attr_names) {}
+
+        // Most hidden classes only have a handful of attributes and children, which are faster to
+        // find (and take less memory) as short arrays that get scanned linearly.  Past this many
+        // entries, lookups go through a hash table instead.
+        static const int MAX_LINEAR_ENTRIES = 16;
+
+        std::unordered_map<const std::string*, int> *attr_index;
+        std::unordered_map<const std::string*, HiddenClass*> *children_index;
+
+        void dropDeadChildren();
+
     public:
-        static HiddenClass* getRoot();
-        std::unordered_map<std::string, int> attr_offsets;
-        std::unordered_map<std::string, HiddenClass*> children;
+        // Each object layout (number of attribute slots allocated inside the object, and in the
+        // attr_list it starts out with) gets its own tree of hidden classes, so guarding on the
+        // hidden class also guards on the layout.
+        static HiddenClass* getRoot(int num_inline_slots=0, int num_list_slots=0);
+        // Objects that get too many attributes stop getting new hidden classes, and instead keep
+        // their attributes in a per-object hash table (HCBox::attr_dict).  They all share this
+        // hidden class, which has no attributes or children of its own:
+        static HiddenClass* getDictMode();
+
+        const int num_inline_slots;
+        // Objects with this layout get an attr_list of at least this many entries when they're
+        // created, so adding attributes that fit in it doesn't need to allocate.
+        const int num_list_slots;
+        const bool is_dict_mode;
+
+        // The transitions are weak: a hidden class only stays alive while there are objects that have
+        // it (or one of its descendants, since the parent pointers are strong), and the collector drops
+        // the children that died (see dropDeadTransitions).  ICs that bake in a hidden class's address
+        // depend on dependent_ics, which gets invalidated when it's freed, so that the address can't
+        // get mistaken for a new hidden class that ends up in the same memory.
+        HiddenClass* const parent;
+        ICInvalidator dependent_ics;
+
+        ~HiddenClass() {
+            delete attr_index;
+            delete children_index;
+        }
 
-        HiddenClass* getOrMakeChild(const std::string &attr);
+        // Attribute names are interned (see core/intern.h), so they can be compared by pointer.
+        // attr_names[i] is the name of the attribute at offset i.
+        std::vector<const std::string*> attr_names;
+        std::vector<std::pair<const std::string*, HiddenClass*> > children;
 
+        int numAttrs() {
+            return attr_names.size();
+        }
+
+        HiddenClass* getOrMakeChild(const std::string* interned_attr);
+        // Called by the collector once marking is done, for all of the roots:
+        static void dropDeadTransitions();
+        HiddenClass* getOrMakeChild(const std::string &attr) {
+            return getOrMakeChild(internString(attr));
+        }
+
+        int getOffset(const std::string* interned_attr) {
+            if (attr_index) {
+                std::unordered_map<const std::string*, int>::iterator it = attr_index->find(interned_attr);
+                if (it == attr_index->end())
+                    return -1;
+                return it->second;
+            }
+
+            for (int i = 0, n = attr_names.size(); i < n; i++) {
+                if (attr_names[i] == interned_attr)
+                    return i;
+            }
+            return -1;
+        }
         int getOffset(const std::string& attr) {
-            std::unordered_map<std::string, int>::iterator it = attr_offsets.find(attr);
-            if (it == attr_offsets.end())
-                return -1;
-            return it->second;
+            return getOffset(internString(attr));
         }
 };
 
+// Set once the runtime is up if the allocation profiler is on (see runtime/alloc_profile.h):
 extern bool TRACK_ALLOCATIONS;
-class Box : public GCObject {
+void trackAllocation(Box* b) __attribute__((visibility("default")));
+// Boxes don't have a GCObjectHeader, so that the small ones (ints, floats) fit in 16 bytes; flavor has
+// to be cls->instance_flavor.
+class Box {
     public:
         BoxedClass *cls;
 
-        constexpr Box(const ObjectFlavor *flavor, BoxedClass *c) __attribute__((visibility("default"))) : GCObject(flavor), cls(c) {
-            //if (TRACK_ALLOCATIONS) {
-                //int id = Stats::getStatId("allocated_" + *getNameOfClass(c));
-                //Stats::log(id);
-            //}
+        Box(const ObjectFlavor *flavor, BoxedClass *c) __attribute__((visibility("default"))) : cls(c) {
+            // The sweep only has to look at the class of objects that might need finalizing:
+            if (flavor->finalizer)
+                rt_set_finalizable(this);
+            if (TRACK_ALLOCATIONS)
+                trackAllocation(this);
         }
 
+        void* operator new(size_t size) __attribute__((visibility("default"))) {
+            return rt_alloc(size);
+        }
+        void operator delete(void* ptr) __attribute__((visibility("default"))) {
+            rt_free(ptr);
+        }
 };
 
 
@@ -309,20 +462,61 @@ class HCBox : public Box {
         struct AttrList : GCObject {
             Box* attrs[0];
         };
+        // Open-addressed table of interned name -> value; capacity is a power of two.
+        struct AttrDict : GCObject {
+            int num_attrs, capacity;
+            struct Entry {
+                const std::string* name;
+                Box* val;
+            } entries[0];
+        };
 
         HiddenClass *hcls;
-        // Python-level attributes:
-        AttrList *attr_list;
+        // Python-level attributes.  The first hcls->num_inline_slots of them are stored at the
+        // end of the object itself, and the rest go in attr_list.  If hcls is in dict mode, all of
+        // them are in attr_dict instead.
+        union {
+            AttrList *attr_list;
+            AttrDict *attr_dict;
+        };
 
         HCBox(const ObjectFlavor *flavor, BoxedClass *cls);
+        HCBox(const ObjectFlavor *flavor, BoxedClass *cls, int num_inline_slots, int num_list_slots);
+
+        void* operator new(size_t size) __attribute__((visibility("default"))) {
+            return rt_alloc(size);
+        }
+        // Only for objects that are exactly HCBox's, since the slots go right after the HCBox fields:
+        void* operator new(size_t size, int num_inline_slots) __attribute__((visibility("default"))) {
+            return rt_alloc(size + num_inline_slots * sizeof(Box*));
+        }
+
+        Box** inlineAttrs() {
+            return reinterpret_cast<Box**>(this + 1);
+        }
+        Box** attrSlot(int offset) {
+            int num_inline = hcls->num_inline_slots;
+            if (offset < num_inline)
+                return &inlineAttrs()[offset];
+            return &attr_list->attrs[offset - num_inline];
+        }
+
+        // Returns NULL if the (dict-mode) object doesn't have the attribute:
+        Box** getDictSlot(const std::string* interned_attr);
+        void dictSetattr(const std::string* interned_attr, Box* val);
+        void convertToDictMode();
 
         void setattr(const std::string &attr, Box* val, SetattrRewriteArgs* rewrite_args, SetattrRewriteArgs2 *rewrite_args2);
         void giveAttr(const std::string &attr, Box* val);
         Box* getattr(const std::string &attr, GetattrRewriteArgs* rewrite_args, GetattrRewriteArgs2* rewrite_args2);
         Box* peekattr(const std::string &attr) {
+            if (hcls->is_dict_mode) {
+                Box** slot = getDictSlot(internString(attr));
+                return slot ? *slot : NULL;
+            }
             int offset = hcls->getOffset(attr);
             if (offset == -1) return NULL;
-            return attr_list->attrs[offset];
+            return *attrSlot(offset);
         }
 };
 
@@ -332,6 +526,10 @@ class BoxedClass : public HCBox {
         //typedef void (*Dtor)(Box*);
         typedef void* Dtor;
 
+        // What all instances of this class get created with; this is how the collector finds their
+        // gc handler and finalizer, since Boxes don't have a gc header.
+        const ObjectFlavor* const instance_flavor;
+
         // whether or not instances of this class are subclasses of HCBox,
         // ie they have python-level instance attributes:
         const bool hasattrs;
@@ -351,7 +549,20 @@ class BoxedClass : public HCBox {
         // to guard on anything about the class.
         ICInvalidator dependent_icgetattrs;
 
-        BoxedClass(bool hasattrs, Dtor dtor);
+        // How many attribute slots to allocate inside new instances, and how many to preallocate in
+        // their attr_list; these grow to fit the number of attributes instances end up with after
+        // __init__ (up to MAX_INLINE_ATTRS inside the object).
+        int instance_inline_attrs, instance_list_attrs;
+
+        // Changes every time an attribute of the class gets set; tags are never reused (even across
+        // classes), so they can be used to validate cached lookups.
+        int64_t version_tag;
+
+        // A native version of __hasnext__ followed by next, for the builtin iterators, that returns
+        // NULL if there's nothing left.  For loops call this directly (see iterNext()).
+        Box* (*iter_next)(Box*);
+
+        BoxedClass(const ObjectFlavor *instance_flavor, bool hasattrs, Dtor dtor);
         void freeze() {
             assert(!is_constant);
             is_constant = true;
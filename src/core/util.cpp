@@ -20,6 +20,7 @@
 
 #include "core/common.h"
 #include "core/options.h"
+#include "core/trace.h"
 
 #include "core/util.h"
 
@@ -36,6 +37,7 @@ void Timer::restart(const char* newdesc, int min_usec) {
     desc = newdesc;
     this->min_usec = min_usec;
     gettimeofday(&start_time, NULL);
+    trace_start_us = TRACING ? traceNow() : -1;
     Timer::level++;
     ended = false;
 }
@@ -47,6 +49,8 @@ long Timer::end() {
         long us = 1000000L * (end.tv_sec - start_time.tv_sec) + (end.tv_usec - start_time.tv_usec);
 
         Timer::level--;
+        if (trace_start_us >= 0)
+            traceComplete("timer", desc, trace_start_us);
         if (VERBOSITY("time") >= 1) {
             if (us > min_usec) {
                 for (int i = 0; i < Timer::level; i++) {
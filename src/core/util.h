@@ -29,6 +29,8 @@ class Timer {
         const char* desc;
         int min_usec;
         bool ended;
+        // -1 if we're not tracing:
+        long trace_start_us;
     public:
         Timer(const char* desc, int min_usec=-1);
         ~Timer();
@@ -12,27 +12,58 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 #define UNW_LOCAL_ONLY
 #include <libunwind.h>
 
 #include "core/common.h"
+#include "core/options.h"
+#include "core/trace.h"
+#include "core/util.h"
 #include "core/types.h"
 
 #include "codegen/codegen.h"
 
 #include "gc/collector.h"
+#include "gc/gc_stats.h"
 #include "gc/heap.h"
+#include "gc/numa.h"
 #include "gc/root_finder.h"
 
 namespace pyston {
 namespace gc {
 
 //unsigned numAllocs = 0;
-unsigned bytesAllocatedSinceCollection = 0;
+long bytesAllocatedSinceCollection = 0;
+
+// How much to let the program allocate before doing the next collection; recomputed after
+// every collection based on the size of the heap.
+#define MIN_ALLOCBYTES_PER_COLLECTION 2000000
+long allocBytesBeforeCollection = MIN_ALLOCBYTES_PER_COLLECTION;
+
+// Bytes in the heap as of the end of the last collection, ie the surviving objects plus any
+// old garbage that a minor collection didn't look at.  Only known once sweeping is done.
+static long bytesInHeap = 0;
+
+// Do a full collection once this much has been promoted to the old generation:
+#define PROMOTEDBYTES_PER_FULL_COLLECTION 20000000
+static long bytesPromotedSinceFullCollection = 0;
+
+static std::vector<WeakRefCallback> weak_ref_callbacks;
+void registerWeakRefCallback(WeakRefCallback callback) {
+    weak_ref_callbacks.push_back(callback);
+}
 
 static TraceStack roots;
 void registerStaticRootObj(void* obj) {
@@ -75,76 +106,612 @@ void TraceStackGCVisitor::visitPotentialRange(void** start, void** end) {
 }
 
 #define MAX_KINDS 1024
+// Kind ids are odd (see GCObjectHeader), so they go up by two:
 #define KIND_OFFSET 0x111
 static kindid_t num_kinds = 0;
 static AllocationKind::GCHandler handlers[MAX_KINDS];
+static AllocationKind::FinalizationFunc finalizers[MAX_KINDS];
 
 extern "C" kindid_t registerKind(const AllocationKind *kind) {
     assert(kind == &untracked_kind || kind->gc_handler);
     assert(num_kinds < MAX_KINDS);
     assert(handlers[num_kinds] == NULL);
     handlers[num_kinds] = kind->gc_handler;
-    return KIND_OFFSET + num_kinds++;
+    finalizers[num_kinds] = kind->finalizer;
+    return KIND_OFFSET + 2 * num_kinds++;
+}
+
+static inline int kindIndex(GCObjectHeader* header) {
+    int idx = (header->kind_id - KIND_OFFSET) / 2;
+    ASSERT((header->kind_id & 1) && 0 <= idx && idx < num_kinds, "%p %d", header, header->kind_id);
+    return idx;
+}
+
+static inline void visitByGCKind(void* p, GCVisitor *visitor) {
+    if (isBox(p)) {
+        Box* b = static_cast<Box*>(p);
+        assert(b->cls);
+        const ObjectFlavor* flavor = b->cls->instance_flavor;
+        assert(flavor->gc_handler);
+        flavor->gc_handler(visitor, p);
+        return;
+    }
+
+    GCObjectHeader* header = headerFromObject(p);
+    if (header->kind_id == untracked_kind.kind_id)
+        return;
+
+    AllocationKind::GCHandler gcf = handlers[kindIndex(header)];
+    assert(gcf);
+    gcf(visitor, p);
+}
+
+void visitReferences(void* p, GCVisitor* visitor) {
+    visitByGCKind(p, visitor);
+}
+
+// Only called on objects that are still allocated.  Boxes only get here if they have the finalizable bit,
+// and the classes with finalizers are all builtin ones, so the class is still around even if the sweep
+// has already gotten to garbage that was allocated after the object was.
+static AllocationKind::FinalizationFunc finalizerFor(void* obj) {
+    if (isBox(obj))
+        return static_cast<Box*>(obj)->cls->instance_flavor->finalizer;
+    return finalizers[kindIndex(headerFromObject(obj))];
+}
+
+static std::vector<void*> finalization_queue;
+bool queueForFinalization(void* obj) {
+    if (isFinalizationPending(obj))
+        return true;
+
+    // The sweep calls this for every dead object; most Boxes don't have a finalizer, and this way
+    // it doesn't have to look at their class at all:
+    if (isBox(obj) && !isFinalizable(obj))
+        return false;
+
+    if (!finalizerFor(obj))
+        return false;
+
+    setFinalizationPending(obj);
+    finalization_queue.push_back(obj);
+    return true;
+}
+
+void runPendingFinalizers() {
+    static StatCounter sc("gc_finalized_objs");
+
+    // Finalizers can allocate, which can trigger another collection:
+    static bool running = false;
+    if (running)
+        return;
+    running = true;
+
+    while (finalization_queue.size()) {
+        std::vector<void*> to_finalize;
+        to_finalize.swap(finalization_queue);
+        for (void* p : to_finalize) {
+            assert(isFinalizationPending(p));
+            finalizerFor(p)(p);
+            global_heap.free(p);
+        }
+        sc.log(to_finalize.size());
+    }
+
+    running = false;
+}
+
+static std::vector<void*> remembered_set;
+void _rememberObject(void* obj) {
+    static StatCounter sc("gc_remembered_objs");
+    sc.log();
+
+    assert(isMarked(obj));
+    assert(!isRemembered(obj));
+    setRemembered(obj);
+    remembered_set.push_back(obj);
+}
+
+// Used to rescan remembered objects during a minor collection.
+// Old objects get skipped; the remembered object's own handler is responsible for
+// finding any young pointers that are stored in its private storage.
+class RememberedSetVisitor : public GCVisitor {
+    private:
+        TraceStack *stack;
+
+        void _visit(void* p) {
+            if (!isMarked(p))
+                stack->push(p);
+        }
+
+    public:
+        RememberedSetVisitor(TraceStack *stack) : stack(stack) {}
+
+        void scan(void* p) {
+            visitByGCKind(p, this);
+        }
+
+        void visit(void* p) override {
+            assert(global_heap.getAllocationFromInteriorPointer(p));
+            _visit(p);
+        }
+
+        void visitRange(void** start, void** end) override {
+            while (start < end) {
+                visit(*start);
+                start++;
+            }
+        }
+
+        void visitPotential(void* p) override {
+            void* a = global_heap.getAllocationFromInteriorPointer(p);
+            if (a)
+                _visit(a);
+        }
+
+        void visitPotentialRange(void** start, void** end) override {
+            while (start < end) {
+                visitPotential(*start);
+                start++;
+            }
+        }
+};
+
+static inline void markAndScan(void* p, GCVisitor *visitor, bool parallel) {
+    assert(((intptr_t)p) % 8 == 0);
+    //printf("%p\n", p);
+
+    if (parallel) {
+        // Another thread could be trying to mark the same object:
+        if (!tryMark(p))
+            return;
+    } else {
+        if (isMarked(p)) {
+            //printf("Already marked, skipping\n");
+            return;
+        }
+        setMark(p);
+    }
+
+    //printf("Marking + scanning %p\n", p);
+    visitByGCKind(p, visitor);
 }
 
-static void markPhase() {
+// Nearly every object that the mark loop pops is a cache miss, first on its mark bit (in the side
+// tables) and then on its first word (its class or kind).  So instead of scanning objects as soon as
+// they come off the stack, drainMarkStack prefetches both and puts the object in a small FIFO, and
+// scans whatever's been in there the longest, which gives the loads time to finish.
+#define MARK_PREFETCH_DISTANCE 8
+
+static inline void prefetchForMarking(void* p) {
+    uint64_t mask;
+    uint64_t* word = bitWordForObject(p, MARK_BIT, &mask);
+    if (word)
+        __builtin_prefetch(word, 1);
+    __builtin_prefetch(p);
+}
+
+// Marks and scans everything reachable from the stack, or until max_objects objects have been
+// looked at; returns whether there's anything left.  (The objects that are still in the FIFO at that
+// point go back on the stack.)
+static bool drainMarkStack(TraceStack *stack, GCVisitor *visitor, long max_objects = -1) {
+    void* fifo[MARK_PREFETCH_DISTANCE];
+    int head = 0, n = 0;
+    long nscanned = 0;
+
+    while (true) {
+        if (nscanned == max_objects) {
+            for (int i = 0; i < n; i++)
+                stack->push(fifo[(head + i) % MARK_PREFETCH_DISTANCE]);
+            return n != 0 || stack->size() != 0;
+        }
+
+        void* p = stack->pop();
+        void* next;
+        if (p) {
+            prefetchForMarking(p);
+            if (n < MARK_PREFETCH_DISTANCE) {
+                fifo[(head + n) % MARK_PREFETCH_DISTANCE] = p;
+                n++;
+                continue;
+            }
+            next = fifo[head];
+            fifo[head] = p;
+        } else {
+            if (n == 0)
+                return false;
+            next = fifo[head];
+            n--;
+        }
+        head = (head + 1) % MARK_PREFETCH_DISTANCE;
+
+        markAndScan(next, visitor, false);
+        nscanned++;
+    }
+}
+
+// Work is shared between the marking threads in chunks of this many objects:
+#define MARK_CHUNK_SIZE 256
+
+// The global pool of chunks that marking threads give away to and steal from.
+// Threads only touch it when they run out of work, or when they have plenty of
+// work and there's some other thread waiting for it.
+// Chunks are kept per NUMA node (see numa.h), and threads take work from their own
+// node before they take it from anyone else's.
+class MarkWorkPool {
+    private:
+        std::mutex lock;
+        std::condition_variable cv;
+        std::vector<std::vector<void*> > chunks[MAX_NUMA_NODES];
+        int nchunks;
+        const int nthreads;
+        std::atomic<int> nidle;
+        bool done;
+
+    public:
+        MarkWorkPool(int nthreads) : nchunks(0), nthreads(nthreads), nidle(0), done(false) {}
+
+        bool hasIdleThreads() {
+            return nidle.load(std::memory_order_relaxed) > 0;
+        }
+
+        void donate(int node, std::vector<void*> &&chunk) {
+            std::lock_guard<std::mutex> l(lock);
+            chunks[node].push_back(std::move(chunk));
+            nchunks++;
+            cv.notify_one();
+        }
+
+        // Blocks until it can hand out a chunk of work; returns false once every
+        // thread is out of work, ie marking is finished.
+        bool steal(int node, std::vector<void*> *into) {
+            std::unique_lock<std::mutex> l(lock);
+            nidle++;
+            while (nchunks == 0 && !done) {
+                if (nidle == nthreads) {
+                    done = true;
+                    cv.notify_all();
+                    break;
+                }
+                cv.wait(l);
+            }
+            if (done)
+                return false;
+
+            nidle--;
+            int from = node;
+            while (chunks[from].empty())
+                from = (from + 1) % MAX_NUMA_NODES;
+            *into = std::move(chunks[from].back());
+            chunks[from].pop_back();
+            nchunks--;
+            return true;
+        }
+};
+
+static void markWorker(MarkWorkPool *pool, int node) {
+    TraceStack stack;
+    TraceStackGCVisitor visitor(&stack);
+
+    std::vector<void*> chunk;
+    while (pool->steal(node, &chunk)) {
+        stack.pushAll(chunk);
+        chunk.clear();
+
+        while (void* p = stack.pop()) {
+            markAndScan(p, &visitor, true);
+
+            if (stack.size() >= 2 * MARK_CHUNK_SIZE && pool->hasIdleThreads()) {
+                std::vector<void*> give;
+                stack.popInto(&give, MARK_CHUNK_SIZE);
+                pool->donate(node, std::move(give));
+            }
+        }
+    }
+}
+
+static void parallelMark(TraceStack *roots, int nthreads) {
+    static StatCounter sc("gc_parallel_marks");
+    sc.log();
+
+    MarkWorkPool pool(nthreads);
+    int nnodes = numNumaNodes();
+    if (nnodes == 1) {
+        while (roots->size()) {
+            std::vector<void*> chunk;
+            roots->popInto(&chunk, std::min(roots->size(), MARK_CHUNK_SIZE));
+            pool.donate(0, std::move(chunk));
+        }
+    } else {
+        // Hand each root to the node whose memory it's in, so that it gets scanned from there:
+        std::vector<void*> by_node[MAX_NUMA_NODES];
+        while (void* p = roots->pop()) {
+            int node = global_heap.nodeFor(p);
+            by_node[node].push_back(p);
+            if (by_node[node].size() == MARK_CHUNK_SIZE) {
+                pool.donate(node, std::move(by_node[node]));
+                by_node[node].clear();
+            }
+        }
+        for (int node = 0; node < nnodes; node++) {
+            if (by_node[node].size())
+                pool.donate(node, std::move(by_node[node]));
+        }
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nthreads; i++) {
+        threads.push_back(std::thread([&pool, i, nnodes]() {
+            pinThreadToNumaNode(i % nnodes);
+            markWorker(&pool, i % nnodes);
+        }));
+    }
+    markWorker(&pool, currentNumaNode());
+
+    for (std::thread &t : threads) {
+        t.join();
+    }
+}
+
+void collectRoots(TraceStack* stack) {
+    *stack = roots;
+    collectStackRoots(stack);
+}
+
+static void markPhase(bool minor) {
     TraceStack stack(roots);
     collectStackRoots(&stack);
 
     TraceStackGCVisitor visitor(&stack);
 
+    if (minor) {
+        RememberedSetVisitor remembered_visitor(&stack);
+        for (void* p : remembered_set) {
+            clearRemembered(p);
+            remembered_visitor.scan(p);
+        }
+    } else {
+        // A full collection retraces everything anyway
+        for (void* p : remembered_set) {
+            clearRemembered(p);
+        }
+    }
+    remembered_set.clear();
+
     //if (VERBOSITY()) printf("Found %d roots\n", stack.size());
-    while (void* p = stack.pop()) {
-        assert(((intptr_t)p) % 8 == 0);
-        GCObjectHeader* header = headerFromObject(p);
-        //printf("%p\n", p);
+    if (GC_MARK_THREADS > 1 && stack.size() > MARK_CHUNK_SIZE) {
+        parallelMark(&stack, GC_MARK_THREADS);
+        return;
+    }
 
-        if (isMarked(header)) {
-            //printf("Already marked, skipping\n");
-            continue;
-        }
+    drainMarkStack(&stack, &visitor);
+}
 
-        //printf("Marking + scanning %p\n", p);
+// Incremental marking (GC_INCREMENTAL_MARKING) works on the same principle as the generational
+// write barrier: once marking has started, a marked object is one that's been (or is about to be)
+// traced, and any time a pointer to an unmarked object gets stored into a marked one, that object
+// gets put on the remembered set.  A short final pause then rescans the roots, the stack and the
+// remembered set, and finishes off the trace.
+//
+// The marking slices happen at allocation time, on the thread that's allocating, so they see the
+// heap in the same state that a regular collection would.
+#define MARK_SLICE_OBJECTS 20000
+#define MARK_SLICE_ALLOCBYTES 500000
+static bool incrementalMarkInProgress = false;
+static TraceStack incremental_stack;
+static long incremental_mark_us = 0;
+
+static void startIncrementalMark() {
+    static StatCounter sc("gc_incremental_marks");
+    sc.log();
 
-        setMark(header);
+    global_heap.clearMarks();
+    for (void* p : remembered_set) {
+        clearRemembered(p);
+    }
+    remembered_set.clear();
 
-        ASSERT(KIND_OFFSET <= header->kind_id && header->kind_id < KIND_OFFSET + num_kinds, "%p %d", header, header->kind_id);
+    incremental_stack = roots;
+    collectStackRoots(&incremental_stack);
 
-        if (header->kind_id == untracked_kind.kind_id)
-            continue;
+    global_heap.setDeferFrees(true);
+    incrementalMarkInProgress = true;
+    incremental_mark_us = 0;
+}
 
-        //ASSERT(kind->_cookie == AllocationKind::COOKIE, "%lx %lx", kind->_cookie, AllocationKind::COOKIE);
-        //AllocationKind::GCHandler gcf = kind->gc_handler;
-        AllocationKind::GCHandler gcf = handlers[header->kind_id - KIND_OFFSET];
+// Traces a bounded number of objects; returns whether there's anything left to trace.
+static bool incrementalMarkSlice() {
+    static StatCounter sc("gc_mark_slices");
+    sc.log();
 
-        assert(gcf);
-        //if (!gcf) {
-            //std::string name = g.func_addr_registry.getFuncNameAtAddress((void*)kind, true);
-            //ASSERT(gcf, "%p %s", kind, name.c_str());
-        //}
+    TraceStackGCVisitor visitor(&incremental_stack);
+    return drainMarkStack(&incremental_stack, &visitor, MARK_SLICE_OBJECTS);
+}
 
-        gcf(&visitor, p);
+static void finishIncrementalMark() {
+    TraceStack &stack = incremental_stack;
+    TraceStackGCVisitor visitor(&stack);
 
+    // The roots and the remembered objects have already been marked, so they need to be
+    // rescanned directly:
+    TraceStack static_roots(roots);
+    while (void* p = static_roots.pop()) {
+        visitByGCKind(p, &visitor);
     }
+    for (void* p : remembered_set) {
+        clearRemembered(p);
+        visitByGCKind(p, &visitor);
+    }
+    remembered_set.clear();
+
+    collectStackRoots(&stack);
+
+    if (GC_MARK_THREADS > 1 && stack.size() > MARK_CHUNK_SIZE) {
+        parallelMark(&stack, GC_MARK_THREADS);
+    } else {
+        drainMarkStack(&stack, &visitor);
+    }
+
+    incrementalMarkInProgress = false;
+    global_heap.setDeferFrees(false);
+}
+
+// Nursery size at the last minor collection, for working out how much of it got promoted:
+static long bytesInLastNursery = 0;
+static bool sweepInProgress = false;
+static void finishPreviousSweep() {
+    if (!sweepInProgress)
+        return;
+    sweepInProgress = false;
+
+    long bytes_freed = global_heap.finishSweep();
+    bytesPromotedSinceFullCollection += std::max(0L, bytesInLastNursery - bytes_freed);
+    bytesInLastNursery = 0;
+
+    bytesInHeap = std::max(0L, bytesInHeap - bytes_freed);
+    recordSweepFinished(bytesInHeap, global_heap.lastSweepStats());
+
+    // Blocks only become empty when they get swept, so this is a good time to check on them:
+    global_heap.releaseEmptyBlocks(GC_BLOCK_RELEASE_DELAY_MS);
+}
+
+long trimHeap() {
+    std::lock_guard<std::recursive_mutex> _l(global_heap.lock);
+    finishPreviousSweep();
+    return global_heap.releaseEmptyBlocks(0);
 }
 
-static void sweepPhase() {
-    global_heap.freeUnmarked();
+static bool isOverMaxHeapSize() {
+    return GC_MAX_HEAP_SIZE && bytesInHeap >= GC_MAX_HEAP_SIZE;
+}
+
+static void scheduleNextCollection() {
+    // bytesInHeap doesn't know about the garbage found by this collection until it gets swept;
+    // use its value from the previous collection, which is the best guess we have.
+    long target = (long)(bytesInHeap * GC_HEAP_GROWTH_FACTOR);
+    if (GC_MIN_HEAP_SIZE)
+        target = std::max(target, GC_MIN_HEAP_SIZE);
+    if (GC_MAX_HEAP_SIZE)
+        target = std::min(target, GC_MAX_HEAP_SIZE);
+
+    allocBytesBeforeCollection = std::max((long)MIN_ALLOCBYTES_PER_COLLECTION, target - bytesInHeap);
+
+    if (VERBOSITY("gc") >= 2) printf("Heap is %ld bytes, next collection after %ld more\n", bytesInHeap, allocBytesBeforeCollection);
 }
 
 static int ncollections = 0;
-void runCollection() {
-    static StatCounter sc("gc_collections");
-    sc.log();
+static int nminor_collections = 0;
+static void collect(bool full) {
+    // The blocks that the threads are allocating out of aren't on the heap's lists:
+    global_heap.flushThreadCaches();
+
+    bool finish_incremental = false;
+    if (incrementalMarkInProgress) {
+        // Explicit collections, and running out of room, don't wait for the marking to finish:
+        if (!full && !isOverMaxHeapSize()) {
+            static StatCounter sc_us("gc_mark_slice_us");
+            Timer _ts("incremental marking");
+            bool more = incrementalMarkSlice();
+            long us = _ts.end();
+            sc_us.log(us);
+            incremental_mark_us += us;
+
+            if (more) {
+                allocBytesBeforeCollection = bytesAllocatedSinceCollection + MARK_SLICE_ALLOCBYTES;
+                return;
+            }
+        }
+        finish_incremental = true;
+        full = true;
+    }
 
-    if (VERBOSITY("gc") >= 2) printf("Collection #%d\n", ++ncollections);
+    Timer _t("collection");
+    TraceScope _trace("gc", full ? "full collection" : "minor collection");
+    CollectionInfo info;
+    memset(&info, 0, sizeof(info));
 
-    //if (ncollections == 754) {
-        //raise(SIGTRAP);
-    //}
+    Timer _t2("finishing the previous sweep");
+    finishPreviousSweep();
+    info.finish_sweep_us = _t2.end();
+
+    bool start_incremental = false;
+    if (!full && bytesPromotedSinceFullCollection >= PROMOTEDBYTES_PER_FULL_COLLECTION) {
+        full = true;
+        start_incremental = GC_INCREMENTAL_MARKING;
+    }
+    // Minor collections can't free anything in the old generation, so once we're at the heap
+    // limit, only a full collection will do (and it can't wait for an incremental mark).
+    if (isOverMaxHeapSize()) {
+        full = true;
+        start_incremental = false;
+    }
+
+    if (start_incremental) {
+        startIncrementalMark();
+        incremental_mark_us += _t.end();
+        allocBytesBeforeCollection = bytesAllocatedSinceCollection + MARK_SLICE_ALLOCBYTES;
+        return;
+    }
+
+    if (full) {
+        static StatCounter sc("gc_collections");
+        sc.log();
+
+        if (VERBOSITY("gc") >= 2) printf("Collection #%d\n", ++ncollections);
+
+        //if (ncollections == 754) {
+            //raise(SIGTRAP);
+        //}
+    } else {
+        static StatCounter sc("gc_minor_collections");
+        sc.log();
+
+        if (VERBOSITY("gc") >= 2) printf("Minor collection #%d\n", ++nminor_collections);
+    }
+
+    info.full = full;
+    info.heap_bytes_before = bytesInHeap + bytesAllocatedSinceCollection;
+    info.large_objs_before = global_heap.numLargeObjects();
+
+    _t2.restart("marking");
+    if (finish_incremental) {
+        finishIncrementalMark();
+        info.incremental_mark_us = incremental_mark_us;
+    } else {
+        if (full)
+            global_heap.clearMarks();
+        markPhase(!full);
+    }
+    for (WeakRefCallback callback : weak_ref_callbacks)
+        callback();
+    info.mark_us = _t2.end();
+
+    _t2.restart("starting the sweep");
+    global_heap.startSweep(!full);
+    sweepInProgress = true;
+    info.sweep_us = _t2.end();
+
+    if (full)
+        bytesPromotedSinceFullCollection = 0;
+    else
+        bytesInLastNursery = bytesAllocatedSinceCollection;
+    bytesInHeap += bytesAllocatedSinceCollection;
+    bytesAllocatedSinceCollection = 0;
+    scheduleNextCollection();
+
+    info.pause_us = _t.end();
+    recordCollection(info);
+}
+
+void runCollection() {
+    std::lock_guard<std::recursive_mutex> _l(global_heap.lock);
+    collect(true);
+    runPendingFinalizers();
+}
 
-    markPhase();
-    sweepPhase();
+void runMinorCollection() {
+    std::lock_guard<std::recursive_mutex> _l(global_heap.lock);
+    collect(false);
+    runPendingFinalizers();
 }
 
 } // namespace gc
@@ -19,28 +19,136 @@
 
 #include "core/types.h"
 
+#include "gc/heap.h"
+
 namespace pyston {
 namespace gc {
 
-#define MARK_BIT 0x1
+// Boxes don't have a GCObjectHeader; their first word is their class, which says what flavor they are.
+// Everything else starts with a header, and since kind ids are always odd while class pointers are
+// aligned, the low bit of the first word tells the two apart.
+inline bool isBox(void* obj) {
+    return (*(uintptr_t*)obj & 1) == 0;
+}
 
 inline GCObjectHeader* headerFromObject(void* obj) {
+    assert(!isBox(obj));
     return static_cast<GCObjectHeader*>(obj);
 }
 
-inline void setMark(GCObjectHeader *header) {
-    header->gc_flags |= MARK_BIT;
+// The per-object bits live in the heap's side tables (see BlockGCState), not in the objects.
+inline void setObjectBit(void* obj, ObjectBit bit) {
+    uint64_t mask;
+    uint64_t* word = bitWordForObject(obj, bit, &mask);
+    assert(word);
+    *word |= mask;
 }
 
-inline void clearMark(GCObjectHeader *header) {
-    header->gc_flags &= ~MARK_BIT;
+inline void clearObjectBit(void* obj, ObjectBit bit) {
+    uint64_t mask;
+    uint64_t* word = bitWordForObject(obj, bit, &mask);
+    assert(word);
+    *word &= ~mask;
 }
 
-inline bool isMarked(GCObjectHeader *header) {
-    return (header->gc_flags & MARK_BIT) != 0;
+// Things outside of the heap never have any of the bits set; in particular they're never marked,
+// ie they're treated as being young.
+inline bool testObjectBit(void* obj, ObjectBit bit) {
+    uint64_t mask;
+    uint64_t* word = bitWordForObject(obj, bit, &mask);
+    if (!word)
+        return false;
+    return (*word & mask) != 0;
 }
 
-#undef MARK_BIT
+inline void setMark(void* obj) {
+    setObjectBit(obj, MARK_BIT);
+}
+
+inline void clearMark(void* obj) {
+    clearObjectBit(obj, MARK_BIT);
+}
+
+inline bool isMarked(void* obj) {
+    return testObjectBit(obj, MARK_BIT);
+}
+
+// Atomically sets the mark bit; returns whether this call was the one that set it.
+inline bool tryMark(void* obj) {
+    uint64_t mask;
+    uint64_t* word = bitWordForObject(obj, MARK_BIT, &mask);
+    assert(word);
+    uint64_t prev = __atomic_fetch_or(word, mask, __ATOMIC_RELAXED);
+    return (prev & mask) == 0;
+}
+
+inline void setRemembered(void* obj) {
+    setObjectBit(obj, REMEMBERED_BIT);
+}
+
+inline void clearRemembered(void* obj) {
+    clearObjectBit(obj, REMEMBERED_BIT);
+}
+
+inline bool isRemembered(void* obj) {
+    return testObjectBit(obj, REMEMBERED_BIT);
+}
+
+// Objects that aren't in the heap (ex tuples that got created in place on the stack) don't get
+// finalized, so this ignores them.
+inline void setFinalizable(void* obj) {
+    uint64_t mask;
+    uint64_t* word = bitWordForObject(obj, FINALIZABLE_BIT, &mask);
+    if (word)
+        *word |= mask;
+}
+
+inline bool isFinalizable(void* obj) {
+    return testObjectBit(obj, FINALIZABLE_BIT);
+}
+
+inline void setFinalizationPending(void* obj) {
+    setObjectBit(obj, FINALIZATION_PENDING_BIT);
+}
+
+inline bool isFinalizationPending(void* obj) {
+    return testObjectBit(obj, FINALIZATION_PENDING_BIT);
+}
+
+inline void clearGCFlags(void* obj) {
+    for (int bit = 0; bit < NUM_OBJECT_BITS; bit++)
+        clearObjectBit(obj, (ObjectBit)bit);
+}
+
+// Objects whose kind has a finalizer don't get freed by the sweep; instead they get put on a queue,
+// and their finalizers get run (and their memory freed) once the collection is over instead of in
+// the middle of it.  Since the rest of the dead objects can get freed in the meantime, finalizers
+// can only release non-gc resources, such as malloc'd memory or FILE*'s.
+//
+// Called by the sweep for each unreachable object; returns whether the object is (now) waiting
+// to be finalized, in which case it mustn't be freed.
+bool queueForFinalization(void* obj);
+// Runs the finalizers that have been queued up so far.
+void runPendingFinalizers();
+
+// Marked objects (ie objects that survived the last collection) make up the old generation;
+// minor collections don't trace through them, so any time a pointer to a young object gets
+// stored into an old one, the old object has to get added to the remembered set.
+void _rememberObject(void* obj);
+
+// Adds obj to the remembered set if it's old, for cases where we can't easily tell what got stored.
+inline void rememberObject(void* obj) {
+    if (isMarked(obj) && !isRemembered(obj))
+        _rememberObject(obj);
+}
+
+inline void writeBarrier(void* parent, void* child) {
+    if (!isMarked(parent) || isRemembered(parent))
+        return;
+    if (!child || isMarked(child))
+        return;
+    _rememberObject(parent);
+}
 
 class TraceStack {
     private:
@@ -63,6 +171,17 @@ class TraceStack {
             }
             return NULL;
         }
+
+        void pushAll(const std::vector<void*> &ptrs) {
+            v.insert(v.end(), ptrs.begin(), ptrs.end());
+        }
+
+        // Moves the top n entries into *into
+        void popInto(std::vector<void*> *into, int n) {
+            assert(n <= v.size());
+            into->insert(into->end(), v.end() - n, v.end());
+            v.resize(v.size() - n);
+        }
 };
 
 class TraceStackGCVisitor : public GCVisitor {
@@ -85,7 +204,26 @@ class TraceStackGCVisitor : public GCVisitor {
 // ie this only works for constant roots, and not out-of-gc-knowledge storage locations
 // (that should be registerStaticRootPtr)
 void registerStaticRootObj(void* root_obj);
+// For the holders of weak references: these get called once marking is done, before anything gets
+// swept, and should forget about anything that isn't marked by then.  (In a minor collection the old
+// objects all count as marked.)
+typedef void (*WeakRefCallback)();
+void registerWeakRefCallback(WeakRefCallback callback);
+
+// For walking the heap the same way a full collection would, without touching the mark bits (see
+// runtime/heap_dump.h): pushes everything the collector starts marking from, ie the static roots
+// and whatever the thread stacks point to.
+void collectRoots(TraceStack* stack);
+// Has the visitor visit each of the objects that p points to, using p's class's or kind's gc handler.
+void visitReferences(void* p, GCVisitor* visitor);
+
+// Collects the whole heap:
 void runCollection();
+// Only collects the objects allocated since the last collection; will do a full collection
+// instead if enough objects have been promoted to the old generation since the last one.
+void runMinorCollection();
+// Gives as much memory back to the OS as we can without doing a collection, and returns how many bytes that was.
+long trimHeap();
 
 }
 }
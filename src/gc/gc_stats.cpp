@@ -0,0 +1,186 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "core/common.h"
+#include "core/options.h"
+#include "core/stats.h"
+
+#include "gc/gc_stats.h"
+#include "gc/heap.h"
+
+namespace pyston {
+namespace gc {
+
+// Only the details of this many collections get kept; the totals and the histogram cover all of them.
+#define MAX_RECORDED_COLLECTIONS 100000
+
+// Pause times get bucketed by powers of two: the first bucket is everything under 64us,
+// and the last one is everything that didn't fit in the others.
+#define PAUSE_HIST_BUCKETS 16
+static long pauseHistLimit(int bucket) {
+    return 64L << bucket;
+}
+
+static int pauseHistBucket(long us) {
+    int b = 0;
+    while (b < PAUSE_HIST_BUCKETS - 1 && us >= pauseHistLimit(b))
+        b++;
+    return b;
+}
+
+static std::vector<CollectionInfo> recorded;
+// Whether the last element of recorded is the most recent collection, ie is waiting for its sweep to finish:
+static bool last_recorded = false;
+
+static long num_collections = 0, num_full_collections = 0;
+static long total_pause_us = 0, max_pause_us = 0;
+static long pause_hist[PAUSE_HIST_BUCKETS];
+
+void recordCollection(const CollectionInfo &info) {
+    static StatCounter sc_pause("gc_pause_us");
+    static StatCounter sc_mark("gc_mark_us");
+    static StatCounter sc_sweep("gc_sweep_us");
+    static std::vector<StatCounter> sc_hist;
+    if (sc_hist.empty()) {
+        for (int i = 0; i < PAUSE_HIST_BUCKETS; i++) {
+            char buf[80];
+            if (i == PAUSE_HIST_BUCKETS - 1)
+                snprintf(buf, sizeof(buf), "gc_pause_hist_ge_%07ldus", pauseHistLimit(i - 1));
+            else
+                snprintf(buf, sizeof(buf), "gc_pause_hist_lt_%07ldus", pauseHistLimit(i));
+            sc_hist.push_back(StatCounter(buf));
+        }
+    }
+
+    num_collections++;
+    if (info.full)
+        num_full_collections++;
+    total_pause_us += info.pause_us;
+    max_pause_us = std::max(max_pause_us, info.pause_us);
+
+    int bucket = pauseHistBucket(info.pause_us);
+    pause_hist[bucket]++;
+
+    sc_pause.log(info.pause_us);
+    sc_mark.log(info.mark_us);
+    sc_sweep.log(info.finish_sweep_us + info.sweep_us);
+    sc_hist[bucket].log();
+
+    last_recorded = recorded.size() < MAX_RECORDED_COLLECTIONS;
+    if (last_recorded) {
+        recorded.push_back(info);
+        recorded.back().heap_bytes_after = -1;
+    }
+
+    if (VERBOSITY("gc") >= 1) {
+        printf("%s collection: %.1fms pause (%.1fms marking), heap was %ld bytes\n", info.full ? "Full" : "Minor",
+                info.pause_us / 1000.0, info.mark_us / 1000.0, info.heap_bytes_before);
+    }
+}
+
+void recordSweepFinished(long heap_bytes_after, const SweepStats &freed) {
+    static std::vector<StatCounter> sc_freed;
+    static StatCounter sc_freed_large("gc_freed_large_objs");
+    if (sc_freed.empty()) {
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            char buf[80];
+            snprintf(buf, sizeof(buf), "gc_freed_objs_%04ld", (long)sizes[i]);
+            sc_freed.push_back(StatCounter(buf));
+        }
+    }
+
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        sc_freed[i].log(freed.objs_freed[i]);
+    }
+    sc_freed_large.log(freed.large_objs_freed);
+
+    if (last_recorded) {
+        CollectionInfo &info = recorded.back();
+        info.heap_bytes_after = heap_bytes_after;
+        info.freed = freed;
+        last_recorded = false;
+    }
+}
+
+void dumpGCStats(FILE* f) {
+    fprintf(f, "{\n");
+    fprintf(f, "  \"collections\": %ld,\n", num_collections);
+    fprintf(f, "  \"full_collections\": %ld,\n", num_full_collections);
+    fprintf(f, "  \"total_pause_us\": %ld,\n", total_pause_us);
+    fprintf(f, "  \"max_pause_us\": %ld,\n", max_pause_us);
+
+    // the upper limit of each bucket; the last one doesn't have one
+    fprintf(f, "  \"pause_histogram\": [");
+    for (int i = 0; i < PAUSE_HIST_BUCKETS; i++) {
+        if (i)
+            fprintf(f, ", ");
+        if (i == PAUSE_HIST_BUCKETS - 1)
+            fprintf(f, "{\"lt_us\": null, \"count\": %ld}", pause_hist[i]);
+        else
+            fprintf(f, "{\"lt_us\": %ld, \"count\": %ld}", pauseHistLimit(i), pause_hist[i]);
+    }
+    fprintf(f, "],\n");
+
+    fprintf(f, "  \"size_classes\": [");
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        fprintf(f, i ? ", %ld" : "%ld", (long)sizes[i]);
+    }
+    fprintf(f, "],\n");
+
+    fprintf(f, "  \"history\": [");
+    for (int i = 0; i < recorded.size(); i++) {
+        const CollectionInfo &info = recorded[i];
+        fprintf(f, i ? ",\n    " : "\n    ");
+        fprintf(f, "{\"full\": %s, \"pause_us\": %ld, \"finish_sweep_us\": %ld, \"mark_us\": %ld, \"incremental_mark_us\": %ld, \"sweep_us\": %ld, ",
+                info.full ? "true" : "false", info.pause_us, info.finish_sweep_us, info.mark_us, info.incremental_mark_us, info.sweep_us);
+        fprintf(f, "\"heap_bytes_before\": %ld, \"heap_bytes_after\": %ld, \"large_objs_before\": %ld, \"large_objs_freed\": %ld, ",
+                info.heap_bytes_before, info.heap_bytes_after, info.large_objs_before, info.freed.large_objs_freed);
+        fprintf(f, "\"objs_freed\": [");
+        for (int j = 0; j < NUM_BUCKETS; j++) {
+            fprintf(f, j ? ", %ld" : "%ld", info.freed.objs_freed[j]);
+        }
+        fprintf(f, "]}");
+    }
+    fprintf(f, "\n  ]\n");
+    fprintf(f, "}\n");
+}
+
+static const char* stats_filename = NULL;
+static void writeGCStats() {
+    FILE* f = fopen(stats_filename, "w");
+    if (!f) {
+        fprintf(stderr, "Warning: couldn't open %s to write the gc stats: %s\n", stats_filename, strerror(errno));
+        return;
+    }
+    dumpGCStats(f);
+    fclose(f);
+}
+
+void writeGCStatsAtExit(const char* filename) {
+    bool registered = (stats_filename != NULL);
+    stats_filename = filename;
+    if (!registered)
+        atexit(writeGCStats);
+}
+
+}
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_GC_GCSTATS_H
+#define PYSTON_GC_GCSTATS_H
+
+#include <cstdio>
+
+#include "gc/heap.h"
+
+namespace pyston {
+namespace gc {
+
+// What happened during a single collection.  Times are in microseconds.
+struct CollectionInfo {
+    bool full;
+    // total time spent in the collector, ie how long the program was stopped for:
+    long pause_us;
+    // finishing the previous collection's lazy sweep, marking, and starting this one's sweep:
+    long finish_sweep_us, mark_us, sweep_us;
+    // for incremental collections, the time spent marking before the final pause:
+    long incremental_mark_us;
+
+    // heap size at the start of the collection, including everything allocated since the last one:
+    long heap_bytes_before;
+    // heap size once this collection's sweep has finished, or -1 if it hasn't yet:
+    long heap_bytes_after;
+
+    long large_objs_before;
+    SweepStats freed;
+};
+
+// Called at the end of every collection.
+void recordCollection(const CollectionInfo &info);
+// Called once the sweep started by the most recent collection has been finished.
+void recordSweepFinished(long heap_bytes_after, const SweepStats &freed);
+
+// Writes everything that's been recorded, in json.
+void dumpGCStats(FILE* f);
+// Arranges for dumpGCStats to write to this file when the program exits.
+void writeGCStatsAtExit(const char* filename);
+
+}
+}
+
+#endif
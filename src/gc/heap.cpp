@@ -15,28 +15,33 @@
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <set>
 #include <stdint.h>
 #include <sys/mman.h>
+#include <sys/time.h>
 
 #include "valgrind.h"
 
 #include "gc/gc_alloc.h"
+#include "gc/numa.h"
 
 #include "core/common.h"
+#include "core/options.h"
+#include "core/stats.h"
 
 namespace pyston {
 namespace gc {
 
 //extern unsigned numAllocs;
 //#define ALLOCS_PER_COLLECTION 1000
-extern unsigned bytesAllocatedSinceCollection;
-#define ALLOCBYTES_PER_COLLECTION 2000000
 
 void _collectIfNeeded(size_t bytes) {
-    if (bytesAllocatedSinceCollection >= ALLOCBYTES_PER_COLLECTION) {
-        bytesAllocatedSinceCollection = 0;
-        runCollection();
+    if (bytesAllocatedSinceCollection >= allocBytesBeforeCollection) {
+        // resets bytesAllocatedSinceCollection:
+        runMinorCollection();
     }
     bytesAllocatedSinceCollection += bytes;
 }
@@ -44,23 +49,74 @@ void _collectIfNeeded(size_t bytes) {
 
 Heap global_heap;
 
-#define PAGE_SIZE 4096
+static void reserveSideTables() {
+    static bool reserved = false;
+    if (reserved)
+        return;
+    reserved = true;
+
+    void* r = mmap((void*)BLOCK_GC_STATES_START, BLOCK_GC_STATES_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    RELEASE_ASSERT(r == (void*)BLOCK_GC_STATES_START, "couldn't reserve the block state table: %p", r);
+    r = mmap((void*)LARGE_OBJ_BITS_START, LARGE_OBJ_BITS_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    RELEASE_ASSERT(r == (void*)LARGE_OBJ_BITS_START, "couldn't reserve the large object bit table: %p", r);
+}
+
 class Arena {
     private:
         void* start;
         void* cur;
+        void* end;
+        int node;
+
+        // Only used with GC_USE_HUGE_PAGES: the end of the memory that's been mapped so far.
+        void* committed;
+
+        void commitHugePages(void* end) {
+            size_t size = ((uintptr_t)end - (uintptr_t)committed + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+            RELEASE_ASSERT((uint8_t*)committed + size <= (uint8_t*)this->end, "gc arena is full");
+
+            void* mrtn = mmap(committed, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            assert((uintptr_t)mrtn != -1 && "failed to allocate memory from OS");
+            ASSERT(mrtn == committed, "%p %p\n", mrtn, committed);
+            bindToNumaNode(mrtn, size, node);
+            // Only a hint; if transparent huge pages are disabled we still get regular pages.
+            madvise(mrtn, size, MADV_HUGEPAGE);
+            committed = (uint8_t*)committed + size;
+        }
 
     public:
-        constexpr Arena(void* start) : start(start), cur(start) {
+        // Arenas don't have any space until they get init()'d.  (This is constexpr so that the arenas are
+        // usable before the static constructors have run.)
+        constexpr Arena() : start(NULL), cur(NULL), end(NULL), node(0), committed(NULL) {
+        }
+
+        void init(void* start, size_t size, int node) {
+            this->start = this->cur = this->committed = start;
+            this->end = (uint8_t*)start + size;
+            this->node = node;
+        }
+
+        bool hasRoomFor(size_t size) {
+            return (uint8_t*)cur + size <= (uint8_t*)end;
         }
 
         void* doMmap(size_t size) {
             assert(size % PAGE_SIZE == 0);
             //printf("mmap %ld\n", size);
-
-            void* mrtn = mmap(cur, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-            assert((uintptr_t)mrtn != -1 && "failed to allocate memory from OS");
-            ASSERT(mrtn == cur, "%p %p\n", mrtn, cur);
+            RELEASE_ASSERT(hasRoomFor(size), "gc arena is full");
+            reserveSideTables();
+
+            void* mrtn = cur;
+            if (GC_USE_HUGE_PAGES) {
+                // Memory gets committed a whole huge page at a time, and handed out from there:
+                if ((uint8_t*)cur + size > (uint8_t*)committed)
+                    commitHugePages((uint8_t*)cur + size);
+            } else {
+                mrtn = mmap(cur, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                assert((uintptr_t)mrtn != -1 && "failed to allocate memory from OS");
+                ASSERT(mrtn == cur, "%p %p\n", mrtn, cur);
+                bindToNumaNode(mrtn, size, node);
+            }
             cur = (uint8_t*)cur + size;
             return mrtn;
         }
@@ -70,8 +126,69 @@ class Arena {
         }
 };
 
-Arena small_arena((void*)0x1270000000L);
-Arena large_arena((void*)0x2270000000L);
+// Each NUMA node gets its own equal slice of both arenas (all of it, if there's only one node), and memory
+// that comes from a node's slice gets bound to that node.  The slices are a power of two in size, so the
+// node that an address belongs to is just a shift away.
+static Arena small_arenas[MAX_NUMA_NODES];
+static Arena large_arenas[MAX_NUMA_NODES];
+static int num_arena_nodes = 0;
+static int node_arena_shift = 0;
+static_assert((ARENA_SIZE & (ARENA_SIZE - 1)) == 0, "");
+static_assert((MAX_NUMA_NODES & (MAX_NUMA_NODES - 1)) == 0, "");
+static_assert(ARENA_SIZE / MAX_NUMA_NODES % HUGE_PAGE_SIZE == 0, "");
+
+// Has to be called (with the heap lock held) before anything gets taken from the arenas.
+static void initArenas() {
+    if (num_arena_nodes)
+        return;
+
+    num_arena_nodes = numNumaNodes();
+    int slices = 1;
+    while (slices < num_arena_nodes)
+        slices *= 2;
+    node_arena_shift = __builtin_ctzl(ARENA_SIZE / slices);
+
+    for (int i = 0; i < num_arena_nodes; i++) {
+        small_arenas[i].init((void*)(SMALL_ARENA_START + ((uintptr_t)i << node_arena_shift)), 1UL << node_arena_shift, i);
+        large_arenas[i].init((void*)(LARGE_ARENA_START + ((uintptr_t)i << node_arena_shift)), 1UL << node_arena_shift, i);
+    }
+}
+
+// Which node's slice of the arena starting at arena_start ptr is in, or -1 if it's not in that arena.
+static inline int arenaNodeFor(uintptr_t arena_start, void* ptr) {
+    uintptr_t offset = (uintptr_t)ptr - arena_start;
+    if (offset >= ARENA_SIZE)
+        return -1;
+    int node = offset >> node_arena_shift;
+    if (node >= num_arena_nodes)
+        return -1;
+    return node;
+}
+
+static inline bool inSmallArena(void* ptr) {
+    int node = arenaNodeFor(SMALL_ARENA_START, ptr);
+    return node >= 0 && small_arenas[node].contains(ptr);
+}
+
+static inline bool inLargeArena(void* ptr) {
+    int node = arenaNodeFor(LARGE_ARENA_START, ptr);
+    return node >= 0 && large_arenas[node].contains(ptr);
+}
+
+// Takes memory from the given node's slice of the arena, or from another node's if that one is full.
+static void* mmapFromArenas(Arena* arenas, int node, size_t size) {
+    initArenas();
+    if (arenas[node].hasRoomFor(size))
+        return arenas[node].doMmap(size);
+
+    static StatCounter numa_remote_mmaps("gc_numa_remote_mmaps");
+    numa_remote_mmaps.log();
+    for (int i = 0; i < num_arena_nodes; i++) {
+        if (arenas[i].hasRoomFor(size))
+            return arenas[i].doMmap(size);
+    }
+    RELEASE_ASSERT(0, "gc arena is full");
+}
 
 struct LargeObj {
     LargeObj *next, **prev;
@@ -95,12 +212,17 @@ struct LargeObj {
     }
 };
 
+// All live large objects, ordered by address, so that interior pointers can be looked up without
+// walking the whole large_head list.
+static std::set<LargeObj*> large_objs;
+
 void* Heap::allocLarge(size_t size) {
+    std::lock_guard<std::recursive_mutex> _l(lock);
     _collectIfNeeded(size);
 
     size_t total_size = size + sizeof(LargeObj);
     total_size = (total_size + PAGE_SIZE - 1) & ~(PAGE_SIZE-1);
-    LargeObj* rtn = (LargeObj*)large_arena.doMmap(total_size);
+    LargeObj* rtn = (LargeObj*)mmapFromArenas(large_arenas, currentNumaNode(), total_size);
     rtn->obj_size = size;
 
     rtn->next = large_head;
@@ -109,17 +231,49 @@ void* Heap::allocLarge(size_t size) {
     rtn->prev = &large_head;
     large_head = rtn;
 
+    large_objs.insert(rtn);
+
     return &rtn->data;
 }
 
-static Block* alloc_block(uint64_t size, Block** prev) {
-    // TODO use mmap
+static long currentTimeMs() {
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000L + tv.tv_usec / 1000;
+}
+
+Block* Heap::takeEmptyBlock(int node) {
+    Block* rtn = NULL;
+    if (empty_blocks[node].size()) {
+        rtn = empty_blocks[node].back().block;
+        empty_blocks[node].pop_back();
+    } else if (released_blocks[node].size()) {
+        // Touching it will get us fresh zeroed pages from the OS:
+        rtn = released_blocks[node].back();
+        released_blocks[node].pop_back();
+    }
+    return rtn;
+}
 
-    Block* rtn = (Block*)small_arena.doMmap(sizeof(Block));
+Block* Heap::allocBlock(uint64_t size, Block** prev) {
+    initArenas();
+
+    // Prefer memory from the node that this thread is running on: first its empty blocks, then new memory
+    // from its slice of the arena, and only then the other nodes' empty blocks.
+    int node = currentNumaNode();
+    Block* rtn = takeEmptyBlock(node);
+    if (!rtn && small_arenas[node].hasRoomFor(sizeof(Block)))
+        rtn = (Block*)small_arenas[node].doMmap(sizeof(Block));
+    for (int i = 0; !rtn && i < num_arena_nodes; i++)
+        rtn = takeEmptyBlock(i);
+    if (!rtn)
+        rtn = (Block*)mmapFromArenas(small_arenas, node, sizeof(Block));
     assert(rtn);
     rtn->size = size;
     rtn->prev = prev;
     rtn->next = NULL;
+    rtn->owner = NULL;
+    rtn->in_nursery = 0;
 
 #ifdef VALGRIND
     VALGRIND_CREATE_MEMPOOL(rtn, 0, true);
@@ -127,6 +281,7 @@ static Block* alloc_block(uint64_t size, Block** prev) {
 
     // Don't think I need to do this:
     memset(rtn->isfree, 0, sizeof(Block::isfree));
+    memset(rtn->gcState(), 0, sizeof(BlockGCState));
 
     int num_objects = rtn->numObjects();
     int num_lost = rtn->minObjIndex();
@@ -145,83 +300,284 @@ static Block* alloc_block(uint64_t size, Block** prev) {
     return rtn;
 }
 
-void* Heap::allocSmall(size_t rounded_size, Block** prev, Block** full_head) {
-    _collectIfNeeded(rounded_size);
+static long sweepBlock(Block* b);
+
+static inline void unlinkBlock(Block* b) {
+    *b->prev = b->next;
+    if (b->next)
+        b->next->prev = b->prev;
+}
+
+static inline void pushBlock(Block* b, Block** head) {
+    b->prev = head;
+    b->next = *head;
+    if (b->next)
+        b->next->prev = &b->next;
+    *head = b;
+}
+
+bool Heap::retireIfEmpty(Block* b) {
+    int nfree = 0;
+    for (int i = 0; i < BITFIELD_ELTS; i++) {
+        nfree += __builtin_popcountll(b->isfree[i]);
+    }
+    if (nfree != b->numObjects() - b->minObjIndex())
+        return false;
+
+    assert(!b->in_nursery);
+    assert(!b->gcState()->needs_sweep);
+    unlinkBlock(b);
+    b->next = NULL;
+    b->prev = NULL;
+
+#ifdef VALGRIND
+    VALGRIND_DESTROY_MEMPOOL(b);
+#endif
+
+    empty_blocks[arenaNodeFor(SMALL_ARENA_START, b)].push_back(EmptyBlock({b, currentTimeMs()}));
+    return true;
+}
+
+long Heap::releaseEmptyBlocks(long min_age_ms) {
+    long now = currentTimeMs();
+
+    long bytes_released = 0;
+    for (int node = 0; node < num_arena_nodes; node++) {
+        bytes_released += releaseEmptyBlocks(node, now - min_age_ms);
+    }
+    if (VERBOSITY("gc") >= 2) if (bytes_released) printf("Released %ld bytes to the OS\n", bytes_released);
+    return bytes_released;
+}
+
+long Heap::releaseEmptyBlocks(int node, long empty_before_ms) {
+    std::vector<Block*> to_release;
+    std::vector<EmptyBlock> still_empty;
+    for (const EmptyBlock &e : empty_blocks[node]) {
+        if (e.empty_since_ms <= empty_before_ms)
+            to_release.push_back(e.block);
+        else
+            still_empty.push_back(e);
+    }
+    empty_blocks[node].swap(still_empty);
+
+    // Blocks tend to be contiguous, so madvise them in runs:
+    std::sort(to_release.begin(), to_release.end());
+    for (int i = 0; i < to_release.size(); ) {
+        int j = i + 1;
+        while (j < to_release.size() && to_release[j] == to_release[j - 1] + 1)
+            j++;
+
+        int r = madvise(to_release[i], (j - i) * sizeof(Block), MADV_DONTNEED);
+        ASSERT(r == 0, "%d", errno);
+        i = j;
+    }
+    // (the memory stays bound to the node, so it'll come back from the same one)
+    released_blocks[node].insert(released_blocks[node].end(), to_release.begin(), to_release.end());
+
+    return to_release.size() * sizeof(Block);
+}
+
+bool Heap::lazySweep(int bucket_idx) {
+    std::vector<Block*> &pending = unswept[bucket_idx];
+    while (pending.size()) {
+        Block* b = pending.back();
+        pending.pop_back();
+
+        if (!b->gcState()->needs_sweep)
+            continue;
+
+        long freed = sweep(b, bucket_idx);
+
+        // The allocator will reuse it from the empty list if nothing else turns up:
+        if (freed && retireIfEmpty(b))
+            return false;
+
+        if (freed) {
+            // It might be on either the full list or the non-full list, so just
+            // move it to the front of the non-full one:
+            unlinkBlock(b);
+            pushBlock(b, &heads[bucket_idx]);
+            return true;
+        }
+    }
+    return false;
+}
+
+// This thread's cache; it gets created the first time the thread allocates.  (This lives here rather
+// than in the header since gc_alloc is part of the stdlib bitcode, and the JIT can't handle thread-local
+// accesses.)
+static __thread ThreadCache* thread_cache = NULL;
+
+static inline void* allocFromBlock(Block* b) {
+    for (int i = 0; i < BITFIELD_ELTS; i++) {
+        uint64_t mask = b->isfree[i];
+        if (mask) {
+            int first = __builtin_ctzll(mask);
+            b->isfree[i] = mask & (mask - 1);
+            return &b->atoms[first + i * 64];
+        }
+    }
+    return NULL;
+}
+
+void* Heap::tryAllocFromCache(int bucket_idx) {
+#ifdef VALGRIND
+    return NULL;
+#endif
+    ThreadCache *cache = thread_cache;
+    if (!cache)
+        return NULL;
+
+    Block *cur = cache->blocks[bucket_idx];
+    if (!cur)
+        return NULL;
+
+    void* rtn = allocFromBlock(cur);
+    if (rtn)
+        cache->bytes_allocated += sizes[bucket_idx];
+    return rtn;
+}
+
+Block* Heap::takeBlock(int bucket_idx) {
+    size_t rounded_size = sizes[bucket_idx];
+    Block **prev = &heads[bucket_idx];
+    Block **full_head = &full_heads[bucket_idx];
 
     Block *cur = *prev;
     assert(!cur || prev == cur->prev);
-    int scanned = 0;
-
-    //printf("alloc(%ld)\n", rounded_size);
 
-    //Block **full_prev = full_head;
     while (true) {
         //printf("cur = %p, prev = %p\n", cur, prev);
         if (cur == NULL) {
-            Block *next = alloc_block(rounded_size, &cur->next);
+            // Before taking fresh memory, try to get some from the blocks that haven't
+            // been swept since the last collection:
+            if (lazySweep(bucket_idx)) {
+                cur = *prev;
+                continue;
+            }
+
+            Block *next = allocBlock(rounded_size, prev);
             //printf("allocated new block %p\n", next);
             *prev = next;
-            next->prev = prev;
-            prev = &cur->next;
 
+            // Give the full blocks another look, since things might have been freed from them:
             next->next = *full_head;
+            if (next->next)
+                next->next->prev = &next->next;
             *full_head = NULL;
-            prev = full_head;
 
             cur = next;
         }
 
-        int i = 0;
-        uint64_t mask = 0;
-        for (; i < BITFIELD_ELTS; i++) {
-            mask = cur->isfree[i];
-            if (mask != 0L) {
+        // Never allocate into a block that still has garbage from the last collection,
+        // since the new object would look unmarked and get swept:
+        if (cur->gcState()->needs_sweep)
+            sweep(cur, bucket_idx);
+
+        bool has_free = false;
+        for (int i = 0; i < BITFIELD_ELTS; i++) {
+            if (cur->isfree[i]) {
+                has_free = true;
                 break;
             }
         }
 
-        if (i == BITFIELD_ELTS) {
-            scanned++;
+        if (!has_free) {
             //printf("moving on\n");
-
             Block *t = *prev = cur->next;
             cur->next = NULL;
             if (t) t->prev = prev;
 
-            cur->prev = full_head;
-            cur->next = *full_head;
-            *full_head = cur;
+            pushBlock(cur, full_head);
 
             cur = t;
-
-            scanned++;
             continue;
         }
 
-        //printf("scanned %d\n", scanned);
-        int first = __builtin_ctzll(mask);
-        assert(first < 64);
-        //printf("mask: %lx, first: %d\n", mask, first);
-        cur->isfree[i] ^= (1L << first);
+        unlinkBlock(cur);
+        cur->next = NULL;
+        cur->prev = NULL;
 
-        int idx = first + i * 64;
+        if (!cur->in_nursery) {
+            cur->in_nursery = 1;
+            nursery_blocks.push_back(cur);
+        }
+        return cur;
+    }
+}
 
-        //printf("Using index %d\n", idx);
+void* Heap::allocSmall(size_t rounded_size, int bucket_idx) {
+    std::lock_guard<std::recursive_mutex> _l(lock);
 
-        void* rtn = &cur->atoms[idx];
+    if (!thread_cache) {
+        thread_cache = new ThreadCache();
+        thread_caches.push_back(thread_cache);
+    }
+    ThreadCache *cache = thread_cache;
+
+    // With VALGRIND, every allocation comes through here, so the current block might still have room:
+    void* rtn = NULL;
+    if (cache->blocks[bucket_idx])
+        rtn = allocFromBlock(cache->blocks[bucket_idx]);
+
+    if (rtn) {
+        cache->bytes_allocated += rounded_size;
+    } else {
+        bytesAllocatedSinceCollection += cache->bytes_allocated;
+        cache->bytes_allocated = 0;
+        // If this collects, all of the caches' blocks get handed back:
+        _collectIfNeeded(rounded_size);
+
+        Block *full = cache->blocks[bucket_idx];
+        if (full) {
+            full->owner = NULL;
+            pushBlock(full, &full_heads[bucket_idx]);
+        }
+
+        Block *next = takeBlock(bucket_idx);
+        next->owner = cache;
+        cache->blocks[bucket_idx] = next;
+
+        rtn = allocFromBlock(next);
+        assert(rtn);
+    }
 
 #ifndef NDEBUG
-        Block *b = Block::forPointer(rtn);
-        assert(b == cur);
-        int offset = (char*)rtn - (char*)b;
-        assert(offset % rounded_size == 0);
+    Block *b = Block::forPointer(rtn);
+    assert(b == cache->blocks[bucket_idx]);
+    int offset = (char*)rtn - (char*)b;
+    assert(offset % rounded_size == 0);
 #endif
 
 #ifdef VALGRIND
-        VALGRIND_MEMPOOL_ALLOC(cur, rtn, rounded_size);
+    VALGRIND_MEMPOOL_ALLOC(cache->blocks[bucket_idx], rtn, rounded_size);
 #endif
 
-        return rtn;
+    return rtn;
+}
+
+void Heap::flushThreadCaches() {
+    std::lock_guard<std::recursive_mutex> _l(lock);
+
+    for (ThreadCache* cache : thread_caches) {
+        bytesAllocatedSinceCollection += cache->bytes_allocated;
+        cache->bytes_allocated = 0;
+
+        for (int bidx = 0; bidx < NUM_BUCKETS; bidx++) {
+            Block *b = cache->blocks[bidx];
+            if (!b)
+                continue;
+            b->owner = NULL;
+            // allocSmall will move it to the full list if it needs to:
+            pushBlock(b, &heads[bidx]);
+            cache->blocks[bidx] = NULL;
+        }
+    }
+
+    std::vector<void*> frees;
+    frees.swap(remote_frees);
+    for (void* p : frees) {
+        free(p);
     }
 }
 
@@ -238,6 +594,10 @@ void _freeFrom(void* ptr, Block* b) {
     uint64_t mask = 1L << bitmap_bit;
     assert((b->isfree[bitmap_idx] & mask) == 0);
     b->isfree[bitmap_idx] ^= mask;
+    // The next object to get allocated here has to start out unmarked (and without any of the other bits):
+    BlockGCState* state = b->gcState();
+    for (int bit = 0; bit < NUM_OBJECT_BITS; bit++)
+        state->bits[bit][bitmap_idx] &= ~mask;
 
 #ifdef VALGRIND
     VALGRIND_MEMPOOL_FREE(b, ptr);
@@ -249,24 +609,50 @@ static void _freeLargeObj(LargeObj *lobj) {
     if (lobj->next)
         lobj->next->prev = lobj->prev;
 
+    large_objs.erase(lobj);
+    clearGCFlags(lobj->data);
+
     int r = munmap(lobj, lobj->mmap_size());
     assert(r == 0);
 }
 
 void Heap::free(void* ptr) {
-    if (large_arena.contains(ptr)) {
+    std::lock_guard<std::recursive_mutex> _l(lock);
+
+    if (defer_frees) {
+        deferred_frees.push_back(ptr);
+        return;
+    }
+
+    if (inLargeArena(ptr)) {
         LargeObj *lobj = LargeObj::fromPointer(ptr);
         _freeLargeObj(lobj);
         return;
     }
 
-    assert(small_arena.contains(ptr));
+    assert(inSmallArena(ptr));
     Block *b = Block::forPointer(ptr);
+    // The owner allocates out of it without taking the lock:
+    if (b->owner && b->owner != thread_cache) {
+        remote_frees.push_back(ptr);
+        return;
+    }
     _freeFrom(ptr, b);
 }
 
+void Heap::setDeferFrees(bool defer) {
+    defer_frees = defer;
+    if (defer)
+        return;
+
+    for (void* p : deferred_frees) {
+        free(p);
+    }
+    deferred_frees.clear();
+}
+
 void* Heap::realloc(void* ptr, size_t bytes) {
-    if (large_arena.contains(ptr)) {
+    if (inLargeArena(ptr)) {
         LargeObj *lobj = LargeObj::fromPointer(ptr);
 
         int capacity = lobj->capacity();
@@ -275,12 +661,14 @@ void* Heap::realloc(void* ptr, size_t bytes) {
 
         void* rtn = alloc(bytes);
         memcpy(rtn, ptr, std::min(bytes, lobj->obj_size));
+        // the copy is a new object, so it starts out in the young generation:
+        clearGCFlags(rtn);
 
-        _freeLargeObj(lobj);
+        free(ptr);
         return rtn;
     }
 
-    assert(small_arena.contains(ptr));
+    assert(inSmallArena(ptr));
     Block *b = Block::forPointer(ptr);
 
     size_t size = b->size;
@@ -291,27 +679,43 @@ void* Heap::realloc(void* ptr, size_t bytes) {
     void* rtn = alloc(bytes);
 
     memcpy(rtn, ptr, std::min(bytes, size));
+    clearGCFlags(rtn);
 
-    _freeFrom(ptr, b);
+    free(ptr);
     return rtn;
 }
 
+int Heap::nodeFor(void* ptr) {
+    int node = arenaNodeFor(SMALL_ARENA_START, ptr);
+    if (node < 0)
+        node = arenaNodeFor(LARGE_ARENA_START, ptr);
+    if (node < 0)
+        return 0;
+    return node;
+}
+
 void* Heap::getAllocationFromInteriorPointer(void* ptr) {
-    if (large_arena.contains(ptr)) {
-        LargeObj *cur = large_head;
-        while (cur) {
-            if (ptr >= cur && ptr < &cur->data[cur->obj_size])
-                return &cur->data[0];
-            cur = cur->next;
-        }
+    if (inLargeArena(ptr)) {
+        // Find the last object that starts at or before ptr:
+        auto it = large_objs.upper_bound((LargeObj*)ptr);
+        if (it == large_objs.begin())
+            return NULL;
+        --it;
+
+        LargeObj *cur = *it;
+        if (ptr < &cur->data[cur->obj_size])
+            return &cur->data[0];
         return NULL;
     }
 
-    if (!small_arena.contains(ptr))
+    if (!inSmallArena(ptr))
         return NULL;
 
     Block *b = Block::forPointer(ptr);
     size_t size = b->size;
+    // this block's memory has been given back to the OS, so it reads as zeroes:
+    if (size == 0)
+        return NULL;
     int offset = (char*)ptr - (char*)b;
     int obj_idx = offset / size;
 
@@ -329,59 +733,78 @@ void* Heap::getAllocationFromInteriorPointer(void* ptr) {
     return &b->atoms[atom_idx];
 }
 
-static long freeChain(Block* head) {
+size_t Heap::getAllocationSize(void* ptr) {
+    if (inLargeArena(ptr))
+        return LargeObj::fromPointer(ptr)->obj_size;
+
+    assert(inSmallArena(ptr));
+    return Block::forPointer(ptr)->size;
+}
+
+static long sweepBlock(Block* b) {
+    BlockGCState* state = b->gcState();
+    assert(state->needs_sweep);
+
     long bytes_freed = 0;
-    while (head) {
-        int num_objects = head->numObjects();
-        int first_obj = head->minObjIndex();
-        int atoms_per_obj = head->atomsPerObj();
+    int num_objects = b->numObjects();
+    int first_obj = b->minObjIndex();
+    int atoms_per_obj = b->atomsPerObj();
 
-        for (int obj_idx = first_obj; obj_idx < num_objects; obj_idx++) {
-            int atom_idx = obj_idx * atoms_per_obj;
-            int bitmap_idx = atom_idx / 64;
-            int bitmap_bit = atom_idx % 64;
-            uint64_t mask = 1L << bitmap_bit;
+    for (int obj_idx = first_obj; obj_idx < num_objects; obj_idx++) {
+        int atom_idx = obj_idx * atoms_per_obj;
+        int bitmap_idx = atom_idx / 64;
+        int bitmap_bit = atom_idx % 64;
+        uint64_t mask = 1L << bitmap_bit;
 
-            if (head->isfree[bitmap_idx] & mask)
+        if (b->isfree[bitmap_idx] & mask)
+            continue;
+
+        if (!(state->bits[MARK_BIT][bitmap_idx] & mask)) {
+            void *p = &b->atoms[atom_idx];
+            // It'll get freed once its finalizer has been run:
+            if (queueForFinalization(p))
                 continue;
+            if (VERBOSITY() >= 2) printf("Freeing %p\n", p);
+            //assert(p != (void*)0x127000d960); // the main module
+            bytes_freed += b->size;
+            b->isfree[bitmap_idx] |= mask;
+        }
+    }
 
-            void *p = &head->atoms[atom_idx];
-            GCObjectHeader* header = headerFromObject(p);
+    state->needs_sweep = 0;
+    return bytes_freed;
+}
 
-            if (isMarked(header)) {
-                clearMark(header);
-            } else {
-                if (VERBOSITY() >= 2) printf("Freeing %p\n", p);
-                //assert(p != (void*)0x127000d960); // the main module
-                bytes_freed += head->size;
-                head->isfree[bitmap_idx] |= mask;
-            }
-        }
+static void clearChainMarks(Block* head) {
+    while (head) {
+        BlockGCState* state = head->gcState();
+        assert(!state->needs_sweep);
+        memset(state->bits[MARK_BIT], 0, sizeof(state->bits[MARK_BIT]));
 
         head = head->next;
     }
-    return bytes_freed;
 }
 
-void Heap::freeUnmarked() {
-    long bytes_freed = 0;
+void Heap::clearMarks() {
     for (int bidx = 0; bidx < NUM_BUCKETS; bidx++) {
-        bytes_freed += freeChain(heads[bidx]);
-        bytes_freed += freeChain(full_heads[bidx]);
+        clearChainMarks(heads[bidx]);
+        clearChainMarks(full_heads[bidx]);
+    }
+
+    for (LargeObj *cur = large_head; cur; cur = cur->next) {
+        clearMark(cur->data);
     }
+}
 
-    LargeObj *cur = large_head;
+static long freeUnmarkedLarge(LargeObj **head, long *objs_freed) {
+    long bytes_freed = 0;
+    LargeObj *cur = *head;
     while (cur) {
         void *p = cur->data;
-        GCObjectHeader* header = headerFromObject(p);
-        if (isMarked(header)) {
-            clearMark(header);
-        } else {
+        if (!isMarked(p) && !queueForFinalization(p)) {
             if (VERBOSITY() >= 2) printf("Freeing %p\n", p);
             bytes_freed += cur->mmap_size();
-
-            *cur->prev = cur->next;
-            if (cur->next) cur->next->prev = cur->prev;
+            (*objs_freed)++;
 
             LargeObj *to_free = cur;
             cur = cur->next;
@@ -391,8 +814,80 @@ void Heap::freeUnmarked() {
 
         cur = cur->next;
     }
+    return bytes_freed;
+}
+
+static int bucketForSize(size_t size) {
+    int bucket_idx = bucket_for_atoms[size / ATOM_SIZE];
+    assert(sizes[bucket_idx] == size);
+    return bucket_idx;
+}
 
-    if (VERBOSITY("gc") >= 2) if (bytes_freed) printf("Freed %ld bytes\n", bytes_freed);
+long Heap::sweep(Block* b, int bucket_idx) {
+    long freed = sweepBlock(b);
+    bytes_swept += freed;
+    sweep_stats.objs_freed[bucket_idx] += freed / b->size;
+    return freed;
+}
+
+int Heap::numLargeObjects() {
+    return large_objs.size();
+}
+
+void Heap::startSweep(bool young_only) {
+    assert(bytes_swept == 0);
+    memset(&sweep_stats, 0, sizeof(sweep_stats));
+
+    if (young_only) {
+        // Everything that was alive at the end of the previous collection still has its mark bit set,
+        // so any unmarked object has to have been allocated since then, ie lives in a nursery block.
+        for (Block* b : nursery_blocks) {
+            assert(!b->gcState()->needs_sweep);
+            b->in_nursery = 0;
+            b->gcState()->needs_sweep = 1;
+            unswept[bucketForSize(b->size)].push_back(b);
+        }
+    } else {
+        for (int bidx = 0; bidx < NUM_BUCKETS; bidx++) {
+            for (Block* head : {heads[bidx], full_heads[bidx]}) {
+                for (Block* b = head; b; b = b->next) {
+                    assert(!b->gcState()->needs_sweep);
+                    b->in_nursery = 0;
+                    b->gcState()->needs_sweep = 1;
+                    unswept[bidx].push_back(b);
+                }
+            }
+        }
+    }
+    nursery_blocks.clear();
+
+    // Large objects don't get reused, so there's no point in sweeping them lazily
+    // TODO this walks all of the large objects even for a minor collection
+    bytes_swept += freeUnmarkedLarge(&large_head, &sweep_stats.large_objs_freed);
+}
+
+long Heap::finishSweep() {
+    for (int bidx = 0; bidx < NUM_BUCKETS; bidx++) {
+        for (Block* b : unswept[bidx]) {
+            if (b->gcState()->needs_sweep) {
+                long freed = sweep(b, bidx);
+                if (freed)
+                    retireIfEmpty(b);
+            }
+        }
+        unswept[bidx].clear();
+    }
+
+    long rtn = bytes_swept;
+    bytes_swept = 0;
+
+    if (VERBOSITY("gc") >= 2) if (rtn) printf("Freed %ld bytes\n", rtn);
+    return rtn;
+}
+
+void Heap::freeUnmarked() {
+    startSweep(false);
+    finishSweep();
 }
 
 }
@@ -16,9 +16,13 @@
 #define PYSTON_GC_HEAP_H
 
 #include <cstdint>
+#include <mutex>
+#include <vector>
 
 #include "core/common.h"
 
+#include "gc/numa.h"
+
 namespace pyston {
 namespace gc {
 
@@ -30,18 +34,26 @@ static_assert(ATOMS_PER_BLOCK % 64 == 0, "");
 #define BITFIELD_SIZE (ATOMS_PER_BLOCK / 8)
 #define BITFIELD_ELTS (BITFIELD_SIZE / 8)
 
-#define BLOCK_HEADER_SIZE (BITFIELD_SIZE + 2 * sizeof(void*) + sizeof(uint64_t))
+#define BLOCK_HEADER_SIZE (BITFIELD_SIZE + 3 * sizeof(void*) + 2 * sizeof(uint64_t))
 #define BLOCK_HEADER_ATOMS ((BLOCK_HEADER_SIZE + ATOM_SIZE - 1) / ATOM_SIZE)
 
 struct Atoms {
     char _data[ATOM_SIZE];
 };
 
+struct BlockGCState;
+struct ThreadCache;
 struct Block {
     union {
         struct {
             Block *next, **prev;
+            // The thread cache that's allocating out of this block, if any; owned blocks aren't on
+            // any of the Heap's lists.
+            ThreadCache *owner;
             uint64_t size;
+            // whether this block has been allocated out of since the last collection,
+            // ie whether it's on the Heap's nursery_blocks list:
+            uint64_t in_nursery;
             uint64_t isfree[BITFIELD_ELTS];
         };
         Atoms atoms[ATOMS_PER_BLOCK];
@@ -62,9 +74,76 @@ struct Block {
     static Block* forPointer(void* ptr) {
         return (Block*)((uintptr_t)ptr & ~(BLOCK_SIZE-1));
     }
+
+    inline BlockGCState* gcState();
 };
 static_assert(sizeof(Block) == BLOCK_SIZE, "bad size");
 
+#define PAGE_SIZE 4096
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// The arenas live at fixed addresses, and each one can grow up to ARENA_SIZE bytes.
+// (The starts are huge-page aligned, see GC_USE_HUGE_PAGES.)
+#define SMALL_ARENA_START 0x1270000000L
+#define LARGE_ARENA_START 0x2270000000L
+#define ARENA_SIZE 0x1000000000L
+
+// The collector's per-object state (the mark bits, and the other flags below) is kept in side tables
+// instead of in the objects or the block headers.  Blocks are a single page, so writing to their headers
+// would dirty the page just the same; keeping the mark bits off to the side means that a collection only
+// writes to pages that have garbage on them, so processes forked from a warmed-up parent keep sharing most
+// of the heap.  It also means that Boxes don't need a header word for them (see GCObjectHeader).
+//
+// Like the arenas, the side tables are at fixed addresses, and get reserved (without being backed
+// by memory until they get touched) the first time either arena grows.
+enum ObjectBit {
+    MARK_BIT = 0,
+    // the object is on the remembered set:
+    REMEMBERED_BIT,
+    // the object's kind has a finalizer.  This gets set when the object is constructed, so that the sweep
+    // doesn't have to look at the (possibly already freed) classes of dead Boxes to find out.
+    FINALIZABLE_BIT,
+    // the object is dead, and waiting for its finalizer to run:
+    FINALIZATION_PENDING_BIT,
+    NUM_OBJECT_BITS,
+};
+struct BlockGCState {
+    uint64_t bits[NUM_OBJECT_BITS][BITFIELD_ELTS];
+    // whether this block still needs to be swept after the last collection:
+    uint64_t needs_sweep;
+};
+#define BLOCK_GC_STATES_START 0x3270000000L
+#define BLOCK_GC_STATES_SIZE (ARENA_SIZE / BLOCK_SIZE * sizeof(BlockGCState))
+// Each of the bits, for each page of the large arena; large objects start on a page boundary.
+#define LARGE_OBJ_BITS_START 0x3370000000L
+#define LARGE_OBJ_BITS_ELTS (ARENA_SIZE / PAGE_SIZE / 64)
+#define LARGE_OBJ_BITS_SIZE (NUM_OBJECT_BITS * LARGE_OBJ_BITS_ELTS * sizeof(uint64_t))
+static_assert(SMALL_ARENA_START % HUGE_PAGE_SIZE == 0 && LARGE_ARENA_START % HUGE_PAGE_SIZE == 0, "");
+static_assert(BLOCK_GC_STATES_START + BLOCK_GC_STATES_SIZE <= LARGE_OBJ_BITS_START, "side tables overlap");
+
+inline BlockGCState* Block::gcState() {
+    uintptr_t idx = ((uintptr_t)this - SMALL_ARENA_START) / BLOCK_SIZE;
+    return &((BlockGCState*)BLOCK_GC_STATES_START)[idx];
+}
+
+// Finds the word + mask that hold one of the ObjectBits for a heap object; returns NULL for anything
+// that's not in the heap.
+inline uint64_t* bitWordForObject(void* obj, ObjectBit bit, uint64_t *mask) {
+    uintptr_t addr = (uintptr_t)obj;
+    if (addr - SMALL_ARENA_START < ARENA_SIZE) {
+        Block* b = Block::forPointer(obj);
+        int atom_idx = (addr % BLOCK_SIZE) / ATOM_SIZE;
+        *mask = 1UL << (atom_idx % 64);
+        return &b->gcState()->bits[bit][atom_idx / 64];
+    }
+    if (addr - LARGE_ARENA_START < ARENA_SIZE) {
+        uintptr_t page_idx = (addr - LARGE_ARENA_START) / PAGE_SIZE;
+        *mask = 1UL << (page_idx % 64);
+        return &((uint64_t*)LARGE_OBJ_BITS_START)[bit * LARGE_OBJ_BITS_ELTS + page_idx / 64];
+    }
+    return NULL;
+}
+
 constexpr const size_t sizes[] = {
     16, 32, 48, 64,
     80, 96, 112, 128,
@@ -75,6 +154,50 @@ constexpr const size_t sizes[] = {
     //2560, 3072, 3584, // 4096,
 };
 #define NUM_BUCKETS (sizeof(sizes) / sizeof(sizes[0]))
+#define MAX_SMALL_SIZE (sizes[NUM_BUCKETS-1])
+
+// Size -> size class lookup, indexed by the number of atoms the object takes up; this gets
+// generated at compile time, so picking a bucket doesn't have to search sizes[].
+constexpr int _bucketForSize(size_t size, int start = 0) {
+    return sizes[start] >= size ? start : _bucketForSize(size, start + 1);
+}
+#define _BUCKET1(n) (uint8_t)_bucketForSize((n) * ATOM_SIZE)
+#define _BUCKET4(n) _BUCKET1(n), _BUCKET1(n + 1), _BUCKET1(n + 2), _BUCKET1(n + 3)
+#define _BUCKET16(n) _BUCKET4(n), _BUCKET4(n + 4), _BUCKET4(n + 8), _BUCKET4(n + 12)
+#define _BUCKET64(n) _BUCKET16(n), _BUCKET16(n + 16), _BUCKET16(n + 32), _BUCKET16(n + 48)
+constexpr const uint8_t bucket_for_atoms[] = {
+    _BUCKET64(0), _BUCKET64(64), _BUCKET1(128),
+};
+#undef _BUCKET1
+#undef _BUCKET4
+#undef _BUCKET16
+#undef _BUCKET64
+static_assert(sizeof(bucket_for_atoms) == MAX_SMALL_SIZE / ATOM_SIZE + 1, "");
+static_assert(bucket_for_atoms[1] == 0 && bucket_for_atoms[3] == 2 && bucket_for_atoms[9] == 8, "");
+
+// Maintained by the collector; allocations past the threshold trigger the next collection.
+extern long bytesAllocatedSinceCollection;
+extern long allocBytesBeforeCollection;
+
+// What the most recent sweep has freed so far; sweeping is lazy, so this is only complete once
+// finishSweep has been called.
+struct SweepStats {
+    long objs_freed[NUM_BUCKETS];
+    long large_objs_freed;
+};
+
+// Each thread allocates small objects out of its own current block for each size class, so the
+// common case doesn't need the heap lock.  Only the owning thread allocates out of (or frees into)
+// those blocks; the bytes that got allocated out of them get added to bytesAllocatedSinceCollection
+// whenever the thread has to get a new block.
+//
+// Collections give all of the blocks back to the heap first, so they have to happen while the
+// other threads are stopped; the GIL takes care of that (see core/threading.h), since only the
+// thread holding it can allocate.
+struct ThreadCache {
+    Block* blocks[NUM_BUCKETS];
+    long bytes_allocated;
+};
 
 class LargeObj;
 class Heap {
@@ -83,37 +206,119 @@ class Heap {
         Block* full_heads[NUM_BUCKETS];
         LargeObj *large_head = NULL;
 
-        void* allocSmall(size_t rounded_size, Block **head, Block **full_head);
+        // The young generation: every block that has handed out an object since the last
+        // collection.  Objects are never moved (we can't, since the stack scanning is
+        // conservative), so instead of a separate nursery space, objects are "old" once
+        // they've had their mark bit set by a collection, and minor collections only need
+        // to sweep these blocks.
+        std::vector<Block*> nursery_blocks;
+
+        // Sweeping is done lazily: after a collection, the blocks that need sweeping get put
+        // on these lists, and get swept when we need more space for that size class.
+        std::vector<Block*> unswept[NUM_BUCKETS];
+        long bytes_swept = 0;
+        SweepStats sweep_stats;
+        // Sweeps b, which is in size class bucket_idx, and keeps track of what got freed.
+        long sweep(Block* b, int bucket_idx);
+
+        // Blocks that don't have any objects left in them.  They get reused (by any size class) before
+        // we take more memory from the arena, and once they've gone unused for long enough their memory
+        // gets given back to the OS.  Released blocks are kept around so their addresses can be reused.
+        // Both are kept per NUMA node (see numa.h), by which node's part of the arena the block is in.
+        struct EmptyBlock {
+            Block* block;
+            long empty_since_ms;
+        };
+        std::vector<EmptyBlock> empty_blocks[MAX_NUMA_NODES];
+        std::vector<Block*> released_blocks[MAX_NUMA_NODES];
+        // Takes one of the node's empty or released blocks, if it has any.
+        Block* takeEmptyBlock(int node);
+        long releaseEmptyBlocks(int node, long empty_before_ms);
+
+        Block* allocBlock(uint64_t size, Block** prev);
+        // If b has no live objects left, takes it off its size class's lists and onto empty_blocks.
+        bool retireIfEmpty(Block* b);
+
+        // Every cache that's been created, including ones for threads that have exited (their blocks
+        // still get handed back at the next collection).
+        std::vector<ThreadCache*> thread_caches;
+        // Frees of objects in blocks that other threads are allocating out of; they get done once
+        // those blocks have been handed back.
+        std::vector<void*> remote_frees;
+
+        // The fast path of allocSmall: takes a free slot from this thread's current block for the size
+        // class, and returns NULL if anything else needs to be done.
+        void* tryAllocFromCache(int bucket_idx);
+        // Finds a block of this size class with some free space, and takes it off of the lists.
+        Block* takeBlock(int bucket_idx);
+        void* allocSmall(size_t rounded_size, int bucket_idx);
         void* allocLarge(size_t bytes);
 
+        // Sweeps pending blocks of this size class until one of them has free space.
+        bool lazySweep(int bucket_idx);
+
+        // While the collector is marking incrementally, objects can't be freed out from under it
+        // (they might be on its mark stack), so explicit frees get held back until it's done.
+        bool defer_frees = false;
+        std::vector<void*> deferred_frees;
+
     public:
+        // Protects everything but the thread caches' fast paths; collections hold it throughout.
+        // It's recursive since collections happen from inside the allocator, and the finalizers
+        // they run can free things.
+        std::recursive_mutex lock;
+
         void* realloc(void* ptr, size_t bytes);
 
         void* alloc(size_t bytes) {
             //assert(bytes >= 16);
-            if (bytes == 16)
-                return allocSmall(16, &heads[0], &full_heads[0]);
-            if (bytes <= 32)
-                return allocSmall(32, &heads[1], &full_heads[1]);
-
-            if (bytes > sizes[NUM_BUCKETS-1]) {
+            if (bytes > MAX_SMALL_SIZE) {
                 return allocLarge(bytes);
             }
 
-            for (int i = 2; i < NUM_BUCKETS; i++) {
-                if (sizes[i] >= bytes) {
-                    return allocSmall(sizes[i], &heads[i], &full_heads[i]);
-                }
-            }
-
-            //unreachable
-            abort();
+            int bucket_idx = bucket_for_atoms[(bytes + ATOM_SIZE - 1) / ATOM_SIZE];
+            void* rtn = tryAllocFromCache(bucket_idx);
+            if (rtn)
+                return rtn;
+            return allocSmall(sizes[bucket_idx], bucket_idx);
         }
 
         void free(void* ptr);
+        // Puts every thread's current blocks back on the heap's lists, so that the collector can see
+        // them; called at the start of each collection.
+        void flushThreadCaches();
+        // Turning this off does the frees that got held back in the meantime.
+        void setDeferFrees(bool defer);
 
         void* getAllocationFromInteriorPointer(void* ptr);
+        // Which NUMA node's part of the heap ptr is in (0 if it's not in the heap at all).
+        int nodeFor(void* ptr);
+        // How many bytes the allocation starting at ptr takes up.
+        size_t getAllocationSize(void* ptr);
+
+        // Clears the mark bits of every object in the heap, in preparation for a full collection.
+        // Requires that there's no sweeping left to do.
+        void clearMarks();
+
+        // Called at the end of marking: queues up the unmarked objects to be freed.  Mark bits are
+        // left set on the survivors, since a set mark bit is what makes an object part of the old
+        // generation.  If young_only is set, only objects allocated since the last collection are
+        // considered.
+        void startSweep(bool young_only);
+        // Does whatever sweeping hasn't been done yet; this has to happen before the next mark phase.
+        // Returns the number of bytes freed since startSweep.
+        long finishSweep();
+        // Frees every unmarked object in the heap right away.
         void freeUnmarked();
+
+        const SweepStats& lastSweepStats() {
+            return sweep_stats;
+        }
+        int numLargeObjects();
+
+        // Returns the memory of the blocks that have been empty for at least min_age_ms to the OS.
+        // Returns the number of bytes released.
+        long releaseEmptyBlocks(long min_age_ms);
 };
 
 extern Heap global_heap;
@@ -0,0 +1,128 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cerrno>
+#include <cstdio>
+#include <mutex>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#include "core/common.h"
+#include "core/options.h"
+
+#include "gc/numa.h"
+
+namespace pyston {
+namespace gc {
+
+// This is all done with the raw syscalls rather than through libnuma, so that there's no extra
+// library to depend on; from linux/mempolicy.h:
+#define PYSTON_MPOL_PREFERRED 1
+
+static std::once_flag topology_read;
+static int num_nodes = 1;
+// Which node each cpu belongs to:
+static std::vector<int> node_for_cpu;
+static cpu_set_t node_cpus[MAX_NUMA_NODES];
+
+// Parses a cpu list like "0-7,16-23" into the node's cpu set.  Returns false if it couldn't be read.
+static bool readNodeCpus(int node) {
+    char fn[80];
+    snprintf(fn, sizeof(fn), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE* f = fopen(fn, "r");
+    if (!f)
+        return false;
+
+    CPU_ZERO(&node_cpus[node]);
+    int first, last;
+    while (fscanf(f, "%d", &first) == 1) {
+        last = first;
+        int c = fgetc(f);
+        if (c == '-') {
+            if (fscanf(f, "%d", &last) != 1)
+                break;
+            c = fgetc(f);
+        }
+
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &node_cpus[node]);
+            if (cpu >= node_for_cpu.size())
+                node_for_cpu.resize(cpu + 1, 0);
+            node_for_cpu[cpu] = node;
+        }
+
+        if (c != ',')
+            break;
+    }
+    fclose(f);
+    return true;
+}
+
+static void readTopology() {
+    std::call_once(topology_read, []() {
+        if (!GC_NUMA_AWARE)
+            return;
+
+        int n = 0;
+        while (n < MAX_NUMA_NODES && readNodeCpus(n))
+            n++;
+        // (the cpus of any nodes past MAX_NUMA_NODES count as being on node 0)
+        if (n > 1)
+            num_nodes = n;
+        if (VERBOSITY("gc") >= 1)
+            printf("gc: splitting the heap between %d numa nodes\n", num_nodes);
+    });
+}
+
+int numNumaNodes() {
+    readTopology();
+    return num_nodes;
+}
+
+int currentNumaNode() {
+    if (numNumaNodes() == 1)
+        return 0;
+
+    int cpu = sched_getcpu();
+    if (cpu < 0 || cpu >= node_for_cpu.size())
+        return 0;
+    return node_for_cpu[cpu];
+}
+
+void bindToNumaNode(void* addr, size_t size, int node) {
+    if (numNumaNodes() == 1)
+        return;
+
+    assert(0 <= node && node < num_nodes);
+    unsigned long mask = 1UL << node;
+    long r = syscall(SYS_mbind, addr, size, PYSTON_MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+    // It's only a placement hint, so failing isn't worth stopping for:
+    if (r != 0 && VERBOSITY("gc") >= 1)
+        printf("gc: mbind of %p failed: %d\n", addr, errno);
+}
+
+void pinThreadToNumaNode(int node) {
+    if (numNumaNodes() == 1)
+        return;
+
+    assert(0 <= node && node < num_nodes);
+    int r = sched_setaffinity(0, sizeof(cpu_set_t), &node_cpus[node]);
+    if (r != 0 && VERBOSITY("gc") >= 1)
+        printf("gc: couldn't pin a thread to node %d: %d\n", node, errno);
+}
+
+} // namespace gc
+} // namespace pyston
@@ -0,0 +1,44 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_GC_NUMA_H
+#define PYSTON_GC_NUMA_H
+
+#include <cstddef>
+
+namespace pyston {
+namespace gc {
+
+// The heap gives each NUMA node its own slice of the arenas, so this has to be a power of two
+// (see heap.cpp):
+#define MAX_NUMA_NODES 8
+
+// How many nodes the heap should split itself up between.  This is 1 unless GC_NUMA_AWARE is set and
+// the machine actually has more than one node; the topology gets read from /sys the first time.
+int numNumaNodes();
+
+// The node that the calling thread is running on right now (threads can get moved, so this is only a hint).
+int currentNumaNode();
+
+// Asks for the pages in the range to come from the given node once they get faulted in; they still
+// come from another node if that one is out of memory.  Does nothing if there's only one node.
+void bindToNumaNode(void* addr, size_t size, int node);
+
+// Keeps the calling thread on the cpus of the given node.
+void pinThreadToNumaNode(int node);
+
+} // namespace gc
+} // namespace pyston
+
+#endif
@@ -19,10 +19,14 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cassert>
+#include <unordered_map>
 #include <vector>
 
 #include "core/common.h"
+#include "core/stats.h"
+#include "core/threading.h"
 
+#include "codegen/ast_interpreter.h"
 #include "codegen/codegen.h"
 #include "codegen/llvm_interpreter.h"
 
@@ -47,7 +51,57 @@ void collectRoots(void* start, void* end, TraceStack* stack) {
     }
 }
 
+static std::unordered_map<void*, std::vector<FrameRootLocation> > frame_roots_by_return_addr;
+
+void registerFrameRoots(void* return_addr, std::vector<FrameRootLocation> roots) {
+    assert(frame_roots_by_return_addr.count(return_addr) == 0);
+    frame_roots_by_return_addr[return_addr] = std::move(roots);
+}
+
+static void collectFrameRoots(unw_cursor_t* cursor, const std::vector<FrameRootLocation> &roots, TraceStack* stack) {
+    for (const FrameRootLocation &l : roots) {
+        // libunwind's x86_64 register numbering matches the dwarf one
+        unw_word_t reg;
+        int code = unw_get_reg(cursor, l.regnum, &reg);
+        RELEASE_ASSERT(code == 0, "couldn't get register %d: %d", l.regnum, code);
+
+        if (l.type == FrameRootLocation::Register) {
+            void* p = global_heap.getAllocationFromInteriorPointer((void*)reg);
+            if (p)
+                stack->push(p);
+        } else if (l.type == FrameRootLocation::Indirect) {
+            void* p = global_heap.getAllocationFromInteriorPointer(*(void**)(reg + l.offset));
+            if (p)
+                stack->push(p);
+        } else {
+            assert(l.type == FrameRootLocation::Range);
+            char* start = (char*)reg + l.offset;
+            collectRoots(start, start + l.size, stack);
+        }
+    }
+}
+
+// A frame's values in the callee-saved registers don't have to be in its own [sp, bp) range: the functions that
+// it called can save them in theirs, and those might be jitted frames that only get scanned precisely.  The
+// cursor knows where the registers got saved, so this gets them from it.
+static const int callee_saved_regs[] = { UNW_X86_64_RBX, UNW_X86_64_RBP, UNW_X86_64_R12, UNW_X86_64_R13,
+    UNW_X86_64_R14, UNW_X86_64_R15 };
+
+static void collectCalleeSavedRegisters(unw_cursor_t* cursor, TraceStack* stack) {
+    for (int regnum : callee_saved_regs) {
+        unw_word_t reg;
+        if (unw_get_reg(cursor, regnum, &reg) != 0)
+            continue;
+        void* p = global_heap.getAllocationFromInteriorPointer((void*)reg);
+        if (p)
+            stack->push(p);
+    }
+}
+
 void collectStackRoots(TraceStack *stack) {
+    static StatCounter sc_precise("gc_precise_frames");
+    static StatCounter sc_conservative("gc_conservative_frames");
+
     unw_cursor_t cursor;
     unw_context_t uc;
     unw_word_t ip, sp, bp;
@@ -76,9 +130,11 @@ void collectStackRoots(TraceStack *stack) {
 
     TraceStackGCVisitor visitor(stack);
 
-    int code;
     while (true) {
         int code = unw_step(&cursor);
+        // The other threads' stacks end at clone() rather than __libc_start_main:
+        if (code == 0)
+            break;
         assert(code > 0 && "something broke unwinding!");
 
         unw_get_reg(&cursor, UNW_REG_IP, &ip);
@@ -103,7 +159,37 @@ void collectStackRoots(TraceStack *stack) {
             gatherInterpreterRootsForFrame(&visitor, cur_bp);
         }
 
+        if (pip.start_ip == (intptr_t)astInterpretFunction) {
+            // The temporaries are still on the C stack, which gets scanned conservatively below;
+            // this is for the local variables.
+            gatherASTInterpreterRootsForFrame(&visitor, cur_bp);
+        }
+
+        auto it = frame_roots_by_return_addr.find((void*)ip);
+        if (it != frame_roots_by_return_addr.end()) {
+            sc_precise.log();
+            collectFrameRoots(&cursor, it->second, stack);
+            continue;
+        }
+
+        sc_conservative.log();
         collectRoots(cur_sp, (char*)cur_bp, stack);
+        collectCalleeSavedRegisters(&cursor, stack);
+    }
+
+    // The other threads are all stopped (waiting for the GIL, or in a blocking call), and saved their registers
+    // when they let go of it; their stacks just get scanned conservatively, since they can't be unwound from here.
+    for (threading::ThreadState* t : threading::getOtherThreads()) {
+        visitor.visitPotential(t->start_arg1);
+        visitor.visitPotential(t->start_arg2);
+
+        if (!t->stack_start)
+            continue;
+
+        collectRoots(&t->registers, &t->registers + 1, stack);
+        collectRoots(t->stack_start, t->stack_end, stack);
+        gatherInterpreterRootsInRange(&visitor, t->stack_start, t->stack_end);
+        gatherASTInterpreterRootsInRange(&visitor, t->stack_start, t->stack_end);
     }
 }
 
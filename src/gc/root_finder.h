@@ -15,12 +15,31 @@
 #ifndef PYSTON_GC_ROOTFINDER_H
 #define PYSTON_GC_ROOTFINDER_H
 
+#include <stdint.h>
+#include <vector>
+
 namespace pyston {
 namespace gc {
 
 class TraceStack;
 void collectStackRoots(TraceStack*);
 
+// Where to find the live gc pointers of a jitted frame that is stopped at a particular call.
+// Registers are identified by their dwarf numbers.
+struct FrameRootLocation {
+    enum LocationType : uint8_t {
+        Register, // the register holds the pointer
+        Indirect, // the pointer is stored at [reg + offset]
+        Range,    // [reg + offset, reg + offset + size) should be scanned conservatively
+    } type;
+    uint16_t regnum;
+    int32_t offset;
+    int32_t size;
+};
+// Frames whose return address has been registered here get scanned precisely instead of
+// conservatively; everything else (C++ frames, calls out of ICs) is still scanned conservatively.
+void registerFrameRoots(void* return_addr, std::vector<FrameRootLocation> roots);
+
 }
 }
 
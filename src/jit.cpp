@@ -27,14 +27,30 @@
 #include "core/common.h"
 #include "core/options.h"
 #include "core/stats.h"
+#include "core/threading.h"
+#include "core/trace.h"
 #include "core/types.h"
 
 #include "core/ast.h"
 #include "core/util.h"
 
+#include "asm_writing/icinfo.h"
+
 #include "codegen/entry.h"
-#include "codegen/llvm_interpreter.h"
+#include "codegen/irgen/tiering.h"
+#include "codegen/irgen/warmup.h"
+#include "codegen/opt/pipelines.h"
+#include "codegen/native_parser.h"
 #include "codegen/parser.h"
+#include "codegen/startup_server.h"
+#include "codegen/profiling/line_profiler.h"
+#include "codegen/profiling/sampler.h"
+
+#include "gc/gc_stats.h"
+
+#include "runtime/alloc_profile.h"
+#include "runtime/heap_dump.h"
+#include "runtime/importing.h"
 
 
 #ifndef GITREV
@@ -44,6 +60,13 @@
 using namespace pyston;
 
 int main(int argc, char** argv) {
+    // Terminals stay line-buffered, but when stdout is a file or a pipe give it a much bigger
+    // buffer than stdio's default, so that output-heavy scripts make fewer write calls.
+    // (Has to happen before anything gets written to stdout.)
+    static char stdout_buf[1 << 16];
+    if (!isatty(fileno(stdout)))
+        setvbuf(stdout, stdout_buf, _IOFBF, sizeof(stdout_buf));
+
     Timer _t("for jit startup");
     //llvm::sys::PrintStackTraceOnErrorSignal();
     //llvm::PrettyStackTraceProgram X(argc, argv);
@@ -54,7 +77,10 @@ int main(int argc, char** argv) {
     bool force_repl = false;
     bool repl = true;
     bool stats = false;
-    while ((code = getopt(argc, argv, "+Oqcdibpjtrsvn")) != -1) {
+    const char* heap_dump_filename = NULL;
+    const char* startup_server_socket = NULL;
+    const char* startup_client_socket = NULL;
+    while ((code = getopt(argc, argv, "+OqcdibpjtrsvnlJHNIBCXg:G:m:M:L:a:T:K:R:P:S:U:E:x:V:D:W:Z:z:")) != -1) {
         if (code == 'O')
             FORCE_OPTIMIZE = true;
         else if (code == 't')
@@ -73,6 +99,10 @@ int main(int argc, char** argv) {
             BENCH = true;
         } else if (code == 'n') {
             ENABLE_INTERPRETER = false;
+        } else if (code == 'l') {
+            ENABLE_LLVM_INTERPRETER = true;
+        } else if (code == 'J') {
+            ENABLE_THREADED_INTERPRETER = true;
         } else if (code == 'p') {
             PROFILE = true;
         } else if (code == 'j') {
@@ -81,6 +111,81 @@ int main(int argc, char** argv) {
             stats = true;
         } else if (code == 'r') {
             USE_STRIPPED_STDLIB = true;
+        } else if (code == 'H') {
+            GC_USE_HUGE_PAGES = true;
+        } else if (code == 'N') {
+            GC_NUMA_AWARE = true;
+        } else if (code == 'I') {
+            GC_INCREMENTAL_MARKING = true;
+        } else if (code == 'B') {
+            BACKGROUND_COMPILE = true;
+        } else if (code == 'C') {
+            IC_REPORT = true;
+        } else if (code == 'X') {
+            ENABLE_SHARED_IC_STUBS = ENABLE_ICS;
+        } else if (code == 'K') {
+            COMPILE_CACHE_DIR = optarg;
+        } else if (code == 'R') {
+            COMPILE_CACHE_SHARED_DIRS = optarg;
+        } else if (code == 'W') {
+            WARMUP_MANIFEST = optarg;
+        } else if (code == 'Z') {
+            // see codegen/startup_server.h
+            startup_server_socket = optarg;
+        } else if (code == 'z') {
+            startup_client_socket = optarg;
+        } else if (code == 'g') {
+            GC_MARK_THREADS = atoi(optarg);
+            if (GC_MARK_THREADS < 1) {
+                fprintf(stderr, "Error: need at least one gc marking thread\n");
+                exit(1);
+            }
+        } else if (code == 'V') {
+            MAX_SPECIALIZED_VERSIONS = atoi(optarg);
+            if (MAX_SPECIALIZED_VERSIONS < 0) {
+                fprintf(stderr, "Error: the number of specialized versions can't be negative\n");
+                exit(1);
+            }
+        } else if (code == 'G') {
+            GC_HEAP_GROWTH_FACTOR = atof(optarg);
+            if (GC_HEAP_GROWTH_FACTOR <= 1.0) {
+                fprintf(stderr, "Error: the heap growth factor has to be greater than 1\n");
+                exit(1);
+            }
+        } else if (code == 'm') {
+            // heap size limits are given in megabytes
+            GC_MIN_HEAP_SIZE = atol(optarg) << 20;
+        } else if (code == 'M') {
+            GC_MAX_HEAP_SIZE = atol(optarg) << 20;
+        } else if (code == 'L') {
+            gc::writeGCStatsAtExit(optarg);
+        } else if (code == 'S') {
+            startSamplingProfiler(optarg);
+        } else if (code == 'U') {
+            // SIGUSR1 turns the line profiler on and off, and writes the report to this file
+            setupLineProfilerSignal(optarg);
+        } else if (code == 'D') {
+            // written once the program's done running, before the runtime gets torn down
+            heap_dump_filename = optarg;
+        } else if (code == 'x') {
+            startTracing(optarg);
+        } else if (code == 'E') {
+            // For anything that wants a different interval, there's pyston_stats.export()
+            Stats::startPeriodicExport(optarg, 10000);
+        } else if (code == 'a') {
+            ALLOC_PROFILE_RATE = atoi(optarg);
+            if (ALLOC_PROFILE_RATE < 1) {
+                fprintf(stderr, "Error: the allocation sampling rate has to be at least 1\n");
+                exit(1);
+            }
+        } else if (code == 'T') {
+            // ex -T minimal_calls=1000,moderate_calls=50000,osr_effort=moderate
+            if (!getTieringPolicy()->parseSettings(optarg))
+                exit(1);
+        } else if (code == 'P') {
+            // ex -P moderate=early_cse,instcombine,simplifycfg
+            if (!parsePassPipelineSetting(optarg))
+                exit(1);
         } else if (code == '?')
             abort();
     }
@@ -98,14 +203,36 @@ int main(int argc, char** argv) {
 
     // end of argument parsing
 
+    // The point of this is to not do any of the initialization:
+    if (startup_client_socket) {
+        if (fn == NULL) {
+            fprintf(stderr, "Error: -z needs a script to run\n");
+            exit(1);
+        }
+        return runOnStartupServer(startup_client_socket, fn);
+    }
+    if (startup_server_socket && fn != NULL) {
+        fprintf(stderr, "Error: -Z doesn't take a script; they get sent to it with -z\n");
+        exit(1);
+    }
+
+    threading::registerMainThread();
+
     {
         Timer _t("for initCodegen");
         initCodegen();
     }
 
+    if (startup_server_socket) {
+        fn = serveStartupRequests(startup_server_socket);
+        repl = false;
+    }
+
     BoxedModule* main = createMainModule(fn);
+    setImportPath(fn);
 
-    _t.split("to run");
+    static StatCounter us_startup("us_startup");
+    us_startup.log(_t.split("to run"));
     if (fn != NULL) {
         int num_iterations = 1;
         if (BENCH)
@@ -124,11 +251,12 @@ int main(int argc, char** argv) {
                 fprintf(stderr, "==============\n");
             }
 
+            prefetchImports(m);
             CompiledFunction* compiled = compileModule(m, main);
             if (VERBOSITY() >= 1)
                 fprintf(stderr, "compiled module.main to machine code; running:\n");
             if (compiled->is_interpreted)
-                interpretFunction(compiled->func, 0, NULL, NULL, NULL, NULL);
+                callCompiledFunc(compiled, 0, NULL, NULL, NULL, NULL);
             else
                 ((void (*)())compiled->code)();
             if (VERBOSITY() >= 1)
@@ -148,7 +276,7 @@ int main(int argc, char** argv) {
             AST_Module *m = new AST_Module();
             CompiledFunction* compiled = compileModule(m, main);
             if (compiled->is_interpreted)
-                interpretFunction(compiled->func, 0, NULL, NULL, NULL, NULL);
+                callCompiledFunc(compiled, 0, NULL, NULL, NULL, NULL);
             else
                 ((void (*)())compiled->code)();
 
@@ -184,24 +312,11 @@ int main(int argc, char** argv) {
             timeval start, end;
             gettimeofday(&start, NULL);
 
-            char buf[] = "pystontmp_XXXXXX";
-            char *tmpdir = mkdtemp(buf);
-            assert(tmpdir);
-            std::string tmp = std::string(tmpdir) + "/in.py";
-            if (VERBOSITY() >= 1) {
-                printf("writing %d bytes to %s\n", read, tmp.c_str());
-            }
-
-            FILE* f = fopen(tmp.c_str(), "w");
-            fwrite(line, 1, read, f);
-            fclose(f);
-
-            AST_Module* m = parse(tmp.c_str());
-            removeDirectoryIfExists(tmpdir);
+            AST_Module* m = parseSource(std::string(line, read), "<stdin>");
 
             if (m->body.size() > 0 && m->body[0]->type == AST_TYPE::Expr) {
                 AST_Expr *e = static_cast<AST_Expr*>(m->body[0]);
-                AST_Print *p = new AST_Print();
+                AST_Print *p = m->arena.make<AST_Print>();
                 p->dest = NULL;
                 p->nl = true;
                 p->values.push_back(e->value);
@@ -210,7 +325,7 @@ int main(int argc, char** argv) {
 
             CompiledFunction* compiled = compileModule(m, main);
             if (compiled->is_interpreted)
-                interpretFunction(compiled->func, 0, NULL, NULL, NULL, NULL);
+                callCompiledFunc(compiled, 0, NULL, NULL, NULL, NULL);
             else
                 ((void (*)())compiled->code)();
 
@@ -221,6 +336,10 @@ int main(int argc, char** argv) {
             }
         }
     }
+    if (heap_dump_filename)
+        dumpHeap(heap_dump_filename);
+    writeWarmupManifest();
+
     _t.split("joinRuntime");
 
     int rtncode = joinRuntime();
@@ -229,6 +348,12 @@ int main(int argc, char** argv) {
     if (VERBOSITY() >= 1 || stats)
         Stats::dump();
 
+    if (ALLOC_PROFILE_RATE)
+        dumpAllocationProfile(stdout);
+
+    if (IC_REPORT)
+        dumpICReport(stdout);
+
     // I don't know why this is required...
     fflush(stdout);
     return rtncode;
@@ -0,0 +1,133 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#define UNW_LOCAL_ONLY
+#include <libunwind.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "core/common.h"
+#include "core/options.h"
+#include "core/types.h"
+
+#include "codegen/ast_interpreter.h"
+#include "codegen/codegen.h"
+#include "codegen/llvm_interpreter.h"
+
+#include "gc/collector.h"
+#include "gc/heap.h"
+
+#include "runtime/alloc_profile.h"
+#include "runtime/objmodel.h"
+#include "runtime/types.h"
+
+namespace pyston {
+
+// Don't look further than this many frames up the stack for a Python function:
+#define MAX_ALLOC_PROFILE_DEPTH 32
+
+struct AllocationSamples {
+    long count, bytes;
+};
+// (class name, function name); classes can get freed, so hold on to their names instead of the classes.
+typedef std::pair<std::string, std::string> AllocationSite;
+static std::map<AllocationSite, AllocationSamples> samples;
+// Where each of the sampled objects that's still alive got allocated, for the heap dumps.  The
+// entries point into samples, which never has anything taken out of it.
+static std::unordered_map<void*, const AllocationSite*> sampled_objects;
+
+static long allocs_until_sample = 0;
+
+static std::string findPythonCaller() {
+    unw_cursor_t cursor;
+    unw_context_t uc;
+    unw_word_t ip;
+
+    unw_getcontext(&uc);
+    unw_init_local(&cursor, &uc);
+
+    std::string name;
+    for (int i = 0; i < MAX_ALLOC_PROFILE_DEPTH && unw_step(&cursor) > 0; i++) {
+        unw_get_reg(&cursor, UNW_REG_IP, &ip);
+        if (g.func_addr_registry.getFuncNameContaining((void*)ip, &name))
+            return name;
+
+        unw_proc_info_t pip;
+        unw_get_proc_info(&cursor, &pip);
+        if (pip.start_ip == (uintptr_t)interpretFunction || pip.start_ip == (uintptr_t)astInterpretFunction)
+            return "<interpreted>";
+    }
+    return "<runtime>";
+}
+
+void trackAllocation(Box* b) {
+    if (--allocs_until_sample > 0)
+        return;
+    allocs_until_sample = ALLOC_PROFILE_RATE;
+
+    // Some of the bootstrapping classes get created before their class:
+    if (!b->cls)
+        return;
+
+    auto it = samples.insert(std::make_pair(AllocationSite(*getNameOfClass(b->cls), findPythonCaller()), AllocationSamples()));
+    AllocationSamples &s = it.first->second;
+    s.count++;
+    // Boxes aren't necessarily gc allocations, ex if something got allocated on the stack.
+    if (gc::global_heap.getAllocationFromInteriorPointer(b) == b) {
+        s.bytes += gc::global_heap.getAllocationSize(b);
+        sampled_objects[b] = &it.first->first;
+    }
+}
+
+void dropDeadSampledObjects() {
+    for (auto it = sampled_objects.begin(); it != sampled_objects.end(); ) {
+        if (gc::isMarked(it->first))
+            ++it;
+        else
+            it = sampled_objects.erase(it);
+    }
+}
+
+const std::string* getAllocationSite(Box* b) {
+    auto it = sampled_objects.find(b);
+    if (it == sampled_objects.end())
+        return NULL;
+    // Explicit frees don't tell us anything, so the address could have been reused by an allocation
+    // that didn't get sampled:
+    if (it->second->first != *getNameOfClass(b->cls))
+        return NULL;
+    return &it->second->second;
+}
+
+void dumpAllocationProfile(FILE* f) {
+    std::vector<std::pair<AllocationSite, AllocationSamples> > sorted(samples.begin(), samples.end());
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<AllocationSite, AllocationSamples> &lhs, const std::pair<AllocationSite, AllocationSamples> &rhs) {
+        return lhs.second.bytes > rhs.second.bytes;
+    });
+
+    fprintf(f, "Allocation profile (1 in %d allocations sampled; counts are estimates):\n", ALLOC_PROFILE_RATE);
+    fprintf(f, "%12s %14s  %-20s %s\n", "allocs", "bytes", "class", "function");
+    for (auto &p : sorted) {
+        fprintf(f, "%12ld %14ld  %-20s %s\n", p.second.count * ALLOC_PROFILE_RATE, p.second.bytes * ALLOC_PROFILE_RATE,
+                p.first.first.c_str(), p.first.second.c_str());
+    }
+}
+
+}
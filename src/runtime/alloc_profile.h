@@ -0,0 +1,37 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_RUNTIME_ALLOCPROFILE_H
+#define PYSTON_RUNTIME_ALLOCPROFILE_H
+
+#include <cstdio>
+#include <string>
+
+namespace pyston {
+
+// A sampling allocation profiler: when ALLOC_PROFILE_RATE is set, every Box that gets constructed
+// counts towards a sample, and each sampled allocation is attributed to its class and to the
+// innermost jitted Python function on the stack.
+void dumpAllocationProfile(FILE* f);
+
+class Box;
+// The sampled objects are remembered until they die, so that heap dumps (see heap_dump.h) can say where
+// they came from; this is registered as a gc weak ref callback, and forgets about the dead ones.
+void dropDeadSampledObjects();
+// The function that allocated b, if it was one of the sampled allocations; NULL otherwise.
+const std::string* getAllocationSite(Box* b);
+
+}
+
+#endif
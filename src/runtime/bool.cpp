@@ -41,6 +41,11 @@ extern "C" Box* boolNonzero(BoxedBool* v) {
     return v;
 }
 
+// Same as the ints they're equal to:
+extern "C" Box* boolHash(BoxedBool* v) {
+    return boxInt(v->b);
+}
+
 extern "C" Box* boolRepr(BoxedBool* v) {
     if (v->b)
         return boxStrConstant("True");
@@ -67,6 +72,7 @@ void setupBool() {
     bool_cls->giveAttr("__neg__", new BoxedFunction(boxRTFunction((void*)boolNeg, NULL, 1, false)));
     bool_cls->giveAttr("__nonzero__", new BoxedFunction(boxRTFunction((void*)boolNonzero, NULL, 1, false)));
     bool_cls->giveAttr("__repr__", new BoxedFunction(boxRTFunction((void*)boolRepr, NULL, 1, false)));
+    bool_cls->giveAttr("__hash__", new BoxedFunction(boxRTFunction((void*)boolHash, NULL, 1, false)));
     bool_cls->setattr("__str__", bool_cls->peekattr("__repr__"), NULL, NULL);
 
     CLFunction *__new__ = boxRTFunction((void*)boolNew1, NULL, 1, false);
@@ -13,11 +13,14 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <cstring>
 
 #include "core/ast.h"
 #include "core/types.h"
 
 #include "runtime/gc_runtime.h"
+#include "runtime/int.h"
+#include "runtime/list.h"
 #include "runtime/objmodel.h"
 #include "runtime/types.h"
 #include "runtime/util.h"
@@ -64,7 +67,213 @@ extern "C" Box* max_(Box* o0, Box* o1) {
     return o0;
 }
 
-extern "C" Box* open2(Box* arg1, Box* arg2) {
+// The reductions below go over lists in their unboxed strategies, and over xranges, natively; anything else
+// (and object lists, by index) does the same thing with boxed values, which is what ends up running Python code.
+static Box* getIterator(Box* iterable) {
+    if (!getclsattr_internal(iterable, "__iter__", NULL, NULL))
+        raiseNotIterableError(getTypeName(iterable)->c_str());
+
+    static std::string* iter_str = const_cast<std::string*>(internString("__iter__"));
+    return callattr(iterable, iter_str, true, 0, NULL, NULL, NULL, NULL);
+}
+
+static Box* minmax(Box* iterable, bool is_max) {
+    const char* name = is_max ? "max" : "min";
+    int op_type = is_max ? AST_TYPE::Gt : AST_TYPE::Lt;
+
+    if (iterable->cls == list_cls) {
+        BoxedList *l = static_cast<BoxedList*>(iterable);
+        if (l->size && l->strategy == BoxedList::INT_STRATEGY) {
+            int64_t* elts = l->elts->intElts();
+            i64 best = elts[0];
+            for (int64_t i = 1; i < l->size; i++) {
+                if (is_max ? elts[i] > best : elts[i] < best)
+                    best = elts[i];
+            }
+            return boxInt(best);
+        } else if (l->size && l->strategy == BoxedList::FLOAT_STRATEGY) {
+            // (same comparisons as the boxed version, so nans come out the same way)
+            double* elts = l->elts->floatElts();
+            double best = elts[0];
+            for (int64_t i = 1; i < l->size; i++) {
+                if (is_max ? elts[i] > best : elts[i] < best)
+                    best = elts[i];
+            }
+            return boxFloat(best);
+        } else if (l->size) {
+            // The comparisons can change the list, so this rechecks the size each time:
+            Box* best = l->getElt(0);
+            for (int64_t i = 1; i < l->size; i++) {
+                Box* v = l->getElt(i);
+                if (nonzero(compareInternal(v, best, op_type, NULL)))
+                    best = v;
+            }
+            return best;
+        }
+    } else if (iterable->cls == tuple_cls) {
+        BoxedTuple *t = static_cast<BoxedTuple*>(iterable);
+        if (t->nelts) {
+            Box* best = t->elts[0];
+            for (int64_t i = 1; i < t->nelts; i++) {
+                if (nonzero(compareInternal(t->elts[i], best, op_type, NULL)))
+                    best = t->elts[i];
+            }
+            return best;
+        }
+    } else if (iterable->cls == xrange_cls) {
+        i64 first, step, len;
+        xrangeElements(iterable, &first, &step, &len);
+        if (len) {
+            // (it's an element, so it fits, even if the distance to it doesn't)
+            i64 last = (i64)((uint64_t)first + (uint64_t)(len - 1) * (uint64_t)step);
+            return boxInt(is_max == (step > 0) ? last : first);
+        }
+    } else {
+        Box* iter = getIterator(iterable);
+        Box* best = iterNext(iter);
+        if (best) {
+            while (Box* v = iterNext(iter)) {
+                if (nonzero(compareInternal(v, best, op_type, NULL)))
+                    best = v;
+            }
+            return best;
+        }
+    }
+
+    fprintf(stderr, "ValueError: %s() arg is an empty sequence\n", name);
+    raiseExc();
+}
+
+Box* min1(Box* iterable) {
+    return minmax(iterable, false);
+}
+
+Box* max1(Box* iterable) {
+    return minmax(iterable, true);
+}
+
+Box* sum2(Box* iterable, Box* start) {
+    if (start->cls == str_cls) {
+        fprintf(stderr, "TypeError: sum() can't sum strings [use ''.join(seq) instead]\n");
+        raiseExc();
+    }
+
+    Box* total = start;
+    int64_t i = 0;
+    if (iterable->cls == list_cls) {
+        BoxedList *l = static_cast<BoxedList*>(iterable);
+        if (l->strategy == BoxedList::INT_STRATEGY && start->cls == int_cls) {
+            int64_t* elts = l->elts->intElts();
+            i64 itotal = static_cast<BoxedInt*>(start)->n;
+            for (; i < l->size; i++) {
+                // On overflow, the rest gets added up with binop, which switches to longs:
+                i64 next;
+                if (addOverflows(itotal, elts[i], &next))
+                    break;
+                itotal = next;
+            }
+            if (i == l->size)
+                return boxInt(itotal);
+            total = boxInt(itotal);
+        } else if (l->strategy == BoxedList::FLOAT_STRATEGY && (start->cls == int_cls || start->cls == float_cls)) {
+            // (python adds these up left to right too, so this comes out the same)
+            double* elts = l->elts->floatElts();
+            double ftotal = start->cls == int_cls ? static_cast<BoxedInt*>(start)->n : static_cast<BoxedFloat*>(start)->d;
+            for (; i < l->size; i++)
+                ftotal += elts[i];
+            return boxFloat(ftotal);
+        }
+
+        // The adds can change the list, so this rechecks the size each time:
+        for (; i < l->size; i++)
+            total = binop(total, l->getElt(i), AST_TYPE::Add);
+        return total;
+    } else if (iterable->cls == tuple_cls) {
+        BoxedTuple *t = static_cast<BoxedTuple*>(iterable);
+        for (; i < t->nelts; i++)
+            total = binop(total, t->elts[i], AST_TYPE::Add);
+        return total;
+    } else if (iterable->cls == xrange_cls && start->cls == int_cls) {
+        i64 isum;
+        if (xrangeSum(iterable, &isum) && !addOverflows(static_cast<BoxedInt*>(start)->n, isum, &isum))
+            return boxInt(isum);
+    }
+
+    Box* iter = getIterator(iterable);
+    while (Box* v = iterNext(iter))
+        total = binop(total, v, AST_TYPE::Add);
+    return total;
+}
+
+Box* sum1(Box* iterable) {
+    return sum2(iterable, boxInt(0));
+}
+
+// Whether any (or, if is_all, every) element is true; stops at the first one that decides it:
+static bool anyall(Box* iterable, bool is_all) {
+    if (iterable->cls == list_cls) {
+        BoxedList *l = static_cast<BoxedList*>(iterable);
+        if (l->strategy == BoxedList::INT_STRATEGY) {
+            int64_t* elts = l->elts->intElts();
+            for (int64_t i = 0; i < l->size; i++) {
+                if ((elts[i] != 0) != is_all)
+                    return !is_all;
+            }
+            return is_all;
+        } else if (l->strategy == BoxedList::FLOAT_STRATEGY) {
+            double* elts = l->elts->floatElts();
+            for (int64_t i = 0; i < l->size; i++) {
+                if ((elts[i] != 0.0) != is_all)
+                    return !is_all;
+            }
+            return is_all;
+        }
+
+        for (int64_t i = 0; i < l->size; i++) {
+            if (nonzero(l->getElt(i)) != is_all)
+                return !is_all;
+        }
+        return is_all;
+    } else if (iterable->cls == tuple_cls) {
+        BoxedTuple *t = static_cast<BoxedTuple*>(iterable);
+        for (int64_t i = 0; i < t->nelts; i++) {
+            if (nonzero(t->elts[i]) != is_all)
+                return !is_all;
+        }
+        return is_all;
+    } else if (iterable->cls == xrange_cls) {
+        i64 first, step, len;
+        xrangeElements(iterable, &first, &step, &len);
+        if (!is_all)
+            // The elements are all different, so only one of them can be 0:
+            return len > 1 || (len == 1 && first != 0);
+
+        // Whether 0 is one of the elements:
+        if (len == 0)
+            return true;
+        __int128 last = first + (__int128)(len - 1) * step;
+        bool in_bounds = step > 0 ? (first <= 0 && 0 <= last) : (last <= 0 && 0 <= first);
+        return !(in_bounds && (0 - (__int128)first) % step == 0);
+    }
+
+    Box* iter = getIterator(iterable);
+    while (Box* v = iterNext(iter)) {
+        if (nonzero(v) != is_all)
+            return !is_all;
+    }
+    return is_all;
+}
+
+Box* any(Box* iterable) {
+    return boxBool(anyall(iterable, false));
+}
+
+Box* all(Box* iterable) {
+    return boxBool(anyall(iterable, true));
+}
+
+// The third argument is python's "buffering": the size of the file's buffers, or negative for the default.
+extern "C" Box* open3(Box* arg1, Box* arg2, Box* arg3) {
     if (arg1->cls != str_cls) {
         fprintf(stderr, "TypeError: coercing to Unicode: need string of buffer, %s found\n", getTypeName(arg1)->c_str());
         raiseExc();
@@ -77,10 +286,22 @@ extern "C" Box* open2(Box* arg1, Box* arg2) {
     const std::string &fn = static_cast<BoxedString*>(arg1)->s;
     const std::string &mode = static_cast<BoxedString*>(arg2)->s;
 
+    if (arg3->cls != int_cls) {
+        fprintf(stderr, "TypeError: an integer is required\n");
+        raiseExc();
+    }
+    i64 buffering = static_cast<BoxedInt*>(arg3)->n;
+    i64 buffer_size = buffering > 1 ? buffering : (buffering < 0 ? BoxedFile::DEFAULT_BUFFER_SIZE : 1);
+
     FILE* f = fopen(fn.c_str(), mode.c_str());
     RELEASE_ASSERT(f, "");
+    setvbuf(f, NULL, buffering == 0 ? _IONBF : _IOFBF, buffer_size);
+
+    return new BoxedFile(f, buffer_size);
+}
 
-    return new BoxedFile(f);
+extern "C" Box* open2(Box* arg1, Box* arg2) {
+    return open3(arg1, arg2, boxInt(-1));
 }
 
 extern "C" Box* open1(Box* arg) {
@@ -97,34 +318,47 @@ extern "C" Box* chr(Box* arg) {
     i64 n = static_cast<BoxedInt*>(arg)->n;
     RELEASE_ASSERT(n >= 0 && n < 256, "");
 
-    return boxString(std::string(1, (char)n));
+    return boxCharacter((char)n);
 }
 
-Box* range1(Box* end) {
-    RELEASE_ASSERT(end->cls == int_cls, "%s", getTypeName(end)->c_str());
+// range() results are lists of ints, so build them directly in the unboxed int strategy
+// rather than boxing every element and then unboxing it again on append.
+static Box* makeIntRange(i64 start, i64 end, i64 step) {
+    assert(step != 0);
 
     BoxedList *rtn = new BoxedList();
-    i64 iend = static_cast<BoxedInt*>(end)->n;
-    for (i64 i = 0; i < iend; i++) {
-        Box *bi = boxInt(i);
-        listAppendInternal(rtn, bi);
+    i64 len = 0;
+    if (step > 0 && start < end)
+        len = (end - start - 1) / step + 1;
+    else if (step < 0 && start > end)
+        len = (start - end - 1) / (-step) + 1;
+
+    if (len == 0)
+        return rtn;
+
+    rtn->strategy = BoxedList::INT_STRATEGY;
+    rtn->ensure(len);
+    int64_t* elts = rtn->elts->intElts();
+    i64 cur = start;
+    for (i64 i = 0; i < len; i++) {
+        elts[i] = cur;
+        cur += step;
     }
+    rtn->size = len;
     return rtn;
 }
 
+Box* range1(Box* end) {
+    RELEASE_ASSERT(end->cls == int_cls, "%s", getTypeName(end)->c_str());
+
+    return makeIntRange(0, static_cast<BoxedInt*>(end)->n, 1);
+}
+
 Box* range2(Box* start, Box* end) {
     RELEASE_ASSERT(start->cls == int_cls, "%s", getTypeName(start)->c_str());
     RELEASE_ASSERT(end->cls == int_cls, "%s", getTypeName(end)->c_str());
 
-    BoxedList *rtn = new BoxedList();
-    i64 istart = static_cast<BoxedInt*>(start)->n;
-    i64 iend = static_cast<BoxedInt*>(end)->n;
-
-    for (i64 i = istart; i < iend; i++) {
-        Box *bi = boxInt(i);
-        listAppendInternal(rtn, bi);
-    }
-    return rtn;
+    return makeIntRange(static_cast<BoxedInt*>(start)->n, static_cast<BoxedInt*>(end)->n, 1);
 }
 
 Box* range3(Box* start, Box* end, Box* step) {
@@ -132,24 +366,10 @@ Box* range3(Box* start, Box* end, Box* step) {
     RELEASE_ASSERT(end->cls == int_cls, "%s", getTypeName(end)->c_str());
     RELEASE_ASSERT(step->cls == int_cls, "%s", getTypeName(step)->c_str());
 
-    BoxedList *rtn = new BoxedList();
-    i64 istart = static_cast<BoxedInt*>(start)->n;
-    i64 iend = static_cast<BoxedInt*>(end)->n;
     i64 istep = static_cast<BoxedInt*>(step)->n;
     RELEASE_ASSERT(istep != 0, "step can't be 0");
 
-    if (istep > 0) {
-        for (i64 i = istart; i < iend; i += istep) {
-            Box *bi = boxInt(i);
-            listAppendInternal(rtn, bi);
-        }
-    } else {
-        for (i64 i = istart; i > iend; i += istep) {
-            Box *bi = boxInt(i);
-            listAppendInternal(rtn, bi);
-        }
-    }
-    return rtn;
+    return makeIntRange(static_cast<BoxedInt*>(start)->n, static_cast<BoxedInt*>(end)->n, istep);
 }
 
 Box* notimplementedRepr(Box* self) {
@@ -167,12 +387,10 @@ Box* sorted(Box* obj) {
     rtn->elts = new (size) BoxedList::ElementArray();
     rtn->size = size;
     rtn->capacity = size;
-    for (int i = 0; i < size; i++) {
-        Box* t = rtn->elts->elts[i] = lobj->elts->elts[i];
-    }
-
-    std::sort<Box**, PyLt>(rtn->elts->elts, rtn->elts->elts + size, PyLt());
+    rtn->strategy = lobj->strategy;
+    memcpy(rtn->elts->elts, lobj->elts->elts, size * sizeof(Box*));
 
+    listSort(rtn);
     return rtn;
 }
 
@@ -180,8 +398,9 @@ Box* isinstance(Box* obj, Box *cls) {
     assert(cls->cls == type_cls);
     BoxedClass *ccls = static_cast<BoxedClass*>(cls);
 
-    // TODO need to check if it's a subclass, or if subclasshook exists
-    return boxBool(obj->cls == cls);
+    // TODO need to check if it's a subclass, or if subclasshook exists; the exception classes are the only
+    // ones with a hierarchy so far:
+    return boxBool(obj->cls == cls || isExceptionSubclass(obj->cls, ccls));
 }
 
 Box* getattr2(Box* obj, Box* _str) {
@@ -228,7 +447,7 @@ void setupBuiltins() {
 
     builtins_module->setattr("None", None, NULL, NULL);
 
-    notimplemented_cls = new BoxedClass(false, NULL);
+    notimplemented_cls = new BoxedClass(&notimplemented_flavor, false, NULL);
     notimplemented_cls->giveAttr("__name__", boxStrConstant("NotImplementedType"));
     notimplemented_cls->giveAttr("__repr__", new BoxedFunction(boxRTFunction((void*)notimplementedRepr, NULL, 1, false)));
     notimplemented_cls->freeze();
@@ -246,10 +465,22 @@ void setupBuiltins() {
     builtins_module->giveAttr("hash", hash_obj);
     abs_obj = new BoxedFunction(boxRTFunction((void*)abs_, NULL, 1, false));
     builtins_module->giveAttr("abs", abs_obj);
-    min_obj = new BoxedFunction(boxRTFunction((void*)min_, NULL, 2, false));
+    CLFunction *min_clf = boxRTFunction((void*)min1, NULL, 1, false);
+    addRTFunction(min_clf, (void*)min_, NULL, 2, false);
+    min_obj = new BoxedFunction(min_clf);
     builtins_module->giveAttr("min", min_obj);
-    max_obj = new BoxedFunction(boxRTFunction((void*)max_, NULL, 2, false));
+    CLFunction *max_clf = boxRTFunction((void*)max1, NULL, 1, false);
+    addRTFunction(max_clf, (void*)max_, NULL, 2, false);
+    max_obj = new BoxedFunction(max_clf);
     builtins_module->giveAttr("max", max_obj);
+    CLFunction *sum_clf = boxRTFunction((void*)sum1, NULL, 1, false);
+    addRTFunction(sum_clf, (void*)sum2, NULL, 2, false);
+    sum_obj = new BoxedFunction(sum_clf);
+    builtins_module->giveAttr("sum", sum_obj);
+    any_obj = new BoxedFunction(boxRTFunction((void*)any, NULL, 1, false));
+    builtins_module->giveAttr("any", any_obj);
+    all_obj = new BoxedFunction(boxRTFunction((void*)all, NULL, 1, false));
+    builtins_module->giveAttr("all", all_obj);
     chr_obj = new BoxedFunction(boxRTFunction((void*)chr, NULL, 1, false));
     builtins_module->giveAttr("chr", chr_obj);
     trap_obj = new BoxedFunction(boxRTFunction((void*)trap, NULL, 0, false));
@@ -259,7 +490,7 @@ void setupBuiltins() {
     addRTFunction(getattr_func, (void*)getattr3, NULL, 3, false);
     builtins_module->giveAttr("getattr", new BoxedFunction(getattr_func));
 
-    Box* isinstance_obj = new BoxedFunction(boxRTFunction((void*)isinstance, NULL, 2, false));
+    isinstance_obj = new BoxedFunction(boxRTFunction((void*)isinstance, NULL, 2, false));
     builtins_module->giveAttr("isinstance", isinstance_obj);
 
     builtins_module->giveAttr("sorted", new BoxedFunction(boxRTFunction((void*)sorted, NULL, 1, false)));
@@ -278,12 +509,14 @@ void setupBuiltins() {
 
     CLFunction *open = boxRTFunction((void*)open1, NULL, 1, false);
     addRTFunction(open, (void*)open2, NULL, 2, false);
+    addRTFunction(open, (void*)open3, NULL, 3, false);
     open_obj = new BoxedFunction(open);
     builtins_module->giveAttr("open", open_obj);
 
 
     builtins_module->setattr("str", str_cls, NULL, NULL);
     builtins_module->setattr("int", int_cls, NULL, NULL);
+    builtins_module->setattr("long", long_cls, NULL, NULL);
     builtins_module->setattr("float", float_cls, NULL, NULL);
     builtins_module->setattr("list", list_cls, NULL, NULL);
     builtins_module->setattr("slice", slice_cls, NULL, NULL);
@@ -291,8 +524,11 @@ void setupBuiltins() {
     builtins_module->setattr("file", file_cls, NULL, NULL);
     builtins_module->setattr("bool", bool_cls, NULL, NULL);
     builtins_module->setattr("dict", dict_cls, NULL, NULL);
+    builtins_module->setattr("set", set_cls, NULL, NULL);
     builtins_module->setattr("tuple", tuple_cls, NULL, NULL);
     builtins_module->setattr("instancemethod", instancemethod_cls, NULL, NULL);
+
+    setupExceptions();
 }
 
 }
@@ -22,6 +22,8 @@
 #include "runtime/util.h"
 #include "runtime/inline/boxing.h"
 
+#include "codegen/compvars.h"
+
 namespace pyston {
 
 BoxedModule* math_module;
@@ -38,21 +40,36 @@ static double _extractFloat(Box* b) {
         return static_cast<BoxedFloat*>(b)->d;
 }
 
-Box* mathSqrt(Box* b) {
-    double d = _extractFloat(b);
+// The unboxed versions get called directly from jitted code when the argument is already
+// known to be a float (see IRGenerator::evalUnboxedMathCall); the boxed ones handle everything else.
+extern "C" double mathSqrtFloat(double d) {
     if (d < 0) {
         fprintf(stderr, "ValueError: math domain error\n");
         raiseExc();
     }
 
-    double r = sqrt(d);
+    return sqrt(d);
+}
 
-    return boxFloat(r);
+Box* mathSqrt(Box* b) {
+    return boxFloat(mathSqrtFloat(_extractFloat(b)));
+}
+
+extern "C" double mathTanFloat(double d) {
+    return tan(d);
 }
 
 Box* mathTan(Box* b) {
-    double d = _extractFloat(b);
-    return boxFloat(tan(d));
+    return boxFloat(mathTanFloat(_extractFloat(b)));
+}
+
+static void _addFunc(const char* name, void* boxed_func, void* float_func) {
+    std::vector<ConcreteCompilerType*> v_f;
+    v_f.push_back(FLOAT);
+
+    CLFunction *cl = boxRTFunction(boxed_func, NULL, 1, false);
+    addRTFunction(cl, float_func, FLOAT, v_f, false);
+    math_module->giveAttr(name, new BoxedFunction(cl));
 }
 
 void setupMath() {
@@ -62,8 +79,8 @@ void setupMath() {
 
     math_module->giveAttr("pi", boxFloat(M_PI));
 
-    math_module->giveAttr("sqrt", new BoxedFunction(boxRTFunction((void*)mathSqrt, NULL, 1, false)));
-    math_module->giveAttr("tan", new BoxedFunction(boxRTFunction((void*)mathTan, NULL, 1, false)));
+    _addFunc("sqrt", (void*)mathSqrt, (void*)mathSqrtFloat);
+    _addFunc("tan", (void*)mathTan, (void*)mathTanFloat);
 }
 
 }
@@ -0,0 +1,106 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "core/threading.h"
+#include "core/types.h"
+
+#include "gc/collector.h"
+
+#include "runtime/gc_runtime.h"
+#include "runtime/types.h"
+#include "runtime/util.h"
+
+#include "codegen/irgen/hooks.h"
+
+namespace pyston {
+
+BoxedModule* os_module;
+
+static i64 _extractInt(Box* b) {
+    if (b->cls != int_cls) {
+        fprintf(stderr, "TypeError: an integer is required\n");
+        raiseExc();
+    }
+    return static_cast<BoxedInt*>(b)->n;
+}
+
+static void raiseOSError() __attribute__((__noreturn__));
+static void raiseOSError() {
+    fprintf(stderr, "OSError: [Errno %d] %s\n", errno, strerror(errno));
+    raiseExc();
+}
+
+// This is meant for prefork servers: warm the program up (so that the hot functions have gotten reoptimized), then
+// fork off the workers, which all share the parent's jitted code and heap pages until they write to them.
+// Collecting first means that the children don't each end up sweeping (and so copying) the parent's garbage;
+// the mark bits are in side tables, so marking doesn't dirty the shared pages either.
+Box* osFork() {
+    gc::runCollection();
+    // Otherwise anything that's still buffered would get written out by the parent and all the children:
+    fflush(NULL);
+
+    beforeFork();
+    threading::beforeFork();
+    pid_t pid = fork();
+    threading::afterFork(pid == 0);
+    afterFork(pid == 0);
+
+    if (pid == -1)
+        raiseOSError();
+    return boxInt(pid);
+}
+
+Box* osGetpid() {
+    return boxInt(getpid());
+}
+
+Box* osWaitpid(Box* pid, Box* options) {
+    int status;
+    pid_t rtn = waitpid(_extractInt(pid), &status, _extractInt(options));
+    if (rtn == -1)
+        raiseOSError();
+
+    Box* elts[] = {boxInt(rtn), boxInt(status)};
+    return BoxedTuple::create(2, elts);
+}
+
+Box* osWEXITSTATUS(Box* status) {
+    return boxInt(WEXITSTATUS(_extractInt(status)));
+}
+
+// Like cpython's, this skips all the usual process teardown, including flushing stdout.
+Box* os_Exit(Box* code) {
+    _exit(_extractInt(code));
+}
+
+void setupOs() {
+    std::string name("os");
+    std::string fn("__builtin__");
+    os_module = new BoxedModule(&name, &fn);
+
+    os_module->giveAttr("fork", new BoxedFunction(boxRTFunction((void*)osFork, NULL, 0, false)));
+    os_module->giveAttr("getpid", new BoxedFunction(boxRTFunction((void*)osGetpid, NULL, 0, false)));
+    os_module->giveAttr("waitpid", new BoxedFunction(boxRTFunction((void*)osWaitpid, NULL, 2, false)));
+    os_module->giveAttr("WEXITSTATUS", new BoxedFunction(boxRTFunction((void*)osWEXITSTATUS, NULL, 1, false)));
+    os_module->giveAttr("_exit", new BoxedFunction(boxRTFunction((void*)os_Exit, NULL, 1, false)));
+}
+
+}
@@ -0,0 +1,138 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/stats.h"
+#include "core/types.h"
+
+#include "codegen/profiling/line_profiler.h"
+#include "gc/collector.h"
+
+#include "runtime/gc_runtime.h"
+#include "runtime/heap_dump.h"
+#include "runtime/objmodel.h"
+#include "runtime/types.h"
+#include "runtime/util.h"
+
+namespace pyston {
+
+// Lets the program look at the same stats that get printed at exit with -s, while it's running.
+BoxedModule* pyston_stats_module;
+
+static const std::string &_extractStr(Box* b) {
+    if (b->cls != str_cls) {
+        fprintf(stderr, "TypeError: expected a string, %s found\n", getTypeName(b)->c_str());
+        raiseExc();
+    }
+    return static_cast<BoxedString*>(b)->s;
+}
+
+Box* pystonStatsGet(Box* name) {
+    const std::string &s = _extractStr(name);
+    for (auto &p : Stats::snapshot()) {
+        if (p.first == s)
+            return boxInt(p.second);
+    }
+
+    fprintf(stderr, "KeyError: '%s'\n", s.c_str());
+    raiseExc();
+}
+
+Box* pystonStatsSnapshot() {
+    BoxedDict* rtn = new BoxedDict();
+    for (auto &p : Stats::snapshot())
+        rtn->set(boxString(p.first), boxInt(p.second));
+    return rtn;
+}
+
+Box* pystonStatsExport(Box* dest, Box* interval_ms) {
+    if (interval_ms->cls != int_cls || static_cast<BoxedInt*>(interval_ms)->n <= 0) {
+        fprintf(stderr, "ValueError: the interval has to be a positive number of milliseconds\n");
+        raiseExc();
+    }
+    Stats::startPeriodicExport(_extractStr(dest), static_cast<BoxedInt*>(interval_ms)->n);
+    return None;
+}
+
+// line_profile_start(None) profiles every function, line_profile_start(["f", "g"]) just the ones named f or g:
+Box* pystonLineProfileStart(Box* names) {
+    std::vector<std::string> v;
+    if (names->cls == list_cls) {
+        BoxedList* l = static_cast<BoxedList*>(names);
+        for (int64_t i = 0; i < l->size; i++)
+            v.push_back(_extractStr(l->getElt(i)));
+        if (v.empty()) {
+            fprintf(stderr, "ValueError: no functions to profile\n");
+            raiseExc();
+        }
+    } else if (names != None) {
+        fprintf(stderr, "TypeError: expected a list of function names or None, %s found\n", getTypeName(names)->c_str());
+        raiseExc();
+    }
+    startLineProfiling(v);
+    return None;
+}
+
+Box* pystonLineProfileStop() {
+    stopLineProfiling();
+    return None;
+}
+
+// A list of (filename, function, lineno, hits, ns) tuples, hottest first:
+Box* pystonLineProfileReport() {
+    Box* rtn = new BoxedList();
+    for (const LineProfileResult &r : getLineProfile()) {
+        std::vector<Box*> elts;
+        elts.push_back(boxString(r.filename));
+        elts.push_back(boxString(r.function));
+        elts.push_back(boxInt(r.lineno));
+        elts.push_back(boxInt(r.count));
+        elts.push_back(boxInt(r.ns));
+        listAppendInternal(rtn, BoxedTuple::create(elts));
+    }
+    return rtn;
+}
+
+// Writes a heap dump for tools/heap_analyzer.py, and returns how many objects went into it:
+Box* pystonDumpHeap(Box* filename) {
+    long nobjs = dumpHeap(_extractStr(filename).c_str());
+    if (nobjs < 0) {
+        fprintf(stderr, "IOError: couldn't write the heap dump\n");
+        raiseExc();
+    }
+    return boxInt(nobjs);
+}
+
+// Gives the heap's empty blocks back to the OS right away, and returns how many bytes that freed up:
+Box* pystonTrimHeap() {
+    return boxInt(gc::trimHeap());
+}
+
+void setupPystonStats() {
+    std::string name("pyston_stats");
+    std::string fn("__builtin__");
+    pyston_stats_module = new BoxedModule(&name, &fn);
+
+    pyston_stats_module->giveAttr("get", new BoxedFunction(boxRTFunction((void*)pystonStatsGet, NULL, 1, false)));
+    pyston_stats_module->giveAttr("snapshot", new BoxedFunction(boxRTFunction((void*)pystonStatsSnapshot, NULL, 0, false)));
+    pyston_stats_module->giveAttr("export", new BoxedFunction(boxRTFunction((void*)pystonStatsExport, NULL, 2, false)));
+
+    pyston_stats_module->giveAttr("line_profile_start", new BoxedFunction(boxRTFunction((void*)pystonLineProfileStart, NULL, 1, false)));
+    pyston_stats_module->giveAttr("line_profile_stop", new BoxedFunction(boxRTFunction((void*)pystonLineProfileStop, NULL, 0, false)));
+    pyston_stats_module->giveAttr("line_profile_report", new BoxedFunction(boxRTFunction((void*)pystonLineProfileReport, NULL, 0, false)));
+
+    pyston_stats_module->giveAttr("dump_heap", new BoxedFunction(boxRTFunction((void*)pystonDumpHeap, NULL, 1, false)));
+    pyston_stats_module->giveAttr("trim_heap", new BoxedFunction(boxRTFunction((void*)pystonTrimHeap, NULL, 0, false)));
+}
+
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <cstdio>
+
+#include "core/threading.h"
+#include "core/types.h"
+
+#include "codegen/entry.h"
+
+#include "runtime/gc_runtime.h"
+#include "runtime/objmodel.h"
+#include "runtime/types.h"
+#include "runtime/util.h"
+
+namespace pyston {
+
+BoxedModule* thread_module;
+
+static Box* threadEntry(Box* func, Box* args) {
+    // Python threads use the main thread's llvm context, which is fine since only one of them runs at a time:
+    shareMainThreadCodegen();
+
+    BoxedTuple* t = static_cast<BoxedTuple*>(args);
+    int64_t nargs = t->nelts;
+    runtimeCall(func, nargs, nargs >= 1 ? t->elts[0] : NULL, nargs >= 2 ? t->elts[1] : NULL,
+            nargs >= 3 ? t->elts[2] : NULL, nargs >= 4 ? &t->elts[3] : NULL);
+    return None;
+}
+
+Box* startNewThread(Box* func, Box* args) {
+    if (args->cls != tuple_cls) {
+        fprintf(stderr, "TypeError: 2nd arg must be a tuple\n");
+        raiseExc();
+    }
+
+    intptr_t id = threading::startThread(threadEntry, func, args);
+    return boxInt(id);
+}
+
+void setupThread() {
+    std::string name("thread");
+    std::string fn("__builtin__");
+    thread_module = new BoxedModule(&name, &fn);
+
+    thread_module->giveAttr("start_new_thread", new BoxedFunction(boxRTFunction((void*)startNewThread, NULL, 2, false)));
+}
+
+}
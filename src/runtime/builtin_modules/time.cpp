@@ -12,23 +12,157 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
+#include <unistd.h>
 
+#include "core/threading.h"
 #include "core/types.h"
 
+#include "codegen/compvars.h"
+
 #include "runtime/gc_runtime.h"
+#include "runtime/objmodel.h"
 #include "runtime/types.h"
+#include "runtime/util.h"
 
 namespace pyston {
 
 BoxedModule* time_module;
 
+// The unboxed versions of the timers (and of hwcounter_read) get called directly from jitted code, so
+// that timing a region doesn't allocate (see IRGenerator::evalUnboxedTimeCall).  clock_gettime goes
+// through the vDSO, so none of these enter the kernel either.
+static double clockSeconds(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+extern "C" double timeTimeFloat() {
+    return clockSeconds(CLOCK_REALTIME);
+}
+
 Box* timeTime() {
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    double t = now.tv_sec + .000001 * now.tv_usec;
-    return boxFloat(t);
+    return boxFloat(timeTimeFloat());
+}
+
+extern "C" double timeMonotonicFloat() {
+    return clockSeconds(CLOCK_MONOTONIC);
+}
+
+Box* timeMonotonic() {
+    return boxFloat(timeMonotonicFloat());
+}
+
+// Hardware counters, through perf_event_open: hwcounter_open(name) starts counting one event for the
+// calling thread (in user space only, so that it works without any extra privileges) and returns a
+// handle for hwcounter_read and hwcounter_close.
+struct HWCounterKind {
+    const char* name;
+    uint64_t config;
+};
+static const HWCounterKind hwcounter_kinds[] = {
+    {"cycles", PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache_references", PERF_COUNT_HW_CACHE_REFERENCES},
+    {"cache_misses", PERF_COUNT_HW_CACHE_MISSES},
+    {"branches", PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+    {"branch_misses", PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+Box* timeHWCounterOpen(Box* name) {
+    if (name->cls != str_cls) {
+        fprintf(stderr, "TypeError: hwcounter_open() argument must be string, not %s\n", getTypeName(name)->c_str());
+        raiseExc();
+    }
+    const std::string &s = static_cast<BoxedString*>(name)->s;
+
+    const HWCounterKind* kind = NULL;
+    for (const HWCounterKind &k : hwcounter_kinds) {
+        if (s == k.name)
+            kind = &k;
+    }
+    if (!kind) {
+        fprintf(stderr, "ValueError: unknown hardware counter '%s'\n", s.c_str());
+        raiseExc();
+    }
+
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = kind->config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    int fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0) {
+        fprintf(stderr, "OSError: [Errno %d] %s\n", errno, strerror(errno));
+        raiseExc();
+    }
+    return boxInt(fd);
+}
+
+extern "C" i64 timeHWCounterReadInt(i64 fd) {
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+        fprintf(stderr, "OSError: [Errno %d] %s\n", errno, strerror(errno));
+        raiseExc();
+    }
+    return count;
+}
+
+Box* timeHWCounterRead(Box* fd) {
+    if (fd->cls != int_cls) {
+        fprintf(stderr, "TypeError: an integer is required\n");
+        raiseExc();
+    }
+    return boxInt(timeHWCounterReadInt(static_cast<BoxedInt*>(fd)->n));
+}
+
+Box* timeHWCounterClose(Box* fd) {
+    if (fd->cls != int_cls) {
+        fprintf(stderr, "TypeError: an integer is required\n");
+        raiseExc();
+    }
+    close(static_cast<BoxedInt*>(fd)->n);
+    return None;
+}
+
+Box* timeSleep(Box* arg) {
+    double secs;
+    if (arg->cls == int_cls)
+        secs = static_cast<BoxedInt*>(arg)->n;
+    else if (arg->cls == float_cls)
+        secs = static_cast<BoxedFloat*>(arg)->d;
+    else {
+        fprintf(stderr, "TypeError: a float is required\n");
+        raiseExc();
+    }
+
+    if (secs < 0) {
+        fprintf(stderr, "IOError: [Errno 22] Invalid argument\n");
+        raiseExc();
+    }
+
+    double fullsecs;
+    double nanosecs = modf(secs, &fullsecs) * 1e9;
+    timespec req;
+    req.tv_sec = (time_t)fullsecs;
+    req.tv_nsec = (long)nanosecs;
+
+    {
+        threading::GLAllowThreadsRegion _allow;
+        while (nanosleep(&req, &req) == -1 && errno == EINTR) {
+        }
+    }
+    return None;
 }
 
 void setupTime() {
@@ -36,7 +170,26 @@ void setupTime() {
     std::string fn("__builtin__");
     time_module = new BoxedModule(&name, &fn);
 
-    time_module->giveAttr("time", new BoxedFunction(boxRTFunction((void*)timeTime, NULL, 0, false)));
+    std::vector<ConcreteCompilerType*> no_args;
+    CLFunction *time_cl = boxRTFunction((void*)timeTime, NULL, 0, false);
+    addRTFunction(time_cl, (void*)timeTimeFloat, FLOAT, no_args, false);
+    time_module->giveAttr("time", new BoxedFunction(time_cl));
+    time_module->giveAttr("sleep", new BoxedFunction(boxRTFunction((void*)timeSleep, NULL, 1, false)));
+
+    // There's only the one clock, so these are the same function, like they are in CPython 3 on linux:
+    CLFunction *monotonic_cl = boxRTFunction((void*)timeMonotonic, NULL, 0, false);
+    addRTFunction(monotonic_cl, (void*)timeMonotonicFloat, FLOAT, no_args, false);
+    Box* monotonic = new BoxedFunction(monotonic_cl);
+    time_module->giveAttr("monotonic", monotonic);
+    time_module->giveAttr("perf_counter", monotonic);
+
+    std::vector<ConcreteCompilerType*> v_i;
+    v_i.push_back(INT);
+    time_module->giveAttr("hwcounter_open", new BoxedFunction(boxRTFunction((void*)timeHWCounterOpen, NULL, 1, false)));
+    CLFunction *read_cl = boxRTFunction((void*)timeHWCounterRead, NULL, 1, false);
+    addRTFunction(read_cl, (void*)timeHWCounterReadInt, INT, v_i, false);
+    time_module->giveAttr("hwcounter_read", new BoxedFunction(read_cl));
+    time_module->giveAttr("hwcounter_close", new BoxedFunction(boxRTFunction((void*)timeHWCounterClose, NULL, 1, false)));
 }
 
 }
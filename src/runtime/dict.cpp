@@ -12,47 +12,158 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cstring>
+
 #include "core/common.h"
 #include "core/stats.h"
 #include "core/types.h"
 
+#include "runtime/dict.h"
 #include "runtime/gc_runtime.h"
 #include "runtime/objmodel.h"
 #include "runtime/types.h"
 #include "runtime/util.h"
 
+#include "codegen/compvars.h"
+
+#include "gc/collector.h"
+
 namespace pyston {
 
+// Returns the index slot for the key: either the one pointing to its entry, or the empty one
+// where it would go.
+static int64_t* findSlot(BoxedDict* self, Box* k, size_t hash) {
+    assert(self->index_size > 0);
+    size_t mask = self->index_size - 1;
+    size_t i = hash & mask;
+    size_t perturb = hash;
+    while (true) {
+        int64_t* slot = &self->index->index[i];
+        if (*slot == BoxedDict::EMPTY)
+            return slot;
+
+        BoxedDict::Entry &e = self->entries->entries[*slot];
+        if (e.hash == hash && PyEq()(e.key, k))
+            return slot;
+
+        // Same probe sequence as CPython, so that runs of consecutive int keys don't pile up:
+        perturb >>= 5;
+        i = (i * 5 + 1 + perturb) & mask;
+    }
+}
+
+static inline int64_t* findSlotFor(BoxedDict* self, Box* k, size_t hash) {
+    if (self->str_keys_only && k->cls == str_cls)
+        return findStrSlot(self, static_cast<BoxedString*>(k), hash);
+    return findSlot(self, k, hash);
+}
+
+static void rebuildIndex(BoxedDict* self, int64_t new_index_size) {
+    BoxedDict::IndexArray* new_index = new (new_index_size) BoxedDict::IndexArray();
+    for (int64_t i = 0; i < new_index_size; i++)
+        new_index->index[i] = BoxedDict::EMPTY;
+
+    size_t mask = new_index_size - 1;
+    for (int64_t j = 0; j < self->size; j++) {
+        size_t hash = self->entries->entries[j].hash;
+        size_t i = hash & mask;
+        size_t perturb = hash;
+        while (new_index->index[i] != BoxedDict::EMPTY) {
+            perturb >>= 5;
+            i = (i * 5 + 1 + perturb) & mask;
+        }
+        new_index->index[i] = j;
+    }
+
+    self->index = new_index;
+    self->index_size = new_index_size;
+    gc::writeBarrier(self, new_index);
+}
+
+Box* BoxedDict::getOrNull(Box* k) {
+    if (size == 0)
+        return NULL;
+
+    int64_t* slot = findSlotFor(this, k, PyHasher()(k));
+    if (*slot == EMPTY)
+        return NULL;
+    return entries->entries[*slot].value;
+}
+
+void BoxedDict::set(Box* k, Box* v) {
+    size_t hash = PyHasher()(k);
+
+    if (index_size == 0)
+        rebuildIndex(this, 8);
+
+    int64_t* slot = findSlotFor(this, k, hash);
+    if (*slot != EMPTY) {
+        entries->entries[*slot].value = v;
+        gc::writeBarrier(this, v);
+        return;
+    }
+
+    // Keep the index at most 2/3 full:
+    if ((size + 1) * 3 > index_size * 2) {
+        rebuildIndex(this, index_size * 4);
+        slot = findSlotFor(this, k, hash);
+        assert(*slot == EMPTY);
+    }
+
+    if (str_keys_only && k->cls != str_cls) {
+        static StatCounter sc("num_dicts_with_nonstr_keys");
+        sc.log();
+        str_keys_only = false;
+    }
+
+    if (size == entries_capacity) {
+        int64_t new_capacity = std::max(entries_capacity * 2, (int64_t)8);
+        if (entries)
+            entries = (EntryArray*)rt_realloc(entries, new_capacity * sizeof(Entry) + sizeof(EntryArray));
+        else
+            entries = new (new_capacity) EntryArray();
+        entries_capacity = new_capacity;
+        gc::writeBarrier(this, entries);
+    }
+
+    Entry &e = entries->entries[size];
+    e.hash = hash;
+    e.key = k;
+    e.value = v;
+    *slot = size;
+    size++;
+    gc::writeBarrier(this, k);
+    gc::writeBarrier(this, v);
+}
+
 Box* dictRepr(BoxedDict* self) {
-    std::vector<char> chars;
-    chars.push_back('{');
+    StringBuilder sb;
+    sb.append('{');
     bool first = true;
-    for (BoxedDict::PyDict::iterator it = self->d.begin(), end = self->d.end(); it != end; ++it) {
-        if (!first) {
-            chars.push_back(',');
-            chars.push_back(' ');
-        }
+    for (BoxedDict::Entry* it = self->begin(), *end = self->end(); it != end; ++it) {
+        if (!first)
+            sb.append(", ", 2);
         first = false;
 
-        BoxedString *k = repr(it->first);
-        BoxedString *v = repr(it->second);
-        chars.insert(chars.end(), k->s.begin(), k->s.end());
-        chars.push_back(':');
-        chars.push_back(' ');
-        chars.insert(chars.end(), v->s.begin(), v->s.end());
+        BoxedString *k = repr(it->key);
+        BoxedString *v = repr(it->value);
+        sb.append(k->s);
+        sb.append(": ", 2);
+        sb.append(v->s);
     }
-    chars.push_back('}');
-    return boxString(std::string(chars.begin(), chars.end()));
+    sb.append('}');
+    return sb.finish();
 }
 
 Box* dictItems(BoxedDict* self) {
     BoxedList* rtn = new BoxedList();
 
-    for (BoxedDict::PyDict::const_iterator it = self->d.begin(), end = self->d.end(); it != end; ++it) {
+    for (BoxedDict::Entry* it = self->begin(), *end = self->end(); it != end; ++it) {
         std::vector<Box*> elts;
-        elts.push_back(it->first);
-        elts.push_back(it->second);
-        BoxedTuple *t = new BoxedTuple(elts);
+        elts.push_back(it->key);
+        elts.push_back(it->value);
+        BoxedTuple *t = BoxedTuple::create(elts);
         listAppendInternal(rtn, t);
     }
 
@@ -61,55 +172,145 @@ Box* dictItems(BoxedDict* self) {
 
 Box* dictValues(BoxedDict* self) {
     BoxedList* rtn = new BoxedList();
-    for (BoxedDict::PyDict::const_iterator it = self->d.begin(), end = self->d.end(); it != end; ++it) {
-        listAppendInternal(rtn, it->second);
+    for (BoxedDict::Entry* it = self->begin(), *end = self->end(); it != end; ++it) {
+        listAppendInternal(rtn, it->value);
     }
     return rtn;
 }
 
 Box* dictKeys(BoxedDict* self) {
     BoxedList* rtn = new BoxedList();
-    for (BoxedDict::PyDict::const_iterator it = self->d.begin(), end = self->d.end(); it != end; ++it) {
-        listAppendInternal(rtn, it->first);
+    for (BoxedDict::Entry* it = self->begin(), *end = self->end(); it != end; ++it) {
+        listAppendInternal(rtn, it->key);
     }
     return rtn;
 }
 
-Box* dictGetitem(BoxedDict* self, Box* k) {
-    Box* &pos = self->d[k];
+BoxedClass *dict_iterator_cls = NULL;
+
+// Walks the entry array in place, so iterating doesn't have to build a list (and, for keys and
+// values, doesn't allocate anything per element).  Like CPython, changing the dict's size during
+// the iteration is an error, which the iterator notices by remembering the size it started with.
+class BoxedDictIterator : public Box {
+    public:
+        enum IteratorType { KEYS, VALUES, ITEMS };
+
+        BoxedDict* const d;
+        int64_t pos;
+        const int64_t orig_size;
+        const IteratorType type;
+
+        BoxedDictIterator(BoxedDict* d, IteratorType type);
+};
+
+extern "C" void dictIteratorGCHandler(GCVisitor *v, void* p) {
+    boxGCHandler(v, p);
+    BoxedDictIterator *it = (BoxedDictIterator*)p;
+    v->visit(it->d);
+}
+
+extern "C" const ObjectFlavor dict_iterator_flavor(&dictIteratorGCHandler, NULL);
+
+BoxedDictIterator::BoxedDictIterator(BoxedDict* d, IteratorType type) : Box(&dict_iterator_flavor, dict_iterator_cls), d(d), pos(0), orig_size(d->size), type(type) {
+}
 
-    if (pos == NULL) {
+static void checkDictSize(BoxedDictIterator* self) {
+    if (self->d->size != self->orig_size) {
+        fprintf(stderr, "RuntimeError: dictionary changed size during iteration\n");
+        raiseExc();
+    }
+}
+
+void dictiterDtor(BoxedDictIterator *self) {
+}
+
+Box* dictIterKeys(BoxedDict* self) {
+    return new BoxedDictIterator(self, BoxedDictIterator::KEYS);
+}
+
+Box* dictIterValues(BoxedDict* self) {
+    return new BoxedDictIterator(self, BoxedDictIterator::VALUES);
+}
+
+Box* dictIterItems(BoxedDict* self) {
+    return new BoxedDictIterator(self, BoxedDictIterator::ITEMS);
+}
+
+i1 dictiterHasnextUnboxed(Box* s) {
+    assert(s->cls == dict_iterator_cls);
+    BoxedDictIterator* self = static_cast<BoxedDictIterator*>(s);
+
+    // (a changed size counts as there being more, so that the next() reports it)
+    return self->pos < self->d->size || self->d->size != self->orig_size;
+}
+
+Box* dictiterHasnext(Box* s) {
+    return boxBool(dictiterHasnextUnboxed(s));
+}
+
+Box* dictiterNext(Box* s) {
+    assert(s->cls == dict_iterator_cls);
+    BoxedDictIterator* self = static_cast<BoxedDictIterator*>(s);
+
+    checkDictSize(self);
+    assert(self->pos >= 0 && self->pos < self->d->size);
+    BoxedDict::Entry &e = self->d->entries->entries[self->pos];
+    self->pos++;
+
+    switch (self->type) {
+        case BoxedDictIterator::KEYS:
+            return e.key;
+        case BoxedDictIterator::VALUES:
+            return e.value;
+        case BoxedDictIterator::ITEMS: {
+            Box* elts[] = { e.key, e.value };
+            return BoxedTuple::create(2, elts);
+        }
+    }
+    abort();
+}
+
+Box* dictiterNextOrEnd(Box* s) {
+    assert(s->cls == dict_iterator_cls);
+    BoxedDictIterator* self = static_cast<BoxedDictIterator*>(s);
+
+    checkDictSize(self);
+    if (self->pos >= self->d->size)
+        return NULL;
+    return dictiterNext(s);
+}
+
+extern "C" Box* dictGetitemSlowpath(BoxedDict* self, Box* k) {
+    Box* rtn = self->getOrNull(k);
+
+    if (rtn == NULL) {
         BoxedString *s = repr(k);
         fprintf(stderr, "KeyError: %s\n", s->s.c_str());
         raiseExc();
     }
 
-    return pos;
+    return rtn;
 }
 
-Box* dictSetitem(BoxedDict* self, Box* k, Box* v) {
-    //printf("Starting setitem\n");
-    Box* &pos = self->d[k];
-    //printf("Got the pos\n");
-
-    if (pos != NULL) {
-        pos = v;
-    } else {
-        pos = v;
-    }
+Box* dictContains(BoxedDict* self, Box* k) {
+    return boxBool(self->getOrNull(k) != NULL);
+}
 
+Box* dictSetitem(BoxedDict* self, Box* k, Box* v) {
+    self->set(k, v);
     return None;
 }
 
 void dict_dtor(BoxedDict* self) {
-    self->d.clear();
-
-    // Not sure how to express this without the typedef:
-    typedef BoxedDict::PyDict T;
-    (&self->d)->~T();
+    if (self->entries)
+        rt_free(self->entries);
+    if (self->index)
+        rt_free(self->index);
 }
 
 void setupDict() {
+    dict_iterator_cls = new BoxedClass(&dict_iterator_flavor, false, (BoxedClass::Dtor)dictiterDtor);
+
     dict_cls->giveAttr("__name__", boxStrConstant("dict"));
     //dict_cls->giveAttr("__len__", new BoxedFunction(boxRTFunction((void*)dictLen, NULL, 1, false)));
     //dict_cls->giveAttr("__getitem__", new BoxedFunction(boxRTFunction((void*)dictGetitem, NULL, 2, false)));
@@ -119,18 +320,34 @@ void setupDict() {
     dict_cls->setattr("__str__", dict_cls->peekattr("__repr__"), NULL, NULL);
 
     dict_cls->giveAttr("items", new BoxedFunction(boxRTFunction((void*)dictItems, NULL, 1, false)));
-    dict_cls->setattr("iteritems", dict_cls->peekattr("items"), NULL, NULL);
+    dict_cls->giveAttr("iteritems", new BoxedFunction(boxRTFunction((void*)dictIterItems, typeFromClass(dict_iterator_cls), 1, false)));
 
     dict_cls->giveAttr("values", new BoxedFunction(boxRTFunction((void*)dictValues, NULL, 1, false)));
-    dict_cls->setattr("itervalues", dict_cls->peekattr("values"), NULL, NULL);
+    dict_cls->giveAttr("itervalues", new BoxedFunction(boxRTFunction((void*)dictIterValues, typeFromClass(dict_iterator_cls), 1, false)));
 
     dict_cls->giveAttr("keys", new BoxedFunction(boxRTFunction((void*)dictKeys, NULL, 1, false)));
-    dict_cls->setattr("iterkeys", dict_cls->peekattr("keys"), NULL, NULL);
+    dict_cls->giveAttr("iterkeys", new BoxedFunction(boxRTFunction((void*)dictIterKeys, typeFromClass(dict_iterator_cls), 1, false)));
+    dict_cls->setattr("__iter__", dict_cls->peekattr("iterkeys"), NULL, NULL);
 
     dict_cls->giveAttr("__getitem__", new BoxedFunction(boxRTFunction((void*)dictGetitem, NULL, 2, false)));
     dict_cls->giveAttr("__setitem__", new BoxedFunction(boxRTFunction((void*)dictSetitem, NULL, 3, false)));
+    dict_cls->giveAttr("__contains__", new BoxedFunction(boxRTFunction((void*)dictContains, BOXED_BOOL, 2, false)));
 
     dict_cls->freeze();
+
+    registerContainsImpl(dict_cls, (void*)dictContains);
+
+
+    gc::registerStaticRootObj(dict_iterator_cls);
+    dict_iterator_cls->giveAttr("__name__", boxStrConstant("dictionary-iterator"));
+
+    CLFunction *hasnext = boxRTFunction((void*)dictiterHasnextUnboxed, BOOL, 1, false);
+    addRTFunction(hasnext, (void*)dictiterHasnext, BOXED_BOOL, 1, false);
+    dict_iterator_cls->giveAttr("__hasnext__", new BoxedFunction(hasnext));
+    dict_iterator_cls->giveAttr("next", new BoxedFunction(boxRTFunction((void*)dictiterNext, UNKNOWN, 1, false)));
+    dict_iterator_cls->iter_next = dictiterNextOrEnd;
+
+    dict_iterator_cls->freeze();
 }
 
 void teardownDict() {
@@ -0,0 +1,66 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_RUNTIME_DICT_H
+#define PYSTON_RUNTIME_DICT_H
+
+#include <cstring>
+
+#include "runtime/types.h"
+
+namespace pyston {
+
+// These are in here (rather than in dict.cpp) so that the lookup in inline/dict.cpp's dictGetitem can use them.
+
+inline bool strKeysEqual(BoxedString* a, BoxedString* b) {
+    // Interned strings are equal only if they're the same object:
+    if (a->interned && b->interned)
+        return false;
+    size_t len = a->s.size();
+    return len == b->s.size() && memcmp(a->s.data(), b->s.data(), len) == 0;
+}
+
+// Returns the index slot for the key, for when every key in the dict is a str and so is k: either the one
+// pointing to its entry, or the empty one where it would go.  The hashes are already in the entries, so most
+// mismatches don't even need to look at the other string.
+inline int64_t* findStrSlot(BoxedDict* self, BoxedString* k, size_t hash) {
+    assert(self->index_size > 0);
+    size_t mask = self->index_size - 1;
+    size_t i = hash & mask;
+    size_t perturb = hash;
+    while (true) {
+        int64_t* slot = &self->index->index[i];
+        if (*slot == BoxedDict::EMPTY)
+            return slot;
+
+        BoxedDict::Entry &e = self->entries->entries[*slot];
+        if (e.key == k)
+            return slot;
+        if (e.hash == hash && strKeysEqual(static_cast<BoxedString*>(e.key), k))
+            return slot;
+
+        // Same probe sequence as CPython (and findSlot):
+        perturb >>= 5;
+        i = (i * 5 + 1 + perturb) & mask;
+    }
+}
+
+// Finding a str key in a dict that only has str keys happens in the inline section, so that it can get
+// inlined into jitted code; everything else (including raising the KeyError) is in dictGetitemSlowpath.
+extern "C" Box* dictGetitem(Box* self, Box* k);
+extern "C" Box* dictGetitemSlowpath(BoxedDict* self, Box* k);
+
+}
+
+#endif
@@ -0,0 +1,502 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "core/common.h"
+
+#include "runtime/dtoa.h"
+
+namespace pyston {
+
+// Grisu2, from Florian Loitsch's "Printing Floating-Point Numbers Quickly and Accurately with
+// Integers" (PLDI 2010); this follows the shape of the implementation in rapidjson.
+// It always produces digits that round-trip, and almost always the shortest such digits.
+
+namespace {
+
+const int DP_SIGNIFICAND_SIZE = 52;
+const int DP_EXPONENT_BIAS = 0x3FF + DP_SIGNIFICAND_SIZE;
+const int DP_MIN_EXPONENT = -DP_EXPONENT_BIAS;
+const uint64_t DP_EXPONENT_MASK = 0x7FF0000000000000ULL;
+const uint64_t DP_SIGNIFICAND_MASK = 0x000FFFFFFFFFFFFFULL;
+const uint64_t DP_HIDDEN_BIT = 0x0010000000000000ULL;
+
+// A floating point number f * 2^e with a 64-bit significand ("do-it-yourself floating point")
+struct DiyFp {
+    uint64_t f;
+    int e;
+
+    DiyFp() {}
+    DiyFp(uint64_t f, int e) : f(f), e(e) {}
+
+    explicit DiyFp(double d) {
+        uint64_t u;
+        memcpy(&u, &d, sizeof(u));
+        int biased_e = (u & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE;
+        uint64_t significand = u & DP_SIGNIFICAND_MASK;
+        if (biased_e != 0) {
+            f = significand + DP_HIDDEN_BIT;
+            e = biased_e - DP_EXPONENT_BIAS;
+        } else {
+            f = significand;
+            e = DP_MIN_EXPONENT + 1;
+        }
+    }
+
+    DiyFp operator-(const DiyFp &rhs) const {
+        return DiyFp(f - rhs.f, e);
+    }
+
+    DiyFp operator*(const DiyFp &rhs) const {
+        unsigned __int128 p = (unsigned __int128)f * rhs.f;
+        uint64_t h = p >> 64;
+        uint64_t l = (uint64_t)p;
+        // round
+        if (l & (1ULL << 63))
+            h++;
+        return DiyFp(h, e + rhs.e + 64);
+    }
+
+    DiyFp normalize() const {
+        int s = __builtin_clzll(f);
+        return DiyFp(f << s, e - s);
+    }
+
+    DiyFp normalizeBoundary() const {
+        DiyFp rtn = *this;
+        while (!(rtn.f & (DP_HIDDEN_BIT << 1))) {
+            rtn.f <<= 1;
+            rtn.e--;
+        }
+        const int shift = 64 - DP_SIGNIFICAND_SIZE - 2;
+        rtn.f <<= shift;
+        rtn.e -= shift;
+        return rtn;
+    }
+
+    // The boundaries halfway to the neighboring doubles, with the same exponent:
+    void normalizedBoundaries(DiyFp* minus, DiyFp* plus) const {
+        DiyFp pl = DiyFp((f << 1) + 1, e - 1).normalizeBoundary();
+        // The gap below a power of two is half as big:
+        DiyFp mi = (f == DP_HIDDEN_BIT) ? DiyFp((f << 2) - 1, e - 2) : DiyFp((f << 1) - 1, e - 1);
+        mi.f <<= mi.e - pl.e;
+        mi.e = pl.e;
+        *plus = pl;
+        *minus = mi;
+    }
+};
+
+// Normalized 10^k for k = -348, -340, ..., 340
+const struct { uint64_t f; int e; } CACHED_POWERS[] = {
+    { 0xfa8fd5a0081c0288ULL, -1220 },  // 1e-348
+    { 0xbaaee17fa23ebf76ULL, -1193 },  // 1e-340
+    { 0x8b16fb203055ac76ULL, -1166 },  // 1e-332
+    { 0xcf42894a5dce35eaULL, -1140 },  // 1e-324
+    { 0x9a6bb0aa55653b2dULL, -1113 },  // 1e-316
+    { 0xe61acf033d1a45dfULL, -1087 },  // 1e-308
+    { 0xab70fe17c79ac6caULL, -1060 },  // 1e-300
+    { 0xff77b1fcbebcdc4fULL, -1034 },  // 1e-292
+    { 0xbe5691ef416bd60cULL, -1007 },  // 1e-284
+    { 0x8dd01fad907ffc3cULL, -980 },  // 1e-276
+    { 0xd3515c2831559a83ULL, -954 },  // 1e-268
+    { 0x9d71ac8fada6c9b5ULL, -927 },  // 1e-260
+    { 0xea9c227723ee8bcbULL, -901 },  // 1e-252
+    { 0xaecc49914078536dULL, -874 },  // 1e-244
+    { 0x823c12795db6ce57ULL, -847 },  // 1e-236
+    { 0xc21094364dfb5637ULL, -821 },  // 1e-228
+    { 0x9096ea6f3848984fULL, -794 },  // 1e-220
+    { 0xd77485cb25823ac7ULL, -768 },  // 1e-212
+    { 0xa086cfcd97bf97f4ULL, -741 },  // 1e-204
+    { 0xef340a98172aace5ULL, -715 },  // 1e-196
+    { 0xb23867fb2a35b28eULL, -688 },  // 1e-188
+    { 0x84c8d4dfd2c63f3bULL, -661 },  // 1e-180
+    { 0xc5dd44271ad3cdbaULL, -635 },  // 1e-172
+    { 0x936b9fcebb25c996ULL, -608 },  // 1e-164
+    { 0xdbac6c247d62a584ULL, -582 },  // 1e-156
+    { 0xa3ab66580d5fdaf6ULL, -555 },  // 1e-148
+    { 0xf3e2f893dec3f126ULL, -529 },  // 1e-140
+    { 0xb5b5ada8aaff80b8ULL, -502 },  // 1e-132
+    { 0x87625f056c7c4a8bULL, -475 },  // 1e-124
+    { 0xc9bcff6034c13053ULL, -449 },  // 1e-116
+    { 0x964e858c91ba2655ULL, -422 },  // 1e-108
+    { 0xdff9772470297ebdULL, -396 },  // 1e-100
+    { 0xa6dfbd9fb8e5b88fULL, -369 },  // 1e-92
+    { 0xf8a95fcf88747d94ULL, -343 },  // 1e-84
+    { 0xb94470938fa89bcfULL, -316 },  // 1e-76
+    { 0x8a08f0f8bf0f156bULL, -289 },  // 1e-68
+    { 0xcdb02555653131b6ULL, -263 },  // 1e-60
+    { 0x993fe2c6d07b7facULL, -236 },  // 1e-52
+    { 0xe45c10c42a2b3b06ULL, -210 },  // 1e-44
+    { 0xaa242499697392d3ULL, -183 },  // 1e-36
+    { 0xfd87b5f28300ca0eULL, -157 },  // 1e-28
+    { 0xbce5086492111aebULL, -130 },  // 1e-20
+    { 0x8cbccc096f5088ccULL, -103 },  // 1e-12
+    { 0xd1b71758e219652cULL, -77 },  // 1e-4
+    { 0x9c40000000000000ULL, -50 },  // 1e4
+    { 0xe8d4a51000000000ULL, -24 },  // 1e12
+    { 0xad78ebc5ac620000ULL, 3 },  // 1e20
+    { 0x813f3978f8940984ULL, 30 },  // 1e28
+    { 0xc097ce7bc90715b3ULL, 56 },  // 1e36
+    { 0x8f7e32ce7bea5c70ULL, 83 },  // 1e44
+    { 0xd5d238a4abe98068ULL, 109 },  // 1e52
+    { 0x9f4f2726179a2245ULL, 136 },  // 1e60
+    { 0xed63a231d4c4fb27ULL, 162 },  // 1e68
+    { 0xb0de65388cc8ada8ULL, 189 },  // 1e76
+    { 0x83c7088e1aab65dbULL, 216 },  // 1e84
+    { 0xc45d1df942711d9aULL, 242 },  // 1e92
+    { 0x924d692ca61be758ULL, 269 },  // 1e100
+    { 0xda01ee641a708deaULL, 295 },  // 1e108
+    { 0xa26da3999aef774aULL, 322 },  // 1e116
+    { 0xf209787bb47d6b85ULL, 348 },  // 1e124
+    { 0xb454e4a179dd1877ULL, 375 },  // 1e132
+    { 0x865b86925b9bc5c2ULL, 402 },  // 1e140
+    { 0xc83553c5c8965d3dULL, 428 },  // 1e148
+    { 0x952ab45cfa97a0b3ULL, 455 },  // 1e156
+    { 0xde469fbd99a05fe3ULL, 481 },  // 1e164
+    { 0xa59bc234db398c25ULL, 508 },  // 1e172
+    { 0xf6c69a72a3989f5cULL, 534 },  // 1e180
+    { 0xb7dcbf5354e9beceULL, 561 },  // 1e188
+    { 0x88fcf317f22241e2ULL, 588 },  // 1e196
+    { 0xcc20ce9bd35c78a5ULL, 614 },  // 1e204
+    { 0x98165af37b2153dfULL, 641 },  // 1e212
+    { 0xe2a0b5dc971f303aULL, 667 },  // 1e220
+    { 0xa8d9d1535ce3b396ULL, 694 },  // 1e228
+    { 0xfb9b7cd9a4a7443cULL, 720 },  // 1e236
+    { 0xbb764c4ca7a44410ULL, 747 },  // 1e244
+    { 0x8bab8eefb6409c1aULL, 774 },  // 1e252
+    { 0xd01fef10a657842cULL, 800 },  // 1e260
+    { 0x9b10a4e5e9913129ULL, 827 },  // 1e268
+    { 0xe7109bfba19c0c9dULL, 853 },  // 1e276
+    { 0xac2820d9623bf429ULL, 880 },  // 1e284
+    { 0x80444b5e7aa7cf85ULL, 907 },  // 1e292
+    { 0xbf21e44003acdd2dULL, 933 },  // 1e300
+    { 0x8e679c2f5e44ff8fULL, 960 },  // 1e308
+    { 0xd433179d9c8cb841ULL, 986 },  // 1e316
+    { 0x9e19db92b4e31ba9ULL, 1013 },  // 1e324
+    { 0xeb96bf6ebadf77d9ULL, 1039 },  // 1e332
+    { 0xaf87023b9bf0ee6bULL, 1066 },  // 1e340
+};
+
+const uint64_t POW10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL,
+};
+
+// Returns a cached power c = 10^-K such that multiplying by it brings a number with binary
+// exponent e into the range that digit generation wants.
+DiyFp getCachedPower(int e, int* K) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347; // 1/log2(10)
+    int k = (int)dk;
+    if (dk - k > 0.0)
+        k++;
+
+    unsigned index = (unsigned)((k >> 3) + 1);
+    *K = -(-348 + (int)(index << 3));
+    assert(index < sizeof(CACHED_POWERS) / sizeof(CACHED_POWERS[0]));
+    return DiyFp(CACHED_POWERS[index].f, CACHED_POWERS[index].e);
+}
+
+void grisuRound(char* buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa && (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buf[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+int countDecimalDigits(uint32_t n) {
+    int d = 1;
+    while (d < 10 && n >= POW10[d])
+        d++;
+    return d;
+}
+
+void digitGen(const DiyFp &W, const DiyFp &Mp, uint64_t delta, char* buf, int* len, int* K) {
+    const DiyFp one(1ULL << -Mp.e, Mp.e);
+    const DiyFp wp_w = Mp - W;
+    uint32_t p1 = (uint32_t)(Mp.f >> -one.e);
+    uint64_t p2 = Mp.f & (one.f - 1);
+    int kappa = countDecimalDigits(p1);
+    *len = 0;
+
+    // The integer part:
+    while (kappa > 0) {
+        uint32_t d = p1 / POW10[kappa - 1];
+        p1 %= POW10[kappa - 1];
+        if (d || *len)
+            buf[(*len)++] = '0' + d;
+        kappa--;
+
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *K += kappa;
+            grisuRound(buf, *len, delta, rest, POW10[kappa] << -one.e, wp_w.f);
+            return;
+        }
+    }
+
+    // The fractional part:
+    while (true) {
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)(p2 >> -one.e);
+        if (d || *len)
+            buf[(*len)++] = '0' + d;
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *K += kappa;
+            int index = -kappa;
+            grisuRound(buf, *len, delta, p2, one.f, wp_w.f * (index < 20 ? POW10[index] : 0));
+            return;
+        }
+    }
+}
+
+}
+
+int doubleToShortestDigits(double d, char* buf, int* decpt) {
+    assert(d > 0 && std::isfinite(d));
+
+    const DiyFp v(d);
+    DiyFp w_m, w_p;
+    v.normalizedBoundaries(&w_m, &w_p);
+
+    int K;
+    const DiyFp c_mk = getCachedPower(w_p.e, &K);
+    const DiyFp W = v.normalize() * c_mk;
+    DiyFp Wp = w_p * c_mk;
+    DiyFp Wm = w_m * c_mk;
+    // Stay strictly inside the boundaries, to make up for the imprecision of the multiplications:
+    Wm.f++;
+    Wp.f--;
+
+    int len;
+    digitGen(W, Wp, Wp.f - Wm.f, buf, &len, &K);
+    *decpt = len + K;
+
+    // Grisu2 very occasionally comes out a digit longer than necessary (1e23 gives
+    // 9.999999999999999e22), and as far as I've seen only for 16- and 17-digit results.
+    // Those are rare enough to double-check against libc:
+    if (len >= 16) {
+        char tmp[32];
+        for (int p = len - 1; p >= 1; p--) {
+            snprintf(tmp, sizeof(tmp), "%.*e", p - 1, d);
+            if (strtod(tmp, NULL) != d)
+                break;
+
+            // tmp looks like d.ddde+XX
+            buf[0] = tmp[0];
+            if (p > 1)
+                memcpy(buf + 1, tmp + 2, p - 1);
+            len = p;
+            *decpt = atoi(strchr(tmp, 'e') + 1) + 1;
+        }
+    }
+    return len;
+}
+
+std::string formatFloatDigits(bool negative, const char* digits, int ndigits, int decpt, int max_positional_decpt) {
+    assert(ndigits > 0);
+
+    std::string rtn;
+    rtn.reserve(ndigits + 8);
+    if (negative)
+        rtn.push_back('-');
+
+    if (decpt < -3 || decpt > max_positional_decpt) {
+        rtn.push_back(digits[0]);
+        if (ndigits > 1) {
+            rtn.push_back('.');
+            rtn.append(digits + 1, ndigits - 1);
+        }
+
+        int exp = decpt - 1;
+        rtn.push_back('e');
+        rtn.push_back(exp < 0 ? '-' : '+');
+        if (exp < 0)
+            exp = -exp;
+        char buf[8];
+        int n = intToDecimal(exp, buf);
+        if (n < 2)
+            rtn.push_back('0');
+        rtn.append(buf, n);
+    } else if (decpt <= 0) {
+        rtn.append("0.");
+        rtn.append(-decpt, '0');
+        rtn.append(digits, ndigits);
+    } else if (decpt >= ndigits) {
+        rtn.append(digits, ndigits);
+        rtn.append(decpt - ndigits, '0');
+        rtn.append(".0");
+    } else {
+        rtn.append(digits, decpt);
+        rtn.push_back('.');
+        rtn.append(digits + decpt, ndigits - decpt);
+    }
+    return rtn;
+}
+
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+int intToDecimal(int64_t n, char* buf) {
+    // Work with the magnitude as unsigned so that INT64_MIN works too:
+    uint64_t u = n < 0 ? -(uint64_t)n : (uint64_t)n;
+
+    // Generate the digits backwards, two at a time:
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+    while (u >= 100) {
+        int i = (u % 100) * 2;
+        u /= 100;
+        *--p = DIGIT_PAIRS[i + 1];
+        *--p = DIGIT_PAIRS[i];
+    }
+    if (u >= 10) {
+        int i = u * 2;
+        *--p = DIGIT_PAIRS[i + 1];
+        *--p = DIGIT_PAIRS[i];
+    } else {
+        *--p = '0' + u;
+    }
+
+    int len = 0;
+    if (n < 0)
+        buf[len++] = '-';
+    int ndigits = tmp + sizeof(tmp) - p;
+    memcpy(buf + len, p, ndigits);
+    return len + ndigits;
+}
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+bool parseDouble(const std::string &s, double* out) {
+    const char* p = s.c_str();
+    const char* end = p + s.size();
+    while (p < end && isSpace(*p))
+        p++;
+    while (end > p && isSpace(end[-1]))
+        end--;
+    if (p == end)
+        return false;
+
+    // Fast path (Clinger's): if the significand and the power of ten are both exactly representable
+    // as doubles, a single correctly-rounded multiplication or division gives the right answer.
+    const char* q = p;
+    bool negative = false;
+    if (*q == '+' || *q == '-') {
+        negative = (*q == '-');
+        q++;
+    }
+
+    uint64_t mantissa = 0;
+    int ndigits = 0, exp10 = 0;
+    bool any_digits = false, exact = true;
+    while (q < end && *q >= '0' && *q <= '9') {
+        any_digits = true;
+        if (mantissa || *q != '0') {
+            if (ndigits < 19)
+                mantissa = mantissa * 10 + (*q - '0');
+            else
+                exact = false;
+            ndigits++;
+        }
+        q++;
+    }
+    if (ndigits > 19)
+        exp10 += ndigits - 19;
+    if (q < end && *q == '.') {
+        q++;
+        while (q < end && *q >= '0' && *q <= '9') {
+            any_digits = true;
+            if (mantissa || *q != '0') {
+                if (ndigits < 19) {
+                    mantissa = mantissa * 10 + (*q - '0');
+                    exp10--;
+                } else {
+                    exact = false;
+                }
+                ndigits++;
+            } else {
+                exp10--;
+            }
+            q++;
+        }
+    }
+    if (q < end && any_digits && (*q == 'e' || *q == 'E')) {
+        const char* exp_start = q;
+        q++;
+        bool exp_negative = false;
+        if (q < end && (*q == '+' || *q == '-')) {
+            exp_negative = (*q == '-');
+            q++;
+        }
+        if (q == end || *q < '0' || *q > '9') {
+            q = exp_start;
+        } else {
+            int e = 0;
+            while (q < end && *q >= '0' && *q <= '9') {
+                if (e < 100000)
+                    e = e * 10 + (*q - '0');
+                q++;
+            }
+            exp10 += exp_negative ? -e : e;
+        }
+    }
+
+    if (any_digits && q == end && exact && mantissa < (1ULL << 53) && exp10 >= -22 && exp10 <= 22) {
+        static const double EXACT_POW10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+        };
+        double d = (double)mantissa;
+        if (exp10 < 0)
+            d /= EXACT_POW10[-exp10];
+        else
+            d *= EXACT_POW10[exp10];
+        *out = negative ? -d : d;
+        return true;
+    }
+
+    // Everything else (including nan and inf) goes to the libc implementation, which also takes
+    // hex floats that python doesn't:
+    std::string trimmed(p, end);
+    if (trimmed.find_first_of("xX") != std::string::npos)
+        return false;
+    char* parse_end;
+    double d = strtod(trimmed.c_str(), &parse_end);
+    if (parse_end != trimmed.c_str() + trimmed.size())
+        return false;
+    *out = d;
+    return true;
+}
+
+}
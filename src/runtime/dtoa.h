@@ -0,0 +1,44 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_RUNTIME_DTOA_H
+#define PYSTON_RUNTIME_DTOA_H
+
+#include <stdint.h>
+#include <string>
+
+namespace pyston {
+
+// Conversions between numbers and their decimal representations.
+
+// Produces the shortest string of digits that reads back as exactly d (which has to be finite
+// and positive), using Grisu2.  The value is 0.<digits> * 10^decpt; returns the number of digits.
+// buf needs room for at least 18 chars.
+int doubleToShortestDigits(double d, char* buf, int* decpt);
+
+// Lays out digits (as produced by doubleToShortestDigits) in python's float style: positional
+// notation with at least one digit after the point, unless decpt is below -3 or above
+// max_positional_decpt, in which case it's d[.ddd]e<sign><exp>.
+std::string formatFloatDigits(bool negative, const char* digits, int ndigits, int decpt, int max_positional_decpt);
+
+// Writes the decimal representation of n into buf (which needs at least 21 chars); returns the length.
+// Doesn't null-terminate.
+int intToDecimal(int64_t n, char* buf);
+
+// Parses a python float literal (surrounding whitespace allowed); returns false if s isn't one.
+bool parseDouble(const std::string &s, double* out);
+
+}
+
+#endif
@@ -0,0 +1,191 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <unordered_map>
+
+#include "core/common.h"
+#include "core/types.h"
+
+#include "runtime/gc_runtime.h"
+#include "runtime/objmodel.h"
+#include "runtime/types.h"
+#include "runtime/util.h"
+
+#include "codegen/compvars.h"
+
+#include "gc/collector.h"
+
+namespace pyston {
+
+// The builtin exception classes, with CPython's hierarchy.  The runtime doesn't have class inheritance, so
+// the hierarchy is kept here (it's what isinstance and, once there are except clauses, the matching of them
+// go by), and each class gets the same methods; the instances are regular objects with an "args" tuple, the
+// same as in CPython.  The bases come before the classes that derive from them.
+static const struct {
+    const char* name;
+    const char* base;
+} exception_defs[] = {
+    { "BaseException", NULL },
+    { "SystemExit", "BaseException" },
+    { "KeyboardInterrupt", "BaseException" },
+    { "Exception", "BaseException" },
+    { "StopIteration", "Exception" },
+    { "StandardError", "Exception" },
+    { "ArithmeticError", "StandardError" },
+    { "OverflowError", "ArithmeticError" },
+    { "ZeroDivisionError", "ArithmeticError" },
+    { "AssertionError", "StandardError" },
+    { "AttributeError", "StandardError" },
+    { "LookupError", "StandardError" },
+    { "IndexError", "LookupError" },
+    { "KeyError", "LookupError" },
+    { "NameError", "StandardError" },
+    { "RuntimeError", "StandardError" },
+    { "NotImplementedError", "RuntimeError" },
+    { "TypeError", "StandardError" },
+    { "ValueError", "StandardError" },
+    { NULL, NULL },
+};
+// Each exception class's base (NULL for BaseException):
+static std::unordered_map<BoxedClass*, BoxedClass*> exception_bases;
+static BoxedClass* key_error_cls;
+
+static bool isExceptionClass(BoxedClass* cls) {
+    return exception_bases.count(cls) != 0;
+}
+
+bool isExceptionSubclass(BoxedClass* cls, BoxedClass* parent) {
+    std::unordered_map<BoxedClass*, BoxedClass*>::iterator it = exception_bases.find(cls);
+    while (it != exception_bases.end()) {
+        if (it->first == parent)
+            return true;
+        it = exception_bases.find(it->second);
+    }
+    return false;
+}
+
+static BoxedTuple* exceptionArgs(Box* self) {
+    Box* args = getattr(self, "args");
+    RELEASE_ASSERT(args->cls == tuple_cls, "%s", getTypeName(args)->c_str());
+    return static_cast<BoxedTuple*>(args);
+}
+
+Box* exceptionInit(Box* self, BoxedList* args) {
+    assert(args->cls == list_cls);
+    if (!isExceptionClass(self->cls)) {
+        fprintf(stderr, "TypeError: descriptor '__init__' requires a 'exceptions.BaseException' object but received a '%s'\n", getTypeName(self)->c_str());
+        raiseExc();
+    }
+
+    std::vector<Box*> elts;
+    for (int64_t i = 0; i < args->size; i++)
+        elts.push_back(args->getElt(i));
+    static_cast<HCBox*>(self)->setattr("args", BoxedTuple::create(elts), NULL, NULL);
+    return None;
+}
+
+Box* exceptionStr(Box* self) {
+    BoxedTuple* args = exceptionArgs(self);
+    if (args->nelts == 0)
+        return boxStrConstant("");
+    if (args->nelts > 1)
+        return str(args);
+    // KeyErrors use the repr, so that it's clear what the key was (ex if it was the empty string):
+    if (self->cls == key_error_cls)
+        return repr(args->elts[0]);
+    return str(args->elts[0]);
+}
+
+Box* exceptionRepr(Box* self) {
+    return boxString(*getTypeName(self) + repr(exceptionArgs(self))->s);
+}
+
+// What gets printed for an exception that doesn't get caught, which for now is all of them:
+static void printException(Box* exc) {
+    const std::string &msg = str(exc)->s;
+    if (msg.size())
+        fprintf(stderr, "%s: %s\n", getTypeName(exc)->c_str(), msg.c_str());
+    else
+        fprintf(stderr, "%s\n", getTypeName(exc)->c_str());
+}
+
+extern "C" void raise3(Box* type, Box* value, Box* tback) {
+    // There aren't any traceback objects to pass:
+    if (tback != None) {
+        fprintf(stderr, "TypeError: raise: arg 3 must be a traceback or None\n");
+        raiseExc();
+    }
+
+    Box* exc;
+    if (type->cls == type_cls && isExceptionClass(static_cast<BoxedClass*>(type))) {
+        if (value->cls == type) {
+            exc = value;
+        } else if (value == None) {
+            exc = runtimeCall(type, 0, NULL, NULL, NULL, NULL);
+        } else if (value->cls == tuple_cls) {
+            // "raise E, (a, b)" is E(a, b):
+            BoxedTuple* t = static_cast<BoxedTuple*>(value);
+            int64_t nargs = t->nelts;
+            exc = runtimeCall(type, nargs, nargs > 0 ? t->elts[0] : NULL, nargs > 1 ? t->elts[1] : NULL,
+                    nargs > 2 ? t->elts[2] : NULL, nargs > 3 ? &t->elts[3] : NULL);
+        } else {
+            exc = runtimeCall(type, 1, value, NULL, NULL, NULL);
+        }
+    } else if (isExceptionClass(type->cls)) {
+        if (value != None) {
+            fprintf(stderr, "TypeError: instance exception may not have a separate value\n");
+            raiseExc();
+        }
+        exc = type;
+    } else {
+        // (including a bare "raise", since no exception is ever being handled)
+        fprintf(stderr, "TypeError: exceptions must be old-style classes or derived from BaseException, not %s\n", getTypeName(type)->c_str());
+        raiseExc();
+    }
+
+    printException(exc);
+    raiseExc();
+}
+
+void setupExceptions() {
+    CLFunction *init_func = boxRTFunction((void*)exceptionInit, NONE, 1, true);
+    CLFunction *str_func = boxRTFunction((void*)exceptionStr, STR, 1, false);
+    CLFunction *repr_func = boxRTFunction((void*)exceptionRepr, STR, 1, false);
+
+    BoxedString *modname = boxStrConstant("exceptions");
+    for (int i = 0; exception_defs[i].name; i++) {
+        // Not frozen, and made the same way as the classes that a class statement makes, so that typeCall
+        // creates the instances as regular objects that can hold the args:
+        BoxedClass *cls = new BoxedClass(&user_flavor, true, NULL);
+        gc::registerStaticRootObj(cls);
+        cls->giveAttr("__name__", boxStrConstant(exception_defs[i].name));
+        cls->giveAttr("__module__", modname);
+        cls->giveAttr("__init__", new BoxedFunction(init_func));
+        cls->giveAttr("__str__", new BoxedFunction(str_func));
+        cls->giveAttr("__repr__", new BoxedFunction(repr_func));
+
+        BoxedClass *base = NULL;
+        if (exception_defs[i].base) {
+            base = static_cast<BoxedClass*>(builtins_module->peekattr(exception_defs[i].base));
+            assert(base && isExceptionClass(base));
+        }
+        exception_bases[cls] = base;
+        builtins_module->giveAttr(exception_defs[i].name, cls);
+    }
+
+    key_error_cls = static_cast<BoxedClass*>(builtins_module->peekattr("KeyError"));
+}
+
+}
@@ -12,11 +12,15 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
-#include <sstream>
+#include <sched.h>
 
 #include "core/common.h"
 #include "core/stats.h"
+#include "core/threading.h"
 #include "core/types.h"
 
 #include "runtime/gc_runtime.h"
@@ -31,32 +35,158 @@ Box* fileRepr(BoxedFile* self) {
     RELEASE_ASSERT(0, "");
 }
 
-static Box* _fileRead(BoxedFile* self, i64 size) {
+static void _checkReadable(BoxedFile* self) {
     if (self->closed) {
         fprintf(stderr, "IOError: file not open for reading\n");
         raiseExc();
     }
+}
 
-    std::ostringstream os("");
+// The reads and writes let go of the GIL around the actual I/O, and bump unlocked_count while they do.
+// Anything else that wants to use the file or its read buffer waits for them to be done first (and has
+// to check again whether the file got closed in the meantime); closing it while that's going on is an
+// error, like in CPython.
+static void _fileWaitForIO(BoxedFile* self) {
+    while (self->unlocked_count) {
+        threading::GLAllowThreadsRegion _allow;
+        sched_yield();
+    }
+}
+
+// Refills the read buffer if it's been used up; returns false at EOF.
+static bool _fileFill(BoxedFile* self) {
+    _fileWaitForIO(self);
+    _checkReadable(self);
+    if (self->rbuf_pos < self->rbuf_len)
+        return true;
+
+    if (!self->rbuf)
+        self->rbuf = (char*)malloc(self->rbuf_capacity);
+
+    self->rbuf_pos = self->rbuf_len = 0;
+    size_t more_read;
+    self->unlocked_count++;
+    {
+        threading::GLAllowThreadsRegion _allow;
+        more_read = fread(self->rbuf, 1, self->rbuf_capacity, self->f);
+    }
+    self->unlocked_count--;
+    if (more_read == 0) {
+        ASSERT(!ferror(self->f), "%d", ferror(self->f));
+        return false;
+    }
+    self->rbuf_len = more_read;
+    return true;
+}
+
+// Gives back whatever is still buffered, so that the underlying FILE* is positioned where
+// the python code thinks it is.
+static void _fileDropReadBuffer(BoxedFile* self) {
+    _fileWaitForIO(self);
+    if (self->rbuf_pos < self->rbuf_len) {
+        int r = fseek(self->f, self->rbuf_pos - self->rbuf_len, SEEK_CUR);
+        ASSERT(r == 0, "%d", errno);
+    }
+    self->rbuf_pos = self->rbuf_len = 0;
+}
+
+static Box* _fileRead(BoxedFile* self, i64 size) {
+    _checkReadable(self);
 
     if (size < 0)
         size = 1L << 60;
 
-    i64 read = 0;
-    while (read < size) {
-        const int BUF_SIZE = 1024;
-        char buf[BUF_SIZE];
-        size_t more_read = fread(buf, 1, std::min((i64)BUF_SIZE, size - read), self->f);
-        if (more_read == 0) {
-            ASSERT(!ferror(self->f), "%d", ferror(self->f));
+    StringBuilder sb;
+    while (sb.size() < size) {
+        i64 want = size - sb.size();
+
+        _fileWaitForIO(self);
+        _checkReadable(self);
+        // Big reads don't need to be staged through the buffer:
+        if (self->rbuf_pos == self->rbuf_len && want >= self->rbuf_capacity) {
+            char buf[1 << 16];
+            size_t more_read;
+            self->unlocked_count++;
+            {
+                threading::GLAllowThreadsRegion _allow;
+                more_read = fread(buf, 1, std::min((i64)sizeof(buf), want), self->f);
+            }
+            self->unlocked_count--;
+            if (more_read == 0) {
+                ASSERT(!ferror(self->f), "%d", ferror(self->f));
+                break;
+            }
+            sb.append(buf, more_read);
+            continue;
+        }
+
+        if (!_fileFill(self))
+            break;
+        i64 n = std::min(want, self->rbuf_len - self->rbuf_pos);
+        sb.append(self->rbuf + self->rbuf_pos, n);
+        self->rbuf_pos += n;
+    }
+    return sb.finish();
+}
+
+// Returns the next line including its '\n', or an empty string at EOF.
+static BoxedString* _fileReadline(BoxedFile* self) {
+    _checkReadable(self);
+
+    StringBuilder sb;
+    while (_fileFill(self)) {
+        char* start = self->rbuf + self->rbuf_pos;
+        i64 avail = self->rbuf_len - self->rbuf_pos;
+        char* nl = (char*)memchr(start, '\n', avail);
+        if (nl) {
+            i64 n = nl - start + 1;
+            sb.append(start, n);
+            self->rbuf_pos += n;
             break;
         }
+        sb.append(start, avail);
+        self->rbuf_pos = self->rbuf_len;
+    }
+    return sb.finish();
+}
+
+Box* fileReadline(BoxedFile* self) {
+    assert(self->cls == file_cls);
+    return _fileReadline(self);
+}
 
-        read += more_read;
-        // this is probably inefficient:
-        os << std::string(buf, more_read);
+Box* fileReadlines(BoxedFile* self) {
+    assert(self->cls == file_cls);
+
+    BoxedList* rtn = new BoxedList();
+    while (true) {
+        BoxedString* line = _fileReadline(self);
+        if (line->s.size() == 0)
+            break;
+        listAppendInternal(rtn, line);
     }
-    return boxString(os.str());
+    return rtn;
+}
+
+Box* fileIter(BoxedFile* self) {
+    assert(self->cls == file_cls);
+    return self;
+}
+
+Box* fileHasnext(BoxedFile* self) {
+    assert(self->cls == file_cls);
+    _checkReadable(self);
+    return boxBool(_fileFill(self));
+}
+
+Box* fileNext(BoxedFile* self) {
+    assert(self->cls == file_cls);
+    BoxedString* line = _fileReadline(self);
+    if (line->s.size() == 0) {
+        fprintf(stderr, "StopIteration\n");
+        raiseExc();
+    }
+    return line;
 }
 
 Box* fileRead1(BoxedFile* self) {
@@ -76,35 +206,23 @@ Box* fileRead2(BoxedFile* self, Box* size) {
 Box* fileWrite(BoxedFile* self, Box* val) {
     assert(self->cls == file_cls);
 
+    _fileWaitForIO(self);
     if (self->closed) {
         fprintf(stderr, "IOError: file is closed\n");
         raiseExc();
     }
 
+    _fileDropReadBuffer(self);
 
     if (val->cls == str_cls) {
         const std::string &s = static_cast<BoxedString*>(val)->s;
-
-        size_t size = s.size();
-        size_t written = 0;
-        while (written < size) {
-            //const int BUF_SIZE = 1024;
-            //char buf[BUF_SIZE];
-            //int to_write = std::min(BUF_SIZE, size - written);
-            //memcpy(buf, s.c_str() + written, to_write);
-            //size_t new_written = fwrite(buf, 1, to_write, self->f);
-
-            size_t new_written = fwrite(s.c_str() + written, 1, size - written, self->f);
-
-            if (!new_written) {
-                int error = ferror(self->f);
-                fprintf(stderr, "IOError %d\n", error);
-                raiseExc();
-            }
-
-            written += new_written;
+        self->unlocked_count++;
+        {
+            // The string stays alive, since val is still on this thread's stack:
+            threading::GLAllowThreadsRegion _allow;
+            writeBytes(self->f, s.data(), s.size());
         }
-
+        self->unlocked_count--;
         return None;
     } else {
         fprintf(stderr, "str expected\n");
@@ -118,9 +236,16 @@ Box* fileClose(BoxedFile* self) {
         fprintf(stderr, "IOError: file is closed\n");
         raiseExc();
     }
+    // (the other thread is still using the FILE* and the buffer)
+    if (self->unlocked_count) {
+        fprintf(stderr, "IOError: close() called during concurrent operation on the same file object.\n");
+        raiseExc();
+    }
 
     fclose(self->f);
     self->closed = true;
+    free(self->rbuf);
+    self->rbuf = NULL;
 
     return None;
 }
@@ -141,6 +266,9 @@ Box* fileExit(BoxedFile* self, Box* exc_type, Box* exc_val, Box** args) {
 }
 
 void file_dtor(BoxedFile* t) {
+    if (!t->closed)
+        fclose(t->f);
+    free(t->rbuf);
 }
 
 Box* fileNew2(BoxedClass *cls, Box* s) {
@@ -153,6 +281,11 @@ Box* fileNew3(BoxedClass *cls, Box* s, Box* m) {
     return open2(s, m);
 }
 
+Box* fileNew4(BoxedClass *cls, Box* s, Box* m, Box** args) {
+    assert(cls == file_cls);
+    return open3(s, m, args[0]);
+}
+
 void setupFile() {
     file_cls->giveAttr("__name__", boxStrConstant("file"));
 
@@ -160,6 +293,12 @@ void setupFile() {
     addRTFunction(read, (void*)fileRead2, NULL, 2, false);
     file_cls->giveAttr("read", new BoxedFunction(read));
 
+    file_cls->giveAttr("readline", new BoxedFunction(boxRTFunction((void*)fileReadline, NULL, 1, false)));
+    file_cls->giveAttr("readlines", new BoxedFunction(boxRTFunction((void*)fileReadlines, NULL, 1, false)));
+    file_cls->giveAttr("__iter__", new BoxedFunction(boxRTFunction((void*)fileIter, NULL, 1, false)));
+    file_cls->giveAttr("__hasnext__", new BoxedFunction(boxRTFunction((void*)fileHasnext, NULL, 1, false)));
+    file_cls->giveAttr("next", new BoxedFunction(boxRTFunction((void*)fileNext, NULL, 1, false)));
+
     file_cls->giveAttr("write", new BoxedFunction(boxRTFunction((void*)fileWrite, NULL, 2, false)));
     file_cls->giveAttr("close", new BoxedFunction(boxRTFunction((void*)fileClose, NULL, 1, false)));
 
@@ -171,6 +310,7 @@ void setupFile() {
 
     CLFunction *__new__ = boxRTFunction((void*)fileNew2, NULL, 2, false);
     addRTFunction(__new__, (void*)fileNew3, NULL, 3, false);
+    addRTFunction(__new__, (void*)fileNew4, NULL, 4, false);
     file_cls->giveAttr("__new__", new BoxedFunction(__new__));
 
     file_cls->freeze();
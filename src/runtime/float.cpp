@@ -15,8 +15,10 @@
 #include <cmath>
 #include <cstring>
 
+#include "core/ast.h"
 #include "core/types.h"
 
+#include "runtime/dtoa.h"
 #include "runtime/gc_runtime.h"
 #include "runtime/objmodel.h"
 #include "runtime/types.h"
@@ -56,6 +58,14 @@ extern "C" double div_float_float(double lhs, double rhs) {
     return lhs / rhs;
 }
 
+extern "C" double floordiv_float_float(double lhs, double rhs) {
+    if (rhs == 0) {
+        fprintf(stderr, "float divide by zero\n");
+        raiseExc();
+    }
+    return floor(lhs / rhs);
+}
+
 extern "C" Box* floatAddFloat(BoxedFloat* lhs, BoxedFloat *rhs) {
     assert(lhs->cls == float_cls);
     assert(rhs->cls == float_cls);
@@ -131,15 +141,28 @@ extern "C" Box* floatEq(BoxedFloat* lhs, Box *rhs) {
 
 extern "C" Box* floatFloorDiv(BoxedFloat* lhs, Box *rhs) {
     assert(lhs->cls == float_cls);
-    if (rhs->cls != float_cls) {
+    if (rhs->cls == int_cls) {
+        BoxedInt *rhs_int = static_cast<BoxedInt*>(rhs);
+        return boxFloat(floordiv_float_float(lhs->d, rhs_int->n));
+    } else if (rhs->cls == float_cls) {
+        BoxedFloat *rhs_float = static_cast<BoxedFloat*>(rhs);
+        return boxFloat(floordiv_float_float(lhs->d, rhs_float->d));
+    } else {
         return NotImplemented;
     }
-    BoxedFloat *rhs_float = static_cast<BoxedFloat*>(rhs);
-    if (rhs_float->d == 0) {
-        fprintf(stderr, "float divide by zero\n");
-        raiseExc();
+}
+
+extern "C" Box* floatRFloorDiv(BoxedFloat* lhs, Box *rhs) {
+    assert(lhs->cls == float_cls);
+    if (rhs->cls == int_cls) {
+        BoxedInt *rhs_int = static_cast<BoxedInt*>(rhs);
+        return boxFloat(floordiv_float_float(rhs_int->n, lhs->d));
+    } else if (rhs->cls == float_cls) {
+        BoxedFloat *rhs_float = static_cast<BoxedFloat*>(rhs);
+        return boxFloat(floordiv_float_float(rhs_float->d, lhs->d));
+    } else {
+        return NotImplemented;
     }
-    return boxFloat(floor(lhs->d / rhs_float->d));
 }
 
 extern "C" Box* floatNe(BoxedFloat* lhs, Box *rhs) {
@@ -288,6 +311,19 @@ extern "C" Box* floatPow(BoxedFloat* lhs, Box *rhs) {
     }
 }
 
+extern "C" Box* floatRPow(BoxedFloat* lhs, Box *rhs) {
+    assert(lhs->cls == float_cls);
+    if (rhs->cls == int_cls) {
+        BoxedInt* rhs_int = static_cast<BoxedInt*>(rhs);
+        return boxFloat(pow_float_float(rhs_int->n, lhs->d));
+    } else if (rhs->cls == float_cls) {
+        BoxedFloat *rhs_float = static_cast<BoxedFloat*>(rhs);
+        return boxFloat(pow_float_float(rhs_float->d, lhs->d));
+    } else {
+        return NotImplemented;
+    }
+}
+
 extern "C" Box* floatMulFloat(BoxedFloat* lhs, BoxedFloat *rhs) {
     assert(lhs->cls == float_cls);
     assert(rhs->cls == float_cls);
@@ -346,6 +382,28 @@ Box* floatNeg(BoxedFloat *self) {
     return boxFloat(-self->d);
 }
 
+// Has to agree with int hashing for the values that are integers, so that 1 and 1.0 are the same dict key;
+// the rest get mixed up the same way CPython does it.
+Box* floatHash(BoxedFloat *self) {
+    assert(self->cls == float_cls);
+    double d = self->d;
+
+    if (isnan(d))
+        return boxInt(0);
+    if (isinf(d))
+        return boxInt(d > 0 ? 314159 : -271828);
+
+    double intpart;
+    if (modf(d, &intpart) == 0.0 && intpart >= -9223372036854775808.0 && intpart < 9223372036854775808.0)
+        return boxInt((i64)intpart);
+
+    int expo;
+    double m = frexp(d, &expo) * 2147483648.0;
+    i64 hipart = (i64)m;
+    m = (m - hipart) * 2147483648.0;
+    return boxInt(hipart + (i64)m + ((i64)expo << 15));
+}
+
 Box* floatNonzero(BoxedFloat *self) {
     assert(self->cls == float_cls);
     return boxBool(self->d != 0.0);
@@ -449,24 +507,46 @@ Box* floatNew2(BoxedClass *cls, Box* a) {
         if (s == "-inf")
             return boxFloat(-INFINITY);
 
-        RELEASE_ASSERT(0, "%s", s.c_str());
+        double d;
+        if (!parseDouble(s, &d)) {
+            fprintf(stderr, "ValueError: could not convert string to float: %s\n", s.c_str());
+            raiseExc();
+        }
+        return boxFloat(d);
     }
     RELEASE_ASSERT(0, "%s", getTypeName(a)->c_str());
 }
 
+// repr() is the shortest string that reads back as the same float; str() rounds to 12 digits.
+// For the str() of anything with a short enough repr (most floats that show up in practice),
+// those are the same digits.
+static std::string floatToString(double x, bool is_repr) {
+    if (!std::isfinite(x) || x == 0)
+        return floatFmt(x, 12, 'g');
+
+    char digits[20];
+    int decpt;
+    int ndigits = doubleToShortestDigits(fabs(x), digits, &decpt);
+    if (is_repr)
+        return formatFloatDigits(x < 0, digits, ndigits, decpt, 16);
+    if (ndigits <= 12)
+        return formatFloatDigits(x < 0, digits, ndigits, decpt, 12);
+    return floatFmt(x, 12, 'g');
+}
+
 Box* floatStr(BoxedFloat *self) {
     assert(self->cls == float_cls);
-    return boxString(floatFmt(self->d, 12, 'g'));
+    return new BoxedString(floatToString(self->d, false));
 }
 
 Box* floatRepr(BoxedFloat *self) {
     assert(self->cls == float_cls);
-    return boxString(floatFmt(self->d, 16, 'g'));
+    return new BoxedString(floatToString(self->d, true));
 }
 
 extern "C" void printFloat(double d) {
-    std::string s = floatFmt(d, 12, 'g');
-    printf("%s", s.c_str());
+    std::string s = floatToString(d, false);
+    writeBytes(stdout, s.data(), s.size());
 }
 
 static void _addFunc(const char* name, void* float_func, void* boxed_func) {
@@ -490,6 +570,7 @@ void setupFloat() {
     float_cls->giveAttr("__rdiv__", new BoxedFunction(boxRTFunction((void*)floatRDiv, NULL, 2, false)));
     float_cls->giveAttr("__eq__", new BoxedFunction(boxRTFunction((void*)floatEq, NULL, 2, false)));
     float_cls->giveAttr("__floordiv__", new BoxedFunction(boxRTFunction((void*)floatFloorDiv, NULL, 2, false)));
+    float_cls->giveAttr("__rfloordiv__", new BoxedFunction(boxRTFunction((void*)floatRFloorDiv, NULL, 2, false)));
     float_cls->giveAttr("__ge__", new BoxedFunction(boxRTFunction((void*)floatGe, NULL, 2, false)));
     float_cls->giveAttr("__gt__", new BoxedFunction(boxRTFunction((void*)floatGt, NULL, 2, false)));
     float_cls->giveAttr("__le__", new BoxedFunction(boxRTFunction((void*)floatLe, NULL, 2, false)));
@@ -500,6 +581,7 @@ void setupFloat() {
     float_cls->setattr("__rmul__", float_cls->peekattr("__mul__"), NULL, NULL);
     float_cls->giveAttr("__ne__", new BoxedFunction(boxRTFunction((void*)floatNe, NULL, 2, false)));
     float_cls->giveAttr("__pow__", new BoxedFunction(boxRTFunction((void*)floatPow, NULL, 2, false)));
+    float_cls->giveAttr("__rpow__", new BoxedFunction(boxRTFunction((void*)floatRPow, NULL, 2, false)));
     //float_cls->giveAttr("__sub__", new BoxedFunction(boxRTFunction((void*)floatSub, NULL, 2, false)));
     _addFunc("__sub__", (void*)floatSubFloat, (void*)floatSub);
     float_cls->giveAttr("__rsub__", new BoxedFunction(boxRTFunction((void*)floatRSub, NULL, 2, false)));
@@ -509,10 +591,27 @@ void setupFloat() {
     float_cls->giveAttr("__new__", new BoxedFunction(__new__));
 
     float_cls->giveAttr("__neg__", new BoxedFunction(boxRTFunction((void*)floatNeg, NULL, 1, false)));
+    float_cls->giveAttr("__hash__", new BoxedFunction(boxRTFunction((void*)floatHash, NULL, 1, false)));
     float_cls->giveAttr("__nonzero__", new BoxedFunction(boxRTFunction((void*)floatNonzero, NULL, 1, false)));
     float_cls->giveAttr("__str__", new BoxedFunction(boxRTFunction((void*)floatStr, NULL, 1, false)));
     float_cls->giveAttr("__repr__", new BoxedFunction(boxRTFunction((void*)floatRepr, NULL, 1, false)));
     float_cls->freeze();
+
+    registerBinopImpl(float_cls, float_cls, AST_TYPE::Add, (void*)floatAddFloat);
+    registerBinopImpl(float_cls, float_cls, AST_TYPE::Sub, (void*)floatSubFloat);
+    registerBinopImpl(float_cls, float_cls, AST_TYPE::Mult, (void*)floatMulFloat);
+    registerBinopImpl(float_cls, int_cls, AST_TYPE::Add, (void*)floatAdd);
+    registerBinopImpl(float_cls, int_cls, AST_TYPE::Sub, (void*)floatSub);
+    registerBinopImpl(float_cls, int_cls, AST_TYPE::Mult, (void*)floatMul);
+    BoxedClass* rhs_classes[] = { float_cls, int_cls };
+    for (BoxedClass* rhs_cls : rhs_classes) {
+        registerBinopImpl(float_cls, rhs_cls, AST_TYPE::Eq, (void*)floatEq);
+        registerBinopImpl(float_cls, rhs_cls, AST_TYPE::NotEq, (void*)floatNe);
+        registerBinopImpl(float_cls, rhs_cls, AST_TYPE::Lt, (void*)floatLt);
+        registerBinopImpl(float_cls, rhs_cls, AST_TYPE::LtE, (void*)floatLe);
+        registerBinopImpl(float_cls, rhs_cls, AST_TYPE::Gt, (void*)floatGt);
+        registerBinopImpl(float_cls, rhs_cls, AST_TYPE::GtE, (void*)floatGe);
+    }
 }
 
 void teardownFloat() {
@@ -17,6 +17,8 @@
 
 extern "C" double mod_float_float(double lhs, double rhs);
 extern "C" double div_float_float(double lhs, double rhs);
+extern "C" double floordiv_float_float(double lhs, double rhs);
 extern "C" double pow_float_float(double lhs, double rhs);
+extern "C" void printFloat(double d);
 
 #endif
@@ -27,6 +27,12 @@ void gc_teardown();
 extern "C" void* rt_alloc(size_t size);
 extern "C" void* rt_realloc(void* ptr, size_t new_size);
 extern "C" void rt_free(void* ptr);
+// For Boxes whose flavor has a finalizer (see the Box constructor):
+extern "C" void rt_set_finalizable(void* obj);
+// Write-barrier entry points for jitted code and ICs.  rt_write_barrier is in the stdlib bitcode, so jitted
+// code gets its side-table checks inlined, and only calls out when the parent needs remembering:
+extern "C" void rt_remember(void* obj);
+extern "C" void rt_write_barrier(void* parent, void* child);
 }
 
 #endif
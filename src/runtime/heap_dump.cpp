@@ -0,0 +1,169 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "core/common.h"
+#include "core/stats.h"
+#include "core/types.h"
+#include "core/util.h"
+
+#include "gc/collector.h"
+#include "gc/heap.h"
+
+#include "runtime/alloc_profile.h"
+#include "runtime/heap_dump.h"
+#include "runtime/objmodel.h"
+#include "runtime/types.h"
+
+namespace pyston {
+
+// Collects the pointers out of one object; the same thing as the marking visitors, except that
+// nothing gets marked.
+class EdgeCollector : public GCVisitor {
+    public:
+        std::vector<void*> edges;
+
+        void visit(void* p) override {
+            assert(gc::global_heap.getAllocationFromInteriorPointer(p) == p);
+            edges.push_back(p);
+        }
+
+        void visitRange(void** start, void** end) override {
+            while (start < end) {
+                visit(*start);
+                start++;
+            }
+        }
+
+        void visitPotential(void* p) override {
+            void* a = gc::global_heap.getAllocationFromInteriorPointer(p);
+            if (a)
+                edges.push_back(a);
+        }
+
+        void visitPotentialRange(void** start, void** end) override {
+            while (start < end) {
+                visitPotential(*start);
+                start++;
+            }
+        }
+};
+
+// Hands out the ids of type names and allocation sites, writing each one out the first time it's seen:
+class NameTable {
+    private:
+        const char kind;
+        std::unordered_map<std::string, int> ids;
+
+    public:
+        NameTable(char kind) : kind(kind) {}
+
+        int idFor(FILE* f, const std::string &name) {
+            auto it = ids.find(name);
+            if (it != ids.end())
+                return it->second;
+
+            int id = ids.size();
+            ids[name] = id;
+            fprintf(f, "%c %d %s\n", kind, id, name.c_str());
+            return id;
+        }
+};
+
+static std::string typeNameOf(void* p) {
+    if (gc::isBox(p))
+        return *getNameOfClass(static_cast<Box*>(p)->cls);
+
+    kindid_t kind_id = gc::headerFromObject(p)->kind_id;
+    if (kind_id == hc_kind.kind_id)
+        return "<hidden class>";
+    if (kind_id == untracked_kind.kind_id)
+        return "<untracked>";
+    char buf[40];
+    snprintf(buf, sizeof(buf), "<gc kind %d>", kind_id);
+    return buf;
+}
+
+long dumpHeap(const char* filename) {
+    FILE* f = fopen(filename, "w");
+    if (!f) {
+        fprintf(stderr, "Couldn't open %s to write the heap dump: %s\n", filename, strerror(errno));
+        return -1;
+    }
+
+    Timer _t("dumping the heap");
+    // Nothing's allowed to get freed (or swept) out from under us:
+    std::lock_guard<std::recursive_mutex> _l(gc::global_heap.lock);
+
+    fprintf(f, "pyston_heap_dump 1\n");
+
+    gc::TraceStack stack;
+    gc::collectRoots(&stack);
+
+    std::unordered_set<void*> seen;
+    std::vector<void*> todo;
+    while (void* p = stack.pop()) {
+        if (!seen.insert(p).second)
+            continue;
+        fprintf(f, "r %p\n", p);
+        todo.push_back(p);
+    }
+
+    NameTable types('t'), sites('s');
+    EdgeCollector collector;
+    long nobjs = 0;
+    while (todo.size()) {
+        void* p = todo.back();
+        todo.pop_back();
+
+        collector.edges.clear();
+        gc::visitReferences(p, &collector);
+
+        int type_id = types.idFor(f, typeNameOf(p));
+        int site_id = -1;
+        if (gc::isBox(p)) {
+            const std::string* site = getAllocationSite(static_cast<Box*>(p));
+            if (site)
+                site_id = sites.idFor(f, *site);
+        }
+
+        fprintf(f, "o %p %ld %d %d", p, (long)gc::global_heap.getAllocationSize(p), type_id, site_id);
+        for (void* e : collector.edges) {
+            fprintf(f, " %p", e);
+            if (seen.insert(e).second)
+                todo.push_back(e);
+        }
+        fprintf(f, "\n");
+        nobjs++;
+    }
+
+    fclose(f);
+
+    long us = _t.end();
+    static StatCounter sc_us("us_heap_dumps");
+    sc_us.log(us);
+    if (VERBOSITY() >= 1)
+        printf("Wrote %ld objects to %s in %ldms\n", nobjs, filename, us / 1000);
+    return nobjs;
+}
+
+}
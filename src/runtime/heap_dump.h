@@ -0,0 +1,42 @@
+// Copyright (c) 2014 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_RUNTIME_HEAPDUMP_H
+#define PYSTON_RUNTIME_HEAPDUMP_H
+
+namespace pyston {
+
+// Writes out every object that a full collection would find to be alive, along with the pointers
+// between them, for tools/heap_analyzer.py to work out what's keeping how much memory alive.
+// The objects get found the same way the collector finds them (starting from the same roots, and
+// going through the same gc handlers), but the mark bits are left alone, so this can be done at
+// any point, including in the middle of an incremental mark.
+//
+// The file is text, one record per line:
+//   pyston_heap_dump 1
+//   t <type id> <name>                  a type name, given before the first object that uses it
+//   s <site id> <function>              same, for allocation sites
+//   r <addr>                            a root
+//   o <addr> <size> <type id> <site id> <addr>...
+//                                       an object, its size in the heap, and what it points to
+// Addresses are in hex.  The site id is -1 unless the object's allocation got sampled by the
+// allocation profiler (ie -a has to be on to get allocation sites).  Objects that aren't Boxes
+// get named after their gc kind.
+//
+// Returns the number of objects written, or -1 if the file couldn't be opened.
+long dumpHeap(const char* filename);
+
+}
+
+#endif
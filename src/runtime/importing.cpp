@@ -13,11 +13,25 @@
 // limitations under the License.
 
 #include <dlfcn.h>
+#include <stdarg.h>
+#include <future>
 #include <string.h>
+#include <sys/stat.h>
+#include <unordered_map>
 
+#include "core/ast.h"
+#include "core/stats.h"
 #include "core/types.h"
 
+#include "codegen/entry.h"
+#include "codegen/parser.h"
+
+#include "gc/collector.h"
+
+#include "runtime/importing.h"
+#include "runtime/objmodel.h"
 #include "runtime/types.h"
+#include "runtime/util.h"
 
 #include "Python.h"
 
@@ -28,12 +42,12 @@ static BoxedModule* test_module = NULL;
 extern "C" const ObjectFlavor capifunc_flavor(&boxGCHandler, NULL);
 BoxedClass *capifunc_cls;
 class BoxedCApiFunction : public Box {
-    private:
+    public:
         const char* name;
         PyCFunction func;
+        int flags;
 
-    public:
-        BoxedCApiFunction(const char* name, PyCFunction func) : Box(&capifunc_flavor, capifunc_cls), name(name), func(func) {
+        BoxedCApiFunction(const char* name, PyCFunction func, int flags) : Box(&capifunc_flavor, capifunc_cls), name(name), func(func), flags(flags) {
         }
 
         static BoxedString* __repr__(BoxedCApiFunction* self) {
@@ -45,12 +59,37 @@ class BoxedCApiFunction : public Box {
             assert(self->cls == capifunc_cls);
             assert(varargs->cls == list_cls);
 
+            if (self->flags != METH_VARARGS) {
+                int64_t expected = self->flags == METH_O ? 1 : 0;
+                if (varargs->size != expected) {
+                    fprintf(stderr, "TypeError: %s() takes exactly %ld argument%s (%ld given)\n", self->name, expected, expected == 1 ? "" : "s", varargs->size);
+                    raiseExc();
+                }
+                return callCApiDirect(self, expected ? varargs->getElt(0) : NULL);
+            }
+
             Box* rtn = (Box*)self->func(test_module, varargs);
             assert(rtn);
             return rtn;
         }
 };
 
+bool canCallCApiDirect(Box* capifunc, int64_t nargs) {
+    assert(capifunc->cls == capifunc_cls);
+    int flags = static_cast<BoxedCApiFunction*>(capifunc)->flags;
+    return (flags == METH_NOARGS && nargs == 0) || (flags == METH_O && nargs == 1);
+}
+
+extern "C" Box* callCApiDirect(Box* capifunc, Box* arg) {
+    BoxedCApiFunction *f = static_cast<BoxedCApiFunction*>(capifunc);
+    assert(f->cls == capifunc_cls);
+    assert(f->flags == METH_NOARGS || f->flags == METH_O);
+
+    Box* rtn = (Box*)f->func(test_module, arg);
+    assert(rtn);
+    return rtn;
+}
+
 extern "C" void* Py_InitModule4(const char *arg0, PyMethodDef *arg1, const char *arg2, PyObject *arg3, int arg4) {
     std::string name("test");
     std::string fn("../test/test_extension/test.so");
@@ -58,10 +97,10 @@ extern "C" void* Py_InitModule4(const char *arg0, PyMethodDef *arg1, const char
 
     while (arg1->ml_name) {
         if (VERBOSITY()) printf("Loading method %s\n", arg1->ml_name);
-        assert(arg1->ml_flags == METH_VARARGS);
+        RELEASE_ASSERT(arg1->ml_flags == METH_VARARGS || arg1->ml_flags == METH_NOARGS || arg1->ml_flags == METH_O, "unsupported flags %d for %s", arg1->ml_flags, arg1->ml_name);
 
         //test_module->giveAttr(arg1->ml_name, boxInt(1));
-        test_module->giveAttr(arg1->ml_name, new BoxedCApiFunction(arg1->ml_name, arg1->ml_meth));
+        test_module->giveAttr(arg1->ml_name, new BoxedCApiFunction(arg1->ml_name, arg1->ml_meth, arg1->ml_flags));
 
         arg1++;
     }
@@ -73,20 +112,89 @@ extern "C" void* Py_BuildValue(const char* arg0) {
     return None;
 }
 
-extern "C" bool PyArg_ParseTuple(void* tuple, const char* fmt, ...) {
-    if (strcmp("", fmt) == 0)
-        return true;
+// The format string, boiled down to one character per argument, and how many of them are required.
+// Extensions pass string literals, so these get cached by the address of the format string.
+struct ParsedFormat {
+    std::string codes;
+    int nrequired;
+};
+static std::unordered_map<const char*, ParsedFormat*> parsed_formats;
+
+static ParsedFormat* parseFormat(const char* fmt) {
+    std::unordered_map<const char*, ParsedFormat*>::iterator it = parsed_formats.find(fmt);
+    if (it != parsed_formats.end())
+        return it->second;
+
+    ParsedFormat *rtn = new ParsedFormat();
+    rtn->nrequired = -1;
+    for (const char* c = fmt; *c && *c != ':' && *c != ';'; c++) {
+        if (*c == '|') {
+            RELEASE_ASSERT(rtn->nrequired == -1, "%s", fmt);
+            rtn->nrequired = rtn->codes.size();
+            continue;
+        }
+        RELEASE_ASSERT(strchr("Oilds", *c), "unsupported format character '%c' in \"%s\"", *c, fmt);
+        rtn->codes.push_back(*c);
+    }
+    if (rtn->nrequired == -1)
+        rtn->nrequired = rtn->codes.size();
 
-    assert(strcmp("O", fmt) == 0);
+    parsed_formats[fmt] = rtn;
+    return rtn;
+}
+
+extern "C" bool PyArg_ParseTuple(void* tuple, const char* fmt, ...) {
+    ParsedFormat *parsed = parseFormat(fmt);
 
     BoxedList *varargs = (BoxedList*)tuple;
-    assert(varargs->size == 1);
+    assert(varargs->cls == list_cls);
+    int64_t nargs = varargs->size;
+    int64_t nparams = parsed->codes.size();
+    if (nargs < parsed->nrequired || nargs > nparams) {
+        if (parsed->nrequired == nparams)
+            fprintf(stderr, "TypeError: function takes exactly %ld argument%s (%ld given)\n", nparams, nparams == 1 ? "" : "s", nargs);
+        else if (nargs < parsed->nrequired)
+            fprintf(stderr, "TypeError: function takes at least %d argument%s (%ld given)\n", parsed->nrequired, parsed->nrequired == 1 ? "" : "s", nargs);
+        else
+            fprintf(stderr, "TypeError: function takes at most %ld argument%s (%ld given)\n", nparams, nparams == 1 ? "" : "s", nargs);
+        raiseExc();
+    }
 
     va_list ap;
     va_start(ap, fmt);
 
-    Box** arg0 = va_arg(ap, Box**);
-    *arg0 = varargs->elts->elts[0];
+    for (int i = 0; i < nargs; i++) {
+        Box* arg = varargs->getElt(i);
+        char code = parsed->codes[i];
+        if (code == 'O') {
+            *va_arg(ap, Box**) = arg;
+        } else if (code == 'i' || code == 'l') {
+            if (arg->cls != int_cls) {
+                fprintf(stderr, "TypeError: an integer is required\n");
+                raiseExc();
+            }
+            if (code == 'i')
+                *va_arg(ap, int*) = static_cast<BoxedInt*>(arg)->n;
+            else
+                *va_arg(ap, long*) = static_cast<BoxedInt*>(arg)->n;
+        } else if (code == 'd') {
+            if (arg->cls == float_cls) {
+                *va_arg(ap, double*) = static_cast<BoxedFloat*>(arg)->d;
+            } else if (arg->cls == int_cls) {
+                *va_arg(ap, double*) = static_cast<BoxedInt*>(arg)->n;
+            } else {
+                fprintf(stderr, "TypeError: a float is required\n");
+                raiseExc();
+            }
+        } else {
+            assert(code == 's');
+            if (arg->cls != str_cls) {
+                fprintf(stderr, "TypeError: argument %d must be string, not %s\n", i + 1, getTypeName(arg)->c_str());
+                raiseExc();
+            }
+            *va_arg(ap, const char**) = static_cast<BoxedString*>(arg)->s.c_str();
+        }
+    }
 
     va_end(ap);
 
@@ -120,8 +228,92 @@ BoxedModule* getTestModule() {
     return test_module;
 }
 
+// Modules that got imported from .py files, by name.  They only ever get imported once, so they
+// live forever.
+static std::unordered_map<std::string, BoxedModule*> imported_modules;
+// Cache lookups for the modules that the already-loaded ones import at their top level, which can
+// happen on other threads while those get compiled:
+static std::unordered_map<std::string, std::future<AST_Module*> > prefetched_parses;
+static std::string import_dir(".");
+
+void setImportPath(const char* main_fn) {
+    if (!main_fn)
+        return;
+    const char* slash = strrchr(main_fn, '/');
+    if (slash)
+        import_dir = std::string(main_fn, slash - main_fn);
+}
+
+static std::string findModuleFile(const std::string &name) {
+    // Packages aren't supported:
+    if (name.find('.') != std::string::npos)
+        return "";
+
+    std::string fn = import_dir + "/" + name + ".py";
+    struct stat st;
+    if (stat(fn.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return "";
+    return fn;
+}
+
+void prefetchImports(AST_Module* m) {
+    for (int i = 0; i < m->body.size(); i++) {
+        if (m->body[i]->type != AST_TYPE::Import)
+            continue;
+
+        AST_Import *node = static_cast<AST_Import*>(m->body[i]);
+        for (int j = 0; j < node->names.size(); j++) {
+            const std::string &name = node->names[j]->name;
+            if (imported_modules.count(name) || prefetched_parses.count(name))
+                continue;
+
+            std::string fn = findModuleFile(name);
+            if (fn.empty())
+                continue;
+            prefetched_parses[name] = std::async(std::launch::async, [fn]() { return read_parse_cache(fn.c_str()); });
+        }
+    }
+}
+
+BoxedModule* importModuleFile(const std::string &name) {
+    std::unordered_map<std::string, BoxedModule*>::iterator it = imported_modules.find(name);
+    if (it != imported_modules.end())
+        return it->second;
+
+    std::string fn = findModuleFile(name);
+    if (fn.empty())
+        return NULL;
+
+    AST_Module* m = NULL;
+    std::unordered_map<std::string, std::future<AST_Module*> >::iterator prefetched = prefetched_parses.find(name);
+    if (prefetched != prefetched_parses.end()) {
+        m = prefetched->second.get();
+        prefetched_parses.erase(prefetched);
+
+        static StatCounter num_prefetched("num_import_prefetch_hits");
+        if (m)
+            num_prefetched.log();
+    }
+    if (!m)
+        m = caching_parse(fn.c_str());
+
+    // Registered before it runs, so that circular imports get the partially-initialized module:
+    BoxedModule* bm = createModule(&name, &fn);
+    gc::registerStaticRootObj(bm);
+    imported_modules[name] = bm;
+
+    prefetchImports(m);
+
+    CompiledFunction* compiled = compileModule(m, bm);
+    if (compiled->is_interpreted)
+        callCompiledFunc(compiled, 0, NULL, NULL, NULL, NULL);
+    else
+        ((void (*)())compiled->code)();
+    return bm;
+}
+
 void setupCAPI() {
-    capifunc_cls = new BoxedClass(false, NULL);
+    capifunc_cls = new BoxedClass(&capifunc_flavor, false, NULL);
     capifunc_cls->giveAttr("__name__", boxStrConstant("capifunc"));
 
     capifunc_cls->giveAttr("__repr__", new BoxedFunction(boxRTFunction((void*)BoxedCApiFunction::__repr__, NULL, 1, false)));
@@ -15,11 +15,32 @@
 #ifndef PYSTON_RUNTIME_IMPORTING_H
 #define PYSTON_RUNTIME_IMPORTING_H
 
+#include <stdint.h>
+#include <string>
+
 namespace pyston {
 
+class AST_Module;
+class Box;
+class BoxedClass;
 class BoxedModule;
 BoxedModule* getTestModule();
 
+// Modules get looked for in the directory of the main file.
+void setImportPath(const char* main_fn);
+// Starts looking up the parses of the modules that m imports at its top level, on other threads, so
+// that they're ready once those imports run.
+void prefetchImports(AST_Module* m);
+// Imports name.py, or returns NULL if there isn't one.  Each module only gets run once.
+BoxedModule* importModuleFile(const std::string &name);
+
+extern BoxedClass *capifunc_cls;
+// METH_NOARGS and METH_O functions take their argument (if any) directly, so calls to them don't need
+// to build an argument tuple: if this returns true, the call can go to callCApiDirect, with NULL as the
+// argument for METH_NOARGS.  For the same function object this always gives the same answer.
+bool canCallCApiDirect(Box* capifunc, int64_t nargs);
+extern "C" Box* callCApiDirect(Box* capifunc, Box* arg);
+
 }
 
 #endif
@@ -30,6 +30,13 @@ extern "C" Box* createList() {
     return new BoxedList();
 }
 
+extern "C" Box* createListSized(int64_t capacity) {
+    BoxedList* rtn = new BoxedList();
+    if (capacity > 0)
+        rtn->ensure(capacity);
+    return rtn;
+}
+
 extern "C" BoxedString* boxStrConstant(const char* chars) {
     return new BoxedString(chars);
 }
@@ -53,9 +60,41 @@ i64 unboxInt(Box *b) {
     return ((BoxedInt*)b)->n;
 }
 
+extern "C" bool listNonzeroUnboxed(BoxedList* self) {
+    return self->size != 0;
+}
+
+extern "C" bool tupleNonzeroUnboxed(BoxedTuple* self) {
+    return self->nelts != 0;
+}
+
+extern "C" bool dictNonzeroUnboxed(BoxedDict* self) {
+    return self->size != 0;
+}
+
+extern "C" bool strNonzeroUnboxed(BoxedString* self) {
+    return self->s.size() != 0;
+}
+
+extern "C" i64 listLenUnboxed(BoxedList* self) {
+    return self->size;
+}
+
+extern "C" i64 tupleLenUnboxed(BoxedTuple* self) {
+    return self->nelts;
+}
+
+extern "C" i64 dictLenUnboxed(BoxedDict* self) {
+    return self->size;
+}
+
+extern "C" i64 strLenUnboxed(BoxedString* self) {
+    return self->s.size();
+}
+
 Box* boxInt(int64_t n) {
-    if (0 <= n && n < NUM_INTERNED_INTS) {
-        return interned_ints[n];
+    if (MIN_INTERNED_INT <= n && n < MAX_INTERNED_INT) {
+        return interned_ints[n - MIN_INTERNED_INT];
     }
     return new BoxedInt(n);
 }
@@ -0,0 +1,35 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/types.h"
+
+#include "runtime/dict.h"
+#include "runtime/types.h"
+
+namespace pyston {
+
+extern "C" Box* dictGetitem(Box* s, Box* k) {
+    assert(s->cls == dict_cls);
+    BoxedDict* self = static_cast<BoxedDict*>(s);
+
+    if (k->cls == str_cls && self->str_keys_only && self->size > 0) {
+        BoxedString* sk = static_cast<BoxedString*>(k);
+        int64_t* slot = findStrSlot(self, sk, sk->getHash());
+        if (*slot != BoxedDict::EMPTY)
+            return self->entries->entries[*slot].value;
+    }
+    return dictGetitemSlowpath(self, k);
+}
+
+}
@@ -85,6 +85,18 @@ void rt_free(void* ptr) {
     //assert(nallocs >= 0);
 }
 
+void rt_set_finalizable(void* obj) {
+    gc::setFinalizable(obj);
+}
+
+void rt_remember(void* obj) {
+    gc::rememberObject(obj);
+}
+
+void rt_write_barrier(void* parent, void* child) {
+    gc::writeBarrier(parent, child);
+}
+
 void gc_teardown() {
     /*
     if (nallocs != 0) {
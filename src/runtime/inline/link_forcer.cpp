@@ -46,20 +46,38 @@ void force() {
     FORCE(unboxFloat);
     FORCE(boxStringPtr);
     FORCE(boxCLFunction);
+    FORCE(boxCLFunctionDefaults);
+    FORCE(boxCLFunctionClosure);
     FORCE(unboxCLFunction);
     FORCE(boxInstanceMethod);
     FORCE(boxBool);
     FORCE(unboxBool);
     FORCE(createTuple);
+    FORCE(createTupleInPlace);
     FORCE(createDict);
     FORCE(createList);
+    FORCE(createListSized);
     FORCE(createSlice);
+    FORCE(listSliceUnboxed);
+    FORCE(strSliceUnboxed);
+    FORCE(listNonzeroUnboxed);
+    FORCE(tupleNonzeroUnboxed);
+    FORCE(dictNonzeroUnboxed);
+    FORCE(strNonzeroUnboxed);
+    FORCE(listLenUnboxed);
+    FORCE(tupleLenUnboxed);
+    FORCE(dictLenUnboxed);
+    FORCE(strLenUnboxed);
+    FORCE(strEqUnboxed);
+    FORCE(xrangeSumUnboxed);
+    FORCE(createClosure);
     FORCE(createClass);
 
     FORCE(getattr);
     FORCE(setattr);
     FORCE(print);
     FORCE(nonzero);
+    FORCE(iterNext);
     FORCE(binop);
     FORCE(compare);
     FORCE(unboxedLen);
@@ -74,7 +92,9 @@ void force() {
     FORCE(raiseAttributeError);
     FORCE(raiseAttributeErrorStr);
     FORCE(raiseNotIterableError);
+    FORCE(raise3);
     FORCE(assertNameDefined);
+    FORCE(raiseUndefinedClosureName);
 
     FORCE(printFloat);
     FORCE(listAppendInternal);
@@ -84,11 +104,15 @@ void force() {
     FORCE(runtimeCall);
     FORCE(callattr);
 
+    FORCE(add_i64_i64);
+    FORCE(sub_i64_i64);
+    FORCE(mul_i64_i64);
     FORCE(div_i64_i64);
     FORCE(mod_i64_i64);
     FORCE(pow_i64_i64);
 
     FORCE(div_float_float);
+    FORCE(floordiv_float_float);
     FORCE(mod_float_float);
     FORCE(pow_float_float);
 
@@ -15,6 +15,8 @@
 #include "runtime/list.h"
 #include "runtime/gc_runtime.h"
 
+#include "gc/collector.h"
+
 namespace pyston {
 
 BoxedListIterator::BoxedListIterator(BoxedList* l) : Box(&list_iterator_flavor, list_iterator_cls), l(l), pos(0) {
@@ -45,7 +47,18 @@ Box* listiterNext(Box* s) {
     BoxedListIterator* self = static_cast<BoxedListIterator*>(s);
 
     assert(self->pos >= 0 && self->pos < self->l->size);
-    Box* rtn = self->l->elts->elts[self->pos];
+    Box* rtn = self->l->getElt(self->pos);
+    self->pos++;
+    return rtn;
+}
+
+Box* listiterNextOrEnd(Box* s) {
+    assert(s->cls == list_iterator_cls);
+    BoxedListIterator* self = static_cast<BoxedListIterator*>(s);
+
+    if (self->pos >= self->l->size)
+        return NULL;
+    Box* rtn = self->l->getElt(self->pos);
     self->pos++;
     return rtn;
 }
@@ -63,21 +76,76 @@ void BoxedList::ensure(int space) {
             elts = (BoxedList::ElementArray*)rt_realloc(elts, new_capacity * sizeof(Box*) + sizeof(BoxedList::ElementArray));
             capacity = new_capacity;
         }
+        gc::writeBarrier(this, elts);
     }
     assert(capacity >= size + space);
 }
 
-// TODO the inliner doesn't want to inline these; is there any point to having them in the inline section?
+void BoxedList::setElt(int64_t i, Box* v) {
+    assert(0 <= i && i < size);
+    if (!canStoreUnchanged(v))
+        switchToObjectStrategy();
+
+    if (strategy == INT_STRATEGY) {
+        elts->intElts()[i] = static_cast<BoxedInt*>(v)->n;
+    } else if (strategy == FLOAT_STRATEGY) {
+        elts->floatElts()[i] = static_cast<BoxedFloat*>(v)->d;
+    } else {
+        elts->elts[i] = v;
+        gc::writeBarrier(this, v);
+    }
+}
+
+void BoxedList::switchToObjectStrategy() {
+    if (strategy == OBJECT_STRATEGY)
+        return;
+
+    // Boxing the elements can trigger a collection, so put the boxes into a separate list
+    // (that the collector knows how to scan) until they're all done:
+    BoxedList* boxed = new BoxedList();
+    boxed->ensure(std::max(capacity, (int64_t)1));
+    for (int64_t i = 0; i < size; i++) {
+        boxed->elts->elts[i] = getElt(i);
+        boxed->size = i + 1;
+        gc::writeBarrier(boxed, boxed->elts->elts[i]);
+    }
+
+    elts = boxed->elts;
+    capacity = boxed->capacity;
+    strategy = OBJECT_STRATEGY;
+    gc::rememberObject(this);
+
+    boxed->elts = NULL;
+    boxed->size = boxed->capacity = 0;
+}
+
+// Only the case where there's room and the element fits the current strategy is in here, so that it's
+// small enough for the inliner to put into the jitted code; everything else is in listAppendSlowpath.
 extern "C" void listAppendInternal(Box* s, Box* v) {
     assert(s->cls == list_cls);
     BoxedList* self = static_cast<BoxedList*>(s);
 
-    assert(self->size <= self->capacity);
-    self->ensure(1);
+    int64_t size = self->size;
+    if (size > 0 && size < self->capacity) {
+        if (self->strategy == BoxedList::OBJECT_STRATEGY) {
+            self->elts->elts[size] = v;
+            self->size = size + 1;
+            gc::writeBarrier(self, v);
+            return;
+        }
+        if (self->strategy == BoxedList::INT_STRATEGY && v->cls == int_cls) {
+            self->elts->intElts()[size] = static_cast<BoxedInt*>(v)->n;
+            self->size = size + 1;
+            return;
+        }
+        if (self->strategy == BoxedList::FLOAT_STRATEGY && v->cls == float_cls) {
+            self->elts->floatElts()[size] = static_cast<BoxedFloat*>(v)->d;
+            self->size = size + 1;
+            return;
+        }
+    }
 
-    assert(self->size < self->capacity);
-    self->elts->elts[self->size] = v;
-    self->size++;
+    listAppendSlowpath(self, v);
 }
 
 // TODO the inliner doesn't want to inline these; is there any point to having them in the inline section?
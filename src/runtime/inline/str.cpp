@@ -0,0 +1,37 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "core/types.h"
+
+#include "runtime/str.h"
+#include "runtime/types.h"
+
+#include "runtime/inline/boxing.h"
+
+namespace pyston {
+
+// Takes a Box* receiver, like the calls that irgen makes for known-str `__eq__` callattrs do, since the
+// inliner needs the argument types to match exactly.
+extern "C" Box* strEq(Box* lhs, Box* rhs) {
+    assert(lhs->cls == str_cls);
+    if (rhs->cls != str_cls)
+        return False;
+    return boxBool(static_cast<BoxedString*>(lhs)->equals(static_cast<BoxedString*>(rhs)));
+}
+
+extern "C" bool strEqUnboxed(BoxedString* lhs, BoxedString* rhs) {
+    return lhs->equals(rhs);
+}
+
+}
@@ -15,9 +15,12 @@
 #include "core/types.h"
 
 #include "runtime/types.h"
+#include "runtime/int.h"
 #include "runtime/objmodel.h"
 #include "runtime/gc_runtime.h"
 
+#include "runtime/inline/xrange.h"
+
 #include "codegen/compvars.h"
 
 namespace pyston {
@@ -36,6 +39,7 @@ class BoxedXrange : public Box {
         BoxedXrange(i64 start, i64 stop, i64 step) : Box(&xrange_flavor, xrange_cls), start(start), stop(stop), step(step) {}
 
         friend class BoxedXrangeIterator;
+        friend void xrangeElements(Box* xrange, i64* first, i64* step, i64* len);
 };
 
 class BoxedXrangeIterator : public Box {
@@ -54,16 +58,15 @@ class BoxedXrangeIterator : public Box {
 
         static Box* xrangeIteratorHasnext(Box *s) __attribute__((visibility("default"))) {
             assert(s->cls == xrange_iterator_cls);
-            BoxedXrangeIterator *self = static_cast<BoxedXrangeIterator*>(s);
-            assert(self->xrange->step > 0);
-            return boxBool(self->cur < self->xrange->stop);
+            return boxBool(xrangeIteratorHasnextUnboxed(s));
         }
 
         static bool xrangeIteratorHasnextUnboxed(Box *s) __attribute__((visibility("default"))) {
             assert(s->cls == xrange_iterator_cls);
             BoxedXrangeIterator *self = static_cast<BoxedXrangeIterator*>(s);
-            assert(self->xrange->step > 0);
-            return self->cur < self->xrange->stop;
+            if (self->xrange->step > 0)
+                return self->cur < self->xrange->stop;
+            return self->cur > self->xrange->stop;
         }
 
         static Box* xrangeIteratorNext(Box *s) __attribute__((visibility("default"))) {
@@ -75,6 +78,12 @@ class BoxedXrangeIterator : public Box {
             return boxInt(rtn);
         }
 
+        static Box* xrangeIteratorNextOrEnd(Box *s) __attribute__((visibility("default"))) {
+            if (!xrangeIteratorHasnextUnboxed(s))
+                return NULL;
+            return xrangeIteratorNext(s);
+        }
+
         static i64 xrangeIteratorNextUnboxed(Box *s) __attribute__((visibility("default"))) {
             assert(s->cls == xrange_iterator_cls);
             BoxedXrangeIterator *self = static_cast<BoxedXrangeIterator*>(s);
@@ -93,6 +102,50 @@ class BoxedXrangeIterator : public Box {
 };
 extern "C" const ObjectFlavor xrange_iterator_flavor(&BoxedXrangeIterator::xrangeIteratorGCHandler, NULL);
 
+void xrangeElements(Box* s, i64* first, i64* step, i64* len) {
+    assert(s->cls == xrange_cls);
+    BoxedXrange *self = static_cast<BoxedXrange*>(s);
+
+    *first = self->start;
+    *step = self->step;
+    // (the distance between start and stop can be too big for an i64, but not for a uint64)
+    if (self->step > 0 && self->start < self->stop)
+        *len = ((uint64_t)self->stop - (uint64_t)self->start - 1) / (uint64_t)self->step + 1;
+    else if (self->step < 0 && self->start > self->stop)
+        *len = ((uint64_t)self->start - (uint64_t)self->stop - 1) / (0 - (uint64_t)self->step) + 1;
+    else
+        *len = 0;
+}
+
+bool xrangeSum(Box* xrange, i64* rtn) {
+    i64 first, step, len;
+    xrangeElements(xrange, &first, &step, &len);
+    if (len == 0) {
+        *rtn = 0;
+        return true;
+    }
+    // Anything this long would take forever to go through anyway, and would overflow the products below:
+    if (len < 0 || len > (1L << 62))
+        return false;
+
+    // len * (first + last) is always even, so this is exact:
+    __int128 last = first + (__int128)(len - 1) * step;
+    __int128 total = (__int128)len * (first + last) / 2;
+    if (total != (i64)total)
+        return false;
+    *rtn = (i64)total;
+    return true;
+}
+
+// For irgen, which would rather not need a stack slot for the result: returns INT64_MIN when the sum doesn't
+// fit (and when it really is INT64_MIN), and irgen does those the slow way.
+extern "C" i64 xrangeSumUnboxed(Box* xrange) {
+    i64 rtn;
+    if (!xrangeSum(xrange, &rtn))
+        return INT64_MIN;
+    return rtn;
+}
+
 Box* xrange1(Box* cls, Box* stop) {
     assert(cls == xrange_cls);
     RELEASE_ASSERT(stop->cls == int_cls, "%s", getTypeName(stop)->c_str());
@@ -134,9 +187,9 @@ Box* xrangeIter(Box* self) {
 }
 
 void setupXrange() {
-    xrange_cls = new BoxedClass(false, NULL);
+    xrange_cls = new BoxedClass(&xrange_flavor, false, NULL);
     xrange_cls->giveAttr("__name__", boxStrConstant("xrange"));
-    xrange_iterator_cls = new BoxedClass(false, (BoxedClass::Dtor)BoxedXrangeIterator::xrangeIteratorDtor);
+    xrange_iterator_cls = new BoxedClass(&xrange_iterator_flavor, false, (BoxedClass::Dtor)BoxedXrangeIterator::xrangeIteratorDtor);
     xrange_iterator_cls->giveAttr("__name__", boxStrConstant("rangeiterator"));
 
     CLFunction *xrange_clf = boxRTFunction((void*)xrange1, NULL, 2, false);
@@ -152,6 +205,7 @@ void setupXrange() {
     CLFunction *next = boxRTFunction((void*)BoxedXrangeIterator::xrangeIteratorNextUnboxed, INT, 1, false);
     addRTFunction(next, (void*)BoxedXrangeIterator::xrangeIteratorNext, BOXED_INT, 1, false);
     xrange_iterator_cls->giveAttr("next", new BoxedFunction(next));
+    xrange_iterator_cls->iter_next = BoxedXrangeIterator::xrangeIteratorNextOrEnd;
 
     // TODO this is pretty hacky, but stuff the iterator cls into xrange to make sure it gets decref'd at the end
     xrange_cls->giveAttr("__iterator_cls__", xrange_iterator_cls);
@@ -15,10 +15,18 @@
 #ifndef PYSTON_RUNTIME_INLINE_XRANGE_H
 #define PYSTON_RUNTIME_INLINE_XRANGE_H
 
+#include "core/types.h"
+
 namespace pyston {
 
 void setupXrange();
 
+// The first element, the step and the number of elements of an xrange, for code that goes over one
+// without making an iterator:
+void xrangeElements(Box* xrange, i64* first, i64* step, i64* len);
+// Works out the sum of the elements from the bounds; returns false if it doesn't fit in an int.
+bool xrangeSum(Box* xrange, i64* rtn);
+
 }
 
 #endif
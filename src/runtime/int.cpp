@@ -14,13 +14,17 @@
 
 #include <sstream>
 
+#include "core/ast.h"
 #include "core/common.h"
 #include "core/options.h"
 #include "core/stats.h"
 #include "core/types.h"
 
+#include "runtime/dtoa.h"
+#include "runtime/float.h"
 #include "runtime/gc_runtime.h"
 #include "runtime/int.h"
+#include "runtime/long.h"
 #include "runtime/objmodel.h"
 #include "runtime/types.h"
 #include "runtime/util.h"
@@ -35,14 +39,41 @@ namespace pyston {
 
 BoxedInt* interned_ints[NUM_INTERNED_INTS];
 
+// The unboxed i64 versions can't change their result type, so when they overflow all they can do is
+// raise (irgen's unboxed math deopts to the boxed path instead); the boxed versions below promote to long.
+extern "C" void raiseIntOverflow() {
+    fprintf(stderr, "OverflowError: integer overflow\n");
+    raiseExc();
+}
+
+static bool powOverflows(i64 lhs, i64 rhs, i64* result) {
+    RELEASE_ASSERT(rhs >= 0, "");
+    i64 rtn = 1, curpow = lhs;
+    while (rhs) {
+        if ((rhs & 1) && mulOverflows(rtn, curpow, &rtn))
+            return true;
+        rhs >>= 1;
+        if (rhs && mulOverflows(curpow, curpow, &curpow))
+            return true;
+    }
+    *result = rtn;
+    return false;
+}
+
 // Could add this to the others, but the inliner should be smart enough
 // that this isn't needed:
 extern "C" i64 add_i64_i64(i64 lhs, i64 rhs) {
-    return lhs + rhs;
+    i64 rtn;
+    if (addOverflows(lhs, rhs, &rtn))
+        raiseIntOverflow();
+    return rtn;
 }
 
 extern "C" i64 sub_i64_i64(i64 lhs, i64 rhs) {
-    return lhs - rhs;
+    i64 rtn;
+    if (subOverflows(lhs, rhs, &rtn))
+        raiseIntOverflow();
+    return rtn;
 }
 
 extern "C" i64 div_i64_i64(i64 lhs, i64 rhs) {
@@ -50,6 +81,12 @@ extern "C" i64 div_i64_i64(i64 lhs, i64 rhs) {
         fprintf(stderr, "ZeroDivisionError: integer division or modulo by zero\n");
         raiseExc();
     }
+    // The one quotient that doesn't fit (and that the hardware divide would trap on):
+    if (rhs == -1) {
+        if (lhs == INT64_MIN)
+            raiseIntOverflow();
+        return -lhs;
+    }
     if (lhs < 0 && rhs > 0)
         return (lhs - rhs + 1) / rhs;
     if (lhs > 0 && rhs < 0)
@@ -62,6 +99,8 @@ extern "C" i64 mod_i64_i64(i64 lhs, i64 rhs) {
         fprintf(stderr, "ZeroDivisionError: integer division or modulo by zero\n");
         raiseExc();
     }
+    if (rhs == -1)
+        return 0;
     if (lhs < 0 && rhs > 0)
         return ((lhs + 1) % rhs) + (rhs - 1);
     if (lhs > 0 && rhs < 0)
@@ -70,20 +109,17 @@ extern "C" i64 mod_i64_i64(i64 lhs, i64 rhs) {
 }
 
 extern "C" i64 pow_i64_i64(i64 lhs, i64 rhs) {
-    // TODO overflow very possible
-    i64 rtn = 1, curpow = lhs;
-    RELEASE_ASSERT(rhs >= 0, "");
-    while (rhs) {
-        if (rhs & 1)
-            rtn *= curpow;
-        curpow *= curpow;
-        rhs >>= 1;
-    }
+    i64 rtn;
+    if (powOverflows(lhs, rhs, &rtn))
+        raiseIntOverflow();
     return rtn;
 }
 
 extern "C" i64 mul_i64_i64(i64 lhs, i64 rhs) {
-    return lhs * rhs;
+    i64 rtn;
+    if (mulOverflows(lhs, rhs, &rtn))
+        raiseIntOverflow();
+    return rtn;
 }
 
 extern "C" i1 eq_i64_i64(i64 lhs, i64 rhs) {
@@ -114,7 +150,10 @@ extern "C" i1 ge_i64_i64(i64 lhs, i64 rhs) {
 extern "C" Box* intAddInt(BoxedInt* lhs, BoxedInt *rhs) {
     assert(lhs->cls == int_cls);
     assert(rhs->cls == int_cls);
-    return boxInt(lhs->n + rhs->n);
+    i64 rtn;
+    if (addOverflows(lhs->n, rhs->n, &rtn))
+        return longAdd(longFromInt(lhs->n), rhs);
+    return boxInt(rtn);
 }
 
 extern "C" Box* intAddFloat(BoxedInt* lhs, BoxedFloat *rhs) {
@@ -126,8 +165,7 @@ extern "C" Box* intAddFloat(BoxedInt* lhs, BoxedFloat *rhs) {
 extern "C" Box* intAdd(BoxedInt* lhs, Box *rhs) {
     assert(lhs->cls == int_cls);
     if (rhs->cls == int_cls) {
-        BoxedInt *rhs_int = static_cast<BoxedInt*>(rhs);
-        return boxInt(lhs->n + rhs_int->n);
+        return intAddInt(lhs, static_cast<BoxedInt*>(rhs));
     } else if (rhs->cls == float_cls) {
         BoxedFloat *rhs_float = static_cast<BoxedFloat*>(rhs);
         return boxFloat(lhs->n + rhs_float->d);
@@ -148,6 +186,8 @@ extern "C" Box* intAnd(BoxedInt* lhs, Box *rhs) {
 extern "C" Box* intDivInt(BoxedInt* lhs, BoxedInt *rhs) {
     assert(lhs->cls == int_cls);
     assert(rhs->cls == int_cls);
+    if (lhs->n == INT64_MIN && rhs->n == -1)
+        return longNeg(longFromInt(lhs->n));
     return boxInt(div_i64_i64(lhs->n, rhs->n));
 }
 
@@ -173,6 +213,18 @@ extern "C" Box* intDiv(BoxedInt* lhs, Box *rhs) {
     }
 }
 
+extern "C" Box* intFloorDiv(BoxedInt* lhs, Box *rhs) {
+    assert(lhs->cls == int_cls);
+    if (rhs->cls == int_cls) {
+        return intDivInt(lhs, static_cast<BoxedInt*>(rhs));
+    } else if (rhs->cls == float_cls) {
+        BoxedFloat *rhs_float = static_cast<BoxedFloat*>(rhs);
+        return boxFloat(floordiv_float_float(lhs->n, rhs_float->d));
+    } else {
+        return NotImplemented;
+    }
+}
+
 extern "C" Box* intEq(BoxedInt* lhs, Box *rhs) {
     assert(lhs->cls == int_cls);
     if (rhs->cls != int_cls) {
@@ -249,7 +301,10 @@ extern "C" Box* intMod(BoxedInt* lhs, Box *rhs) {
 extern "C" Box* intMulInt(BoxedInt* lhs, BoxedInt *rhs) {
     assert(lhs->cls == int_cls);
     assert(rhs->cls == int_cls);
-    return boxInt(lhs->n * rhs->n);
+    i64 rtn;
+    if (mulOverflows(lhs->n, rhs->n, &rtn))
+        return longMul(longFromInt(lhs->n), rhs);
+    return boxInt(rtn);
 }
 
 extern "C" Box* intMulFloat(BoxedInt* lhs, BoxedFloat *rhs) {
@@ -261,8 +316,7 @@ extern "C" Box* intMulFloat(BoxedInt* lhs, BoxedFloat *rhs) {
 extern "C" Box* intMul(BoxedInt* lhs, Box *rhs) {
     assert(lhs->cls == int_cls);
     if (rhs->cls == int_cls) {
-        BoxedInt *rhs_int = static_cast<BoxedInt*>(rhs);
-        return boxInt(lhs->n * rhs_int->n);
+        return intMulInt(lhs, static_cast<BoxedInt*>(rhs));
     } else if (rhs->cls == float_cls) {
         BoxedFloat *rhs_float = static_cast<BoxedFloat*>(rhs);
         return boxFloat(lhs->n * rhs_float->d);
@@ -277,7 +331,10 @@ extern "C" Box* intPow(BoxedInt* lhs, Box *rhs) {
         return NotImplemented;
     }
     BoxedInt *rhs_int = static_cast<BoxedInt*>(rhs);
-    return boxInt(pow_i64_i64(lhs->n, rhs_int->n));
+    i64 rtn;
+    if (powOverflows(lhs->n, rhs_int->n, &rtn))
+        return longPow(longFromInt(lhs->n), rhs);
+    return boxInt(rtn);
 }
 
 extern "C" Box* intRShift(BoxedInt* lhs, Box *rhs) {
@@ -292,7 +349,10 @@ extern "C" Box* intRShift(BoxedInt* lhs, Box *rhs) {
 extern "C" Box* intSubInt(BoxedInt* lhs, BoxedInt *rhs) {
     assert(lhs->cls == int_cls);
     assert(rhs->cls == int_cls);
-    return boxInt(lhs->n - rhs->n);
+    i64 rtn;
+    if (subOverflows(lhs->n, rhs->n, &rtn))
+        return longSub(longFromInt(lhs->n), rhs);
+    return boxInt(rtn);
 }
 
 extern "C" Box* intSubFloat(BoxedInt* lhs, BoxedFloat *rhs) {
@@ -304,8 +364,7 @@ extern "C" Box* intSubFloat(BoxedInt* lhs, BoxedFloat *rhs) {
 extern "C" Box* intSub(BoxedInt* lhs, Box *rhs) {
     assert(lhs->cls == int_cls);
     if (rhs->cls == int_cls) {
-        BoxedInt *rhs_int = static_cast<BoxedInt*>(rhs);
-        return boxInt(lhs->n - rhs_int->n);
+        return intSubInt(lhs, static_cast<BoxedInt*>(rhs));
     } else if (rhs->cls == float_cls) {
         BoxedFloat *rhs_float = static_cast<BoxedFloat*>(rhs);
         return boxFloat(lhs->n - rhs_float->d);
@@ -326,6 +385,8 @@ extern "C" Box* intPos(BoxedInt* v) {
 
 extern "C" Box* intNeg(BoxedInt* v) {
     assert(v->cls == int_cls);
+    if (v->n == INT64_MIN)
+        return longNeg(longFromInt(v->n));
     return boxInt(-v->n);
 }
 
@@ -336,8 +397,8 @@ extern "C" Box* intNonzero(BoxedInt* v) {
 
 extern "C" BoxedString* intRepr(BoxedInt* v) {
     assert(v->cls == int_cls);
-    char buf[80];
-    int len = snprintf(buf, 80, "%ld", v->n);
+    char buf[24];
+    int len = intToDecimal(v->n, buf);
     return new BoxedString(std::string(buf, len));
 }
 
@@ -348,7 +409,7 @@ extern "C" Box* intHash(BoxedInt* self) {
 
 extern "C" Box* intNew1(Box* cls) {
     assert(cls == int_cls);
-    return new BoxedInt(0);
+    return boxInt(0);
 }
 
 extern "C" Box* intNew2(Box* cls, Box* val) {
@@ -407,6 +468,7 @@ void setupInt() {
     int_cls->giveAttr("__and__", new BoxedFunction(boxRTFunction((void*)intAnd, NULL, 2, false)));
     _addFunc("__div__", (void*)intDivInt, (void*)intDivFloat, (void*)intDiv);
     //int_cls->giveAttr("__div__", new BoxedFunction(boxRTFunction((void*)intDiv, NULL, 2, false)));
+    int_cls->giveAttr("__floordiv__", new BoxedFunction(boxRTFunction((void*)intFloorDiv, NULL, 2, false)));
     int_cls->giveAttr("__eq__", new BoxedFunction(boxRTFunction((void*)intEq, NULL, 2, false)));
     int_cls->giveAttr("__ne__", new BoxedFunction(boxRTFunction((void*)intNe, NULL, 2, false)));
     int_cls->giveAttr("__lt__", new BoxedFunction(boxRTFunction((void*)intLt, NULL, 2, false)));
@@ -440,8 +502,21 @@ void setupInt() {
 
     int_cls->freeze();
 
+    registerBinopImpl(int_cls, int_cls, AST_TYPE::Add, (void*)intAddInt);
+    registerBinopImpl(int_cls, int_cls, AST_TYPE::Sub, (void*)intSubInt);
+    registerBinopImpl(int_cls, int_cls, AST_TYPE::Mult, (void*)intMulInt);
+    registerBinopImpl(int_cls, float_cls, AST_TYPE::Add, (void*)intAddFloat);
+    registerBinopImpl(int_cls, float_cls, AST_TYPE::Sub, (void*)intSubFloat);
+    registerBinopImpl(int_cls, float_cls, AST_TYPE::Mult, (void*)intMulFloat);
+    registerBinopImpl(int_cls, int_cls, AST_TYPE::Eq, (void*)intEq);
+    registerBinopImpl(int_cls, int_cls, AST_TYPE::NotEq, (void*)intNe);
+    registerBinopImpl(int_cls, int_cls, AST_TYPE::Lt, (void*)intLt);
+    registerBinopImpl(int_cls, int_cls, AST_TYPE::LtE, (void*)intLe);
+    registerBinopImpl(int_cls, int_cls, AST_TYPE::Gt, (void*)intGt);
+    registerBinopImpl(int_cls, int_cls, AST_TYPE::GtE, (void*)intGe);
+
     for (int i = 0; i < NUM_INTERNED_INTS; i++) {
-        interned_ints[i] = new BoxedInt(i);
+        interned_ints[i] = new BoxedInt(MIN_INTERNED_INT + i);
         gc::registerStaticRootObj(interned_ints[i]);
     }
 }
@@ -37,9 +37,30 @@ extern "C" i1 lt_i64_i64(i64 lhs, i64 rhs);
 extern "C" i1 le_i64_i64(i64 lhs, i64 rhs);
 extern "C" i1 gt_i64_i64(i64 lhs, i64 rhs);
 extern "C" i1 ge_i64_i64(i64 lhs, i64 rhs);
+extern "C" void raiseIntOverflow() __attribute__((__noreturn__));
+
+// Overflow-checked arithmetic: these return whether the result overflowed, and store the
+// (possibly wrapped) result into *result either way.
+static inline bool addOverflows(i64 lhs, i64 rhs, i64* result) {
+    *result = (i64)((uint64_t)lhs + (uint64_t)rhs);
+    return ((lhs ^ *result) & (rhs ^ *result)) < 0;
+}
+
+static inline bool subOverflows(i64 lhs, i64 rhs, i64* result) {
+    *result = (i64)((uint64_t)lhs - (uint64_t)rhs);
+    return ((lhs ^ rhs) & (lhs ^ *result)) < 0;
+}
+
+static inline bool mulOverflows(i64 lhs, i64 rhs, i64* result) {
+    __int128 full = (__int128)lhs * rhs;
+    *result = (i64)full;
+    return full != *result;
+}
+
 extern "C" Box* intAdd(BoxedInt* lhs, Box *rhs);
 extern "C" Box* intAnd(BoxedInt* lhs, Box *rhs);
 extern "C" Box* intDiv(BoxedInt* lhs, Box *rhs);
+extern "C" Box* intFloorDiv(BoxedInt* lhs, Box *rhs);
 extern "C" Box* intEq(BoxedInt* lhs, Box *rhs);
 extern "C" Box* intNe(BoxedInt* lhs, Box *rhs);
 extern "C" Box* intLt(BoxedInt* lhs, Box *rhs);
@@ -62,7 +83,11 @@ extern "C" Box* intNew2(Box* cls, Box* val);
 extern "C" Box* intInit1(BoxedInt* self);
 extern "C" Box* intInit2(BoxedInt* self, Box* val);
 
-#define NUM_INTERNED_INTS 100
+// boxInt() hands out preallocated objects for ints in [MIN_INTERNED_INT, MAX_INTERNED_INT), which
+// covers most loop counters and small results; interned_ints[i] holds MIN_INTERNED_INT + i.
+#define MIN_INTERNED_INT -5
+#define MAX_INTERNED_INT 1024
+#define NUM_INTERNED_INTS (MAX_INTERNED_INT - MIN_INTERNED_INT)
 extern BoxedInt* interned_ints[NUM_INTERNED_INTS];
 
 }
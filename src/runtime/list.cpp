@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <climits>
 #include <cstring>
 #include <sstream>
 
@@ -32,18 +34,17 @@
 namespace pyston {
 
 extern "C" Box* listRepr(BoxedList* self) {
-    // TODO highly inefficient with all the string copying
-    std::ostringstream os;
-    os << '[';
+    StringBuilder os;
+    os.append('[');
     for (int i = 0; i < self->size; i++) {
         if (i > 0)
-            os << ", ";
+            os.append(", ", 2);
 
-        BoxedString *s = repr(self->elts->elts[i]);
-        os << s->s;
+        BoxedString *s = repr(self->getElt(i));
+        os.append(s->s);
     }
-    os << ']';
-    return new BoxedString(os.str());
+    os.append(']');
+    return os.finish();
 }
 
 extern "C" Box* listNonzero(BoxedList* self) {
@@ -56,8 +57,8 @@ extern "C" Box* listPop1(BoxedList* self) {
         raiseExc();
     }
 
+    Box* rtn = self->getElt(self->size - 1);
     self->size--;
-    Box* rtn = self->elts->elts[self->size];
     return rtn;
 }
 
@@ -79,7 +80,7 @@ extern "C" Box* listPop2(BoxedList* self, Box* idx) {
         raiseExc();
     }
 
-    Box* rtn = self->elts->elts[n];
+    Box* rtn = self->getElt(n);
     memmove(self->elts->elts + n, self->elts->elts + n + 1, (self->size - n - 1) * sizeof(Box*));
     self->size--;
 
@@ -87,7 +88,7 @@ extern "C" Box* listPop2(BoxedList* self, Box* idx) {
 }
 
 extern "C" Box* listLen(BoxedList* self) {
-    return new BoxedInt(self->size);
+    return boxInt(self->size);
 }
 
 Box* _listSlice(BoxedList *self, i64 start, i64 stop, i64 step) {
@@ -105,12 +106,18 @@ Box* _listSlice(BoxedList *self, i64 start, i64 stop, i64 step) {
 
     int cur = start;
     while ((step > 0 && cur < stop) || (step < 0 && cur > stop)) {
-        listAppendInternal(rtn, self->elts->elts[cur]);
+        listAppendInternal(rtn, self->getElt(cur));
         cur += step;
     }
     return rtn;
 }
 
+extern "C" Box* listSliceUnboxed(BoxedList* self, i64 start, i64 stop, i64 step) {
+    assert(self->cls == list_cls);
+    parseSliceBounds(self->size, start, stop, step, &start, &stop, &step);
+    return _listSlice(self, start, stop, step);
+}
+
 extern "C" Box* listGetitem(BoxedList* self, Box* slice) {
     if (slice->cls == int_cls) {
         BoxedInt* islice = static_cast<BoxedInt*>(slice);
@@ -122,7 +129,7 @@ extern "C" Box* listGetitem(BoxedList* self, Box* slice) {
             fprintf(stderr, "IndexError: list index out of range\n");
             raiseExc();
         }
-        Box* rtn = self->elts->elts[n];
+        Box* rtn = self->getElt(n);
         return rtn;
     } else if (slice->cls == slice_cls) {
         BoxedSlice *sslice = static_cast<BoxedSlice*>(slice);
@@ -148,8 +155,7 @@ extern "C" Box* listSetitem(BoxedList* self, Box* slice, Box* v) {
             raiseExc();
         }
 
-        Box* prev = self->elts->elts[n];
-        self->elts->elts[n] = v;
+        self->setElt(n, v);
 
         return None;
     } else if (slice->cls == slice_cls) {
@@ -166,6 +172,16 @@ extern "C" Box* listSetitem(BoxedList* self, Box* slice, Box* v) {
         ASSERT(v->cls == list_cls, "unsupported %s", getTypeName(v)->c_str());
         BoxedList *lv = static_cast<BoxedList*>(v);
 
+        // Make sure the elements can just get copied over:
+        if (lv->size && lv->strategy != self->strategy) {
+            if (self->size == 0) {
+                self->strategy = lv->strategy;
+            } else {
+                self->switchToObjectStrategy();
+                lv->switchToObjectStrategy();
+            }
+        }
+
         int delts = lv->size - (stop - start);
         int remaining_elts = self->size - stop;
         self->ensure(delts);
@@ -177,6 +193,7 @@ extern "C" Box* listSetitem(BoxedList* self, Box* slice, Box* v) {
         }
 
         self->size += delts;
+        gc::rememberObject(self);
 
         return None;
     } else {
@@ -185,6 +202,27 @@ extern "C" Box* listSetitem(BoxedList* self, Box* slice, Box* v) {
     }
 }
 
+extern "C" void listAppendSlowpath(BoxedList* self, Box* v) {
+    // Empty lists can pick whichever strategy fits the first element:
+    if (self->size == 0) {
+        if (v->cls == int_cls)
+            self->strategy = BoxedList::INT_STRATEGY;
+        else if (v->cls == float_cls)
+            self->strategy = BoxedList::FLOAT_STRATEGY;
+        else
+            self->strategy = BoxedList::OBJECT_STRATEGY;
+    } else if (!self->canStoreUnchanged(v)) {
+        self->switchToObjectStrategy();
+    }
+
+    assert(self->size <= self->capacity);
+    self->ensure(1);
+
+    assert(self->size < self->capacity);
+    self->size++;
+    self->setElt(self->size - 1, v);
+}
+
 extern "C" Box* listInsert(BoxedList* self, Box* idx, Box* v) {
     if (idx->cls != int_cls) {
         fprintf(stderr, "TypeError: an integer is required\n");
@@ -206,30 +244,192 @@ extern "C" Box* listInsert(BoxedList* self, Box* idx, Box* v) {
         memmove(self->elts->elts + n + 1, self->elts->elts + n, (self->size - n) * sizeof(Box*));
 
         self->size++;
-        self->elts->elts[n] = v;
+        self->setElt(n, v);
     }
 
     return None;
 }
 
+// A simplified timsort: find the runs that are already there (reversing strictly descending ones),
+// extend short ones with a binary insertion sort, and merge them in the same order timsort would.
+// It's stable, and close to linear on input that's already mostly sorted.
+template <class T, class Lt>
+static void adaptiveSort(T* a, int64_t n, Lt lt) {
+    const int64_t MIN_RUN = 32;
+
+    // (start, end) of the runs that still need merging; each is at least twice as long as the next.
+    std::vector<std::pair<int64_t, int64_t> > runs;
+    auto mergeTop = [&]() {
+        std::pair<int64_t, int64_t> second = runs.back();
+        runs.pop_back();
+        std::pair<int64_t, int64_t> &first = runs.back();
+        assert(first.second == second.first);
+        std::inplace_merge(a + first.first, a + first.second, a + second.second, lt);
+        first.second = second.second;
+    };
+
+    int64_t i = 0;
+    while (i < n) {
+        int64_t j = i + 1;
+        if (j < n && lt(a[j], a[i])) {
+            while (j < n && lt(a[j], a[j - 1]))
+                j++;
+            std::reverse(a + i, a + j);
+        } else {
+            while (j < n && !lt(a[j], a[j - 1]))
+                j++;
+        }
+
+        int64_t end = std::min(n, std::max(j, i + MIN_RUN));
+        for (int64_t k = j; k < end; k++) {
+            T v = a[k];
+            T* pos = std::upper_bound(a + i, a + k, v, lt);
+            memmove(pos + 1, pos, (a + k - pos) * sizeof(T));
+            *pos = v;
+        }
+
+        runs.push_back(std::make_pair(i, end));
+        while (runs.size() >= 2) {
+            int64_t top = runs[runs.size() - 1].second - runs[runs.size() - 1].first;
+            int64_t below = runs[runs.size() - 2].second - runs[runs.size() - 2].first;
+            if (below > top * 2)
+                break;
+            mergeTop();
+        }
+        i = end;
+    }
+
+    while (runs.size() >= 2)
+        mergeTop();
+}
+
+namespace {
+struct IntLt {
+    bool operator()(Box* lhs, Box* rhs) const {
+        return static_cast<BoxedInt*>(lhs)->n < static_cast<BoxedInt*>(rhs)->n;
+    }
+};
+struct FloatLt {
+    bool operator()(Box* lhs, Box* rhs) const {
+        return static_cast<BoxedFloat*>(lhs)->d < static_cast<BoxedFloat*>(rhs)->d;
+    }
+};
+struct StrLt {
+    bool operator()(Box* lhs, Box* rhs) const {
+        return static_cast<BoxedString*>(lhs)->s < static_cast<BoxedString*>(rhs)->s;
+    }
+};
+}
+
+extern "C" Box* listSort(BoxedList* self) {
+    assert(self->cls == list_cls);
+
+    int64_t size = self->size;
+    if (size < 2)
+        return None;
+
+    // Unboxed elements can be compared directly:
+    if (self->strategy == BoxedList::INT_STRATEGY) {
+        adaptiveSort(self->elts->intElts(), size, std::less<int64_t>());
+        return None;
+    }
+    if (self->strategy == BoxedList::FLOAT_STRATEGY) {
+        adaptiveSort(self->elts->floatElts(), size, std::less<double>());
+        return None;
+    }
+
+    // So can lists that only have one of the builtin types, as long as it's the same throughout:
+    Box** elts = self->elts->elts;
+    BoxedClass* cls = elts[0]->cls;
+    bool homogeneous = (cls == int_cls || cls == float_cls || cls == str_cls);
+    for (int64_t i = 1; homogeneous && i < size; i++) {
+        if (elts[i]->cls != cls)
+            homogeneous = false;
+    }
+
+    if (homogeneous) {
+        if (cls == int_cls)
+            adaptiveSort(elts, size, IntLt());
+        else if (cls == float_cls)
+            adaptiveSort(elts, size, FloatLt());
+        else
+            adaptiveSort(elts, size, StrLt());
+        return None;
+    }
+
+    // Everything else goes through __lt__, which can run arbitrary code (and collections).
+    // The merges temporarily move elements out into buffers the collector can't see, so keep
+    // a copy of the original contents around while we sort:
+    // (volatile, so that the pointer stays on the stack where the collector will find it)
+    BoxedList* volatile keepalive = new BoxedList();
+    keepalive->ensure(size);
+    memcpy(keepalive->elts->elts, self->elts->elts, size * sizeof(Box*));
+    keepalive->size = size;
+
+    adaptiveSort(self->elts->elts, size, PyLt());
+
+    keepalive->size = 0;
+    return None;
+}
+
 Box* listMul(BoxedList* self, Box* rhs) {
     if (rhs->cls != int_cls) {
         fprintf(stderr, "TypeError: can't multiply sequence by non-int of type '%s'\n", getTypeName(rhs)->c_str());
         raiseExc();
     }
 
-    int n = static_cast<BoxedInt*>(rhs)->n;
-    int s = self->size;
+    int64_t n = static_cast<BoxedInt*>(rhs)->n;
+    int64_t s = self->size;
 
     BoxedList* rtn = new BoxedList();
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < s; j++) {
-            listAppendInternal(rtn, self->elts->elts[j]);
-        }
+    if (n <= 0 || s == 0)
+        return rtn;
+    if (n > INT_MAX / s) {
+        fprintf(stderr, "MemoryError\n");
+        raiseExc();
     }
+
+    // All the strategies have 8-byte elements, so the copies work the same way (and don't box anything);
+    // the result only gets allocated once:
+    rtn->ensure(n * s);
+    rtn->strategy = self->strategy;
+    for (int64_t i = 0; i < n; i++)
+        memcpy(rtn->elts->elts + i * s, self->elts->elts, s * sizeof(Box*));
+    rtn->size = n * s;
+    if (rtn->strategy == BoxedList::OBJECT_STRATEGY)
+        gc::rememberObject(rtn);
     return rtn;
 }
 
+Box* listContains(BoxedList* self, Box* elt) {
+    int64_t size = self->size;
+    // Unboxed elements can be compared directly:
+    if (self->strategy == BoxedList::INT_STRATEGY && elt->cls == int_cls) {
+        int64_t n = static_cast<BoxedInt*>(elt)->n;
+        int64_t* elts = self->elts->intElts();
+        for (int64_t i = 0; i < size; i++) {
+            if (elts[i] == n)
+                return True;
+        }
+        return False;
+    }
+    if (self->strategy == BoxedList::FLOAT_STRATEGY && elt->cls == float_cls) {
+        double d = static_cast<BoxedFloat*>(elt)->d;
+        double* elts = self->elts->floatElts();
+        for (int64_t i = 0; i < size; i++) {
+            if (elts[i] == d)
+                return True;
+        }
+        return False;
+    }
+
+    for (int64_t i = 0; i < self->size; i++) {
+        if (PyEq()(self->getElt(i), elt))
+            return True;
+    }
+    return False;
+}
+
 BoxedClass *list_iterator_cls = NULL;
 extern "C" void listIteratorGCHandler(GCVisitor *v, void* p) {
     boxGCHandler(v, p);
@@ -257,6 +457,7 @@ extern "C" Box* listNew2(Box* cls, Box* rhs) {
     BoxedList *rtn = new BoxedList();
     rtn->elts = new (size) BoxedList::ElementArray();
     memcpy(rtn->elts->elts, lrhs->elts->elts, size * sizeof(Box*));
+    rtn->strategy = lrhs->strategy;
     rtn->size = size;
     rtn->capacity = size;
     return rtn;
@@ -268,7 +469,7 @@ void list_dtor(BoxedList* self) {
 }
 
 void setupList() {
-    list_iterator_cls = new BoxedClass(false, (BoxedClass::Dtor)listiterDtor);
+    list_iterator_cls = new BoxedClass(&list_iterator_flavor, false, (BoxedClass::Dtor)listiterDtor);
 
     list_cls->giveAttr("__name__", boxStrConstant("list"));
 
@@ -288,6 +489,8 @@ void setupList() {
     list_cls->giveAttr("__setitem__", new BoxedFunction(boxRTFunction((void*)listSetitem, NULL, 3, false)));
     list_cls->giveAttr("insert", new BoxedFunction(boxRTFunction((void*)listInsert, NULL, 3, false)));
     list_cls->giveAttr("__mul__", new BoxedFunction(boxRTFunction((void*)listMul, NULL, 2, false)));
+    list_cls->giveAttr("sort", new BoxedFunction(boxRTFunction((void*)listSort, NULL, 1, false)));
+    list_cls->giveAttr("__contains__", new BoxedFunction(boxRTFunction((void*)listContains, BOXED_BOOL, 2, false)));
 
     CLFunction *new_ = boxRTFunction((void*)listNew1, NULL, 1, false);
     addRTFunction(new_, (void*)listNew2, NULL, 2, false);
@@ -295,6 +498,8 @@ void setupList() {
 
     list_cls->freeze();
 
+    registerContainsImpl(list_cls, (void*)listContains);
+
 
     gc::registerStaticRootObj(list_iterator_cls);
     list_iterator_cls->giveAttr("__name__", boxStrConstant("listiterator"));
@@ -303,6 +508,7 @@ void setupList() {
     addRTFunction(hasnext, (void*)listiterHasnext, BOXED_BOOL, 1, false);
     list_iterator_cls->giveAttr("__hasnext__", new BoxedFunction(hasnext));
     list_iterator_cls->giveAttr("next", new BoxedFunction(boxRTFunction((void*)listiterNext, UNKNOWN, 1, false)));
+    list_iterator_cls->iter_next = listiterNextOrEnd;
 
     list_iterator_cls->freeze();
 }
@@ -24,7 +24,7 @@ namespace pyston {
 extern BoxedClass *list_iterator_cls;
 struct BoxedListIterator : public Box {
     BoxedList *l;
-    int pos;
+    int64_t pos;
     BoxedListIterator(BoxedList* l);
 };
 
@@ -33,7 +33,11 @@ Box* listIter(Box* self);
 Box* listiterHasnext(Box *self);
 i1 listiterHasnextUnboxed(Box *self);
 Box* listiterNext(Box *self);
+Box* listiterNextOrEnd(Box *self);
 extern "C" Box* listAppend(Box* self, Box* v);
+// The part of listAppendInternal that has to grow the list or change its strategy:
+extern "C" void listAppendSlowpath(BoxedList* self, Box* v);
+extern "C" Box* listSort(BoxedList* self);
 
 }
 
@@ -0,0 +1,581 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cctype>
+#include <cmath>
+
+#include "core/common.h"
+#include "core/types.h"
+
+#include "runtime/gc_runtime.h"
+#include "runtime/long.h"
+#include "runtime/objmodel.h"
+#include "runtime/types.h"
+#include "runtime/util.h"
+
+namespace pyston {
+
+typedef std::vector<uint32_t> Digits;
+
+// The magnitude helpers all work on normalized digit vectors (see BoxedLong); the outputs
+// must not alias the inputs.
+
+static void trim(Digits &d) {
+    while (!d.empty() && d.back() == 0)
+        d.pop_back();
+}
+
+static int cmpMagnitude(const Digits &a, const Digits &b) {
+    if (a.size() != b.size())
+        return a.size() < b.size() ? -1 : 1;
+    for (int i = a.size() - 1; i >= 0; i--) {
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static void addMagnitude(const Digits &a, const Digits &b, Digits &out) {
+    const Digits &big = a.size() >= b.size() ? a : b;
+    const Digits &small = a.size() >= b.size() ? b : a;
+
+    out.resize(big.size() + 1);
+    uint64_t carry = 0;
+    for (int i = 0; i < big.size(); i++) {
+        carry += big[i];
+        if (i < small.size())
+            carry += small[i];
+        out[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    out[big.size()] = (uint32_t)carry;
+    trim(out);
+}
+
+// requires |a| >= |b|
+static void subMagnitude(const Digits &a, const Digits &b, Digits &out) {
+    out.resize(a.size());
+    int64_t borrow = 0;
+    for (int i = 0; i < a.size(); i++) {
+        int64_t v = (int64_t)a[i] - borrow - (i < b.size() ? b[i] : 0);
+        borrow = v < 0;
+        if (borrow)
+            v += (1LL << 32);
+        out[i] = (uint32_t)v;
+    }
+    trim(out);
+}
+
+static void mulMagnitude(const Digits &a, const Digits &b, Digits &out) {
+    out.clear();
+    if (a.empty() || b.empty())
+        return;
+
+    out.resize(a.size() + b.size(), 0);
+    for (int i = 0; i < a.size(); i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < b.size(); j++) {
+            uint64_t t = (uint64_t)a[i] * b[j] + out[i + j] + carry;
+            out[i + j] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        out[i + b.size()] = (uint32_t)carry;
+    }
+    trim(out);
+}
+
+// Divides d in place, returning the remainder.
+static uint32_t divmodSmall(Digits &d, uint32_t divisor) {
+    uint64_t rem = 0;
+    for (int i = d.size() - 1; i >= 0; i--) {
+        uint64_t cur = (rem << 32) | d[i];
+        d[i] = (uint32_t)(cur / divisor);
+        rem = cur % divisor;
+    }
+    trim(d);
+    return (uint32_t)rem;
+}
+
+// Truncating division of magnitudes.  Multi-digit divisors go one bit at a time, which is slow but
+// simple; dividing by something that fits in a digit (the common case) doesn't go through here.
+static void divmodMagnitude(const Digits &a, const Digits &b, Digits &q, Digits &r) {
+    assert(!b.empty());
+    if (b.size() == 1) {
+        q = a;
+        uint32_t rem = divmodSmall(q, b[0]);
+        r.clear();
+        if (rem)
+            r.push_back(rem);
+        return;
+    }
+
+    q.assign(a.size(), 0);
+    r.clear();
+    Digits t;
+    for (int i = a.size() * 32 - 1; i >= 0; i--) {
+        uint32_t carry = (a[i / 32] >> (i % 32)) & 1;
+        for (int j = 0; j < r.size(); j++) {
+            uint32_t next = r[j] >> 31;
+            r[j] = (r[j] << 1) | carry;
+            carry = next;
+        }
+        if (carry)
+            r.push_back(carry);
+
+        if (cmpMagnitude(r, b) >= 0) {
+            subMagnitude(r, b, t);
+            r.swap(t);
+            q[i / 32] |= (1u << (i % 32));
+        }
+    }
+    trim(q);
+}
+
+static BoxedLong* makeLong(bool negative, Digits &digits) {
+    BoxedLong* rtn = new BoxedLong();
+    rtn->digits.swap(digits);
+    rtn->negative = negative && !rtn->digits.empty();
+    return rtn;
+}
+
+BoxedLong* longFromInt(i64 n) {
+    BoxedLong* rtn = new BoxedLong();
+    rtn->negative = n < 0;
+    uint64_t u = n < 0 ? -(uint64_t)n : (uint64_t)n;
+    while (u) {
+        rtn->digits.push_back((uint32_t)u);
+        u >>= 32;
+    }
+    return rtn;
+}
+
+static bool longToInt64(BoxedLong* v, i64* out) {
+    if (v->digits.size() > 2)
+        return false;
+
+    uint64_t u = 0;
+    for (int i = v->digits.size() - 1; i >= 0; i--)
+        u = (u << 32) | v->digits[i];
+
+    if (v->negative) {
+        if (u > (1ULL << 63))
+            return false;
+        *out = (i64)(-u);
+    } else {
+        if (u > (uint64_t)INT64_MAX)
+            return false;
+        *out = (i64)u;
+    }
+    return true;
+}
+
+static double longToDouble(BoxedLong* v) {
+    double r = 0;
+    for (int i = v->digits.size() - 1; i >= 0; i--)
+        r = r * 4294967296.0 + v->digits[i];
+    return v->negative ? -r : r;
+}
+
+// Converts the other operand of a binop; returns NULL for types we don't know how to combine with.
+static BoxedLong* asLong(Box* b) {
+    if (b->cls == long_cls)
+        return static_cast<BoxedLong*>(b);
+    if (b->cls == int_cls)
+        return longFromInt(static_cast<BoxedInt*>(b)->n);
+    return NULL;
+}
+
+static BoxedLong* addSigned(BoxedLong* a, BoxedLong* b, bool negate_b) {
+    bool b_negative = b->negative ^ negate_b;
+    Digits out;
+    bool negative;
+    if (a->negative == b_negative) {
+        addMagnitude(a->digits, b->digits, out);
+        negative = a->negative;
+    } else if (cmpMagnitude(a->digits, b->digits) >= 0) {
+        subMagnitude(a->digits, b->digits, out);
+        negative = a->negative;
+    } else {
+        subMagnitude(b->digits, a->digits, out);
+        negative = b_negative;
+    }
+    return makeLong(negative, out);
+}
+
+static BoxedLong* mulSigned(BoxedLong* a, BoxedLong* b) {
+    Digits out;
+    mulMagnitude(a->digits, b->digits, out);
+    return makeLong(a->negative != b->negative, out);
+}
+
+// Floor division, like the int versions: the remainder takes the sign of the divisor.
+static void divmodSigned(BoxedLong* a, BoxedLong* b, BoxedLong** q_out, BoxedLong** r_out) {
+    if (b->digits.empty()) {
+        fprintf(stderr, "ZeroDivisionError: long division or modulo by zero\n");
+        raiseExc();
+    }
+
+    Digits q, r;
+    divmodMagnitude(a->digits, b->digits, q, r);
+
+    if (a->negative != b->negative && !r.empty()) {
+        Digits one(1, 1), t;
+        addMagnitude(q, one, t);
+        q.swap(t);
+        subMagnitude(b->digits, r, t);
+        r.swap(t);
+    }
+
+    if (q_out)
+        *q_out = makeLong(a->negative != b->negative, q);
+    if (r_out)
+        *r_out = makeLong(b->negative, r);
+}
+
+static Box* powSigned(BoxedLong* base, BoxedLong* exp) {
+    if (exp->negative)
+        return boxFloat(pow(longToDouble(base), longToDouble(exp)));
+
+    i64 n;
+    if (!longToInt64(exp, &n)) {
+        fprintf(stderr, "OverflowError: exponent too large\n");
+        raiseExc();
+    }
+
+    Digits rtn(1, 1), cur(base->digits), t;
+    bool negative = base->negative && (n & 1);
+    while (n) {
+        if (n & 1) {
+            mulMagnitude(rtn, cur, t);
+            rtn.swap(t);
+        }
+        n >>= 1;
+        if (n) {
+            mulMagnitude(cur, cur, t);
+            cur.swap(t);
+        }
+    }
+    return makeLong(negative, rtn);
+}
+
+static int cmpSigned(BoxedLong* a, BoxedLong* b) {
+    if (a->negative != b->negative)
+        return a->negative ? -1 : 1;
+    int c = cmpMagnitude(a->digits, b->digits);
+    return a->negative ? -c : c;
+}
+
+static std::string longToString(BoxedLong* v) {
+    if (v->digits.empty())
+        return "0";
+
+    // Peel off nine decimal digits at a time:
+    Digits d(v->digits);
+    std::vector<uint32_t> chunks;
+    while (!d.empty())
+        chunks.push_back(divmodSmall(d, 1000000000));
+
+    std::string rtn;
+    if (v->negative)
+        rtn.push_back('-');
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u", chunks.back());
+    rtn += buf;
+    for (int i = chunks.size() - 2; i >= 0; i--) {
+        snprintf(buf, sizeof(buf), "%09u", chunks[i]);
+        rtn += buf;
+    }
+    return rtn;
+}
+
+void long_dtor(BoxedLong* l) {
+    (&l->digits)->~Digits();
+}
+
+extern "C" Box* longAdd(BoxedLong* lhs, Box* rhs) {
+    assert(lhs->cls == long_cls);
+    if (rhs->cls == float_cls)
+        return boxFloat(longToDouble(lhs) + static_cast<BoxedFloat*>(rhs)->d);
+    BoxedLong* r = asLong(rhs);
+    if (!r)
+        return NotImplemented;
+    return addSigned(lhs, r, false);
+}
+
+extern "C" Box* longSub(BoxedLong* lhs, Box* rhs) {
+    assert(lhs->cls == long_cls);
+    if (rhs->cls == float_cls)
+        return boxFloat(longToDouble(lhs) - static_cast<BoxedFloat*>(rhs)->d);
+    BoxedLong* r = asLong(rhs);
+    if (!r)
+        return NotImplemented;
+    return addSigned(lhs, r, true);
+}
+
+extern "C" Box* longRSub(BoxedLong* lhs, Box* rhs) {
+    assert(lhs->cls == long_cls);
+    if (rhs->cls == float_cls)
+        return boxFloat(static_cast<BoxedFloat*>(rhs)->d - longToDouble(lhs));
+    BoxedLong* r = asLong(rhs);
+    if (!r)
+        return NotImplemented;
+    return addSigned(r, lhs, true);
+}
+
+extern "C" Box* longMul(BoxedLong* lhs, Box* rhs) {
+    assert(lhs->cls == long_cls);
+    if (rhs->cls == float_cls)
+        return boxFloat(longToDouble(lhs) * static_cast<BoxedFloat*>(rhs)->d);
+    BoxedLong* r = asLong(rhs);
+    if (!r)
+        return NotImplemented;
+    return mulSigned(lhs, r);
+}
+
+extern "C" Box* longDiv(BoxedLong* lhs, Box* rhs) {
+    assert(lhs->cls == long_cls);
+    BoxedLong* r = asLong(rhs);
+    if (!r)
+        return NotImplemented;
+    BoxedLong* q;
+    divmodSigned(lhs, r, &q, NULL);
+    return q;
+}
+
+extern "C" Box* longRDiv(BoxedLong* lhs, Box* rhs) {
+    assert(lhs->cls == long_cls);
+    BoxedLong* r = asLong(rhs);
+    if (!r)
+        return NotImplemented;
+    BoxedLong* q;
+    divmodSigned(r, lhs, &q, NULL);
+    return q;
+}
+
+extern "C" Box* longMod(BoxedLong* lhs, Box* rhs) {
+    assert(lhs->cls == long_cls);
+    BoxedLong* r = asLong(rhs);
+    if (!r)
+        return NotImplemented;
+    BoxedLong* m;
+    divmodSigned(lhs, r, NULL, &m);
+    return m;
+}
+
+extern "C" Box* longRMod(BoxedLong* lhs, Box* rhs) {
+    assert(lhs->cls == long_cls);
+    BoxedLong* r = asLong(rhs);
+    if (!r)
+        return NotImplemented;
+    BoxedLong* m;
+    divmodSigned(r, lhs, NULL, &m);
+    return m;
+}
+
+extern "C" Box* longPow(BoxedLong* lhs, Box* rhs) {
+    assert(lhs->cls == long_cls);
+    BoxedLong* r = asLong(rhs);
+    if (!r)
+        return NotImplemented;
+    return powSigned(lhs, r);
+}
+
+extern "C" Box* longRPow(BoxedLong* lhs, Box* rhs) {
+    assert(lhs->cls == long_cls);
+    BoxedLong* r = asLong(rhs);
+    if (!r)
+        return NotImplemented;
+    return powSigned(r, lhs);
+}
+
+// Returns whether the comparison could be done; ints, longs and floats can all be compared.
+static bool longCompare(BoxedLong* lhs, Box* rhs, int* result) {
+    if (rhs->cls == float_cls) {
+        double l = longToDouble(lhs), r = static_cast<BoxedFloat*>(rhs)->d;
+        *result = (l > r) - (l < r);
+        return true;
+    }
+    BoxedLong* r = asLong(rhs);
+    if (!r)
+        return false;
+    *result = cmpSigned(lhs, r);
+    return true;
+}
+
+#define LONG_COMPARE(name, op) \
+extern "C" Box* name(BoxedLong* lhs, Box* rhs) { \
+    assert(lhs->cls == long_cls); \
+    int c; \
+    if (!longCompare(lhs, rhs, &c)) \
+        return NotImplemented; \
+    return boxBool(c op 0); \
+}
+LONG_COMPARE(longEq, ==)
+LONG_COMPARE(longNe, !=)
+LONG_COMPARE(longLt, <)
+LONG_COMPARE(longLe, <=)
+LONG_COMPARE(longGt, >)
+LONG_COMPARE(longGe, >=)
+#undef LONG_COMPARE
+
+extern "C" Box* longNeg(BoxedLong* v) {
+    assert(v->cls == long_cls);
+    Digits d(v->digits);
+    return makeLong(!v->negative, d);
+}
+
+extern "C" Box* longPos(BoxedLong* v) {
+    assert(v->cls == long_cls);
+    return v;
+}
+
+extern "C" Box* longNonzero(BoxedLong* v) {
+    assert(v->cls == long_cls);
+    return boxBool(!v->digits.empty());
+}
+
+extern "C" BoxedString* longRepr(BoxedLong* v) {
+    assert(v->cls == long_cls);
+    return new BoxedString(longToString(v) + "L");
+}
+
+extern "C" BoxedString* longStr(BoxedLong* v) {
+    assert(v->cls == long_cls);
+    return new BoxedString(longToString(v));
+}
+
+extern "C" Box* longHash(BoxedLong* self) {
+    assert(self->cls == long_cls);
+
+    // Has to agree with int hashing for values that fit, so that 5 and 5L are the same dict key:
+    i64 n;
+    if (longToInt64(self, &n))
+        return boxInt(n);
+
+    uint64_t h = 0;
+    for (int i = self->digits.size() - 1; i >= 0; i--)
+        h = (h * 1000003) ^ self->digits[i];
+    return boxInt(self->negative ? -(i64)h : (i64)h);
+}
+
+extern "C" Box* longNew1(Box* cls) {
+    assert(cls == long_cls);
+    return new BoxedLong();
+}
+
+extern "C" Box* longNew2(Box* cls, Box* val) {
+    assert(cls == long_cls);
+
+    if (val->cls == long_cls) {
+        return val;
+    } else if (val->cls == int_cls) {
+        return longFromInt(static_cast<BoxedInt*>(val)->n);
+    } else if (val->cls == float_cls) {
+        double d = static_cast<BoxedFloat*>(val)->d;
+        if (std::isnan(d) || std::isinf(d)) {
+            fprintf(stderr, "OverflowError: cannot convert float infinity or NaN to long\n");
+            raiseExc();
+        }
+
+        // Dividing by a power of two is exact, so this peels the digits off without rounding:
+        double m = trunc(fabs(d));
+        Digits digits;
+        while (m > 0) {
+            double rem = fmod(m, 4294967296.0);
+            digits.push_back((uint32_t)rem);
+            m = (m - rem) / 4294967296.0;
+        }
+        return makeLong(d < 0, digits);
+    } else if (val->cls == str_cls) {
+        const std::string &s = static_cast<BoxedString*>(val)->s;
+
+        int start = 0, end = s.size();
+        while (start < end && isspace(s[start]))
+            start++;
+        while (end > start && isspace(s[end - 1]))
+            end--;
+        if (end > start && (s[end - 1] == 'L' || s[end - 1] == 'l'))
+            end--;
+
+        bool negative = false;
+        if (start < end && (s[start] == '-' || s[start] == '+')) {
+            negative = s[start] == '-';
+            start++;
+        }
+        if (start == end) {
+            fprintf(stderr, "ValueError: invalid literal for long() with base 10: '%s'\n", s.c_str());
+            raiseExc();
+        }
+
+        Digits digits, t;
+        Digits ten(1, 10);
+        for (int i = start; i < end; i++) {
+            if (s[i] < '0' || s[i] > '9') {
+                fprintf(stderr, "ValueError: invalid literal for long() with base 10: '%s'\n", s.c_str());
+                raiseExc();
+            }
+            mulMagnitude(digits, ten, t);
+            Digits digit;
+            if (s[i] != '0')
+                digit.push_back(s[i] - '0');
+            addMagnitude(t, digit, digits);
+        }
+        return makeLong(negative, digits);
+    } else {
+        fprintf(stderr, "long() argument must be a string or a number, not '%s'\n", getTypeName(val)->c_str());
+        raiseExc();
+    }
+}
+
+static void _addBinop(const char* name, const char* rname, void* func, void* rfunc) {
+    long_cls->giveAttr(name, new BoxedFunction(boxRTFunction(func, NULL, 2, false)));
+    long_cls->giveAttr(rname, new BoxedFunction(boxRTFunction(rfunc, NULL, 2, false)));
+}
+
+void setupLong() {
+    long_cls->giveAttr("__name__", boxStrConstant("long"));
+
+    _addBinop("__add__", "__radd__", (void*)longAdd, (void*)longAdd);
+    _addBinop("__sub__", "__rsub__", (void*)longSub, (void*)longRSub);
+    _addBinop("__mul__", "__rmul__", (void*)longMul, (void*)longMul);
+    _addBinop("__div__", "__rdiv__", (void*)longDiv, (void*)longRDiv);
+    _addBinop("__floordiv__", "__rfloordiv__", (void*)longDiv, (void*)longRDiv);
+    _addBinop("__mod__", "__rmod__", (void*)longMod, (void*)longRMod);
+    _addBinop("__pow__", "__rpow__", (void*)longPow, (void*)longRPow);
+
+    long_cls->giveAttr("__eq__", new BoxedFunction(boxRTFunction((void*)longEq, NULL, 2, false)));
+    long_cls->giveAttr("__ne__", new BoxedFunction(boxRTFunction((void*)longNe, NULL, 2, false)));
+    long_cls->giveAttr("__lt__", new BoxedFunction(boxRTFunction((void*)longLt, NULL, 2, false)));
+    long_cls->giveAttr("__le__", new BoxedFunction(boxRTFunction((void*)longLe, NULL, 2, false)));
+    long_cls->giveAttr("__gt__", new BoxedFunction(boxRTFunction((void*)longGt, NULL, 2, false)));
+    long_cls->giveAttr("__ge__", new BoxedFunction(boxRTFunction((void*)longGe, NULL, 2, false)));
+
+    long_cls->giveAttr("__neg__", new BoxedFunction(boxRTFunction((void*)longNeg, NULL, 1, false)));
+    long_cls->giveAttr("__pos__", new BoxedFunction(boxRTFunction((void*)longPos, NULL, 1, false)));
+    long_cls->giveAttr("__nonzero__", new BoxedFunction(boxRTFunction((void*)longNonzero, NULL, 1, false)));
+    long_cls->giveAttr("__repr__", new BoxedFunction(boxRTFunction((void*)longRepr, NULL, 1, false)));
+    long_cls->giveAttr("__str__", new BoxedFunction(boxRTFunction((void*)longStr, NULL, 1, false)));
+    long_cls->giveAttr("__hash__", new BoxedFunction(boxRTFunction((void*)longHash, NULL, 1, false)));
+
+    CLFunction *__new__ = boxRTFunction((void*)longNew1, NULL, 1, false);
+    addRTFunction(__new__, (void*)longNew2, NULL, 2, false);
+    long_cls->giveAttr("__new__", new BoxedFunction(__new__));
+
+    long_cls->freeze();
+}
+
+void teardownLong() {
+}
+
+}
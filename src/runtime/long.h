@@ -0,0 +1,34 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_RUNTIME_LONG_H
+#define PYSTON_RUNTIME_LONG_H
+
+#include "core/common.h"
+
+#include "runtime/types.h"
+
+namespace pyston {
+
+BoxedLong* longFromInt(i64 n);
+
+extern "C" Box* longAdd(BoxedLong* lhs, Box* rhs);
+extern "C" Box* longSub(BoxedLong* lhs, Box* rhs);
+extern "C" Box* longMul(BoxedLong* lhs, Box* rhs);
+extern "C" Box* longPow(BoxedLong* lhs, Box* rhs);
+extern "C" Box* longNeg(BoxedLong* v);
+
+}
+
+#endif
@@ -28,21 +28,33 @@
 #include "asm_writing/rewriter.h"
 #include "asm_writing/rewriter2.h"
 
+#include "runtime/dtoa.h"
+#include "runtime/float.h"
 #include "runtime/gc_runtime.h"
 #include "runtime/importing.h"
 #include "runtime/objmodel.h"
 #include "runtime/types.h"
 #include "runtime/util.h"
 
+#include "gc/collector.h"
+
 #define BOX_NREFS_OFFSET ((char*)&(((HCBox*)0x01)->nrefs) - (char*)0x1)
 #define BOX_CLS_OFFSET ((char*)&(((HCBox*)0x01)->cls) - (char*)0x1)
 #define BOX_HCLS_OFFSET ((char*)&(((HCBox*)0x01)->hcls) - (char*)0x1)
 #define BOX_ATTRS_OFFSET ((char*)&(((HCBox*)0x01)->attr_list) - (char*)0x1)
+#define BOX_INLINE_ATTRS_OFFSET (sizeof(HCBox))
 #define ATTRLIST_ATTRS_OFFSET ((char*)&(((HCBox::AttrList*)0x01)->attrs) - (char*)0x1)
 #define ATTRLIST_KIND_OFFSET ((char*)&(((HCBox::AttrList*)0x01)->gc_header.kind_id) - (char*)0x1)
 #define INSTANCEMETHOD_FUNC_OFFSET ((char*)&(((BoxedInstanceMethod*)0x01)->func) - (char*)0x1)
 #define INSTANCEMETHOD_OBJ_OFFSET ((char*)&(((BoxedInstanceMethod*)0x01)->obj) - (char*)0x1)
 #define BOOL_B_OFFSET ((char*)&(((BoxedBool*)0x01)->b) - (char*)0x1)
+#define LIST_SIZE_OFFSET ((char*)&(((BoxedList*)0x01)->size) - (char*)0x1)
+#define LIST_ELTS_OFFSET ((char*)&(((BoxedList*)0x01)->elts) - (char*)0x1)
+#define LIST_STRATEGY_OFFSET ((char*)&(((BoxedList*)0x01)->strategy) - (char*)0x1)
+#define ELEMENT_ARRAY_ELTS_OFFSET ((char*)&(((BoxedList::ElementArray*)0x01)->elts) - (char*)0x1)
+#define TUPLE_NELTS_OFFSET ((char*)&(((BoxedTuple*)0x01)->nelts) - (char*)0x1)
+#define DICT_SIZE_OFFSET ((char*)&(((BoxedDict*)0x01)->size) - (char*)0x1)
+#define TUPLE_ELTS_OFFSET ((char*)&(((BoxedTuple*)0x01)->elts) - (char*)0x1)
 #define INT_N_OFFSET ((char*)&(((BoxedInt*)0x01)->n) - (char*)0x1)
 
 namespace pyston {
@@ -167,25 +179,14 @@ static Box* (*callattrInternal1)(Box*, const std::string*, LookupScope, CallRewr
 static Box* (*callattrInternal2)(Box*, const std::string*, LookupScope, CallRewriteArgs*, int64_t, Box*, Box*) = (Box* (*)(Box*, const std::string*, LookupScope, CallRewriteArgs*, int64_t, Box*, Box*))callattrInternal;
 static Box* (*callattrInternal3)(Box*, const std::string*, LookupScope, CallRewriteArgs*, int64_t, Box*, Box*, Box*) = (Box* (*)(Box*, const std::string*, LookupScope, CallRewriteArgs*, int64_t, Box*, Box*, Box*))callattrInternal;
 
-size_t PyHasher::operator() (Box* b) const {
-    if (b->cls == str_cls) {
-        std::hash<std::string> H;
-        return H(static_cast<BoxedString*>(b)->s);
-    }
-
+size_t PyHasher::hashSlow(Box* b) {
     BoxedInt *i = hash(b);
     assert(sizeof(size_t) == sizeof(i->n));
     size_t rtn = i->n;
     return rtn;
 }
 
-bool PyEq::operator() (Box* lhs, Box* rhs) const {
-    if (lhs->cls == rhs->cls) {
-        if (lhs->cls == str_cls) {
-            return static_cast<BoxedString*>(lhs)->s == static_cast<BoxedString*>(rhs)->s;
-        }
-    }
-
+bool PyEq::eqSlow(Box* lhs, Box* rhs) {
     // TODO fix this
     Box* cmp = compareInternal(lhs, rhs, AST_TYPE::Eq, NULL);
     assert(cmp->cls == bool_cls);
@@ -214,6 +215,11 @@ extern "C" void assertNameDefined(bool b, const char* name) {
     }
 }
 
+extern "C" void raiseUndefinedClosureName(const char* name) {
+    fprintf(stderr, "NameError: free variable '%s' referenced before assignment in enclosing scope\n", name);
+    raiseExc();
+}
+
 extern "C" void raiseAttributeErrorStr(const char* typeName, const char* attr) {
     fprintf(stderr, "AttributeError: '%s' object has no attribute '%s'\n", typeName, attr);
     raiseExc();
@@ -248,7 +254,41 @@ extern "C" void checkUnpackingLength(i64 expected, i64 given) {
     raiseExc();
 }
 
-BoxedClass::BoxedClass(bool hasattrs, BoxedClass::Dtor dtor): HCBox(&type_flavor, type_cls), hasattrs(hasattrs), dtor(dtor), is_constant(false) {
+static int64_t next_class_version_tag = 1;
+
+BoxedClass::BoxedClass(const ObjectFlavor *instance_flavor, bool hasattrs, BoxedClass::Dtor dtor): HCBox(&type_flavor, type_cls), instance_flavor(instance_flavor), hasattrs(hasattrs), dtor(dtor), is_constant(false), instance_inline_attrs(0), instance_list_attrs(0), version_tag(next_class_version_tag++), iter_next(NULL) {
+}
+
+// Second tier behind the ICs for looking up attributes on classes: a direct-mapped cache keyed
+// on the class and the interned attribute name.  An entry is only valid while the class's
+// version tag matches; negative results get cached too.
+struct MethodCacheEntry {
+    BoxedClass* cls;
+    const std::string* attr;
+    int64_t version_tag;
+    Box* val;
+};
+static const int METHOD_CACHE_SIZE = 4096;
+static MethodCacheEntry method_cache[METHOD_CACHE_SIZE];
+
+static Box* lookupClassAttr(BoxedClass* cls, const std::string* interned_attr) {
+    static StatCounter method_cache_hits("method_cache_hits");
+    static StatCounter method_cache_misses("method_cache_misses");
+
+    uintptr_t h = ((uintptr_t)cls >> 4) * 31 + ((uintptr_t)interned_attr >> 4);
+    MethodCacheEntry &e = method_cache[h & (METHOD_CACHE_SIZE - 1)];
+    if (e.cls == cls && e.attr == interned_attr && e.version_tag == cls->version_tag) {
+        method_cache_hits.log();
+        return e.val;
+    }
+    method_cache_misses.log();
+
+    Box* val = cls->getattr(*interned_attr, NULL, NULL);
+    e.cls = cls;
+    e.attr = interned_attr;
+    e.version_tag = cls->version_tag;
+    e.val = val;
+    return val;
 }
 
 extern "C" const std::string* getNameOfClass(BoxedClass* cls) {
@@ -263,23 +303,99 @@ extern "C" const std::string* getTypeName(Box* o) {
     return getNameOfClass(o->cls);
 }
 
-HiddenClass* HiddenClass::getOrMakeChild(const std::string& attr) {
-    std::unordered_map<std::string, HiddenClass*>::iterator it = children.find(attr);
-    if (it != children.end())
-        return it->second;
+HiddenClass* HiddenClass::getOrMakeChild(const std::string* attr) {
+    if (children_index) {
+        std::unordered_map<const std::string*, HiddenClass*>::iterator it = children_index->find(attr);
+        if (it != children_index->end())
+            return it->second;
+    } else {
+        for (auto &p : children) {
+            if (p.first == attr)
+                return p.second;
+        }
+    }
 
     static StatCounter num_hclses("num_hidden_classes");
     num_hclses.log();
 
     HiddenClass* rtn = new HiddenClass(this);
-    this->children[attr] = rtn;
-    rtn->attr_offsets[attr] = attr_offsets.size();
+    children.push_back(std::make_pair(attr, rtn));
+    if (children_index) {
+        (*children_index)[attr] = rtn;
+    } else if (children.size() > MAX_LINEAR_ENTRIES) {
+        children_index = new std::unordered_map<const std::string*, HiddenClass*>(children.begin(), children.end());
+    }
+    // (No write barrier, since the collector doesn't trace through the children.)
+
+    rtn->attr_names.push_back(attr);
+    if (rtn->attr_names.size() > MAX_LINEAR_ENTRIES) {
+        rtn->attr_index = new std::unordered_map<const std::string*, int>();
+        for (int i = 0; i < rtn->attr_names.size(); i++) {
+            (*rtn->attr_index)[rtn->attr_names[i]] = i;
+        }
+    }
     return rtn;
 }
 
-HiddenClass* HiddenClass::getRoot() {
-    static HiddenClass* root = new HiddenClass();
-    return root;
+void HiddenClass::dropDeadChildren() {
+    int nlive = 0;
+    for (int i = 0; i < children.size(); i++) {
+        HiddenClass* child = children[i].second;
+        if (!gc::isMarked(child)) {
+            if (children_index)
+                children_index->erase(children[i].first);
+            continue;
+        }
+
+        // This only goes as deep as the number of attributes, which is at most MAX_HIDDEN_CLASS_ATTRS:
+        child->dropDeadChildren();
+        children[nlive++] = children[i];
+    }
+
+    if (nlive != children.size()) {
+        static StatCounter sc_freed("num_hidden_classes_freed");
+        sc_freed.log(children.size() - nlive);
+        children.resize(nlive);
+    }
+}
+
+// Every live hidden class is reachable from one of these through live children, since the parent
+// pointers are strong.
+static std::vector<std::vector<HiddenClass*> > hcls_roots;
+
+void HiddenClass::dropDeadTransitions() {
+    for (auto &by_list_slots : hcls_roots) {
+        for (HiddenClass* root : by_list_slots) {
+            if (root)
+                root->dropDeadChildren();
+        }
+    }
+}
+
+HiddenClass* HiddenClass::getRoot(int num_inline_slots, int num_list_slots) {
+    std::vector<std::vector<HiddenClass*> > &roots = hcls_roots;
+    assert(num_inline_slots >= 0);
+    assert(num_list_slots >= 0);
+    if (num_inline_slots >= roots.size())
+        roots.resize(num_inline_slots + 1);
+    std::vector<HiddenClass*> &by_list_slots = roots[num_inline_slots];
+    if (num_list_slots >= by_list_slots.size())
+        by_list_slots.resize(num_list_slots + 1, NULL);
+    if (!by_list_slots[num_list_slots]) {
+        by_list_slots[num_list_slots] = new HiddenClass(num_inline_slots, num_list_slots);
+        // Objects only point to the root while they're empty, so keep it alive ourselves:
+        gc::registerStaticRootObj(by_list_slots[num_list_slots]);
+    }
+    return by_list_slots[num_list_slots];
+}
+
+HiddenClass* HiddenClass::getDictMode() {
+    static HiddenClass* dict_mode = NULL;
+    if (!dict_mode) {
+        dict_mode = new HiddenClass(0, 0, true);
+        gc::registerStaticRootObj(dict_mode);
+    }
+    return dict_mode;
 }
 
 HCBox::HCBox(const ObjectFlavor *flavor, BoxedClass *cls) : Box(flavor, cls), hcls(HiddenClass::getRoot()), attr_list(NULL) {
@@ -290,26 +406,148 @@ HCBox::HCBox(const ObjectFlavor *flavor, BoxedClass *cls) : Box(flavor, cls), hc
     assert((cls == NULL && type_cls == NULL) || cls->hasattrs);
 }
 
+HCBox::HCBox(const ObjectFlavor *flavor, BoxedClass *cls, int num_inline_slots, int num_list_slots) : Box(flavor, cls), hcls(HiddenClass::getRoot(num_inline_slots, num_list_slots)), attr_list(NULL) {
+    assert(flavor->isUserDefined() == isUserDefined(cls));
+    assert(cls->hasattrs);
+
+    if (num_list_slots) {
+        attr_list = (AttrList*)rt_alloc(sizeof(AttrList) + sizeof(Box*) * num_list_slots);
+        attr_list->gc_header.kind_id = untracked_kind.kind_id;
+    }
+}
+
+// Interned strings get compared by address, so that's what gets hashed too:
+static int attrDictIndex(const std::string* attr, int capacity) {
+    uint64_t h = (uint64_t)attr * 0x9E3779B97F4A7C15UL;
+    return (h >> 32) & (capacity - 1);
+}
+
+static HCBox::AttrDict* allocAttrDict(int capacity) {
+    assert((capacity & (capacity - 1)) == 0);
+    int size = sizeof(HCBox::AttrDict) + sizeof(HCBox::AttrDict::Entry) * capacity;
+    HCBox::AttrDict* rtn = (HCBox::AttrDict*)rt_alloc(size);
+    rtn->gc_header.kind_id = untracked_kind.kind_id;
+    rtn->num_attrs = 0;
+    rtn->capacity = capacity;
+    memset(rtn->entries, 0, sizeof(HCBox::AttrDict::Entry) * capacity);
+    return rtn;
+}
+
+// Doesn't grow the table or do any write barriers:
+static void attrDictInsert(HCBox::AttrDict* d, const std::string* attr, Box* val) {
+    int i = attrDictIndex(attr, d->capacity);
+    while (true) {
+        HCBox::AttrDict::Entry &e = d->entries[i];
+        if (e.name == NULL) {
+            e.name = attr;
+            e.val = val;
+            d->num_attrs++;
+            return;
+        }
+        if (e.name == attr) {
+            e.val = val;
+            return;
+        }
+        i = (i + 1) & (d->capacity - 1);
+    }
+}
+
+Box** HCBox::getDictSlot(const std::string* attr) {
+    assert(hcls->is_dict_mode);
+
+    AttrDict* d = attr_dict;
+    int i = attrDictIndex(attr, d->capacity);
+    while (true) {
+        AttrDict::Entry &e = d->entries[i];
+        if (e.name == attr)
+            return &e.val;
+        if (e.name == NULL)
+            return NULL;
+        i = (i + 1) & (d->capacity - 1);
+    }
+}
+
+void HCBox::dictSetattr(const std::string* attr, Box* val) {
+    Box** slot = getDictSlot(attr);
+    if (slot) {
+        *slot = val;
+        gc::writeBarrier(this, val);
+        return;
+    }
+
+    // Keep the table at most half full:
+    AttrDict* d = attr_dict;
+    if (2 * (d->num_attrs + 1) > d->capacity) {
+        AttrDict* new_dict = allocAttrDict(d->capacity * 2);
+        for (int i = 0; i < d->capacity; i++) {
+            if (d->entries[i].name)
+                attrDictInsert(new_dict, d->entries[i].name, d->entries[i].val);
+        }
+        attr_dict = d = new_dict;
+        gc::writeBarrier(this, new_dict);
+    }
+
+    attrDictInsert(d, attr, val);
+    gc::writeBarrier(this, val);
+}
+
+void HCBox::convertToDictMode() {
+    static StatCounter num_converted("num_dict_mode_objects");
+    num_converted.log();
+
+    HiddenClass* old_hcls = hcls;
+    assert(!old_hcls->is_dict_mode);
+
+    int nattrs = old_hcls->numAttrs();
+    int capacity = 16;
+    while (capacity < 2 * (nattrs + 1))
+        capacity *= 2;
+
+    AttrDict* d = allocAttrDict(capacity);
+    for (int i = 0; i < nattrs; i++) {
+        attrDictInsert(d, old_hcls->attr_names[i], *attrSlot(i));
+    }
+
+    // As in setattr, switch over only once the allocation is done, so that a collection
+    // always sees a consistent hcls and attribute storage.
+    this->hcls = HiddenClass::getDictMode();
+    this->attr_dict = d;
+    gc::writeBarrier(this, d);
+}
+
 
 Box* HCBox::getattr(const std::string &attr, GetattrRewriteArgs* rewrite_args, GetattrRewriteArgs2* rewrite_args2) {
+    if (hcls->is_dict_mode) {
+        // The hidden class doesn't say which attributes a dict-mode object has, so there's
+        // nothing for the IC to specialize on; leave these lookups to the slow path.
+        Box** slot = getDictSlot(internString(attr));
+        return slot ? *slot : NULL;
+    }
+
     if (rewrite_args) {
         rewrite_args->out_success = true;
 
-        if (!rewrite_args->obj_hcls_guarded)
+        if (!rewrite_args->obj_hcls_guarded) {
             rewrite_args->obj.addAttrGuard(BOX_HCLS_OFFSET, (intptr_t)this->hcls);
+            rewrite_args->rewriter->addDependenceOn(this->hcls->dependent_ics);
+        }
     }
 
     if (rewrite_args2) {
         rewrite_args2->out_success = true;
 
-        if (!rewrite_args2->obj_hcls_guarded)
+        if (!rewrite_args2->obj_hcls_guarded) {
             rewrite_args2->obj.addAttrGuard(BOX_HCLS_OFFSET, (intptr_t)this->hcls);
+            rewrite_args2->rewriter->addDependenceOn(this->hcls->dependent_ics);
+        }
     }
 
-    int offset = hcls->getOffset(attr);
+    int offset = hcls->getOffset(internString(attr));
     if (offset == -1)
         return NULL;
 
+    int num_inline = hcls->num_inline_slots;
+
     if (rewrite_args) {
         // TODO using the output register as the temporary makes register allocation easier
         // since we don't need to clobber a register, but does it make the code slower?
@@ -318,8 +556,12 @@ Box* HCBox::getattr(const std::string &attr, GetattrRewriteArgs* rewrite_args, G
             //temp_reg = -3;
         int temp_reg = rewrite_args->preferred_dest_reg;
 
-        RewriterVar attrs = rewrite_args->obj.getAttr(BOX_ATTRS_OFFSET, temp_reg);
-        rewrite_args->out_rtn = attrs.getAttr(offset * sizeof(Box*) + ATTRLIST_ATTRS_OFFSET, rewrite_args->preferred_dest_reg);
+        if (offset < num_inline) {
+            rewrite_args->out_rtn = rewrite_args->obj.getAttr(offset * sizeof(Box*) + BOX_INLINE_ATTRS_OFFSET, rewrite_args->preferred_dest_reg);
+        } else {
+            RewriterVar attrs = rewrite_args->obj.getAttr(BOX_ATTRS_OFFSET, temp_reg);
+            rewrite_args->out_rtn = attrs.getAttr((offset - num_inline) * sizeof(Box*) + ATTRLIST_ATTRS_OFFSET, rewrite_args->preferred_dest_reg);
+        }
 
         rewrite_args->rewriter->addDependenceOn(cls->dependent_icgetattrs);
     }
@@ -328,23 +570,36 @@ Box* HCBox::getattr(const std::string &attr, GetattrRewriteArgs* rewrite_args, G
         if (!rewrite_args2->more_guards_after)
             rewrite_args2->rewriter->setDoneGuarding();
 
-        RewriterVarUsage2 attrs = rewrite_args2->obj.getAttr(BOX_ATTRS_OFFSET, RewriterVarUsage2::Kill);
-        rewrite_args2->out_rtn = attrs.getAttr(offset * sizeof(Box*) + ATTRLIST_ATTRS_OFFSET, RewriterVarUsage2::Kill, rewrite_args2->destination);
+        if (offset < num_inline) {
+            rewrite_args2->out_rtn = rewrite_args2->obj.getAttr(offset * sizeof(Box*) + BOX_INLINE_ATTRS_OFFSET, RewriterVarUsage2::Kill, rewrite_args2->destination);
+        } else {
+            RewriterVarUsage2 attrs = rewrite_args2->obj.getAttr(BOX_ATTRS_OFFSET, RewriterVarUsage2::Kill);
+            rewrite_args2->out_rtn = attrs.getAttr((offset - num_inline) * sizeof(Box*) + ATTRLIST_ATTRS_OFFSET, RewriterVarUsage2::Kill, rewrite_args2->destination);
+        }
     }
 
-    Box* rtn = attr_list->attrs[offset];
+    Box* rtn = *attrSlot(offset);
     return rtn;
 }
 
+static void dictModeSetattr(HCBox* obj, const std::string* attr, Box* val) {
+    obj->dictSetattr(attr, val);
+}
+
 void HCBox::giveAttr(const std::string& attr, Box* val) {
     assert(this->peekattr(attr) == NULL);
     this->setattr(attr, val, NULL, NULL);
 }
 
-void HCBox::setattr(const std::string& attr, Box* val, SetattrRewriteArgs *rewrite_args, SetattrRewriteArgs2 *rewrite_args2) {
-    RELEASE_ASSERT(attr != "None" || this == builtins_module, "can't assign to None");
+void HCBox::setattr(const std::string& attr_str, Box* val, SetattrRewriteArgs *rewrite_args, SetattrRewriteArgs2 *rewrite_args2) {
+    static const std::string *none_str = internString("None");
+    static const std::string *getattr_str = internString("__getattr__");
+    static const std::string *getattribute_str = internString("__getattribute__");
 
-    bool isgetattr = (attr == "__getattr__" || attr == "__getattribute__");
+    const std::string* attr = internString(attr_str);
+    RELEASE_ASSERT(attr != none_str || this == builtins_module, "can't assign to None");
+
+    bool isgetattr = (attr == getattr_str || attr == getattribute_str);
     if (isgetattr && this->cls == type_cls) {
         // Will have to embed the clear in the IC, so just disable the patching for now:
         rewrite_args = NULL;
@@ -356,18 +611,71 @@ void HCBox::setattr(const std::string& attr, Box* val, SetattrRewriteArgs *rewri
         self->dependent_icgetattrs.invalidateAll();
     }
 
+    if (this->cls == type_cls) {
+        // There's no way to get a fresh version tag from an IC, but stores to classes should
+        // be rare anyway:
+        rewrite_args = NULL;
+        rewrite_args2 = NULL;
+
+        static_cast<BoxedClass*>(this)->version_tag = next_class_version_tag++;
+    }
+
+    if (this->cls == module_cls) {
+        BoxedModule *self = static_cast<BoxedModule*>(this);
+        if (self->globalChanged(attr)) {
+            // Jitted code has the old value embedded; the store has to go through here
+            // so that it can be invalidated.
+            rewrite_args = NULL;
+            rewrite_args2 = NULL;
+        } else {
+            if (rewrite_args)
+                rewrite_args->rewriter->addDependenceOn(self->dependent_setattrs);
+            if (rewrite_args2)
+                rewrite_args2->rewriter->addDependenceOn(self->dependent_setattrs);
+        }
+    }
+
     HiddenClass *hcls = this->hcls;
-    int numattrs = hcls->attr_offsets.size();
+    int numattrs = hcls->numAttrs();
+    int num_inline = hcls->num_inline_slots;
+
+    if (!hcls->is_dict_mode && numattrs >= MAX_HIDDEN_CLASS_ATTRS && hcls->getOffset(attr) == -1) {
+        convertToDictMode();
+        hcls = this->hcls;
+    }
+
+    if (hcls->is_dict_mode) {
+        // All dict-mode objects share the same hidden class, so guarding on it is enough to
+        // let the IC call straight into the generic setter:
+        if (rewrite_args2) {
+            rewrite_args2->obj.addAttrGuard(BOX_HCLS_OFFSET, (intptr_t)hcls);
+            if (!rewrite_args2->more_guards_after)
+                rewrite_args2->rewriter->setDoneGuarding();
+
+            std::vector<RewriterVarUsage2> args;
+            args.push_back(std::move(rewrite_args2->obj));
+            args.push_back(rewrite_args2->rewriter->loadConst((intptr_t)attr, Location::forArg(1)));
+            args.push_back(std::move(rewrite_args2->attrval));
+            rewrite_args2->rewriter->call(false, (void*)dictModeSetattr, std::move(args)).setDoneUsing();
+
+            rewrite_args2->out_success = true;
+        }
+
+        dictSetattr(attr, val);
+        return;
+    }
 
     int offset = hcls->getOffset(attr);
 
     if (rewrite_args) {
         rewrite_args->obj.addAttrGuard(BOX_HCLS_OFFSET, (intptr_t)hcls);
+        rewrite_args->rewriter->addDependenceOn(hcls->dependent_ics);
         rewrite_args->rewriter->addDecision(offset == -1 ? 1 : 0);
     }
 
     if (rewrite_args2) {
         rewrite_args2->obj.addAttrGuard(BOX_HCLS_OFFSET, (intptr_t)hcls);
+        rewrite_args2->rewriter->addDependenceOn(hcls->dependent_ics);
 
         if (!rewrite_args2->more_guards_after)
             rewrite_args2->rewriter->setDoneGuarding();
@@ -376,22 +684,33 @@ void HCBox::setattr(const std::string& attr, Box* val, SetattrRewriteArgs *rewri
 
     if (offset >= 0) {
         assert(offset < numattrs);
-        Box* prev = this->attr_list->attrs[offset];
-        this->attr_list->attrs[offset] = val;
+        *attrSlot(offset) = val;
+        gc::writeBarrier(this, val);
 
         if (rewrite_args) {
-            RewriterVar r_hattrs = rewrite_args->obj.getAttr(BOX_ATTRS_OFFSET, 1);
-
-            r_hattrs.setAttr(offset * sizeof(Box*) + ATTRLIST_ATTRS_OFFSET, rewrite_args->attrval);
+            if (offset < num_inline) {
+                rewrite_args->obj.setAttr(offset * sizeof(Box*) + BOX_INLINE_ATTRS_OFFSET, rewrite_args->attrval);
+            } else {
+                RewriterVar r_hattrs = rewrite_args->obj.getAttr(BOX_ATTRS_OFFSET, 1);
+                r_hattrs.setAttr((offset - num_inline) * sizeof(Box*) + ATTRLIST_ATTRS_OFFSET, rewrite_args->attrval);
+            }
             rewrite_args->out_success = true;
         }
 
         if (rewrite_args2) {
+            // The barrier's checks only look at the side tables, so this only gets as far as
+            // remembering obj when an old object gets a young value:
+            rewrite_args2->rewriter->call(false, (void*)rt_write_barrier, rewrite_args2->obj.addUse(), rewrite_args2->attrval.addUse()).setDoneUsing();
 
-            RewriterVarUsage2 r_hattrs = rewrite_args2->obj.getAttr(BOX_ATTRS_OFFSET, RewriterVarUsage2::Kill, Location::any());
+            if (offset < num_inline) {
+                rewrite_args2->obj.setAttr(offset * sizeof(Box*) + BOX_INLINE_ATTRS_OFFSET, std::move(rewrite_args2->attrval));
+                rewrite_args2->obj.setDoneUsing();
+            } else {
+                RewriterVarUsage2 r_hattrs = rewrite_args2->obj.getAttr(BOX_ATTRS_OFFSET, RewriterVarUsage2::Kill, Location::any());
 
-            r_hattrs.setAttr(offset * sizeof(Box*) + ATTRLIST_ATTRS_OFFSET, std::move(rewrite_args2->attrval));
-            r_hattrs.setDoneUsing();
+                r_hattrs.setAttr((offset - num_inline) * sizeof(Box*) + ATTRLIST_ATTRS_OFFSET, std::move(rewrite_args2->attrval));
+                r_hattrs.setDoneUsing();
+            }
 
             rewrite_args2->out_success = true;
         }
@@ -401,16 +720,79 @@ void HCBox::setattr(const std::string& attr, Box* val, SetattrRewriteArgs *rewri
 
     assert(offset == -1);
     HiddenClass *new_hcls = hcls->getOrMakeChild(attr);
+    // The ICs store new_hcls into the objects, so they have to go away along with it:
+    if (rewrite_args)
+        rewrite_args->rewriter->addDependenceOn(new_hcls->dependent_ics);
+    if (rewrite_args2)
+        rewrite_args2->rewriter->addDependenceOn(new_hcls->dependent_ics);
 
     // TODO need to make sure we don't need to rearrange the attributes
-    assert(new_hcls->attr_offsets[attr] == numattrs);
+    assert(new_hcls->getOffset(attr) == numattrs);
 #ifndef NDEBUG
-    for (std::unordered_map<std::string, int>::iterator it = hcls->attr_offsets.begin(), end = hcls->attr_offsets.end();
-            it != end; ++it) {
-        assert(new_hcls->attr_offsets[it->first] == it->second);
+    for (int i = 0; i < numattrs; i++) {
+        assert(new_hcls->attr_names[i] == hcls->attr_names[i]);
     }
 #endif
 
+    if (numattrs < num_inline) {
+        // There's still room inside the object, so no allocation needed:
+        if (rewrite_args) {
+            rewrite_args->obj.setAttr(numattrs * sizeof(Box*) + BOX_INLINE_ATTRS_OFFSET, rewrite_args->attrval);
+            RewriterVar r_hcls = rewrite_args->rewriter->loadConst(1, (intptr_t)new_hcls);
+            rewrite_args->obj.setAttr(BOX_HCLS_OFFSET, r_hcls);
+            rewrite_args->out_success = true;
+        }
+        if (rewrite_args2) {
+            // This stores both the value and new_hcls, so remember obj if it's old no matter what got stored:
+            rewrite_args2->rewriter->call(false, (void*)rt_remember, rewrite_args2->obj.addUse()).setDoneUsing();
+
+            rewrite_args2->obj.setAttr(numattrs * sizeof(Box*) + BOX_INLINE_ATTRS_OFFSET, std::move(rewrite_args2->attrval));
+            RewriterVarUsage2 r_hcls = rewrite_args2->rewriter->loadConst((intptr_t)new_hcls);
+            rewrite_args2->obj.setAttr(BOX_HCLS_OFFSET, std::move(r_hcls));
+            rewrite_args2->obj.setDoneUsing();
+
+            rewrite_args2->out_success = true;
+        }
+
+        this->inlineAttrs()[numattrs] = val;
+        this->hcls = new_hcls;
+        gc::writeBarrier(this, val);
+        gc::writeBarrier(this, new_hcls);
+        return;
+    }
+
+    int list_idx = numattrs - num_inline;
+
+    if (list_idx < hcls->num_list_slots) {
+        // The attr_list was preallocated big enough, so this is just a store as well:
+        if (rewrite_args) {
+            RewriterVar r_hattrs = rewrite_args->obj.getAttr(BOX_ATTRS_OFFSET, 1);
+            r_hattrs.setAttr(list_idx * sizeof(Box*) + ATTRLIST_ATTRS_OFFSET, rewrite_args->attrval);
+            RewriterVar r_hcls = rewrite_args->rewriter->loadConst(1, (intptr_t)new_hcls);
+            rewrite_args->obj.setAttr(BOX_HCLS_OFFSET, r_hcls);
+            rewrite_args->out_success = true;
+        }
+        if (rewrite_args2) {
+            // Same as above, the value and new_hcls both get stored:
+            rewrite_args2->rewriter->call(false, (void*)rt_remember, rewrite_args2->obj.addUse()).setDoneUsing();
+
+            RewriterVarUsage2 r_hattrs = rewrite_args2->obj.getAttr(BOX_ATTRS_OFFSET, RewriterVarUsage2::NoKill, Location::any());
+            r_hattrs.setAttr(list_idx * sizeof(Box*) + ATTRLIST_ATTRS_OFFSET, std::move(rewrite_args2->attrval));
+            r_hattrs.setDoneUsing();
+            RewriterVarUsage2 r_hcls = rewrite_args2->rewriter->loadConst((intptr_t)new_hcls);
+            rewrite_args2->obj.setAttr(BOX_HCLS_OFFSET, std::move(r_hcls));
+            rewrite_args2->obj.setDoneUsing();
+
+            rewrite_args2->out_success = true;
+        }
+
+        this->attr_list->attrs[list_idx] = val;
+        this->hcls = new_hcls;
+        gc::writeBarrier(this, val);
+        gc::writeBarrier(this, new_hcls);
+        return;
+    }
+
     if (rewrite_args) {
         rewrite_args->obj.push();
         rewrite_args->attrval.push();
@@ -418,10 +800,16 @@ void HCBox::setattr(const std::string& attr, Box* val, SetattrRewriteArgs *rewri
 
 
 
+    if (rewrite_args2) {
+        // The attr list is about to get replaced with a new (young) allocation, so remember
+        // the object before we start, while it's still in the first argument register:
+        rewrite_args2->rewriter->call(false, (void*)rt_remember, rewrite_args2->obj.addUse()).setDoneUsing();
+    }
+
     RewriterVar r_new_array;
     RewriterVarUsage2 r_new_array2(RewriterVarUsage2::empty());
-    int new_size = sizeof(HCBox::AttrList) + sizeof(Box*) * (numattrs + 1);
-    if (numattrs == 0) {
+    int new_size = sizeof(HCBox::AttrList) + sizeof(Box*) * (list_idx + 1);
+    if (list_idx == 0) {
         this->attr_list = (HCBox::AttrList*)rt_alloc(new_size);
         this->attr_list->gc_header.kind_id = untracked_kind.kind_id;
         if (rewrite_args) {
@@ -458,13 +846,13 @@ void HCBox::setattr(const std::string& attr, Box* val, SetattrRewriteArgs *rewri
         RewriterVar attrval = rewrite_args->rewriter->pop(0);
         RewriterVar obj = rewrite_args->rewriter->pop(2);
         obj.setAttr(BOX_ATTRS_OFFSET, r_new_array);
-        r_new_array.setAttr(numattrs * sizeof(Box*) + ATTRLIST_ATTRS_OFFSET, attrval);
+        r_new_array.setAttr(list_idx * sizeof(Box*) + ATTRLIST_ATTRS_OFFSET, attrval);
         RewriterVar hcls = rewrite_args->rewriter->loadConst(1, (intptr_t)new_hcls);
         obj.setAttr(BOX_HCLS_OFFSET, hcls);
         rewrite_args->out_success = true;
     }
     if (rewrite_args2) {
-        r_new_array2.setAttr(numattrs * sizeof(Box*) + ATTRLIST_ATTRS_OFFSET, std::move(rewrite_args2->attrval));
+        r_new_array2.setAttr(list_idx * sizeof(Box*) + ATTRLIST_ATTRS_OFFSET, std::move(rewrite_args2->attrval));
         rewrite_args2->obj.setAttr(BOX_ATTRS_OFFSET, std::move(r_new_array2));
 
         RewriterVarUsage2 r_hcls = rewrite_args2->rewriter->loadConst((intptr_t)new_hcls);
@@ -473,7 +861,10 @@ void HCBox::setattr(const std::string& attr, Box* val, SetattrRewriteArgs *rewri
 
         rewrite_args2->out_success = true;
     }
-    this->attr_list->attrs[numattrs] = val;
+    this->attr_list->attrs[list_idx] = val;
+    gc::writeBarrier(this, this->attr_list);
+    gc::writeBarrier(this, val);
+    gc::writeBarrier(this, new_hcls);
 }
 
 static Box* _handleClsAttr(Box* obj, Box* attr) {
@@ -521,7 +912,7 @@ Box* getclsattr_internal(Box* obj, const char* attr, GetattrRewriteArgs *rewrite
             }
         }
     } else {
-        val = getattr_internal(obj->cls, attr, false, false, NULL, NULL);
+        val = lookupClassAttr(obj->cls, internString(attr));
     }
 
     if (val == NULL) {
@@ -600,11 +991,11 @@ Box* getattr_internal(Box *obj, const char* attr, bool check_cls, bool allow_cus
     if (allow_custom) {
         // Don't need to pass icentry args, since we special-case __getattribtue__ and __getattr__ to use
         // invalidation rather than guards
-        Box* getattribute = getclsattr_internal(obj, "__getattribute__", NULL, NULL);
-        if (getattribute) {
+        static const std::string* getattribute_str = internString("__getattribute__");
+        if (lookupClassAttr(obj->cls, getattribute_str)) {
             // TODO this is a good candidate for interning?
             Box* boxstr = boxStrConstant(attr);
-            Box* rtn = runtimeCall1(getattribute, 1, boxstr);
+            Box* rtn = callattrInternal1(obj, getattribute_str, CLASS_ONLY, NULL, 1, boxstr);
             return rtn;
         }
 
@@ -616,14 +1007,23 @@ Box* getattr_internal(Box *obj, const char* attr, bool check_cls, bool allow_cus
         }
     }
 
+    if (obj->cls == slice_cls) {
+        // Not worth rewriting:
+        Box* val = getSliceAttr(static_cast<BoxedSlice*>(obj), attr);
+        if (val)
+            return val;
+    }
+
     if (obj->cls->hasattrs) {
         HCBox* hobj = static_cast<HCBox*>(obj);
+        // Jitted code passes us the characters of an interned string, so this doesn't have to hash the name:
+        const std::string &interned_attr = *internString(attr);
 
         Box* val = NULL;
         if (rewrite_args) {
             GetattrRewriteArgs hrewrite_args(rewrite_args->rewriter, rewrite_args->obj);
             hrewrite_args.preferred_dest_reg = rewrite_args->preferred_dest_reg;
-            val = hobj->getattr(attr, &hrewrite_args, NULL);
+            val = hobj->getattr(interned_attr, &hrewrite_args, NULL);
 
             if (hrewrite_args.out_success) {
                 if (val)
@@ -633,7 +1033,7 @@ Box* getattr_internal(Box *obj, const char* attr, bool check_cls, bool allow_cus
             }
         } else if (rewrite_args2) {
             GetattrRewriteArgs2 hrewrite_args(rewrite_args2->rewriter, std::move(rewrite_args2->obj), rewrite_args2->destination, rewrite_args2->more_guards_after);
-            val = hobj->getattr(attr, NULL, &hrewrite_args);
+            val = hobj->getattr(interned_attr, NULL, &hrewrite_args);
 
             if (hrewrite_args.out_success) {
                 if (val)
@@ -644,7 +1044,7 @@ Box* getattr_internal(Box *obj, const char* attr, bool check_cls, bool allow_cus
                 rewrite_args2 = NULL;
             }
         } else {
-            val = hobj->getattr(attr, NULL, NULL);
+            val = hobj->getattr(interned_attr, NULL, NULL);
         }
 
         if (val) {
@@ -657,10 +1057,10 @@ Box* getattr_internal(Box *obj, const char* attr, bool check_cls, bool allow_cus
     if (allow_custom) {
         // Don't need to pass icentry args, since we special-case __getattribtue__ and __getattr__ to use
         // invalidation rather than guards
-        Box* getattr = getclsattr_internal(obj, "__getattr__", NULL, NULL);
-        if (getattr) {
+        static const std::string* getattr_str = internString("__getattr__");
+        if (lookupClassAttr(obj->cls, getattr_str)) {
             Box* boxstr = boxStrConstant(attr);
-            Box* rtn = runtimeCall1(getattr, 1, boxstr);
+            Box* rtn = callattrInternal1(obj, getattr_str, CLASS_ONLY, NULL, 1, boxstr);
             return rtn;
         }
 
@@ -711,9 +1111,8 @@ extern "C" Box* getattr(Box* obj, const char* attr) {
     slowpath_getattr.log();
 
     if (VERBOSITY() >= 2) {
-        std::string per_name_stat_name = "getattr__" + std::string(attr);
-        int id = Stats::getStatId(per_name_stat_name);
-        Stats::log(id);
+        static StatCounterFamily per_name_stats("getattr__");
+        per_name_stats.log(attr);
     }
 
     { /* anonymous scope to make sure destructors get run before we err out */
@@ -777,6 +1176,7 @@ extern "C" void setattr(Box *obj, const char* attr, Box* attr_val) {
     }
 
     HCBox* hobj = static_cast<HCBox*>(obj);
+    const std::string &interned_attr = *internString(attr);
 
 #if 0
     std::unique_ptr<Rewriter> rewriter(Rewriter::createRewriter(__builtin_extract_return_addr(__builtin_return_address(0)), 3, 1, "setattr"));
@@ -784,7 +1184,7 @@ extern "C" void setattr(Box *obj, const char* attr, Box* attr_val) {
     if (rewriter.get()) {
         //rewriter->trap();
         SetattrRewriteArgs rewrite_args(rewriter.get(), rewriter->getArg(0), rewriter->getArg(2));
-        hobj->setattr(attr, attr_val, &rewrite_args);
+        hobj->setattr(interned_attr, attr_val, &rewrite_args);
         if (rewrite_args.out_success) {
             rewriter->commit();
         }
@@ -794,7 +1194,7 @@ extern "C" void setattr(Box *obj, const char* attr, Box* attr_val) {
     if (rewriter.get()) {
         //rewriter->trap();
         SetattrRewriteArgs2 rewrite_args(rewriter.get(), rewriter->getArg(0), rewriter->getArg(2), false);
-        hobj->setattr(attr, attr_val, NULL, &rewrite_args);
+        hobj->setattr(interned_attr, attr_val, NULL, &rewrite_args);
         if (rewrite_args.out_success) {
             rewriter->commit();
         } else {
@@ -803,7 +1203,7 @@ extern "C" void setattr(Box *obj, const char* attr, Box* attr_val) {
         }
 #endif
     } else {
-        hobj->setattr(attr, attr_val, NULL, NULL);
+        hobj->setattr(interned_attr, attr_val, NULL, NULL);
     }
 }
 
@@ -844,6 +1244,41 @@ extern "C" bool nonzero(Box* obj) {
         return int_obj->n != 0;
     } else if (obj->cls == float_cls) {
         return static_cast<BoxedFloat*>(obj)->d != 0;
+    } else if (obj->cls == none_cls) {
+        if (rewriter.get()) {
+            rewriter->loadConst(-1, 0);
+            rewriter->commit();
+        }
+        return false;
+    } else if (obj->cls == list_cls || obj->cls == tuple_cls || obj->cls == dict_cls) {
+        // The sizes are all full words, so these are just a load and a setnz:
+        int offset;
+        int64_t size;
+        if (obj->cls == list_cls) {
+            offset = LIST_SIZE_OFFSET;
+            size = static_cast<BoxedList*>(obj)->size;
+        } else if (obj->cls == tuple_cls) {
+            offset = TUPLE_NELTS_OFFSET;
+            size = static_cast<BoxedTuple*>(obj)->nelts;
+        } else {
+            offset = DICT_SIZE_OFFSET;
+            size = static_cast<BoxedDict*>(obj)->size;
+        }
+
+        if (rewriter.get()) {
+            RewriterVar r_size = rewriter->getArg(0).getAttr(offset, 1);
+            r_size.toBool(-1);
+            rewriter->commit();
+        }
+        return size != 0;
+    } else if (obj->cls == str_cls) {
+        // The length is inside the std::string, so leave that to strNonzeroUnboxed rather than
+        // depending on its layout:
+        if (rewriter.get()) {
+            rewriter->call((void*)strNonzeroUnboxed);
+            rewriter->commit();
+        }
+        return strNonzeroUnboxed(static_cast<BoxedString*>(obj));
     }
 
     slowpath_nonzero.log();
@@ -851,13 +1286,19 @@ extern "C" bool nonzero(Box* obj) {
     //int id = Stats::getStatId("slowpath_nonzero_" + *getTypeName(obj));
     //Stats::log(id);
 
-    Box* func = getclsattr_internal(obj, "__nonzero__", NULL, NULL);
-    if (func == NULL) {
+    // Call it through callattr so that we don't have to create an instancemethod for it:
+    static const std::string* nonzero_str = internString("__nonzero__");
+    Box* r = callattrInternal0(obj, nonzero_str, CLASS_ONLY, NULL, 0);
+    if (r == NULL) {
+        // Like CPython, fall back to __len__:
+        static const std::string* len_str = internString("__len__");
+        r = callattrInternal0(obj, len_str, CLASS_ONLY, NULL, 0);
+    }
+    if (r == NULL) {
         RELEASE_ASSERT(isUserDefined(obj->cls), "%s.__nonzero__", getTypeName(obj)->c_str()); // TODO
         return true;
     }
 
-    Box* r = runtimeCall0(func, 0);
     if (r->cls == bool_cls) {
         BoxedBool* b = static_cast<BoxedBool*>(r);
         bool rtn = b->b;
@@ -872,23 +1313,52 @@ extern "C" bool nonzero(Box* obj) {
     }
 }
 
+// What for loops use to step their iterator: the next value, or NULL once it's exhausted.  The builtin
+// iterators do that natively (BoxedClass::iter_next), which the IC calls straight into; anything else
+// gets __hasnext__ and next called on it like before.
+extern "C" Box* iterNext(Box* iter) {
+    static StatCounter slowpath_iternext("slowpath_iternext");
+
+    std::unique_ptr<Rewriter> rewriter(Rewriter::createRewriter(__builtin_extract_return_addr(__builtin_return_address(0)), 1, 0, "iterNext"));
+
+    if (iter->cls->iter_next) {
+        // (the builtin iterator classes are all frozen, so their iter_next can't go stale)
+        if (rewriter.get()) {
+            rewriter->getArg(0).addAttrGuard(BOX_CLS_OFFSET, (intptr_t)iter->cls);
+            rewriter->call((void*)iter->cls->iter_next);
+            rewriter->commit();
+        }
+        return iter->cls->iter_next(iter);
+    }
+
+    slowpath_iternext.log();
+
+    static std::string* hasnext_str = const_cast<std::string*>(internString("__hasnext__"));
+    static std::string* next_str = const_cast<std::string*>(internString("next"));
+    if (!nonzero(callattr(iter, hasnext_str, true, 0, NULL, NULL, NULL, NULL)))
+        return NULL;
+    return callattr(iter, next_str, true, 0, NULL, NULL, NULL, NULL);
+}
+
 extern "C" BoxedString* str(Box* obj) {
     static StatCounter slowpath_str("slowpath_str");
     slowpath_str.log();
 
     if (obj->cls != str_cls) {
-        Box *str = getclsattr_internal(obj, "__str__", NULL, NULL);
-        if (str == NULL)
-            str = getclsattr_internal(obj, "__repr__", NULL, NULL);
+        static const std::string* str_str = internString("__str__");
+        static const std::string* repr_str = internString("__repr__");
+        Box *rtn = callattrInternal0(obj, str_str, CLASS_ONLY, NULL, 0);
+        if (rtn == NULL)
+            rtn = callattrInternal0(obj, repr_str, CLASS_ONLY, NULL, 0);
 
-        if (str == NULL) {
+        if (rtn == NULL) {
             ASSERT(isUserDefined(obj->cls), "%s.__str__", getTypeName(obj)->c_str());
 
             char buf[80];
             snprintf(buf, 80, "<%s object at %p>", getTypeName(obj)->c_str(), obj);
             return boxStrConstant(buf);
         } else {
-            obj = runtimeCallInternal0(str, NULL, 0);
+            obj = rtn;
         }
     }
     if (obj->cls != str_cls) {
@@ -902,8 +1372,9 @@ extern "C" BoxedString* repr(Box* obj) {
     static StatCounter slowpath_repr("slowpath_repr");
     slowpath_repr.log();
 
-    Box *repr = getclsattr_internal(obj, "__repr__", NULL, NULL);
-    if (repr == NULL) {
+    static const std::string* repr_str = internString("__repr__");
+    Box *rtn = callattrInternal0(obj, repr_str, CLASS_ONLY, NULL, 0);
+    if (rtn == NULL) {
         ASSERT(isUserDefined(obj->cls), "%s", getTypeName(obj)->c_str());
 
         char buf[80];
@@ -914,7 +1385,7 @@ extern "C" BoxedString* repr(Box* obj) {
         }
         return boxStrConstant(buf);
     } else {
-        obj = runtimeCall0(repr, 0);
+        obj = rtn;
     }
 
     if (obj->cls != str_cls) {
@@ -928,14 +1399,14 @@ extern "C" BoxedInt* hash(Box* obj) {
     static StatCounter slowpath_hash("slowpath_hash");
     slowpath_hash.log();
 
-    Box *hash = getclsattr_internal(obj, "__hash__", NULL, NULL);
-    if (hash == NULL) {
+    static const std::string* hash_str = internString("__hash__");
+    Box *rtn = callattrInternal0(obj, hash_str, CLASS_ONLY, NULL, 0);
+    if (rtn == NULL) {
         ASSERT(isUserDefined(obj->cls), "%s.__hash__", getTypeName(obj)->c_str());
         // TODO not the best way to handle this...
         return static_cast<BoxedInt*>(boxInt((i64)obj));
     }
 
-    Box* rtn = runtimeCall0(hash, 0);
     if (rtn->cls != int_cls) {
         fprintf(stderr, "TypeError: an integer is required\n");
         raiseExc();
@@ -986,6 +1457,33 @@ extern "C" i64 unboxedLen(Box* obj) {
 
     std::unique_ptr<Rewriter> rewriter(Rewriter::createRewriter(__builtin_extract_return_addr(__builtin_return_address(0)), 1, 1, "unboxedLen"));
 
+    // The builtin containers don't need to go through __len__: their sizes are full words, so the
+    // IC is a class guard and a load, except for str's, which is inside the std::string.
+    BoxedClass* cls = obj->cls;
+    if (cls == list_cls || cls == tuple_cls || cls == dict_cls || cls == str_cls) {
+        if (rewriter.get()) {
+            RewriterVar r_obj = rewriter->getArg(0);
+            r_obj.addAttrGuard(BOX_CLS_OFFSET, (intptr_t)cls);
+            if (cls == list_cls)
+                r_obj.getAttr(LIST_SIZE_OFFSET, -1);
+            else if (cls == tuple_cls)
+                r_obj.getAttr(TUPLE_NELTS_OFFSET, -1);
+            else if (cls == dict_cls)
+                r_obj.getAttr(DICT_SIZE_OFFSET, -1);
+            else
+                rewriter->call((void*)strLenUnboxed);
+            rewriter->commit();
+        }
+
+        if (cls == list_cls)
+            return listLenUnboxed(static_cast<BoxedList*>(obj));
+        if (cls == tuple_cls)
+            return tupleLenUnboxed(static_cast<BoxedTuple*>(obj));
+        if (cls == dict_cls)
+            return dictLenUnboxed(static_cast<BoxedDict*>(obj));
+        return strLenUnboxed(static_cast<BoxedString*>(obj));
+    }
+
     BoxedInt* lobj;
     RewriterVar r_boxed;
     if (rewriter.get()) {
@@ -1016,8 +1514,29 @@ extern "C" void print(Box *obj) {
     static StatCounter slowpath_print("slowpath_print");
     slowpath_print.log();
 
+    // The common types can be written out directly, without boxing up their str() first:
+    if (obj->cls == str_cls) {
+        const std::string &s = static_cast<BoxedString*>(obj)->s;
+        writeBytes(stdout, s.data(), s.size());
+        return;
+    }
+    if (obj->cls == int_cls) {
+        char buf[24];
+        int len = intToDecimal(static_cast<BoxedInt*>(obj)->n, buf);
+        writeBytes(stdout, buf, len);
+        return;
+    }
+    if (obj->cls == float_cls) {
+        printFloat(static_cast<BoxedFloat*>(obj)->d);
+        return;
+    }
+    if (obj->cls == bool_cls) {
+        fputs(static_cast<BoxedBool*>(obj)->b ? "True" : "False", stdout);
+        return;
+    }
+
     BoxedString *strd = str(obj);
-    printf("%s", strd->s.c_str());
+    writeBytes(stdout, strd->s.data(), strd->s.size());
 }
 
 extern "C" void dump(Box *obj) {
@@ -1129,7 +1648,7 @@ extern "C" Box* callattrInternal(Box* obj, const std::string *attr, LookupScope
             else if (clsattr)
                 r_clsattr = ga_rewrite_args.out_rtn.move(-1);
         } else {
-            clsattr = getattr_internal(obj->cls, attr->c_str(), false, false, NULL, NULL);
+            clsattr = lookupClassAttr(obj->cls, internString(attr->c_str()));
         }
     }
 
@@ -1330,6 +1849,124 @@ extern "C" Box* callattr(Box* obj, std::string *attr, bool clsonly, int64_t narg
     return rtn;
 }
 
+static void raiseArgCountError(CLFunction *cl, bool too_many, int64_t ngiven) {
+    AST_arguments *params = cl->source->getArgsAST();
+    int nnamed = params->args.size();
+    int ndefaults = params->defaults.size();
+
+    const char* how = "exactly";
+    if (ndefaults || params->vararg.size())
+        how = too_many ? "at most" : "at least";
+    int n = too_many ? nnamed : nnamed - ndefaults;
+    fprintf(stderr, "TypeError: %s() takes %s %d argument%s (%ld given)\n", cl->source->getName().c_str(), how, n, n == 1 ? "" : "s", ngiven);
+    raiseExc();
+}
+
+// Figures out how a call with npositional positional arguments (including the bound self, if any) and
+// the given keywords binds to the function's parameters; this only depends on the function's
+// code, not on the function object or on the arguments, so it can be reused for every call of
+// the same CLFunction from the same call site.
+static void computeArgMapping(CLFunction *cl, int64_t npositional, const std::vector<const std::string*> &keyword_names, ArgMapping *mapping) {
+    AST_arguments *params = cl->source->getArgsAST();
+    int nnamed = params->args.size();
+    int ndefaults = params->defaults.size();
+    int nkeywords = keyword_names.size();
+
+    mapping->sources.assign(nnamed, -1);
+    mapping->extra_keywords.clear();
+
+    if (npositional > nnamed && !params->vararg.size())
+        raiseArgCountError(cl, true, npositional + nkeywords);
+    std::vector<bool> filled(nnamed, false);
+    for (int i = 0; i < nnamed && i < npositional; i++) {
+        mapping->sources[i] = i;
+        filled[i] = true;
+    }
+
+    for (int k = 0; k < nkeywords; k++) {
+        const std::string &name = *keyword_names[k];
+        int idx = -1;
+        for (int i = 0; i < nnamed; i++) {
+            // Tuple parameters can't be passed by keyword:
+            if (params->args[i]->type == AST_TYPE::Name && static_cast<AST_Name*>(params->args[i])->id == name) {
+                idx = i;
+                break;
+            }
+        }
+
+        if (idx == -1) {
+            if (!params->kwarg) {
+                fprintf(stderr, "TypeError: %s() got an unexpected keyword argument '%s'\n", cl->source->getName().c_str(), name.c_str());
+                raiseExc();
+            }
+            mapping->extra_keywords.push_back(k);
+            continue;
+        }
+
+        if (filled[idx]) {
+            fprintf(stderr, "TypeError: %s() got multiple values for keyword argument '%s'\n", cl->source->getName().c_str(), name.c_str());
+            raiseExc();
+        }
+        filled[idx] = true;
+        mapping->sources[idx] = npositional + k;
+    }
+
+    for (int i = 0; i < nnamed; i++) {
+        if (filled[i])
+            continue;
+        if (i < nnamed - ndefaults)
+            raiseArgCountError(cl, false, npositional + nkeywords);
+        mapping->sources[i] = ~(i - (nnamed - ndefaults));
+    }
+}
+
+// Calls f with its parameters filled in according to the mapping: args has the npositional
+// positional arguments (not counting self) followed by the keyword ones.  The dict for **kwargs
+// only gets made if the function takes one.
+static Box* callMapped(BoxedFunction *f, const ArgMapping &mapping, Box* self, int64_t npositional, Box** args, const std::vector<const std::string*> &keyword_names) {
+    static StatCounter num_mapped_calls("num_mapped_calls");
+    num_mapped_calls.log();
+
+    AST_arguments *params = f->f->source->getArgsAST();
+    int nnamed = params->args.size();
+    int nself = self ? 1 : 0;
+    int64_t nparams = f->f->source->getArgNames().size();
+
+    Box** bound = (Box**)alloca(std::max(nparams, 3L) * sizeof(Box*));
+    for (int i = 0; i < nnamed; i++) {
+        int src = mapping.sources[i];
+        if (src < 0)
+            bound[i] = f->defaults->elts[~src];
+        else if (src < nself)
+            bound[i] = self;
+        else
+            bound[i] = args[src - nself];
+    }
+
+    int next = nnamed;
+    if (params->vararg.size()) {
+        int64_t nextra = std::max(0L, nself + npositional - nnamed);
+        Box** extra = (Box**)alloca(std::max(nextra, 1L) * sizeof(Box*));
+        for (int i = 0; i < nextra; i++) {
+            int src = nnamed + i;
+            extra[i] = src < nself ? self : args[src - nself];
+        }
+        bound[next++] = createTuple(nextra, extra);
+    }
+    if (params->kwarg) {
+        BoxedDict *kwargs = new BoxedDict();
+        for (int k : mapping.extra_keywords)
+            kwargs->set(boxString(*keyword_names[k]), args[npositional + k]);
+        bound[next++] = kwargs;
+    }
+    if (f->closure)
+        bound[next++] = f->closure;
+    assert(next == nparams);
+
+    CompiledFunction *cf = resolveCLFunc(f->f, nparams, bound[0], bound[1], bound[2], bound + 3);
+    return callCompiledFunc(cf, nparams, bound[0], bound[1], bound[2], bound + 3);
+}
+
 static const std::string _call_str("__call__"), _new_str("__new__"), _init_str("__init__");
 Box* runtimeCallInternal(Box* obj, CallRewriteArgs *rewrite_args, int64_t nargs, Box* arg1, Box* arg2, Box* arg3, Box* *args) {
     // the 10M upper bound isn't a hard max, just almost certainly a bug
@@ -1338,6 +1975,24 @@ Box* runtimeCallInternal(Box* obj, CallRewriteArgs *rewrite_args, int64_t nargs,
 
     Box* orig_obj = obj;
 
+    if (obj->cls == capifunc_cls && canCallCApiDirect(obj, nargs)) {
+        // Which calls can go directly depends only on the function object, so that's all that the IC
+        // needs to guard on:
+        if (rewrite_args) {
+            if (!rewrite_args->func_guarded)
+                rewrite_args->obj.addGuard((intptr_t)obj);
+            if (nargs == 1)
+                rewrite_args->arg1.move(1);
+            else
+                rewrite_args->rewriter->loadConst(1, 0);
+            rewrite_args->rewriter->loadConst(0, (intptr_t)obj);
+            RewriterVar r_rtn = rewrite_args->rewriter->call((void*)callCApiDirect);
+            rewrite_args->out_rtn = r_rtn.move(-1);
+            rewrite_args->out_success = true;
+        }
+        return callCApiDirect(obj, nargs == 1 ? arg1 : NULL);
+    }
+
     if (obj->cls != function_cls && obj->cls != instancemethod_cls) {
         if (rewrite_args) {
             // TODO is this ok?
@@ -1368,6 +2023,43 @@ Box* runtimeCallInternal(Box* obj, CallRewriteArgs *rewrite_args, int64_t nargs,
     if (obj->cls == function_cls) {
         BoxedFunction *f = static_cast<BoxedFunction*>(obj);
 
+        // Python-level functions take exactly their parameters (plus the closure, if they take one);
+        // anything else needs binding first.
+        int64_t nargs_passed = nargs;
+        AST_arguments *params = f->f->source ? f->f->source->getArgsAST() : NULL;
+        if (params && (nargs != params->args.size() || params->vararg.size() || params->kwarg || f->closure)) {
+            int nnamed = params->args.size();
+            int ndefaults = params->defaults.size();
+            int nclosure = f->closure ? 1 : 0;
+            if (!params->vararg.size() && !params->kwarg && nargs <= nnamed && nargs >= nnamed - ndefaults && nnamed + nclosure <= 3) {
+                // Leaving off parameters that have defaults: the defaults and the closure can't change for
+                // this function object, which the IC guards on, so they get passed as constants (see below).
+                Box* filled[3] = {arg1, arg2, arg3};
+                for (int i = nargs; i < nnamed; i++)
+                    filled[i] = f->defaults->elts[i - (nnamed - ndefaults)];
+                if (f->closure)
+                    filled[nnamed] = f->closure;
+                arg1 = filled[0];
+                arg2 = filled[1];
+                arg3 = filled[2];
+                nargs = nnamed + nclosure;
+            } else {
+                // Extra arguments for *args, or a function that takes **kwargs (or has lots of parameters,
+                // counting the closure):
+                // bind the same way that calls with keywords do, without rewriting.
+                Box** all_args = (Box**)alloca(std::max(nargs, 1L) * sizeof(Box*));
+                if (nargs >= 1) all_args[0] = arg1;
+                if (nargs >= 2) all_args[1] = arg2;
+                if (nargs >= 3) all_args[2] = arg3;
+                if (nargs >= 4) memcpy(all_args + 3, args, (nargs - 3) * sizeof(Box*));
+
+                static std::vector<const std::string*> no_keywords;
+                ArgMapping mapping;
+                computeArgMapping(f->f, nargs, no_keywords, &mapping);
+                return callMapped(f, mapping, NULL, nargs, all_args, no_keywords);
+            }
+        }
+
         CompiledFunction *cf = resolveCLFunc(f->f, nargs, arg1, arg2, arg3, args);
 
         // typeCall (ie the base for constructors) is important enough that it knows
@@ -1394,14 +2086,41 @@ Box* runtimeCallInternal(Box* obj, CallRewriteArgs *rewrite_args, int64_t nargs,
             return rtn;
         }
 
-        if (cf->sig->is_vararg) rewrite_args = NULL;
-        if (cf->is_interpreted) rewrite_args = NULL;
+        // Versions that can't be called directly go through callCompiledFunc, with the version that we
+        // resolved embedded in the IC.  To keep the shuffling simple, that only gets done if the
+        // arguments (including the array of the ones past the third) are where they got passed in.
+        bool call_directly = !cf->sig->is_vararg && !cf->is_interpreted;
+        if (rewrite_args && !call_directly) {
+            if ((nargs_passed >= 1 && rewrite_args->arg1.getArgnum() != 0)
+                    || (nargs_passed >= 2 && rewrite_args->arg2.getArgnum() != 1)
+                    || (nargs_passed >= 3 && rewrite_args->arg3.getArgnum() != 2)
+                    || (nargs_passed >= 4 && rewrite_args->args.getArgnum() != 3))
+                rewrite_args = NULL;
+        }
 
         if (rewrite_args) {
             if (!rewrite_args->func_guarded)
                 rewrite_args->obj.addGuard((intptr_t)obj);
 
             rewrite_args->rewriter->addDependenceOn(cf->dependent_callsites);
+        }
+
+        if (rewrite_args && !call_directly) {
+            // Shift the arguments up by two to make room for cf and nargs; going from the last one
+            // down, so that none of them get overwritten before they're moved:
+            if (nargs >= 4) rewrite_args->args.move(5);
+            else rewrite_args->rewriter->loadConst(5, 0);
+            if (nargs_passed >= 3) rewrite_args->arg3.move(4);
+            if (nargs_passed >= 2) rewrite_args->arg2.move(3);
+            if (nargs_passed >= 1) rewrite_args->arg1.move(2);
+            Box* firstargs[] = {arg1, arg2, arg3};
+            for (int i = nargs_passed; i < nargs; i++)
+                rewrite_args->rewriter->loadConst(2 + i, (intptr_t)firstargs[i]);
+            rewrite_args->rewriter->loadConst(1, nargs);
+            rewrite_args->rewriter->loadConst(0, (intptr_t)cf);
+            RewriterVar r_rtn = rewrite_args->rewriter->call((void*)callCompiledFunc);
+            rewrite_args->out_rtn = r_rtn.move(-1);
+        } else if (rewrite_args) {
 
             //if (VERBOSITY()) {
                 //printf("runtimeCallInternal: %d", rewrite_args->obj.getArgnum());
@@ -1412,10 +2131,13 @@ Box* runtimeCallInternal(Box* obj, CallRewriteArgs *rewrite_args, int64_t nargs,
                 //printf("\n");
             //}
 
-            if (nargs >= 1) rewrite_args->arg1.move(0);
-            if (nargs >= 2) rewrite_args->arg2.move(1);
-            if (nargs >= 3) rewrite_args->arg3.move(2);
+            if (nargs_passed >= 1) rewrite_args->arg1.move(0);
+            if (nargs_passed >= 2) rewrite_args->arg2.move(1);
+            if (nargs_passed >= 3) rewrite_args->arg3.move(2);
             if (nargs >= 4) rewrite_args->args.move(3);
+            Box* firstargs[] = {arg1, arg2, arg3};
+            for (int i = nargs_passed; i < nargs; i++)
+                rewrite_args->rewriter->loadConst(i, (intptr_t)firstargs[i]);
             RewriterVar r_rtn = rewrite_args->rewriter->call(cf->code);
             rewrite_args->out_rtn = r_rtn.move(-1);
         }
@@ -1458,10 +2180,60 @@ Box* runtimeCallInternal(Box* obj, CallRewriteArgs *rewrite_args, int64_t nargs,
             if (rewrite_args) rewrite_args->out_success = true;
             return rtn;
         } else {
-            Box **new_args = (Box**)alloca(sizeof(Box*) * (nargs + 1 - 3));
+            int alloca_size = sizeof(Box*) * (nargs + 1 - 3);
+            Box **new_args = (Box**)alloca(alloca_size);
             new_args[0] = arg3;
             memcpy(new_args+1, args, (nargs - 3) * sizeof(Box*));
-            Box* rtn = runtimeCall(im->func, nargs + 1, im->obj, arg1, arg2, new_args);
+
+            // The new array and the copying use the scratch registers, so nothing can be living in those:
+            if (rewrite_args) {
+                bool in_scratch = false;
+                for (RewriterVar *v : {&rewrite_args->obj, &rewrite_args->arg1, &rewrite_args->arg2, &rewrite_args->arg3, &rewrite_args->args}) {
+                    if (v->getArgnum() == -2 || v->getArgnum() == -3)
+                        in_scratch = true;
+                }
+                if (in_scratch)
+                    rewrite_args = NULL;
+            }
+
+            Box* rtn;
+            if (rewrite_args) {
+                // Same as in callattrInternal: the shifted-over arguments go into an array on the IC's stack.
+                RewriterVar r_new_args = rewrite_args->rewriter->alloca_(alloca_size, -3);
+
+                if (rewrite_args->arg3.isInReg())
+                    r_new_args.setAttr(0, rewrite_args->arg3, /* user_visible = */ false);
+                else
+                    r_new_args.setAttr(0, rewrite_args->arg3.move(-2), /* user_visible = */ false);
+
+                for (int i = 0; i < nargs - 3; i++) {
+                    RewriterVar arg;
+                    if (rewrite_args->args.isInReg())
+                        arg = rewrite_args->args.getAttr(i * sizeof(Box*), -2);
+                    else
+                        arg = rewrite_args->args.move(-2).getAttr(i * sizeof(Box*), -2);
+                    r_new_args.setAttr((i + 1) * sizeof(Box*), arg, /* user_visible = */ false);
+                }
+
+                CallRewriteArgs srewrite_args(rewrite_args->rewriter, RewriterVar());
+                srewrite_args.arg1 = rewrite_args->obj.getAttr(INSTANCEMETHOD_OBJ_OFFSET, 0);
+                srewrite_args.arg2 = rewrite_args->arg1;
+                srewrite_args.arg3 = rewrite_args->arg2;
+                srewrite_args.args = r_new_args;
+                srewrite_args.func_guarded = true;
+                srewrite_args.args_guarded = true;
+
+                rtn = runtimeCallInternal(im->func, &srewrite_args, nargs + 1, im->obj, arg1, arg2, new_args);
+
+                if (!srewrite_args.out_success) {
+                    rewrite_args = NULL;
+                } else {
+                    rewrite_args->out_rtn = srewrite_args.out_rtn.move(-1);
+                }
+            } else {
+                rtn = runtimeCallInternal(im->func, NULL, nargs + 1, im->obj, arg1, arg2, new_args);
+            }
+            if (rewrite_args) rewrite_args->out_success = true;
             return rtn;
         }
     }
@@ -1506,13 +2278,134 @@ extern "C" Box* runtimeCall(Box *obj, int64_t nargs, Box* arg1, Box* arg2, Box*
     return rtn;
 }
 
+namespace {
+struct BinopImplKey {
+    BoxedClass *lhs_cls, *rhs_cls;
+    int op_type;
+
+    BinopImplKey(BoxedClass* lhs_cls, BoxedClass* rhs_cls, int op_type) : lhs_cls(lhs_cls), rhs_cls(rhs_cls), op_type(op_type) {}
+    bool operator==(const BinopImplKey &rhs) const {
+        return lhs_cls == rhs.lhs_cls && rhs_cls == rhs.rhs_cls && op_type == rhs.op_type;
+    }
+};
+struct BinopImplKeyHasher {
+    size_t operator()(const BinopImplKey &k) const {
+        return ((uintptr_t)k.lhs_cls >> 4) * 31 + ((uintptr_t)k.rhs_cls >> 4) * 7 + k.op_type;
+    }
+};
+}
+static std::unordered_map<BinopImplKey, void*, BinopImplKeyHasher> binop_impls;
+
+void registerBinopImpl(BoxedClass* lhs_cls, BoxedClass* rhs_cls, int op_type, void* impl) {
+    // What Div means depends on FUTURE_DIVISION:
+    assert(op_type != AST_TYPE::Div);
+    binop_impls[BinopImplKey(lhs_cls, rhs_cls, op_type)] = impl;
+}
+
+static void* getBinopImpl(BoxedClass* lhs_cls, BoxedClass* rhs_cls, int op_type) {
+    // Only trust these as long as nothing can change the classes' attributes:
+    if (!lhs_cls->is_constant || !rhs_cls->is_constant)
+        return NULL;
+
+    std::unordered_map<BinopImplKey, void*, BinopImplKeyHasher>::iterator it = binop_impls.find(BinopImplKey(lhs_cls, rhs_cls, op_type));
+    if (it == binop_impls.end())
+        return NULL;
+    return it->second;
+}
+
+static std::unordered_map<BoxedClass*, void*> contains_impls;
+
+void registerContainsImpl(BoxedClass* cls, void* impl) {
+    contains_impls[cls] = impl;
+}
+
+static void* getContainsImpl(BoxedClass* cls) {
+    if (!cls->is_constant)
+        return NULL;
+
+    std::unordered_map<BoxedClass*, void*>::iterator it = contains_impls.find(cls);
+    if (it == contains_impls.end())
+        return NULL;
+    return it->second;
+}
+
+// `elt in container` for anything that doesn't have a registered impl: __contains__ if it's there,
+// otherwise comparing against everything the container iterates over.
+static bool containsSlow(Box* container, Box* elt) {
+    static std::string* contains_str = const_cast<std::string*>(internString("__contains__"));
+    Box* r = callattrInternal1(container, contains_str, CLASS_ONLY, NULL, 1, elt);
+    if (r)
+        return nonzero(r);
+
+    if (!getclsattr_internal(container, "__iter__", NULL, NULL)) {
+        fprintf(stderr, "TypeError: argument of type '%s' is not iterable\n", getTypeName(container)->c_str());
+        raiseExc();
+    }
+
+    static std::string* iter_str = const_cast<std::string*>(internString("__iter__"));
+    Box* iter = callattr(container, iter_str, true, 0, NULL, NULL, NULL, NULL);
+    while (Box* v = iterNext(iter)) {
+        if (PyEq()(v, elt))
+            return true;
+    }
+    return false;
+}
+
+// How a binop or comparison on a pair of classes resolves: the lhs's __op__ and the rhs's reverse
+// method (either of which can be NULL).  The lookups get cached in a direct-mapped table that is
+// validated by the version tags of both classes.
+struct BinopResolution {
+    BoxedClass *lhs_cls, *rhs_cls;
+    int op_type;
+    int64_t lhs_version_tag, rhs_version_tag;
+    const std::string *op_name, *rop_name;
+    Box *lhs_func, *rhs_func;
+};
+static const int BINOP_CACHE_SIZE = 1024;
+static BinopResolution binop_cache[BINOP_CACHE_SIZE];
+
+static BinopResolution resolveBinop(BoxedClass* lhs_cls, BoxedClass* rhs_cls, int op_type) {
+    static StatCounter binop_cache_hits("binop_cache_hits");
+    static StatCounter binop_cache_misses("binop_cache_misses");
+
+    uintptr_t h = ((uintptr_t)lhs_cls >> 4) * 31 + ((uintptr_t)rhs_cls >> 4) * 7 + op_type;
+    BinopResolution &e = binop_cache[h & (BINOP_CACHE_SIZE - 1)];
+    if (e.lhs_cls == lhs_cls && e.rhs_cls == rhs_cls && e.op_type == op_type
+            && e.lhs_version_tag == lhs_cls->version_tag && e.rhs_version_tag == rhs_cls->version_tag) {
+        binop_cache_hits.log();
+        return e;
+    }
+    binop_cache_misses.log();
+
+    BinopResolution rtn;
+    rtn.lhs_cls = lhs_cls;
+    rtn.rhs_cls = rhs_cls;
+    rtn.op_type = op_type;
+    rtn.lhs_version_tag = lhs_cls->version_tag;
+    rtn.rhs_version_tag = rhs_cls->version_tag;
+    rtn.op_name = internString(getOpName(op_type));
+    rtn.rop_name = internString(getReverseOpName(op_type));
+    rtn.lhs_func = lookupClassAttr(lhs_cls, rtn.op_name);
+    rtn.rhs_func = lookupClassAttr(rhs_cls, rtn.rop_name);
+
+    // The names for Div depend on FUTURE_DIVISION, so don't remember those:
+    if (op_type != AST_TYPE::Div)
+        e = rtn;
+    return rtn;
+}
+
+// Calls a class attribute the same way callattrInternal would:
+static Box* callBinopFunc(Box* func, Box* self, Box* other) {
+    if (func->cls == function_cls)
+        return runtimeCallInternal2(func, NULL, 2, self, other);
+    return runtimeCallInternal1(func, NULL, 1, other);
+}
+
 extern "C" Box* binop(Box* lhs, Box* rhs, int op_type) {
     static StatCounter slowpath_binop("slowpath_binop");
     slowpath_binop.log();
     static StatCounter nopatch_binop("nopatch_binop");
 
-    std::string op_name = getOpName(op_type);
-
     //int id = Stats::getStatId("slowpath_binop_" + *getTypeName(lhs) + op_name + *getTypeName(rhs));
     //Stats::log(id);
 
@@ -1541,6 +2434,22 @@ extern "C" Box* binop(Box* lhs, Box* rhs, int op_type) {
             r_rhs.addAttrGuard(BOX_CLS_OFFSET, (intptr_t)rhs->cls);
         }
 
+        void* impl = getBinopImpl(lhs->cls, rhs->cls, op_type);
+        if (impl) {
+            // The operands are still in the first two argument registers:
+            if (rewriter.get()) {
+                rewriter->call(impl);
+                rewriter->commit();
+            }
+
+            Box* rtn = ((Box* (*)(Box*, Box*))impl)(lhs, rhs);
+            assert(rtn != NotImplemented);
+            return rtn;
+        }
+
+        BinopResolution res = resolveBinop(lhs->cls, rhs->cls, op_type);
+        const std::string &op_name = *res.op_name;
+
         Box* lrtn;
         if (rewriter.get()) {
             CallRewriteArgs rewrite_args(rewriter.get(), rewriter->getArg(0));
@@ -1552,7 +2461,7 @@ extern "C" Box* binop(Box* lhs, Box* rhs, int op_type) {
             else if (lrtn)
                 rewrite_args.out_rtn.move(-1);
         } else {
-            lrtn = callattrInternal1(lhs, &op_name, CLASS_ONLY, NULL, 1, rhs);
+            lrtn = res.lhs_func ? callBinopFunc(res.lhs_func, lhs, rhs) : NULL;
         }
 
 
@@ -1571,10 +2480,10 @@ extern "C" Box* binop(Box* lhs, Box* rhs, int op_type) {
 
         // TODO patch these cases
 
-        std::string rop_name = getReverseOpName(op_type);
-        Box* rattr_func = getattr_internal(rhs->cls, rop_name.c_str(), false, false, NULL, NULL);
+        const std::string &rop_name = *res.rop_name;
+        Box* rattr_func = res.rhs_func;
         if (rattr_func) {
-            Box* rtn = runtimeCall2(rattr_func, 2, rhs, lhs);
+            Box* rtn = runtimeCallInternal2(rattr_func, NULL, 2, rhs, lhs);
             if (rtn != NotImplemented) {
                 return rtn;
             }
@@ -1613,6 +2522,34 @@ Box* compareInternal(Box* lhs, Box* rhs, int op_type, CompareRewriteArgs *rewrit
         return boxBool((lhs == rhs) ^ neg);
     }
 
+    // These dispatch on the container, which is the rhs, and only ever return a bool:
+    if (op_type == AST_TYPE::In || op_type == AST_TYPE::NotIn) {
+        bool neg = (op_type == AST_TYPE::NotIn);
+
+        void* impl = getContainsImpl(rhs->cls);
+        if (impl) {
+            // irgen emits `not in` as a negated `in`, so only bother rewriting the latter:
+            if (rewrite_args && !neg) {
+                rewrite_args->rhs.addAttrGuard(BOX_CLS_OFFSET, (intptr_t)rhs->cls);
+                // The impls take (container, elt), so swap the args, using the op_type's register
+                // as the scratch:
+                RewriterVar r_elt = rewrite_args->lhs.move(2);
+                rewrite_args->rhs.move(0);
+                r_elt.move(1);
+                rewrite_args->out_rtn = rewrite_args->rewriter->call(impl);
+                rewrite_args->out_success = true;
+            }
+
+            Box* rtn = ((Box* (*)(Box*, Box*))impl)(rhs, lhs);
+            assert(rtn == True || rtn == False);
+            if (neg)
+                return boxBool(rtn == False);
+            return rtn;
+        }
+
+        return boxBool(containsSlow(rhs, lhs) ^ neg);
+    }
+
     // Can do the guard checks after the Is/IsNot handling, since that is
     // irrespective of the object classes
     if (rewrite_args) {
@@ -1625,7 +2562,27 @@ Box* compareInternal(Box* lhs, Box* rhs, int op_type, CompareRewriteArgs *rewrit
         rewrite_args->rhs.addAttrGuard(BOX_CLS_OFFSET, (intptr_t)rhs->cls);
     }
 
-    std::string op_name = getOpName(op_type);
+    void* impl = getBinopImpl(lhs->cls, rhs->cls, op_type);
+    if (impl) {
+        if (rewrite_args) {
+            rewrite_args->lhs.move(0);
+            rewrite_args->rhs.move(1);
+            rewrite_args->out_rtn = rewrite_args->rewriter->call(impl);
+            rewrite_args->out_success = true;
+        }
+
+        Box* rtn = ((Box* (*)(Box*, Box*))impl)(lhs, rhs);
+        assert(rtn != NotImplemented);
+        return rtn;
+    }
+
+    // We never keep the rewrite for user-defined classes, so don't bother trying:
+    bool can_patchpoint = !isUserDefined(lhs->cls) && !isUserDefined(rhs->cls);
+    if (!can_patchpoint)
+        rewrite_args = NULL;
+
+    BinopResolution res = resolveBinop(lhs->cls, rhs->cls, op_type);
+    const std::string &op_name = *res.op_name;
 
     Box* lrtn;
     if (rewrite_args) {
@@ -1638,12 +2595,11 @@ Box* compareInternal(Box* lhs, Box* rhs, int op_type, CompareRewriteArgs *rewrit
         else if (lrtn)
             rewrite_args->out_rtn = crewrite_args.out_rtn;
     } else {
-        lrtn = callattrInternal1(lhs, &op_name, CLASS_ONLY, NULL, 1, rhs);
+        lrtn = res.lhs_func ? callBinopFunc(res.lhs_func, lhs, rhs) : NULL;
     }
 
     if (lrtn) {
         if (lrtn != NotImplemented) {
-            bool can_patchpoint = !isUserDefined(lhs->cls) && !isUserDefined(rhs->cls);
             if (rewrite_args && can_patchpoint) {
                 rewrite_args->out_success = true;
             }
@@ -1652,10 +2608,9 @@ Box* compareInternal(Box* lhs, Box* rhs, int op_type, CompareRewriteArgs *rewrit
     } else {
     }
 
-    std::string rop_name = getReverseOpName(op_type);
-    Box* rattr_func = getattr_internal(rhs->cls, rop_name.c_str(), false, false, NULL, NULL);
+    Box* rattr_func = res.rhs_func;
     if (rattr_func) {
-        Box* rtn = runtimeCall2(rattr_func, 2, rhs, lhs);
+        Box* rtn = runtimeCallInternal2(rattr_func, NULL, 2, rhs, lhs);
         if (rtn != NotImplemented) {
             ////printf("rfunc returned NotImplemented\n");
             ////bool can_patchpoint = lhs->cls->is_constant && (lattr_func == NULL || (lattr;
@@ -1687,11 +2642,11 @@ Box* compareInternal(Box* lhs, Box* rhs, int op_type, CompareRewriteArgs *rewrit
             cmp2 = (intptr_t)rhs;
         } else {
             // This isn't really necessary, but try to make sure that numbers get sorted first
-            if (lhs->cls == int_cls || lhs->cls == float_cls)
+            if (lhs->cls == int_cls || lhs->cls == long_cls || lhs->cls == float_cls)
                 cmp1 = 0;
             else
                 cmp1 = (intptr_t)lhs->cls;
-            if (rhs->cls == int_cls || rhs->cls == float_cls)
+            if (rhs->cls == int_cls || rhs->cls == long_cls || rhs->cls == float_cls)
                 cmp2 = 0;
             else
                 cmp2 = (intptr_t)rhs->cls;
@@ -1750,14 +2705,71 @@ extern "C" Box* unaryop(Box* operand, int op_type) {
     return rtn;
 }
 
+// Indexing a list or a tuple with an in-range int gets done entirely in the IC: the bounds check and
+// the load of the element, without calling __getitem__ (lists of unboxed ints still need to box the
+// element).  Negative indices don't get handled, they just fail the bounds check and take the normal path.
+static bool tryInlineGetitem(Rewriter *rewriter, Box* value, Box* slice, Box** rtn) {
+    if (slice->cls != int_cls)
+        return false;
+    int64_t n = static_cast<BoxedInt*>(slice)->n;
+
+    RewriterVar r_value = rewriter->getArg(0);
+    RewriterVar r_slice = rewriter->getArg(1);
+    if (value->cls == list_cls) {
+        BoxedList *list = static_cast<BoxedList*>(value);
+        if (list->strategy == BoxedList::FLOAT_STRATEGY || n < 0 || n >= list->size)
+            return false;
+
+        r_value.addAttrGuard(BOX_CLS_OFFSET, (intptr_t)list_cls);
+        r_slice.addAttrGuard(BOX_CLS_OFFSET, (intptr_t)int_cls);
+        r_value.addAttrGuard(LIST_STRATEGY_OFFSET, list->strategy);
+        RewriterVar r_n = r_slice.getAttr(INT_N_OFFSET, -2);
+        RewriterVar r_size = r_value.getAttr(LIST_SIZE_OFFSET, -3);
+        r_n.addGuardBelow(r_size);
+        RewriterVar r_elts = r_value.getAttr(LIST_ELTS_OFFSET, -3);
+        if (list->strategy == BoxedList::INT_STRATEGY) {
+            r_elts.getIndexedAttr(r_n, ELEMENT_ARRAY_ELTS_OFFSET, 0);
+            rewriter->call((void*)boxInt).move(-1);
+        } else {
+            r_elts.getIndexedAttr(r_n, ELEMENT_ARRAY_ELTS_OFFSET, -1);
+        }
+
+        *rtn = list->getElt(n);
+        return true;
+    }
+
+    if (value->cls == tuple_cls) {
+        BoxedTuple *tuple = static_cast<BoxedTuple*>(value);
+        if (n < 0 || n >= tuple->nelts)
+            return false;
+
+        r_value.addAttrGuard(BOX_CLS_OFFSET, (intptr_t)tuple_cls);
+        r_slice.addAttrGuard(BOX_CLS_OFFSET, (intptr_t)int_cls);
+        RewriterVar r_n = r_slice.getAttr(INT_N_OFFSET, -2);
+        RewriterVar r_size = r_value.getAttr(TUPLE_NELTS_OFFSET, -3);
+        r_n.addGuardBelow(r_size);
+        r_value.getIndexedAttr(r_n, TUPLE_ELTS_OFFSET, -1);
+
+        *rtn = tuple->elts[n];
+        return true;
+    }
+
+    return false;
+}
+
 extern "C" Box* getitem(Box* value, Box* slice) {
     static StatCounter slowpath_getitem("slowpath_getitem");
     slowpath_getitem.log();
     static std::string str_getitem("__getitem__");
 
-    std::unique_ptr<Rewriter> rewriter(Rewriter::createRewriter(__builtin_extract_return_addr(__builtin_return_address(0)), 2, 1, "getitem"));
+    std::unique_ptr<Rewriter> rewriter(Rewriter::createRewriter(__builtin_extract_return_addr(__builtin_return_address(0)), 2, 2, "getitem"));
 
     Box* rtn;
+    if (rewriter.get() && tryInlineGetitem(rewriter.get(), value, slice, &rtn)) {
+        rewriter->commit();
+        return rtn;
+    }
+
     if (rewriter.get()) {
         CallRewriteArgs rewrite_args(rewriter.get(), rewriter->getArg(0));
         rewrite_args.arg1 = rewriter->getArg(1);
@@ -1825,8 +2837,9 @@ extern "C" void setitem(Box* target, Box* slice, Box* value) {
 
 // A wrapper around the HCBox constructor
 // TODO is there a way to avoid the indirection?
-static Box* makeHCBox(ObjectFlavor *flavor, BoxedClass *cls) {
-    return new HCBox(flavor, cls);
+static Box* makeHCBox(const ObjectFlavor *flavor, BoxedClass *cls) {
+    int num_inline = cls->instance_inline_attrs;
+    return new (num_inline) HCBox(flavor, cls, num_inline, cls->instance_list_attrs);
 }
 
 // For use on __init__ return values
@@ -1945,7 +2958,7 @@ Box* typeCallInternal(CallRewriteArgs *rewrite_args, int64_t nargs, Box* arg1, B
         }
     } else {
         if (isUserDefined(ccls)) {
-            made = new HCBox(&user_flavor, ccls);
+            made = makeHCBox(&user_flavor, ccls);
 
             if (rewrite_args) {
                 if (init_attr) r_init.push();
@@ -2013,6 +3026,22 @@ Box* typeCallInternal(CallRewriteArgs *rewrite_args, int64_t nargs, Box* arg1, B
         }
     }
 
+    if (new_attr == NULL) {
+        // Size the next instances so that the attributes __init__ gave this one fit without any
+        // more allocations (and so that __init__'s setattr ICs turn into plain stores).
+        // Objects that went into dict mode don't use either kind of slot.
+        HiddenClass* final_hcls = static_cast<HCBox*>(made)->hcls;
+        if (!final_hcls->is_dict_mode) {
+            int nattrs = final_hcls->numAttrs();
+            int ninline = std::min(nattrs, MAX_INLINE_ATTRS);
+            if (ninline > ccls->instance_inline_attrs)
+                ccls->instance_inline_attrs = ninline;
+            int nlist = nattrs - ccls->instance_inline_attrs;
+            if (nlist > ccls->instance_list_attrs)
+                ccls->instance_list_attrs = nlist;
+        }
+    }
+
     if (rewrite_args) {
         rewrite_args->out_rtn = r_made;
         rewrite_args->out_success = true;
@@ -2022,6 +3051,7 @@ Box* typeCallInternal(CallRewriteArgs *rewrite_args, int64_t nargs, Box* arg1, B
 
 Box* typeCall(Box* obj, BoxedList* vararg) {
     assert(vararg->cls == list_cls);
+    vararg->switchToObjectStrategy();
     if (vararg->size == 0)
         return typeCallInternal1(NULL, 1, obj);
     else if (vararg->size == 1)
@@ -2032,6 +3062,56 @@ Box* typeCall(Box* obj, BoxedList* vararg) {
         return typeCallInternal(NULL, 1 + vararg->size, obj, vararg->elts->elts[0], vararg->elts->elts[1], &vararg->elts->elts[2]);
 }
 
+// Calls func (which has to be a python-level function) with the site's arguments, and self (if it's
+// not NULL) in front of them.
+static Box* callKeywordsInternal(Box* func, KeywordCallSite *site, Box* self, Box** args) {
+    if (func->cls != function_cls || static_cast<BoxedFunction*>(func)->f->source == NULL) {
+        fprintf(stderr, "TypeError: keyword arguments aren't supported for calls to '%s' objects\n", getTypeName(func)->c_str());
+        raiseExc();
+    }
+    BoxedFunction *f = static_cast<BoxedFunction*>(func);
+
+    bool bound = self != NULL;
+    if (site->cached_func != f->f || site->cached_bound != bound) {
+        static StatCounter slowpath_keyword_mapping("slowpath_keyword_mapping");
+        slowpath_keyword_mapping.log();
+
+        site->cached_func = NULL;
+        computeArgMapping(f->f, site->npositional + (bound ? 1 : 0), site->keyword_names, &site->cached_mapping);
+        site->cached_func = f->f;
+        site->cached_bound = bound;
+    }
+
+    return callMapped(f, site->cached_mapping, self, site->npositional, args, site->keyword_names);
+}
+
+extern "C" Box* runtimeCallKeywords(Box* obj, KeywordCallSite* site, Box** args) {
+    static StatCounter slowpath_runtimecall_keywords("slowpath_runtimecall_keywords");
+    slowpath_runtimecall_keywords.log();
+
+    if (obj->cls == instancemethod_cls) {
+        BoxedInstanceMethod *im = static_cast<BoxedInstanceMethod*>(obj);
+        return callKeywordsInternal(im->func, site, im->obj, args);
+    }
+
+    // Constructing instances of user-defined classes, which is typeCallInternal's common case:
+    if (obj->cls == type_cls) {
+        BoxedClass *ccls = static_cast<BoxedClass*>(obj);
+        Box* new_attr = getattr_internal(ccls, "__new__", false, false, NULL, NULL);
+        Box* init_attr = getattr_internal(ccls, "__init__", false, false, NULL, NULL);
+        if (new_attr || !init_attr || !isUserDefined(ccls)) {
+            fprintf(stderr, "TypeError: keyword arguments aren't supported for constructing '%s' objects\n", getNameOfClass(ccls)->c_str());
+            raiseExc();
+        }
+
+        Box* made = makeHCBox(&user_flavor, ccls);
+        assertInitNone(callKeywordsInternal(init_attr, site, made, args));
+        return made;
+    }
+
+    return callKeywordsInternal(obj, site, NULL, args);
+}
+
 Box* typeNew(Box* cls, Box* obj) {
     assert(cls == type_cls);
 
@@ -2045,16 +3125,20 @@ extern "C" Box* getGlobal(BoxedModule* m, std::string *name, bool from_global) {
     static StatCounter nopatch_getglobal("nopatch_getglobal");
 
     if (VERBOSITY() >= 2) {
-        std::string per_name_stat_name = "getglobal__" + *name;
-        int id = Stats::getStatId(per_name_stat_name);
-        Stats::log(id);
+        static StatCounterFamily per_name_stats("getglobal__");
+        per_name_stats.log(*name);
     }
 
     { /* anonymous scope to make sure destructors get run before we err out */
         std::unique_ptr<Rewriter> rewriter(Rewriter::createRewriter(__builtin_extract_return_addr(__builtin_return_address(0)), 3, 1, "getGlobal"));
 
+        // If the name hasn't been changing, the IC can just embed the value without any guards, and
+        // rely on the global cells to get invalidated if it (or the corresponding builtin) changes.
+        BoxedModule::GlobalCell *cell = m->getGlobalCell(name);
+        bool embed_value = (cell->num_changes < BoxedModule::MAX_GLOBAL_CHANGES);
+
         Box *r;
-        if (rewriter.get()) {
+        if (rewriter.get() && !embed_value) {
             //rewriter->trap();
 
             GetattrRewriteArgs rewrite_args(rewriter.get(), rewriter->getArg(0));
@@ -2063,11 +3147,16 @@ extern "C" Box* getGlobal(BoxedModule* m, std::string *name, bool from_global) {
                 rewriter.reset(NULL);
         } else {
             r = m->getattr(*name, NULL, NULL);
-            nopatch_getglobal.log();
+            if (!rewriter.get())
+                nopatch_getglobal.log();
         }
 
         if (r) {
             if (rewriter.get()) {
+                if (embed_value) {
+                    rewriter->addDependenceOn(cell->invalidator);
+                    rewriter->loadConst(-1, (intptr_t)r);
+                }
                 rewriter->commit();
             }
             return r;
@@ -2077,6 +3166,9 @@ extern "C" Box* getGlobal(BoxedModule* m, std::string *name, bool from_global) {
         static StatCounter stat_builtins("getglobal_builtins");
         stat_builtins.log();
 
+        if (rewriter.get() && embed_value)
+            rewriter->addDependenceOn(cell->invalidator);
+
         if ((*name) == "__builtins__") {
             if (rewriter.get()) {
                 RewriterVar r_rtn = rewriter->loadConst(-1, (intptr_t)builtins_module);
@@ -2085,8 +3177,11 @@ extern "C" Box* getGlobal(BoxedModule* m, std::string *name, bool from_global) {
             return builtins_module;
         }
 
+        BoxedModule::GlobalCell *builtin_cell = builtins_module->getGlobalCell(name);
+        embed_value = embed_value && (builtin_cell->num_changes < BoxedModule::MAX_GLOBAL_CHANGES);
+
         Box* rtn;
-        if (rewriter.get()) {
+        if (rewriter.get() && !embed_value) {
             RewriterVar builtins = rewriter->loadConst(3, (intptr_t)builtins_module);
             GetattrRewriteArgs rewrite_args(rewriter.get(), builtins);
             rtn = builtins_module->getattr(*name, &rewrite_args, NULL);
@@ -2097,6 +3192,16 @@ extern "C" Box* getGlobal(BoxedModule* m, std::string *name, bool from_global) {
             rtn = builtins_module->getattr(*name, NULL, NULL);
         }
 
+        if (rewriter.get() && embed_value) {
+            if (rtn) {
+                rewriter->addDependenceOn(builtin_cell->invalidator);
+                rewriter->loadConst(-1, (intptr_t)rtn);
+            } else {
+                // Not worth patching in the error path:
+                rewriter.reset(NULL);
+            }
+        }
+
         if (rewriter.get()) {
             rewriter->commit();
         }
@@ -2126,10 +3231,26 @@ extern "C" Box* import(const std::string *name) {
         return time_module;
     }
 
+    if ((*name) == "thread") {
+        return thread_module;
+    }
+
+    if ((*name) == "os") {
+        return os_module;
+    }
+
+    if ((*name) == "pyston_stats") {
+        return pyston_stats_module;
+    }
+
     if ((*name) == "test") {
         return getTestModule();
     }
 
+    BoxedModule* module = importModuleFile(*name);
+    if (module)
+        return module;
+
     fprintf(stderr, "ImportError: No module named %s\n", name->c_str());
     raiseExc();
 }
@@ -17,6 +17,7 @@
 
 #include <string>
 #include <stdint.h>
+#include <vector>
 
 #include "core/types.h"
 
@@ -36,6 +37,7 @@ extern "C" void my_assert(bool b);
 extern "C" Box* getattr(Box* obj, const char* attr);
 extern "C" void setattr(Box* obj, const char* attr, Box* attr_val);
 extern "C" bool nonzero(Box* obj);
+extern "C" Box* iterNext(Box* iter);
 extern "C" Box* runtimeCall(Box*, int64_t, Box*, Box*, Box*, Box**);
 extern "C" Box* callattr(Box*, std::string*, bool, int64_t, Box*, Box*, Box*, Box**);
 extern "C" BoxedString* str(Box* obj);
@@ -46,6 +48,7 @@ extern "C" BoxedInt* hash(Box* obj);
 //extern "C" Box* max_(Box* o0, Box* o1);
 extern "C" Box* open1(Box* arg);
 extern "C" Box* open2(Box* arg1, Box* arg2);
+extern "C" Box* open3(Box* arg1, Box* arg2, Box* arg3);
 //extern "C" Box* chr(Box* arg);
 extern "C" Box* compare(Box*, Box*, int);
 extern "C" BoxedInt* len(Box* obj);
@@ -62,14 +65,52 @@ extern "C" Box* unaryop(Box* operand, int op_type);
 extern "C" Box* import(const std::string *name);
 extern "C" void checkUnpackingLength(i64 expected, i64 given);
 extern "C" void assertNameDefined(bool b, const char* name);
+extern "C" void raiseUndefinedClosureName(const char* name);
 
 struct CompareRewriteArgs;
 Box* compareInternal(Box* lhs, Box* rhs, int op_type, CompareRewriteArgs *rewrite_args);
+// Registers a direct implementation of lhs_cls <op> rhs_cls for binop() and compareInternal() to use
+// (and rewrite to) without looking anything up.  impl takes (lhs, rhs) and must never return
+// NotImplemented; both classes have to end up frozen.
+void registerBinopImpl(BoxedClass* lhs_cls, BoxedClass* rhs_cls, int op_type, void* impl);
+// Same thing for `in`, which only depends on the container's class; impl takes (container, elt) like
+// __contains__ does, and returns True or False.
+void registerContainsImpl(BoxedClass* cls, void* impl);
 Box* getattr_internal(Box *obj, const char* attr, bool check_cls, bool allow_custom, GetattrRewriteArgs* rewrite_args, GetattrRewriteArgs2* rewrite_args2);
+Box* getclsattr_internal(Box* obj, const char* attr, GetattrRewriteArgs *rewrite_args, GetattrRewriteArgs2 *rewrite_args2);
 
 extern "C" void raiseAttributeErrorStr(const char* typeName, const char* attr) __attribute__((__noreturn__));
 extern "C" void raiseAttributeError(Box* obj, const char* attr) __attribute__((__noreturn__));
 extern "C" void raiseNotIterableError(const char* typeName) __attribute__((__noreturn__));
+// A raise statement (see runtime/exceptions.cpp); with nothing to catch it yet, this reports the exception and exits.
+extern "C" void raise3(Box* type, Box* value, Box* tback) __attribute__((__noreturn__));
+
+// How the arguments of a call get bound to the parameters of a python-level function.
+struct ArgMapping {
+    // Where each named parameter comes from: an index into the call's arguments (which start with
+    // the bound self, for instancemethods), or ~i for the function's i-th default.
+    std::vector<int> sources;
+    // The keyword arguments (by their index among the keywords) that go into **kwargs:
+    std::vector<int> extra_keywords;
+};
+
+// Calls that pass arguments by keyword all go through runtimeCallKeywords.  The keyword names are
+// known when the call gets compiled, so each call site gets one of these (which lives as long as the
+// code does), and remembers how it mapped the arguments onto the parameters of the function that
+// it called last; calling the same function again just reuses that.
+struct KeywordCallSite {
+    const int npositional;
+    // Interned:
+    const std::vector<const std::string*> keyword_names;
+
+    CLFunction *cached_func;
+    bool cached_bound;
+    ArgMapping cached_mapping;
+
+    KeywordCallSite(int npositional, const std::vector<const std::string*> &keyword_names) : npositional(npositional), keyword_names(keyword_names), cached_func(NULL), cached_bound(false) {}
+};
+// args has the positional arguments, followed by the keyword ones in the order of the names.
+extern "C" Box* runtimeCallKeywords(Box* obj, KeywordCallSite* site, Box** args);
 
 Box* typeCall(Box*, BoxedList*);
 Box* typeNew(Box*, Box*);
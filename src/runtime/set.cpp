@@ -0,0 +1,478 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+
+#include "core/common.h"
+#include "core/stats.h"
+#include "core/types.h"
+
+#include "runtime/gc_runtime.h"
+#include "runtime/objmodel.h"
+#include "runtime/types.h"
+#include "runtime/util.h"
+
+#include "codegen/compvars.h"
+
+#include "gc/collector.h"
+
+namespace pyston {
+
+extern "C" void setGCHandler(GCVisitor *v, void* p) {
+    boxGCHandler(v, p);
+
+    BoxedSet *s = (BoxedSet*)p;
+
+    // The arrays don't get scanned on their own, so visit what's in them here:
+    if (s->index)
+        v->visit(s->index);
+    if (s->entries) {
+        v->visit(s->entries);
+        for (int64_t i = 0; i < s->nentries; i++) {
+            if (s->entries->entries[i].key)
+                v->visit(s->entries->entries[i].key);
+        }
+    }
+
+    static StatCounter sc("gc_setelts_visited");
+    sc.log(s->nentries);
+}
+
+extern "C" const ObjectFlavor set_flavor(&setGCHandler, NULL);
+BoxedClass *set_cls, *set_iterator_cls;
+
+// Same probe sequence as the dict's.  Removed entries can't match anything, but they don't end a
+// probe sequence either.
+static int64_t* findSlot(BoxedSet* self, Box* k, size_t hash) {
+    assert(self->index_size > 0);
+    size_t mask = self->index_size - 1;
+    size_t i = hash & mask;
+    size_t perturb = hash;
+    while (true) {
+        int64_t* slot = &self->index->index[i];
+        if (*slot == BoxedSet::EMPTY)
+            return slot;
+
+        BoxedSet::Entry &e = self->entries->entries[*slot];
+        if (e.key && e.hash == hash && PyEq()(e.key, k))
+            return slot;
+
+        perturb >>= 5;
+        i = (i * 5 + 1 + perturb) & mask;
+    }
+}
+
+// Drops the removed entries, and rebuilds the index at the new size.
+static void rebuildIndex(BoxedSet* self, int64_t new_index_size) {
+    if (self->nentries != self->size) {
+        int64_t j = 0;
+        for (int64_t i = 0; i < self->nentries; i++) {
+            if (self->entries->entries[i].key)
+                self->entries->entries[j++] = self->entries->entries[i];
+        }
+        assert(j == self->size);
+        self->nentries = j;
+    }
+
+    BoxedSet::IndexArray* new_index = new (new_index_size) BoxedSet::IndexArray();
+    for (int64_t i = 0; i < new_index_size; i++)
+        new_index->index[i] = BoxedSet::EMPTY;
+
+    size_t mask = new_index_size - 1;
+    for (int64_t j = 0; j < self->nentries; j++) {
+        size_t hash = self->entries->entries[j].hash;
+        size_t i = hash & mask;
+        size_t perturb = hash;
+        while (new_index->index[i] != BoxedSet::EMPTY) {
+            perturb >>= 5;
+            i = (i * 5 + 1 + perturb) & mask;
+        }
+        new_index->index[i] = j;
+    }
+
+    self->index = new_index;
+    self->index_size = new_index_size;
+    gc::writeBarrier(self, new_index);
+}
+
+bool BoxedSet::contains(Box* k) {
+    if (size == 0)
+        return false;
+    return *findSlot(this, k, PyHasher()(k)) != EMPTY;
+}
+
+void BoxedSet::add(Box* k) {
+    size_t hash = PyHasher()(k);
+
+    if (index_size == 0)
+        rebuildIndex(this, 8);
+
+    int64_t* slot = findSlot(this, k, hash);
+    if (*slot != EMPTY)
+        return;
+
+    // Keep the index at most 2/3 full, counting the removed entries; if it's mostly the removed
+    // ones that filled it up, rebuilding it at the same size is enough:
+    if ((nentries + 1) * 3 > index_size * 2) {
+        int64_t new_index_size = index_size;
+        if ((size + 1) * 3 > index_size)
+            new_index_size = index_size * 4;
+        rebuildIndex(this, new_index_size);
+        slot = findSlot(this, k, hash);
+        assert(*slot == EMPTY);
+    }
+
+    if (nentries == entries_capacity) {
+        int64_t new_capacity = std::max(entries_capacity * 2, (int64_t)8);
+        if (entries)
+            entries = (EntryArray*)rt_realloc(entries, new_capacity * sizeof(Entry) + sizeof(EntryArray));
+        else
+            entries = new (new_capacity) EntryArray();
+        entries_capacity = new_capacity;
+        gc::writeBarrier(this, entries);
+    }
+
+    Entry &e = entries->entries[nentries];
+    e.hash = hash;
+    e.key = k;
+    *slot = nentries;
+    nentries++;
+    size++;
+    gc::writeBarrier(this, k);
+}
+
+bool BoxedSet::discard(Box* k) {
+    if (size == 0)
+        return false;
+
+    int64_t* slot = findSlot(this, k, PyHasher()(k));
+    if (*slot == EMPTY)
+        return false;
+
+    // The index keeps pointing at it until the next rebuild:
+    entries->entries[*slot].key = NULL;
+    size--;
+    return true;
+}
+
+static void addAll(BoxedSet* self, Box* iterable) {
+    if (iterable->cls == set_cls) {
+        BoxedSet* s = static_cast<BoxedSet*>(iterable);
+        for (int64_t i = 0; i < s->nentries; i++) {
+            if (s->entries->entries[i].key)
+                self->add(s->entries->entries[i].key);
+        }
+    } else if (iterable->cls == list_cls) {
+        BoxedList* l = static_cast<BoxedList*>(iterable);
+        for (int64_t i = 0; i < l->size; i++)
+            self->add(l->getElt(i));
+    } else if (iterable->cls == tuple_cls) {
+        BoxedTuple* t = static_cast<BoxedTuple*>(iterable);
+        for (int64_t i = 0; i < t->nelts; i++)
+            self->add(t->elts[i]);
+    } else if (iterable->cls == dict_cls) {
+        BoxedDict* d = static_cast<BoxedDict*>(iterable);
+        for (BoxedDict::Entry* it = d->begin(), *end = d->end(); it != end; ++it)
+            self->add(it->key);
+    } else {
+        static std::string* iter_str = const_cast<std::string*>(internString("__iter__"));
+        Box* iter = callattr(iterable, iter_str, true, 0, NULL, NULL, NULL, NULL);
+        while (Box* v = iterNext(iter))
+            self->add(v);
+    }
+}
+
+static BoxedSet* copySet(BoxedSet* self) {
+    BoxedSet* rtn = new BoxedSet();
+    addAll(rtn, self);
+    return rtn;
+}
+
+extern "C" Box* setNew1(Box* cls) {
+    assert(cls == set_cls);
+    return new BoxedSet();
+}
+
+extern "C" Box* setNew2(Box* cls, Box* iterable) {
+    assert(cls == set_cls);
+    BoxedSet* rtn = new BoxedSet();
+    addAll(rtn, iterable);
+    return rtn;
+}
+
+Box* setRepr(BoxedSet* self) {
+    StringBuilder sb;
+    sb.append("set([", 5);
+    bool first = true;
+    for (int64_t i = 0; i < self->nentries; i++) {
+        Box* k = self->entries->entries[i].key;
+        if (!k)
+            continue;
+        if (!first)
+            sb.append(", ", 2);
+        first = false;
+        sb.append(repr(k)->s);
+    }
+    sb.append("])", 2);
+    return sb.finish();
+}
+
+Box* setLen(BoxedSet* self) {
+    return boxInt(self->size);
+}
+
+Box* setNonzero(BoxedSet* self) {
+    return boxBool(self->size != 0);
+}
+
+Box* setContains(BoxedSet* self, Box* k) {
+    return boxBool(self->contains(k));
+}
+
+Box* setAdd(BoxedSet* self, Box* k) {
+    self->add(k);
+    return None;
+}
+
+Box* setDiscard(BoxedSet* self, Box* k) {
+    self->discard(k);
+    return None;
+}
+
+Box* setRemove(BoxedSet* self, Box* k) {
+    if (!self->discard(k)) {
+        BoxedString *s = repr(k);
+        fprintf(stderr, "KeyError: %s\n", s->s.c_str());
+        raiseExc();
+    }
+    return None;
+}
+
+Box* setCopy(BoxedSet* self) {
+    return copySet(self);
+}
+
+Box* setUnion(BoxedSet* self, Box* other) {
+    BoxedSet* rtn = copySet(self);
+    addAll(rtn, other);
+    return rtn;
+}
+
+// Goes through the smaller one, looking each element up in the bigger one:
+static BoxedSet* intersect(BoxedSet* lhs, BoxedSet* rhs) {
+    BoxedSet* small = lhs->size <= rhs->size ? lhs : rhs;
+    BoxedSet* big = lhs->size <= rhs->size ? rhs : lhs;
+
+    BoxedSet* rtn = new BoxedSet();
+    for (int64_t i = 0; i < small->nentries; i++) {
+        Box* k = small->entries->entries[i].key;
+        if (k && big->contains(k))
+            rtn->add(k);
+    }
+    return rtn;
+}
+
+Box* setIntersection(BoxedSet* self, Box* other) {
+    if (other->cls == set_cls)
+        return intersect(self, static_cast<BoxedSet*>(other));
+
+    BoxedSet* other_set = new BoxedSet();
+    addAll(other_set, other);
+    return intersect(self, other_set);
+}
+
+static BoxedSet* subtract(BoxedSet* lhs, BoxedSet* rhs) {
+    BoxedSet* rtn = new BoxedSet();
+    for (int64_t i = 0; i < lhs->nentries; i++) {
+        Box* k = lhs->entries->entries[i].key;
+        if (k && !rhs->contains(k))
+            rtn->add(k);
+    }
+    return rtn;
+}
+
+Box* setDifference(BoxedSet* self, Box* other) {
+    if (other->cls == set_cls)
+        return subtract(self, static_cast<BoxedSet*>(other));
+
+    BoxedSet* other_set = new BoxedSet();
+    addAll(other_set, other);
+    return subtract(self, other_set);
+}
+
+// The operators only take sets, unlike the methods:
+Box* setOr(BoxedSet* self, Box* other) {
+    if (other->cls != set_cls)
+        return NotImplemented;
+    return setUnion(self, other);
+}
+
+Box* setAnd(BoxedSet* self, Box* other) {
+    if (other->cls != set_cls)
+        return NotImplemented;
+    return intersect(self, static_cast<BoxedSet*>(other));
+}
+
+Box* setSub(BoxedSet* self, Box* other) {
+    if (other->cls != set_cls)
+        return NotImplemented;
+    return subtract(self, static_cast<BoxedSet*>(other));
+}
+
+static bool isSubset(BoxedSet* lhs, BoxedSet* rhs) {
+    if (lhs->size > rhs->size)
+        return false;
+    for (int64_t i = 0; i < lhs->nentries; i++) {
+        Box* k = lhs->entries->entries[i].key;
+        if (k && !rhs->contains(k))
+            return false;
+    }
+    return true;
+}
+
+Box* setEq(BoxedSet* self, Box* other) {
+    if (other->cls != set_cls)
+        return False;
+    BoxedSet* sother = static_cast<BoxedSet*>(other);
+    return boxBool(self->size == sother->size && isSubset(self, sother));
+}
+
+Box* setNe(BoxedSet* self, Box* other) {
+    return boxBool(setEq(self, other) == False);
+}
+
+Box* setIssubset(BoxedSet* self, Box* other) {
+    if (other->cls == set_cls)
+        return boxBool(isSubset(self, static_cast<BoxedSet*>(other)));
+
+    BoxedSet* other_set = new BoxedSet();
+    addAll(other_set, other);
+    return boxBool(isSubset(self, other_set));
+}
+
+void set_dtor(BoxedSet* self) {
+    if (self->entries)
+        rt_free(self->entries);
+    if (self->index)
+        rt_free(self->index);
+}
+
+// Walks the entry array in place, skipping the removed entries.
+class BoxedSetIterator : public Box {
+    public:
+        BoxedSet* const s;
+        int64_t pos;
+
+        BoxedSetIterator(BoxedSet* s);
+};
+
+extern "C" void setIteratorGCHandler(GCVisitor *v, void* p) {
+    boxGCHandler(v, p);
+    BoxedSetIterator *it = (BoxedSetIterator*)p;
+    v->visit(it->s);
+}
+
+extern "C" const ObjectFlavor set_iterator_flavor(&setIteratorGCHandler, NULL);
+
+BoxedSetIterator::BoxedSetIterator(BoxedSet* s) : Box(&set_iterator_flavor, set_iterator_cls), s(s), pos(0) {
+}
+
+void setiterDtor(BoxedSetIterator *self) {
+}
+
+Box* setIter(BoxedSet* self) {
+    return new BoxedSetIterator(self);
+}
+
+i1 setiterHasnextUnboxed(Box* s) {
+    assert(s->cls == set_iterator_cls);
+    BoxedSetIterator* self = static_cast<BoxedSetIterator*>(s);
+
+    while (self->pos < self->s->nentries && self->s->entries->entries[self->pos].key == NULL)
+        self->pos++;
+    return self->pos < self->s->nentries;
+}
+
+Box* setiterHasnext(Box* s) {
+    return boxBool(setiterHasnextUnboxed(s));
+}
+
+Box* setiterNext(Box* s) {
+    assert(s->cls == set_iterator_cls);
+    BoxedSetIterator* self = static_cast<BoxedSetIterator*>(s);
+
+    RELEASE_ASSERT(setiterHasnextUnboxed(s), "");
+    return self->s->entries->entries[self->pos++].key;
+}
+
+Box* setiterNextOrEnd(Box* s) {
+    if (!setiterHasnextUnboxed(s))
+        return NULL;
+    return setiterNext(s);
+}
+
+void setupSet() {
+    set_cls = new BoxedClass(&set_flavor, false, (BoxedClass::Dtor)set_dtor);
+    gc::registerStaticRootObj(set_cls);
+    SET = typeFromClass(set_cls);
+
+    set_iterator_cls = new BoxedClass(&set_iterator_flavor, false, (BoxedClass::Dtor)setiterDtor);
+    gc::registerStaticRootObj(set_iterator_cls);
+
+    set_cls->giveAttr("__name__", boxStrConstant("set"));
+    set_cls->giveAttr("__repr__", new BoxedFunction(boxRTFunction((void*)setRepr, STR, 1, false)));
+    set_cls->setattr("__str__", set_cls->peekattr("__repr__"), NULL, NULL);
+    set_cls->giveAttr("__len__", new BoxedFunction(boxRTFunction((void*)setLen, BOXED_INT, 1, false)));
+    set_cls->giveAttr("__nonzero__", new BoxedFunction(boxRTFunction((void*)setNonzero, BOXED_BOOL, 1, false)));
+    set_cls->giveAttr("__contains__", new BoxedFunction(boxRTFunction((void*)setContains, BOXED_BOOL, 2, false)));
+    set_cls->giveAttr("__iter__", new BoxedFunction(boxRTFunction((void*)setIter, typeFromClass(set_iterator_cls), 1, false)));
+    set_cls->giveAttr("__eq__", new BoxedFunction(boxRTFunction((void*)setEq, BOXED_BOOL, 2, false)));
+    set_cls->giveAttr("__ne__", new BoxedFunction(boxRTFunction((void*)setNe, BOXED_BOOL, 2, false)));
+
+    set_cls->giveAttr("add", new BoxedFunction(boxRTFunction((void*)setAdd, NONE, 2, false)));
+    set_cls->giveAttr("discard", new BoxedFunction(boxRTFunction((void*)setDiscard, NONE, 2, false)));
+    set_cls->giveAttr("remove", new BoxedFunction(boxRTFunction((void*)setRemove, NONE, 2, false)));
+    set_cls->giveAttr("copy", new BoxedFunction(boxRTFunction((void*)setCopy, SET, 1, false)));
+    set_cls->giveAttr("union", new BoxedFunction(boxRTFunction((void*)setUnion, SET, 2, false)));
+    set_cls->giveAttr("intersection", new BoxedFunction(boxRTFunction((void*)setIntersection, SET, 2, false)));
+    set_cls->giveAttr("difference", new BoxedFunction(boxRTFunction((void*)setDifference, SET, 2, false)));
+    set_cls->giveAttr("issubset", new BoxedFunction(boxRTFunction((void*)setIssubset, BOXED_BOOL, 2, false)));
+
+    set_cls->giveAttr("__or__", new BoxedFunction(boxRTFunction((void*)setOr, NULL, 2, false)));
+    set_cls->giveAttr("__and__", new BoxedFunction(boxRTFunction((void*)setAnd, NULL, 2, false)));
+    set_cls->giveAttr("__sub__", new BoxedFunction(boxRTFunction((void*)setSub, NULL, 2, false)));
+
+    CLFunction *__new__ = boxRTFunction((void*)setNew1, NULL, 1, false);
+    addRTFunction(__new__, (void*)setNew2, NULL, 2, false);
+    set_cls->giveAttr("__new__", new BoxedFunction(__new__));
+
+    set_cls->freeze();
+
+    registerContainsImpl(set_cls, (void*)setContains);
+
+    set_iterator_cls->giveAttr("__name__", boxStrConstant("setiterator"));
+
+    CLFunction *hasnext = boxRTFunction((void*)setiterHasnextUnboxed, BOOL, 1, false);
+    addRTFunction(hasnext, (void*)setiterHasnext, BOXED_BOOL, 1, false);
+    set_iterator_cls->giveAttr("__hasnext__", new BoxedFunction(hasnext));
+    set_iterator_cls->giveAttr("next", new BoxedFunction(boxRTFunction((void*)setiterNext, UNKNOWN, 1, false)));
+    set_iterator_cls->iter_next = setiterNextOrEnd;
+
+    set_iterator_cls->freeze();
+}
+
+void teardownSet() {
+}
+
+}
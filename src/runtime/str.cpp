@@ -13,10 +13,15 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <cctype>
 #include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <sstream>
 #include <unordered_map>
 
+#include "core/ast.h"
 #include "core/common.h"
 #include "core/types.h"
 
@@ -25,145 +30,266 @@
 
 #include "runtime/gc_runtime.h"
 #include "runtime/objmodel.h"
+#include "runtime/str.h"
 #include "runtime/types.h"
 #include "runtime/util.h"
 
+#include "gc/collector.h"
+
 namespace pyston {
 
 extern "C" BoxedString* strAdd(BoxedString* lhs, BoxedString* rhs) {
     assert(lhs->cls == str_cls);
     assert(rhs->cls == str_cls);
-    return new BoxedString(lhs->s + rhs->s);
+    StringBuilder sb(lhs->s.size() + rhs->s.size());
+    sb.append(lhs->s);
+    sb.append(rhs->s);
+    return sb.finish();
+}
+
+// Parses the conversion after a '%', leaving fmt just past it.  Returns the conversion character (which
+// can be one we don't support), or 0 if the spec is malformed or incomplete.
+static char parseFormatSpec(const char* &fmt, const char* fmt_end, FormatSpec &spec) {
+    spec.nspace = spec.ndot = spec.nzero = 0;
+    int mode = 0;
+    while (fmt < fmt_end) {
+        char c = *fmt;
+        fmt++;
+
+        if (c == ' ') {
+            if (mode != 0)
+                return 0;
+            mode = 1;
+        } else if (c == '.') {
+            if (mode != 0)
+                return 0;
+            mode = 2;
+        } else if (mode == 0 && c == '0') {
+            mode = 3;
+        } else if ('0' <= c && c <= '9') {
+            if (mode == 1) {
+                spec.nspace = spec.nspace * 10 + c - '0';
+            } else if (mode == 2) {
+                spec.ndot = spec.ndot * 10 + c - '0';
+            } else if (mode == 3) {
+                spec.nzero = spec.nzero * 10 + c - '0';
+            } else {
+                return 0;
+            }
+        } else {
+            spec.conv = c;
+            return c;
+        }
+    }
+    return 0;
+}
+
+static void formatInt(StringBuilder &os, const FormatSpec &spec, int64_t n) {
+    char buf[20];
+    int len;
+    if (spec.nspace)
+        len = snprintf(buf, 20, "% *ld", spec.nspace, n);
+    else if (spec.ndot)
+        len = snprintf(buf, 20, "%.*ld", spec.ndot, n);
+    else if (spec.nzero)
+        len = snprintf(buf, 20, "%0*ld", spec.nzero, n);
+    else
+        len = snprintf(buf, 20, "%ld", n);
+    os.append(buf, std::min(len, 19));
+}
+
+static void formatFloat(StringBuilder &os, const FormatSpec &spec, double d) {
+    char buf[20];
+    int len;
+    if (spec.nspace)
+        len = snprintf(buf, 20, "% *f", spec.nspace, d);
+    else if (spec.ndot)
+        len = snprintf(buf, 20, "%.*f", spec.ndot, d);
+    else if (spec.nzero)
+        len = snprintf(buf, 20, "%0*f", spec.nzero, d);
+    else
+        len = snprintf(buf, 20, "%f", d);
+    os.append(buf, std::min(len, 19));
+}
+
+static void formatBoxed(StringBuilder &os, const FormatSpec &spec, Box* b) {
+    if (spec.conv == 's') {
+        BoxedString *s = str(b);
+        os.append(s->s);
+    } else if (spec.conv == 'd') {
+        RELEASE_ASSERT(b->cls == int_cls, "unsupported");
+        formatInt(os, spec, static_cast<BoxedInt*>(b)->n);
+    } else {
+        assert(spec.conv == 'f');
+        double d;
+        if (b->cls == float_cls) {
+            d = static_cast<BoxedFloat*>(b)->d;
+        } else if (b->cls == int_cls) {
+            d = static_cast<BoxedInt*>(b)->n;
+        } else {
+            RELEASE_ASSERT(0, "unsupported");
+        }
+        formatFloat(os, spec, d);
+    }
 }
 
 extern "C" Box* strMod(BoxedString* lhs, Box* rhs) {
-    const std::vector<Box*> *elts;
-    std::vector<Box*> _elts;
+    Box** elts;
+    int num_elts;
     if (rhs->cls == tuple_cls) {
-        elts = &static_cast<BoxedTuple*>(rhs)->elts;
+        elts = static_cast<BoxedTuple*>(rhs)->elts;
+        num_elts = static_cast<BoxedTuple*>(rhs)->nelts;
     } else {
-        elts = &_elts;
-        _elts.push_back(rhs);
+        elts = &rhs;
+        num_elts = 1;
     }
 
     const char* fmt = lhs->s.c_str();
     const char* fmt_end = fmt + lhs->s.size();
 
     int elt_num = 0;
-    int num_elts = elts->size();
 
-    std::ostringstream os("");
+    StringBuilder os(lhs->s.size());
     while (fmt < fmt_end) {
         if (*fmt != '%') {
-            os << (*fmt);
-            fmt++;
+            // Copy everything up to the next format specifier at once:
+            const char* next = fmt;
+            while (next < fmt_end && *next != '%')
+                next++;
+            os.append(fmt, next - fmt);
+            fmt = next;
         } else {
             fmt++;
 
-            int nspace = 0;
-            int ndot = 0;
-            int nzero = 0;
-            int mode = 0;
-            while (true) {
-                RELEASE_ASSERT(fmt < fmt_end, "");
-                char c = *fmt;
-                fmt++;
-
-                if (c == ' ') {
-                    assert(mode == 0);
-                    mode = 1;
-                } else if (c == '.') {
-                    assert(mode == 0);
-                    mode = 2;
-                } else if (mode == 0 && c == '0') {
-                    mode = 3;
-                } else if ('0' <= c && c <= '9') {
-                    assert(mode == 1 || mode == 2 || mode == 3);
-                    if (mode == 1) {
-                        nspace = nspace * 10 + c - '0';
-                    } else if (mode == 2) {
-                        ndot = ndot * 10 + c - '0';
-                    } else if (mode == 3) {
-                        nzero = nzero * 10 + c - '0';
-                    } else {
-                        assert(0);
-                    }
-                } else if (c == '%') {
-                    for (int i = 1; i < nspace; i++) {
-                        os << ' ';
-                    }
-                    os << '%';
-                    break;
-                } else if (c == 's') {
-                    RELEASE_ASSERT(ndot == 0, "");
-                    RELEASE_ASSERT(nzero == 0, "");
-                    RELEASE_ASSERT(nspace == 0, "");
+            FormatSpec spec;
+            char c = parseFormatSpec(fmt, fmt_end, spec);
+            RELEASE_ASSERT(c, "incomplete format");
 
-                    RELEASE_ASSERT(elt_num < num_elts, "insufficient number of arguments for format string");
-                    Box* b = (*elts)[elt_num];
-                    elt_num++;
-
-                    BoxedString *s = str(b);
-                    os << s->s;
-                    break;
-                } else if (c == 'd') {
-                    RELEASE_ASSERT(elt_num < num_elts, "insufficient number of arguments for format string");
-                    Box* b = (*elts)[elt_num];
-                    elt_num++;
-
-                    RELEASE_ASSERT(b->cls == int_cls, "unsupported");
-
-                    std::ostringstream fmt("");
-                    fmt << '%';
-                    if (nspace)
-                        fmt << ' ' << nspace;
-                    else if (ndot)
-                        fmt << '.' << ndot;
-                    else if (nzero)
-                        fmt << '0' << nzero;
-                    fmt << "ld";
-
-                    char buf[20];
-                    snprintf(buf, 20, fmt.str().c_str(), static_cast<BoxedInt*>(b)->n);
-                    os << std::string(buf);
-                    break;
-                } else if (c == 'f') {
-                    RELEASE_ASSERT(elt_num < num_elts, "insufficient number of arguments for format string");
-                    Box* b = (*elts)[elt_num];
-                    elt_num++;
-
-                    double d;
-                    if (b->cls == float_cls) {
-                        d = static_cast<BoxedFloat*>(b)->d;
-                    } else if (b->cls == int_cls) {
-                        d = static_cast<BoxedInt*>(b)->n;
-                    } else {
-                        RELEASE_ASSERT(0, "unsupported");
-                    }
-
-                    std::ostringstream fmt("");
-                    fmt << '%';
-                    if (nspace)
-                        fmt << ' ' << nspace;
-                    else if (ndot)
-                        fmt << '.' << ndot;
-                    else if (nzero)
-                        fmt << '0' << nzero;
-                    fmt << "f";
-
-                    char buf[20];
-                    snprintf(buf, 20, fmt.str().c_str(), d);
-                    os << std::string(buf);
-                    break;
-                } else {
-                    RELEASE_ASSERT(0, "unsupported format character '%c'", c);
+            if (c == '%') {
+                for (int i = 1; i < spec.nspace; i++) {
+                    os.append(' ');
                 }
+                os.append('%');
+                continue;
             }
+
+            RELEASE_ASSERT(c == 's' || c == 'd' || c == 'f', "unsupported format character '%c'", c);
+            if (c == 's') {
+                RELEASE_ASSERT(spec.ndot == 0, "");
+                RELEASE_ASSERT(spec.nzero == 0, "");
+                RELEASE_ASSERT(spec.nspace == 0, "");
+            }
+
+            RELEASE_ASSERT(elt_num < num_elts, "insufficient number of arguments for format string");
+            formatBoxed(os, spec, elts[elt_num]);
+            elt_num++;
         }
     }
     assert(fmt == fmt_end && "incomplete format");
 
-    return boxString(os.str());
+    return os.finish();
+}
+
+CompiledFormat* compileFormat(const std::string &fmt_str, const std::vector<FormatArgKind> &kinds) {
+    // The same format tends to get compiled again at each tier, so share them:
+    static std::unordered_map<std::string, CompiledFormat*> cache;
+
+    std::string key = fmt_str;
+    key.push_back('\0');
+    for (int i = 0; i < kinds.size(); i++)
+        key.push_back('0' + kinds[i]);
+
+    CompiledFormat* &cached = cache[key];
+    if (cached)
+        return cached;
+
+    CompiledFormat* rtn = new CompiledFormat();
+    rtn->literals.push_back(std::string());
+
+    const char* fmt = fmt_str.c_str();
+    const char* fmt_end = fmt + fmt_str.size();
+    while (fmt < fmt_end) {
+        if (*fmt != '%') {
+            rtn->literals.back().push_back(*fmt);
+            fmt++;
+            continue;
+        }
+        fmt++;
+
+        FormatSpec spec;
+        char c = parseFormatSpec(fmt, fmt_end, spec);
+        if (c == '%') {
+            for (int i = 1; i < spec.nspace; i++)
+                rtn->literals.back().push_back(' ');
+            rtn->literals.back().push_back('%');
+            continue;
+        }
+
+        // Leave anything strMod would complain about to strMod, so that it still only happens when the
+        // code actually runs:
+        int arg_num = rtn->specs.size();
+        bool ok = (c == 's' || c == 'd' || c == 'f') && arg_num < kinds.size();
+        if (ok && c == 's')
+            ok = (spec.nspace == 0 && spec.ndot == 0 && spec.nzero == 0);
+        if (ok && c == 'd')
+            ok = (kinds[arg_num] != FMT_FLOAT);
+        if (!ok) {
+            delete rtn;
+            return NULL;
+        }
+
+        FormatArgKind kind = kinds[arg_num];
+        // str() of a float isn't the same as any of the printf formats, so let it get boxed:
+        if (c == 's' && kind == FMT_FLOAT)
+            kind = FMT_BOXED;
+
+        rtn->specs.push_back(spec);
+        rtn->kinds.push_back(kind);
+        rtn->literals.push_back(std::string());
+    }
+
+    if (rtn->specs.size() != kinds.size()) {
+        delete rtn;
+        return NULL;
+    }
+
+    rtn->literal_size = 0;
+    for (int i = 0; i < rtn->literals.size(); i++)
+        rtn->literal_size += rtn->literals[i].size();
+
+    cached = rtn;
+    return rtn;
+}
+
+extern "C" Box* strModCompiled(CompiledFormat* cf, int64_t* args) {
+    int nspecs = cf->specs.size();
+
+    // Guess a few characters per argument:
+    StringBuilder os(cf->literal_size + 8 * nspecs);
+    for (int i = 0; i < nspecs; i++) {
+        os.append(cf->literals[i]);
+
+        const FormatSpec &spec = cf->specs[i];
+        switch (cf->kinds[i]) {
+            case FMT_BOXED:
+                formatBoxed(os, spec, reinterpret_cast<Box*>(args[i]));
+                break;
+            case FMT_INT:
+                if (spec.conv == 'f')
+                    formatFloat(os, spec, args[i]);
+                else
+                    formatInt(os, spec, args[i]);
+                break;
+            case FMT_FLOAT: {
+                double d;
+                memcpy(&d, &args[i], sizeof(d));
+                formatFloat(os, spec, d);
+                break;
+            }
+        }
+    }
+    os.append(cf->literals[nspecs]);
+    return os.finish();
 }
 
 extern "C" BoxedString* strMul(BoxedString* lhs, BoxedInt* rhs) {
@@ -174,21 +300,11 @@ extern "C" BoxedString* strMul(BoxedString* lhs, BoxedInt* rhs) {
 
     int sz = lhs->s.size();
     int n = rhs->n;
-    char* buf = new char[sz * n + 1];
+    StringBuilder sb(sz * n);
     for (int i = 0; i < n; i++) {
-        memcpy(buf + (sz * i), lhs->s.c_str(), sz);
+        sb.append(lhs->s);
     }
-    buf[sz * n] = '\0';
-
-    return new BoxedString(buf);
-}
-
-extern "C" Box* strEq(BoxedString* lhs, Box* rhs) {
-    if (rhs->cls != str_cls)
-        return boxBool(false);
-
-    BoxedString* srhs = static_cast<BoxedString*>(rhs);
-    return boxBool(lhs->s == srhs->s);
+    return sb.finish();
 }
 
 extern "C" Box* strLen(BoxedString* self) {
@@ -251,8 +367,35 @@ extern "C" Box* strRepr(BoxedString* self) {
 }
 
 extern "C" Box* strHash(BoxedString* self) {
-    std::hash<std::string> H;
-    return boxInt(H(self->s));
+    return boxInt(self->getHash());
+}
+
+BoxedString* boxInternedString(const std::string &s) {
+    static std::unordered_map<const std::string*, BoxedString*> interned_boxes;
+
+    BoxedString* &r = interned_boxes[internString(s)];
+    if (!r) {
+        r = new BoxedString(s);
+        r->interned = true;
+        gc::registerStaticRootObj(r);
+    }
+    return r;
+}
+
+static BoxedString* characters[256];
+BoxedString* boxCharacter(char c) {
+    BoxedString* &r = characters[(unsigned char)c];
+    if (!r)
+        r = boxInternedString(std::string(1, c));
+    return r;
+}
+
+bool isIdentifierLike(const std::string &s) {
+    for (char c : s) {
+        if (!isalnum(c) && c != '_')
+            return false;
+    }
+    return true;
 }
 
 extern "C" Box* strNonzero(BoxedString* self) {
@@ -282,41 +425,245 @@ Box* _strSlice(BoxedString *self, i64 start, i64 stop, i64 step) {
         assert(-1 <= stop);
     }
 
-    std::vector<char> chars;
+    if (step == 1) {
+        if (stop <= start)
+            return boxInternedString("");
+        if (stop - start == 1)
+            return boxCharacter(s[start]);
+        return new BoxedString(s.substr(start, stop - start));
+    }
+
+    StringBuilder sb;
     int cur = start;
     while ((step > 0 && cur < stop) || (step < 0 && cur > stop)) {
-        chars.push_back(s[cur]);
+        sb.append(s[cur]);
         cur += step;
     }
-    // TODO too much copying
-    return boxString(std::string(chars.begin(), chars.end()));
+    if (sb.size() == 1)
+        return boxCharacter(s[start]);
+    return sb.finish();
+}
+
+// Flips the case of every byte in [lo, hi], which has to be one of the two ascii letter ranges;
+// str methods only know about ascii, like CPython's do in the C locale.
+static void flipCaseRange(char* s, size_t n, char lo, char hi) {
+    size_t i = 0;
+#ifdef __SSE2__
+    // Bytes >= 0x80 compare as negative, so they're never in the range:
+    const __m128i below = _mm_set1_epi8(lo - 1);
+    const __m128i above = _mm_set1_epi8(hi + 1);
+    const __m128i flip = _mm_set1_epi8(0x20);
+    for (; i + 16 <= n; i += 16) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(c, below), _mm_cmplt_epi8(c, above));
+        c = _mm_xor_si128(c, _mm_and_si128(in_range, flip));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(s + i), c);
+    }
+#endif
+    for (; i < n; i++) {
+        if (lo <= s[i] && s[i] <= hi)
+            s[i] ^= 0x20;
+    }
 }
 
 Box* strLower(BoxedString* self) {
     assert(self->cls == str_cls);
     std::string lowered(self->s);
-    std::transform(lowered.begin(), lowered.end(), lowered.begin(), tolower);
+    flipCaseRange(&lowered[0], lowered.size(), 'A', 'Z');
     return boxString(std::move(lowered));
 }
 
+Box* strUpper(BoxedString* self) {
+    assert(self->cls == str_cls);
+    std::string uppered(self->s);
+    flipCaseRange(&uppered[0], uppered.size(), 'a', 'z');
+    return boxString(std::move(uppered));
+}
+
+// The searching below goes through memchr / memmem, which glibc already picks a vectorized version of
+// for the cpu it's running on.
+static BoxedString* checkStrArg(Box* arg, const char* method) {
+    if (arg->cls != str_cls) {
+        fprintf(stderr, "TypeError: %s() argument must be str, not %s\n", method, getTypeName(arg)->c_str());
+        raiseExc();
+    }
+    return static_cast<BoxedString*>(arg);
+}
+
+static int64_t findSubstr(const std::string &s, const std::string &sub, size_t start) {
+    if (start > s.size())
+        return -1;
+    if (sub.size() == 0)
+        return start;
+
+    const char* found;
+    if (sub.size() == 1)
+        found = (const char*)memchr(s.data() + start, sub[0], s.size() - start);
+    else
+        found = (const char*)memmem(s.data() + start, s.size() - start, sub.data(), sub.size());
+    if (!found)
+        return -1;
+    return found - s.data();
+}
+
+Box* strFind(BoxedString* self, Box* sub) {
+    assert(self->cls == str_cls);
+    BoxedString* ssub = checkStrArg(sub, "find");
+    return boxInt(findSubstr(self->s, ssub->s, 0));
+}
+
+Box* strContains(BoxedString* self, Box* elt) {
+    assert(self->cls == str_cls);
+    if (elt->cls != str_cls) {
+        fprintf(stderr, "TypeError: 'in <string>' requires string as left operand, not %s\n", getTypeName(elt)->c_str());
+        raiseExc();
+    }
+    return boxBool(findSubstr(self->s, static_cast<BoxedString*>(elt)->s, 0) != -1);
+}
+
+static bool isStrSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\x0b' || c == '\x0c';
+}
+
+Box* strSplit1(BoxedString* self) {
+    assert(self->cls == str_cls);
+    const std::string &s = self->s;
+
+    BoxedList* rtn = new BoxedList();
+    size_t i = 0;
+    while (true) {
+        while (i < s.size() && isStrSpace(s[i]))
+            i++;
+        if (i == s.size())
+            break;
+        size_t start = i;
+        while (i < s.size() && !isStrSpace(s[i]))
+            i++;
+        listAppendInternal(rtn, boxString(s.substr(start, i - start)));
+    }
+    return rtn;
+}
+
+Box* strSplit2(BoxedString* self, Box* sep) {
+    assert(self->cls == str_cls);
+    if (sep == None)
+        return strSplit1(self);
+
+    const std::string &s = self->s;
+    const std::string &ssep = checkStrArg(sep, "split")->s;
+    if (ssep.size() == 0) {
+        fprintf(stderr, "ValueError: empty separator\n");
+        raiseExc();
+    }
+
+    BoxedList* rtn = new BoxedList();
+    size_t start = 0;
+    while (true) {
+        int64_t found = findSubstr(s, ssep, start);
+        if (found == -1)
+            break;
+        listAppendInternal(rtn, boxString(s.substr(start, found - start)));
+        start = found + ssep.size();
+    }
+    listAppendInternal(rtn, boxString(s.substr(start)));
+    return rtn;
+}
+
+Box* strReplace(BoxedString* self, Box* old, Box* new_) {
+    assert(self->cls == str_cls);
+    const std::string &s = self->s;
+    const std::string &sold = checkStrArg(old, "replace")->s;
+    const std::string &snew = checkStrArg(new_, "replace")->s;
+
+    if (sold.size() == 0) {
+        // Matches before every character and at the end:
+        StringBuilder sb(s.size() + (s.size() + 1) * snew.size());
+        sb.append(snew);
+        for (int i = 0; i < s.size(); i++) {
+            sb.append(s[i]);
+            sb.append(snew);
+        }
+        return sb.finish();
+    }
+
+    int64_t found = findSubstr(s, sold, 0);
+    if (found == -1)
+        return self;
+
+    StringBuilder sb(s.size());
+    size_t start = 0;
+    while (found != -1) {
+        sb.append(s.data() + start, found - start);
+        sb.append(snew);
+        start = found + sold.size();
+        found = findSubstr(s, sold, start);
+    }
+    sb.append(s.data() + start, s.size() - start);
+    return sb.finish();
+}
+
+static Box* _strStrip(BoxedString* self, const char* chars, size_t nchars) {
+    const std::string &s = self->s;
+
+    size_t start = 0, end = s.size();
+    if (chars) {
+        while (start < end && memchr(chars, s[start], nchars))
+            start++;
+        while (end > start && memchr(chars, s[end - 1], nchars))
+            end--;
+    } else {
+        while (start < end && isStrSpace(s[start]))
+            start++;
+        while (end > start && isStrSpace(s[end - 1]))
+            end--;
+    }
+
+    if (start == 0 && end == s.size())
+        return self;
+    return boxString(s.substr(start, end - start));
+}
+
+Box* strStrip1(BoxedString* self) {
+    assert(self->cls == str_cls);
+    return _strStrip(self, NULL, 0);
+}
+
+Box* strStrip2(BoxedString* self, Box* chars) {
+    assert(self->cls == str_cls);
+    if (chars == None)
+        return _strStrip(self, NULL, 0);
+    const std::string &schars = checkStrArg(chars, "strip")->s;
+    return _strStrip(self, schars.data(), schars.size());
+}
+
 Box* strJoin(BoxedString* self, Box* rhs) {
     assert(self->cls == str_cls);
 
     if (rhs->cls == list_cls) {
         BoxedList *list = static_cast<BoxedList*>(rhs);
-        std::ostringstream os;
+        StringBuilder sb;
         for (int i = 0; i < list->size; i++) {
-            if (i > 0) os << self->s;
-            BoxedString *elt_str = str(list->elts->elts[i]);
-            os << elt_str->s;
+            Box* elt = list->getElt(i);
+            if (elt->cls != str_cls) {
+                fprintf(stderr, "TypeError: sequence item %d: expected string, %s found\n", i, getTypeName(elt)->c_str());
+                raiseExc();
+            }
+            if (i > 0) sb.append(self->s);
+            sb.append(static_cast<BoxedString*>(elt)->s);
         }
-        return boxString(os.str());
+        return sb.finish();
     } else {
         fprintf(stderr, "TypeError\n");
         raiseExc();
     }
 }
 
+extern "C" Box* strSliceUnboxed(BoxedString* self, i64 start, i64 stop, i64 step) {
+    assert(self->cls == str_cls);
+    parseSliceBounds(self->s.size(), start, stop, step, &start, &stop, &step);
+    return _strSlice(self, start, stop, step);
+}
+
 extern "C" Box* strGetitem(BoxedString* self, Box* slice) {
     if (slice->cls == int_cls) {
         BoxedInt* islice = static_cast<BoxedInt*>(slice);
@@ -330,8 +677,7 @@ extern "C" Box* strGetitem(BoxedString* self, Box* slice) {
             raiseExc();
         }
 
-        char c = self->s[n];
-        return new BoxedString(std::string(1, c));
+        return boxCharacter(self->s[n]);
     } else if (slice->cls == slice_cls) {
         BoxedSlice *sslice = static_cast<BoxedSlice*>(slice);
 
@@ -354,12 +700,24 @@ void setupStr() {
     str_cls->giveAttr("__nonzero__", new BoxedFunction(boxRTFunction((void*)strNonzero, NULL, 1, false)));
 
     str_cls->giveAttr("lower", new BoxedFunction(boxRTFunction((void*)strLower, STR, 1, false)));
+    str_cls->giveAttr("upper", new BoxedFunction(boxRTFunction((void*)strUpper, STR, 1, false)));
+    str_cls->giveAttr("find", new BoxedFunction(boxRTFunction((void*)strFind, BOXED_INT, 2, false)));
+    str_cls->giveAttr("replace", new BoxedFunction(boxRTFunction((void*)strReplace, STR, 3, false)));
+
+    CLFunction *split = boxRTFunction((void*)strSplit1, LIST, 1, false);
+    addRTFunction(split, (void*)strSplit2, LIST, 2, false);
+    str_cls->giveAttr("split", new BoxedFunction(split));
+
+    CLFunction *strip = boxRTFunction((void*)strStrip1, STR, 1, false);
+    addRTFunction(strip, (void*)strStrip2, STR, 2, false);
+    str_cls->giveAttr("strip", new BoxedFunction(strip));
 
     str_cls->giveAttr("__add__", new BoxedFunction(boxRTFunction((void*)strAdd, NULL, 2, false)));
     str_cls->giveAttr("__mod__", new BoxedFunction(boxRTFunction((void*)strMod, NULL, 2, false)));
     str_cls->giveAttr("__mul__", new BoxedFunction(boxRTFunction((void*)strMul, NULL, 2, false)));
     str_cls->giveAttr("__eq__", new BoxedFunction(boxRTFunction((void*)strEq, NULL, 2, false)));
     str_cls->giveAttr("__getitem__", new BoxedFunction(boxRTFunction((void*)strGetitem, NULL, 2, false)));
+    str_cls->giveAttr("__contains__", new BoxedFunction(boxRTFunction((void*)strContains, BOXED_BOOL, 2, false)));
 
     str_cls->giveAttr("join", new BoxedFunction(boxRTFunction((void*)strJoin, NULL, 2, false)));
 
@@ -368,6 +726,11 @@ void setupStr() {
     str_cls->giveAttr("__new__", new BoxedFunction(__new__));
 
     str_cls->freeze();
+
+    registerBinopImpl(str_cls, str_cls, AST_TYPE::Add, (void*)strAdd);
+    registerBinopImpl(str_cls, str_cls, AST_TYPE::Eq, (void*)strEq);
+    registerBinopImpl(str_cls, int_cls, AST_TYPE::Mult, (void*)strMul);
+    registerContainsImpl(str_cls, (void*)strContains);
 }
 
 void teardownStr() {
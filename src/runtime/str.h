@@ -0,0 +1,61 @@
+// Copyright (c) 2014 Dropbox, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//    http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_RUNTIME_STR_H
+#define PYSTON_RUNTIME_STR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pyston {
+
+class Box;
+
+struct FormatSpec {
+    // 's', 'd' or 'f'
+    char conv;
+    int nspace, ndot, nzero;
+};
+
+enum FormatArgKind {
+    FMT_BOXED,
+    FMT_INT,
+    FMT_FLOAT,
+};
+
+// A format string that got parsed at compile time, for "..." % args where the format is a constant.
+struct CompiledFormat {
+    // literals[i] comes right before specs[i], and there's one more literal at the end.
+    std::vector<std::string> literals;
+    std::vector<FormatSpec> specs;
+    // How each argument gets passed to strModCompiled:
+    std::vector<FormatArgKind> kinds;
+    size_t literal_size;
+};
+
+// kinds says which arguments the compiler has as unboxed ints or floats.  Returns NULL if it should just
+// call strMod (unsupported formats, or the wrong number of arguments), and otherwise the kinds to actually
+// pass, which can say FMT_BOXED for arguments that will need a box anyway.  The result lives forever.
+CompiledFormat* compileFormat(const std::string &fmt, const std::vector<FormatArgKind> &kinds);
+
+// (in the inline section)
+extern "C" Box* strEq(Box* lhs, Box* rhs);
+
+// args[i] holds a Box*, an int64_t, or the bits of a double, depending on cf->kinds[i].
+extern "C" Box* strModCompiled(CompiledFormat* cf, int64_t* args);
+
+}
+
+#endif
@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstring>
+#include <new>
 #include <sstream>
 
 #include "core/ast.h"
@@ -26,27 +28,88 @@
 
 namespace pyston {
 
+BoxedTuple* BoxedTuple::create(int64_t nelts, Box** elts) {
+    BoxedTuple* rtn = new (nelts) BoxedTuple(nelts);
+    // Nothing can allocate (and trigger a collection) between the allocation and filling in the elements:
+    memcpy(rtn->elts, elts, nelts * sizeof(Box*));
+    return rtn;
+}
+
+BoxedTuple* BoxedTuple::createInPlace(void* mem, int64_t nelts, Box** elts) {
+    BoxedTuple* rtn = ::new (mem) BoxedTuple(nelts);
+    memcpy(rtn->elts, elts, nelts * sizeof(Box*));
+    return rtn;
+}
+
 extern "C" Box* createTuple(int64_t nelts, Box* *elts) {
-    std::vector<Box*> velts(elts, elts + nelts);
-    return new BoxedTuple(velts);
+    return BoxedTuple::create(nelts, elts);
+}
+
+extern "C" Box* createTupleInPlace(void* mem, int64_t nelts, Box* *elts) {
+    return BoxedTuple::createInPlace(mem, nelts, elts);
 }
 
 void tuple_dtor(BoxedTuple* t) {
-    typedef std::vector<Box*> T;
-    (&t->elts)->~T();
+}
+
+size_t BoxedTuple::getHash() {
+    if (hash_computed)
+        return hash;
+
+    // The same way CPython combines the element hashes:
+    size_t x = 0x345678;
+    size_t mult = 1000003;
+    for (int64_t i = 0; i < nelts; i++) {
+        x = (x ^ PyHasher()(elts[i])) * mult;
+        mult += 82520 + 2 * (nelts - i - 1);
+    }
+    x += 97531;
+    if (x == (size_t)-1)
+        x = -2;
+
+    hash = x;
+    hash_computed = true;
+    return hash;
+}
+
+static bool eltsEqual(Box* lhs, Box* rhs) {
+    if (lhs == rhs)
+        return true;
+    if (lhs->cls == int_cls && rhs->cls == int_cls)
+        return static_cast<BoxedInt*>(lhs)->n == static_cast<BoxedInt*>(rhs)->n;
+    if (lhs->cls == str_cls && rhs->cls == str_cls)
+        return static_cast<BoxedString*>(lhs)->equals(static_cast<BoxedString*>(rhs));
+    if (lhs->cls == tuple_cls && rhs->cls == tuple_cls)
+        return static_cast<BoxedTuple*>(lhs)->equals(static_cast<BoxedTuple*>(rhs));
+    return nonzero(compareInternal(lhs, rhs, AST_TYPE::Eq, NULL));
+}
+
+bool BoxedTuple::equals(BoxedTuple* rhs) {
+    if (this == rhs)
+        return true;
+    // (unlike BoxedString::equals, this can't give up when the cached hashes are different: objects
+    // that define __eq__ but not __hash__ still get hashed by identity)
+    if (nelts != rhs->nelts)
+        return false;
+
+    for (int64_t i = 0; i < nelts; i++) {
+        if (!eltsEqual(elts[i], rhs->elts[i]))
+            return false;
+    }
+    return true;
 }
 
 Box* tupleGetitem(BoxedTuple *self, Box* slice) {
     assert(self->cls == tuple_cls);
 
-    i64 size = self->elts.size();
+    i64 size = self->nelts;
 
     if (slice->cls == int_cls) {
         i64 n = static_cast<BoxedInt*>(slice)->n;
 
-        if (n < 0) n = size - n;
+        if (n < 0) n = size + n;
         if (n < 0 || n >= size) {
-            fprintf(stderr, "indexerror\n");
+            fprintf(stderr, "IndexError: tuple index out of range\n");
             raiseExc();
         }
 
@@ -59,49 +122,44 @@ Box* tupleGetitem(BoxedTuple *self, Box* slice) {
 
 Box* tupleLen(BoxedTuple *t) {
     assert(t->cls == tuple_cls);
-    return boxInt(t->elts.size());
+    return boxInt(t->nelts);
 }
 
 Box* tupleRepr(BoxedTuple *t) {
     assert(t->cls == tuple_cls);
 
-    std::ostringstream os("");
-    os << "(";
+    StringBuilder os;
+    os.append('(');
 
-    int n = t->elts.size();
+    int n = t->nelts;
     for (int i = 0; i < n; i++) {
-        if (i) os << ", ";
+        if (i) os.append(", ", 2);
 
         BoxedString *elt_repr =repr(t->elts[i]);
-        os << elt_repr->s;
+        os.append(elt_repr->s);
     }
-    if (n == 1) os << ",";
-    os << ")";
+    if (n == 1) os.append(',');
+    os.append(')');
 
-    return boxString(os.str());
+    return os.finish();
 }
 
 Box* _tupleCmp(BoxedTuple *lhs, BoxedTuple *rhs, AST_TYPE::AST_TYPE op_type) {
-    int lsz = lhs->elts.size();
-    int rsz = rhs->elts.size();
+    int lsz = lhs->nelts;
+    int rsz = rhs->nelts;
 
-    bool is_order = (op_type == AST_TYPE::Lt || op_type == AST_TYPE::LtE || op_type == AST_TYPE::Gt || op_type == AST_TYPE::GtE);
+    // (these can stop as soon as the sizes are different)
+    if (op_type == AST_TYPE::Eq)
+        return boxBool(lhs->equals(rhs));
+    if (op_type == AST_TYPE::NotEq)
+        return boxBool(!lhs->equals(rhs));
 
+    // The first elements that are different decide it:
     int n = std::min(lsz, rsz);
     for (int i = 0; i < n; i++) {
-        Box* is_eq = compareInternal(lhs->elts[i], rhs->elts[i], AST_TYPE::Eq, NULL);
-        bool bis_eq = nonzero(is_eq);
-
-        if (bis_eq) continue;
-
-        if (op_type == AST_TYPE::Eq) {
-            return boxBool(false);
-        } else if (op_type == AST_TYPE::NotEq) {
-            return boxBool(true);
-        } else {
-            Box* r = compareInternal(lhs->elts[i], rhs->elts[i], op_type, NULL);
-            return r;
-        }
+        if (eltsEqual(lhs->elts[i], rhs->elts[i]))
+            continue;
+        return compareInternal(lhs->elts[i], rhs->elts[i], op_type, NULL);
     }
 
     if (op_type == AST_TYPE::Lt)
@@ -112,10 +170,6 @@ Box* _tupleCmp(BoxedTuple *lhs, BoxedTuple *rhs, AST_TYPE::AST_TYPE op_type) {
         return boxBool(lsz > rsz);
     else if (op_type == AST_TYPE::GtE)
         return boxBool(lsz >= rsz);
-    else if (op_type == AST_TYPE::Eq)
-        return boxBool(lsz == rsz);
-    else if (op_type == AST_TYPE::NotEq)
-        return boxBool(lsz != rsz);
 
     RELEASE_ASSERT(0, "%d", op_type);
 }
@@ -162,6 +216,19 @@ Box* tupleNe(BoxedTuple *self, Box *rhs) {
     return _tupleCmp(self, static_cast<BoxedTuple*>(rhs), AST_TYPE::NotEq);
 }
 
+Box* tupleHash(BoxedTuple *self) {
+    assert(self->cls == tuple_cls);
+    return boxInt(self->getHash());
+}
+
+Box* tupleContains(BoxedTuple *self, Box *elt) {
+    for (int64_t i = 0; i < self->nelts; i++) {
+        if (PyEq()(self->elts[i], elt))
+            return True;
+    }
+    return False;
+}
+
 void setupTuple() {
     tuple_cls->giveAttr("__name__", boxStrConstant("tuple"));
 
@@ -174,11 +241,15 @@ void setupTuple() {
     tuple_cls->giveAttr("__eq__", new BoxedFunction(boxRTFunction((void*)tupleEq, NULL, 2, false)));
     tuple_cls->giveAttr("__ne__", new BoxedFunction(boxRTFunction((void*)tupleNe, NULL, 2, false)));
 
+    tuple_cls->giveAttr("__hash__", new BoxedFunction(boxRTFunction((void*)tupleHash, NULL, 1, false)));
     tuple_cls->giveAttr("__len__", new BoxedFunction(boxRTFunction((void*)tupleLen, NULL, 1, false)));
+    tuple_cls->giveAttr("__contains__", new BoxedFunction(boxRTFunction((void*)tupleContains, NULL, 2, false)));
     tuple_cls->giveAttr("__repr__", new BoxedFunction(boxRTFunction((void*)tupleRepr, NULL, 1, false)));
     tuple_cls->setattr("__str__", tuple_cls->peekattr("__repr__"), NULL, NULL);
 
     tuple_cls->freeze();
+
+    registerContainsImpl(tuple_cls, (void*)tupleContains);
 }
 
 void teardownTuple() {
@@ -23,6 +23,7 @@
 #include "core/stats.h"
 #include "core/types.h"
 
+#include "runtime/alloc_profile.h"
 #include "runtime/gc_runtime.h"
 #include "runtime/objmodel.h"
 #include "runtime/types.h"
@@ -35,7 +36,7 @@ namespace pyston {
 
 bool IN_SHUTDOWN = false;
 
-extern "C" BoxedFunction::BoxedFunction(CLFunction *f) : HCBox(&function_flavor, function_cls), f(f) {
+extern "C" BoxedFunction::BoxedFunction(CLFunction *f, BoxedTuple *defaults, BoxedClosure *closure) : HCBox(&function_flavor, function_cls), f(f), defaults(defaults), closure(closure) {
     if (f->source) {
         assert(f->source->ast);
         //this->giveAttr("__name__", boxString(&f->source->ast->name));
@@ -51,10 +52,45 @@ BoxedModule::BoxedModule(const std::string *name, const std::string *fn) : HCBox
     this->giveAttr("__file__", boxString(*fn));
 }
 
+BoxedModule::GlobalCell* BoxedModule::getGlobalCell(const std::string *interned_name) {
+    std::unordered_map<const std::string*, GlobalCell>::iterator it = global_cells.find(interned_name);
+    if (it != global_cells.end())
+        return &it->second;
+
+    dependent_setattrs.invalidateAll();
+    return &global_cells[interned_name];
+}
+
+bool BoxedModule::globalChanged(const std::string *interned_name) {
+    std::unordered_map<const std::string*, GlobalCell>::iterator it = global_cells.find(interned_name);
+    if (it == global_cells.end())
+        return false;
+
+    it->second.num_changes++;
+    it->second.invalidator.invalidateAll();
+    return true;
+}
+
 extern "C" Box* boxCLFunction(CLFunction *f) {
     return new BoxedFunction(f);
 }
 
+extern "C" Box* boxCLFunctionDefaults(CLFunction *f, Box* defaults) {
+    assert(defaults->cls == tuple_cls);
+    return new BoxedFunction(f, static_cast<BoxedTuple*>(defaults));
+}
+
+extern "C" Box* boxCLFunctionClosure(CLFunction *f, Box* defaults, Box* closure) {
+    assert(defaults == NULL || defaults->cls == tuple_cls);
+    assert(closure->cls == closure_cls);
+    return new BoxedFunction(f, static_cast<BoxedTuple*>(defaults), static_cast<BoxedClosure*>(closure));
+}
+
+extern "C" Box* createClosure(Box* parent, int64_t nelts) {
+    assert(parent == NULL || parent->cls == closure_cls);
+    return new (nelts) BoxedClosure(static_cast<BoxedClosure*>(parent), nelts);
+}
+
 extern "C" CLFunction* unboxCLFunction(Box* b) {
     return static_cast<BoxedFunction*>(b)->f;
 }
@@ -74,17 +110,64 @@ extern "C" void hcBoxGCHandler(GCVisitor *v, void* p) {
 
     HCBox* b = (HCBox*)p;
     v->visit(b->hcls);
-    int nattrs = b->hcls->attr_offsets.size();
-    if (nattrs) {
-        HCBox::AttrList *attr_list = b->attr_list;
-        assert(attr_list);
+
+    if (b->hcls->is_dict_mode) {
+        HCBox::AttrDict *attr_dict = b->attr_dict;
+        v->visit(attr_dict);
+        for (int i = 0; i < attr_dict->capacity; i++) {
+            if (attr_dict->entries[i].name)
+                v->visit(attr_dict->entries[i].val);
+        }
+        return;
+    }
+
+    int nattrs = b->hcls->numAttrs();
+    int ninline = std::min(nattrs, b->hcls->num_inline_slots);
+    for (int i = 0; i < ninline; i++) {
+        v->visit(b->inlineAttrs()[i]);
+    }
+    // The attr_list can be preallocated before anything gets put in it:
+    HCBox::AttrList *attr_list = b->attr_list;
+    assert(attr_list || nattrs <= ninline);
+    if (attr_list) {
         v->visit(attr_list);
-        for (int i = 0; i < nattrs; i++) {
+        for (int i = 0; i < nattrs - ninline; i++) {
             v->visit(attr_list->attrs[i]);
         }
     }
 }
 
+extern "C" void functionGCHandler(GCVisitor *v, void* p) {
+    hcBoxGCHandler(v, p);
+
+    BoxedFunction *f = (BoxedFunction*)p;
+    if (f->defaults)
+        v->visit(f->defaults);
+    if (f->closure)
+        v->visit(f->closure);
+}
+
+extern "C" void closureGCHandler(GCVisitor *v, void* p) {
+    boxGCHandler(v, p);
+
+    BoxedClosure *c = (BoxedClosure*)p;
+    if (c->parent)
+        v->visit(c->parent);
+    for (int i = 0; i < c->nelts; i++) {
+        if (c->elts[i])
+            v->visit(c->elts[i]);
+    }
+}
+
+extern "C" void sliceGCHandler(GCVisitor *v, void* p) {
+    boxGCHandler(v, p);
+
+    BoxedSlice *s = (BoxedSlice*)p;
+    v->visit(s->start);
+    v->visit(s->stop);
+    v->visit(s->step);
+}
+
 extern "C" void typeGCHandler(GCVisitor *v, void* p) {
     hcBoxGCHandler(v, p);
 
@@ -93,9 +176,15 @@ extern "C" void typeGCHandler(GCVisitor *v, void* p) {
 
 extern "C" void hcGCHandler(GCVisitor *v, void* p) {
     HiddenClass *hc = (HiddenClass*)p;
-    for (auto it : hc->children) {
-        v->visit(it.second);
-    }
+    // Not the children, since those are weak:
+    if (hc->parent)
+        v->visit(hc->parent);
+}
+
+static void hcFinalizer(void* p) {
+    HiddenClass *hc = (HiddenClass*)p;
+    hc->dependent_ics.invalidateAll();
+    hc->~HiddenClass();
 }
 
 extern "C" void instancemethodGCHandler(GCVisitor *v, void* p) {
@@ -111,9 +200,11 @@ extern "C" void listGCHandler(GCVisitor *v, void* p) {
 
     BoxedList *l = (BoxedList*)p;
     int size = l->size;
-    if (size) {
+    if (l->capacity) {
         v->visit(l->elts);
-        v->visitRange((void**)&l->elts->elts[0], (void**)&l->elts->elts[size]);
+        // Unboxed elements aren't pointers:
+        if (l->strategy == BoxedList::OBJECT_STRATEGY)
+            v->visitRange((void**)&l->elts->elts[0], (void**)&l->elts->elts[size]);
     }
 
     static StatCounter sc("gc_listelts_visited");
@@ -125,7 +216,7 @@ extern "C" void tupleGCHandler(GCVisitor *v, void* p) {
     boxGCHandler(v, p);
 
     BoxedTuple *t = (BoxedTuple*)p;
-    int size = t->elts.size();
+    int size = t->nelts;
     for (int i = 0; i < size; i++) {
         v->visit(t->elts[i]);
     }
@@ -137,57 +228,51 @@ extern "C" void dictGCHandler(GCVisitor *v, void* p) {
 
     BoxedDict *d = (BoxedDict*)p;
 
-    // This feels like a cludge, but we need to find anything that
-    // the unordered_map might have allocated.
-    // Another way to handle this would be to rt_alloc the unordered_map
-    // as well, though that incurs extra memory dereferences which would
-    // be nice to avoid.
-    void **start = (void**)&d->d;
-    void **end = start + (sizeof(d->d) / 8);
-    v->visitPotentialRange(start, end);
-}
-
-extern "C" void conservativeGCHandler(GCVisitor *v, void* p) {
-    ConservativeWrapper *wrapper = static_cast<ConservativeWrapper*>(p);
-    assert(wrapper->gc_header.kind_id == conservative_kind.kind_id);
-
-    int size = wrapper->gc_header.kind_data;
-    assert(size % sizeof(void*) == 0);
+    // The arrays don't get scanned on their own, so visit what's in them here:
+    if (d->index)
+        v->visit(d->index);
+    if (d->entries) {
+        v->visit(d->entries);
+        for (int64_t i = 0; i < d->size; i++) {
+            v->visit(d->entries->entries[i].key);
+            v->visit(d->entries->entries[i].value);
+        }
+    }
 
-    void** start = &wrapper->data[0];
-    //printf("Found a %d-byte object; header is %p (object is %p)\n", size, p, start);
-    v->visitPotentialRange(start, start + (size / sizeof(void*)));
+    static StatCounter sc("gc_dictelts_visited");
+    sc.log(d->size);
 }
 
 extern "C" {
-    BoxedClass *type_cls, *none_cls, *bool_cls, *int_cls, *float_cls, *str_cls, *function_cls, *instancemethod_cls, *list_cls, *slice_cls, *module_cls, *dict_cls, *tuple_cls, *file_cls;
+    BoxedClass *type_cls, *none_cls, *bool_cls, *int_cls, *long_cls, *float_cls, *str_cls, *function_cls, *instancemethod_cls, *list_cls, *slice_cls, *module_cls, *dict_cls, *tuple_cls, *file_cls, *closure_cls;
 
     const ObjectFlavor type_flavor(&typeGCHandler, NULL);
     const ObjectFlavor none_flavor(&boxGCHandler, NULL);
     const ObjectFlavor bool_flavor(&boxGCHandler, NULL);
     const ObjectFlavor int_flavor(&boxGCHandler, NULL);
+    const ObjectFlavor long_flavor(&boxGCHandler, (AllocationKind::FinalizationFunc)&long_dtor);
     const ObjectFlavor float_flavor(&boxGCHandler, NULL);
-    const ObjectFlavor str_flavor(&boxGCHandler, NULL);
-    const ObjectFlavor function_flavor(&hcBoxGCHandler, NULL);
+    const ObjectFlavor str_flavor(&boxGCHandler, (AllocationKind::FinalizationFunc)&str_dtor);
+    const ObjectFlavor function_flavor(&functionGCHandler, NULL);
     const ObjectFlavor instancemethod_flavor(&instancemethodGCHandler, NULL);
     const ObjectFlavor list_flavor(&listGCHandler, NULL);
-    const ObjectFlavor slice_flavor(&hcBoxGCHandler, NULL);
+    const ObjectFlavor slice_flavor(&sliceGCHandler, NULL);
     const ObjectFlavor module_flavor(&hcBoxGCHandler, NULL);
     const ObjectFlavor dict_flavor(&dictGCHandler, NULL);
-    const ObjectFlavor tuple_flavor(&tupleGCHandler, NULL);
-    const ObjectFlavor file_flavor(&boxGCHandler, NULL);
+    const ObjectFlavor tuple_flavor(&tupleGCHandler, (AllocationKind::FinalizationFunc)&tuple_dtor);
+    const ObjectFlavor file_flavor(&boxGCHandler, (AllocationKind::FinalizationFunc)&file_dtor);
     const ObjectFlavor user_flavor(&hcBoxGCHandler, NULL);
+    const ObjectFlavor closure_flavor(&closureGCHandler, NULL);
 
     const AllocationKind untracked_kind(NULL, NULL);
-    const AllocationKind hc_kind(&hcGCHandler, NULL);
-    const AllocationKind conservative_kind(&conservativeGCHandler, NULL);
+    const AllocationKind hc_kind(&hcGCHandler, &hcFinalizer);
 }
 
 void instancemethod_dtor(BoxedInstanceMethod* b) {
 }
 
 extern "C" Box* createClass(std::string *name, BoxedModule *parent_module) {
-    BoxedClass* rtn = new BoxedClass(true, NULL);
+    BoxedClass* rtn = new BoxedClass(&user_flavor, true, NULL);
     rtn->giveAttr("__name__", boxString(*name));
 
     Box* modname = parent_module->getattr("__name__", NULL, NULL);
@@ -207,6 +292,12 @@ extern "C" BoxedString* noneRepr(Box* v) {
     return new BoxedString("None");
 }
 
+// There's only the one None, so hashing it by identity is consistent:
+extern "C" Box* noneHash(Box* v) {
+    assert(v == None);
+    return boxInt((i64)v);
+}
+
 extern "C" BoxedString* functionRepr(BoxedFunction* v) {
     // TODO there has to be a better way
     if (v == repr_obj)
@@ -227,6 +318,14 @@ extern "C" BoxedString* functionRepr(BoxedFunction* v) {
         return boxStrConstant("<built-in function open>");
     if (v == chr_obj)
         return boxStrConstant("<built-in function chr>");
+    if (v == isinstance_obj)
+        return boxStrConstant("<built-in function isinstance>");
+    if (v == sum_obj)
+        return boxStrConstant("<built-in function sum>");
+    if (v == any_obj)
+        return boxStrConstant("<built-in function any>");
+    if (v == all_obj)
+        return boxStrConstant("<built-in function all>");
     return new BoxedString("function");
 }
 
@@ -246,21 +345,31 @@ extern "C" {
     Box *open_obj = NULL;
     Box *chr_obj = NULL;
     Box *trap_obj = NULL;
+    Box *isinstance_obj = NULL;
     Box *range_obj = NULL;
+    Box *sum_obj = NULL;
+    Box *any_obj = NULL;
+    Box *all_obj = NULL;
 }
 
 extern "C" Box* createSlice(Box* start, Box* stop, Box* step) {
-    BoxedSlice *rtn = new BoxedSlice(start, stop, step);
-    rtn->setattr("start", start, NULL, NULL);
-    rtn->setattr("stop", stop, NULL, NULL);
-    rtn->setattr("step", step, NULL, NULL);
-    return rtn;
+    return new BoxedSlice(start, stop, step);
 }
 
 Box* instancemethodRepr(BoxedInstanceMethod* self) {
     return boxStrConstant("<bound instancemethod object>");
 }
 
+Box* getSliceAttr(BoxedSlice* self, const char* attr) {
+    if (strcmp(attr, "start") == 0)
+        return self->start;
+    if (strcmp(attr, "stop") == 0)
+        return self->stop;
+    if (strcmp(attr, "step") == 0)
+        return self->step;
+    return NULL;
+}
+
 Box* sliceRepr(BoxedSlice* self) {
     BoxedString *start = repr(self->start);
     BoxedString *stop = repr(self->stop);
@@ -329,27 +438,30 @@ CLFunction* unboxRTFunction(Box* b) {
 bool TRACK_ALLOCATIONS = false;
 void setupRuntime() {
     HiddenClass::getRoot();
+    gc::registerWeakRefCallback(&HiddenClass::dropDeadTransitions);
 
-    type_cls = new BoxedClass(true, NULL);
+    type_cls = new BoxedClass(&type_flavor, true, NULL);
     type_cls->cls = type_cls;
 
-    none_cls = new BoxedClass(false, NULL);
+    none_cls = new BoxedClass(&none_flavor, false, NULL);
     None = new Box(&none_flavor, none_cls);
     gc::registerStaticRootObj(None);
 
-    module_cls = new BoxedClass(true, NULL);
-
-    bool_cls = new BoxedClass(false, NULL);
-    int_cls = new BoxedClass(false, NULL);
-    float_cls = new BoxedClass(false, NULL);
-    str_cls = new BoxedClass(false, (BoxedClass::Dtor)str_dtor);
-    function_cls = new BoxedClass(true, NULL);
-    instancemethod_cls = new BoxedClass(false, (BoxedClass::Dtor)instancemethod_dtor);
-    list_cls = new BoxedClass(false, (BoxedClass::Dtor)list_dtor);
-    slice_cls = new BoxedClass(true, NULL);
-    dict_cls = new BoxedClass(false, (BoxedClass::Dtor)dict_dtor);
-    tuple_cls = new BoxedClass(false, (BoxedClass::Dtor)tuple_dtor);
-    file_cls = new BoxedClass(false, (BoxedClass::Dtor)file_dtor);
+    module_cls = new BoxedClass(&module_flavor, true, NULL);
+
+    bool_cls = new BoxedClass(&bool_flavor, false, NULL);
+    int_cls = new BoxedClass(&int_flavor, false, NULL);
+    long_cls = new BoxedClass(&long_flavor, false, (BoxedClass::Dtor)long_dtor);
+    float_cls = new BoxedClass(&float_flavor, false, NULL);
+    str_cls = new BoxedClass(&str_flavor, false, (BoxedClass::Dtor)str_dtor);
+    function_cls = new BoxedClass(&function_flavor, true, NULL);
+    instancemethod_cls = new BoxedClass(&instancemethod_flavor, false, (BoxedClass::Dtor)instancemethod_dtor);
+    list_cls = new BoxedClass(&list_flavor, false, (BoxedClass::Dtor)list_dtor);
+    slice_cls = new BoxedClass(&slice_flavor, false, NULL);
+    dict_cls = new BoxedClass(&dict_flavor, false, (BoxedClass::Dtor)dict_dtor);
+    tuple_cls = new BoxedClass(&tuple_flavor, false, (BoxedClass::Dtor)tuple_dtor);
+    file_cls = new BoxedClass(&file_flavor, false, (BoxedClass::Dtor)file_dtor);
+    closure_cls = new BoxedClass(&closure_flavor, false, NULL);
 
     STR = typeFromClass(str_cls);
     BOXED_INT = typeFromClass(int_cls);
@@ -371,6 +483,7 @@ void setupRuntime() {
 
     none_cls->giveAttr("__name__", boxStrConstant("NoneType"));
     none_cls->giveAttr("__repr__", new BoxedFunction(boxRTFunction((void*)noneRepr, NULL, 1, false)));
+    none_cls->giveAttr("__hash__", new BoxedFunction(boxRTFunction((void*)noneHash, NULL, 1, false)));
     none_cls->setattr("__str__", none_cls->peekattr("__repr__"), NULL, NULL);
     none_cls->freeze();
 
@@ -381,10 +494,12 @@ void setupRuntime() {
 
     setupBool();
     setupInt();
+    setupLong();
     setupFloat();
     setupStr();
     setupList();
     setupDict();
+    setupSet();
     setupTuple();
     setupFile();
 
@@ -402,21 +517,32 @@ void setupRuntime() {
     slice_cls->setattr("__str__", slice_cls->peekattr("__repr__"), NULL, NULL);
     slice_cls->freeze();
 
+    closure_cls->giveAttr("__name__", boxStrConstant("closure"));
+    closure_cls->freeze();
+
     setupMath();
     gc::registerStaticRootObj(math_module);
     setupTime();
     gc::registerStaticRootObj(time_module);
+    setupThread();
+    gc::registerStaticRootObj(thread_module);
+    setupOs();
+    gc::registerStaticRootObj(os_module);
+    setupPystonStats();
+    gc::registerStaticRootObj(pyston_stats_module);
     setupBuiltins();
     gc::registerStaticRootObj(builtins_module);
 
 
     setupCAPI();
 
-    TRACK_ALLOCATIONS = true;
+    TRACK_ALLOCATIONS = (ALLOC_PROFILE_RATE > 0);
+    if (TRACK_ALLOCATIONS)
+        gc::registerWeakRefCallback(&dropDeadSampledObjects);
 }
 
 void freeHiddenClasses(HiddenClass *hcls) {
-    for (auto it : hcls->children) {
+    for (auto &it : hcls->children) {
         freeHiddenClasses(it.second);
     }
     rt_free(hcls);
@@ -433,10 +559,12 @@ void teardownRuntime() {
 
     teardownList();
     teardownInt();
+    teardownLong();
     teardownFloat();
     teardownStr();
     teardownBool();
     teardownDict();
+    teardownSet();
     teardownTuple();
     teardownFile();
 
@@ -15,6 +15,7 @@
 #ifndef PYSTON_RUNTIME_TYPES_H
 #define PYSTON_RUNTIME_TYPES_H
 
+#include "core/hash.h"
 #include "core/types.h"
 
 namespace pyston {
@@ -24,15 +25,22 @@ extern bool IN_SHUTDOWN;
 class BoxedString;
 class BoxedList;
 class BoxedDict;
+class BoxedSet;
 class BoxedTuple;
+class BoxedClosure;
 class BoxedFile;
+class BoxedLong;
 
 void setupInt();
 void teardownInt();
+void setupLong();
+void teardownLong();
+void long_dtor(BoxedLong* l);
 void setupFloat();
 void teardownFloat();
 void setupStr();
 void teardownStr();
+void str_dtor(BoxedString* s);
 void setupList();
 void teardownList();
 void list_dtor(BoxedList* l);
@@ -41,26 +49,35 @@ void teardownBool();
 void dict_dtor(BoxedDict* d);
 void setupDict();
 void teardownDict();
+void set_dtor(BoxedSet* s);
+void setupSet();
+void teardownSet();
 void tuple_dtor(BoxedTuple* d);
 void setupTuple();
 void teardownTuple();
 void file_dtor(BoxedFile* d);
 void setupFile();
 void teardownFile();
+void setupExceptions();
+// Whether cls is parent or derives from it, for the builtin exception classes (see runtime/exceptions.cpp):
+bool isExceptionSubclass(BoxedClass* cls, BoxedClass* parent);
 void setupCAPI();
 void teardownCAPI();
 
 void setupMath();
 void setupTime();
+void setupThread();
+void setupOs();
+void setupPystonStats();
 void setupBuiltins();
 
-extern "C" { extern BoxedClass *type_cls, *bool_cls, *int_cls, *float_cls, *str_cls, *function_cls, *none_cls, *instancemethod_cls, *list_cls, *slice_cls, *module_cls, *dict_cls, *tuple_cls, *file_cls, *xrange_cls; }
-extern "C" { extern const ObjectFlavor type_flavor, bool_flavor, int_flavor, float_flavor, str_flavor, function_flavor, none_flavor, instancemethod_flavor, list_flavor, slice_flavor, module_flavor, dict_flavor, tuple_flavor, file_flavor, xrange_flavor; }
+extern "C" { extern BoxedClass *type_cls, *bool_cls, *int_cls, *long_cls, *float_cls, *str_cls, *function_cls, *none_cls, *instancemethod_cls, *list_cls, *slice_cls, *module_cls, *dict_cls, *set_cls, *tuple_cls, *file_cls, *xrange_cls, *closure_cls; }
+extern "C" { extern const ObjectFlavor type_flavor, bool_flavor, int_flavor, long_flavor, float_flavor, str_flavor, function_flavor, none_flavor, instancemethod_flavor, list_flavor, slice_flavor, module_flavor, dict_flavor, set_flavor, tuple_flavor, file_flavor, xrange_flavor, closure_flavor; }
 extern "C" { extern const ObjectFlavor user_flavor; }
 
 extern "C" { extern Box *None, *NotImplemented, *True, *False; }
-extern "C" { extern Box *repr_obj, *len_obj, *hash_obj, *range_obj, *abs_obj, *min_obj, *max_obj, *open_obj, *chr_obj, *trap_obj; } // these are only needed for functionRepr, which is hacky
-extern "C" { extern BoxedModule *math_module, *time_module, *builtins_module; }
+extern "C" { extern Box *repr_obj, *len_obj, *hash_obj, *range_obj, *abs_obj, *min_obj, *max_obj, *open_obj, *chr_obj, *trap_obj, *isinstance_obj, *sum_obj, *any_obj, *all_obj; } // these are only needed for functionRepr, which is hacky
+extern "C" { extern BoxedModule *math_module, *time_module, *thread_module, *os_module, *pyston_stats_module, *builtins_module; }
 
 extern "C" Box* boxBool(bool);
 extern "C" Box* boxInt(i64);
@@ -72,13 +89,41 @@ Box* boxString(const std::string &s);
 extern "C" BoxedString* boxStrConstant(const char* chars);
 extern "C" void listAppendInternal(Box* self, Box* v);
 extern "C" Box* boxCLFunction(CLFunction *f);
+extern "C" Box* boxCLFunctionDefaults(CLFunction *f, Box* defaults);
+// For functions that take a closure; defaults can be NULL.
+extern "C" Box* boxCLFunctionClosure(CLFunction *f, Box* defaults, Box* closure);
 extern "C" CLFunction* unboxCLFunction(Box* b);
 extern "C" Box* createClass(std::string *name, BoxedModule *parent_module);
 extern "C" double unboxFloat(Box *b);
 extern "C" Box* createDict();
 extern "C" Box* createList();
+// For when the number of elements that are about to get appended is known, so the list only gets allocated once:
+extern "C" Box* createListSized(int64_t capacity);
 extern "C" Box* createSlice(Box* start, Box* stop, Box* step);
+// Slicing with bounds that are already unboxed, for when the jit knows the type of the receiver, so that no
+// slice object has to get made; bounds that weren't given are SLICE_BOUND_NONE (see parseSliceBounds).
+extern "C" Box* listSliceUnboxed(BoxedList* self, i64 start, i64 stop, i64 step);
+extern "C" Box* strSliceUnboxed(BoxedString* self, i64 start, i64 stop, i64 step);
+// Truthiness of the builtin containers, for when the jit knows the type; these are in the inline
+// section so that they end up as a load and a compare.
+extern "C" bool listNonzeroUnboxed(BoxedList* self);
+extern "C" bool tupleNonzeroUnboxed(BoxedTuple* self);
+extern "C" bool dictNonzeroUnboxed(BoxedDict* self);
+extern "C" bool strNonzeroUnboxed(BoxedString* self);
+// Same for len():
+extern "C" i64 listLenUnboxed(BoxedList* self);
+extern "C" i64 tupleLenUnboxed(BoxedTuple* self);
+extern "C" i64 dictLenUnboxed(BoxedDict* self);
+extern "C" i64 strLenUnboxed(BoxedString* self);
+// For == and != when both sides are known to be strs:
+extern "C" bool strEqUnboxed(BoxedString* lhs, BoxedString* rhs);
+// sum() of an xrange: takes a Box* since its class isn't visible outside of xrange.cpp.  The result is an
+// unboxed int, so like the rest of the unboxed int math, this raises if it doesn't fit.
+extern "C" i64 xrangeSumUnboxed(Box* xrange);
 extern "C" Box* createTuple(int64_t nelts, Box* *elts);
+// For tuples that the jit has proven never escape their frame; mem has to be big enough for the elements.
+extern "C" Box* createTupleInPlace(void* mem, int64_t nelts, Box* *elts);
+extern "C" Box* createClosure(Box* parent, int64_t nelts);
 extern "C" void printFloat(double d);
 
 
@@ -88,11 +133,24 @@ struct BoxedInt : public Box {
     BoxedInt(int64_t n) __attribute__((visibility("default"))) : Box(&int_flavor, int_cls), n(n) {}
 };
 
+// Arbitrary-precision integers, which is what int arithmetic promotes to when it overflows.
+// Sign-magnitude, with the magnitude stored as little-endian base-2**32 digits and no leading
+// zero digits (so zero is the empty vector).
+struct BoxedLong : public Box {
+    bool negative;
+    std::vector<uint32_t> digits;
+
+    BoxedLong() __attribute__((visibility("default"))) : Box(&long_flavor, long_cls), negative(false) {}
+};
+
 struct BoxedFloat : public Box {
     double d;
 
     BoxedFloat(double d) __attribute__((visibility("default"))) : Box(&float_flavor, float_cls), d(d) {}
 };
+// These are by far the most common allocations, and fit in the heap's smallest size class:
+static_assert(sizeof(BoxedInt) == 16, "");
+static_assert(sizeof(BoxedFloat) == 16, "");
 
 struct BoxedBool : public Box {
     bool b;
@@ -102,9 +160,40 @@ struct BoxedBool : public Box {
 
 struct BoxedString : public Box {
     const std::string s;
+    // Computed the first time it's needed:
+    size_t hash;
+    bool hash_computed;
+    // Interned strings are the only ones with their contents (see boxInternedString), so two of them
+    // are equal only if they're the same object.
+    bool interned;
+
+    BoxedString(const std::string &s) __attribute__((visibility("default"))) : Box(&str_flavor, str_cls), s(s), hash(0), hash_computed(false), interned(false) {}
+    BoxedString(std::string &&s) __attribute__((visibility("default"))) : Box(&str_flavor, str_cls), s(std::move(s)), hash(0), hash_computed(false), interned(false) {}
+
+    size_t getHash() {
+        if (!hash_computed) {
+            hash = hashBytes(s.data(), s.size());
+            hash_computed = true;
+        }
+        return hash;
+    }
 
-    BoxedString(const std::string &s) __attribute__((visibility("default"))) : Box(&str_flavor, str_cls), s(s) {}
+    bool equals(BoxedString* rhs) {
+        if (this == rhs)
+            return true;
+        if (interned && rhs->interned)
+            return false;
+        if (hash_computed && rhs->hash_computed && hash != rhs->hash)
+            return false;
+        return s == rhs->s;
+    }
 };
+// Returns the canonical object for this string, creating it the first time; these never get freed.
+BoxedString* boxInternedString(const std::string &s);
+// The (interned) one-character string for c:
+BoxedString* boxCharacter(char c);
+// Whether s looks like an identifier, which is what string constants get interned for:
+bool isIdentifierLike(const std::string &s);
 
 struct BoxedInstanceMethod : public Box {
     Box *obj, *func;
@@ -113,6 +202,16 @@ struct BoxedInstanceMethod : public Box {
 };
 
 struct BoxedList : public Box {
+    // How the elements are stored: lists that only ever contain ints (or only floats) keep them
+    // unboxed, and switch to storing Box*'s the first time something else gets put in them.
+    // All three element types are 8 bytes, so moving elements around works the same for all of them.
+    // (The strategy is a full word so that ICs can guard on it.)
+    enum Strategy : int64_t {
+        OBJECT_STRATEGY,
+        INT_STRATEGY,
+        FLOAT_STRATEGY,
+    };
+
     struct ElementArray : GCObject {
             Box* elts[0];
 
@@ -121,55 +220,141 @@ struct BoxedList : public Box {
             void *operator new(size_t size, int capacity) {
                 return rt_alloc(capacity * sizeof(Box*) + sizeof(BoxedList::ElementArray));
             }
+
+            int64_t* intElts() {
+                return reinterpret_cast<int64_t*>(elts);
+            }
+            double* floatElts() {
+                return reinterpret_cast<double*>(elts);
+            }
     };
 
     int64_t size, capacity;
     ElementArray *elts;
+    Strategy strategy;
 
-    BoxedList() __attribute__((visibility("default"))) : Box(&list_flavor, list_cls), size(0), capacity(0) {}
+    BoxedList() __attribute__((visibility("default"))) : Box(&list_flavor, list_cls), size(0), capacity(0), strategy(OBJECT_STRATEGY) {}
 
     void ensure(int space);
+
+    Box* getElt(int64_t i) {
+        assert(0 <= i && i < size);
+        if (strategy == INT_STRATEGY)
+            return boxInt(elts->intElts()[i]);
+        if (strategy == FLOAT_STRATEGY)
+            return boxFloat(elts->floatElts()[i]);
+        return elts->elts[i];
+    }
+    bool canStoreUnchanged(Box* v) {
+        if (strategy == INT_STRATEGY)
+            return v->cls == int_cls;
+        if (strategy == FLOAT_STRATEGY)
+            return v->cls == float_cls;
+        return true;
+    }
+    // Sets element i (which has to be < size), switching strategies if v doesn't fit the current one.
+    void setElt(int64_t i, Box* v);
+    // Converts the elements to Box*'s (if they weren't already), for code that wants to use elts->elts directly.
+    void switchToObjectStrategy();
 };
 
+// The elements are stored right after the object, so a tuple is a single allocation; use
+// BoxedTuple::create() to make one.
 struct BoxedTuple : public Box {
-    const std::vector<Box*> elts;
+    const int64_t nelts;
+    // Computed the first time it's needed, from the hashes of the elements (which can't change):
+    size_t hash;
+    bool hash_computed;
+    Box* elts[0];
+
+    static BoxedTuple* create(int64_t nelts, Box** elts);
+    static BoxedTuple* create(const std::vector<Box*> &elts) {
+        return create(elts.size(), const_cast<Box**>(elts.data()));
+    }
+    static BoxedTuple* createInPlace(void* mem, int64_t nelts, Box** elts);
+
+    size_t getHash();
+    // Compares the elements pairwise; skips the ones that are the same object, and does the ones that are
+    // both ints or both strs (or both tuples) without going through compareInternal.  Doesn't look at the
+    // cached hashes, since elements can be equal without hashing the same.
+    bool equals(BoxedTuple* rhs);
 
-    BoxedTuple(std::vector<Box*> &elts) __attribute__((visibility("default"))) : Box(&tuple_flavor, tuple_cls), elts(elts) {}
+    private:
+        BoxedTuple(int64_t nelts) __attribute__((visibility("default"))) : Box(&tuple_flavor, tuple_cls), nelts(nelts), hash(0), hash_computed(false) {}
+
+        void *operator new(size_t size, int64_t nelts) __attribute__((visibility("default"))) {
+            return rt_alloc(size + nelts * sizeof(Box*));
+        }
 };
 
 struct BoxedFile : public Box {
+    static const int64_t DEFAULT_BUFFER_SIZE = 1 << 16;
+
     FILE *f;
     bool closed;
-    BoxedFile(FILE* f) __attribute__((visibility("default"))) : Box(&file_flavor, file_cls), f(f), closed(false) {}
+
+    // Reads go through our own buffer (allocated on the first read), so that readline and
+    // line iteration can scan for newlines in bulk instead of going through stdio a
+    // character at a time.  [rbuf_pos, rbuf_len) is the part that hasn't been consumed yet.
+    char* rbuf;
+    int64_t rbuf_capacity, rbuf_pos, rbuf_len;
+    // How many threads are in the middle of reading or writing this file with the GIL released (see
+    // _fileWaitForIO); protected by the GIL.
+    int64_t unlocked_count;
+
+    BoxedFile(FILE* f, int64_t buffer_size=DEFAULT_BUFFER_SIZE) __attribute__((visibility("default"))) : Box(&file_flavor, file_cls), f(f), closed(false), rbuf(NULL), rbuf_capacity(buffer_size), rbuf_pos(0), rbuf_len(0), unlocked_count(0) {}
 };
 
+// str, int and tuple keys are common enough to hash without going through hash():
 struct PyHasher {
-    size_t operator()(Box*) const;
+    size_t operator()(Box* b) const {
+        if (b->cls == str_cls)
+            return static_cast<BoxedString*>(b)->getHash();
+        if (b->cls == int_cls)
+            return static_cast<BoxedInt*>(b)->n;
+        if (b->cls == tuple_cls)
+            return static_cast<BoxedTuple*>(b)->getHash();
+        return hashSlow(b);
+    }
+
+    static size_t hashSlow(Box*);
 };
 
+// Same for comparing them, which is also what dicts and sets use for their keys:
 struct PyEq {
-    bool operator()(Box*, Box*) const;
+    bool operator()(Box* lhs, Box* rhs) const {
+        if (lhs == rhs)
+            return true;
+        if (lhs->cls == int_cls && rhs->cls == int_cls)
+            return static_cast<BoxedInt*>(lhs)->n == static_cast<BoxedInt*>(rhs)->n;
+        if (lhs->cls == str_cls && rhs->cls == str_cls)
+            return static_cast<BoxedString*>(lhs)->equals(static_cast<BoxedString*>(rhs));
+        if (lhs->cls == tuple_cls && rhs->cls == tuple_cls)
+            return static_cast<BoxedTuple*>(lhs)->equals(static_cast<BoxedTuple*>(rhs));
+        return eqSlow(lhs, rhs);
+    }
+
+    static bool eqSlow(Box*, Box*);
 };
 
 struct PyLt {
     bool operator()(Box*, Box*) const;
 };
 
-struct ConservativeWrapper : GCObject {
+// The memory backing STL containers.  It doesn't get scanned by the collector: whatever owns the
+// container is responsible for visiting both the storage and the objects that are stored in it.
+struct StlStorage : GCObject {
     void* data[0];
 
-    ConservativeWrapper(size_t data_size) : GCObject(&conservative_kind), data() {
-        assert(data_size % sizeof(void*) == 0);
-        gc_header.kind_data = data_size;
-    }
+    StlStorage() : GCObject(&untracked_kind), data() {}
 
     void *operator new(size_t size, size_t data_size) {
-        assert(size == sizeof(ConservativeWrapper));
+        assert(size == sizeof(StlStorage));
         return rt_alloc(data_size + size);
     }
 
-    static ConservativeWrapper* fromPointer(void* p) {
-        ConservativeWrapper* o = (ConservativeWrapper*)((void**)p - 1);
+    static StlStorage* fromPointer(void* p) {
+        StlStorage* o = (StlStorage*)((void**)p - 1);
         assert(&o->data == p);
         return o;
     }
@@ -196,15 +381,12 @@ class StlCompatAllocator {
         };
 
         pointer allocate(size_t n) {
-            size_t to_allocate = n * sizeof(value_type);
-            assert(to_allocate < (1<<16));
-
-            ConservativeWrapper* rtn = new (to_allocate) ConservativeWrapper(to_allocate);
+            StlStorage* rtn = new (n * sizeof(value_type)) StlStorage();
             return (pointer)&rtn->data[0];
         }
 
         void deallocate(pointer p, size_t n) {
-            ConservativeWrapper* o = ConservativeWrapper::fromPointer(p);
+            StlStorage* o = StlStorage::fromPointer(p);
             rt_free(o);
         }
 
@@ -222,37 +404,159 @@ class StlCompatAllocator {
 };
 
 struct BoxedDict : public Box {
-    typedef std::unordered_map<Box*, Box*, PyHasher, PyEq, StlCompatAllocator<std::pair<Box*, Box*> > > PyDict;
-    PyDict d;
+    // An insertion-ordered hash table: the entries get appended to a dense array (and remember
+    // their key's hash), and a sparse open-addressed index maps hashes to positions in that array.
+    struct Entry {
+        size_t hash;
+        Box *key, *value;
+    };
+    struct EntryArray : GCObject {
+        Entry entries[0];
 
-    BoxedDict() __attribute__((visibility("default"))) : Box(&dict_flavor, dict_cls) {}
+        EntryArray() : GCObject(&untracked_kind) {}
 
-    void verify() {
-        int i = 0;
-        for (auto it : d) {
-            ++i;
+        void *operator new(size_t size, int64_t capacity) {
+            return rt_alloc(capacity * sizeof(Entry) + sizeof(EntryArray));
         }
-        assert(i == d.size());
+    };
+    // index[i] is either EMPTY or the position of an entry; the size is always a power of two.
+    struct IndexArray : GCObject {
+        int64_t index[0];
+
+        IndexArray() : GCObject(&untracked_kind) {}
+
+        void *operator new(size_t size, int64_t capacity) {
+            return rt_alloc(capacity * sizeof(int64_t) + sizeof(IndexArray));
+        }
+    };
+    static const int64_t EMPTY = -1;
+
+    int64_t size, entries_capacity, index_size;
+    EntryArray *entries;
+    IndexArray *index;
+    // Whether every key that's ever been put in is a str, which is the case for most dicts (kwargs,
+    // anything keyed by names); while it is, lookups by str compare the keys directly instead of going
+    // through PyEq.  Goes back to the general lookup for good once a key of any other type gets added.
+    bool str_keys_only;
+
+    BoxedDict() __attribute__((visibility("default"))) : Box(&dict_flavor, dict_cls), size(0), entries_capacity(0), index_size(0), entries(NULL), index(NULL), str_keys_only(true) {}
+
+    // Returns NULL if the key isn't in the dict:
+    Box* getOrNull(Box* k);
+    void set(Box* k, Box* v);
+
+    Entry* begin() {
+        return entries ? &entries->entries[0] : NULL;
+    }
+    Entry* end() {
+        return entries ? &entries->entries[size] : NULL;
+    }
+
+    void verify() {
+        for (int64_t i = 0; i < size; i++)
+            assert(getOrNull(entries->entries[i].key) == entries->entries[i].value);
     }
 };
 
+// Laid out like BoxedDict (a dense, insertion-ordered entry array plus an open-addressed index), minus
+// the values.  Removing an element just clears its entry's key, and leaves the index pointing at it so
+// that probe sequences stay intact; the entries get compacted the next time the index is rebuilt.
+struct BoxedSet : public Box {
+    struct Entry {
+        size_t hash;
+        // NULL if it got removed
+        Box *key;
+    };
+    struct EntryArray : GCObject {
+        Entry entries[0];
+
+        EntryArray() : GCObject(&untracked_kind) {}
+
+        void *operator new(size_t size, int64_t capacity) {
+            return rt_alloc(capacity * sizeof(Entry) + sizeof(EntryArray));
+        }
+    };
+    typedef BoxedDict::IndexArray IndexArray;
+    static const int64_t EMPTY = BoxedDict::EMPTY;
+
+    // size is the number of elements, and nentries the number of entries in use, including removed ones.
+    int64_t size, nentries, entries_capacity, index_size;
+    EntryArray *entries;
+    IndexArray *index;
+
+    BoxedSet() __attribute__((visibility("default"))) : Box(&set_flavor, set_cls), size(0), nentries(0), entries_capacity(0), index_size(0), entries(NULL), index(NULL) {}
+
+    bool contains(Box* k);
+    void add(Box* k);
+    // Returns whether it was there:
+    bool discard(Box* k);
+};
+
 struct BoxedFunction : public HCBox {
     CLFunction *f;
+    // The values of the parameters' defaults, which get evaluated when the def runs; NULL if
+    // there aren't any.
+    BoxedTuple *defaults;
+    // The closure of the scope that the def ran in, if the function takes one; the calls append it
+    // to the arguments.
+    BoxedClosure *closure;
+
+    BoxedFunction(CLFunction *f, BoxedTuple *defaults=NULL, BoxedClosure *closure=NULL);
+};
+
+// The variables of a function that nested functions refer to.  The scoping analysis gives each of
+// them a fixed slot, and parent is the closure that the function itself took (if any), so getting to
+// a variable is a load per level plus one for the slot.  Slots that haven't been assigned yet are NULL.
+struct BoxedClosure : public Box {
+    BoxedClosure *parent;
+    const int64_t nelts;
+    Box* elts[0];
+
+    BoxedClosure(BoxedClosure *parent, int64_t nelts) __attribute__((visibility("default"))) : Box(&closure_flavor, closure_cls), parent(parent), nelts(nelts) {
+        for (int i = 0; i < nelts; i++)
+            elts[i] = NULL;
+    }
 
-    BoxedFunction(CLFunction *f);
+    void *operator new(size_t size, int64_t nelts) __attribute__((visibility("default"))) {
+        return rt_alloc(size + nelts * sizeof(Box*));
+    }
 };
 
 struct BoxedModule : public HCBox {
     const std::string fn; // for traceback purposes; not the same as __file__
 
+    // getGlobal ICs embed the value they found rather than guarding on the module, and depend on
+    // the cell of each name they looked at instead; assigning to the global invalidates them.
+    struct GlobalCell {
+        ICInvalidator invalidator;
+        int num_changes;
+
+        GlobalCell() : num_changes(0) {}
+    };
+    // Globals that keep getting reassigned aren't worth treating as constants:
+    static const int MAX_GLOBAL_CHANGES = 16;
+
+    std::unordered_map<const std::string*, GlobalCell> global_cells;
+    // Setattr ICs on the module skip the invalidation, so they depend on this, which gets
+    // triggered whenever a new cell gets created.
+    ICInvalidator dependent_setattrs;
+
     BoxedModule(const std::string *name, const std::string *fn);
+
+    GlobalCell* getGlobalCell(const std::string *interned_name);
+    // Returns whether there was a cell for this name:
+    bool globalChanged(const std::string *interned_name);
 };
 
-struct BoxedSlice : public HCBox {
+// The bounds are fields rather than attributes, which getattr special-cases (see getSliceAttr):
+struct BoxedSlice : public Box {
     Box *start, *stop, *step;
-    BoxedSlice(Box *lower, Box *upper, Box *step) : HCBox(&slice_flavor, slice_cls), start(lower), stop(upper), step(step) {}
+    BoxedSlice(Box *lower, Box *upper, Box *step) : Box(&slice_flavor, slice_cls), start(lower), stop(upper), step(step) {}
 };
 
+// Returns NULL if attr isn't one of the bounds:
+Box* getSliceAttr(BoxedSlice* self, const char* attr);
+
 extern "C" void boxGCHandler(GCVisitor *v, void* p);
 
 }
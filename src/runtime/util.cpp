@@ -19,6 +19,25 @@
 
 namespace pyston {
 
+BoxedString* StringBuilder::finish() {
+    return new BoxedString(std::move(buf));
+}
+
+void writeBytes(FILE* f, const char* data, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+        size_t new_written = fwrite(data + written, 1, size - written, f);
+
+        if (!new_written) {
+            int error = ferror(f);
+            fprintf(stderr, "IOError %d\n", error);
+            raiseExc();
+        }
+
+        written += new_written;
+    }
+}
+
 void parseSlice(BoxedSlice* slice, int size, i64 *out_start, i64 *out_stop, i64 *out_step) {
     BoxedSlice *sslice = static_cast<BoxedSlice*>(slice);
 
@@ -33,16 +52,20 @@ void parseSlice(BoxedSlice* slice, int size, i64 *out_start, i64 *out_stop, i64
     RELEASE_ASSERT(stop->cls == int_cls || stop->cls == none_cls, "");
     RELEASE_ASSERT(step->cls == int_cls || step->cls == none_cls, "");
 
+    parseSliceBounds(size,
+            start->cls == int_cls ? static_cast<BoxedInt*>(start)->n : SLICE_BOUND_NONE,
+            stop->cls == int_cls ? static_cast<BoxedInt*>(stop)->n : SLICE_BOUND_NONE,
+            step->cls == int_cls ? static_cast<BoxedInt*>(step)->n : 1,
+            out_start, out_stop, out_step);
+}
+
+void parseSliceBounds(i64 size, i64 start, i64 stop, i64 step, i64 *out_start, i64 *out_stop, i64 *out_step) {
     int64_t istart;
     int64_t istop;
-    int64_t istep = 1;
-
-    if (step->cls == int_cls) {
-        istep = static_cast<BoxedInt*>(step)->n;
-    }
+    int64_t istep = step;
 
-    if (start->cls == int_cls) {
-        istart = static_cast<BoxedInt*>(start)->n;
+    if (start != SLICE_BOUND_NONE) {
+        istart = start;
         if (istart < 0)
             istart = size + istart;
     } else {
@@ -51,8 +74,8 @@ void parseSlice(BoxedSlice* slice, int size, i64 *out_start, i64 *out_stop, i64
         else
             istart = size - 1;
     }
-    if (stop->cls == int_cls) {
-        istop = static_cast<BoxedInt*>(stop)->n;
+    if (stop != SLICE_BOUND_NONE) {
+        istop = stop;
         if (istop < 0)
             istop = size + istop;
     } else {
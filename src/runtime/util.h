@@ -15,13 +15,54 @@
 #ifndef PYSTON_RUNTIME_UTIL_H
 #define PYSTON_RUNTIME_UTIL_H
 
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+
 #include "core/types.h"
 
 namespace pyston {
 
 class BoxedSlice;
+class BoxedString;
 
 void parseSlice(BoxedSlice* slice, int size, i64 *out_start, i64 *out_stop, i64 *out_end);
+// The same, for bounds that are already unboxed, with SLICE_BOUND_NONE for the ones that weren't given
+// (a missing step is just 1):
+const i64 SLICE_BOUND_NONE = INT64_MIN;
+void parseSliceBounds(i64 size, i64 start, i64 stop, i64 step, i64 *out_start, i64 *out_stop, i64 *out_step);
+
+// Writes all of the data (raising an IOError if that fails); used by file.write and print.
+void writeBytes(FILE* f, const char* data, size_t size);
+
+// For building up the contents of a new str: appends grow the buffer geometrically, and finish()
+// hands the buffer to the new BoxedString instead of copying it.
+class StringBuilder {
+    private:
+        std::string buf;
+
+    public:
+        StringBuilder(size_t reserve=0) {
+            if (reserve)
+                buf.reserve(reserve);
+        }
+
+        void append(const std::string &s) {
+            buf.append(s);
+        }
+        void append(const char* s, size_t n) {
+            buf.append(s, n);
+        }
+        void append(char c) {
+            buf.push_back(c);
+        }
+
+        size_t size() const {
+            return buf.size();
+        }
+
+        BoxedString* finish();
+};
 
 void raiseExc() __attribute__((__noreturn__));
 
@@ -32,9 +32,43 @@ test_load(PyObject *self, PyObject *args)
     return stored;
 }
 
+static PyObject *
+test_identity(PyObject *self, PyObject *arg)
+{
+    Py_INCREF(arg);
+    return arg;
+}
+
+static PyObject *
+test_nothing(PyObject *self, PyObject *unused)
+{
+    return Py_BuildValue("");
+}
+
+static PyObject *
+test_pick(PyObject *self, PyObject *args)
+{
+    int which;
+    PyObject* a;
+    PyObject* b = NULL;
+
+    if (!PyArg_ParseTuple(args, "iO|O:pick", &which, &a, &b))
+        return NULL;
+
+    if (which == 0 || !b) {
+        Py_INCREF(a);
+        return a;
+    }
+    Py_INCREF(b);
+    return b;
+}
+
 static PyMethodDef TestMethods[] = {
     {"store",  test_store, METH_VARARGS, "Store."},
     {"load",  test_load, METH_VARARGS, "Load."},
+    {"identity",  test_identity, METH_O, "Return the argument."},
+    {"nothing",  test_nothing, METH_NOARGS, "Return None."},
+    {"pick",  test_pick, METH_VARARGS, "Return the second argument, or the third if the first is nonzero."},
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
@@ -0,0 +1,42 @@
+# Exercises the interpreted tier: everything starts off in the AST interpreter, and then either
+# gets reoptimized after enough calls or OSRs out of its loops.
+
+class C(object):
+    def __init__(self, n):
+        self.n = n
+
+    def get(self):
+        return self.n
+
+def unpack(t):
+    a, b = t
+    return b, a
+
+def collect(n):
+    l = []
+    d = {}
+    for i in xrange(n):
+        l.append(i * 2)
+        d[i] = C(i).get()
+    return l[1:4], len(d), d[n - 1]
+
+def maybe_defined(n):
+    # y is only potentially defined at the top of the loop
+    for i in xrange(n):
+        if i > 3:
+            y = i
+    return y
+
+def boolops(x, y):
+    return (x and y), (x or y), not x
+
+print unpack((1, "two"))
+print collect(5)
+print collect(500)
+print maybe_defined(300)
+print boolops(0, 5), boolops(3, 0)
+
+total = 0
+for i in xrange(1000):
+    total = total + len(unpack((i, i)))
+print total, [1, 2.5, "s"], (1,), {"a": 1}
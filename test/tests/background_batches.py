@@ -0,0 +1,23 @@
+# run_args: -B -T batch_size=4,batch_window_ms=20
+# Background reopts that get queued together get compiled in one module; each function still has
+# to end up with its own version.
+
+def a(x):
+    return x + 1
+
+def b(x):
+    return x * 3
+
+def c(x):
+    return a(x) - b(x)
+
+def d(l, x):
+    l.append(c(x))
+    return len(l)
+
+l = []
+t = 0
+for i in xrange(30000):
+    t = t + a(i) + b(i) + c(i)
+    d(l, i)
+print t, len(l), l[-1]
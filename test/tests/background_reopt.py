@@ -0,0 +1,23 @@
+# run_args: -B
+# Functions get reoptimized on the background compile thread; results have to stay the same
+# while the old versions keep getting used and after the new ones get swapped in.
+
+def f(x):
+    return x * 2 + 1
+
+def g(l, x):
+    l.append(f(x))
+    return len(l)
+
+l = []
+t = 0
+for i in xrange(30000):
+    t = t + f(i)
+    g(l, i)
+print t, len(l), l[-1]
+
+def fib(n):
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+print fib(22)
@@ -0,0 +1,29 @@
+# Binops and comparisons on builtin types dispatch through a per-type-pair cache;
+# make sure the results (including mixed-type and reversed cases) are unaffected.
+
+class C(object):
+    def __init__(self, n):
+        self.n = n
+
+    def __add__(self, rhs):
+        return C(self.n + rhs)
+
+    def __radd__(self, lhs):
+        return C(lhs * 100 + self.n)
+
+    def __lt__(self, rhs):
+        return self.n < rhs
+
+def f(a, b):
+    return a + b, a - b, a * b
+
+def cmp(a, b):
+    return a == b, a != b, a < b, a <= b, a > b, a >= b
+
+for i in xrange(20):
+    print f(i, 3), f(i, 1.5), f(1.5, i), f(2.5, 0.5)
+    print cmp(i, 10), cmp(1.0 * i, 10), cmp(1.0 * i, 10.0)
+    print "a" + "b", "ab" * (i % 3), "a" == "a", "a" == "b"
+
+    c = C(i)
+    print (c + 1).n, (1 + c).n, c < 5
@@ -0,0 +1,24 @@
+# run_args: -T interpreted_calls=200,minimal_calls=50,moderate_calls=50
+# Boxes that only escape on some paths (or after a loop) still have to come out right.
+
+def f(n):
+    x = 0.0
+    t = 0
+    for i in xrange(n):
+        x = x + 1.5
+        t = t + i
+        if i % 37 == 0:
+            l = [x]
+    return x, t
+
+def g(n, o):
+    m = o.append
+    for i in xrange(n):
+        if i == n - 1:
+            m(i * 2)
+    return o
+
+for i in xrange(300):
+    r = f(i)
+    o = g(i, [])
+print r, o
@@ -0,0 +1,66 @@
+# Closures: reading variables of enclosing functions, including through a function that doesn't use them
+# itself, from methods, and after the enclosing function has changed them.  Called enough times to get
+# past the interpreter, and with a loop long enough to OSR.
+
+def outer(n):
+    def inner():
+        return n
+    return inner
+
+def adder(a, b):
+    c = a + b
+    def add(x):
+        return x + a + c
+    return add
+
+def grand(x):
+    y = x * 2
+    def middle():
+        def inner(z):
+            return x + y + z
+        return inner
+    return middle
+
+def late():
+    fs = []
+    for i in xrange(3):
+        def f():
+            return i
+        fs.append(f)
+    return fs
+
+def counter(start):
+    n = start
+    def get():
+        return n
+    n = n + 1
+    return get
+
+def withclass(v):
+    class C(object):
+        def m(self):
+            return v
+    return C()
+
+def looping(n):
+    t = 0
+    def step(i):
+        return i + n
+    for i in xrange(n):
+        t = t + step(i)
+    return t
+
+total = 0
+for i in xrange(1000):
+    total = total + outer(i)()
+    total = total + adder(1, 2)(i)
+    total = total + grand(1)()(i)
+    total = total + counter(i)()
+    total = total + withclass(i).m()
+print total
+
+print outer(5)(), adder(1, 2)(3), grand(1)()(2), counter(7)(), withclass(4).m()
+for f in late():
+    print f(),
+print
+print looping(20000)
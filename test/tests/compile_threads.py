@@ -0,0 +1,30 @@
+# run_args: -B -T compile_threads=3
+# Background compiles on several threads, each optimizing in its own llvm context.  The reopted
+# versions call into the runtime (and get inlined into) the same way as ones compiled on the main thread.
+
+class C(object):
+    def __init__(self, n):
+        self.n = n
+
+def f(x):
+    return (x, x + 1)[1] * 2
+
+def g(x):
+    c = C(x)
+    return c.n - 1
+
+def h(l, x):
+    l.append(str(x))
+    return len(l[-1])
+
+def k(x):
+    t = 0
+    for i in xrange(x):
+        t = t + f(i) - g(i)
+    return t
+
+l = []
+t = 0
+for i in xrange(20000):
+    t = t + f(i) + g(i) + h(l, i)
+print t, len(l), l[-1], k(1000)
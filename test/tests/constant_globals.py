@@ -0,0 +1,46 @@
+# Calls to global functions, classes and builtins from hot code, including after the global gets
+# rebound while the caller is running.
+
+def double(x):
+    return x * 2
+
+def triple(x):
+    return x * 3
+
+def fake_len(x):
+    return 100
+
+class C(object):
+    def __init__(self, x):
+        self.x = x
+
+def f(n):
+    t = 0
+    for i in xrange(n):
+        t = t + double(i) + C(i).x + len("abc") + abs(-i)
+    return t
+
+def g(n):
+    global double
+    t = 0
+    for i in xrange(n):
+        if i == n / 2:
+            double = triple
+        t = t + double(i)
+    return t
+
+def h(n):
+    global len
+    t = 0
+    for i in xrange(n):
+        if i == n / 2:
+            len = fake_len
+        t = t + len("ab")
+    return t
+
+for i in xrange(5):
+    print f(1000)
+print g(100000)
+print g(10)
+print h(100000)
+print h(10)
@@ -0,0 +1,30 @@
+# Exercise dict growth and lookups with int, str and other keys.
+
+d = {}
+for i in xrange(1000):
+    d[i] = i * 2
+    d[str(i)] = i
+t = 0
+for i in xrange(1000):
+    t = t + d[i] + d[str(i)]
+print t, len(d.keys()), len(d.values()), len(d.items())
+
+for i in xrange(0, 1000, 7):
+    d[i] = -i
+print d[0], d[7], d[8], d["999"]
+
+class C(object):
+    pass
+c1 = C()
+c2 = C()
+o = {}
+o[c1] = 1
+o[c2] = 2
+o["c"] = 3
+o[c1] = 5
+print o[c1], o[c2], o["c"], len(o.items())
+
+s = {}
+s[5] = "five"
+s[1] = "one"
+print sorted(s.keys()), sorted(s.values())
@@ -0,0 +1,34 @@
+# iterkeys/itervalues/iteritems walk the dict in place instead of building lists.
+
+d = {}
+for i in xrange(20):
+    d[i] = i * i
+
+t = 0
+for k in d.iterkeys():
+    t = t + k
+print t
+
+t = 0
+for v in d.itervalues():
+    t = t + v
+print t
+
+t = 0
+for k, v in d.iteritems():
+    t = t + k * v
+print t
+
+t = 0
+for k in d:
+    t = t + k
+print t
+
+it = {"a": 1}.iteritems()
+print it.next()
+
+# Changing the dict's size during the iteration is an error:
+d = {1: 1}
+for k in d.iterkeys():
+    d[k + 1] = k
+print "not reached"
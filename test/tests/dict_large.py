@@ -0,0 +1,20 @@
+# Big dicts: the bucket array and nodes should stay alive (and keep their contents alive)
+# across collections, however big they get.
+
+d = {}
+for i in xrange(100000):
+    d[i] = [i]
+
+l = []
+for i in xrange(100000):
+    l.append(str(i))
+
+t = 0
+for i in xrange(100000):
+    t = t + d[i][0]
+print len(d), t
+
+for i in xrange(0, 100000, 2):
+    d[i] = str(i)
+for i in xrange(0, 100000, 1000):
+    print d[i], d[i + 1]
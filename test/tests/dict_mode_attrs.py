@@ -0,0 +1,208 @@
+# Objects that get a lot of attributes switch over to storing them in a hash table;
+# make sure they keep working (and that setattr ICs on them work) after the switch.
+
+class C(object):
+    pass
+
+c = C()
+c.a0 = 0
+c.a1 = 1
+c.a2 = 2
+c.a3 = 3
+c.a4 = 4
+c.a5 = 5
+c.a6 = 6
+c.a7 = 7
+c.a8 = 8
+c.a9 = 9
+c.a10 = 10
+c.a11 = 11
+c.a12 = 12
+c.a13 = 13
+c.a14 = 14
+c.a15 = 15
+c.a16 = 16
+c.a17 = 17
+c.a18 = 18
+c.a19 = 19
+c.a20 = 20
+c.a21 = 21
+c.a22 = 22
+c.a23 = 23
+c.a24 = 24
+c.a25 = 25
+c.a26 = 26
+c.a27 = 27
+c.a28 = 28
+c.a29 = 29
+c.a30 = 30
+c.a31 = 31
+c.a32 = 32
+c.a33 = 33
+c.a34 = 34
+c.a35 = 35
+c.a36 = 36
+c.a37 = 37
+c.a38 = 38
+c.a39 = 39
+c.a40 = 40
+c.a41 = 41
+c.a42 = 42
+c.a43 = 43
+c.a44 = 44
+c.a45 = 45
+c.a46 = 46
+c.a47 = 47
+c.a48 = 48
+c.a49 = 49
+c.a50 = 50
+c.a51 = 51
+c.a52 = 52
+c.a53 = 53
+c.a54 = 54
+c.a55 = 55
+c.a56 = 56
+c.a57 = 57
+c.a58 = 58
+c.a59 = 59
+c.a60 = 60
+c.a61 = 61
+c.a62 = 62
+c.a63 = 63
+c.a64 = 64
+c.a65 = 65
+c.a66 = 66
+c.a67 = 67
+c.a68 = 68
+c.a69 = 69
+c.a70 = 70
+c.a71 = 71
+c.a72 = 72
+c.a73 = 73
+c.a74 = 74
+c.a75 = 75
+c.a76 = 76
+c.a77 = 77
+c.a78 = 78
+c.a79 = 79
+c.a80 = 80
+c.a81 = 81
+c.a82 = 82
+c.a83 = 83
+c.a84 = 84
+c.a85 = 85
+c.a86 = 86
+c.a87 = 87
+c.a88 = 88
+c.a89 = 89
+c.a90 = 90
+c.a91 = 91
+c.a92 = 92
+c.a93 = 93
+c.a94 = 94
+c.a95 = 95
+c.a96 = 96
+c.a97 = 97
+c.a98 = 98
+c.a99 = 99
+c.a100 = 100
+c.a101 = 101
+c.a102 = 102
+c.a103 = 103
+c.a104 = 104
+c.a105 = 105
+c.a106 = 106
+c.a107 = 107
+c.a108 = 108
+c.a109 = 109
+c.a110 = 110
+c.a111 = 111
+c.a112 = 112
+c.a113 = 113
+c.a114 = 114
+c.a115 = 115
+c.a116 = 116
+c.a117 = 117
+c.a118 = 118
+c.a119 = 119
+c.a120 = 120
+c.a121 = 121
+c.a122 = 122
+c.a123 = 123
+c.a124 = 124
+c.a125 = 125
+c.a126 = 126
+c.a127 = 127
+c.a128 = 128
+c.a129 = 129
+c.a130 = 130
+c.a131 = 131
+c.a132 = 132
+c.a133 = 133
+c.a134 = 134
+c.a135 = 135
+c.a136 = 136
+c.a137 = 137
+c.a138 = 138
+c.a139 = 139
+c.a140 = 140
+c.a141 = 141
+c.a142 = 142
+c.a143 = 143
+c.a144 = 144
+c.a145 = 145
+c.a146 = 146
+c.a147 = 147
+c.a148 = 148
+c.a149 = 149
+c.a150 = 150
+c.a151 = 151
+c.a152 = 152
+c.a153 = 153
+c.a154 = 154
+c.a155 = 155
+c.a156 = 156
+c.a157 = 157
+c.a158 = 158
+c.a159 = 159
+
+t = 0
+t = t + c.a0
+t = t + c.a7
+t = t + c.a14
+t = t + c.a21
+t = t + c.a28
+t = t + c.a35
+t = t + c.a42
+t = t + c.a49
+t = t + c.a56
+t = t + c.a63
+t = t + c.a70
+t = t + c.a77
+t = t + c.a84
+t = t + c.a91
+t = t + c.a98
+t = t + c.a105
+t = t + c.a112
+t = t + c.a119
+t = t + c.a126
+t = t + c.a133
+t = t + c.a140
+t = t + c.a147
+t = t + c.a154
+print t
+
+def f(o, v):
+    o.a5 = v
+    o.a150 = v
+    return o.a5 + o.a150 + o.a0
+
+for i in xrange(100):
+    f(c, i)
+print f(c, 1000)
+
+d = C()
+d.a0 = 1
+d.a5 = 2
+d.a150 = 3
+print f(d, 7)
@@ -0,0 +1,43 @@
+# Dicts whose keys are all strs, looked up by interned constants and by equal strings that got built at
+# runtime (which are different objects); then the same dicts once they've gotten a non-str key.
+
+def build(n):
+    d = {}
+    for i in xrange(n):
+        d["k" + str(i)] = i
+    return d
+
+d = build(200)
+print len(d), d["k0"], d["k199"], d["k" + "5" + "0"]
+print "k7" in d, "k200" in d, "" in d, 7 in d
+d["a"] = 1
+d["a" + ""] = 2
+d["ab"[:1]] = 3
+print len(d), d["a"]
+
+# Strings with the same hash bucket but different contents, and ones that only differ in length:
+e = {}
+e["x"] = 1
+e["xx"] = 2
+e["xxx"] = 3
+e["x" * 2] = 4
+print e["x"], e["xx"], e["xxx"], len(e)
+
+counts = {}
+for w in "the quick brown fox jumps over the lazy dog the end".split():
+    if w in counts:
+        counts[w] = counts[w] + 1
+    else:
+        counts[w] = 1
+print counts["the"], counts["fox"], len(counts)
+
+# Switching over to the general lookup:
+d[5] = "five"
+d[2.5] = "float"
+print d[5], d[2.5], d["k3"], d["k" + "3"], "k3" in d, 5 in d, 6 in d
+d["k3"] = 33
+print d["k3"], len(d)
+
+def kw(**kwargs):
+    return kwargs["a"] + kwargs["b"]
+print kw(a=1, b=2), kw(b=5, a=3)
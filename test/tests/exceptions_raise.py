@@ -0,0 +1,62 @@
+# try/finally runs the finally block on every way out of the body, and raise
+# builds its exception the same way as CPython.  (try/except, and raise inside
+# of a try/finally, get rejected until there's unwinding.)
+
+def f(x):
+    try:
+        if x == 0:
+            return "returned"
+        print "body", x
+    finally:
+        print "finally", x
+    return "fell through"
+
+print f(0)
+print f(1)
+
+def g():
+    i = 0
+    while i < 5:
+        i = i + 1
+        try:
+            if i == 2:
+                continue
+            if i == 4:
+                break
+            print "iteration", i
+        finally:
+            print "finally", i
+    return i
+
+print g()
+
+def h():
+    try:
+        try:
+            return 1
+        finally:
+            print "inner"
+    finally:
+        print "outer"
+
+print h()
+
+e = KeyError("key")
+print e.args, str(e), repr(e)
+print isinstance(e, KeyError), isinstance(e, IndexError)
+print isinstance(e, LookupError), isinstance(e, StandardError), isinstance(e, Exception), isinstance(e, BaseException)
+print isinstance(StopIteration(), StandardError), isinstance(NotImplementedError(), RuntimeError)
+print isinstance(ZeroDivisionError(), ArithmeticError), isinstance(SystemExit(), Exception)
+e = ValueError("a", 2)
+print e.args, str(e), repr(e)
+print str(ValueError()), repr(StopIteration())
+print KeyError.__name__, KeyError.__module__
+
+def raises(x):
+    if x:
+        raise ValueError, "not raised"
+    return "didn't raise"
+
+print raises(0)
+
+raise KeyError("missing")
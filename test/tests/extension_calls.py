@@ -0,0 +1,13 @@
+# Calls to METH_O and METH_NOARGS extension functions (which don't build an argument tuple), and
+# PyArg_ParseTuple with optional arguments, called enough times to get rewritten.
+import test
+
+n = 0
+for i in xrange(10000):
+    n = n + test.identity(i)
+    test.nothing()
+    n = n + test.pick(1, 0, 1) + test.pick(0, 1)
+print n
+
+print test.identity("hi"), test.nothing()
+print test.pick(0, "a"), test.pick(0, "a", "b"), test.pick(1, "a", "b")
@@ -0,0 +1,19 @@
+# Files that become garbage get closed by their finalizers; without that,
+# this would run out of file descriptors.
+
+def f():
+    for i in xrange(5000):
+        fd = open("/dev/null")
+        l = []
+        for j in xrange(20):
+            l.append(str(i))
+    print "done"
+f()
+
+# Strings and tuples get finalized too:
+t = 0
+for i in xrange(100000):
+    s = str(i) * 10
+    tup = (s, i)
+    t = t + len(tup[0])
+print t
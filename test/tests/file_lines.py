@@ -0,0 +1,28 @@
+# readline/readlines/line iteration over the buffered file reader.
+
+fn = "/tmp/pyston_test_file_lines.txt"
+f = open(fn, "w")
+for i in xrange(1000):
+    f.write("line " + str(i) + "\n")
+f.write("no newline at the end")
+f.close()
+
+f = open(fn)
+print repr(f.readline()), repr(f.readline())
+print repr(f.read(6))
+print repr(f.readline())
+n = 0
+for l in f:
+    n = n + 1
+print n, repr(l)
+print repr(f.readline()), repr(f.read())
+f.close()
+
+# Tiny buffers have to be refilled in the middle of lines:
+f = open(fn, "r", 3)
+lines = f.readlines()
+print len(lines), repr(lines[0]), repr(lines[-2]), repr(lines[-1])
+f.close()
+
+with open(fn, "r", 1 << 20) as f:
+    print len(f.read())
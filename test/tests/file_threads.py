@@ -0,0 +1,40 @@
+# Several threads reading lines from the same file object: the reads let go of the GIL, so they have to
+# take turns with the file's buffer.  Every line should get read exactly once.
+
+import thread
+import time
+
+fn = "/tmp/pyston_test_file_threads.txt"
+f = open(fn, "w")
+for i in xrange(20000):
+    f.write(str(i) + "\n")
+f.close()
+
+nthreads = 4
+counts = [0] * nthreads
+totals = [0] * nthreads
+done = [0]
+
+f = open(fn, "r", 7)
+def work(n):
+    while True:
+        l = f.readline()
+        if not l:
+            break
+        counts[n] = counts[n] + 1
+        totals[n] = totals[n] + int(l)
+    done[0] = done[0] + 1
+
+for i in xrange(nthreads):
+    thread.start_new_thread(work, (i,))
+
+while done[0] < nthreads:
+    time.sleep(0.01)
+f.close()
+
+c = 0
+t = 0
+for i in xrange(nthreads):
+    c = c + counts[i]
+    t = t + totals[i]
+print c, t
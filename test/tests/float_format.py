@@ -0,0 +1,12 @@
+# repr() of floats is the shortest string that round-trips; str() rounds to 12 digits.
+
+for x in [0.1, 0.1 + 0.2, 1.0, -2.5, 1e16, 1e15, 1e-5, 1e-4, 1e22, 1e23, 123456789012345678.0,
+          2.0 / 3, 1.0 / 7, 5e-324, 1.7976931348623157e308, 0.0, -0.0, 100.0, 3.14159]:
+    print repr(x), str(x), x
+
+print float("1.5"), float(" -2e3 "), float("0.1"), repr(float("0.30000000000000004"))
+print float("123456789012345678901234567890"), float(".5"), float("5.")
+print repr(float("1e400")), float("inf"), float("-inf")
+
+for n in [0, 5, -5, 10, 99, 100, 123456789, -9223372036854775807 - 1]:
+    print n, str(n), repr(n)
@@ -0,0 +1,28 @@
+# run_args: -I
+# Keep a lot of data alive and keep changing it, so that full collections happen
+# with incremental marking while old objects are getting new pointers stored into them.
+
+class Node(object):
+    def __init__(self, n):
+        self.n = n
+        self.next = None
+
+d = {}
+l = []
+for i in xrange(200000):
+    n = Node(i)
+    d[i % 5000] = n
+    l.append(n)
+    if i % 3 == 0:
+        l[i // 2].next = Node(-i)
+
+t = 0
+for n in l:
+    t = t + n.n
+    if n.next is not None:
+        t = t + n.next.n
+print t
+s = 0
+for n in d.values():
+    s = s + n.n
+print s
@@ -0,0 +1,48 @@
+# run_args: -O
+# Jitted frames get their roots from stackmaps, and everything else gets scanned conservatively; make sure
+# that collections which happen while the only reference to an object is in a jitted frame, or in a runtime
+# frame that called back into jitted code, don't free it.
+
+class C(object):
+    def __init__(self, n):
+        self.n = n
+        self.s = str(n)
+
+def churn(n):
+    l = []
+    for i in xrange(n):
+        l.append([i, str(i)])
+    return len(l)
+
+class Key(object):
+    def __init__(self, n):
+        self.n = n
+
+    def __hash__(self):
+        # While this runs, the value that's being stored is only referenced by the dict's setitem:
+        churn(20000)
+        return self.n
+
+    def __eq__(self, other):
+        return self.n == other.n
+
+def held_by_jitted_frame(n):
+    c = C(n)
+    churn(20000)
+    return c.n + len(c.s)
+
+def held_by_runtime_frame(d, n):
+    d[Key(n)] = C(n * 10)
+
+t = 0
+for i in xrange(50):
+    t = t + held_by_jitted_frame(i)
+print t
+
+d = {}
+for i in xrange(20):
+    held_by_runtime_frame(d, i)
+t = 0
+for k, v in d.items():
+    t = t + k.n + v.n + len(v.s)
+print t
@@ -0,0 +1,32 @@
+# run_args: -n
+# statcheck: stats["slowpath_getglobal"] <= 60
+
+# getGlobal ICs embed the value they found; make sure that they notice when
+# the global (or a builtin it resolved to) gets assigned to.
+
+x = 1
+def f():
+    return x
+
+def g():
+    return len([1, 2, 3])
+
+t = 0
+for i in xrange(1000):
+    t = t + f() + g()
+    if i == 500:
+        x = 10
+print t
+
+def len(l):
+    return 100
+print g()
+
+# This one keeps changing, so eventually it should stop getting embedded:
+y = 0
+def h():
+    return y
+for i in xrange(100):
+    y = i
+    t = t + h()
+print t
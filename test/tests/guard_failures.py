@@ -0,0 +1,27 @@
+# run_args: -T interpreted_calls=2,minimal_calls=200,moderate_calls=100000
+# A speculation that stops being true should keep working (through the deopt path), and once
+# its guard has failed enough times the function gets recompiled without it.
+
+class C(object):
+    pass
+
+def get(o):
+    return o.v
+
+def f(o):
+    return get(o) + get(o)
+
+c = C()
+c.v = 1
+t = 0
+for i in xrange(1000):
+    t = t + f(c)
+print t
+
+c.v = "ab"
+for i in xrange(1000):
+    s = f(c)
+print s
+
+c.v = 2.5
+print f(c)
@@ -0,0 +1,67 @@
+# Writes a heap dump from python, and checks that it's self-consistent: everything that gets pointed to
+# has its own record, and the objects that are kept alive by the globals are in it.
+# (This is pyston-only, hence the .expected file.)
+
+import pyston_stats
+
+class Node(object):
+    pass
+
+class Leaf(object):
+    pass
+
+def make_chain(n):
+    head = None
+    for i in xrange(n):
+        c = Node()
+        c.next = head
+        c.leaf = Leaf()
+        head = c
+    return head
+
+def make_garbage(n):
+    for i in xrange(n):
+        Leaf()
+
+chain = make_chain(100)
+# This shouldn't be in the dump, except maybe for a few that are still on the stack somewhere (the
+# stacks get scanned conservatively):
+make_garbage(1000)
+
+fn = "/tmp/pyston_test_heap_dump.txt"
+nobjs = pyston_stats.dump_heap(fn)
+
+f = open(fn)
+print f.readline().strip()
+types = {}
+objs = {}
+pointed_to = []
+nroots = 0
+nrecords = 0
+for l in f:
+    w = l.split()
+    if w[0] == "t":
+        types[w[1]] = w[2]
+    if w[0] == "r":
+        nroots = nroots + 1
+    if w[0] == "o":
+        nrecords = nrecords + 1
+        objs[w[1]] = types[w[3]]
+        for e in w[5:]:
+            pointed_to.append(e)
+f.close()
+
+print nrecords == nobjs, nroots > 0
+missing = 0
+for e in pointed_to:
+    if not e in objs:
+        missing = missing + 1
+print missing
+
+counts = {}
+for name in objs.values():
+    if name in counts:
+        counts[name] = counts[name] + 1
+    else:
+        counts[name] = 1
+print counts["Node"], counts["Leaf"] >= 100, counts["Leaf"] < 200
@@ -0,0 +1,47 @@
+# Hidden classes that no object has anymore get collected, along with the ICs that guarded on them;
+# make sure that the same attribute orders still work (and get new hidden classes) afterwards.
+
+class C(object):
+    pass
+
+def make(i):
+    o = C()
+    k = i % 4
+    if k == 0:
+        o.a = i
+        o.b = 1
+        o.c = 2
+    if k == 1:
+        o.b = 1
+        o.a = i
+        o.c = 2
+    if k == 2:
+        o.c = 2
+        o.b = 1
+        o.a = i
+    if k == 3:
+        o.c = 2
+        o.a = i
+        o.b = 1
+    return o
+
+def total(o):
+    return o.a + o.b + o.c
+
+def churn(n):
+    l = []
+    for i in xrange(n):
+        l.append([i, str(i)])
+    return len(l)
+
+for round in xrange(5):
+    t = 0
+    for i in xrange(2000):
+        t = t + total(make(i))
+    print round, t
+    # Allocate enough to get collections in, while none of the C's are alive:
+    print churn(100000)
+
+kept = make(5)
+print churn(100000)
+print total(kept), total(make(6)), total(make(7))
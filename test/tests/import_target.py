@@ -0,0 +1,6 @@
+# Gets imported by imports.py (and runs as a test of its own too).
+print "running import_target as", __name__
+
+x = 5
+def f(n):
+    return n + x
@@ -0,0 +1,12 @@
+# Importing a module from a .py file next to the main one: it only runs once, and later imports
+# (including ones under another name, or from inside a function) get the same module.
+import import_target
+import import_target as again
+
+print import_target.x, import_target.f(1), again is import_target
+
+def g():
+    import import_target
+    import_target.x = 10
+    return import_target.f(2)
+print g(), again.x
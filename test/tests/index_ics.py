@@ -0,0 +1,23 @@
+# Indexing lists (of objects and of unboxed ints) and tuples from the same sites, with negative indices
+# and lists that change size or element type in between, enough times for the ICs to get rewritten.
+
+def get(c, i):
+    return c[i]
+
+objs = ["a", "b", "c"]
+ints = range(5)
+t = (1, "x", 2.5)
+
+total = 0
+s = ""
+for i in xrange(3000):
+    total = total + get(ints, i % 5) + get(ints, -1)
+    s = get(objs, i % 3) + get(objs, -2)
+    total = total + get(t, 0) + len(get(t, 1)) + get(t, -3)
+    if i == 1000:
+        ints.append(5)
+        objs.append("d")
+    if i == 2000:
+        ints[0] = "zero"
+        ints[0] = 0
+print total, s, get(ints, 5), get(objs, 3), get(t, -1), get(t, 2)
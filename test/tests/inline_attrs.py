@@ -0,0 +1,38 @@
+# Instances of a class get sized to fit the attributes that __init__ sets;
+# make sure objects that end up with more or fewer attributes still work.
+
+class C(object):
+    def __init__(self, n):
+        self.a = n
+        if n > 1:
+            self.b = n * 2
+            self.c = n * 3
+
+def total(o):
+    return o.a + o.b + o.c
+
+objs = []
+for n in [0, 2, 3, 1, 5]:
+    o = C(n)
+    if n <= 1:
+        o.b = 10
+        o.c = 20
+    objs.append(o)
+
+for o in objs:
+    o.d = 1
+    o.e = 2
+    o.f = 3
+    o.g = 4
+    o.h = 5
+    o.i = 6
+    o.j = 7
+    o.k = 8
+    o.b = -o.b
+
+for i in xrange(100):
+    for o in objs:
+        o.a = o.a + 1
+
+for o in objs:
+    print o.a, o.b, o.c, total(o), o.d + o.e + o.f + o.g + o.h + o.i + o.j + o.k
@@ -0,0 +1,49 @@
+# run_args: -T interpreted_calls=2,minimal_calls=5,moderate_calls=100000
+# str == and != between known strs, and dict lookups with str keys, go through fast paths in the inline
+# stdlib; run them enough to get to the moderate tier, which now inlines, and check that the cases that
+# fall off the fast paths still work.
+
+def streq(n):
+    t = 0
+    a = "hello"
+    b = "hel" + "lo"
+    c = "help"
+    for i in xrange(n):
+        if a == b:
+            t = t + 1
+        if a != c:
+            t = t + 10
+        if a == "hello":
+            t = t + 100
+        if "" == a[:0]:
+            t = t + 1000
+        if a == a + "!":
+            t = t - 100000
+    return t
+for i in xrange(20):
+    r = streq(5)
+print r
+
+print "abc".__eq__("abc"), "abc".__eq__("abd"), "abc" == 1, 1 == "abc"
+print "x" * 3 == "xxx", "x" * 3 != "xxx", "ab" == "abc"
+
+def lookup(d, keys):
+    t = 0
+    for k in keys:
+        if k in d:
+            t = t + d[k]
+    return t
+
+d = {"a": 1, "b": 2, "c" * 2: 3}
+keys = ["a", "b", "cc", "c" + "c", "zz"]
+for i in xrange(20):
+    r = lookup(d, keys)
+print r
+
+d[5] = 50
+keys.append(5)
+for i in xrange(20):
+    r = lookup(d, keys)
+print r
+
+print lookup({}, ["a"]), lookup({(1, 2): 7}, [(1, 2)])
@@ -0,0 +1,37 @@
+# Unboxed int //, % and ** with constant divisors (powers of two and not), variable ones, negative
+# operands on either side, and small constant exponents, in loops long enough to get compiled.
+
+def const_divs(n):
+    t = 0
+    for i in xrange(n):
+        j = i - 5000
+        t = t + j // 8 + j % 8 + j // 7 + j % 7 + j // -4 + j % -4 + j // -3 + j % -3
+        t = t + j // 1 + j % 1 + j // -1 + j % -1
+    return t
+
+def var_divs(n):
+    t = 0
+    for i in xrange(n):
+        j = i - 5000
+        d = (i % 13) - 6
+        if d == 0:
+            d = 9
+        t = t + j // d + j % d + d // 3 + (-d) % 5
+    return t
+
+def pows(n):
+    t = 0
+    for i in xrange(n):
+        j = (i % 200) - 100
+        t = t + j ** 0 + j ** 1 + j ** 2 + j ** 3 + (j % 10) ** 7 + 2 ** (i % 20)
+    return t
+
+print const_divs(10000)
+print var_divs(10000)
+print pows(10000)
+
+for a in [7, -7, 0, 1, -1, 100]:
+    for b in [2, -2, 3, -3, 1, -1, 16]:
+        print a // b, a % b,
+    print
+print 3 ** 0, 0 ** 0, (-2) ** 5, 10 ** 15, 2 ** 62
@@ -0,0 +1,36 @@
+# run_args: -T interpreted_calls=2,minimal_calls=5,moderate_calls=20
+# Once these are hot, the int math in them is done unboxed; when it overflows, it has to come out as a long
+# (by getting redone boxed and deopting) rather than raising or wrapping.
+
+def fact(n):
+    r = 1
+    for i in xrange(1, n + 1):
+        r = r * i
+    return r
+
+def add_up(n, x):
+    t = 0
+    for i in xrange(n):
+        t = t + x
+    return t
+
+def poly(x, n):
+    return x ** 3 - x ** n + x * x
+
+def sum_from(start, n):
+    return sum(xrange(start, start + n))
+
+t = 0
+for i in xrange(100):
+    t = t + fact(5) + add_up(i, 3) + poly(i, 2) + sum_from(i, 10)
+print t
+
+print fact(20), fact(21), fact(25)
+print add_up(3, 4611686018427387904), add_up(3, -4611686018427387904)
+print poly(3000000, 2), poly(3000000000, 2), poly(-3000000000, 3)
+print sum_from(4611686018427387904, 4), sum_from(-4611686018427387904, 4)
+
+# And it keeps working after the deopts:
+for i in xrange(100):
+    t = t + fact(22) % 1000 + sum_from(4611686018427387904, 2) % 1000
+print t
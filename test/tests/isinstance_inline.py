@@ -0,0 +1,51 @@
+# isinstance() against classes that are globals, run enough times to get compiled at the top tier, with
+# arguments whose types are known (unboxed ints and floats, literals) and ones that aren't.
+
+class C(object):
+    pass
+
+class D(object):
+    pass
+
+def classify(x):
+    if isinstance(x, int):
+        return 1
+    if isinstance(x, float):
+        return 2
+    if isinstance(x, str):
+        return 3
+    if isinstance(x, C):
+        return 4
+    if isinstance(x, list):
+        return 5
+    return 6
+
+def known(n):
+    t = 0
+    for i in xrange(n):
+        f = i * 0.5
+        if isinstance(i, int):
+            t = t + 1
+        if isinstance(f, int):
+            t = t + 100
+        if isinstance(f, float):
+            t = t + 2
+        if isinstance("s", str):
+            t = t + 3
+        b = isinstance(i, C)
+        if b:
+            t = t + 1000
+    return t
+
+objs = [1, 2.5, "a", C(), [1], D(), None]
+counts = [0, 0, 0, 0, 0, 0, 0]
+for i in xrange(20000):
+    k = classify(objs[i % len(objs)])
+    counts[k] = counts[k] + 1
+print counts
+print known(20000)
+
+# Rebinding one of the class names has to be picked up by the code that was compiled against it:
+C = D
+print classify(D()), classify(objs[3])
+print isinstance(3, int), isinstance(3, float), isinstance(C(), D)
@@ -0,0 +1,55 @@
+# For loops step their iterator with one call that returns the next value or the end; make sure that
+# works for the builtin iterators, user-defined ones, and a mix of them at the same loop.
+
+class Countdown(object):
+    def __init__(self, n):
+        self.n = n
+
+    def __iter__(self):
+        return self
+
+    def __hasnext__(self):
+        return self.n > 0
+
+    def next(self):
+        if self.n <= 0:
+            # (only CPython gets here, since it doesn't use __hasnext__: this raises StopIteration)
+            return [].__iter__().next()
+        self.n = self.n - 1
+        return self.n
+
+def total(it):
+    t = 0
+    for x in it:
+        t = t + x
+    return t
+
+def first_big(it, limit):
+    for x in it:
+        if x > limit:
+            break
+    else:
+        return -1
+    return x
+
+n = 0
+for i in xrange(2000):
+    n = n + total(range(10)) + total(xrange(i % 7)) + total(Countdown(5))
+    n = n + total({1: 2, 3: 4}) + total([])
+print n
+
+for i in xrange(1000):
+    n = first_big(Countdown(20), 15) + first_big([1, 5, 9], 100) + first_big(xrange(10), 3)
+print n
+
+pairs = []
+for a in Countdown(3):
+    for b in [10, 20]:
+        pairs.append(a * b)
+print pairs
+
+d = {"a": 1}
+for k in d:
+    print k, d[k]
+for k, v in d.items():
+    print k, v
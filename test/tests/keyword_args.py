@@ -0,0 +1,46 @@
+# Keyword arguments, defaults, *args and **kwargs, called enough times to get past the interpreter.
+
+def f(a, b, c=3, d=4):
+    return a * 1000 + b * 100 + c * 10 + d
+
+def va(a, *rest):
+    return a + len(rest)
+
+def kw(a, **extra):
+    return a * 10 + len(extra)
+
+n = 5
+def late(x=n):
+    return x
+n = 6
+
+class C(object):
+    def __init__(self, x, y=2):
+        self.x = x
+        self.y = y
+
+    def m(self, a, b=10):
+        return self.x + self.y + a + b
+
+total = 0
+for i in xrange(1000):
+    total = total + f(1, 2)
+    total = total + f(1, 2, 5)
+    total = total + f(b=1, a=2)
+    total = total + f(1, 2, d=7, c=8)
+    total = total + va(1) + va(1, 2, 3)
+    total = total + kw(1) + kw(2, x=1, y=2)
+    c = C(1, y=5)
+    total = total + c.m(1) + c.m(a=2, b=3)
+print total
+
+print f(1, 2), f(1, 2, 5), f(b=1, a=2), f(1, 2, d=7, c=8)
+print va(1), va(1, 2, 3)
+print kw(1), kw(2, x=1, y=2)
+print late(), late(x=1)
+c = C(x=3)
+print c.x, c.y, c.m(b=1, a=0)
+
+def show(*args, **kwargs):
+    print args, kwargs["k"]
+show(1, 2, k=3)
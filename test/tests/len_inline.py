@@ -0,0 +1,47 @@
+# len() of the builtin containers, both when their types are known and when they aren't, run enough
+# times to get compiled at the top tier; then on other classes with __len__, and after len gets rebound.
+
+class C(object):
+    def __len__(self):
+        return 7
+
+def total(objs, n):
+    t = 0
+    for i in xrange(n):
+        t = t + len(objs[i % len(objs)])
+    return t
+
+def known(n):
+    l = [1, 2, 3]
+    s = "hello"
+    d = {1:2}
+    t = 0
+    for i in xrange(n):
+        t = t + len(l) + len(s) + len(d) + len((1, 2))
+    return t
+
+def loop(l):
+    t = 0
+    for i in range(len(l)):
+        t = t + l[i]
+    return t
+
+objs = [[1, 2], (1, 2, 3), {1:2, 3:4, 5:6, 7:8}, "abcde", "", [], C()]
+print total(objs, 20000)
+print known(20000)
+l = range(100)
+for i in xrange(1000):
+    s = loop(l)
+print s
+print len(objs), len(objs[0]), len(C())
+
+def f(x):
+    return len(x)
+for i in xrange(10000):
+    f("abc")
+print f([1]), f(C()), f(objs[2])
+
+def badlen():
+    return 5
+len = badlen
+print len()
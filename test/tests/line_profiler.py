@@ -0,0 +1,55 @@
+# Turning the line profiler on and off from python, for functions that are already compiled (and get swapped
+# over to instrumented code and back) and for ones that haven't been called yet.
+# (This is pyston-only, hence the .expected file.)
+
+import pyston_stats
+
+def work(n):
+    t = 0
+    i = 0
+    while i < n:
+        t = t + i
+        i = i + 1
+    return t
+
+def other(n):
+    return n + 1
+
+def later(n):
+    return n * 2
+
+def hits(fname):
+    r = []
+    for e in pyston_stats.line_profile_report():
+        if e[1] == fname:
+            r.append(e)
+    counts = []
+    for lineno in xrange(1, 30):
+        for e in r:
+            if e[2] == lineno:
+                counts.append((lineno, e[3], e[4] >= 0))
+    return counts
+
+for i in xrange(5000):
+    work(10)
+    other(i)
+
+pyston_stats.line_profile_start(["work", "later"])
+print work(100), other(1), later(3)
+pyston_stats.line_profile_stop()
+print hits("work")
+print hits("other")
+print hits("later")
+
+# Not profiling any more, so these don't change the report:
+print work(5), later(4)
+print hits("work")
+print hits("later")
+
+# Profiling everything, starting over from zero:
+pyston_stats.line_profile_start(None)
+for i in xrange(3):
+    other(i)
+pyston_stats.line_profile_stop()
+print hits("work")
+print hits("other")
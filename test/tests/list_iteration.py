@@ -0,0 +1,29 @@
+# For-loops over lists check the iterator position inline; make sure they still see
+# the list's current size and work for all the element strategies.
+
+def f(l):
+    t = 0
+    for x in l:
+        t = t + x
+    return t
+
+print f(range(100))
+print f([1.5, 2.5, 3.0])
+print f([1, 2.5, 3])
+
+l = [1, 2, 3]
+n = 0
+for x in l:
+    n = n + 1
+    if len(l) < 6:
+        l.append(x)
+print n, l
+
+for x in []:
+    print "never"
+
+l = ["a", "b"]
+it = l.__iter__()
+print it.next(), it.next()
+for x in it:
+    print "never"
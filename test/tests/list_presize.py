@@ -0,0 +1,42 @@
+# List literals and list * n get their storage allocated up front; appends after that still have to handle
+# growing the list and switching its element strategy.
+
+l = [1, 2, 3]
+l.append(4)
+l.append(5.5)
+print l, len(l)
+
+l = [1.5, 2.5]
+l.append(3.5)
+l.append("x")
+print l
+
+l = ["a", 1, 2.0, None]
+for i in xrange(20):
+    l.append(i)
+print l, len(l)
+
+print [] * 3, [1] * 0, [1] * -2, [1, 2] * 1
+print [0] * 5, [1.5, 2] * 3, ["a", 1] * 2
+l = [7] * 4
+l.append(8)
+l.append("y")
+l[0] = 3.5
+print l
+
+l = [[]] * 3
+l[0].append(1)
+print l
+
+def f(x):
+    return [x, x + 1, x + 2]
+t = 0
+for i in xrange(1000):
+    l = f(i)
+    l.append(i)
+    t = t + len(l) + l[3]
+print t
+
+def g(*args):
+    return len(args)
+print g(), g(1), g(1, 2, 3, 4, 5)
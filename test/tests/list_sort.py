@@ -0,0 +1,33 @@
+# sorted() and list.sort() on homogeneous, unboxed and mixed lists.
+
+l = [5, 3, 8, 1, 9, 2] * 20
+l.sort()
+print l[:10], l[-3:]
+
+f = []
+for i in xrange(100):
+    f.append(((i * 37) % 101) * 0.5)
+print sorted(f)[:5], sorted(f)[-2:]
+
+s = ["pear", "apple", "fig", "banana", "apple"]
+print sorted(s), s
+
+class C(object):
+    def __init__(self, k, tag):
+        self.k = k
+        self.tag = tag
+
+    def __lt__(self, rhs):
+        return self.k < rhs.k
+
+cs = []
+for i in xrange(200):
+    cs.append(C(i % 7, i))
+cs.sort()
+tags = []
+for c in cs[:12]:
+    tags.append(c.tag)
+print tags
+
+m = [3, 1.5, 2, 0.5]
+print sorted(m), sorted(range(100, 0, -1))[:5], sorted([])
@@ -0,0 +1,33 @@
+# Lists of only ints or only floats store their elements unboxed; make sure
+# they switch over correctly when something else gets stored.
+
+l = range(5)
+print l, l[2], sorted([3, 1, 2])
+l.append(5)
+l[0] = 10
+print l
+l[1] = 1.5
+l.append("hi")
+print l, l.pop(), l.pop(0), l
+
+f = []
+for i in xrange(10):
+    f.append(i * 0.5)
+t = 0.0
+for x in f:
+    t = t + x
+print f, t, sorted([2.5, 0.5, 1.5])
+f.insert(3, None)
+print f
+
+m = [1, 2, 3]
+m[1:2] = [1.0, 2.0]
+print m
+e = [7]
+e[0:1] = [4.0, 5.0]
+e.append(6.0)
+print e, e * 2
+
+c = [1, 2]
+c.insert(0, "x")
+print c, [1.5] * 3, len(c)
@@ -0,0 +1,51 @@
+# Indexing loops over lists of floats and of ints (dot products, elementwise updates), run long enough to
+# get compiled at the top tier; then the same functions on lists that switched to storing objects, and with
+# negative and out-of-order indices.
+
+def dot(a, b, n):
+    t = 0.0
+    for i in xrange(n):
+        t = t + a[i] * b[i]
+    return t
+
+def axpy(k, x, y, n):
+    for i in xrange(n):
+        y[i] = y[i] + k * x[i]
+
+def isum(l, n):
+    t = 0
+    for i in xrange(n):
+        t = t + l[i]
+    return t
+
+def iscale(l, n):
+    for i in xrange(n):
+        l[i] = l[i] * 3
+
+n = 1000
+a = []
+b = []
+c = []
+for i in xrange(n):
+    a.append(i * 0.5)
+    b.append(1.0 / (i + 1))
+    c.append(i)
+
+for it in xrange(30):
+    d = dot(a, b, n)
+    axpy(0.25, b, a, n)
+    s = isum(c, n)
+print d, s
+print a[0], a[1], a[999], dot(a, a, n)
+
+for it in xrange(5):
+    iscale(c, 100)
+print c[0], c[1], c[99], c[100], isum(c, n)
+
+# The lists stop being all-floats / all-ints:
+b[500] = 7
+print dot(a, b, n)
+c[3] = 2.5
+print isum(c, n)
+a[10] = "x"
+print a[10], a[-1], b[-2], c[-997]
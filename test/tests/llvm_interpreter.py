@@ -0,0 +1,19 @@
+# run_args: -l
+# Runs the interpreted tier through the LLVM IR interpreter, allocating enough that collections
+# happen while values are only reachable from an interpreter frame.
+
+def build(n):
+    l = []
+    for i in xrange(n):
+        l.append(str(i) + "x")
+    return l
+
+def f(a, b, c, d, e):
+    s = 0.0
+    for x in (a, b, c, d, e):
+        s = s + x
+    return s
+
+l = build(20000)
+print len(l), l[0], l[-1]
+print f(1, 2.5, 3, 4, 5.5)
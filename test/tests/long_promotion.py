@@ -0,0 +1,37 @@
+# Boxed int arithmetic promotes to long instead of wrapping when it overflows.
+
+def mul(a, b):
+    return a * b
+
+def add(a, b):
+    return a + b
+
+def sub(a, b):
+    return a - b
+
+def fact(n, one):
+    r = one
+    for i in xrange(1, n + 1):
+        r = mul(r, i)
+    return r
+
+big = mul(4611686018427387904, 4)
+print big, repr(big)
+print add(9223372036854775807, 1), sub(-9223372036854775807, 2)
+print fact(30, 1)
+print repr(fact(25, 1) / mul(1000000007, 1)), fact(25, 1) % 1000000007
+print -fact(21, 1), fact(21, 1) // -7, fact(21, 1) % -7
+print mul(fact(20, 1), fact(20, 1)) / fact(20, 1) == fact(20, 1)
+
+x = fact(22, 1)
+print x > 5, 5 < x, x < 5, x >= x, x == x + 0, x != x, x == fact(22, 1)
+print sub(x, x), repr(sub(x, x)), add(x, -x) == 0
+print hash(long(5)) == hash(5), long(5) == 5, repr(long(-12)), long("123456789012345678901234567890")
+print long(1e20), long(-2.5), repr(long(7))
+
+d = {}
+d[long(3)] = "three"
+print d[3]
+
+print mul(2, 1) ** 100, mul(-3, 1) ** 41
+print sorted([fact(21, 1), 3, -fact(22, 1), 2.5])
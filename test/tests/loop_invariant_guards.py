@@ -0,0 +1,51 @@
+# Locals that a loop uses but doesn't change get their class checked once before the loop; make sure
+# that still does the right thing when the class changes between calls, when the loop rebinds the
+# name, and for names that aren't definitely defined before the loop.
+
+class P(object):
+    def __init__(self, x):
+        self.x = x
+
+    def m(self, i):
+        return self.x + i
+
+class Q(object):
+    def __init__(self, x):
+        self.x = x
+
+    def m(self, i):
+        return self.x * i
+
+def run(objs, n):
+    p = objs[0]
+    t = 0
+    for i in xrange(n):
+        t = t + p.m(i) + p.x
+    return t
+
+def rebinds(objs, n):
+    p = objs[0]
+    t = 0
+    i = 0
+    while i < n:
+        t = t + p.m(i)
+        p = objs[i % 2]
+        i = i + 1
+    return t
+
+def maybe_defined(flag, n):
+    if flag:
+        q = P(1)
+    t = 0
+    for i in xrange(n):
+        if flag:
+            t = t + q.m(i)
+    return t
+
+total = 0
+for k in xrange(100):
+    total = total + run([P(k)], 1000)
+print total
+print run([Q(3)], 1000), run([P(3)], 1000)
+print rebinds([P(1), Q(2)], 1000)
+print maybe_defined(True, 100), maybe_defined(False, 100)
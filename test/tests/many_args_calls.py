@@ -0,0 +1,30 @@
+# Calls with more than three arguments, to functions and to methods, from call sites that get rewritten.
+
+def f4(a, b, c, d):
+    return a + b * c - d
+
+def f8(a, b, c, d, e, f, g, h):
+    return a + b + c + d + e + f + g + h
+
+class C(object):
+    def __init__(self, a, b, c, d):
+        self.s = a + b + c + d
+
+    def m3(self, a, b, c):
+        return self.s + a + b + c
+
+    def m5(self, a, b, c, d, e):
+        return self.s * a + b + c + d + e
+
+t = 0
+for i in xrange(1000):
+    t = t + f4(i, 2, 3, 1)
+    t = t + f8(i, 1, 2, 3, 4, 5, 6, 7)
+    c = C(i, 1, 2, 3)
+    t = t + c.m3(1, 2, 3)
+    t = t + c.m5(2, 1, 1, 1, 1)
+    m = c.m5
+    t = t + m(1, 2, 3, 4, 5)
+print t
+
+print f4(1.5, 2, 3, 0.5), f8("a", "b", "c", "d", "e", "f", "g", "h")
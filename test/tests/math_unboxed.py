@@ -0,0 +1,20 @@
+# math functions called on unboxed floats and ints, including after math.sqrt gets replaced.
+
+import math
+
+def f(x, n):
+    t = 0.0
+    for i in xrange(n):
+        y = x + i
+        t = t + math.sqrt(y) + math.sqrt(i) * math.tan(0.25)
+    return t
+
+print f(2.0, 10000)
+print f(0.5, 100)
+print math.sqrt(16), math.sqrt(2.25), math.tan(0)
+
+def fake_sqrt(x):
+    return 7
+
+math.sqrt = fake_sqrt
+print f(2.0, 100)
@@ -0,0 +1,22 @@
+# An attribute lookup that sees lots of different classes eventually stops getting rewritten,
+# and just goes through the slowpath from then on; it should keep getting the right answers.
+
+classes = []
+for i in xrange(20):
+    class C(object):
+        pass
+    C.n = i
+    classes.append(C)
+
+def get(o):
+    return o.n
+
+t = 0
+for k in xrange(50):
+    for C in classes:
+        t = t + get(C())
+print t
+
+# Changing a class after the site has gone megamorphic still has to be seen:
+classes[3].n = 1000
+print get(classes[3]()), get(classes[4]())
@@ -0,0 +1,26 @@
+# Class attribute lookups that miss in the ICs go through a global cache;
+# make sure it notices when class attributes change.
+
+class A(object):
+    def f(self):
+        return 1
+
+class B(object):
+    def f(self):
+        return 2
+
+def g(self):
+    return 3
+
+def call_f(o):
+    return o.f()
+
+objs = [A(), B(), A(), B()]
+for i in xrange(100):
+    t = 0
+    for o in objs:
+        t = t + call_f(o)
+    if i == 50:
+        A.f = g
+    if i % 10 == 0:
+        print i, t
@@ -0,0 +1,39 @@
+# Mixed int/float arithmetic and comparisons, with the int on either side, run long enough that the
+# loops get compiled with both operands unboxed.
+
+def arith(n):
+    t = 0.0
+    for i in xrange(n):
+        x = i * 0.5
+        t = t + (i + x) - (x - i) + i * 0.25
+        t = t + i / 4.0 + 3 // (x + 1) + i % 2.5 + 2 ** (x / 1000)
+        t = t - (x // 3) + x % 4 + x / (i + 1)
+    return t
+
+def compare(n):
+    c = 0
+    for i in xrange(n):
+        x = i * 0.5
+        if i < x:
+            c = c + 1
+        if i <= x:
+            c = c + 2
+        if x > i:
+            c = c + 4
+        if x >= i:
+            c = c + 8
+        if i == x:
+            c = c + 16
+        if i != x:
+            c = c + 32
+    return c
+
+print arith(20000)
+print compare(20000)
+
+x = 7.5
+i = 2
+print i + x, x + i, i - x, x - i, i * x, x * i
+print i / x, x / i, i // x, x // i, i % x, x % i, i ** 0.5, x ** i
+print 7 // 2, 7.0 // 2, 7 // 2.0, -7 // 2.0, -7.5 // 2, 7 % -2.5, -7 % 2.5
+print i < x, i > x, i == 2.0, 2.0 == i, i != 2.0, i is 2.0
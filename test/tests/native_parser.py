@@ -0,0 +1,36 @@
+# Tokenizer and parser corner cases
+
+s = 'a\tb' "c\x41\101" r'\n' """tri
+ple""" + 'con\
+tinued'
+print s
+print len(s)
+
+x = 0x1F + 0o17 + 0b101 + 0777 + 10 + \
+    5
+print x
+print -9223372036854775807 - 1, 1e3, .5, 5.
+print 2 ** 3 ** 2, -2 ** 2, 7 // 2, 7 % 3, 1 << 4 | 1
+
+a = 1; b = 2;
+print a < b <= 2 != 3, not a or b and 0
+print (a,
+       b,  # comment in the middle
+
+       a)
+
+def f(x, y=2):
+    # comments at odd indentation
+        # are ignored
+    if x:
+        return x + y
+    elif y:
+	return y
+    else:
+        return 0
+print f(1), f(0), f(0, 0)
+
+s = "hello world"
+print s[1:3], s[6:], s[:5]
+print "a", "b",
+print "c"
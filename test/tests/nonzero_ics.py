@@ -0,0 +1,54 @@
+# Truthiness of the builtin types, both on values the jit knows the type of and through the nonzero IC,
+# and of objects that only define __len__.
+
+class L(object):
+    def __init__(self, n):
+        self.n = n
+
+    def __len__(self):
+        return self.n
+
+def count(vals):
+    t = 0
+    for v in vals:
+        if v:
+            t = t + 1
+    return t
+
+def known(n):
+    t = 0
+    l = []
+    d = {}
+    s = ""
+    for i in xrange(n):
+        if l:
+            t = t + 1
+        if d:
+            t = t + 10
+        if s:
+            t = t + 100
+        if not (i, i):
+            t = t + 1000
+        if "":
+            t = t + 10000
+        if None:
+            t = t + 100000
+        if i % 2:
+            l.append(i)
+            d[i] = i
+            s = "x"
+        else:
+            l = []
+            d = {}
+            s = ""
+    return t
+
+vals = [None, 0, 1, 0.0, 2.5, "", "a", [], [1], (), (1,), {}, {1:2}, True, False, L(0), L(3)]
+total = 0
+for i in xrange(1000):
+    total = total + count(vals)
+print total
+print known(10000)
+for v in vals:
+    print bool(v), not v,
+print
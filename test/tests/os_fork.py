@@ -0,0 +1,31 @@
+# run_args: -B -T compile_threads=2
+# Prefork-style: warm up in the parent, then have the children run the (already compiled) code
+# and report back through their exit statuses.
+import os
+
+def work(n):
+    t = 0
+    for i in xrange(n):
+        t = t + i * i
+    return t
+
+for i in xrange(2000):
+    work(50)
+
+print "warmed up"
+
+pids = []
+for i in xrange(4):
+    pid = os.fork()
+    if pid == 0:
+        # Keep calling it, so the child has to start its own compile threads if it wants anything reoptimized:
+        for j in xrange(2000):
+            work(10)
+        os._exit(work(10 * (i + 1)) % 256)
+    pids.append(pid)
+
+for i in xrange(len(pids)):
+    pid, status = os.waitpid(pids[i], 0)
+    print i, pid == pids[i], os.WEXITSTATUS(status)
+
+print os.getpid() != pids[0]
@@ -0,0 +1,22 @@
+# run_args: -P minimal=early_cse,licm,loop_deletion,gvn,simplifycfg -P moderate= -P maximal=inline,instcombine,simplifycfg
+# Custom per-effort-level optimization pipelines shouldn't change what the code does.
+
+def f(n):
+    t = 0
+    for i in xrange(n):
+        if i % 3 == 0:
+            t = t + i * 2
+        else:
+            t = t - 1
+    return t
+
+def g(l):
+    r = []
+    for x in l:
+        r.append((x, x + 1))
+    return len(r), r[-1]
+
+for i in xrange(2000):
+    f(20)
+    g(range(5))
+print f(1000), g(range(100))
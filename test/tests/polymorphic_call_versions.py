@@ -0,0 +1,21 @@
+# Calling the same function with arguments of different classes, from the same call site, so that it
+# ends up with several versions that have to be picked between.
+
+def f(x, y):
+    return x + y
+
+def g(x):
+    return x
+
+args = [(1, 2), (1.5, 2.5), ("a", "b"), (3, 4), ([1], [2]), (2.0, 1.0)]
+for i in xrange(200):
+    for a in args:
+        r = f(a[0], a[1])
+        if i == 199:
+            print r
+
+for i in xrange(1000):
+    x = g(i)
+    y = g(str(i))
+    z = g(i * 0.5)
+print x, y, z
@@ -0,0 +1,31 @@
+# Instances whose __init__ sets more attributes than fit inside the object get
+# their attribute list preallocated; check objects that outgrow the prediction too.
+
+class C(object):
+    def __init__(self, n):
+        self.a0 = n
+        self.a1 = n + 1
+        self.a2 = n + 2
+        self.a3 = n + 3
+        self.a4 = n + 4
+        self.a5 = n + 5
+        self.a6 = n + 6
+        self.a7 = n + 7
+        self.a8 = n + 8
+        self.a9 = n + 9
+        if n % 3 == 0:
+            self.a10 = n + 10
+            self.a11 = n + 11
+
+def total(o):
+    return o.a0 + o.a5 + o.a8 + o.a9
+
+objs = []
+for i in xrange(30):
+    o = C(i)
+    if i % 5 == 0:
+        o.extra = i
+    objs.append(o)
+
+for o in objs:
+    print total(o), getattr(o, "a11", None), getattr(o, "extra", None)
@@ -0,0 +1,18 @@
+# print writes ints, floats, bools and strs straight out; everything else goes through str().
+
+def p(x):
+    print x
+
+for x in [1, -20, 1.5, 1.0 / 3, True, False, "abc", "", None, [1, "a"], (1, 2)]:
+    p(x)
+
+class C(object):
+    def __str__(self):
+        return "C!"
+p(C())
+
+print 1, 2.5, "x", True,
+print
+for i in xrange(5000):
+    print i,
+print
@@ -0,0 +1,38 @@
+# run_args: -T interpreted_calls=200,minimal_calls=50,moderate_calls=50
+# Small functions get inlined into MAXIMAL-effort callers at call sites that only ever called them;
+# the inlined code has to keep working once the call site starts seeing something else.
+
+def add(a, b):
+    return a + b
+
+def caller(x):
+    return add(x, 1) + add(x, 2.5)
+
+def fib(n):
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+
+def describe(o):
+    if o:
+        return "yes"
+    return "no"
+
+def caller2(o):
+    return describe(o)
+
+t = 0
+for i in xrange(2000):
+    t = t + caller(i)
+    caller2(i)
+print t
+print fib(20)
+print caller(9223372036854775807)
+print caller2(0), caller2([1])
+
+def add(a, b):
+    return a * b
+print caller(10)
+
+describe = len
+print caller2("four")
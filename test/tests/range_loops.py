@@ -0,0 +1,23 @@
+# range() builds unboxed int lists directly; xrange() handles negative steps.
+
+print range(5), range(2, 7), range(0, 10, 3), range(10, 0, -3)
+print range(0), range(5, 2), range(2, 5, -1), range(-3, 3)
+l = range(3)
+l.append("x")
+print l
+
+t = 0
+for i in range(100):
+    t = t + i
+print t
+
+for i in xrange(10, 0, -2):
+    print i
+for i in xrange(0, -5, -1):
+    print i
+for i in xrange(5, 5):
+    print "never"
+t = 0
+for i in xrange(20, 1, -3):
+    t = t + i
+print t
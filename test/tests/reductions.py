@@ -0,0 +1,33 @@
+# run_args: -T interpreted_calls=2,minimal_calls=5,moderate_calls=20
+# sum/min/max/any/all over int and float lists, object lists, tuples, xranges and other iterables; sum(xrange(...))
+# gets worked out inline once the function is hot enough, until sum gets rebound.
+
+print sum([]), sum([1, 2, 3]), sum([1, 2, 3], 10), sum([1.5, 2.5]), sum([1.5, 2.5], 1), sum([0.5], 0.25)
+print sum([1, 2.5, 3])
+print sum((1, 2, 3)), sum({1: 2, 3: 4}), sum(set([5, 6]))
+print sum([9223372036854775807, 1]), sum([9223372036854775807, 1, -1])
+print sum(xrange(10)), sum(xrange(10), 5), sum(xrange(5, 0, -1)), sum(xrange(0)), sum(xrange(3, 3))
+print sum(xrange(-7, 8, 3)), sum(xrange(100, -100, -7)), sum(xrange(10000000000, 10000000010))
+
+print min([3, 1, 2]), max([3, 1, 2]), min([2.5, -1.5]), max([2.5, -1.5])
+print min(["b", "a", "c"]), max(["b", "a", "c"]), min([1, 0.5, 2]), max([1, 0.5, 2])
+print min((4, 5)), max({1: 0, 7: 0}), min(xrange(5)), max(xrange(5)), min(xrange(10, 0, -3)), max(xrange(10, 0, -3))
+print min(3, 4), max(3, 4), min("a", "b")
+
+print any([]), any([0, 0]), any([0, 1]), any([0.0]), any([0.0, 0.5]), any([None, ""]), any([None, "x"])
+print all([]), all([1, 2]), all([1, 0]), all([1.5]), all([1.5, 0.0]), all(["x", [1]]), all(["x", []])
+print any(xrange(0)), any(xrange(1)), any(xrange(1, 2)), any(xrange(0, 5))
+print all(xrange(0)), all(xrange(1, 5)), all(xrange(-5, 5)), all(xrange(-5, 5, 2)), all(xrange(6, -6, -3)), all(xrange(6, -6, -4))
+print any((0, 0, 3)), all((1, 1, 0)), any({0: 1}), all(set([1, 2]))
+
+def f(n):
+    return sum(xrange(n)) + sum(xrange(1, n, 3)) - sum(xrange(n, 0, -2))
+
+t = 0
+for i in xrange(100):
+    t = t + f(i)
+print t
+
+def sum(l):
+    return 42
+print f(10)
@@ -0,0 +1,16 @@
+# run_args: -S /tmp/pyston_sampling_profile.txt
+# The profile itself depends on timing, so just make sure that running with the sampler on doesn't change anything.
+
+def inner(n):
+    t = 0
+    for i in xrange(n):
+        t = t + i % 7
+    return t
+
+def outer(n):
+    t = 0
+    for i in xrange(20):
+        t = t + inner(n)
+    return t
+
+print outer(100000)
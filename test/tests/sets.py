@@ -0,0 +1,82 @@
+# Sets: building them from the different kinds of iterables, add/discard/remove, the set operations, and
+# `in` / `not in` on sets and the other builtin containers, in loops long enough to get compiled.
+
+def sorted_elts(s):
+    l = []
+    for x in s:
+        l.append(x)
+    l.sort()
+    return l
+
+s = set()
+print len(s), 1 in s, 1 not in s
+for i in xrange(100):
+    s.add(i % 37)
+print len(s), 5 in s, 40 in s, 40 not in s
+s.discard(5)
+s.discard(5)
+s.remove(6)
+print len(s), 5 in s, 6 in s, 7 in s
+
+# Lots of removals, so that the table has to get compacted:
+t = set()
+for i in xrange(10000):
+    t.add(i)
+    if i >= 10:
+        t.discard(i - 10)
+print len(t), sorted_elts(t)
+
+names = set(["a", "b", "c", "b", "a"])
+print len(names), "a" in names, "d" in names, sorted_elts(names)
+print sorted_elts(set((3, 1, 2, 3))), sorted_elts(set({1: 2, 3: 4}))
+print sorted_elts(set(xrange(5)))
+
+a = set([1, 2, 3, 4])
+b = set([3, 4, 5])
+print sorted_elts(a | b), sorted_elts(a & b), sorted_elts(a - b), sorted_elts(b - a)
+print sorted_elts(a.union([9, 1])), sorted_elts(a.intersection((2, 4, 6))), sorted_elts(a.difference(b))
+print a == set([4, 3, 2, 1]), a == b, a != b, a.issubset(set(xrange(10))), b.issubset(a)
+c = a.copy()
+c.add(10)
+print len(a), len(c), 10 in a, 10 in c
+print set([1]), set(), bool(set()), bool(a)
+
+def count_hits(n):
+    evens = set()
+    for i in xrange(0, n, 2):
+        evens.add(i)
+    hits = 0
+    for i in xrange(n):
+        if i in evens:
+            hits = hits + 1
+        if i not in evens:
+            hits = hits + 100
+    return hits
+print count_hits(20000)
+
+def containers(n):
+    l = [1, 2, 3]
+    fl = [1.5, 2.5]
+    t = (4, "x", None)
+    d = {"k": 1, 2: 3}
+    st = "hello world"
+    c = 0
+    for i in xrange(n):
+        if (i % 5) in l:
+            c = c + 1
+        if (i % 5) not in t:
+            c = c + 2
+        if "k" in d:
+            c = c + 4
+        if (i % 3) in d:
+            c = c + 8
+        if "wor" in st:
+            c = c + 16
+        if "z" not in st:
+            c = c + 32
+        if 2.5 in fl:
+            c = c + 64
+    return c
+print containers(20000)
+
+print 2 in [1, 2], "x" in ("x",), None in [None], "" in "abc", "abc" in "ab"
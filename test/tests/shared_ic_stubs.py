@@ -0,0 +1,70 @@
+# run_args: -X -n
+# With -X, getattr ICs whose rewrites come out identical call a shared copy of the code: check that the
+# sites that share a stub still get the right values when its guards fail (other attribute orders, other
+# classes), and after an invalidation clears the slots that call it.
+# (This is pyston-only, hence the .expected file.)
+
+import pyston_stats
+
+class C(object):
+    def __init__(self, n, flip):
+        # The other order gives the instances a different hidden class, which the guards have to catch:
+        if flip:
+            self.b = n * 2
+            self.a = n
+        else:
+            self.a = n
+            self.b = n * 2
+
+class D(object):
+    def __init__(self, n):
+        self.b = n
+        self.a = n * 3
+
+# Separate functions, so that they each have their own ic, all doing the same thing:
+def get_a1(o):
+    return o.a
+
+def get_a2(o):
+    return o.a
+
+def get_a3(o):
+    return o.a
+
+def get_a4(o):
+    return o.a
+
+def total(objs):
+    t = 0
+    for o in objs:
+        t = t + get_a1(o) + get_a2(o) + get_a3(o) + get_a4(o)
+    return t
+
+cs = []
+flipped = []
+ds = []
+for i in xrange(100):
+    cs.append(C(i, False))
+    flipped.append(C(i, True))
+    ds.append(D(i))
+
+print total(cs)
+print pyston_stats.get("ic_shared_stub_uses") > 0
+
+print total(flipped)
+print total(ds)
+
+mixed = []
+for i in xrange(100):
+    mixed.append(cs[i])
+    mixed.append(ds[i])
+    mixed.append(flipped[i])
+print total(mixed), total(mixed)
+
+# Setting __getattr__ on the class invalidates the getattr ics that depend on it, which clears the slots
+# that call the stubs; the instances still have their own a:
+def fallback(self, attr):
+    return -1
+C.__getattr__ = fallback
+print total(cs), total(mixed)
+print cs[5].missing
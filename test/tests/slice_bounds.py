@@ -0,0 +1,28 @@
+# Slicing lists and strs with int bounds (which doesn't need a slice object when their types are known),
+# with negative and missing bounds and steps, plus slice objects themselves.
+
+def f(l, s, i):
+    a = l[1:i]
+    b = l[-i:]
+    c = l[::2]
+    d = l[i:1:-1]
+    e = s[:i]
+    g = s[i:-1]
+    h = s[::-1]
+    return len(a) + len(b) + len(c) + len(d) + len(e) + len(g) + len(h)
+
+l = range(10)
+s = "hello world"
+total = 0
+for i in xrange(5000):
+    total = total + f(l, s, i % 12)
+print total
+
+print l[2:5], l[-3:], l[:-7], l[::3], l[8:2:-2], l[100:], l[-100:2]
+print s[2:5], s[-3:], s[:-7], s[::3], s[8:2:-2], s[100:], s[-100:2]
+
+class C(object):
+    def __getitem__(self, sl):
+        return sl
+sl = C()[1:5:2]
+print sl, sl.start, sl.stop, sl.step
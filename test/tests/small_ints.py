@@ -0,0 +1,12 @@
+# Small ints come from a preallocated cache; check values on both sides of its edges.
+
+for i in xrange(-10, 10):
+    print i, i + 1, i * i, -i
+
+for i in xrange(1015, 1030):
+    print i, i - 1020, i + 1, len(range(i % 7))
+
+t = 0
+for i in xrange(5000):
+    t = t + (i % 2000) - 3
+print t
@@ -0,0 +1,23 @@
+# statcheck: stats.get("num_instancemethods", 0) < 10
+
+# The runtime calls special methods like these directly, without creating a bound method each time.
+
+class C(object):
+    def __init__(self, n):
+        self.n = n
+    def __nonzero__(self):
+        return self.n % 2 == 0
+    def __repr__(self):
+        return "C(%d)" % self.n
+    def __hash__(self):
+        return self.n
+
+t = 0
+for i in xrange(1000):
+    c = C(i)
+    if c:
+        t = t + 1
+    s = repr(c)
+    s = str(c)
+    t = t + hash(c)
+print t, s
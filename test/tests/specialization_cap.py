@@ -0,0 +1,28 @@
+# run_args: -V 2
+# Once a function has been called with enough different argument types, it gets a generic version,
+# which has to keep handling all of the types that come after that.
+
+class C(object):
+    def __init__(self, n):
+        self.n = n
+
+    def __add__(self, rhs):
+        return self.n + rhs.n
+
+def add(x, y):
+    return x + y
+
+def f(x):
+    return x
+
+for i in xrange(100):
+    a = add(i, 1)
+    b = add(0.5, i * 1.0)
+    c = add("x", str(i))
+    d = add([i], [])
+    e = add((i,), (1,))
+    g = add(C(i), C(2))
+    h = add(1 << 40, i)
+print a, b, c, d, e, g, h
+
+print f(1), f(1.5), f("s"), f(None), f([]), f(()), f(True), f(C(3)).n
@@ -0,0 +1,29 @@
+# run_args: -T interpreted_calls=2,minimal_calls=5,moderate_calls=200,speculation_budget=1
+# With a budget of one speculation, only one of the (equally well-observed) attribute loads below
+# gets speculated on; the others have to stay boxed, and the results shouldn't change.
+
+class P(object):
+    pass
+
+def f(p, n):
+    t = 0.0
+    i = 0
+    while i < n:
+        t = t + p.x * p.y + p.z
+        i = i + 1
+    return t
+
+p = P()
+p.x = 1.5
+p.y = 2.0
+p.z = 0.25
+total = 0.0
+for j in xrange(1000):
+    total = total + f(p, 3)
+print total
+
+# Now make the speculated-on types wrong:
+p.x = 2
+p.y = 3
+p.z = 1
+print f(p, 3)
@@ -0,0 +1,22 @@
+# run_args: -T interpreted_calls=200,minimal_calls=50,moderate_calls=50
+# Tuples that only get unpacked can live on the stack; they still have to hold onto their elements.
+
+def f(n):
+    p = (n, [n] * 3)
+    t = 0
+    for i in xrange(n):
+        a, b = p
+        l = [i] * 10
+        t = t + a + len(b) + len(l)
+    return t
+
+def g(n):
+    p = (n, "x" * n)
+    for i in xrange(n):
+        a, b = p
+    return a, b
+
+for i in xrange(300):
+    r = f(i)
+print r
+print g(5)
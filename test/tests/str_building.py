@@ -0,0 +1,12 @@
+# str concatenation, repeat, join and formatting all go through the same string builder.
+
+s = ""
+for i in xrange(200):
+    s = s + str(i % 10)
+print len(s), s[:20]
+
+print "ab" * 5, "" * 3, len("xyz" * 100)
+print ", ".join(["a", "b", "c"]), "".join([]), "-".join(["1", "2", "3"])
+print "%s and %d and %f, 100%%" % ("x", 42, 1.5), "%05d|% 4d|%.2f" % (7, 3, 2.345)
+print "no format args here" % ()
+print [1, "a", [2.5]], (1,), (1, "b"), {"k": [1, 2]}
@@ -0,0 +1,29 @@
+# "..." % args with a constant format: unboxed ints and floats, boxed args, single non-tuple args, %%,
+# and the flags, in a loop long enough to get compiled.
+
+def f(n):
+    total = 0
+    last = ""
+    for i in xrange(n):
+        x = i * 0.5
+        s = "%d: %s, %f|%5d|%.3d|%03d|%.2f|%% %s" % (i, i, x, i, i, i, x, "done")
+        total = total + len(s)
+        last = s
+        s = "%s and %s" % (x, [i])
+        total = total + len(s)
+        s = "%d" % i
+        total = total + len(s)
+        s = "%f" % i
+        total = total + len(s)
+        s = "%s%%" % x
+        total = total + len(s)
+    print last
+    return total
+
+print f(20000)
+
+x = 1.5
+print "%s %f %d %s" % (x, x, 3, None)
+print "[%s]" % "abc", "[%s]" % True, "%d%%" % 50, "% 5f" % 2.25, "%010f|" % (0.1,)
+print "no args" % (), "%s" % ((1, 2),)
+print "%s-%s" % (1, (2, 3))
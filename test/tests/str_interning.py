@@ -0,0 +1,19 @@
+# Identifier-like string constants are interned, and strings cache their hashes.
+
+def f():
+    return "hello_world"
+
+print f() is f(), f() == "hello_" + "world", "hello_" + "world" == f()
+print "a b" == "a b", "abc" == "abd", "x" * 3 == "xxx"
+
+d = {}
+keys = []
+for i in xrange(100):
+    k = "key" + str(i)
+    keys.append(k)
+    d[k] = i
+t = 0
+for j in xrange(10):
+    for k in keys:
+        t = t + d[k]
+print t, hash("abc") == hash("ab" + "c")
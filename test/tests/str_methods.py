@@ -0,0 +1,28 @@
+# find / split / replace / strip / lower / upper, with strings long enough to go through the vectorized
+# parts as well as the leftovers.
+
+s = "The Quick Brown Fox Jumps Over The Lazy Dog, 0123456789 [@`{] and \xc0\xe0"
+print repr(s.lower())
+print repr(s.upper())
+print s.lower().upper() == s.upper()
+print "".lower(), "aB".upper()
+
+print s.find("Fox"), s.find("The"), s.find("dog"), s.find(""), s.find("g"), s.find("\xe0"), "abc".find("abcd")
+
+print "a,b,,c,".split(","), "a::b::c".split("::"), "".split(","), "abc".split("abcd")
+print "  hello   world\tfoo\n".split(), "".split(), "   ".split(), "x y".split(None)
+
+print "aaaa".replace("a", "bb"), "abcabc".replace("bc", ""), "abc".replace("", "-"), "abc".replace("x", "y")
+print repr(s.replace("The", "A"))
+
+print "[" + "  hi there\t\n".strip() + "]", "[" + "xxhixx".strip("x") + "]", "[" + "   ".strip() + "]"
+print "[" + "abc".strip("cab") + "]", "[" + " a ".strip(None) + "]"
+
+def f(n):
+    t = 0
+    line = "alpha,beta,gamma,delta,epsilon"
+    for i in xrange(n):
+        parts = line.split(",")
+        t = t + len(parts) + line.find("delta") + len(line.upper().replace("A", "aa").strip("E"))
+    return t
+print f(20000)
@@ -0,0 +1,11 @@
+# Character indexing and single-character slices hand out shared strings.
+
+s = "hello world, this is a longer string for slicing"
+print s[0], s[-1], s[1:5], s[6:], s[:5], s[3:3], s[::2], s[::-1], s[4:5], s[10:2:-3]
+print s[0] is s[0], s[0] == "h", chr(104) == s[0]
+
+t = 0
+for i in xrange(len(s)):
+    if s[i] == " ":
+        t = t + 1
+print t
@@ -0,0 +1,36 @@
+# run_args: -J
+# The INTERPRETED tier running as generated calls into the interpreter (threaded dispatch) instead of the interpreter loop.
+
+def sign(x):
+    if x < 0:
+        return -1
+    elif x == 0:
+        return 0
+    return 1
+
+def noreturn(l):
+    l.append(len(l))
+
+def loop(n):
+    t = 0
+    i = 0
+    while i < n:
+        if i % 3 == 0:
+            t = t + i
+        else:
+            t = t - 1
+        i = i + 1
+    return t
+
+l = []
+for i in xrange(30):
+    print sign(i - 15),
+    noreturn(l)
+print
+print len(l), l[-1]
+
+# Long enough to OSR out of the baseline code, and called enough times to get reoptimized:
+print loop(1000)
+for i in xrange(20):
+    print loop(i),
+print
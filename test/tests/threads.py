@@ -0,0 +1,31 @@
+# Threads: each one does some work (long enough to get jitted, and to hit the safepoints while the
+# others are waiting), and the main thread sleeps until they're all done.
+
+import thread
+import time
+
+nthreads = 4
+results = [None] * nthreads
+done = [0]
+
+def work(n, scale):
+    t = 0
+    for i in xrange(20000):
+        t = t + i * scale
+    l = []
+    for i in xrange(1000):
+        l.append(str(i))
+    results[n] = (t, len(l))
+    done[0] = done[0] + 1
+
+for i in xrange(nthreads):
+    thread.start_new_thread(work, (i, i + 1))
+
+while done[0] < nthreads:
+    time.sleep(0.01)
+
+for r in results:
+    print r
+
+time.sleep(0)
+print "done"
@@ -0,0 +1,17 @@
+# run_args: -T interpreted_calls=2,minimal_calls=5,moderate_calls=20,interpreted_backedges=5,minimal_backedges=50,osr_effort=moderate
+# Low tiering thresholds, so that every function goes through all the effort levels (and the
+# loops OSR out) within a few calls.
+
+def f(x, y):
+    return x * y + x
+
+def loop(n):
+    t = 0
+    for i in xrange(n):
+        t = t + f(i, 2)
+    return t
+
+for i in xrange(40):
+    print loop(i * 10),
+print
+print f(3, 4), f("a", 2), f(1.5, 2)
@@ -0,0 +1,31 @@
+# The high-resolution timers, called enough times to get compiled at the top tier, where they get called
+# without boxing their results.  (This is pyston-only, hence the .expected file.)
+
+import time
+
+def spin(n):
+    t = 0.0
+    for i in xrange(n):
+        t = t + i * 0.5
+    return t
+
+def measure(n):
+    ok = 0
+    for i in xrange(n):
+        t0 = time.perf_counter()
+        m0 = time.monotonic()
+        spin(10)
+        t1 = time.perf_counter()
+        m1 = time.monotonic()
+        if t1 >= t0 and m1 >= m0:
+            ok = ok + 1
+    return ok
+
+print measure(20000)
+print type(time.perf_counter()), type(time.monotonic()), type(time.time())
+print time.perf_counter is time.monotonic
+
+start = time.perf_counter()
+time.sleep(0.01)
+print time.perf_counter() - start >= 0.01
+print time.time() > 1400000000
@@ -0,0 +1,37 @@
+# Gives the heap's empty blocks back to the OS in the middle of a program, and checks that everything that was
+# still alive survives it and that the heap keeps working afterwards.
+# (This is pyston-only, hence the .expected file.)
+
+import pyston_stats
+
+class C(object):
+    pass
+
+def make_garbage(n):
+    for i in xrange(n):
+        l = [C(), C(), C()]
+        l[0].x = i
+
+keep = []
+for i in xrange(1000):
+    c = C()
+    c.x = i
+    keep.append(c)
+
+make_garbage(100000)
+
+n = pyston_stats.trim_heap()
+print n >= 0
+print pyston_stats.trim_heap() >= 0
+
+total = 0
+for c in keep:
+    total = total + c.x
+print len(keep), total
+
+# The released blocks should get reused (or new ones mapped in) without any trouble:
+make_garbage(100000)
+more = []
+for i in xrange(1000):
+    more.append(str(i))
+print more[0], more[999], keep[999].x
@@ -0,0 +1,65 @@
+# Tuples as dict and set keys: equal tuples have to hash the same, whether or not they're the same object,
+# and compare equal element by element.
+
+def pair(a, b):
+    return (a, b)
+
+d = {}
+for i in xrange(5):
+    for j in xrange(3):
+        d[pair(i, j)] = i * 10 + j
+print len(d), d[(2, 1)], d[pair(4, 2)], (0, 0) in d, (5, 0) in d, (1,) in d
+
+names = {}
+names[("a", "b")] = 1
+names[("a", "b" + "")] = 2
+names[("x", 1, 2.5)] = 3
+names[(("n", 1), ("m", 2))] = 4
+print len(names), names[("a", "b")], names[("x", 1, 2.5)], names[(("n", 1), ("m", 2))]
+print ("a", "c") in names, ("x", 1, 2.5, None) in names, () in names
+
+s = set()
+s.add((1, 2))
+s.add((1, 2))
+s.add((2, 1))
+s.add(())
+print len(s), (1, 2) in s, (1, 3) in s, () in s
+
+t1 = (1, "two", (3, 4.0))
+t2 = (1, "tw" + "o", (3, 4.0))
+print hash(t1) == hash(t2), hash(t1) == hash(t1), hash(()) == hash(())
+print t1 == t2, t1 != t2, t1 == t1, (1, 2) == (1, 2, 3), (1, 2) != (1, 3), () == ()
+print (1, 2) == (1.0, 2), (None,) == (None,), (1, "a") == ("a", 1)
+print (1, 2) < (1, 3), (1, 2) < (1, 2, 0), (2,) > (1, 5), (1, 2) <= (1, 2), (1, 2) >= (1, 3), ("a", 1) < ("b", 0)
+
+class C(object):
+    def __init__(self, n):
+        self.n = n
+    def __eq__(self, rhs):
+        return self.n == rhs.n
+    def __hash__(self):
+        return self.n
+print (C(1), 2) == (C(1), 2), (C(1), 2) == (C(2), 2)
+c = C(7)
+print hash((c, 1)) == hash((C(7), 1)), (c, 1) == (c, 1)
+
+# Equal objects whose classes don't define __hash__ still hash by identity, so the cached hashes can't
+# decide equality:
+class E(object):
+    def __init__(self, n):
+        self.n = n
+    def __eq__(self, rhs):
+        return self.n == rhs.n
+a = (E(1),)
+b = (E(1),)
+hash(a)
+hash(b)
+print a == b, a != b
+
+# Floats hash the same as the ints they're equal to (and bools hash like ints):
+f = {}
+f[(1, 2)] = "ints"
+print f[(1.0, 2.0)], f[(1, 2.0)], (1.5, None) in f
+f[(0.5, None, 0)] = "mixed"
+print f[(1.0 / 2, None, 0.0)], hash(3.0) == hash(3), hash(-7.0) == hash(-7), hash(True) == hash(1), hash(None) == hash(None)
+print hash(0.25) == hash(0.25), len(set([1, 1.0, 2.5, 2.5]))
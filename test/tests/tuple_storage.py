@@ -0,0 +1,12 @@
+# Tuple elements live inside the tuple object; make sure they survive collections.
+
+l = []
+for i in xrange(20000):
+    l.append((i, str(i), [i]))
+
+t = 0
+for i in xrange(0, 20000, 1000):
+    e = l[i]
+    t = t + e[0] + len(e[1]) + e[2][0]
+print t, len(l[5]), l[19999]
+print (), (1,), (1, 2) < (1, 3), "%s-%d" % ("a", 5)
@@ -0,0 +1,24 @@
+# The lower tiers record the classes they see, and the higher tiers speculate on them;
+# make sure we still do the right thing once the types stop matching what was recorded.
+
+class C(object):
+    def __init__(self, n):
+        self.n = n
+
+def get(o):
+    return o.n
+
+def f(o, i):
+    x = get(o) * i
+    y = o.n + 1
+    return x + y
+
+t = 0
+c = C(3)
+for i in xrange(2000):
+    t = t + f(c, i)
+print t
+
+print f(C(2.5), 2)
+print f(C(1 << 40), 1 << 30)
+print get(C("ab")) * 2
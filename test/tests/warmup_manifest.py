@@ -0,0 +1,30 @@
+# run_args: -B -W /tmp/pyston_test_warmup_manifest
+# The first run writes out which versions got hot, and later runs compile those at that level from
+# the start (while a MINIMAL version runs, since this is on the background threads); either way the
+# results have to be the same.
+
+def f(x):
+    return x * 3 - 1
+
+def g(x, y):
+    return f(x) + f(y) * 2
+
+def h(s, n):
+    l = []
+    for i in xrange(n):
+        l.append(s)
+    return len(l)
+
+t = 0
+for i in xrange(20000):
+    t = t + g(i, i + 1)
+print t
+
+print h("a", 10), h("b", 1000)
+t = 0
+for i in xrange(3000):
+    t = t + h("c", 3)
+print t
+
+# Same function, new argument types:
+print g(1.5, 2.5)
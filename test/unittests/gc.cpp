@@ -1,4 +1,5 @@
 #include <memory>
+#include <thread>
 #include <vector>
 #include <unordered_set>
 
@@ -91,6 +92,41 @@ TEST(gc, freeing) {
     }
 }
 
+TEST(gc, threadCaches) {
+    const int NTHREADS = 4, N = 20000;
+    std::vector<int*> allocd[NTHREADS];
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NTHREADS; t++) {
+        threads.push_back(std::thread([t, &allocd]() {
+            for (int i = 0; i < N; i++) {
+                int* p = static_cast<int*>(gc_alloc(16 + (i % 4) * 16));
+                p[0] = t;
+                p[1] = i;
+                allocd[t].push_back(p);
+            }
+        }));
+    }
+    for (auto &t : threads)
+        t.join();
+
+    std::unordered_set<int*> seen;
+    for (int t = 0; t < NTHREADS; t++) {
+        for (int i = 0; i < N; i++) {
+            int* p = allocd[t][i];
+            ASSERT_EQ(0, seen.count(p));
+            seen.insert(p);
+            ASSERT_EQ(t, p[0]);
+            ASSERT_EQ(i, p[1]);
+        }
+    }
+
+    // These are all in blocks that belong to the other threads' caches:
+    for (int t = 0; t < NTHREADS; t++) {
+        for (int* p : allocd[t])
+            gc_free(p);
+    }
+}
+
 TEST(gc, freeingLarge) {
     for (int i = 0; i < 100000; i++) {
         void* a = gc_alloc(1<<24);
@@ -98,3 +134,96 @@ TEST(gc, freeingLarge) {
     }
 }
 
+
+TEST(gc, reallocCopyIsYoung) {
+    for (int size = 16; size < (1 << 14); size *= 2) {
+        void* a = gc_alloc(size);
+        setMark(a);
+
+        void* b = gc_realloc(a, size * 4);
+        ASSERT_NE(a, b);
+        ASSERT_FALSE(isMarked(b));
+        gc_free(b);
+    }
+}
+
+TEST(gc, objectBitsStartClear) {
+    for (int size = 16; size < (1 << 14); size *= 2) {
+        // The second round gets allocated where the first one's objects were, which have to have
+        // had their bits cleared when they got freed:
+        for (int round = 0; round < 2; round++) {
+            std::vector<void*> allocd;
+            for (int i = 0; i < 100; i++) {
+                void* p = gc_alloc(size);
+                ASSERT_FALSE(isMarked(p));
+                ASSERT_FALSE(isRemembered(p));
+                ASSERT_FALSE(isFinalizable(p));
+                ASSERT_FALSE(isFinalizationPending(p));
+
+                setMark(p);
+                setRemembered(p);
+                setFinalizable(p);
+                setFinalizationPending(p);
+                allocd.push_back(p);
+            }
+
+            for (void* p : allocd)
+                gc_free(p);
+        }
+    }
+}
+
+TEST(gc, largeInteriorPointers) {
+    std::vector<char*> allocd;
+    for (int i = 0; i < 100; i++) {
+        allocd.push_back((char*)gc_alloc(10000 + i * 100));
+    }
+
+    // free every other one so there are holes between the remaining objects
+    for (int i = 0; i < 100; i += 2) {
+        gc_free(allocd[i]);
+    }
+
+    for (int i = 1; i < 100; i += 2) {
+        char* p = allocd[i];
+        int size = 10000 + i * 100;
+        ASSERT_EQ(p, global_heap.getAllocationFromInteriorPointer(p));
+        ASSERT_EQ(p, global_heap.getAllocationFromInteriorPointer(p + size / 2));
+        ASSERT_EQ(p, global_heap.getAllocationFromInteriorPointer(p + size - 1));
+        ASSERT_TRUE(global_heap.getAllocationFromInteriorPointer(p + size + 4096) == NULL);
+    }
+
+    for (int i = 1; i < 100; i += 2) {
+        gc_free(allocd[i]);
+    }
+}
+
+TEST(gc, marksDontTouchObjects) {
+    for (int size : {16, 256, 2048, 1 << 16}) {
+        char* a = (char*)gc_alloc(size);
+        memset(a, 0xab, size);
+
+        setMark(a);
+        ASSERT_TRUE(isMarked(a));
+        for (int i = 0; i < size; i++) {
+            ASSERT_EQ((char)0xab, a[i]);
+        }
+
+        // freed memory has to come back unmarked:
+        gc_free(a);
+        ASSERT_FALSE(isMarked(a));
+    }
+}
+
+TEST(gc, sizeClassLookup) {
+    for (size_t size = 1; size <= MAX_SMALL_SIZE; size++) {
+        int expected = 0;
+        while (sizes[expected] < size)
+            expected++;
+        ASSERT_EQ(expected, bucket_for_atoms[(size + ATOM_SIZE - 1) / ATOM_SIZE]);
+
+        void* a = gc_alloc(size);
+        ASSERT_EQ(sizes[expected], global_heap.getAllocationSize(a));
+        gc_free(a);
+    }
+}
@@ -0,0 +1,350 @@
+// Microbenchmarks for the allocator and the collector.  These go straight at gc::Heap and the
+// collection functions, so they can be used to look at changes there without the noise of the rest
+// of the runtime.  They're gtest tests so that they can share the unittest infrastructure, but they
+// live in their own binary (unittests/gc_bench, "make run_gcbench") since they take a while.
+//
+// Each benchmark prints a line of results; use --gtest_filter to pick which ones to run.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "core/common.h"
+#include "core/stats.h"
+#include "gc/collector.h"
+#include "gc/gc_alloc.h"
+
+using namespace pyston;
+using namespace pyston::gc;
+
+// The synthetic objects that the benchmarks build graphs out of: a header and some child pointers.
+struct Node {
+    GCObjectHeader header;
+    int nchildren;
+    Node* children[0];
+};
+
+static void nodeGCHandler(GCVisitor *visitor, void* p) {
+    Node* n = static_cast<Node*>(p);
+    for (int i = 0; i < n->nchildren; i++) {
+        if (n->children[i])
+            visitor->visit(n->children[i]);
+    }
+}
+static const AllocationKind node_kind(&nodeGCHandler, NULL);
+
+static Node* allocNode(int nchildren, size_t extra_bytes=0) {
+    Node* n = static_cast<Node*>(gc_alloc(sizeof(Node) + nchildren * sizeof(Node*) + extra_bytes));
+    new (&n->header) GCObjectHeader(&node_kind);
+    n->nchildren = nchildren;
+    memset(n->children, 0, nchildren * sizeof(Node*));
+    return n;
+}
+
+static void setChild(Node* parent, int i, Node* child) {
+    assert(i < parent->nchildren);
+    parent->children[i] = child;
+    writeBarrier(parent, child);
+}
+
+// Everything the benchmarks want to keep alive hangs off of this.  Collections can happen during
+// any allocation, so the graphs are always kept reachable from here while they get built.
+#define ROOT_SLOTS 16
+static Node* benchRoot() {
+    static Node* root = NULL;
+    if (!root) {
+        root = allocNode(ROOT_SLOTS);
+        registerStaticRootObj(root);
+    }
+    return root;
+}
+
+static void clearRoot() {
+    Node* root = benchRoot();
+    for (int i = 0; i < ROOT_SLOTS; i++)
+        root->children[i] = NULL;
+    runCollection();
+}
+
+static double nowSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Like google-benchmark: runs fn(iters) with more and more iterations, until a run takes long
+// enough to be measured reliably, and reports the time per iteration.
+#define MIN_BENCH_SECONDS 0.2
+static double runBenchmark(const std::string &name, const std::function<void(long)> &fn) {
+    long iters = 1;
+    while (true) {
+        double start = nowSeconds();
+        fn(iters);
+        double elapsed = nowSeconds() - start;
+
+        if (elapsed >= MIN_BENCH_SECONDS || iters >= (1L << 40)) {
+            double ns = elapsed * 1e9 / iters;
+            printf("%-40s %12ld iters %12.1f ns/iter %10.2f M/s\n", name.c_str(), iters, ns, 1e3 / ns);
+            return ns;
+        }
+        // try to land at about 1.5 * MIN_BENCH_SECONDS the next time:
+        double mult = elapsed > 0 ? 1.5 * MIN_BENCH_SECONDS / elapsed : 100;
+        iters = std::max(iters + 1, (long)(iters * std::min(mult, 100.0)));
+    }
+}
+
+static long statValue(const char* name) {
+    for (auto &p : Stats::snapshot()) {
+        if (p.first == name)
+            return p.second;
+    }
+    return 0;
+}
+
+// Doesn't need to be good, just cheap and deterministic:
+static uint64_t rand_state = 88172645463325252ULL;
+static uint64_t nextRand() {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+    return rand_state;
+}
+
+// Allocates BATCH objects of a size class and then frees them, so that the numbers include
+// getting fresh blocks and not just popping things off of a free list.
+#define BATCH 1000
+TEST(gc_bench, allocFreeBySizeClass) {
+    Node* batch = allocNode(BATCH);
+    setChild(benchRoot(), 0, batch);
+
+    for (int b = 0; b < NUM_BUCKETS; b++) {
+        size_t size = sizes[b];
+        ASSERT_GE(size, sizeof(Node));
+        char name[80];
+        snprintf(name, sizeof(name), "alloc_free/%ld", size);
+
+        runBenchmark(name, [=](long iters) {
+            for (long done = 0; done < iters; done += BATCH) {
+                int n = std::min((long)BATCH, iters - done);
+                for (int i = 0; i < n; i++)
+                    setChild(batch, i, allocNode(0, size - sizeof(Node)));
+                for (int i = 0; i < n; i++) {
+                    gc_free(batch->children[i]);
+                    batch->children[i] = NULL;
+                }
+            }
+        });
+    }
+
+    clearRoot();
+}
+
+// Keeps a window of large objects of varying sizes alive, freeing the oldest one for every new one.
+#define LARGE_WINDOW 64
+TEST(gc_bench, largeObjectChurn) {
+    Node* window = allocNode(LARGE_WINDOW);
+    setChild(benchRoot(), 0, window);
+
+    for (size_t max_size : {64L << 10, 1L << 20, 4L << 20}) {
+        char name[80];
+        snprintf(name, sizeof(name), "large_churn/up_to_%ldKB", max_size >> 10);
+
+        runBenchmark(name, [=](long iters) {
+            for (long i = 0; i < iters; i++) {
+                int slot = i % LARGE_WINDOW;
+                if (window->children[slot]) {
+                    gc_free(window->children[slot]);
+                    window->children[slot] = NULL;
+                }
+                size_t size = MAX_SMALL_SIZE + 1 + nextRand() % (max_size - MAX_SMALL_SIZE);
+                setChild(window, slot, allocNode(0, size));
+            }
+            for (int slot = 0; slot < LARGE_WINDOW; slot++) {
+                if (window->children[slot]) {
+                    gc_free(window->children[slot]);
+                    window->children[slot] = NULL;
+                }
+            }
+        });
+    }
+
+    clearRoot();
+}
+
+#define INTERIOR_OBJS 100000
+#define INTERIOR_LOOKUPS 1000
+TEST(gc_bench, interiorPointerLookups) {
+    for (bool large : {false, true}) {
+        int nobjs = large ? INTERIOR_OBJS / 100 : INTERIOR_OBJS;
+        Node* objs = allocNode(nobjs);
+        setChild(benchRoot(), 0, objs);
+
+        std::vector<size_t> obj_sizes;
+        for (int i = 0; i < nobjs; i++) {
+            size_t size;
+            if (large)
+                size = MAX_SMALL_SIZE + 1 + nextRand() % (256 << 10);
+            else
+                size = sizes[nextRand() % NUM_BUCKETS];
+            setChild(objs, i, allocNode(0, size - std::min(size, sizeof(Node))));
+            obj_sizes.push_back(std::max(size, sizeof(Node)));
+        }
+
+        // Pick the pointers ahead of time so that the loop is just the lookups:
+        std::vector<char*> ptrs, expected;
+        for (int i = 0; i < INTERIOR_LOOKUPS; i++) {
+            int idx = nextRand() % nobjs;
+            char* start = (char*)objs->children[idx];
+            ptrs.push_back(start + nextRand() % obj_sizes[idx]);
+            expected.push_back(start);
+        }
+        for (int i = 0; i < INTERIOR_LOOKUPS; i++)
+            ASSERT_EQ(expected[i], global_heap.getAllocationFromInteriorPointer(ptrs[i]));
+
+        runBenchmark(large ? "interior_ptr/large" : "interior_ptr/small", [&](long iters) {
+            for (long done = 0; done < iters; done += INTERIOR_LOOKUPS) {
+                int n = std::min((long)INTERIOR_LOOKUPS, iters - done);
+                for (int i = 0; i < n; i++) {
+                    void* r = global_heap.getAllocationFromInteriorPointer(ptrs[i]);
+                    asm volatile("" : : "r"(r));
+                }
+            }
+        });
+
+        clearRoot();
+    }
+
+    // Conservative scanning mostly looks at things that aren't heap pointers at all:
+    std::vector<char*> misses;
+    std::vector<char> not_heap(INTERIOR_LOOKUPS);
+    for (int i = 0; i < INTERIOR_LOOKUPS; i++) {
+        misses.push_back(i % 2 ? &not_heap[i] : (char*)(nextRand() & 0x7fffffffffffL));
+    }
+    runBenchmark("interior_ptr/miss", [&](long iters) {
+        for (long done = 0; done < iters; done += INTERIOR_LOOKUPS) {
+            int n = std::min((long)INTERIOR_LOOKUPS, iters - done);
+            for (int i = 0; i < n; i++) {
+                void* r = global_heap.getAllocationFromInteriorPointer(misses[i]);
+                asm volatile("" : : "r"(r));
+            }
+        }
+    });
+    for (int i = 1; i < INTERIOR_LOOKUPS; i += 2)
+        ASSERT_TRUE(global_heap.getAllocationFromInteriorPointer(misses[i]) == NULL);
+}
+
+// The graph shapes for the mark benchmarks.  They all build about n nodes into benchRoot()'s slot,
+// keeping everything reachable as they go.
+static void buildList(int slot, long n) {
+    Node* root = benchRoot();
+    for (long i = 0; i < n; i++) {
+        Node* node = allocNode(1);
+        setChild(node, 0, root->children[slot]);
+        setChild(root, slot, node);
+    }
+}
+
+static void buildTree(Node* parent, int slot, int depth) {
+    Node* node = allocNode(depth > 0 ? 2 : 0);
+    setChild(parent, slot, node);
+    if (depth > 0) {
+        buildTree(node, 0, depth - 1);
+        buildTree(node, 1, depth - 1);
+    }
+}
+
+static void buildWide(int slot, long n) {
+    Node* array = allocNode(n);
+    setChild(benchRoot(), slot, array);
+    for (long i = 0; i < n; i++)
+        setChild(array, i, allocNode(0));
+}
+
+// Every node points at a few random older ones, so the trace has no locality to speak of.
+#define RANDOM_EDGES 4
+static void buildRandom(int slot, long n) {
+    Node* array = allocNode(n);
+    setChild(benchRoot(), slot, array);
+    for (long i = 0; i < n; i++) {
+        Node* node = allocNode(RANDOM_EDGES);
+        for (int j = 0; j < RANDOM_EDGES && i > 0; j++)
+            setChild(node, j, array->children[nextRand() % i]);
+        setChild(array, i, node);
+    }
+}
+
+static void buildShape(const std::string &shape, int slot, long n) {
+    if (shape == "list") {
+        buildList(slot, n);
+    } else if (shape == "tree") {
+        int depth = 0;
+        while ((2L << depth) - 1 < n)
+            depth++;
+        buildTree(benchRoot(), slot, depth);
+    } else if (shape == "wide") {
+        buildWide(slot, n);
+    } else if (shape == "random") {
+        buildRandom(slot, n);
+    } else {
+        RELEASE_ASSERT(0, "%s", shape.c_str());
+    }
+}
+
+struct CollectionTimes {
+    double pause_us, mark_us;
+};
+
+// Full collections of whatever's currently live; returns the medians.
+static CollectionTimes timeCollections(int n) {
+    // Gets rid of the garbage from building the graph, and finishes off any incremental mark:
+    runCollection();
+    runCollection();
+
+    std::vector<double> pauses, marks;
+    for (int i = 0; i < n; i++) {
+        long mark_before = statValue("gc_mark_us");
+        double start = nowSeconds();
+        runCollection();
+        pauses.push_back((nowSeconds() - start) * 1e6);
+        marks.push_back(statValue("gc_mark_us") - mark_before);
+    }
+    std::sort(pauses.begin(), pauses.end());
+    std::sort(marks.begin(), marks.end());
+    return CollectionTimes{pauses[n / 2], marks[n / 2]};
+}
+
+#define MARK_NODES 1000000
+TEST(gc_bench, markThroughputByShape) {
+    for (const char* shape : {"list", "tree", "wide", "random"}) {
+        buildShape(shape, 0, MARK_NODES);
+        CollectionTimes t = timeCollections(5);
+        printf("%-40s %12d nodes %12.0f us pause %10.2f M nodes/s marked\n", (std::string("mark/") + shape).c_str(),
+                MARK_NODES, t.pause_us, t.mark_us > 0 ? MARK_NODES / t.mark_us : 0.0);
+        clearRoot();
+    }
+}
+
+TEST(gc_bench, pauseVsLiveHeapSize) {
+    for (long mb : {1, 4, 16, 64}) {
+        // Random graphs of mostly-small objects, with a large one now and then:
+        long n = (mb << 20) / (sizeof(Node) + RANDOM_EDGES * sizeof(Node*) + sizeof(Node*));
+        buildRandom(0, n);
+
+        long nlarge = n / 1000;
+        Node* large = allocNode(nlarge);
+        setChild(benchRoot(), 1, large);
+        for (long i = 0; i < nlarge; i++)
+            setChild(large, i, allocNode(0, MAX_SMALL_SIZE + nextRand() % (16 << 10)));
+
+        CollectionTimes t = timeCollections(5);
+        char name[80];
+        snprintf(name, sizeof(name), "pause/live_%ldMB", mb);
+        printf("%-40s %12ld nodes %12.0f us pause %10.1f us/MB\n", name, n + nlarge, t.pause_us, t.pause_us / mb);
+        clearRoot();
+    }
+}
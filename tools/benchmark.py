@@ -0,0 +1,235 @@
+#!/usr/bin/env python
+
+#
+# This file is distributed under the MIT License; see LICENSE for details.
+#
+
+# Runs the benchmarks a number of times each, every time in a fresh process, and reports the wall
+# time, peak RSS and the runtime's stats (which include the gc_* ones).  Compile time shows up in those
+# stats, which is what the warmup / steady state split is based on: "warmup" is the time spent
+# starting up, parsing and compiling, "steady" is the rest of the wall time.
+#
+# Usage:
+#   benchmark.py [-R|-P] [-n runs] [-w warmup_runs] [-a jit_arg] [-o out.json] [-c baseline.json] [-T pct] [patterns]
+#
+# Benchmarks that have a native version next to them (foo.cpp, built into foo.native by "make bench_native")
+# get that timed too, and the pyston / native ratio reported; that ratio is the number to track.
+#
+# With -c, every benchmark gets compared against the baseline's, and the script exits with an error if
+# any of them got slower by more than the threshold (-T, 5% by default) with 95% confidence.
+
+import datetime
+import getopt
+import glob
+import json
+import math
+import os
+import re
+import subprocess
+import sys
+import time
+
+IMAGE = "pyston_dbg"
+NUM_RUNS = 5
+WARMUP_RUNS = 1
+EXTRA_JIT_ARGS = []
+THRESHOLD_PCT = 5.0
+BENCH_DIRS = ["../benchmarks", "../microbenchmarks"]
+
+WARMUP_STATS = ["us_startup", "us_parsing", "us_compiling"]
+
+def run_process(args):
+    start = time.time()
+    p = subprocess.Popen(args, stdout=subprocess.PIPE, stdin=open("/dev/null"))
+    out = p.stdout.read()
+    # wait4 (unlike wait) gets us the child's own peak rss:
+    _, status, rusage = os.wait4(p.pid, 0)
+    elapsed = time.time() - start
+    p.returncode = status
+
+    if os.WIFSIGNALED(status) or os.WEXITSTATUS(status) != 0:
+        raise Exception("%s failed with status %d:\n%s" % (' '.join(args), status, out))
+    return out, elapsed, rusage
+
+def run_native(fn):
+    out, elapsed, rusage = run_process([fn])
+    return {"wall": elapsed, "rss_kb": rusage.ru_maxrss}
+
+def run_once(fn):
+    out, elapsed, rusage = run_process(["./%s" % IMAGE, "-q", "-s"] + EXTRA_JIT_ARGS + [fn])
+
+    assert "Stats:" in out, out
+    stats = {}
+    for l in out.rsplit("Stats:", 1)[1].strip().split('\n'):
+        k, v = l.rsplit(':', 1)
+        stats[k.strip()] = int(v)
+
+    warmup = sum(stats.get(s, 0) for s in WARMUP_STATS) / 1000000.0
+    return {
+        "wall": elapsed,
+        "warmup": warmup,
+        "steady": max(0.0, elapsed - warmup),
+        "rss_kb": rusage.ru_maxrss,
+        "stats": stats,
+    }
+
+# Two-sided 95% critical values of Student's t distribution, by degrees of freedom:
+T_95 = [None, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042]
+def t_95(df):
+    df = int(df)
+    if df < 1:
+        return float("inf")
+    if df < len(T_95):
+        return T_95[df]
+    return 1.96
+
+def mean(l):
+    return sum(l) / float(len(l))
+
+def variance(l):
+    if len(l) < 2:
+        return 0.0
+    m = mean(l)
+    return sum((x - m) ** 2 for x in l) / (len(l) - 1)
+
+def summarize(l):
+    m = mean(l)
+    half = t_95(len(l) - 1) * math.sqrt(variance(l) / len(l))
+    return {"mean": m, "stdev": math.sqrt(variance(l)), "min": min(l), "max": max(l), "ci95": [m - half, m + half]}
+
+def compare(base, new):
+    # Welch's t-interval for the difference of the means, as a percentage of the baseline:
+    mb, mn = mean(base), mean(new)
+    vb, vn = variance(base) / len(base), variance(new) / len(new)
+    se = math.sqrt(vb + vn)
+    if se == 0:
+        df = len(base) + len(new) - 2
+    else:
+        df = (vb + vn) ** 2 / ((vb ** 2 / max(1, len(base) - 1)) + (vn ** 2 / max(1, len(new) - 1)))
+    half = t_95(df) * se
+    diff = mn - mb
+    return 100.0 * diff / mb, 100.0 * (diff - half) / mb, 100.0 * (diff + half) / mb
+
+def git_rev():
+    try:
+        return subprocess.check_output(["git", "rev-parse", "HEAD"], stderr=open("/dev/null", 'w')).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+if __name__ == "__main__":
+    out_fn = None
+    baseline_fn = None
+
+    opts, patterns = getopt.getopt(sys.argv[1:], "RPn:w:a:o:c:T:")
+    for (t, v) in opts:
+        if t == '-R':
+            IMAGE = "pyston"
+        elif t == '-P':
+            IMAGE = "pyston_prof"
+        elif t == '-n':
+            NUM_RUNS = int(v)
+            assert NUM_RUNS >= 2, "need at least two runs to say anything about the variance"
+        elif t == '-w':
+            WARMUP_RUNS = int(v)
+        elif t == '-a':
+            EXTRA_JIT_ARGS.append(v)
+        elif t == '-o':
+            out_fn = v
+        elif t == '-c':
+            baseline_fn = v
+        elif t == '-T':
+            THRESHOLD_PCT = float(v)
+        else:
+            raise Exception((t, v))
+
+    benchmarks = []
+    for d in BENCH_DIRS:
+        benchmarks += sorted(glob.glob("%s/*.py" % d))
+    if patterns:
+        benchmarks = [b for b in benchmarks if any(re.match("%s.*\.py" % p, os.path.basename(b)) for p in patterns)]
+    if not benchmarks:
+        print >>sys.stderr, "No benchmarks specified!"
+        sys.exit(1)
+
+    print "Building...",
+    sys.stdout.flush()
+    subprocess.check_call(["make", "-j4", IMAGE, "bench_native"], stdout=open("/dev/null", 'w'), stderr=subprocess.PIPE)
+    print "done"
+
+    results = {
+        "image": IMAGE,
+        "jit_args": EXTRA_JIT_ARGS,
+        "git_rev": git_rev(),
+        "date": datetime.datetime.now().isoformat(),
+        "runs": NUM_RUNS,
+        "warmup_runs": WARMUP_RUNS,
+        "benchmarks": {},
+    }
+
+    for fn in benchmarks:
+        name = os.path.basename(fn)[:-3]
+        print name.rjust(20),
+        sys.stdout.flush()
+
+        # These are about getting the binary and the benchmark into the page cache, not about the jit:
+        for i in xrange(WARMUP_RUNS):
+            run_once(fn)
+        runs = [run_once(fn) for i in xrange(NUM_RUNS)]
+
+        summary = {}
+        for k in ("wall", "warmup", "steady", "rss_kb"):
+            summary[k] = summarize([r[k] for r in runs])
+        results["benchmarks"][name] = {"runs": runs, "summary": summary}
+
+        s = summary["wall"]
+        line = "  %.3fs +- %.3fs (warmup %.3fs)   %dKB" % (s["mean"], s["ci95"][1] - s["mean"],
+                summary["warmup"]["mean"], summary["rss_kb"]["mean"])
+
+        native_fn = fn[:-3] + ".native"
+        if os.path.exists(native_fn):
+            for i in xrange(WARMUP_RUNS):
+                run_native(native_fn)
+            native_runs = [run_native(native_fn) for i in xrange(NUM_RUNS)]
+            native_summary = {}
+            for k in ("wall", "rss_kb"):
+                native_summary[k] = summarize([r[k] for r in native_runs])
+            ratio = s["mean"] / native_summary["wall"]["mean"]
+            steady_ratio = summary["steady"]["mean"] / native_summary["wall"]["mean"]
+            results["benchmarks"][name]["native"] = {"runs": native_runs, "summary": native_summary}
+            results["benchmarks"][name]["native_ratio"] = ratio
+            results["benchmarks"][name]["native_steady_ratio"] = steady_ratio
+            line += "   %.1fx native (%.1fx steady)" % (ratio, steady_ratio)
+        print line
+
+    if out_fn:
+        with open(out_fn, 'w') as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+
+    if baseline_fn:
+        baseline = json.load(open(baseline_fn))
+        regressions = []
+        print
+        print "Compared to %s (%s):" % (baseline_fn, baseline.get("git_rev"))
+        for name in sorted(results["benchmarks"]):
+            if name not in baseline["benchmarks"]:
+                print name.rjust(20), "  (not in the baseline)"
+                continue
+
+            line = name.rjust(20)
+            for k in ("wall", "steady", "rss_kb"):
+                base = [r[k] for r in baseline["benchmarks"][name]["runs"]]
+                new = [r[k] for r in results["benchmarks"][name]["runs"]]
+                pct, lo, hi = compare(base, new)
+                line += "   %s %+.1f%% [%+.1f%%, %+.1f%%]" % (k, pct, lo, hi)
+                if k == "wall" and lo > THRESHOLD_PCT:
+                    regressions.append(name)
+                    line += " \033[31mREGRESSED\033[0m"
+            if "native_ratio" in results["benchmarks"][name] and "native_ratio" in baseline["benchmarks"][name]:
+                line += "   %.1fx -> %.1fx native" % (baseline["benchmarks"][name]["native_ratio"], results["benchmarks"][name]["native_ratio"])
+            print line
+
+        if regressions:
+            print >>sys.stderr, "%d benchmark(s) got more than %.1f%% slower: %s" % (len(regressions), THRESHOLD_PCT, ", ".join(regressions))
+            sys.exit(1)
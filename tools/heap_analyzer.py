@@ -0,0 +1,201 @@
+# Works out what's keeping memory alive in a heap dump (from pyston_stats.dump_heap(), or the -D flag):
+# builds the dominator tree of the object graph, and adds up the retained size of each class and of
+# each allocation site, ie how much memory would get freed if the objects of that class (or from that
+# site) went away.  The sites only cover the allocations that the allocation profiler sampled, so
+# run with -a to get them.
+#
+# usage: python tools/heap_analyzer.py [--top N] dump_file
+
+import argparse
+import sys
+
+class HeapGraph(object):
+    def __init__(self):
+        # Node 0 is a made-up root that points to all of the real roots.
+        self.addrs = [None]
+        self.sizes = [0]
+        self.types = [-1]
+        self.sites = [-1]
+        self.edges = [[]]
+        self.type_names = {}
+        self.site_names = {}
+
+def parse(fn):
+    g = HeapGraph()
+    index = {}
+    pending_edges = []
+    roots = []
+
+    f = open(fn)
+    header = f.readline().split()
+    if header != ["pyston_heap_dump", "1"]:
+        raise Exception("%s isn't a heap dump (or is from a different version)" % fn)
+
+    for l in f:
+        w = l.split()
+        if not w:
+            continue
+        if w[0] == "t":
+            g.type_names[int(w[1])] = " ".join(w[2:])
+        elif w[0] == "s":
+            g.site_names[int(w[1])] = " ".join(w[2:])
+        elif w[0] == "r":
+            roots.append(w[1])
+        elif w[0] == "o":
+            index[w[1]] = len(g.addrs)
+            g.addrs.append(w[1])
+            g.sizes.append(int(w[2]))
+            g.types.append(int(w[3]))
+            g.sites.append(int(w[4]))
+            g.edges.append(None)
+            pending_edges.append(w[5:])
+        else:
+            raise Exception("unknown record type %r" % w[0])
+    f.close()
+
+    # Everything that gets pointed to has its own record, but not necessarily before the pointer to it:
+    for i, targets in enumerate(pending_edges):
+        g.edges[i + 1] = sorted(set(index[t] for t in targets))
+    g.edges[0] = sorted(set(index[r] for r in roots))
+    return g
+
+def reversePostorder(g):
+    n = len(g.addrs)
+    visited = [False] * n
+    order = []
+    visited[0] = True
+    stack = [(0, 0)]
+    while stack:
+        node, i = stack[-1]
+        if i < len(g.edges[node]):
+            stack[-1] = (node, i + 1)
+            child = g.edges[node][i]
+            if not visited[child]:
+                visited[child] = True
+                stack.append((child, 0))
+        else:
+            stack.pop()
+            order.append(node)
+    order.reverse()
+    return order
+
+# Cooper, Harvey and Kennedy's "A Simple, Fast Dominance Algorithm"; heap graphs are mostly shallow
+# and wide, which is where it does well.
+def immediateDominators(g, rpo):
+    n = len(g.addrs)
+    rpo_index = [-1] * n
+    for i, node in enumerate(rpo):
+        rpo_index[node] = i
+
+    preds = [[] for i in xrange(n)]
+    for node in rpo:
+        for child in g.edges[node]:
+            preds[child].append(node)
+
+    idom = [-1] * n
+    idom[0] = 0
+
+    def intersect(a, b):
+        while a != b:
+            while rpo_index[a] > rpo_index[b]:
+                a = idom[a]
+            while rpo_index[b] > rpo_index[a]:
+                b = idom[b]
+        return a
+
+    changed = True
+    while changed:
+        changed = False
+        for node in rpo[1:]:
+            new_idom = -1
+            for p in preds[node]:
+                if idom[p] == -1:
+                    continue
+                if new_idom == -1:
+                    new_idom = p
+                else:
+                    new_idom = intersect(p, new_idom)
+            if idom[node] != new_idom:
+                idom[node] = new_idom
+                changed = True
+    return idom
+
+def retainedSizes(g, rpo, idom):
+    retained = list(g.sizes)
+    # Children come after their dominators in reverse postorder:
+    for node in reversed(rpo[1:]):
+        retained[idom[node]] += retained[node]
+    return retained
+
+def summarize(g, rpo, idom, retained, key_of):
+    # An object's retained size counts towards its key unless one of its dominators has the same key,
+    # in which case it's already been counted as part of that one.
+    children = [[] for i in xrange(len(g.addrs))]
+    for node in rpo[1:]:
+        children[idom[node]].append(node)
+
+    totals = {}
+    on_path = {}
+    stack = [(0, False)]
+    while stack:
+        node, leaving = stack.pop()
+        key = key_of(node)
+        if leaving:
+            on_path[key] -= 1
+            continue
+
+        t = totals.setdefault(key, [0, 0, 0])
+        t[0] += 1
+        t[1] += g.sizes[node]
+        if not on_path.get(key, 0):
+            t[2] += retained[node]
+        on_path[key] = on_path.get(key, 0) + 1
+
+        stack.append((node, True))
+        for c in children[node]:
+            stack.append((c, False))
+
+    del totals[key_of(0)]
+    return sorted(totals.items(), key=lambda (k, t): -t[2])
+
+def printTable(title, rows, top):
+    print title
+    print "%10s %14s %14s  %s" % ("objects", "bytes", "retained", "")
+    for name, (count, shallow, retained) in rows[:top]:
+        print "%10d %14d %14d  %s" % (count, shallow, retained, name)
+    print
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Computes retained sizes from a pyston heap dump")
+    parser.add_argument("dump_file")
+    parser.add_argument("--top", type=int, default=30, help="how many rows to show in each table")
+    args = parser.parse_args()
+
+    g = parse(args.dump_file)
+    rpo = reversePostorder(g)
+    idom = immediateDominators(g, rpo)
+    retained = retainedSizes(g, rpo, idom)
+
+    print "%d objects, %d bytes, reachable from %d roots" % (len(g.addrs) - 1, sum(g.sizes), len(g.edges[0]))
+    print
+
+    def typeOf(node):
+        if node == 0:
+            return "<roots>"
+        return g.type_names[g.types[node]]
+    printTable("By class:", summarize(g, rpo, idom, retained, typeOf), args.top)
+
+    def siteOf(node):
+        if node == 0:
+            return "<roots>"
+        site = g.sites[node]
+        if site == -1:
+            return "<not sampled>"
+        return "%s (%s)" % (g.site_names[site], typeOf(node))
+    printTable("By allocation site (only the sampled allocations have one):", summarize(g, rpo, idom, retained, siteOf), args.top)
+
+    largest = sorted(xrange(1, len(g.addrs)), key=lambda n: -retained[n])[:args.top]
+    print "Largest single objects:"
+    print "%14s %18s  %s" % ("retained", "address", "class")
+    for n in largest:
+        print "%14d %18s  %s" % (retained[n], g.addrs[n], typeOf(n))
@@ -0,0 +1,112 @@
+#!/usr/bin/env python
+
+#
+# This file is distributed under the MIT License; see LICENSE for details.
+#
+
+# Tests the startup server: starts "<image> -Z" on a socket in a temporary directory, runs some scripts on it
+# through -z, and checks that they run in the client's working directory, that their stdout and stderr go to
+# the client's, and that the client exits with the scripts' exit codes.
+#
+# Usage: test_startup_server.py <image>
+
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+TIME_LIMIT = 10
+
+SCRIPTS = {
+    # Same script name (and helper module) in two directories, so that running the other
+    # directory's copy means the worker didn't pick up the client's cwd:
+    "a/main.py": "import helper\nprint 'a', helper.name\nprint 1 + 2\n",
+    "a/helper.py": "name = 'helper a'\n",
+    "b/main.py": "import helper\nprint 'b', helper.name\n",
+    "b/helper.py": "name = 'helper b'\n",
+    "b/raises.py": "print 'before the raise'\nraise ValueError('from the worker')\n",
+}
+
+# (cwd relative to the temporary directory, script, expected exit code, expected stdout, expected last line of stderr)
+RUNS = [
+    ("a", "main.py", 0, "a helper a\n3\n", ""),
+    ("b", "main.py", 0, "b helper b\n", ""),
+    # Relative to the client's cwd, the same as the script's own path:
+    ("", "a/main.py", 0, "a helper a\n3\n", ""),
+    ("b", "raises.py", 1, "before the raise\n", "ValueError: from the worker"),
+    # The server should still be serving after a script failed:
+    ("a", "main.py", 0, "a helper a\n3\n", ""),
+]
+
+def wait_for_server(server, sock):
+    # The socket file shows up before the server is listening on it, so wait until connecting works
+    # (the server drops connections that don't send a request):
+    start = time.time()
+    while True:
+        s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            s.connect(sock)
+            return
+        except socket.error:
+            pass
+        finally:
+            s.close()
+        if server.poll() is not None:
+            raise Exception("the startup server exited with code %d" % server.returncode)
+        if time.time() - start > TIME_LIMIT:
+            raise Exception("the startup server didn't start listening on %s" % sock)
+        time.sleep(0.05)
+
+def run_client(image, sock, cwd, fn):
+    p = subprocess.Popen([image, "-z", sock, fn], cwd=cwd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, stdin=open("/dev/null"))
+    out, err = p.communicate()
+    return p.wait(), out, err
+
+def main():
+    if len(sys.argv) != 2:
+        print >>sys.stderr, "Usage: %s <image>" % sys.argv[0]
+        sys.exit(1)
+    image = os.path.abspath(sys.argv[1])
+
+    tmpdir = tempfile.mkdtemp()
+    server = None
+    try:
+        for fn, contents in SCRIPTS.items():
+            path = os.path.join(tmpdir, fn)
+            if not os.path.isdir(os.path.dirname(path)):
+                os.makedirs(os.path.dirname(path))
+            open(path, 'w').write(contents)
+
+        sock = os.path.join(tmpdir, "server.sock")
+        # The server sits in a different directory than any of the clients:
+        server = subprocess.Popen([image, "-q", "-Z", sock], cwd="/", stdin=open("/dev/null"))
+        wait_for_server(server, sock)
+
+        for cwd, fn, expected_code, expected_out, expected_err in RUNS:
+            code, out, err = run_client(image, sock, os.path.join(tmpdir, cwd), fn)
+            err = err.strip().split('\n')[-1]
+            desc = "%s in %s" % (fn, cwd or ".")
+            if code != expected_code:
+                raise Exception("%s: exited with code %d (expected code %d)\n%s" % (desc, code, expected_code, err))
+            if out != expected_out:
+                raise Exception("%s: bad output: %r (expected %r)" % (desc, out, expected_out))
+            if err != expected_err:
+                raise Exception("%s: bad stderr: %r (expected %r)" % (desc, err, expected_err))
+            print "%s    Correct output" % desc.rjust(20)
+
+        if server.poll() is not None:
+            raise Exception("the startup server exited with code %d" % server.returncode)
+    finally:
+        if server is not None and server.poll() is None:
+            os.kill(server.pid, signal.SIGTERM)
+            server.wait()
+        shutil.rmtree(tmpdir)
+
+    print "All startup server runs passed"
+
+if __name__ == "__main__":
+    main()